@@ -1,9 +1,23 @@
 #include "devices/block.h"
 #include <list.h>
+#include <round.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/percpu.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
 
 /* A block device. */
 struct block {
@@ -12,14 +26,53 @@ struct block {
   char name[16];        /* Block device name. */
   enum block_type type; /* Type of block device. */
   block_sector_t size;  /* Size in sectors. */
+  int channel;          /* Controller channel, or -1 if unknown. */
 
   const struct block_operations* ops; /* Driver operations. */
   void* aux;                          /* Extra data owned by driver. */
 
-  unsigned long long read_cnt;  /* Number of sectors read. */
-  unsigned long long write_cnt; /* Number of sectors written. */
+  struct percpu_counter read_cnt;  /* Number of sectors read. */
+  struct percpu_counter write_cnt; /* Number of sectors written. */
+
+  struct lock queue_lock; /* Protects QUEUE and BUSY. */
+  struct semaphore work;  /* Up'd for each submission and completion. */
+  struct list queue;      /* Submitted struct block_requests, oldest first. */
+  struct list busy;       /* Requests started by an asynchronous driver. */
+  struct list done;       /* Of those, the completed ones.  Interrupts off. */
+
+  enum block_sched sched; /* I/O scheduler. */
+  block_sector_t head;    /* Sector after the last transfer. */
+  uint8_t* merge_buf;     /* MERGE_PAGES for merged transfers, or null. */
+
+  struct block_stats stats;     /* Latencies and depths.  Protected by QUEUE_LOCK. */
+  size_t depth;                 /* Requests queued or in flight. */
+  struct percpu_counter polled; /* Times poll_for_work() found work. */
 };
 
+/* Ticks that a request may wait before the deadline scheduler
+   carries it out ahead of the C-LOOK order. */
+#define BLOCK_DEADLINE (TIMER_FREQ / 2)
+
+/* Size of the buffer that merged requests are gathered into,
+   which bounds the sectors in one merged transfer. */
+#define MERGE_PAGES 8
+#define MERGE_SECTORS (MERGE_PAGES * PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Requests that must be queued or in flight on a device before
+   its driver polls for completions instead of sleeping until an
+   interrupt: the one being waited for and at least one more. */
+#define BLOCK_POLL_DEPTH 2
+
+/* Microseconds that block_async_worker() polls for before it goes
+   back to sleeping until an interrupt.  Long enough to catch a
+   fast device's next completion, short enough that a slow one
+   wastes little. */
+#define BLOCK_POLL_USEC 50
+
+/* Ticks of its rate that an I/O quota's bucket holds, which is
+   how much a process that has been idle may transfer at once. */
+#define IO_QUOTA_BURST (TIMER_FREQ / 4)
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 
@@ -27,6 +80,9 @@ static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 static struct block* block_by_role[BLOCK_ROLE_CNT];
 
 static struct block* list_elem_to_block(struct list_elem*);
+static thread_func block_worker;
+static thread_func block_async_worker;
+static void inherit_priority(struct block*, struct block_request*);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -63,23 +119,29 @@ struct block* block_next(struct block* block) {
 }
 
 /* Returns the block device with the given NAME, or a null
-   pointer if no block device has that name. */
+   pointer if no block device has that name.  Block devices are
+   never unregistered, so the result stays valid. */
 struct block* block_get_by_name(const char* name) {
+  struct block* found = NULL;
   struct list_elem* e;
 
+  rcu_read_lock();
   for (e = list_begin(&all_blocks); e != list_end(&all_blocks); e = list_next(e)) {
     struct block* block = list_entry(e, struct block, list_elem);
-    if (!strcmp(name, block->name))
-      return block;
+    if (!strcmp(name, block->name)) {
+      found = block;
+      break;
+    }
   }
+  rcu_read_unlock();
 
-  return NULL;
+  return found;
 }
 
-/* Verifies that SECTOR is a valid offset within BLOCK.
-   Panics if not. */
-static void check_sector(struct block* block, block_sector_t sector) {
-  if (sector >= block->size) {
+/* Verifies that the CNT sectors starting at SECTOR are valid
+   offsets within BLOCK.  Panics if not. */
+static void check_sectors(struct block* block, block_sector_t sector, size_t cnt) {
+  if (sector >= block->size || cnt > block->size - sector) {
     /* We do not use ASSERT because we want to panic here
          regardless of whether NDEBUG is defined. */
     PANIC("Access past end of device %s (sector=%" PRDSNu ", "
@@ -93,9 +155,7 @@ static void check_sector(struct block* block, block_sector_t sector) {
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void block_read(struct block* block, block_sector_t sector, void* buffer) {
-  check_sector(block, sector);
-  block->ops->read(block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple(block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -104,10 +164,639 @@ void block_read(struct block* block, block_sector_t sector, void* buffer) {
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void block_write(struct block* block, block_sector_t sector, const void* buffer) {
-  check_sector(block, sector);
-  ASSERT(block->type != BLOCK_FOREIGN);
-  block->ops->write(block->aux, sector, buffer);
-  block->write_cnt++;
+  block_write_multiple(block, sector, 1, buffer);
+}
+
+#ifdef USERPROG
+/* Takes CNT sectors' worth of bytes out of the running process's
+   I/O quota, if it has one, and sleeps until the quota has paid
+   for them. */
+static void io_quota_charge(size_t cnt) {
+  struct process* pcb = thread_current()->pcb;
+  struct io_quota* q;
+  enum intr_level old_level;
+  int64_t now, wait = 0;
+
+  if (pcb == NULL || pcb->io_quota.rate == 0)
+    return;
+  q = &pcb->io_quota;
+
+  old_level = intr_disable();
+  now = timer_ticks();
+  q->tokens += (now - q->refilled) * q->rate;
+  if (q->tokens > (int64_t)q->rate * IO_QUOTA_BURST)
+    q->tokens = (int64_t)q->rate * IO_QUOTA_BURST;
+  q->refilled = now;
+  q->tokens -= (int64_t)cnt * BLOCK_SECTOR_SIZE * TIMER_FREQ;
+  if (q->tokens < 0)
+    wait = DIV_ROUND_UP(-q->tokens, q->rate);
+  intr_set_level(old_level);
+
+  if (wait > 0) {
+    pcb->usage.io_throttle_ticks += wait;
+    timer_sleep(wait);
+  }
+}
+#endif
+
+/* Callback for the requests of transfer(), which wakes the
+   submitter. */
+static void transfer_done(struct block_request* req) { sema_up(req->aux); }
+
+/* Submits a request to move the CNT sectors starting at SECTOR
+   between BLOCK and BUFFER, to BLOCK if WRITE is true, with the
+   request's FLUSH and FUA members set to BARRIER, and waits for
+   it to complete. */
+static void transfer(struct block* block, bool write, block_sector_t sector, size_t cnt,
+                     void* buffer, bool barrier) {
+  struct block_request req;
+  struct semaphore done;
+  uint64_t start, cycles;
+
+  if (cnt == 0 && !barrier)
+    return;
+  sema_init(&done, 0);
+  req.block = block;
+  req.write = write;
+  req.flush = barrier;
+  req.fua = barrier && write;
+  req.sector = sector;
+  req.cnt = cnt;
+  req.buffer = buffer;
+  req.aux = &done;
+  req.waiter = thread_current();
+  start = rdtsc();
+#ifdef USERPROG
+  io_quota_charge(cnt);
+#endif
+  block_submit(&req, transfer_done);
+  sema_down(&done);
+
+  cycles = rdtsc() - start;
+  thread_current()->block_wait_cycles += cycles;
+#ifdef USERPROG
+  if (thread_current()->pcb != NULL)
+    thread_current()->pcb->usage.block_wait_cycles += cycles;
+#endif
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers can do this in fewer, larger transfers than
+   CNT calls to block_read().
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void block_read_multiple(struct block* block, block_sector_t sector, size_t cnt, void* buffer) {
+  transfer(block, false, sector, cnt, buffer, false);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void block_write_multiple(struct block* block, block_sector_t sector, size_t cnt,
+                          const void* buffer) {
+  transfer(block, true, sector, cnt, (void*)buffer, false);
+}
+
+/* Writes sector SECTOR to BLOCK from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes, as a barrier: every write to BLOCK
+   that completed before the call is durable before the sector
+   is, and the sector is durable when this returns.  For a commit
+   record that makes earlier writes count. */
+void block_write_barrier(struct block* block, block_sector_t sector, const void* buffer) {
+  transfer(block, true, sector, 1, (void*)buffer, true);
+}
+
+/* Makes every write to BLOCK that completed before the call
+   durable, by flushing the device's write cache, if it has one. */
+void block_flush(struct block* block) { transfer(block, false, 0, 0, NULL, true); }
+
+/* Charges a transfer of CNT sectors, to a block device if WRITE
+   is true and from one otherwise, to the running thread and its
+   process. */
+static void charge_caller(bool write, size_t cnt) {
+  struct thread* cur = thread_current();
+
+  if (write)
+    cur->block_write_bytes += cnt * BLOCK_SECTOR_SIZE;
+  else
+    cur->block_read_bytes += cnt * BLOCK_SECTOR_SIZE;
+#ifdef USERPROG
+  if (cur->pcb != NULL) {
+    if (write)
+      cur->pcb->usage.block_writes += cnt;
+    else
+      cur->pcb->usage.block_reads += cnt;
+  }
+#endif
+}
+
+/* Returns the log2 latency histogram bucket for CYCLES. */
+static int latency_bucket(uint64_t cycles) {
+  int bucket = 63 - __builtin_clzll(cycles | 1);
+  return bucket < BLOCK_LATENCY_BUCKETS ? bucket : BLOCK_LATENCY_BUCKETS - 1;
+}
+
+/* Charges REQ, which BLOCK's driver finished at time DONE, to
+   BLOCK's statistics.  BLOCK's queue_lock must be held. */
+static void account_request(struct block* block, struct block_request* req, uint64_t done) {
+  struct block_stats* s = &block->stats;
+  uint64_t queued = req->started - req->submitted;
+  uint64_t service = done - req->started;
+
+  s->requests++;
+  s->queue_cycles += queued;
+  s->service_cycles += service;
+  s->queue_hist[latency_bucket(queued)]++;
+  s->service_hist[latency_bucket(service)]++;
+  block->depth--;
+  TRACE(TRACE_BLOCK_DONE, req->sector, req->cnt | (uint32_t)req->write << 31);
+}
+
+/* Returns the memory holding the CNT sectors starting at SECTOR
+   of BLOCK, if BLOCK's driver keeps them in memory, so that the
+   caller can read them, or write them if WRITE is true, by
+   itself, or a null pointer if the driver does not.  Counts the
+   access in the statistics, but it does not go through BLOCK's
+   request queue, so the caller must not have requests for any
+   of those sectors queued. */
+void* block_map(struct block* block, block_sector_t sector, size_t cnt, bool write) {
+  void* p;
+
+  if (cnt == 0 || block->ops->map == NULL)
+    return NULL;
+  check_sectors(block, sector, cnt);
+  ASSERT(!write || block->type != BLOCK_FOREIGN);
+
+  p = block->ops->map(block->aux, sector, cnt);
+  if (p != NULL) {
+    if (write)
+      percpu_counter_add(&block->write_cnt, cnt);
+    else
+      percpu_counter_add(&block->read_cnt, cnt);
+    charge_caller(write, cnt);
+  }
+  return p;
+}
+
+/* Queues REQ, whose BLOCK, WRITE, FLUSH, FUA, SECTOR, CNT,
+   BUFFER, AUX and WAITER members the caller has filled in, on
+   REQ->block and returns without waiting for it.  CALLBACK is
+   called with REQ, in REQ->block's worker thread, after the
+   transfer is done.  The transfer is charged to the calling
+   process. */
+void block_submit(struct block_request* req, block_callback* callback) {
+  struct block* block = req->block;
+
+  ASSERT(req->cnt > 0 || (req->flush && !req->write));
+  ASSERT(!req->fua || req->write);
+  if (req->cnt > 0)
+    check_sectors(block, req->sector, req->cnt);
+  ASSERT(!req->write || block->type != BLOCK_FOREIGN);
+
+  req->callback = callback;
+  req->priority = thread_get_priority();
+  req->deadline = timer_ticks() + BLOCK_DEADLINE;
+  charge_caller(req->write, req->cnt);
+  TRACE(TRACE_BLOCK_SUBMIT, req->sector, req->cnt | (uint32_t)req->write << 31);
+
+  lock_acquire(&block->queue_lock);
+  block->stats.depth_hist[block->depth < BLOCK_DEPTH_BUCKETS ? block->depth
+                                                             : BLOCK_DEPTH_BUCKETS - 1]++;
+  block->depth++;
+  req->submitted = rdtsc();
+  list_push_back(&block->queue, &req->elem);
+  inherit_priority(block, req);
+  lock_release(&block->queue_lock);
+  sema_up(&block->work);
+}
+
+/* Initializes Q, the I/O quota of a new process, with the rate
+   of its parent's quota PARENT, or with no limit if PARENT is
+   null.  The bucket starts full. */
+void io_quota_init(struct io_quota* q, const struct io_quota* parent) {
+  q->rate = parent != NULL ? parent->rate : 0;
+  q->tokens = (int64_t)q->rate * IO_QUOTA_BURST;
+  q->refilled = timer_ticks();
+}
+
+/* Limits Q to RATE bytes per second.  Returns false without
+   changing anything if RATE is 0 or looser than Q's rate, since a
+   process may not lift a limit that it was started with.  A
+   process that had no limit starts with a full bucket. */
+bool io_quota_set(struct io_quota* q, uint32_t rate) {
+  enum intr_level old_level;
+
+  if (rate == 0 || (q->rate != 0 && rate > q->rate))
+    return false;
+  old_level = intr_disable();
+  if (q->rate == 0 || q->tokens > (int64_t)rate * IO_QUOTA_BURST) {
+    q->tokens = (int64_t)rate * IO_QUOTA_BURST;
+    q->refilled = timer_ticks();
+  }
+  q->rate = rate;
+  intr_set_level(old_level);
+  return true;
+}
+
+/* Called by an asynchronous driver, possibly from an interrupt
+   handler, when it is done with REQ, which it took in its start
+   operation.  REQ's callback then runs in the worker thread. */
+void block_complete(struct block_request* req) {
+  struct block* block = req->block;
+  enum intr_level old_level;
+
+  req->completed = rdtsc();
+  old_level = intr_disable();
+  list_push_back(&block->done, &req->done_elem);
+  intr_set_level(old_level);
+  sema_up(&block->work);
+}
+
+/* Returns true if REQ must wait for OLDER, an older request:
+   if they overlap and one of them writes, or if REQ flushes and
+   OLDER writes. */
+static bool conflict(const struct block_request* req, const struct block_request* older) {
+  if (req->flush && older->write)
+    return true;
+  return (req->write || older->write) && req->sector < older->sector + older->cnt &&
+         older->sector < req->sector + req->cnt;
+}
+
+/* Returns true if REQ, which is in BLOCK's queue, conflicts with
+   an older request in the queue, or with a request still in
+   flight, and so must wait for it.  BLOCK's queue_lock must be
+   held. */
+static bool must_wait(struct block* block, struct block_request* req) {
+  struct list_elem* e;
+
+  for (e = list_begin(&block->queue); e != &req->elem; e = list_next(e))
+    if (conflict(req, list_entry(e, struct block_request, elem)))
+      return true;
+  for (e = list_begin(&block->busy); e != list_end(&block->busy); e = list_next(e))
+    if (conflict(req, list_entry(e, struct block_request, elem)))
+      return true;
+  return false;
+}
+
+/* Returns REQ's priority: the priority it was submitted at or,
+   if higher, its waiter's current effective priority, which
+   includes what has been donated to the waiter since. */
+static int request_priority(const struct block_request* req) {
+  int priority = req->priority;
+
+  if (req->waiter != NULL && thread_get_priority_of(req->waiter) > priority)
+    priority = thread_get_priority_of(req->waiter);
+  return priority;
+}
+
+/* Raises each older request in BLOCK's queue that REQ, newly
+   queued, must wait for to REQ's priority, so that an urgent
+   request is not held up behind a write it overlaps that the
+   scheduler keeps passing over.  BLOCK's queue_lock must be
+   held. */
+static void inherit_priority(struct block* block, struct block_request* req) {
+  int priority = request_priority(req);
+  struct list_elem* e;
+
+  for (e = list_begin(&block->queue); e != &req->elem; e = list_next(e)) {
+    struct block_request* older = list_entry(e, struct block_request, elem);
+    if (conflict(req, older) && older->priority < priority)
+      older->priority = priority;
+  }
+}
+
+/* Returns the highest priority of a request in BLOCK's queue
+   that does not have to wait, or PRI_MIN - 1 if they all do.
+   BLOCK's queue_lock must be held. */
+static int top_priority(struct block* block) {
+  int top = PRI_MIN - 1;
+  struct list_elem* e;
+
+  for (e = list_begin(&block->queue); e != list_end(&block->queue); e = list_next(e)) {
+    struct block_request* req = list_entry(e, struct block_request, elem);
+    int priority = request_priority(req);
+    if (priority > top && !must_wait(block, req))
+      top = priority;
+  }
+  return top;
+}
+
+/* Returns the oldest request in BLOCK's queue of priority TOP
+   that does not have to wait, or a null pointer if there is
+   none.  BLOCK's queue_lock must be held. */
+static struct block_request* pick_oldest(struct block* block, int top) {
+  struct list_elem* e;
+
+  for (e = list_begin(&block->queue); e != list_end(&block->queue); e = list_next(e)) {
+    struct block_request* req = list_entry(e, struct block_request, elem);
+    if (request_priority(req) >= top && !must_wait(block, req))
+      return req;
+  }
+  return NULL;
+}
+
+/* Returns the request in BLOCK's queue of priority TOP that
+   C-LOOK carries out next: the one with the lowest sector at or
+   after BLOCK->head, if any, otherwise the one with the lowest
+   sector.  Skips requests that must wait.  BLOCK's queue_lock
+   must be held and the queue must not be empty. */
+static struct block_request* pick_clook(struct block* block, int top) {
+  struct block_request* ahead = NULL;
+  struct block_request* lowest = NULL;
+  struct list_elem* e;
+
+  for (e = list_begin(&block->queue); e != list_end(&block->queue); e = list_next(e)) {
+    struct block_request* req = list_entry(e, struct block_request, elem);
+    if (request_priority(req) < top || must_wait(block, req))
+      continue;
+    if (req->sector >= block->head && (ahead == NULL || req->sector < ahead->sector))
+      ahead = req;
+    if (lowest == NULL || req->sector < lowest->sector)
+      lowest = req;
+  }
+  return ahead != NULL ? ahead : lowest;
+}
+
+/* Returns the request in BLOCK's queue that BLOCK's scheduler
+   carries out next, among those of the highest priority that do
+   not have to wait, or a null pointer if every request has to
+   wait for one in flight.  With no requests in flight, the
+   oldest request never has to wait, so there always is one.
+   BLOCK's queue_lock must be held and the queue must not be
+   empty. */
+static struct block_request* pick_request(struct block* block) {
+  struct block_request* oldest = list_entry(list_front(&block->queue), struct block_request, elem);
+  struct block_request* req;
+  int top;
+
+  if (block->sched == BLOCK_SCHED_DEADLINE && timer_ticks() >= oldest->deadline)
+    return must_wait(block, oldest) ? NULL : oldest;
+
+  top = top_priority(block);
+  if (top < PRI_MIN)
+    return NULL;
+  switch (block->sched) {
+    case BLOCK_SCHED_NOOP:
+      req = pick_oldest(block, top);
+      break;
+    case BLOCK_SCHED_DEADLINE:
+    case BLOCK_SCHED_CLOOK:
+      req = pick_clook(block, top);
+      break;
+    default:
+      NOT_REACHED();
+  }
+  if (req != oldest && request_priority(req) > request_priority(oldest))
+    block->stats.urgent++;
+  return req;
+}
+
+/* Moves the requests in BLOCK's queue that continue the transfer
+   of FIRST, which has been taken off the queue, onto RUN, which
+   already holds FIRST, as long as they fit into BLOCK's merge
+   buffer.  A request that flushes first is never merged into a
+   run, since it must follow every older write.  Returns the
+   number of sectors in RUN.  BLOCK's queue_lock must be held. */
+static size_t merge_requests(struct block* block, struct block_request* first,
+                             struct list* run) {
+  size_t cnt = first->cnt;
+
+  if (block->sched == BLOCK_SCHED_NOOP || cnt == 0)
+    return cnt;
+  for (;;) {
+    struct block_request* next = NULL;
+    struct list_elem* e;
+
+    for (e = list_begin(&block->queue); e != list_end(&block->queue); e = list_next(e)) {
+      struct block_request* req = list_entry(e, struct block_request, elem);
+      if (req->write == first->write && !req->flush && req->sector == first->sector + cnt &&
+          cnt + req->cnt <= MERGE_SECTORS && !must_wait(block, req)) {
+        next = req;
+        break;
+      }
+    }
+    if (next == NULL)
+      return cnt;
+
+    if (block->merge_buf == NULL) {
+      block->merge_buf = palloc_get_multiple(0, MERGE_PAGES);
+      if (block->merge_buf == NULL)
+        return cnt;
+    }
+    list_remove(&next->elem);
+    list_push_back(run, &next->elem);
+    cnt += next->cnt;
+  }
+}
+
+/* Thread function for BLOCK_'s worker thread, which passes the
+   requests in its queue to the driver in the order that its
+   scheduler chooses, with runs of adjacent requests in the same
+   direction combined into one transfer, and calls their
+   callbacks.  Flushes the device's write cache before a run that
+   starts with a request with FLUSH set, and after one that
+   includes a write with FUA set, which drivers have no other way
+   to ask for. */
+static void block_worker(void* block_) {
+  struct block* block = block_;
+
+  for (;;) {
+    struct block_request* first;
+    struct list run;
+    struct list_elem* e;
+    uint64_t start, done;
+    size_t cnt;
+    bool fua = false;
+
+    sema_down(&block->work);
+    lock_acquire(&block->queue_lock);
+    if (list_empty(&block->queue)) {
+      /* Already carried out as part of an earlier, merged run. */
+      lock_release(&block->queue_lock);
+      continue;
+    }
+    first = pick_request(block);
+    list_remove(&first->elem);
+    list_init(&run);
+    list_push_back(&run, &first->elem);
+    cnt = merge_requests(block, first, &run);
+    lock_release(&block->queue_lock);
+
+    start = rdtsc();
+    for (e = list_begin(&run); e != list_end(&run); e = list_next(e)) {
+      struct block_request* req = list_entry(e, struct block_request, elem);
+      req->started = start;
+      fua = fua || req->fua;
+    }
+
+    if (first->flush && block->ops->flush != NULL)
+      block->ops->flush(block->aux);
+    if (cnt == 0) {
+      /* FIRST only flushes. */
+    } else if (cnt == first->cnt) {
+      if (first->write)
+        block->ops->write(block->aux, first->sector, cnt, first->buffer);
+      else
+        block->ops->read(block->aux, first->sector, cnt, first->buffer);
+    } else {
+      uint8_t* p;
+
+      if (first->write) {
+        for (e = list_begin(&run), p = block->merge_buf; e != list_end(&run); e = list_next(e)) {
+          struct block_request* req = list_entry(e, struct block_request, elem);
+          memcpy(p, req->buffer, req->cnt * BLOCK_SECTOR_SIZE);
+          p += req->cnt * BLOCK_SECTOR_SIZE;
+        }
+        block->ops->write(block->aux, first->sector, cnt, block->merge_buf);
+      } else {
+        block->ops->read(block->aux, first->sector, cnt, block->merge_buf);
+        for (e = list_begin(&run), p = block->merge_buf; e != list_end(&run); e = list_next(e)) {
+          struct block_request* req = list_entry(e, struct block_request, elem);
+          memcpy(req->buffer, p, req->cnt * BLOCK_SECTOR_SIZE);
+          p += req->cnt * BLOCK_SECTOR_SIZE;
+        }
+      }
+    }
+    if (fua && block->ops->flush != NULL)
+      block->ops->flush(block->aux);
+    if (first->write)
+      percpu_counter_add(&block->write_cnt, cnt);
+    else
+      percpu_counter_add(&block->read_cnt, cnt);
+    if (cnt > 0)
+      block->head = first->sector + cnt;
+
+    done = rdtsc();
+    lock_acquire(&block->queue_lock);
+    for (e = list_begin(&run); e != list_end(&run); e = list_next(e))
+      account_request(block, list_entry(e, struct block_request, elem), done);
+    lock_release(&block->queue_lock);
+
+    while (!list_empty(&run)) {
+      struct block_request* req = list_entry(list_pop_front(&run), struct block_request, elem);
+      req->callback(req);
+    }
+  }
+}
+
+/* Returns true if requests are waiting on BLOCK behind the one
+   its driver is working on, so that the driver is likely to
+   finish another soon and had better look for it than sleep.
+   The answer is a hint and may be out of date. */
+bool block_queue_deep(const struct block* block) { return block->depth >= BLOCK_POLL_DEPTH; }
+
+/* If BLOCK has several requests in flight and a driver that can
+   poll, polls it for up to BLOCK_POLL_USEC for a completion, or
+   for a new submission, and downs BLOCK's work semaphore for it.
+   Returns true if there is work, false if the caller should
+   sleep on the semaphore. */
+static bool poll_for_work(struct block* block) {
+  int usec;
+
+  if (block->ops->poll == NULL || list_empty(&block->busy) || !block_queue_deep(block))
+    return false;
+  for (usec = 0; usec < BLOCK_POLL_USEC; usec++) {
+    block->ops->poll(block->aux);
+    if (sema_try_down(&block->work)) {
+      percpu_counter_inc(&block->polled);
+      return true;
+    }
+    timer_udelay(1);
+  }
+  return false;
+}
+
+/* Thread function for the worker thread of BLOCK_, whose driver
+   is asynchronous.  Hands the driver as many requests as it will
+   take, in the order that BLOCK_'s scheduler chooses, without
+   merging them, since the driver can work on them at once, and
+   calls their callbacks as the driver completes them. */
+static void block_async_worker(void* block_) {
+  struct block* block = block_;
+
+  for (;;) {
+    if (!poll_for_work(block))
+      sema_down(&block->work);
+
+    /* Retire completed requests. */
+    for (;;) {
+      struct block_request* req;
+      enum intr_level old_level;
+
+      old_level = intr_disable();
+      req = (list_empty(&block->done)
+                 ? NULL
+                 : list_entry(list_pop_front(&block->done), struct block_request, done_elem));
+      intr_set_level(old_level);
+      if (req == NULL)
+        break;
+
+      lock_acquire(&block->queue_lock);
+      list_remove(&req->elem);
+      account_request(block, req, req->completed);
+      lock_release(&block->queue_lock);
+      if (req->write)
+        percpu_counter_add(&block->write_cnt, req->cnt);
+      else
+        percpu_counter_add(&block->read_cnt, req->cnt);
+      req->callback(req);
+    }
+
+    /* Start queued requests. */
+    lock_acquire(&block->queue_lock);
+    while (!list_empty(&block->queue)) {
+      struct block_request* req = pick_request(block);
+      if (req == NULL)
+        break;
+      req->started = rdtsc();
+      if (!block->ops->start(block->aux, req))
+        break;
+      list_remove(&req->elem);
+      list_push_back(&block->busy, &req->elem);
+      if (req->cnt > 0)
+        block->head = req->sector + req->cnt;
+    }
+    lock_release(&block->queue_lock);
+  }
+}
+
+/* Returns a human-readable name for I/O scheduler SCHED. */
+const char* block_sched_name(enum block_sched sched) {
+  static const char* block_sched_names[BLOCK_SCHED_CNT] = {"noop", "clook", "deadline"};
+
+  ASSERT(sched < BLOCK_SCHED_CNT);
+  return block_sched_names[sched];
+}
+
+/* Finds the I/O scheduler with the given NAME and stores it in
+   *SCHED.  Returns true if successful, false if there is no such
+   scheduler. */
+bool block_sched_lookup(const char* name, enum block_sched* sched) {
+  enum block_sched i;
+
+  for (i = 0; i < BLOCK_SCHED_CNT; i++)
+    if (!strcmp(name, block_sched_name(i))) {
+      *sched = i;
+      return true;
+    }
+  return false;
+}
+
+/* Returns BLOCK's I/O scheduler. */
+enum block_sched block_get_sched(struct block* block) { return block->sched; }
+
+/* Makes SCHED BLOCK's I/O scheduler, starting with the next
+   request that BLOCK's worker picks. */
+void block_set_sched(struct block* block, enum block_sched sched) {
+  ASSERT(sched < BLOCK_SCHED_CNT);
+
+  lock_acquire(&block->queue_lock);
+  block->sched = sched;
+  lock_release(&block->queue_lock);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -119,38 +808,128 @@ const char* block_name(struct block* block) { return block->name; }
 /* Returns BLOCK's type. */
 enum block_type block_type(struct block* block) { return block->type; }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Returns the number of the controller channel that BLOCK is
+   attached to, or -1 if its driver has not said.  Devices on
+   different channels can carry out requests at the same time;
+   devices on one channel take turns. */
+int block_channel(struct block* block) { return block->channel; }
+
+/* Records that BLOCK is attached to controller channel CHANNEL,
+   for block_channel(). */
+void block_set_channel(struct block* block, int channel) { block->channel = channel; }
+
+/* Prints "NAME: WHAT:" and the nonzero buckets of the CNT-bucket
+   histogram HIST on a line, or nothing if all are zero. */
+static void print_hist(const char* name, const char* what, const uint32_t* hist, int cnt) {
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    if (hist[i] != 0)
+      break;
+  if (i == cnt)
+    return;
+
+  printf("%s: %s:", name, what);
+  for (; i < cnt; i++)
+    if (hist[i] != 0)
+      printf(" %d:%" PRIu32, i, hist[i]);
+  printf("\n");
+}
+
+/* Prints statistics for each block device used for a Pintos role,
+   then the latencies and queue depths of each block device. */
 void block_print_stats(void) {
+  struct block_stats stats;
+  size_t idx;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++) {
     struct block* block = block_by_role[i];
     if (block != NULL) {
-      printf("%s (%s): %llu reads, %llu writes\n", block->name, block_type_name(block->type),
-             block->read_cnt, block->write_cnt);
+      printf("%s (%s): %lld reads, %lld writes\n", block->name, block_type_name(block->type),
+             percpu_counter_sum(&block->read_cnt), percpu_counter_sum(&block->write_cnt));
+      if (percpu_counter_sum(&block->polled) > 0)
+        printf("%s: %lld completions found by polling\n", block->name,
+               percpu_counter_sum(&block->polled));
     }
   }
+
+  /* Latencies and queue depths of every device that was used. */
+  for (idx = 0; block_get_stats(idx, &stats); idx++) {
+    if (stats.requests == 0)
+      continue;
+    printf("%s: %" PRIu64 " requests, %" PRIu64 " cycles queued and %" PRIu64
+           " in service on average\n",
+           stats.name, stats.requests, stats.queue_cycles / stats.requests,
+           stats.service_cycles / stats.requests);
+    if (stats.urgent != 0)
+      printf("%s: %" PRIu64 " requests started ahead of older, less urgent ones\n", stats.name,
+             stats.urgent);
+    print_hist(stats.name, "queue time (log2 cycles:count)", stats.queue_hist,
+               BLOCK_LATENCY_BUCKETS);
+    print_hist(stats.name, "service time (log2 cycles:count)", stats.service_hist,
+               BLOCK_LATENCY_BUCKETS);
+    print_hist(stats.name, "queue depth (requests ahead:count)", stats.depth_hist,
+               BLOCK_DEPTH_BUCKETS);
+  }
+}
+
+/* Stores the statistics of the block device at index IDX in
+   probe order into STATS.  Returns true if successful, false if
+   there are not that many block devices. */
+bool block_get_stats(size_t idx, struct block_stats* stats) {
+  struct block* block;
+
+  for (block = block_first(); block != NULL && idx > 0; block = block_next(block))
+    idx--;
+  if (block == NULL)
+    return false;
+
+  lock_acquire(&block->queue_lock);
+  *stats = block->stats;
+  lock_release(&block->queue_lock);
+  strlcpy(stats->name, block->name, sizeof stats->name);
+  stats->read_sectors = percpu_counter_sum(&block->read_cnt);
+  stats->write_sectors = percpu_counter_sum(&block->write_cnt);
+  return true;
 }
 
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
    be provided, as well as the it operation functions OPS, which
-   will be passed AUX in each function call. */
+   will be passed AUX in each function call.  Starts the worker
+   thread that carries out the new device's requests, so threads
+   must have been started. */
 struct block* block_register(const char* name, enum block_type type, const char* extra_info,
                              block_sector_t size, const struct block_operations* ops, void* aux) {
   struct block* block = malloc(sizeof *block);
   if (block == NULL)
     PANIC("Failed to allocate memory for block device descriptor");
 
-  list_push_back(&all_blocks, &block->list_elem);
   strlcpy(block->name, name, sizeof block->name);
   block->type = type;
   block->size = size;
+  block->channel = -1;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  percpu_counter_reset(&block->read_cnt);
+  percpu_counter_reset(&block->write_cnt);
+  lock_init_named(&block->queue_lock, "block queue");
+  sema_init(&block->work, 0);
+  list_init(&block->queue);
+  list_init(&block->busy);
+  list_init(&block->done);
+  block->sched = BLOCK_SCHED_DEADLINE;
+  block->head = 0;
+  block->merge_buf = NULL;
+  memset(&block->stats, 0, sizeof block->stats);
+  block->depth = 0;
+  percpu_counter_reset(&block->polled);
+  list_push_back_rcu(&all_blocks, &block->list_elem);
+  if (thread_create(block->name, PRI_MAX, ops->start != NULL ? block_async_worker : block_worker,
+                    block) == TID_ERROR)
+    PANIC("Failed to start worker thread for block device %s", block->name);
 
   printf("%s: %'" PRDSNu " sectors (", block->name, block->size);
   print_human_readable_size((uint64_t)block->size * BLOCK_SECTOR_SIZE);
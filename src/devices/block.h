@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include <stats.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -52,20 +55,154 @@ struct block* block_next(struct block*);
 block_sector_t block_size(struct block*);
 void block_read(struct block*, block_sector_t, void*);
 void block_write(struct block*, block_sector_t, const void*);
+void block_read_multiple(struct block*, block_sector_t, size_t cnt, void*);
+void block_write_multiple(struct block*, block_sector_t, size_t cnt, const void*);
+void block_write_barrier(struct block*, block_sector_t, const void*);
+void block_flush(struct block*);
+void* block_map(struct block*, block_sector_t, size_t cnt, bool write);
 const char* block_name(struct block*);
 enum block_type block_type(struct block*);
+int block_channel(struct block*);
+void block_set_channel(struct block*, int channel);
+
+/* Asynchronous block device operations.
+
+   A request is queued on its device with block_submit(), which
+   returns at once.  A worker thread per device hands the queued
+   requests to the driver, one at a time unless the driver can
+   take several (see struct block_operations), and calls each
+   one's callback when the driver is done with it.  The
+   callback runs in the worker thread, so it must not wait for
+   another request to the same device; upping a semaphore or
+   queuing more requests is fine.  The buffer must be kernel
+   memory, since the worker does not run in the submitter's
+   address space, and it and the request belong to the driver
+   until the callback is called.
+
+   The device's I/O scheduler decides which queued request goes
+   next; see enum block_sched.  Whatever it picks, a request
+   never overtakes an older one that it overlaps if either
+   writes.
+
+   Each request has a priority: the effective priority of the
+   thread that submitted it or, if higher, that of its WAITER,
+   which follows any priority donated to the waiter while the
+   request is queued.  The scheduler only chooses among the
+   requests of the highest priority that can go, so an urgent
+   request overtakes a queue of less urgent ones, except that the
+   deadline scheduler still carries out late requests first.  An
+   older request that a newer one has to wait for is raised to
+   the newer one's priority.
+
+   A device may keep written data in a volatile write cache for a
+   while after it acknowledges the write, so a write that has
+   completed may still be lost in a crash, and writes may reach
+   the medium in any order.  A request with FLUSH set waits for
+   every older write, queued or in flight, and then has the
+   device's write cache flushed before it is carried out, so that
+   those writes are durable first.  One with CNT 0 does nothing
+   else.  A write with FUA set completes only once its own data is
+   durable.  Together they make a barrier: everything before it
+   is on the medium before it is. */
+
+struct block_request;
+typedef void block_callback(struct block_request*);
+
+struct block_request {
+  struct list_elem elem;      /* Element in the device's request queue. */
+  struct list_elem done_elem; /* Element in the device's completed requests. */
+
+  struct block* block;      /* Device to transfer to or from. */
+  bool write;               /* Write BUFFER to the device? */
+  bool flush;               /* Flush the write cache first? */
+  bool fua;                 /* Write through the write cache? */
+  block_sector_t sector;    /* First sector. */
+  size_t cnt;               /* Number of sectors, at least one unless FLUSH. */
+  void* buffer;             /* CNT * BLOCK_SECTOR_SIZE bytes. */
+  block_callback* callback; /* Called when done. */
+  void* aux;                /* For the submitter's use. */
+  struct thread* waiter;    /* Thread blocked until it is done, or null. */
+  int priority;             /* Set by block_submit(): submitter's priority. */
+  int64_t deadline;         /* Set by block_submit(): tick to go by. */
+  uint64_t submitted;       /* Set by the block layer: TSC at submission, */
+  uint64_t started;         /* ...when the driver started on it, */
+  uint64_t completed;       /* ...and when an asynchronous driver completed it. */
+};
+
+void block_submit(struct block_request*, block_callback*);
+
+/* A process's block I/O quota: a token bucket that fills at RATE
+   bytes per second, and that the process's synchronous transfers
+   drain.  A transfer that takes more than the bucket holds sleeps
+   until it is paid for.  Interrupts off. */
+struct io_quota {
+  uint32_t rate;    /* Bytes per second, or 0 for no limit. */
+  int64_t tokens;   /* Bytes it may transfer, times TIMER_FREQ; negative in debt. */
+  int64_t refilled; /* Tick at which TOKENS was last filled. */
+};
+
+void io_quota_init(struct io_quota*, const struct io_quota* parent);
+bool io_quota_set(struct io_quota*, uint32_t rate);
+
+/* I/O schedulers. */
+enum block_sched {
+  BLOCK_SCHED_NOOP,     /* Arrival order, no merging. */
+  BLOCK_SCHED_CLOOK,    /* Ascending sectors, wrapping around, merged. */
+  BLOCK_SCHED_DEADLINE, /* C-LOOK, but late requests go first. */
+  BLOCK_SCHED_CNT       /* Number of I/O schedulers. */
+};
+
+const char* block_sched_name(enum block_sched);
+bool block_sched_lookup(const char* name, enum block_sched*);
+enum block_sched block_get_sched(struct block*);
+void block_set_sched(struct block*, enum block_sched);
 
 /* Statistics. */
 void block_print_stats(void);
-
-/* Lower-level interface to block device drivers. */
+bool block_get_stats(size_t idx, struct block_stats*);
+
+/* Lower-level interface to block device drivers.
+   Each operation transfers CNT consecutive sectors, at least
+   one, to or from BUFFER.  MAP is optional: a driver that keeps
+   its sectors in memory returns where the CNT sectors starting
+   at the given one are.
+
+   START is optional too.  A driver that can work on several
+   requests at once provides it instead of READ and WRITE: it
+   starts REQ and returns true at once, or returns false, having
+   done nothing, if it cannot take another request yet.  Either
+   way, it calls block_complete() for each request it took, when
+   that request is done, which may be from an interrupt
+   handler.
+
+   FLUSH is for a device with a volatile write cache.  It returns
+   once every write that the device has acknowledged is durable.
+   The block layer calls it for requests with FLUSH set, before
+   the transfer, and once more after a write with FUA set.  An
+   asynchronous driver provides no FLUSH and instead deals with
+   both members of each request it starts.
+
+   POLL is optional, for an asynchronous driver.  It calls
+   block_complete() for the requests that the device has finished,
+   without waiting for an interrupt to say so.  While several
+   requests are in flight, the worker thread polls for a little
+   while before it sleeps, so that completions arriving at a high
+   rate cost no interrupt-to-thread wakeup each (see
+   BLOCK_POLL_USEC).  A synchronous driver can do the same inside
+   READ and WRITE when block_queue_deep() says so. */
 
 struct block_operations {
-  void (*read)(void* aux, block_sector_t, void* buffer);
-  void (*write)(void* aux, block_sector_t, const void* buffer);
+  void (*read)(void* aux, block_sector_t, size_t cnt, void* buffer);
+  void (*write)(void* aux, block_sector_t, size_t cnt, const void* buffer);
+  void* (*map)(void* aux, block_sector_t, size_t cnt);
+  bool (*start)(void* aux, struct block_request* req);
+  void (*flush)(void* aux);
+  void (*poll)(void* aux);
 };
 
 struct block* block_register(const char* name, enum block_type, const char* extra_info,
                              block_sector_t size, const struct block_operations*, void* aux);
+void block_complete(struct block_request*);
+bool block_queue_deep(const struct block*);
 
 #endif /* devices/block.h */
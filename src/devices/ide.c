@@ -3,15 +3,27 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the controller is a PCI bus master, such as the PIIX found
+   in the PCs that QEMU and Bochs emulate, disks that can do DMA
+   move data with READ DMA and WRITE DMA, so that the CPU only
+   sets up each transfer and sleeps until its interrupt instead of
+   copying every word through the data register.  See [PIIX]
+   chapter 2.7.  Everything else uses PIO. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)   /* Data. */
@@ -30,10 +42,24 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206) /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl(CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table address. */
+
+/* Bus master command register bits. */
+#define BM_START 0x01 /* Start the transfer. */
+#define BM_READ 0x08  /* Transfer from the disk to memory. */
+
+/* Bus master status register bits.  Writing 1 clears them. */
+#define BMS_ERR 0x02  /* Transfer failed. */
+#define BMS_INTR 0x04 /* Disk interrupted. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80  /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
 #define STA_DRQ 0x08  /* Data Request. */
+#define STA_ERR 0x01  /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -49,6 +75,16 @@
 #define CMD_IDENTIFY_DEVICE 0xec    /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20  /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4      /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5     /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6  /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8           /* READ DMA. */
+#define CMD_WRITE_DMA 0xca          /* WRITE DMA. */
+#define CMD_FLUSH_CACHE 0xe7        /* FLUSH CACHE. */
+
+/* Most sectors that one READ SECTOR, WRITE SECTOR, READ MULTIPLE
+   or WRITE MULTIPLE command can transfer. */
+#define MAX_SECTORS_PER_CMD 256
 
 /* An ATA device. */
 struct ata_disk {
@@ -56,21 +92,52 @@ struct ata_disk {
   struct channel* channel; /* Channel that disk is attached to. */
   int dev_no;              /* Device 0 or 1 for master or slave. */
   bool is_ata;             /* Is device an ATA disk? */
+  size_t multiple;         /* Sectors per interrupt in READ/WRITE MULTIPLE, or 0. */
+  bool dma;                /* Move data with READ/WRITE DMA? */
+  bool write_cache;        /* Has a write cache that FLUSH CACHE flushes? */
+  block_sector_t capacity; /* Size in sectors, once identified. */
+  char info[128];          /* Model and serial number, once identified. */
+  struct block* block;     /* Block device, once registered. */
 };
 
+/* A physical region descriptor, which tells the bus master where
+   in memory the next part of a DMA transfer goes.  A region must
+   not cross a 64 kB boundary. */
+struct prd {
+  uint32_t addr;  /* Physical address. */
+  uint16_t size;  /* Size in bytes, or 0 for 64 kB. */
+  uint16_t flags; /* PRD_EOT or 0. */
+};
+
+/* Set in the flags of the last PRD of a table. */
+#define PRD_EOT 0x8000
+
+/* Size of the regions that PRDs must not cross. */
+#define PRD_BOUNDARY 0x10000
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel {
   char name[8];      /* Name, e.g. "ide0". */
   uint16_t reg_base; /* Base I/O port. */
   uint8_t irq;       /* Interrupt in use. */
+  uint16_t bm_base;  /* Bus master I/O base port, or 0 if no DMA. */
+  struct prd* prdt;  /* PRD table, a page, if BM_BASE is nonzero. */
 
   struct lock lock;                 /* Must acquire to access the controller. */
   bool expecting_interrupt;         /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
   struct semaphore completion_wait; /* Up'd by interrupt handler. */
 
+  unsigned long long transfer_cnt; /* Calls to ide_read() and ide_write(). */
+  unsigned long long sector_cnt;   /* Sectors they moved. */
+  unsigned long long flush_cnt;    /* FLUSH CACHE commands issued by ide_flush(). */
+  int64_t busy_ticks;              /* Ticks they held LOCK for. */
+  unsigned long long poll_hits;    /* Interrupts wait_interrupt() caught by polling. */
+  unsigned long long poll_misses;  /* Times it polled in vain and slept. */
+
   struct ata_disk devices[2]; /* The devices on this channel. */
+  struct semaphore probed;    /* Up'd when the devices have been probed. */
 };
 
 /* We support the two "legacy" ATA channels found in a standard PC. */
@@ -79,25 +146,56 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static thread_func probe_channel;
 static void reset_channel(struct channel*);
 static bool check_device_type(struct ata_disk*);
 static void identify_ata_device(struct ata_disk*);
+static void register_ata_device(struct ata_disk*);
+static void set_multiple_mode(struct ata_disk*, const uint8_t* id);
 
-static void select_sector(struct ata_disk*, block_sector_t);
+static void select_sectors(struct ata_disk*, block_sector_t, size_t cnt);
 static void issue_pio_command(struct channel*, uint8_t command);
 static void input_sector(struct channel*, void*);
 static void output_sector(struct channel*, const void*);
 
+static int64_t backoff(int64_t delay);
 static void wait_until_idle(const struct ata_disk*);
 static bool wait_while_busy(const struct ata_disk*);
 static void select_device(const struct ata_disk*);
 static void select_device_wait(const struct ata_disk*);
 
 static void interrupt_handler(struct intr_frame*);
+static void wait_interrupt(struct ata_disk*);
+
+/* Returns the bus master I/O base port of the PCI IDE controller,
+   set up to do DMA, or 0 if there is no controller that can. */
+static uint16_t find_bus_master(void) {
+  pci_addr_t addr;
+  uint32_t command;
+  uint32_t bar;
+
+  if (!pci_find_class(0x01, 0x01, &addr)) /* Mass storage, IDE. */
+    return 0;
+  if ((pci_read_config(addr, PCI_REG_CLASS) & 0x8000) == 0) /* Interface bit 7. */
+    return 0;
+  bar = pci_read_config(addr, PCI_REG_BAR(4));
+  if ((bar & 1) == 0 || (bar & ~3u) == 0) /* Must be an I/O port. */
+    return 0;
+
+  command = pci_read_config(addr, PCI_REG_COMMAND);
+  pci_write_config(addr, PCI_REG_COMMAND, command | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+  return bar & ~3u;
+}
 
-/* Initialize the disk subsystem and detect disks. */
+/* Initialize the disk subsystem and detect disks.  The channels
+   are reset and their disks identified at the same time, in a
+   thread per channel, since most of that is waiting for the
+   hardware, but the disks are registered in channel order to keep
+   the probe order stable. */
 void ide_init(void) {
+  uint16_t bm_base = find_bus_master();
   size_t chan_no;
+  char name[16];
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
     struct channel* c = &channels[chan_no];
@@ -117,9 +215,18 @@ void ide_init(void) {
       default:
         NOT_REACHED();
     }
-    lock_init(&c->lock);
+    c->bm_base = 0;
+    c->prdt = bm_base != 0 ? palloc_get_page(0) : NULL;
+    if (c->prdt != NULL)
+      c->bm_base = bm_base + chan_no * 8;
+    lock_init_named(&c->lock, "ide channel");
     c->expecting_interrupt = false;
     sema_init(&c->completion_wait, 0);
+    c->transfer_cnt = 0;
+    c->sector_cnt = 0;
+    c->busy_ticks = 0;
+    c->poll_hits = 0;
+    c->poll_misses = 0;
 
     /* Initialize devices. */
     for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -128,25 +235,55 @@ void ide_init(void) {
       d->channel = c;
       d->dev_no = dev_no;
       d->is_ata = false;
+      d->multiple = 0;
+      d->dma = false;
+      d->capacity = 0;
+      d->info[0] = '\0';
+      d->block = NULL;
     }
 
     /* Register interrupt handler. */
     intr_register_ext(c->irq, interrupt_handler, c->name);
 
-    /* Reset hardware. */
-    reset_channel(c);
+    /* Probe in the background. */
+    sema_init(&c->probed, 0);
+    snprintf(name, sizeof name, "%s-probe", c->name);
+    if (thread_create(name, PRI_DEFAULT, probe_channel, c) == TID_ERROR)
+      probe_channel(c);
+  }
 
-    /* Distinguish ATA hard disks from other devices. */
-    if (check_device_type(&c->devices[0]))
-      check_device_type(&c->devices[1]);
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
+    struct channel* c = &channels[chan_no];
+    int dev_no;
 
-    /* Read hard disk identity information. */
+    sema_down(&c->probed);
     for (dev_no = 0; dev_no < 2; dev_no++)
       if (c->devices[dev_no].is_ata)
-        identify_ata_device(&c->devices[dev_no]);
+        register_ata_device(&c->devices[dev_no]);
   }
 }
 
+/* Thread function that resets channel C_, finds out which of its
+   devices are ATA disks, and identifies them. */
+static void probe_channel(void* c_) {
+  struct channel* c = c_;
+  int dev_no;
+
+  /* Reset hardware. */
+  reset_channel(c);
+
+  /* Distinguish ATA hard disks from other devices. */
+  if (check_device_type(&c->devices[0]))
+    check_device_type(&c->devices[1]);
+
+  /* Read hard disk identity information. */
+  for (dev_no = 0; dev_no < 2; dev_no++)
+    if (c->devices[dev_no].is_ata)
+      identify_ata_device(&c->devices[dev_no]);
+
+  sema_up(&c->probed);
+}
+
 /* Disk detection and identification. */
 
 static char* descramble_ata_string(char*, int size);
@@ -184,7 +321,10 @@ static void reset_channel(struct channel* c) {
   timer_usleep(10);
   outb(reg_ctl(c), 0);
 
-  timer_msleep(150);
+  /* [ATA-3] 9.3.1 asks for 2 ms before the first look at the
+     status; wait_while_busy() then waits for as long as the
+     devices take. */
+  timer_msleep(2);
 
   /* Wait for device 0 to clear BSY. */
   if (present[0]) {
@@ -194,13 +334,14 @@ static void reset_channel(struct channel* c) {
 
   /* Wait for device 1 to clear BSY. */
   if (present[1]) {
-    int i;
+    int64_t delay, waited;
 
     select_device(&c->devices[1]);
-    for (i = 0; i < 3000; i++) {
+    for (delay = 1, waited = 0; waited < 30 * 1000 * 1000;
+       waited += delay, delay = backoff(delay)) {
       if (inb(reg_nsect(c)) == 1 && inb(reg_lbal(c)) == 1)
         break;
-      timer_msleep(10);
+      timer_usleep(delay);
     }
     wait_while_busy(&c->devices[1]);
   }
@@ -233,15 +374,14 @@ static bool check_device_type(struct ata_disk* d) {
 }
 
 /* Sends an IDENTIFY DEVICE command to disk D and reads the
-   response.  Registers the disk with the block device
-   layer. */
+   response into D, for register_ata_device(), and sets D up to
+   move data as fast as it can.  Clears D's is_ata member if D
+   should not be used. */
 static void identify_ata_device(struct ata_disk* d) {
   struct channel* c = d->channel;
   char id[BLOCK_SECTOR_SIZE];
   block_sector_t capacity;
   char *model, *serial;
-  char extra_info[128];
-  struct block* block;
 
   ASSERT(d->is_ata);
 
@@ -262,7 +402,7 @@ static void identify_ata_device(struct ata_disk* d) {
   capacity = *(uint32_t*)&id[60 * 2];
   model = descramble_ata_string(&id[10 * 2], 20);
   serial = descramble_ata_string(&id[27 * 2], 40);
-  snprintf(extra_info, sizeof extra_info, "model \"%s\", serial \"%s\"", model, serial);
+  snprintf(d->info, sizeof d->info, "model \"%s\", serial \"%s\"", model, serial);
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -277,11 +417,56 @@ static void identify_ata_device(struct ata_disk* d) {
     return;
   }
 
-  /* Register. */
-  block = block_register(d->name, BLOCK_RAW, extra_info, capacity, &ide_operations, d);
+  /* Move several sectors per interrupt if the disk can, or use
+     DMA if both it and the controller can. */
+  set_multiple_mode(d, (const uint8_t*)id);
+  d->dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0; /* Word 49, bit 8. */
+  if (d->dma)
+    strlcat(d->info, ", DMA", sizeof d->info);
+
+  /* A disk that says it has a write cache and supports FLUSH
+     CACHE (words 82 and 83, valid if word 83 bits 15:14 are 01)
+     may acknowledge writes before they are on the medium. */
+  d->write_cache = (id[82 * 2] & 0x20) != 0 && (id[83 * 2 + 1] & 0xc0) == 0x40 &&
+                   (id[83 * 2 + 1] & 0x10) != 0;
+  if (d->write_cache)
+    strlcat(d->info, ", write cache", sizeof d->info);
+  d->capacity = capacity;
+}
+
+/* Registers disk D, which identify_ata_device() has identified,
+   with the block device layer and scans its partitions. */
+static void register_ata_device(struct ata_disk* d) {
+  struct block* block;
+
+  block = block_register(d->name, BLOCK_RAW, d->info, d->capacity, &ide_operations, d);
+  block_set_channel(block, d->channel - channels);
+  d->block = block;
   partition_scan(block);
 }
 
+/* Asks disk D, whose IDENTIFY DEVICE response is ID, to move as
+   many sectors per interrupt in READ MULTIPLE and WRITE MULTIPLE
+   as ID says it can, and records the number in D.  If D cannot,
+   or refuses, it keeps using READ SECTOR and WRITE SECTOR, which
+   move one sector per interrupt. */
+static void set_multiple_mode(struct ata_disk* d, const uint8_t* id) {
+  struct channel* c = d->channel;
+  size_t max = id[47 * 2]; /* Word 47, bits 7:0. */
+
+  d->multiple = 0;
+  if (max < 2)
+    return;
+
+  select_device_wait(d);
+  outb(reg_nsect(c), max);
+  issue_pio_command(c, CMD_SET_MULTIPLE_MODE);
+  sema_down(&c->completion_wait);
+  wait_while_busy(d);
+  if ((inb(reg_alt_status(c)) & STA_ERR) == 0)
+    d->multiple = max;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -306,53 +491,222 @@ static char* descramble_ata_string(char* string, int size) {
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads the CNT sectors, at most MAX_SECTORS_PER_CMD, starting at
+   SEC_NO from disk D into BUFFER with one PIO command, after which
+   the disk interrupts once as each block of D->multiple sectors,
+   or each sector if D does not do READ MULTIPLE, becomes ready.
+   The caller must hold D's channel's lock. */
+static void pio_read(struct ata_disk* d, block_sector_t sec_no, size_t cnt, uint8_t* buffer) {
+  struct channel* c = d->channel;
+  size_t i, j;
+
+  select_sectors(d, sec_no, cnt);
+  issue_pio_command(c, d->multiple > 0 ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+  for (i = 0; i < cnt; i += j) {
+    wait_interrupt(d);
+    if (!wait_while_busy(d))
+      PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no + i);
+    for (j = 0; i + j < cnt && (j == 0 || j < d->multiple); j++) {
+      input_sector(c, buffer);
+      buffer += BLOCK_SECTOR_SIZE;
+    }
+  }
+}
+
+/* Writes the CNT sectors, at most MAX_SECTORS_PER_CMD, starting at
+   SEC_NO to disk D from BUFFER with one PIO command, moving a
+   block of sectors per interrupt as pio_read() does.  The caller
+   must hold D's channel's lock. */
+static void pio_write(struct ata_disk* d, block_sector_t sec_no, size_t cnt,
+                      const uint8_t* buffer) {
+  struct channel* c = d->channel;
+  size_t i, j;
+
+  select_sectors(d, sec_no, cnt);
+  issue_pio_command(c, d->multiple > 0 ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+  for (i = 0; i < cnt; i += j) {
+    if (!wait_while_busy(d))
+      PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no + i);
+    for (j = 0; i + j < cnt && (j == 0 || j < d->multiple); j++) {
+      output_sector(c, buffer);
+      buffer += BLOCK_SECTOR_SIZE;
+    }
+    wait_interrupt(d);
+  }
+}
+
+/* Moves the CNT sectors, at most MAX_SECTORS_PER_CMD, starting at
+   SEC_NO between disk D and BUFFER with one DMA command, to the
+   disk if WRITE is true and from it otherwise, sleeping until
+   the disk interrupts once at the end.  Returns false, having
+   done nothing, if D does not do DMA or BUFFER is not kernel
+   memory, which is physically contiguous, at an even address.
+   Also returns false if the transfer fails, after which D goes
+   back to PIO for good.  The caller must hold D's channel's
+   lock. */
+static bool dma_transfer(struct ata_disk* d, block_sector_t sec_no, size_t cnt,
+                         const void* buffer, bool write) {
+  struct channel* c = d->channel;
+  uint8_t direction = write ? 0 : BM_READ;
+  struct prd* prd = c->prdt;
+  size_t size = cnt * BLOCK_SECTOR_SIZE;
+  uintptr_t phys;
+  uint8_t status;
+
+  if (!d->dma || !is_kernel_vaddr(buffer) || (uintptr_t)buffer % 2 != 0)
+    return false;
+
+  /* Describe BUFFER to the bus master. */
+  for (phys = vtop(buffer); size > 0; prd++) {
+    size_t piece = PRD_BOUNDARY - phys % PRD_BOUNDARY;
+    if (piece > size)
+      piece = size;
+    prd->addr = phys;
+    prd->size = piece; /* PRD_BOUNDARY becomes 0. */
+    prd->flags = 0;
+    phys += piece;
+    size -= piece;
+  }
+  prd[-1].flags = PRD_EOT;
+  outl(reg_bm_prdt(c), vtop(c->prdt));
+  outb(reg_bm_command(c), direction);
+  outb(reg_bm_status(c), inb(reg_bm_status(c)) | BMS_ERR | BMS_INTR);
+
+  /* Start the disk, then the bus master, and wait for the end. */
+  select_sectors(d, sec_no, cnt);
+  issue_pio_command(c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb(reg_bm_command(c), direction | BM_START);
+  wait_interrupt(d);
+  outb(reg_bm_command(c), direction);
+  status = inb(reg_bm_status(c));
+  outb(reg_bm_status(c), status | BMS_ERR | BMS_INTR);
+
+  if ((status & BMS_ERR) != 0 || (inb(reg_alt_status(c)) & STA_ERR) != 0) {
+    printf("%s: DMA failed, sector=%" PRDSNu ", falling back to PIO\n", d->name, sec_no);
+    d->dma = false;
+    return false;
+  }
+  return true;
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Issues one command per MAX_SECTORS_PER_CMD sectors, with DMA if
+   D can and with PIO otherwise.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
-static void ide_read(void* d_, block_sector_t sec_no, void* buffer) {
+static void ide_read(void* d_, block_sector_t sec_no, size_t cnt, void* buffer_) {
   struct ata_disk* d = d_;
   struct channel* c = d->channel;
+  uint8_t* buffer = buffer_;
+  int64_t start;
+
   lock_acquire(&c->lock);
-  select_sector(d, sec_no);
-  issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-  sema_down(&c->completion_wait);
-  if (!wait_while_busy(d))
-    PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no);
-  input_sector(c, buffer);
+  start = timer_ticks();
+  c->transfer_cnt++;
+  c->sector_cnt += cnt;
+  while (cnt > 0) {
+    size_t chunk = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+
+    if (!dma_transfer(d, sec_no, chunk, buffer, false))
+      pio_read(d, sec_no, chunk, buffer);
+    buffer += chunk * BLOCK_SECTOR_SIZE;
+    sec_no += chunk;
+    cnt -= chunk;
+  }
+  c->busy_ticks += timer_elapsed(start);
   lock_release(&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Write the CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data.  Like
+   ide_read(), issues one command per MAX_SECTORS_PER_CMD
+   sectors, with DMA if D can.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
-static void ide_write(void* d_, block_sector_t sec_no, const void* buffer) {
+static void ide_write(void* d_, block_sector_t sec_no, size_t cnt, const void* buffer_) {
   struct ata_disk* d = d_;
   struct channel* c = d->channel;
+  const uint8_t* buffer = buffer_;
+  int64_t start;
+
   lock_acquire(&c->lock);
-  select_sector(d, sec_no);
-  issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy(d))
-    PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
-  output_sector(c, buffer);
+  start = timer_ticks();
+  c->transfer_cnt++;
+  c->sector_cnt += cnt;
+  while (cnt > 0) {
+    size_t chunk = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+
+    if (!dma_transfer(d, sec_no, chunk, buffer, true))
+      pio_write(d, sec_no, chunk, buffer);
+    buffer += chunk * BLOCK_SECTOR_SIZE;
+    sec_no += chunk;
+    cnt -= chunk;
+  }
+  c->busy_ticks += timer_elapsed(start);
+  lock_release(&c->lock);
+}
+
+/* Flushes disk D's write cache, if it has one, so that every
+   write that it has acknowledged is on the medium.  ATA-3's
+   28-bit commands have no forced-unit-access form, so the block
+   layer calls this after such writes as well.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void ide_flush(void* d_) {
+  struct ata_disk* d = d_;
+  struct channel* c = d->channel;
+  int64_t start;
+
+  if (!d->write_cache)
+    return;
+  lock_acquire(&c->lock);
+  start = timer_ticks();
+  c->flush_cnt++;
+  select_device_wait(d);
+  issue_pio_command(c, CMD_FLUSH_CACHE);
   sema_down(&c->completion_wait);
+  wait_while_busy(d);
+  if ((inb(reg_alt_status(c)) & STA_ERR) != 0)
+    PANIC("%s: cache flush failed", d->name);
+  c->busy_ticks += timer_elapsed(start);
   lock_release(&c->lock);
 }
 
-static struct block_operations ide_operations = {ide_read, ide_write};
+static struct block_operations ide_operations = {ide_read, ide_write, NULL, NULL, ide_flush, NULL};
+
+/* Prints how much each channel with a disk on it was used: its
+   transfers, their sectors, its cache flushes, and the share of
+   the ticks since boot during which it was busy with one, and
+   how often waiting for an interrupt was cut short by polling. */
+void ide_print_stats(void) {
+  int64_t now = timer_ticks();
+  struct channel* c;
+
+  for (c = channels; c < channels + CHANNEL_CNT; c++)
+    if (c->devices[0].is_ata || c->devices[1].is_ata)
+      printf("%s: %llu transfers, %llu sectors, %llu flushes, busy %" PRId64 " of %" PRId64
+             " ticks (%" PRId64 "%%)\n",
+             c->name, c->transfer_cnt, c->sector_cnt, c->flush_cnt, c->busy_ticks, now,
+             now > 0 ? c->busy_ticks * 100 / now : 0);
+  for (c = channels; c < channels + CHANNEL_CNT; c++)
+    if (c->poll_hits > 0 || c->poll_misses > 0)
+      printf("%s: %llu interrupts caught by polling, %llu polls in vain\n", c->name,
+             c->poll_hits, c->poll_misses);
+}
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
-static void select_sector(struct ata_disk* d, block_sector_t sec_no) {
+   writes SEC_NO and CNT to the disk's sector selection
+   registers.  (We use LBA mode.) */
+static void select_sectors(struct ata_disk* d, block_sector_t sec_no, size_t cnt) {
   struct channel* c = d->channel;
 
   ASSERT(sec_no < (1UL << 28));
+  ASSERT(cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
 
   select_device_wait(d);
-  outb(reg_nsect(c), 1);
+  outb(reg_nsect(c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt); /* 0 means 256. */
   outb(reg_lbal(c), sec_no);
   outb(reg_lbam(c), sec_no >> 8);
   outb(reg_lbah(c), (sec_no >> 16));
@@ -384,18 +738,33 @@ static void output_sector(struct channel* c, const void* sector) {
 
 /* Low-level ATA primitives. */
 
-/* Wait up to 10 seconds for the controller to become idle, that
-   is, for the BSY and DRQ bits to clear in the status register.
+/* Most microseconds between two looks at a status register. */
+#define POLL_MAX_DELAY 10000
+
+/* Returns the microseconds to wait before the next look at a
+   status register, given that the last wait was DELAY.  Waits
+   start at 1 us and double up to POLL_MAX_DELAY, so that a
+   device that is nearly ready costs little more than a busy wait
+   and a slow one costs little CPU time: timer_usleep() spins for
+   less than a tick and sleeps for more. */
+static int64_t backoff(int64_t delay) {
+  return delay * 2 < POLL_MAX_DELAY ? delay * 2 : POLL_MAX_DELAY;
+}
+
+/* Wait up to 10 milliseconds for the controller to become idle,
+   that is, for the BSY and DRQ bits to clear in the status
+   register.
 
    As a side effect, reading the status register clears any
    pending interrupt. */
 static void wait_until_idle(const struct ata_disk* d) {
-  int i;
+  int64_t delay, waited;
 
-  for (i = 0; i < 1000; i++) {
+  for (delay = 1, waited = 0; waited < 10 * 1000;
+       waited += delay, delay = backoff(delay)) {
     if ((inb(reg_status(d->channel)) & (STA_BSY | STA_DRQ)) == 0)
       return;
-    timer_usleep(10);
+    timer_usleep(delay);
   }
 
   printf("%s: idle timeout\n", d->name);
@@ -407,17 +776,21 @@ static void wait_until_idle(const struct ata_disk* d) {
    complete its reset. */
 static bool wait_while_busy(const struct ata_disk* d) {
   struct channel* c = d->channel;
-  int i;
+  int64_t delay, waited;
+  bool warned = false;
 
-  for (i = 0; i < 3000; i++) {
-    if (i == 700)
+  for (delay = 1, waited = 0; waited < 30 * 1000 * 1000;
+       waited += delay, delay = backoff(delay)) {
+    if (!warned && waited >= 7 * 1000 * 1000) {
       printf("%s: busy, waiting...", d->name);
+      warned = true;
+    }
     if (!(inb(reg_alt_status(c)) & STA_BSY)) {
-      if (i >= 700)
+      if (warned)
         printf("ok\n");
       return (inb(reg_alt_status(c)) & STA_DRQ) != 0;
     }
-    timer_msleep(10);
+    timer_usleep(delay);
   }
 
   printf("failed\n");
@@ -443,6 +816,34 @@ static void select_device_wait(const struct ata_disk* d) {
   wait_until_idle(d);
 }
 
+/* Microseconds that wait_interrupt() polls for. */
+#define POLL_WINDOW 50
+
+/* Waits for disk D's channel to interrupt, for the command in
+   progress.  Normally sleeps until the interrupt handler wakes
+   it.  While other requests are queued for D, which means the
+   disk is being kept busy with small transfers, first polls for
+   up to POLL_WINDOW microseconds for the interrupt to have
+   arrived, so that a transfer that finishes quickly costs no
+   switch to another thread and back.  The caller must hold the
+   channel's lock. */
+static void wait_interrupt(struct ata_disk* d) {
+  struct channel* c = d->channel;
+  int usec;
+
+  if (d->block != NULL && block_queue_deep(d->block)) {
+    for (usec = 0; usec < POLL_WINDOW; usec++) {
+      if (sema_try_down(&c->completion_wait)) {
+        c->poll_hits++;
+        return;
+      }
+      timer_udelay(1);
+    }
+    c->poll_misses++;
+  }
+  sema_down(&c->completion_wait);
+}
+
 /* ATA interrupt handler. */
 static void interrupt_handler(struct intr_frame* f) {
   struct channel* c;
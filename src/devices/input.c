@@ -2,6 +2,7 @@
 #include <debug.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/synch.h"
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
@@ -9,13 +10,15 @@ static struct intq buffer;
 /* Initializes the input buffer. */
 void input_init(void) { intq_init(&buffer); }
 
-/* Adds a key to the input buffer.
+/* Adds a key to the input buffer and advances io_events for
+   poll().
    Interrupts must be off and the buffer must not be full. */
 void input_putc(uint8_t key) {
   ASSERT(intr_get_level() == INTR_OFF);
   ASSERT(!intq_full(&buffer));
 
   intq_putc(&buffer, key);
+  eventcount_advance(&io_events);
   serial_notify();
 }
 
@@ -33,6 +36,40 @@ uint8_t input_getc(void) {
   return key;
 }
 
+/* Retrieves up to SIZE keys from the input buffer into BUF and
+   returns the number retrieved.  If the buffer is empty, waits
+   for one key to be pressed, then takes whatever else is there
+   without waiting again.  Returns 0 only if SIZE is 0. */
+size_t input_getbuf(uint8_t* buf, size_t size) {
+  enum intr_level old_level;
+  size_t cnt = 0;
+
+  if (size == 0)
+    return 0;
+
+  old_level = intr_disable();
+  buf[cnt++] = intq_getc(&buffer);
+  while (cnt < size && !intq_empty(&buffer))
+    buf[cnt++] = intq_getc(&buffer);
+  serial_notify();
+  intr_set_level(old_level);
+
+  return cnt;
+}
+
+/* Returns true if a key is waiting in the input buffer, false
+   otherwise. */
+bool input_ready(void) {
+  enum intr_level old_level;
+  bool ready;
+
+  old_level = intr_disable();
+  ready = !intq_empty(&buffer);
+  intr_set_level(old_level);
+
+  return ready;
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
@@ -144,6 +144,7 @@ static void found_partition(struct block* block, uint8_t part_type, block_sector
                             : part_type == 0x23 ? BLOCK_SWAP
                                                 : BLOCK_FOREIGN);
     struct partition* p;
+    struct block* part;
     char extra_info[128];
     char name[16];
 
@@ -155,7 +156,8 @@ static void found_partition(struct block* block, uint8_t part_type, block_sector
 
     snprintf(name, sizeof name, "%s%d", block_name(block), part_nr);
     snprintf(extra_info, sizeof extra_info, "%s (%02x)", partition_type_name(part_type), part_type);
-    block_register(name, type, extra_info, size, &partition_operations, p);
+    part = block_register(name, type, extra_info, size, &partition_operations, p);
+    block_set_channel(part, block_channel(block));
   }
 }
 
@@ -269,19 +271,28 @@ static const char* partition_type_name(uint8_t type) {
   return type_names[type] != NULL ? type_names[type] : "Unknown";
 }
 
-/* Reads sector SECTOR from partition P into BUFFER, which must
-   have room for BLOCK_SECTOR_SIZE bytes. */
-static void partition_read(void* p_, block_sector_t sector, void* buffer) {
+/* Reads the CNT sectors starting at SECTOR from partition P into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
+static void partition_read(void* p_, block_sector_t sector, size_t cnt, void* buffer) {
   struct partition* p = p_;
-  block_read(p->block, p->start + sector, buffer);
+  block_read_multiple(p->block, p->start + sector, cnt, buffer);
 }
 
-/* Write sector SECTOR to partition P from BUFFER, which must
-   contain BLOCK_SECTOR_SIZE bytes.  Returns after the block has
-   acknowledged receiving the data. */
-static void partition_write(void* p_, block_sector_t sector, const void* buffer) {
+/* Write the CNT sectors starting at SECTOR to partition P from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block has acknowledged receiving the data. */
+static void partition_write(void* p_, block_sector_t sector, size_t cnt, const void* buffer) {
   struct partition* p = p_;
-  block_write(p->block, p->start + sector, buffer);
+  block_write_multiple(p->block, p->start + sector, cnt, buffer);
 }
 
-static struct block_operations partition_operations = {partition_read, partition_write};
+/* Flushes the write cache of the device that partition P is on,
+   which holds P's writes among others. */
+static void partition_flush(void* p_) {
+  struct partition* p = p_;
+  block_flush(p->block);
+}
+
+static struct block_operations partition_operations = {partition_read, partition_write, NULL, NULL,
+                                                       partition_flush, NULL};
@@ -0,0 +1,106 @@
+#include "devices/pci.h"
+#include "threads/io.h"
+
+/* This code finds and configures devices on the PCI bus through
+   configuration mechanism #1, the one every PC chipset since the
+   early PCI days has.  See [PCI] chapter 3.2.2.3.2. */
+
+/* I/O ports of configuration mechanism #1. */
+#define PCI_CONFIG_ADDRESS 0xcf8 /* Selects a register to expose at DATA. */
+#define PCI_CONFIG_DATA 0xcfc    /* The selected 32-bit register. */
+
+/* Set in PCI_CONFIG_ADDRESS to enable the access. */
+#define PCI_CONFIG_ENABLE 0x80000000
+
+/* Set in the header type of a device's function 0 if it has other
+   functions. */
+#define PCI_HEADER_MULTI 0x80
+
+/* Returns the PCI function with bus BUS, device DEV and function
+   FUNC. */
+static pci_addr_t pci_addr(int bus, int dev, int func) {
+  return (bus << 16) | (dev << 11) | (func << 8);
+}
+
+/* Returns the 32-bit configuration register REG, which must be a
+   multiple of 4, of PCI function ADDR. */
+uint32_t pci_read_config(pci_addr_t addr, uint8_t reg) {
+  outl(PCI_CONFIG_ADDRESS, PCI_CONFIG_ENABLE | addr | (reg & 0xfc));
+  return inl(PCI_CONFIG_DATA);
+}
+
+/* Sets the 32-bit configuration register REG, which must be a
+   multiple of 4, of PCI function ADDR to VALUE. */
+void pci_write_config(pci_addr_t addr, uint8_t reg, uint32_t value) {
+  outl(PCI_CONFIG_ADDRESS, PCI_CONFIG_ENABLE | addr | (reg & 0xfc));
+  outl(PCI_CONFIG_DATA, value);
+}
+
+/* Returns true if PCI function ADDR exists and is of class CLASS
+   and subclass SUBCLASS. */
+static bool has_class(pci_addr_t addr, uint8_t class, uint8_t subclass) {
+  uint32_t class_reg;
+
+  if ((pci_read_config(addr, PCI_REG_ID) & 0xffff) == 0xffff)
+    return false;
+  class_reg = pci_read_config(addr, PCI_REG_CLASS);
+  return (class_reg >> 24) == class && ((class_reg >> 16) & 0xff) == subclass;
+}
+
+/* Searches the PCI buses for functions for which MATCH, given
+   AUX, returns true, and stores the first MAX of them into
+   ADDRS[], in bus order.  Returns the number stored. */
+static size_t scan(bool (*match)(pci_addr_t, const void* aux), const void* aux, pci_addr_t addrs[],
+                   size_t max) {
+  size_t cnt = 0;
+  int bus, dev, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++) {
+      pci_addr_t a = pci_addr(bus, dev, 0);
+      int func_cnt;
+
+      if ((pci_read_config(a, PCI_REG_ID) & 0xffff) == 0xffff)
+        continue;
+      func_cnt = (pci_read_config(a, PCI_REG_HEADER) >> 16) & PCI_HEADER_MULTI ? 8 : 1;
+      for (func = 0; func < func_cnt; func++) {
+        a = pci_addr(bus, dev, func);
+        if (match(a, aux)) {
+          addrs[cnt++] = a;
+          if (cnt >= max)
+            return cnt;
+        }
+      }
+    }
+  return cnt;
+}
+
+/* scan() match function for pci_find_class(), AUX pointing to
+   the class and the subclass. */
+static bool match_class(pci_addr_t addr, const void* aux) {
+  const uint8_t* class = aux;
+  return has_class(addr, class[0], class[1]);
+}
+
+/* Searches the PCI buses for the first function of class CLASS
+   and subclass SUBCLASS.  If there is one, stores it into *ADDR
+   and returns true.  Otherwise, returns false. */
+bool pci_find_class(uint8_t class, uint8_t subclass, pci_addr_t* addr) {
+  uint8_t classes[2] = {class, subclass};
+  return scan(match_class, classes, addr, 1) > 0;
+}
+
+/* scan() match function for pci_find_devices(), AUX pointing to
+   the ID register value. */
+static bool match_id(pci_addr_t addr, const void* aux) {
+  const uint32_t* id = aux;
+  return pci_read_config(addr, PCI_REG_ID) == *id;
+}
+
+/* Searches the PCI buses for functions with vendor ID VENDOR and
+   device ID DEVICE and stores the first MAX of them into ADDRS[],
+   in bus order.  Returns the number stored. */
+size_t pci_find_devices(uint16_t vendor, uint16_t device, pci_addr_t addrs[], size_t max) {
+  uint32_t id = ((uint32_t)device << 16) | vendor;
+  return max > 0 ? scan(match_id, &id, addrs, max) : 0;
+}
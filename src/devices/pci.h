@@ -0,0 +1,30 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A PCI function, as the bus number in bits 23:16, the device
+   number in bits 15:11 and the function number in bits 10:8,
+   which is how configuration space addresses it. */
+typedef uint32_t pci_addr_t;
+
+/* Configuration space registers, as byte offsets. */
+#define PCI_REG_ID 0x00                 /* Device ID 31:16, vendor ID 15:0. */
+#define PCI_REG_COMMAND 0x04            /* Status 31:16, command 15:0. */
+#define PCI_REG_CLASS 0x08              /* Class 31:24, subclass 23:16, interface 15:8. */
+#define PCI_REG_HEADER 0x0c             /* Header type 23:16. */
+#define PCI_REG_BAR(N) (0x10 + 4 * (N)) /* Base address register N, 0...5. */
+#define PCI_REG_INTERRUPT 0x3c          /* Interrupt pin 15:8, line 7:0. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001         /* Respond to I/O space accesses. */
+#define PCI_CMD_BUS_MASTER 0x0004 /* May act as bus master. */
+
+bool pci_find_class(uint8_t class, uint8_t subclass, pci_addr_t*);
+size_t pci_find_devices(uint16_t vendor, uint16_t device, pci_addr_t[], size_t max);
+uint32_t pci_read_config(pci_addr_t, uint8_t reg);
+void pci_write_config(pci_addr_t, uint8_t reg, uint32_t);
+
+#endif /* devices/pci.h */
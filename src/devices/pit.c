@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL 0x43                        /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL)) /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -75,3 +72,45 @@ void pit_configure_channel(int channel, int mode, int frequency) {
   outb(PIT_PORT_COUNTER(channel), count >> 8);
   intr_set_level(old_level);
 }
+
+/* Starts a one-shot countdown of COUNT PIT cycles on CHANNEL
+   using mode 0, "interrupt on terminal count": the channel's
+   output goes low now and rises when the count reaches zero.
+   For channel 0 that rising edge is one timer interrupt, after
+   which the channel stays quiet until it is reprogrammed.  A
+   COUNT of 0 is treated by the PIT as 65536. */
+void pit_configure_oneshot(int channel, uint16_t count) {
+  enum intr_level old_level;
+
+  ASSERT(channel == 0 || channel == 2);
+
+  old_level = intr_disable();
+  outb(PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb(PIT_PORT_COUNTER(channel), count);
+  outb(PIT_PORT_COUNTER(channel), count >> 8);
+  intr_set_level(old_level);
+}
+
+/* Returns the current count of CHANNEL, using the read-back
+   command to latch the count and status atomically.  If OUTPUT
+   is nonnull, stores the level of the channel's output pin in
+   *OUTPUT; in mode 0 it is true once the countdown has
+   finished. */
+uint16_t pit_read_count(int channel, bool* output) {
+  enum intr_level old_level;
+  uint8_t status;
+  uint16_t count;
+
+  ASSERT(channel == 0 || channel == 2);
+
+  old_level = intr_disable();
+  outb(PIT_PORT_CONTROL, 0xc0 | (2 << channel));
+  status = inb(PIT_PORT_COUNTER(channel));
+  count = inb(PIT_PORT_COUNTER(channel));
+  count |= inb(PIT_PORT_COUNTER(channel)) << 8;
+  intr_set_level(old_level);
+
+  if (output != NULL)
+    *output = (status & 0x80) != 0;
+  return count;
+}
@@ -0,0 +1,70 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device kept in kernel memory, for scratch or swap
+   data that need not outlive the machine.  Its sectors are one
+   run of pages, so block_map() can hand them out directly and
+   spare a swap transfer the trip through the request queue. */
+
+/* A RAM disk. */
+struct ramdisk {
+  uint8_t* data;   /* Contents, PAGE_CNT pages. */
+  size_t page_cnt; /* Number of pages allocated. */
+};
+
+/* Number of RAM disks created, for naming them. */
+static unsigned ramdisk_cnt;
+
+static struct block_operations ramdisk_operations;
+
+/* Creates and registers a RAM disk of SIZE sectors, zeroed, with
+   the given TYPE.  The RAM disk is named "rd0" for the first one
+   created, "rd1" for the second, and so on.  Panics if there is
+   not enough contiguous kernel memory for it. */
+struct block* ramdisk_create(enum block_type type, block_sector_t size) {
+  struct ramdisk* rd;
+  char name[16];
+
+  ASSERT(size > 0);
+
+  rd = malloc(sizeof *rd);
+  if (rd == NULL)
+    PANIC("Failed to allocate memory for RAM disk descriptor");
+  rd->page_cnt = DIV_ROUND_UP((size_t)size * BLOCK_SECTOR_SIZE, PGSIZE);
+  rd->data = palloc_get_multiple(PAL_ZERO, rd->page_cnt);
+  if (rd->data == NULL)
+    PANIC("Failed to allocate %zu pages for RAM disk", rd->page_cnt);
+
+  snprintf(name, sizeof name, "rd%u", ramdisk_cnt++);
+  return block_register(name, type, "RAM disk", size, &ramdisk_operations, rd);
+}
+
+/* Reads the CNT sectors starting at SECTOR from RAM disk RD_
+   into BUFFER. */
+static void ramdisk_read(void* rd_, block_sector_t sector, size_t cnt, void* buffer) {
+  struct ramdisk* rd = rd_;
+  memcpy(buffer, rd->data + sector * BLOCK_SECTOR_SIZE, cnt * BLOCK_SECTOR_SIZE);
+}
+
+/* Writes the CNT sectors starting at SECTOR to RAM disk RD_ from
+   BUFFER. */
+static void ramdisk_write(void* rd_, block_sector_t sector, size_t cnt, const void* buffer) {
+  struct ramdisk* rd = rd_;
+  memcpy(rd->data + sector * BLOCK_SECTOR_SIZE, buffer, cnt * BLOCK_SECTOR_SIZE);
+}
+
+/* Returns the memory that holds SECTOR of RAM disk RD_ and the
+   sectors after it. */
+static void* ramdisk_map(void* rd_, block_sector_t sector, size_t cnt UNUSED) {
+  struct ramdisk* rd = rd_;
+  return rd->data + sector * BLOCK_SECTOR_SIZE;
+}
+
+static struct block_operations ramdisk_operations = {ramdisk_read, ramdisk_write, ramdisk_map, NULL,
+                                                      NULL, NULL};
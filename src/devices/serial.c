@@ -1,7 +1,8 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <list.h>
+#include <stdio.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -33,6 +34,10 @@
 #define MCR_REG (IO_BASE + 4) /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5) /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01     /* Enable the receive and transmit FIFOs. */
+#define FCR_CLEAR_XMIT 0x04 /* Discard the transmit FIFO's contents. */
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01 /* Interrupt when data received. */
 #define IER_XMIT 0x02 /* Interrupt when transmit finishes. */
@@ -51,11 +56,30 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Data to be transmitted, in a circular buffer.  Written by
+   serial_putc() and serial_putbuf() and drained by the transmit
+   interrupt, TX_BURST bytes at a time: once the transmitter
+   reports that its FIFO is empty, it has room for that many.
+
+   Interrupt handlers print too, so there is more than one
+   producer, and interrupts stay off while the buffer is touched
+   instead of making it lock-free. */
+#define TXQ_SIZE 16384
+#define TX_BURST 16
+static uint8_t txq[TXQ_SIZE];
+static size_t txq_head;         /* New data is written here. */
+static size_t txq_tail;         /* Old data is read here. */
+static struct list txq_waiters; /* Threads waiting for room. */
+static size_t txq_dropped;      /* Bytes dropped for lack of room. */
 
 static void set_serial(int bps);
 static void putc_poll(uint8_t);
+static bool txq_empty(void);
+static bool txq_full(void);
+static uint8_t txq_getc(void);
+static bool txq_wait(enum intr_level);
+static void txq_wake(void);
+static void tx_burst(void);
 static void write_ier(void);
 static intr_handler_func serial_interrupt;
 
@@ -69,7 +93,8 @@ static void init_poll(void) {
   outb(FCR_REG, 0);        /* Disable FIFO. */
   set_serial(9600);        /* 9.6 kbps, N-8-1. */
   outb(MCR_REG, MCR_OUT2); /* Required to enable interrupts. */
-  intq_init(&txq);
+  txq_head = txq_tail = 0;
+  list_init(&txq_waiters);
   mode = POLL;
 }
 
@@ -86,45 +111,81 @@ void serial_init_queue(void) {
   intr_register_ext(0x20 + 4, serial_interrupt, "serial");
   mode = QUEUE;
   old_level = intr_disable();
+  outb(FCR_REG, FCR_ENABLE | FCR_CLEAR_XMIT);
   write_ier();
   intr_set_level(old_level);
 }
 
 /* Sends BYTE to the serial port. */
-void serial_putc(uint8_t byte) {
+void serial_putc(uint8_t byte) { serial_putbuf(&byte, 1); }
+
+/* Sends the SIZE bytes in BUF to the serial port.  In queue mode
+   this only copies them into the transmit buffer, waiting only if
+   it fills up, and the transmit interrupt sends them later.  A
+   caller that cannot wait, because it has interrupts off, loses
+   whatever does not fit; serial_flush() reports how much. */
+void serial_putbuf(const uint8_t* buf, size_t size) {
   enum intr_level old_level = intr_disable();
 
   if (mode != QUEUE) {
     /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit the bytes. */
     if (mode == UNINIT)
       init_poll();
-    putc_poll(byte);
+    while (size-- > 0)
+      putc_poll(*buf++);
   } else {
-    /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-    if (old_level == INTR_OFF && intq_full(&txq)) {
-      /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-      putc_poll(intq_getc(&txq));
+    /* Otherwise, queue the bytes and update the interrupt
+         enable register. */
+    while (size > 0) {
+      if (txq_full() && !txq_wait(old_level)) {
+        txq_dropped += size;
+        break;
+      }
+      while (size > 0 && !txq_full()) {
+        txq[txq_head] = *buf++;
+        txq_head = (txq_head + 1) % TXQ_SIZE;
+        size--;
+      }
+      write_ier();
     }
-
-    intq_putc(&txq, byte);
-    write_ier();
   }
 
   intr_set_level(old_level);
 }
 
 /* Flushes anything in the serial buffer out the port in polling
-   mode. */
+   mode, followed by a note of how many bytes were dropped, if
+   any. */
 void serial_flush(void) {
   enum intr_level old_level = intr_disable();
-  while (!intq_empty(&txq))
-    putc_poll(intq_getc(&txq));
+  while (!txq_empty())
+    putc_poll(txq_getc());
+  if (txq_dropped > 0) {
+    char msg[64];
+    const char* p;
+
+    snprintf(msg, sizeof msg, "(serial: %zu bytes dropped)\n", txq_dropped);
+    for (p = msg; *p != '\0'; p++)
+      putc_poll(*p);
+    txq_dropped = 0;
+  }
+  if (mode != UNINIT)
+    txq_wake();
+  intr_set_level(old_level);
+}
+
+/* Notifies the serial port that a kernel panic is underway.
+   Flushes the transmit buffer and goes back to polling mode, so
+   that the panic message and backtrace come out in order even
+   with interrupts off and nothing is dropped. */
+void serial_panic(void) {
+  enum intr_level old_level = intr_disable();
+  if (mode == QUEUE) {
+    serial_flush();
+    mode = POLL;
+    outb(IER_REG, 0);
+  }
   intr_set_level(old_level);
 }
 
@@ -164,7 +225,7 @@ static void write_ier(void) {
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty(&txq))
+  if (!txq_empty())
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -185,6 +246,66 @@ static void putc_poll(uint8_t byte) {
   outb(THR_REG, byte);
 }
 
+/* Returns true if the transmit buffer is empty. */
+static bool txq_empty(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  return txq_head == txq_tail;
+}
+
+/* Returns true if the transmit buffer is full. */
+static bool txq_full(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  return (txq_head + 1) % TXQ_SIZE == txq_tail;
+}
+
+/* Removes and returns the oldest byte in the transmit buffer,
+   which must not be empty. */
+static uint8_t txq_getc(void) {
+  uint8_t byte;
+
+  ASSERT(!txq_empty());
+  byte = txq[txq_tail];
+  txq_tail = (txq_tail + 1) % TXQ_SIZE;
+  return byte;
+}
+
+/* Makes room in the full transmit buffer.  OLD_LEVEL is the
+   interrupt level of our caller.  If it had interrupts on, we
+   sleep until the transmit interrupt drains a burst and return
+   true.  Otherwise waiting would mean turning interrupts back
+   on, which is impolite, and busy-waiting on the UART would
+   stall the CPU for as long as the output takes, so we only top
+   up the transmit FIFO if it happens to be empty and return
+   whether that made room. */
+static bool txq_wait(enum intr_level old_level) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (old_level == INTR_ON && !intr_context()) {
+    list_push_back(&txq_waiters, &thread_current()->elem);
+    thread_block();
+    return true;
+  }
+  tx_burst();
+  return !txq_full();
+}
+
+/* Wakes up every thread waiting for room in the transmit
+   buffer. */
+static void txq_wake(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  while (!list_empty(&txq_waiters))
+    thread_unblock(list_entry(list_pop_front(&txq_waiters), struct thread, elem));
+}
+
+/* If the transmit FIFO is empty, fills it with up to TX_BURST
+   bytes from the transmit buffer. */
+static void tx_burst(void) {
+  if (!txq_empty() && (inb(LSR_REG) & LSR_THRE) != 0) {
+    int i;
+    for (i = 0; i < TX_BURST && !txq_empty(); i++)
+      outb(THR_REG, txq_getc());
+  }
+}
+
 /* Serial interrupt handler. */
 static void serial_interrupt(struct intr_frame* f UNUSED) {
   /* Inquire about interrupt in UART.  Without this, we can
@@ -196,10 +317,11 @@ static void serial_interrupt(struct intr_frame* f UNUSED) {
   while (!input_full() && (inb(LSR_REG) & LSR_DR) != 0)
     input_putc(inb(RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty(&txq) && (inb(LSR_REG) & LSR_THRE) != 0)
-    outb(THR_REG, intq_getc(&txq));
+  /* If we have bytes to transmit and the transmit FIFO is empty,
+     fill it with a burst, and let writers waiting for room
+     continue. */
+  tx_burst();
+  txq_wake();
 
   /* Update interrupt enable register based on queue status. */
   write_ier();
@@ -4,15 +4,33 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/fpu.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/mq.h"
+#include "vm/swap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -116,12 +134,30 @@ void shutdown_power_off(void) {
 static void print_stats(void) {
   timer_print_stats();
   thread_print_stats();
+  fpu_print_stats();
+  lock_print_stats();
+  palloc_print_stats();
+  malloc_print_stats();
+  kmem_print_stats();
+  wq_print_stats();
+  rcu_print_stats();
 #ifdef FILESYS
   block_print_stats();
+  ide_print_stats();
+  cache_print_stats();
 #endif
   console_print_stats();
   kbd_print_stats();
 #ifdef USERPROG
   exception_print_stats();
+  syscall_print_stats();
+  pagedir_print_stats();
+#endif
+#ifdef VM
+  frame_print_stats();
+  swap_print_stats();
+  mq_print_stats();
 #endif
+  profile_print_stats();
+  trace_print_stats();
 }
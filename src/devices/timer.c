@@ -3,11 +3,16 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "devices/pit.h"
+#include "devices/rtc.h"
 #include "list.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -18,60 +23,141 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Written only with
+   interrupts off, and published in the clock page for readers. */
 static int64_t ticks;
 
 /* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
+   Initialized by timer_calibrate() from tsc_hz. */
 static unsigned loops_per_tick;
-static struct list sleep_list; /* List of sleeping threads ordered by wake_time */
+
+/* High-resolution clock.  timer_calibrate() counts how many TSC
+   cycles go by in CLOCK_CAL_TICKS timer ticks to find tsc_hz,
+   unless the kernel command line gave it.  Then clock_ns()
+   extrapolates from the TSC value the clock page records as its
+   origin.  Until then tsc_hz is 0 and clock_ns() falls back to
+   counting ticks.  The clock page's boot time is the real-time
+   clock's reading at calibration, less the time since boot.
+
+   The clock page, struct clock_page in <time.h>, holds the tick
+   count and the TSC's origin and rate under a sequence count.
+   It is written only with interrupts off, so timer_ticks() and
+   clock_ns() read it without touching the interrupt flag and
+   retry if the timer interrupt updated it under them.  It is a
+   user pool page, which load() maps read-only into every
+   process, so user programs read the same clock without a
+   system call.  Until timer_init() allocates it, EARLY_CLOCK
+   stands in for it. */
+#define NS_PER_SEC 1000000000LL
+#define NS_PER_TICK (NS_PER_SEC / TIMER_FREQ)
+#define CLOCK_CAL_TICKS (TIMER_FREQ / 25)
+#define LOOPS_CAL_LOOPS (1u << 16)
+static uint64_t tsc_hz;
+static struct clock_page early_clock = {.tick_ns = NS_PER_TICK};
+static struct clock_page* clock = &early_clock;
+
+/* Pending callouts are kept in a hierarchical timing wheel, as
+   described by Varghese and Lauck, "Hashed and Hierarchical
+   Timing Wheels".  Level 0 has one slot per tick for the next
+   WHEEL0_SIZE ticks.  Each level above it has WHEELN_SIZE slots
+   that each cover a whole revolution of the level below.  A
+   callout sits in the lowest level whose span reaches its
+   expiry time.  Whenever a level wraps around, the next slot of
+   the level above is "cascaded": its callouts are reinserted and
+   so move down a level.  Adding a callout is O(1), and each
+   callout is moved at most WHEEL_LEVELS - 1 times before it
+   expires.
+
+   wheel_base is the next tick whose level-0 slot has not yet
+   been run.  It normally equals ticks + 1, but it lags behind
+   while tickless idle skips interrupts, and until the timer
+   interrupt's deferred work has run.  That work then catches up,
+   running one callout at a time with interrupts off, but letting
+   other interrupts in between callouts, so that a tick on which
+   many sleepers wake does not hold off every other device. */
+#define WHEEL0_BITS 8
+#define WHEELN_BITS 6
+#define WHEEL0_SIZE (1 << WHEEL0_BITS)
+#define WHEELN_SIZE (1 << WHEELN_BITS)
+#define WHEEL_LEVELS 5
+static struct list wheel0[WHEEL0_SIZE];
+static struct list wheeln[WHEEL_LEVELS - 1][WHEELN_SIZE];
+static int64_t wheel_base;
+static struct intr_work wheel_work;
+
+/* Tickless idle.  While the idle thread runs, there is no point
+   taking an interrupt every tick just to find that no sleeper is
+   due yet, so timer_idle_enter() switches the PIT to a single
+   countdown that ends at the first tick with a callout to run
+   (or as far ahead as the 16-bit counter allows) and
+   timer_idle_exit() switches it back, catching `ticks' up on the
+   ticks that were skipped.  idle_skip is the number of ticks the
+   countdown covers, or 0 when the PIT is in its normal periodic
+   mode. */
+#define PIT_CYCLES_PER_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define IDLE_SKIP_MAX (UINT16_MAX / PIT_CYCLES_PER_TICK)
+static int64_t idle_skip;
 
 static intr_handler_func timer_interrupt;
-static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
 static void real_time_delay(int64_t num, int32_t denom);
-/* Comparison function for ordered insertion */
-static bool wake_time_less(const struct list_elem* a, const struct list_elem* b, void* aux);
-static void timer_wake_sleeping_threads(void); /* Wake threads whose time has expired */
+static void clock_calibrate(uint64_t hz);
+static void clock_set_rate(uint64_t base, int64_t base_ns);
+static void clock_publish_ticks(void);
+static void loops_calibrate(void);
+static void wheel_insert(struct timer_callout*);
+static void wheel_cascade(struct list* slot);
+static void wheel_run(int64_t tick);
+static void wheel_catch_up(void* aux);
+static bool wheel_idle_until(int64_t tick);
+static void timer_wake_thread(void* t);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void timer_init(void) {
-  list_init(&sleep_list);
+  int level, i;
+
+  for (i = 0; i < WHEEL0_SIZE; i++)
+    list_init(&wheel0[i]);
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    for (i = 0; i < WHEELN_SIZE; i++)
+      list_init(&wheeln[level][i]);
+  wheel_base = 1;
+  intr_work_init(&wheel_work, wheel_catch_up, NULL);
+  clock = palloc_get_page(PAL_USER | PAL_ZERO | PAL_ASSERT);
+  clock->tick_ns = NS_PER_TICK;
   pit_configure_channel(0, 2, TIMER_FREQ);
   intr_register_ext(0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
-void timer_calibrate(void) {
-  unsigned high_bit, test_bit;
-
+/* Calibrates the TSC, used by clock_ns(), and loops_per_tick,
+   used to implement brief delays.  If HZ is nonzero, it is taken
+   as the TSC's rate, as printed by an earlier boot on the same
+   machine, which saves timing it against the timer. */
+void timer_calibrate(uint64_t hz) {
   ASSERT(intr_get_level() == INTR_ON);
   printf("Calibrating timer...  ");
 
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops(loops_per_tick << 1)) {
-    loops_per_tick <<= 1;
-    ASSERT(loops_per_tick != 0);
-  }
-
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops(loops_per_tick | test_bit))
-      loops_per_tick |= test_bit;
+  clock_calibrate(hz);
+  loops_calibrate();
 
-  printf("%'" PRIu64 " loops/s.\n", (uint64_t)loops_per_tick * TIMER_FREQ);
+  printf("%'" PRIu64 " loops/s, %'" PRIu64 " TSC cycles/s.\n",
+         (uint64_t)loops_per_tick * TIMER_FREQ, tsc_hz);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t timer_ticks(void) {
-  enum intr_level old_level = intr_disable();
-  int64_t t = ticks;
-  intr_set_level(old_level);
+  const volatile struct clock_page* cp = clock;
+  uint32_t seq;
+  int64_t t;
+
+  do {
+    seq = cp->seq;
+    barrier();
+    t = cp->ticks;
+    barrier();
+  } while ((seq & 1) != 0 || seq != cp->seq);
   return t;
 }
 
@@ -79,6 +165,30 @@ int64_t timer_ticks(void) {
    should be a value once returned by timer_ticks(). */
 int64_t timer_elapsed(int64_t then) { return timer_ticks() - then; }
 
+/* Returns the number of nanoseconds since the OS booted,
+   measured with the TSC once timer_calibrate() has run and in
+   whole timer ticks before that. */
+int64_t clock_ns(void) { return clock_page_read(clock, NULL); }
+
+/* Converts CYCLES TSC cycles to nanoseconds.  Returns 0 until
+   timer_calibrate() has run. */
+int64_t clock_cycles_to_ns(uint64_t cycles) {
+  return clock_page_cycles_to_ns(cycles, clock->mult, clock->shift);
+}
+
+/* Returns the number of seconds since the Unix epoch. */
+int64_t clock_realtime(void) {
+  int64_t boot_time;
+  int64_t ns = clock_page_read(clock, &boot_time);
+
+  return boot_time + ns / NS_PER_SEC;
+}
+
+/* Returns the clock page, to be mapped read-only into user
+   processes.  Each mapping must hold a reference added with
+   palloc_share_page(). */
+void* timer_clock_page(void) { return clock; }
+
 /* Sleeps for approximately TICKS timer ticks. Interrupts MUST be on to avoid deadlocks. */
 void timer_sleep(int64_t ticks) {
   if (ticks <= 0) {
@@ -89,14 +199,59 @@ void timer_sleep(int64_t ticks) {
 
   enum intr_level old_level = intr_disable();
   struct thread* t = thread_current();
-  t->wake_time = timer_ticks() + ticks;
-  list_insert_ordered(&sleep_list, &t->sleepelem, wake_time_less, NULL);
+  timer_add_callout(&t->sleep_callout, ticks, timer_wake_thread, t);
 
   thread_block();
 
   intr_set_level(old_level);
 }
 
+/* Arranges for FN to be called with AUX as its argument from
+   the timer interrupt's deferred work, TICKS timer ticks from
+   now (but at least on the next tick).  C is caller-provided
+   storage for the callout, which must stay valid until FN is
+   called or the callout is cancelled.  C must not already be
+   pending.
+
+   FN runs in interrupt context with interrupts off, so it must
+   not sleep, but it may call intr_yield_on_return() or add
+   callouts. */
+void timer_add_callout(struct timer_callout* c, int64_t ticks, timer_callout_func* fn,
+                       void* aux) {
+  enum intr_level old_level;
+
+  ASSERT(c != NULL);
+  ASSERT(fn != NULL);
+
+  old_level = intr_disable();
+  ASSERT(!c->pending);
+  c->expires = timer_ticks() + (ticks > 0 ? ticks : 1);
+  c->fn = fn;
+  c->aux = aux;
+  c->pending = true;
+  wheel_insert(c);
+  intr_set_level(old_level);
+}
+
+/* Cancels callout C if it is still pending.  Returns true if C
+   was cancelled, false if it had already run (or was never
+   added). */
+bool timer_cancel_callout(struct timer_callout* c) {
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT(c != NULL);
+
+  old_level = intr_disable();
+  was_pending = c->pending;
+  if (was_pending) {
+    list_remove(&c->elem);
+    c->pending = false;
+  }
+  intr_set_level(old_level);
+  return was_pending;
+}
+
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
    turned on. */
 void timer_msleep(int64_t ms) { real_time_sleep(ms, 1000); }
@@ -136,31 +291,187 @@ void timer_udelay(int64_t us) { real_time_delay(us, 1000 * 1000); }
    instead if interrupts are enabled.*/
 void timer_ndelay(int64_t ns) { real_time_delay(ns, 1000 * 1000 * 1000); }
 
+/* Finds tsc_hz by timing CLOCK_CAL_TICKS timer ticks with the
+   TSC, unless HZ is nonzero, in which case it is used as is, and
+   sets the clock's origin. */
+static void clock_calibrate(uint64_t hz) {
+  uint64_t start_tsc, end_tsc;
+  int64_t start;
+
+  if (hz != 0) {
+    /* The origin is only as good as the tick count, but that
+       is as good as clock_ns() was before now. */
+    tsc_hz = hz;
+    clock_set_rate(rdtsc(), timer_ticks() * NS_PER_TICK);
+  } else {
+    /* Wait for a timer tick. */
+    start = timer_ticks();
+    while (timer_ticks() == start)
+      barrier();
+
+    start = timer_ticks();
+    start_tsc = rdtsc();
+    while (timer_ticks() < start + CLOCK_CAL_TICKS)
+      barrier();
+    end_tsc = rdtsc();
+
+    tsc_hz = (end_tsc - start_tsc) * TIMER_FREQ / CLOCK_CAL_TICKS;
+    clock_set_rate(end_tsc, (start + CLOCK_CAL_TICKS) * NS_PER_TICK);
+  }
+}
+
+/* Sets the clock page's origin to TSC value BASE, read BASE_NS
+   nanoseconds after boot, and its rate from tsc_hz.  MULT is
+   made as precise as 32 bits allow. */
+static void clock_set_rate(uint64_t base, int64_t base_ns) {
+  int64_t boot_time = (int64_t)rtc_get_time() - base_ns / NS_PER_SEC;
+  enum intr_level old_level;
+  uint32_t shift;
+
+  for (shift = 32; shift > 0 && ((uint64_t)NS_PER_SEC << shift) / tsc_hz > UINT32_MAX; shift--)
+    continue;
+
+  old_level = intr_disable();
+  clock->seq++;
+  barrier();
+  clock->tsc_base = base;
+  clock->base_ns = base_ns;
+  clock->shift = shift;
+  clock->mult = ((uint64_t)NS_PER_SEC << shift) / tsc_hz;
+  clock->boot_time = boot_time;
+  barrier();
+  clock->seq++;
+  intr_set_level(old_level);
+}
+
+/* Publishes `ticks' in the clock page.  Interrupts must be
+   off. */
+static void clock_publish_ticks(void) {
+  clock->seq++;
+  barrier();
+  clock->ticks = ticks;
+  barrier();
+  clock->seq++;
+}
+
+/* Derives loops_per_tick from tsc_hz by timing LOOPS_CAL_LOOPS
+   iterations of busy_wait() with the TSC.  Interrupts are off
+   meanwhile, so that none of them count as loop time. */
+static void loops_calibrate(void) {
+  enum intr_level old_level;
+  uint64_t cycles;
+
+  old_level = intr_disable();
+  cycles = rdtsc();
+  busy_wait(LOOPS_CAL_LOOPS);
+  cycles = rdtsc() - cycles;
+  intr_set_level(old_level);
+
+  loops_per_tick = LOOPS_CAL_LOOPS * (tsc_hz / TIMER_FREQ) / (cycles > 0 ? cycles : 1);
+  if (loops_per_tick == 0)
+    loops_per_tick = 1;
+}
+
 /* Prints timer statistics. */
 void timer_print_stats(void) { printf("Timer: %" PRId64 " ticks\n", timer_ticks()); }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  If no callout is due on the next tick,
+   reprograms the PIT to interrupt only once, when the next
+   callout is due, instead of on every tick.  If the CPU is
+   already idling, the countdown set up last time keeps
+   running. */
+void timer_idle_enter(void) {
+  int64_t skip = 1;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  /* Still counting down from the last time the CPU idled. */
+  if (idle_skip != 0)
+    return;
+
+  /* Every tick but the last one of the countdown is skipped, so
+     none of those may have any callouts to run. */
+  while (skip < IDLE_SKIP_MAX && wheel_idle_until(ticks + skip))
+    skip++;
+
+  /* The MLFQS load average must be sampled by a real tick at
+     every whole second, so never skip past one. */
+  if (active_sched_policy == SCHED_MLFQS && TIMER_FREQ - ticks % TIMER_FREQ < skip)
+    skip = TIMER_FREQ - ticks % TIMER_FREQ;
+
+  if (skip < 2)
+    return;
+
+  idle_skip = skip;
+  pit_configure_oneshot(0, skip * PIT_CYCLES_PER_TICK);
+}
+
+/* Called, with interrupts off, when the idle thread stops
+   running.  If the PIT is still counting down from
+   timer_idle_enter(), advances `ticks' by the number of whole
+   ticks that have passed and returns the PIT to periodic mode.
+
+   Exactly one timer interrupt is pending afterward: either the
+   countdown already finished, or the switch back to periodic
+   mode raises the PIT output and so raises IRQ 0.  That
+   interrupt delivers the final tick of the idle period through
+   the usual path, so this function counts one tick fewer than
+   it skipped at most. */
+void timer_idle_exit(void) {
+  uint16_t remaining;
+  bool finished;
+  int64_t elapsed;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (idle_skip == 0)
+    return;
+
+  remaining = pit_read_count(0, &finished);
+  if (finished)
+    elapsed = idle_skip - 1;
+  else {
+    elapsed = (idle_skip * PIT_CYCLES_PER_TICK - remaining) / PIT_CYCLES_PER_TICK;
+    if (elapsed > idle_skip - 1)
+      elapsed = idle_skip - 1;
+  }
+
+  pit_configure_channel(0, 2, TIMER_FREQ);
+  ticks += elapsed;
+  clock_publish_ticks();
+  thread_idle_ticks(elapsed);
+  idle_skip = 0;
+}
+
 /* Timer interrupt handler. */
-static void timer_interrupt(struct intr_frame* args UNUSED) {
+static void timer_interrupt(struct intr_frame* args) {
+  if (idle_skip != 0) {
+    /* The tickless countdown ran to completion.  Account for the
+       ticks it skipped, then handle the last one normally. */
+    pit_configure_channel(0, 2, TIMER_FREQ);
+    ticks += idle_skip - 1;
+    thread_idle_ticks(idle_skip - 1);
+    idle_skip = 0;
+  }
+
   ticks++;
-  timer_wake_sleeping_threads();
-  thread_tick();
+  clock_publish_ticks();
+  if (wheel_base <= ticks)
+    intr_defer(&wheel_work);
+  thread_tick(args);
 }
 
-/* Returns true if LOOPS iterations waits for more than one timer
-   tick, otherwise false. */
-static bool too_many_loops(unsigned loops) {
-  /* Wait for a timer tick. */
-  int64_t start = ticks;
-  while (ticks == start)
-    barrier();
-
-  /* Run LOOPS loops. */
-  start = ticks;
-  busy_wait(loops);
+/* Deferred work for the timer interrupt: runs the wheel up to
+   the current tick. */
+static void wheel_catch_up(void* aux UNUSED) {
+  enum intr_level old_level = intr_disable();
 
-  /* If the tick count changed, we iterated too long. */
-  barrier();
-  return start != ticks;
+  while (wheel_base <= ticks) {
+    wheel_run(wheel_base);
+    wheel_base++;
+  }
+  intr_set_level(old_level);
 }
 
 /* Iterates through a simple loop LOOPS times, for implementing
@@ -177,51 +488,132 @@ static void NO_INLINE busy_wait(int64_t loops) {
 
 /* Sleep for approximately NUM/DENOM seconds. */
 static void real_time_sleep(int64_t num, int32_t denom) {
-  /* Convert NUM/DENOM seconds into timer ticks, rounding down.
-
-        (NUM / DENOM) s
-     ---------------------- = NUM * TIMER_FREQ / DENOM ticks.
-     1 s / TIMER_FREQ ticks
-  */
-  int64_t ticks = num * TIMER_FREQ / denom;
+  int64_t deadline, left;
 
   ASSERT(intr_get_level() == INTR_ON);
-  if (ticks > 0) {
-    /* We're waiting for at least one full timer tick.  Use
-         timer_sleep() because it will yield the CPU to other
-         processes. */
-    timer_sleep(ticks);
-  } else {
-    /* Otherwise, use a busy-wait loop for more accurate
-         sub-tick timing. */
-    real_time_delay(num, denom);
+  if (tsc_hz == 0) {
+    /* Without a calibrated clock, wait for whole timer ticks
+       with timer_sleep() and busy-wait for anything shorter.
+
+          (NUM / DENOM) s
+       ---------------------- = NUM * TIMER_FREQ / DENOM ticks.
+       1 s / TIMER_FREQ ticks
+    */
+    int64_t ticks = num * TIMER_FREQ / denom;
+    if (ticks > 0)
+      timer_sleep(ticks);
+    else
+      real_time_delay(num, denom);
+    return;
+  }
+
+  /* Block in timer_sleep() for as many whole ticks as fit before
+     the deadline.  timer_sleep(N) wakes at the Nth tick boundary
+     from now, which is less than N ticks away, so it never
+     overshoots.  The PIT tick is the only timer interrupt, so
+     whatever remains of the last tick is spent yielding the CPU
+     to other threads in a loop instead of spinning in
+     busy_wait(). */
+  deadline = clock_ns() + num * (NS_PER_SEC / denom);
+  while ((left = deadline - clock_ns()) > 0) {
+    if (left >= NS_PER_TICK)
+      timer_sleep(left / NS_PER_TICK);
+    else
+      thread_yield();
   }
 }
 
 /* Busy-wait for approximately NUM/DENOM seconds. */
 static void real_time_delay(int64_t num, int32_t denom) {
+  /* Once the TSC is calibrated, spin on it: unlike the loop
+     count, it does not depend on how busy_wait() is aligned or
+     on interrupts arriving in the meantime. */
+  if (tsc_hz != 0) {
+    uint64_t start = rdtsc();
+    uint64_t cycles = num > 0 ? tsc_hz / (denom / 1000) * num / 1000 : 0;
+    while (rdtsc() - start < cycles)
+      barrier();
+    return;
+  }
+
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT(denom % 1000 == 0);
   busy_wait(loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
 }
 
-static bool wake_time_less(const struct list_elem* a, const struct list_elem* b, UNUSED void* aux) {
-  struct thread* thread_a = list_entry(a, struct thread, sleepelem);
-  struct thread* thread_b = list_entry(b, struct thread, sleepelem);
-  return thread_a->wake_time < thread_b->wake_time;
+/* Puts pending callout C into the timing wheel slot for its
+   expiry time. */
+static void wheel_insert(struct timer_callout* c) {
+  int64_t expires = c->expires < wheel_base ? wheel_base : c->expires;
+  int64_t delta = expires - wheel_base;
+  int level;
+
+  if (delta < WHEEL0_SIZE) {
+    list_push_back(&wheel0[expires & (WHEEL0_SIZE - 1)], &c->elem);
+    return;
+  }
+
+  for (level = 0; level < WHEEL_LEVELS - 2; level++)
+    if (delta < (int64_t)1 << (WHEEL0_BITS + (level + 1) * WHEELN_BITS))
+      break;
+
+  /* Callouts beyond the top level's span wait in its farthest
+     slot and are reinserted each time it cascades. */
+  if (delta >= (int64_t)1 << (WHEEL0_BITS + (level + 1) * WHEELN_BITS))
+    expires = wheel_base + ((int64_t)1 << (WHEEL0_BITS + (level + 1) * WHEELN_BITS)) - 1;
+
+  list_push_back(&wheeln[level][(expires >> (WHEEL0_BITS + level * WHEELN_BITS)) & (WHEELN_SIZE - 1)],
+                 &c->elem);
+}
+
+/* Reinserts every callout in SLOT, which moves each of them down
+   to a lower level of the wheel. */
+static void wheel_cascade(struct list* slot) {
+  struct list pending;
+
+  list_init(&pending);
+  while (!list_empty(slot))
+    list_push_back(&pending, list_pop_front(slot));
+  while (!list_empty(&pending))
+    wheel_insert(list_entry(list_pop_front(&pending), struct timer_callout, elem));
 }
 
-/* Wake threads whose time has expired */
-static void timer_wake_sleeping_threads(void) {
-  int64_t ticks = timer_ticks();
-  while (!list_empty(&sleep_list)) {
-    struct list_elem* e = list_front(&sleep_list);
-    struct thread* t = list_entry(e, struct thread, sleepelem);
-    if (t->wake_time > ticks) {
+/* Runs the callouts that expire at TICK, which must equal
+   wheel_base, first cascading any upper-level slots whose turn
+   starts at TICK.  Must be called with interrupts off, but turns
+   them on briefly after each callout. */
+static void wheel_run(int64_t tick) {
+  struct list* slot = &wheel0[tick & (WHEEL0_SIZE - 1)];
+  int level;
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+    int shift = WHEEL0_BITS + level * WHEELN_BITS;
+    if ((tick & (((int64_t)1 << shift) - 1)) != 0)
       break;
-    }
-    list_remove(e);
-    thread_unblock(t);
+    wheel_cascade(&wheeln[level][(tick >> shift) & (WHEELN_SIZE - 1)]);
+  }
+
+  while (!list_empty(slot)) {
+    struct timer_callout* c = list_entry(list_pop_front(slot), struct timer_callout, elem);
+    c->pending = false;
+    c->fn(c->aux);
+    intr_enable();
+    intr_disable();
   }
 }
+
+/* Returns true if running the wheel up to and including TICK
+   would do nothing: no callout expires and no cascade is due.
+   TICK must be less than wheel_base + WHEEL0_SIZE. */
+static bool wheel_idle_until(int64_t tick) {
+  int64_t t;
+
+  for (t = wheel_base; t <= tick; t++)
+    if ((t & (WHEEL0_SIZE - 1)) == 0 || !list_empty(&wheel0[t & (WHEEL0_SIZE - 1)]))
+      return false;
+  return true;
+}
+
+/* Callout function for timer_sleep(): wakes thread T. */
+static void timer_wake_thread(void* t) { thread_unblock(t); }
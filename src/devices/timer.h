@@ -1,29 +1,59 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Function called when a timer callout expires. */
+typedef void timer_callout_func(void* aux);
+
+/* A function call scheduled for a future timer tick.  Storage
+   is provided by the caller, usually embedded in some other
+   structure, so adding a callout never allocates memory. */
+struct timer_callout {
+  int64_t expires;         /* Tick at which to run. */
+  timer_callout_func* fn;  /* Function to call. */
+  void* aux;               /* Argument to FN. */
+  bool pending;            /* Added and not yet run or cancelled. */
+  struct list_elem elem;   /* Element in a timing wheel slot. */
+};
+
 void timer_init(void);
-void timer_calibrate(void);
+void timer_calibrate(uint64_t tsc_hz);
 
 int64_t timer_ticks(void);
 int64_t timer_elapsed(int64_t);
 
+/* High-resolution clock. */
+int64_t clock_ns(void);
+int64_t clock_cycles_to_ns(uint64_t cycles);
+int64_t clock_realtime(void);
+void* timer_clock_page(void);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep(int64_t ticks);
 void timer_msleep(int64_t milliseconds);
 void timer_usleep(int64_t microseconds);
 void timer_nsleep(int64_t nanoseconds);
 
+/* Run a function from the timer interrupt at a future tick. */
+void timer_add_callout(struct timer_callout*, int64_t ticks, timer_callout_func*, void* aux);
+bool timer_cancel_callout(struct timer_callout*);
+
 /* Busy waits. */
 void timer_mdelay(int64_t milliseconds);
 void timer_udelay(int64_t microseconds);
 void timer_ndelay(int64_t nanoseconds);
 
+/* Tickless idle. */
+void timer_idle_enter(void);
+void timer_idle_exit(void);
+
 void timer_print_stats(void);
 
 #endif /* devices/timer.h */
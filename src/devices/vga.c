@@ -8,7 +8,15 @@
 #include "threads/interrupt.h"
 #include "threads/vaddr.h"
 
-/* VGA text screen support.  See [FREEVGA] for more information. */
+/* VGA text screen support.  See [FREEVGA] for more information.
+
+   Video memory is slow to write and slower still to read back, so
+   text is drawn into a copy of the screen in ordinary memory
+   instead.  Its rows form a ring, so that scrolling moves no
+   characters, only the index of the top row.  After each call
+   into this module, the rows that changed are copied to the
+   framebuffer together, and the hardware cursor, which takes
+   several port writes to move, is set once. */
 
 /* Number of columns and rows on the text display. */
 #define COL_CNT 80
@@ -18,6 +26,9 @@
    the display. */
 static size_t cx, cy;
 
+/* Cursor position last written to the hardware. */
+static size_t hw_cx, hw_cy;
+
 /* Attribute value for gray text on a black background. */
 #define GRAY_ON_BLACK 0x07
 
@@ -26,9 +37,22 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+/* Copy of the screen.  Row y of the display is
+   shadow[(top + y) % ROW_CNT]. */
+static uint8_t shadow[ROW_CNT][COL_CNT][2];
+static size_t top;
+
+/* Rows of the display, from DIRTY_LO up to but not including
+   DIRTY_HI, that differ from the framebuffer. */
+static size_t dirty_lo, dirty_hi;
+
+static void render(int c, enum intr_level);
+static uint8_t (*row(size_t y))[2];
+static void mark_dirty(size_t y);
 static void clear_row(size_t y);
 static void cls(void);
 static void newline(void);
+static void flush(void);
 static void move_cursor(void);
 static void find_cursor(size_t* x, size_t* y);
 
@@ -38,7 +62,10 @@ static void init(void) {
   static bool inited;
   if (!inited) {
     fb = ptov(0xb8000);
+    memcpy(shadow, fb, sizeof shadow);
     find_cursor(&cx, &cy);
+    hw_cx = cx;
+    hw_cy = cy;
     inited = true;
   }
 }
@@ -51,7 +78,30 @@ void vga_putc(int c) {
   enum intr_level old_level = intr_disable();
 
   init();
+  render(c, old_level);
+  flush();
+
+  intr_set_level(old_level);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display, as
+   vga_putc() would one at a time. */
+void vga_putbuf(const char* buffer, size_t n) {
+  enum intr_level old_level = intr_disable();
+  size_t i;
+
+  init();
+  for (i = 0; i < n; i++)
+    render(buffer[i], old_level);
+  flush();
 
+  intr_set_level(old_level);
+}
+
+/* Draws C into the shadow copy of the screen, interpreting
+   control characters.  Interrupts are off, and OLD_LEVEL is the
+   level to restore while beeping. */
+static void render(int c, enum intr_level old_level) {
   switch (c) {
     case '\n':
       newline();
@@ -83,17 +133,27 @@ void vga_putc(int c) {
       break;
 
     default:
-      fb[cy][cx][0] = c;
-      fb[cy][cx][1] = GRAY_ON_BLACK;
+      row(cy)[cx][0] = c;
+      row(cy)[cx][1] = GRAY_ON_BLACK;
+      mark_dirty(cy);
       if (++cx >= COL_CNT)
         newline();
       break;
   }
+}
 
-  /* Update cursor position. */
-  move_cursor();
-
-  intr_set_level(old_level);
+/* Returns row Y of the display in the shadow copy. */
+static uint8_t (*row(size_t y))[2] { return shadow[(top + y) % ROW_CNT]; }
+
+/* Notes that row Y of the display has changed. */
+static void mark_dirty(size_t y) {
+  if (dirty_lo >= dirty_hi) {
+    dirty_lo = y;
+    dirty_hi = y + 1;
+  } else if (y < dirty_lo)
+    dirty_lo = y;
+  else if (y >= dirty_hi)
+    dirty_hi = y + 1;
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
@@ -104,7 +164,6 @@ static void cls(void) {
     clear_row(y);
 
   cx = cy = 0;
-  move_cursor();
 }
 
 /* Clears row Y to spaces. */
@@ -112,21 +171,41 @@ static void clear_row(size_t y) {
   size_t x;
 
   for (x = 0; x < COL_CNT; x++) {
-    fb[y][x][0] = ' ';
-    fb[y][x][1] = GRAY_ON_BLACK;
+    row(y)[x][0] = ' ';
+    row(y)[x][1] = GRAY_ON_BLACK;
   }
+  mark_dirty(y);
 }
 
 /* Advances the cursor to the first column in the next line on
    the screen.  If the cursor is already on the last line on the
-   screen, scrolls the screen upward one line. */
+   screen, scrolls the screen upward one line, which changes
+   every row. */
 static void newline(void) {
   cx = 0;
   cy++;
   if (cy >= ROW_CNT) {
     cy = ROW_CNT - 1;
-    memmove(&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+    top = (top + 1) % ROW_CNT;
     clear_row(ROW_CNT - 1);
+    dirty_lo = 0;
+    dirty_hi = ROW_CNT;
+  }
+}
+
+/* Copies the rows that changed to the framebuffer and moves the
+   hardware cursor to (cx,cy) if it is elsewhere. */
+static void flush(void) {
+  size_t y;
+
+  for (y = dirty_lo; y < dirty_hi; y++)
+    memcpy(fb[y], row(y), sizeof fb[y]);
+  dirty_lo = dirty_hi = 0;
+
+  if (cx != hw_cx || cy != hw_cy) {
+    move_cursor();
+    hw_cx = cx;
+    hw_cy = cy;
   }
 }
 
@@ -0,0 +1,426 @@
+#include "devices/virtio.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a driver for virtio-blk disks, the
+   paravirtual disks that QEMU offers with "-drive if=virtio".
+   It uses the legacy PCI interface of [VIRTIO] 0.9.5, which
+   every QEMU version supports, through I/O ports.
+
+   Unlike an IDE channel, which carries out one command at a
+   time, a virtio disk takes requests through a ring of
+   descriptors in memory, the virtqueue, and completes them in
+   any order, so the driver provides the block layer's start
+   operation and keeps as many requests in flight as the ring has
+   room for.
+
+   A disk that offers VIRTIO_BLK_F_FLUSH has a write cache, which
+   VIRTIO_BLK_T_FLUSH requests flush.  Legacy virtio-blk has no
+   forced unit access, so a block request with FLUSH or FUA set
+   becomes up to three virtio requests in a row on its slot: a
+   flush, the transfer and another flush.  A disk that does not
+   offer the feature writes through, so neither is needed. */
+
+/* Vendor and device IDs of a legacy virtio-blk PCI function. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio I/O port addresses. */
+#define reg_features(DISK) ((DISK)->io_base + 0x00)       /* Device features (r/o). */
+#define reg_guest_features(DISK) ((DISK)->io_base + 0x04) /* Driver features. */
+#define reg_queue_pfn(DISK) ((DISK)->io_base + 0x08)      /* Page number of queue. */
+#define reg_queue_size(DISK) ((DISK)->io_base + 0x0c)     /* Queue size (r/o). */
+#define reg_queue_select(DISK) ((DISK)->io_base + 0x0e)   /* Queue to configure. */
+#define reg_queue_notify(DISK) ((DISK)->io_base + 0x10)   /* Queue with new requests. */
+#define reg_status(DISK) ((DISK)->io_base + 0x12)         /* Device status. */
+#define reg_isr(DISK) ((DISK)->io_base + 0x13)            /* Interrupt status (r/o). */
+#define reg_capacity(DISK) ((DISK)->io_base + 0x14)       /* 64-bit size in sectors. */
+
+/* Feature bits. */
+#define VIRTIO_BLK_F_FLUSH (1u << 9) /* Has a write cache and flush requests. */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Driver found the device. */
+#define STATUS_DRIVER 0x02      /* Driver knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+#define STATUS_FAILED 0x80      /* Driver gave up. */
+
+/* Interrupt status bits.  Reading the register clears them. */
+#define ISR_QUEUE 0x01 /* A queue has completed requests. */
+
+/* A virtqueue descriptor, which tells the device where in memory
+   one piece of a request is. */
+struct vring_desc {
+  uint64_t addr;  /* Physical address. */
+  uint32_t len;   /* Length in bytes. */
+  uint16_t flags; /* VRING_DESC_F_*. */
+  uint16_t next;  /* Next descriptor of the request, if F_NEXT. */
+};
+
+#define VRING_DESC_F_NEXT 1  /* The request continues at NEXT. */
+#define VRING_DESC_F_WRITE 2 /* The device writes this piece. */
+
+/* Ring of requests that the driver makes available. */
+struct vring_avail {
+  uint16_t flags;  /* 0. */
+  uint16_t idx;    /* Where the driver puts the next request. */
+  uint16_t ring[]; /* First descriptors of requests. */
+};
+
+/* Ring of requests that the device has completed. */
+struct vring_used {
+  uint16_t flags; /* Set by the device. */
+  uint16_t idx;   /* Where the device puts the next request. */
+  struct {
+    uint32_t id;  /* First descriptor of the request. */
+    uint32_t len; /* Bytes that the device wrote. */
+  } ring[];
+};
+
+/* Virtqueue alignment of the used ring. */
+#define VRING_ALIGN PGSIZE
+
+/* Header of a virtio-blk request. */
+struct virtio_blk_hdr {
+  uint32_t type;     /* VIRTIO_BLK_T_*. */
+  uint32_t reserved; /* 0. */
+  uint64_t sector;   /* First sector. */
+};
+
+#define VIRTIO_BLK_T_IN 0    /* Read. */
+#define VIRTIO_BLK_T_OUT 1   /* Write. */
+#define VIRTIO_BLK_T_FLUSH 4 /* Flush the write cache. */
+
+/* Descriptors per request: header, data and status.  A flush
+   skips the data descriptor. */
+#define DESCS_PER_REQ 3
+
+/* A slot for one request in flight.  Slot I owns descriptors
+   I * DESCS_PER_REQ through I * DESCS_PER_REQ + 2. */
+struct slot {
+  struct virtio_blk_hdr hdr; /* Header that the device reads. */
+  uint8_t status;            /* Status that the device writes, 0 if OK. */
+  struct block_request* req; /* Request in flight, or null if free. */
+  bool transfer_next;        /* Move REQ's data once the flush in flight is done? */
+  bool flush_next;           /* Flush once REQ's data has moved? */
+};
+
+/* A virtio-blk disk. */
+struct virtio_disk {
+  char name[8];     /* Name, e.g. "vda". */
+  uint16_t io_base; /* Base I/O port. */
+  uint8_t irq;      /* Interrupt in use. */
+  bool flush;       /* Has a write cache, so honor FLUSH and FUA? */
+
+  uint16_t queue_size;              /* Descriptors in the virtqueue. */
+  size_t queue_pages;               /* Pages the virtqueue spans. */
+  struct vring_desc* desc;          /* Descriptor table. */
+  struct vring_avail* avail;        /* Available ring. */
+  volatile struct vring_used* used; /* Used ring. */
+  uint16_t last_used;               /* Index in USED of the next completion. */
+
+  struct slot* slots; /* Requests in flight.  Interrupts off. */
+  size_t slot_cnt;    /* Number of slots. */
+
+  struct intr_work retire_work; /* Deferred retire_requests(). */
+};
+
+/* Disks on channels numbered from here up, each a channel of its
+   own, clear of the IDE channel numbers. */
+#define VIRTIO_CHANNEL_BASE 16
+
+/* Most virtio-blk disks we drive. */
+#define DISK_MAX 4
+static struct virtio_disk disks[DISK_MAX];
+static size_t disk_cnt;
+
+static struct block_operations virtio_operations;
+
+static bool setup_disk(struct virtio_disk*, pci_addr_t);
+static bool setup_queue(struct virtio_disk*);
+static void interrupt_handler(struct intr_frame*);
+static void retire_requests(void* d);
+
+/* Finds virtio-blk disks on the PCI bus, sets them up and
+   registers them with the block layer.  Must run after threads
+   have started, since registering a disk reads its partition
+   table. */
+void virtio_init(void) {
+  pci_addr_t addrs[DISK_MAX];
+  size_t addr_cnt = pci_find_devices(VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, addrs, DISK_MAX);
+  size_t i;
+
+  for (i = 0; i < addr_cnt; i++) {
+    struct virtio_disk* d = &disks[disk_cnt];
+    char extra_info[64];
+    block_sector_t capacity;
+    struct block* block;
+    size_t j;
+
+    snprintf(d->name, sizeof d->name, "vd%c", 'a' + (int)disk_cnt);
+    if (!setup_disk(d, addrs[i]))
+      continue;
+    disk_cnt++;
+    intr_work_init(&d->retire_work, retire_requests, d);
+
+    /* Disks may share an interrupt line, and so a handler. */
+    for (j = 0; j + 1 < disk_cnt; j++)
+      if (disks[j].irq == d->irq)
+        break;
+    if (j + 1 == disk_cnt)
+      intr_register_ext(d->irq, interrupt_handler, d->name);
+
+    /* Capacities past 2 TB do not fit a block_sector_t. */
+    capacity = inl(reg_capacity(d) + 4) == 0 ? inl(reg_capacity(d)) : UINT32_MAX;
+    snprintf(extra_info, sizeof extra_info, "virtio, %zu requests in flight", d->slot_cnt);
+    block = block_register(d->name, BLOCK_RAW, extra_info, capacity, &virtio_operations, d);
+    block_set_channel(block, VIRTIO_CHANNEL_BASE + (d - disks));
+    partition_scan(block);
+  }
+}
+
+/* Resets the virtio-blk device at PCI function ADDR and sets up
+   D to drive it.  Returns true if successful, false if the
+   device is unusable, in which case it is left failed. */
+static bool setup_disk(struct virtio_disk* d, pci_addr_t addr) {
+  uint32_t bar = pci_read_config(addr, PCI_REG_BAR(0));
+  uint8_t line = pci_read_config(addr, PCI_REG_INTERRUPT) & 0xff;
+  uint32_t command;
+
+  if ((bar & 1) == 0 || (bar & ~3u) == 0) { /* Must be an I/O port. */
+    printf("%s: no I/O ports, ignoring\n", d->name);
+    return false;
+  }
+  if (line == 0 || line >= 16) {
+    printf("%s: no interrupt line, ignoring\n", d->name);
+    return false;
+  }
+  d->io_base = bar & ~3u;
+  d->irq = line + 0x20;
+
+  command = pci_read_config(addr, PCI_REG_COMMAND);
+  pci_write_config(addr, PCI_REG_COMMAND, command | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+
+  /* Reset, then say hello.  The only optional feature we want is
+     flushing the write cache, which a disk that has one must be
+     told how to do. */
+  outb(reg_status(d), 0);
+  outb(reg_status(d), STATUS_ACKNOWLEDGE);
+  outb(reg_status(d), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  d->flush = (inl(reg_features(d)) & VIRTIO_BLK_F_FLUSH) != 0;
+  outl(reg_guest_features(d), d->flush ? VIRTIO_BLK_F_FLUSH : 0);
+
+  if (!setup_queue(d)) {
+    outb(reg_status(d), STATUS_FAILED);
+    return false;
+  }
+  outb(reg_status(d), STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  return true;
+}
+
+/* Allocates and lays out D's virtqueue, allocates a slot for
+   every request that fits into it, and hands the queue to the
+   device.  Returns true if successful, false on failure. */
+static bool setup_queue(struct virtio_disk* d) {
+  size_t avail_size, used_ofs;
+  uint8_t* queue;
+  size_t i;
+
+  outw(reg_queue_select(d), 0);
+  d->queue_size = inw(reg_queue_size(d));
+  if (d->queue_size < DESCS_PER_REQ) {
+    printf("%s: no usable virtqueue\n", d->name);
+    return false;
+  }
+
+  avail_size = sizeof(struct vring_avail) + (d->queue_size + 1) * sizeof(uint16_t);
+  used_ofs = ROUND_UP(d->queue_size * sizeof(struct vring_desc) + avail_size, VRING_ALIGN);
+  d->queue_pages =
+      DIV_ROUND_UP(used_ofs + sizeof(struct vring_used) + d->queue_size * sizeof d->used->ring[0] +
+                       sizeof(uint16_t),
+                   PGSIZE);
+  queue = palloc_get_multiple(PAL_ZERO, d->queue_pages);
+  d->slot_cnt = d->queue_size / DESCS_PER_REQ;
+  d->slots = calloc(d->slot_cnt, sizeof *d->slots);
+  if (queue == NULL || d->slots == NULL) {
+    printf("%s: out of memory for virtqueue\n", d->name);
+    if (queue != NULL)
+      palloc_free_multiple(queue, d->queue_pages);
+    free(d->slots);
+    return false;
+  }
+
+  d->desc = (struct vring_desc*)queue;
+  d->avail = (struct vring_avail*)(queue + d->queue_size * sizeof(struct vring_desc));
+  d->used = (struct vring_used*)(queue + used_ofs);
+  d->last_used = 0;
+
+  /* Chain each slot's descriptors once and for all. */
+  for (i = 0; i < d->slot_cnt; i++) {
+    struct vring_desc* desc = &d->desc[i * DESCS_PER_REQ];
+
+    desc[0].addr = vtop(&d->slots[i].hdr);
+    desc[0].len = sizeof d->slots[i].hdr;
+    desc[0].flags = VRING_DESC_F_NEXT;
+    desc[0].next = i * DESCS_PER_REQ + 1;
+
+    desc[1].next = i * DESCS_PER_REQ + 2;
+
+    desc[2].addr = vtop(&d->slots[i].status);
+    desc[2].len = sizeof d->slots[i].status;
+    desc[2].flags = VRING_DESC_F_WRITE;
+  }
+
+  outl(reg_queue_pfn(d), vtop(queue) / PGSIZE);
+  return true;
+}
+
+/* Hands disk D the request of slot I, as a virtio request of
+   TYPE: a flush, or the transfer of the slot's block request.
+   Called by D's worker thread and by retire_requests(), so the
+   available ring is only touched with interrupts off. */
+static void issue(struct virtio_disk* d, size_t i, uint32_t type) {
+  struct slot* s = &d->slots[i];
+  struct vring_desc* desc = &d->desc[i * DESCS_PER_REQ];
+  enum intr_level old_level;
+
+  s->hdr.type = type;
+  s->hdr.reserved = 0;
+  s->hdr.sector = type == VIRTIO_BLK_T_FLUSH ? 0 : s->req->sector;
+  s->status = 0xff;
+  if (type == VIRTIO_BLK_T_FLUSH)
+    desc[0].next = i * DESCS_PER_REQ + 2;
+  else {
+    desc[0].next = i * DESCS_PER_REQ + 1;
+    desc[1].addr = vtop(s->req->buffer);
+    desc[1].len = s->req->cnt * BLOCK_SECTOR_SIZE;
+    desc[1].flags = VRING_DESC_F_NEXT | (s->req->write ? 0 : VRING_DESC_F_WRITE);
+  }
+
+  /* The device may look at the ring as soon as IDX moves, so
+     everything else must be in memory first. */
+  old_level = intr_disable();
+  d->avail->ring[d->avail->idx % d->queue_size] = i * DESCS_PER_REQ;
+  barrier();
+  d->avail->idx++;
+  barrier();
+  outw(reg_queue_notify(d), 0);
+  intr_set_level(old_level);
+}
+
+/* Starts REQ on disk D_.  Returns false, having done nothing, if
+   all of D_'s slots are in use.  A request that only flushes a
+   disk without a write cache is done at once.  Called only by
+   D_'s worker thread. */
+static bool virtio_start(void* d_, struct block_request* req) {
+  struct virtio_disk* d = d_;
+  enum intr_level old_level;
+  struct slot* s;
+  size_t i;
+
+  ASSERT(req->cnt == 0 || is_kernel_vaddr(req->buffer));
+
+  if (req->cnt == 0 && !d->flush) {
+    block_complete(req);
+    return true;
+  }
+
+  old_level = intr_disable();
+  for (i = 0; i < d->slot_cnt; i++)
+    if (d->slots[i].req == NULL)
+      break;
+  if (i < d->slot_cnt)
+    d->slots[i].req = req;
+  intr_set_level(old_level);
+  if (i == d->slot_cnt)
+    return false;
+
+  s = &d->slots[i];
+  s->flush_next = d->flush && req->fua;
+  if (d->flush && req->flush) {
+    s->transfer_next = req->cnt > 0;
+    issue(d, i, VIRTIO_BLK_T_FLUSH);
+  } else {
+    s->transfer_next = false;
+    issue(d, i, req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN);
+  }
+  return true;
+}
+
+static void virtio_poll(void* d_);
+
+static struct block_operations virtio_operations = {NULL, NULL, NULL, virtio_start, NULL,
+                                                    virtio_poll};
+
+/* Passes the requests that disk D has completed since the last
+   call to the block layer and frees their slots, or issues the
+   next step of those that have more to do.  Runs as the
+   interrupt handler's deferred work, so a burst of completions
+   does not hold off other interrupts. */
+static void retire_requests(void* d_) {
+  struct virtio_disk* d = d_;
+
+  while (d->last_used != d->used->idx) {
+    size_t i = d->used->ring[d->last_used % d->queue_size].id / DESCS_PER_REQ;
+    struct slot* s = &d->slots[i];
+    struct block_request* req = s->req;
+    enum intr_level old_level;
+
+    d->last_used++;
+    if (s->status != 0)
+      PANIC("%s: disk %s failed, sector=%" PRDSNu, d->name,
+            s->hdr.type == VIRTIO_BLK_T_FLUSH ? "flush" : req->write ? "write" : "read",
+            req->sector);
+    if (s->transfer_next) {
+      s->transfer_next = false;
+      issue(d, i, req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN);
+      continue;
+    }
+    if (s->flush_next) {
+      s->flush_next = false;
+      issue(d, i, VIRTIO_BLK_T_FLUSH);
+      continue;
+    }
+    old_level = intr_disable();
+    s->req = NULL;
+    intr_set_level(old_level);
+    block_complete(req);
+  }
+}
+
+/* Retires the requests that disk D_ has completed, if any,
+   without waiting for its interrupt.  Called by D_'s worker
+   thread while it polls.  Interrupts are off, so that the
+   interrupt handler's deferred retire_requests() does not run at
+   the same time; it finds nothing left to do afterward. */
+static void virtio_poll(void* d_) {
+  struct virtio_disk* d = d_;
+  enum intr_level old_level = intr_disable();
+
+  if (d->last_used != d->used->idx)
+    retire_requests(d);
+  intr_set_level(old_level);
+}
+
+/* virtio-blk interrupt handler.  Acknowledges the interrupt and
+   leaves the rest to retire_requests(). */
+static void interrupt_handler(struct intr_frame* f) {
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++) {
+    struct virtio_disk* d = &disks[i];
+    if (d->irq == f->vec_no && (inb(reg_isr(d)) & ISR_QUEUE) != 0) /* Acknowledges it. */
+      intr_defer(&d->retire_work);
+  }
+}
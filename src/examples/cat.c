@@ -16,13 +16,8 @@ int main(int argc, char* argv[]) {
       success = false;
       continue;
     }
-    for (;;) {
-      char buffer[1024];
-      int bytes_read = read(fd, buffer, sizeof buffer);
-      if (bytes_read == 0)
-        break;
-      write(STDOUT_FILENO, buffer, bytes_read);
-    }
+    while (sendfile(STDOUT_FILENO, fd, 4096) > 0)
+      continue;
     close(fd);
   }
   return success ? EXIT_SUCCESS : EXIT_FAILURE;
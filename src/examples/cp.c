@@ -7,6 +7,7 @@ Copies one file to another. */
 
 int main(int argc, char* argv[]) {
   int in_fd, out_fd;
+  int size, copied;
 
   if (argc != 3) {
     printf("usage: cp OLD NEW\n");
@@ -21,7 +22,8 @@ int main(int argc, char* argv[]) {
   }
 
   /* Create and open output file. */
-  if (!create(argv[2], filesize(in_fd))) {
+  size = filesize(in_fd);
+  if (!create(argv[2], size)) {
     printf("%s: create failed\n", argv[2]);
     return EXIT_FAILURE;
   }
@@ -31,16 +33,14 @@ int main(int argc, char* argv[]) {
     return EXIT_FAILURE;
   }
 
-  /* Copy data. */
-  for (;;) {
-    char buffer[1024];
-    int bytes_read = read(in_fd, buffer, sizeof buffer);
-    if (bytes_read == 0)
-      break;
-    if (write(out_fd, buffer, bytes_read) != bytes_read) {
+  /* Copy data inside the kernel. */
+  for (copied = 0; copied < size;) {
+    int n = copy_file_range(in_fd, out_fd, size - copied);
+    if (n <= 0) {
       printf("%s: write failed\n", argv[2]);
       return EXIT_FAILURE;
     }
+    copied += n;
   }
 
   return EXIT_SUCCESS;
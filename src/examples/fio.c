@@ -0,0 +1,267 @@
+/* fio.c
+
+   Measures file system throughput and latency for a chosen
+   access pattern, in the manner of the Unix tool of the same
+   name.
+
+   Usage: fio [-b BLOCK] [-s KB] [-n OPS] [-j JOBS] [-w PCT] [-r] FILE
+
+   FILE is created (or overwritten) with KB kilobytes of data.
+   Then JOBS processes each issue OPS requests of BLOCK bytes
+   against it, PCT percent of them writes and the rest reads.
+   With -r the requests go to random block-aligned offsets;
+   otherwise each job reads or writes its own part of the file
+   in order, wrapping around at the end of its part.
+
+   Each job saves the latencies of its requests in file
+   FILE.N, where N is the job number, for the first job to
+   collect once all the jobs have finished.  The report is the
+   overall throughput and IOPS and the latency percentiles, as
+   measured with clock_gettime(). */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <time.h>
+
+#define MAX_BLOCK 65536 /* Largest request, in bytes. */
+#define MAX_OPS 4096    /* Most requests per job. */
+#define MAX_JOBS 8      /* Most jobs. */
+
+/* Test parameters. */
+static int block_size = 4096;
+static int file_kb = 1024;
+static int op_cnt = 256;
+static int job_cnt = 1;
+static int write_pct = 0;
+static bool random_access = false;
+static const char* file_name;
+
+static char buf[MAX_BLOCK];
+
+/* Latency of each request, in nanoseconds.  The first job
+   gathers every job's latencies here. */
+static uint32_t latencies[MAX_JOBS * MAX_OPS];
+
+/* Returns the time on the monotonic clock, in nanoseconds. */
+static int64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Prints a usage message and exits. */
+static void usage(void) {
+  printf("usage: fio [-b BLOCK] [-s KB] [-n OPS] [-j JOBS] [-w PCT] [-r] FILE\n"
+         "  -b BLOCK  bytes per request, at most %d (default 4096)\n"
+         "  -s KB     file size in kilobytes (default 1024)\n"
+         "  -n OPS    requests per job, at most %d (default 256)\n"
+         "  -j JOBS   concurrent processes, at most %d (default 1)\n"
+         "  -w PCT    percent of requests that write (default 0)\n"
+         "  -r        random offsets instead of sequential\n",
+         MAX_BLOCK, MAX_OPS, MAX_JOBS);
+  exit(EXIT_FAILURE);
+}
+
+/* Returns the name of job JOB's latency file in NAME. */
+static void job_file_name(int job, char name[], size_t size) {
+  snprintf(name, size, "%s.%d", file_name, job);
+}
+
+/* Creates the test file and fills it with data, so that reads
+   have something to read.  Returns false on failure. */
+static bool prepare_file(void) {
+  int size = file_kb * 1024;
+  int fd, ofs;
+
+  remove(file_name);
+  if (!create(file_name, 0) || (fd = open(file_name)) < 0) {
+    printf("%s: create failed\n", file_name);
+    return false;
+  }
+  memset(buf, 'f', sizeof buf);
+  for (ofs = 0; ofs < size; ofs += sizeof buf) {
+    int chunk = size - ofs < (int)sizeof buf ? size - ofs : (int)sizeof buf;
+    if (write(fd, buf, chunk) != chunk) {
+      printf("%s: write failed at offset %d\n", file_name, ofs);
+      close(fd);
+      return false;
+    }
+  }
+  close(fd);
+  return true;
+}
+
+/* Issues JOB's requests and saves their latencies to its file.
+   Returns false on failure. */
+static bool run_job(int job) {
+  int block_cnt = file_kb * 1024 / block_size;
+  int first = block_cnt * job / job_cnt;
+  int span = block_cnt * (job + 1) / job_cnt - first;
+  char name[64];
+  int fd, i;
+
+  random_init(job + 1);
+  fd = open(file_name);
+  if (fd < 0) {
+    printf("%s: open failed in job %d\n", file_name, job);
+    return false;
+  }
+
+  for (i = 0; i < op_cnt; i++) {
+    int block = random_access ? (int)(random_ulong() % block_cnt) : first + i % span;
+    bool is_write = (int)(random_ulong() % 100) < write_pct;
+    int64_t start = now_ns();
+    int done;
+
+    if (is_write)
+      done = pwrite(fd, buf, block_size, block * block_size);
+    else
+      done = pread(fd, buf, block_size, block * block_size);
+    latencies[i] = now_ns() - start;
+
+    if (done != block_size) {
+      printf("%s: %s of block %d failed in job %d\n", file_name, is_write ? "write" : "read", block,
+             job);
+      close(fd);
+      return false;
+    }
+  }
+  close(fd);
+
+  job_file_name(job, name, sizeof name);
+  remove(name);
+  if (!create(name, 0) || (fd = open(name)) < 0) {
+    printf("%s: create failed\n", name);
+    return false;
+  }
+  if (write(fd, latencies, op_cnt * sizeof *latencies) != (int)(op_cnt * sizeof *latencies)) {
+    printf("%s: write failed\n", name);
+    close(fd);
+    return false;
+  }
+  close(fd);
+  return true;
+}
+
+/* Reads every job's latencies into LATENCIES and removes the
+   latency files.  Returns false on failure. */
+static bool collect_latencies(void) {
+  int job;
+
+  for (job = 0; job < job_cnt; job++) {
+    int size = op_cnt * sizeof *latencies;
+    char name[64];
+    int fd;
+
+    job_file_name(job, name, sizeof name);
+    fd = open(name);
+    if (fd < 0 || read(fd, latencies + job * op_cnt, size) != size) {
+      printf("%s: read failed\n", name);
+      return false;
+    }
+    close(fd);
+    remove(name);
+  }
+  return true;
+}
+
+/* qsort() comparison function for latencies. */
+static int compare_latencies(const void* a_, const void* b_) {
+  uint32_t a = *(const uint32_t*)a_;
+  uint32_t b = *(const uint32_t*)b_;
+  return a < b ? -1 : a > b;
+}
+
+/* Returns the PCT'th percentile of the CNT sorted latencies, in
+   microseconds. */
+static unsigned percentile_us(int cnt, int pct) {
+  int idx = (cnt * pct + 99) / 100 - 1;
+  return latencies[idx < 0 ? 0 : idx] / 1000;
+}
+
+int main(int argc, char* argv[]) {
+  pid_t children[MAX_JOBS];
+  int64_t start, elapsed, bytes;
+  int total, i;
+  bool ok = true;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    char opt = argv[i][1];
+    if (opt == 'r' && argv[i][2] == '\0') {
+      random_access = true;
+      continue;
+    }
+    if (argv[i][2] != '\0' || i + 1 >= argc)
+      usage();
+    switch (opt) {
+      case 'b':
+        block_size = atoi(argv[++i]);
+        break;
+      case 's':
+        file_kb = atoi(argv[++i]);
+        break;
+      case 'n':
+        op_cnt = atoi(argv[++i]);
+        break;
+      case 'j':
+        job_cnt = atoi(argv[++i]);
+        break;
+      case 'w':
+        write_pct = atoi(argv[++i]);
+        break;
+      default:
+        usage();
+    }
+  }
+  if (i != argc - 1 || block_size <= 0 || block_size > MAX_BLOCK || op_cnt <= 0 ||
+      op_cnt > MAX_OPS || job_cnt <= 0 || job_cnt > MAX_JOBS || write_pct < 0 || write_pct > 100 ||
+      file_kb <= 0 || file_kb * 1024 / block_size < job_cnt)
+    usage();
+  file_name = argv[i];
+
+  if (!prepare_file())
+    return EXIT_FAILURE;
+
+  /* Jobs 1 and up run in child processes; this process is job
+     0. */
+  start = now_ns();
+  for (i = 1; i < job_cnt; i++) {
+    children[i] = fork();
+    if (children[i] == 0)
+      return run_job(i) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (children[i] < 0) {
+      printf("fio: fork failed\n");
+      job_cnt = i;
+      ok = false;
+      break;
+    }
+  }
+  if (!run_job(0))
+    ok = false;
+  for (i = 1; i < job_cnt; i++)
+    if (wait(children[i]) != EXIT_SUCCESS)
+      ok = false;
+  elapsed = now_ns() - start;
+  if (!ok || !collect_latencies())
+    return EXIT_FAILURE;
+
+  total = job_cnt * op_cnt;
+  bytes = (int64_t)total * block_size;
+  qsort(latencies, total, sizeof *latencies, compare_latencies);
+
+  printf("fio: %d job%s x %d requests of %d bytes, %s, %d%% writes, %d kB file\n", job_cnt,
+         job_cnt == 1 ? "" : "s", op_cnt, block_size, random_access ? "random" : "sequential",
+         write_pct, file_kb);
+  if (elapsed < 1)
+    elapsed = 1;
+  printf("throughput: %lld kB/s, %lld IOPS\n", bytes * 1000000000LL / 1024 / elapsed,
+         (int64_t)total * 1000000000LL / elapsed);
+  printf("latency (us): min %u, p50 %u, p90 %u, p99 %u, max %u\n", latencies[0] / 1000,
+         percentile_us(total, 50), percentile_us(total, 90), percentile_us(total, 99),
+         latencies[total - 1] / 1000);
+  return EXIT_SUCCESS;
+}
@@ -9,6 +9,9 @@ int main(int argc, char* argv[]) {
   bool success = true;
   int i;
 
+  /* The dump is many short lines: write them a buffer at a time. */
+  setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
+
   for (i = 1; i < argc; i++) {
     int fd = open(argv[i]);
     if (fd < 0) {
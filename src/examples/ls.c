@@ -6,7 +6,9 @@
 
    By default, only the name of each file is printed.  If "-l" is
    given as the first argument, the type, size, and inumber of
-   each file is also printed.  This won't work until project 4. */
+   each file is also printed.  Entries are read with getdents(),
+   many at a time, along with their types and sizes, so a large
+   directory takes a handful of system calls. */
 
 #include <syscall.h>
 #include <stdio.h>
@@ -20,34 +22,29 @@ static bool list_dir(const char* dir, bool verbose) {
   }
 
   if (isdir(dir_fd)) {
-    char name[READDIR_MAX_LEN];
+    struct dirent ents[32];
+    int size;
 
     printf("%s", dir);
     if (verbose)
       printf(" (inumber %d)", inumber(dir_fd));
     printf(":\n");
 
-    while (readdir(dir_fd, name)) {
-      printf("%s", name);
-      if (verbose) {
-        char full_name[128];
-        int entry_fd;
+    while ((size = getdents(dir_fd, ents, sizeof ents)) > 0) {
+      int i;
 
-        snprintf(full_name, sizeof full_name, "%s/%s", dir, name);
-        entry_fd = open(full_name);
-
-        printf(": ");
-        if (entry_fd != -1) {
-          if (isdir(entry_fd))
+      for (i = 0; i < size / (int)sizeof *ents; i++) {
+        printf("%s", ents[i].name);
+        if (verbose) {
+          printf(": ");
+          if (ents[i].type == DT_DIR)
             printf("directory");
           else
-            printf("%d-byte file", filesize(entry_fd));
-          printf(", inumber %d", inumber(entry_fd));
-        } else
-          printf("open failed");
-        close(entry_fd);
+            printf("%u-byte file", (unsigned)ents[i].size);
+          printf(", inumber %u", (unsigned)ents[i].inumber);
+        }
+        printf("\n");
       }
-      printf("\n");
     }
   } else
     printf("%s: not a directory\n", dir);
@@ -0,0 +1,70 @@
+/* pbubsort.c
+
+   Sorts the same array as bubsort, but with odd-even
+   transposition sort, the parallel form of bubble sort: each of
+   SORT_SIZE phases compares and swaps disjoint pairs of
+   neighbors, alternately starting at even and odd indexes, and
+   the task runtime spreads the pairs of each phase across its
+   workers.
+
+   Usage: pbubsort [WORKERS] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <task.h>
+
+/* Size of array to sort. */
+#define SORT_SIZE 128
+
+/* Array to sort.  Static to reduce stack usage. */
+static int array[SORT_SIZE];
+
+/* Orders pairs [BEGIN, END) of the current phase, where pair P
+   is array[2 * P + *PHASE] and the element after it. */
+static void sort_pairs(int begin, int end, void* phase_) {
+  int phase = *(int*)phase_;
+  int p;
+
+  for (p = begin; p < end; p++) {
+    int j = 2 * p + phase;
+    if (array[j] > array[j + 1]) {
+      int tmp = array[j];
+      array[j] = array[j + 1];
+      array[j + 1] = tmp;
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int workers = argc > 1 ? atoi(argv[1]) : 4;
+  struct rusage usage;
+  int i;
+
+  /* First initialize the array in descending order. */
+  for (i = 0; i < SORT_SIZE; i++)
+    array[i] = SORT_SIZE - i - 1;
+
+  if (!task_runtime_init(workers))
+    printf("pbubsort: started only %d workers\n", task_worker_cnt());
+
+  /* Then sort in ascending order. */
+  for (i = 0; i < SORT_SIZE; i++) {
+    int phase = i % 2;
+    parallel_for(0, (SORT_SIZE - phase) / 2, 8, sort_pairs, &phase);
+  }
+  task_runtime_shutdown();
+
+  for (i = 0; i < SORT_SIZE; i++)
+    if (array[i] != i) {
+      printf("pbubsort: array[%d] is %d, should be %d\n", i, array[i], i);
+      exit(-1);
+    }
+
+  if (getrusage(&usage))
+    printf("pbubsort: %d workers, %lld user ticks, %lld kernel ticks\n", workers,
+           usage.user_ticks, usage.kernel_ticks);
+
+  printf("sort exiting with code %d\n", array[0]);
+  return array[0];
+}
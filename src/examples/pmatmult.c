@@ -0,0 +1,70 @@
+/* pmatmult.c
+
+   Multiplies the same matrices as matmult, but with the rows of
+   the product computed in parallel by the task runtime.
+
+   Usage: pmatmult [WORKERS]
+
+   Reports the CPU time the process used and exits with the same
+   code as matmult. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <task.h>
+
+#define DIM 128
+
+int A[DIM][DIM];
+int B[DIM][DIM];
+int C[DIM][DIM];
+
+/* Computes rows [BEGIN, END) of C. */
+static void multiply_rows(int begin, int end, void* aux UNUSED) {
+  int i, j, k;
+
+  for (i = begin; i < end; i++)
+    for (j = 0; j < DIM; j++) {
+      int sum = 0;
+      for (k = 0; k < DIM; k++)
+        sum += A[i][k] * B[k][j];
+      C[i][j] = sum;
+    }
+}
+
+int main(int argc, char* argv[]) {
+  int workers = argc > 1 ? atoi(argv[1]) : 4;
+  struct rusage usage;
+  int i, j;
+
+  /* Initialize the matrices. */
+  for (i = 0; i < DIM; i++)
+    for (j = 0; j < DIM; j++) {
+      A[i][j] = i;
+      B[i][j] = j;
+      C[i][j] = 0;
+    }
+
+  if (!task_runtime_init(workers))
+    printf("pmatmult: started only %d workers\n", task_worker_cnt());
+
+  /* Multiply matrices, one row per task. */
+  parallel_for(0, DIM, 1, multiply_rows, NULL);
+  task_runtime_shutdown();
+
+  /* Check the product: row I of A is all I's, column J of B is
+     all J's. */
+  for (i = 0; i < DIM; i++)
+    for (j = 0; j < DIM; j++)
+      if (C[i][j] != DIM * i * j) {
+        printf("pmatmult: C[%d][%d] is %d, should be %d\n", i, j, C[i][j], DIM * i * j);
+        exit(-1);
+      }
+
+  if (getrusage(&usage))
+    printf("pmatmult: %d workers, %lld user ticks, %lld kernel ticks\n", workers,
+           usage.user_ticks, usage.kernel_ticks);
+
+  /* Done. */
+  exit(C[DIM - 1][DIM - 1]);
+}
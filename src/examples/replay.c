@@ -0,0 +1,262 @@
+/* replay.c
+
+   Replays a trace of system calls recorded by the kernel, as a
+   benchmark of a realistic mix of process creation and file and
+   console I/O.
+
+   Usage: replay TRACE [TID]
+
+   Run the kernel with -trace, and convert its output to TRACE
+   with `pintos-trace --replay=TRACE'.  Then put TRACE and this
+   program on a fresh file system and run `replay TRACE'.  It
+   replays the calls of the first thread in the trace, in order
+   and without pauses, and prints how long they took compared to
+   the time they took in the kernel when traced.
+
+   Calls name the files that they named when traced, so the file
+   system must start out as it did then.  Reads and writes
+   transfer the sizes they did, of meaningless data, and writes to
+   the console write to the console.  File descriptors and process
+   IDs in the trace are mapped to the ones that the replayed calls
+   return.  A fork() forks this program, and the child replays the
+   calls of the traced child.  An exec() executes this program
+   again, as "replay TRACE TID", to replay the traced child whose
+   thread is TID, so it loads a different executable than the
+   traced one did.  exit() exits with the traced status.  Calls
+   of other kinds, including those of threads other than a
+   process's main thread, are skipped. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall-nr.h>
+#include <syscall.h>
+#include <time.h>
+
+#define MAX_FDS 128     /* File descriptors that are mapped. */
+#define MAX_CHILDREN 64 /* Child processes that are mapped. */
+#define MAX_IO 65536    /* Largest read or write, in bytes. */
+
+/* A traced system call, as written by pintos-trace --replay. */
+struct call {
+  uint32_t tid;     /* Calling thread. */
+  uint32_t nr;      /* System call number. */
+  uint32_t args[3]; /* First three arguments. */
+  int32_t ret;      /* Return value. */
+  uint32_t us;      /* Microseconds it took in the kernel. */
+  char name[64];    /* File name argument, null-padded. */
+};
+
+/* Header at the start of a trace. */
+struct header {
+  char magic[4]; /* "PTRC". */
+  uint32_t cnt;  /* Number of calls that follow. */
+};
+
+static const char* trace_name;
+
+/* Traced file descriptors and process IDs, and ours for them. */
+static int fds[MAX_FDS];
+static pid_t traced_pids[MAX_CHILDREN], pids[MAX_CHILDREN];
+static int child_cnt;
+
+/* Statistics. */
+static int replayed_cnt, skipped_cnt;
+static int64_t traced_us, start_ns;
+
+static char buf[MAX_IO];
+
+/* Returns the time on the monotonic clock, in nanoseconds. */
+static int64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Prints a usage message and exits. */
+static void usage(void) {
+  printf("usage: replay TRACE [TID]\n"
+         "  TRACE  system calls written by pintos-trace --replay\n"
+         "  TID    traced thread to replay (default: the first)\n");
+  exit(EXIT_FAILURE);
+}
+
+/* Returns our file descriptor for traced descriptor FD, or -1. */
+static int fd_of(uint32_t fd) { return fd < MAX_FDS ? fds[fd] : -1; }
+
+/* Returns our process ID for traced process PID, or -1. */
+static pid_t pid_of(pid_t pid) {
+  int i;
+
+  for (i = 0; i < child_cnt; i++)
+    if (traced_pids[i] == pid)
+      return pids[i];
+  return -1;
+}
+
+/* Records that our process PID stands for traced process
+   TRACED. */
+static void add_child(pid_t traced, pid_t pid) {
+  if (traced != -1 && pid != -1 && child_cnt < MAX_CHILDREN) {
+    traced_pids[child_cnt] = traced;
+    pids[child_cnt++] = pid;
+  }
+}
+
+/* Returns the size of a read or write of SIZE bytes, at most
+   MAX_IO. */
+static unsigned io_size(uint32_t size) { return size < MAX_IO ? size : MAX_IO; }
+
+/* Prints what this process replayed, as thread TID of the
+   trace. */
+static void report(int tid) {
+  printf("replay: tid %d: %d calls in %lld us, %d skipped; traced calls took %lld us\n", tid,
+         replayed_cnt, (now_ns() - start_ns) / 1000, skipped_cnt, traced_us);
+}
+
+/* Replays call C, except fork(), which main() handles, as thread
+   TID of the trace.  Returns false if C was skipped. */
+static bool replay(const struct call* c, int tid) {
+  char name[sizeof c->name + 1];
+  char cmd[sizeof name + 32];
+  int fd;
+
+  memcpy(name, c->name, sizeof c->name);
+  name[sizeof c->name] = '\0';
+  switch (c->nr) {
+    case SYS_EXIT:
+      traced_us += c->us;
+      replayed_cnt++;
+      report(tid);
+      exit(c->args[0]);
+    case SYS_EXEC:
+      if (c->ret == -1)
+        return false;
+      snprintf(cmd, sizeof cmd, "replay %s %d", trace_name, c->ret);
+      add_child(c->ret, exec(cmd));
+      break;
+    case SYS_WAIT:
+      wait(pid_of(c->args[0]));
+      break;
+    case SYS_CREATE:
+      create(name, c->args[1]);
+      break;
+    case SYS_REMOVE:
+      remove(name);
+      break;
+    case SYS_OPEN:
+      fd = open(name);
+      if (c->ret >= 0 && c->ret < MAX_FDS)
+        fds[c->ret] = fd;
+      break;
+    case SYS_FILESIZE:
+      filesize(fd_of(c->args[0]));
+      break;
+    case SYS_READ:
+      if (c->args[0] == STDIN_FILENO)
+        return false;
+      read(fd_of(c->args[0]), buf, io_size(c->args[2]));
+      break;
+    case SYS_WRITE:
+      write(fd_of(c->args[0]), buf, io_size(c->args[2]));
+      break;
+    case SYS_SEEK:
+      seek(fd_of(c->args[0]), c->args[1]);
+      break;
+    case SYS_TELL:
+      tell(fd_of(c->args[0]));
+      break;
+    case SYS_CLOSE:
+      close(fd_of(c->args[0]));
+      if (c->args[0] < MAX_FDS)
+        fds[c->args[0]] = -1;
+      break;
+    case SYS_CHDIR:
+      chdir(name);
+      break;
+    case SYS_MKDIR:
+      mkdir(name);
+      break;
+    case SYS_FSYNC:
+      fsync(fd_of(c->args[0]));
+      break;
+    case SYS_SYNC:
+      sync();
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+/* Opens the trace, positioned at call IDX, and returns its file
+   descriptor and the number of calls in it in *CNT.  Exits on
+   failure. */
+static int open_trace(uint32_t idx, uint32_t* cnt) {
+  struct header h;
+  int fd = open(trace_name);
+
+  if (fd < 0 || read(fd, &h, sizeof h) != sizeof h || memcmp(h.magic, "PTRC", 4)) {
+    printf("%s: not a trace\n", trace_name);
+    exit(EXIT_FAILURE);
+  }
+  seek(fd, sizeof h + idx * sizeof(struct call));
+  *cnt = h.cnt;
+  return fd;
+}
+
+int main(int argc, char* argv[]) {
+  uint32_t cnt, i;
+  int tid, fd;
+
+  if (argc < 2 || argc > 3)
+    usage();
+  trace_name = argv[1];
+  tid = argc == 3 ? atoi(argv[2]) : 0;
+
+  for (i = 0; i < MAX_FDS; i++)
+    fds[i] = i <= STDOUT_FILENO ? (int)i : -1;
+  memset(buf, 'r', sizeof buf);
+
+  fd = open_trace(0, &cnt);
+  start_ns = now_ns();
+  for (i = 0; i < cnt; i++) {
+    struct call c;
+
+    if (read(fd, &c, sizeof c) != sizeof c) {
+      printf("%s: truncated\n", trace_name);
+      return EXIT_FAILURE;
+    }
+    if (tid == 0)
+      tid = c.tid;
+    if ((int)c.tid != tid)
+      continue;
+
+    if (c.nr == SYS_FORK) {
+      pid_t pid = fork();
+
+      if (pid == 0) {
+        /* Carry on as the traced child, from the next call, with
+           an offset in the trace of our own. */
+        close(fd);
+        fd = open_trace(i + 1, &cnt);
+        tid = c.ret;
+        child_cnt = replayed_cnt = skipped_cnt = 0;
+        traced_us = 0;
+        start_ns = now_ns();
+        continue;
+      }
+      add_child(c.ret, pid);
+    } else if (!replay(&c, tid)) {
+      skipped_cnt++;
+      continue;
+    }
+    traced_us += c.us;
+    replayed_cnt++;
+  }
+  close(fd);
+  report(tid);
+  return EXIT_SUCCESS;
+}
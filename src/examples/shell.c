@@ -5,6 +5,10 @@
 
 static void read_line(char line[], size_t);
 static bool backspace(char** pos, char line[]);
+static void run_pipeline(char* command);
+
+/* Most commands in one pipeline. */
+#define MAX_STAGES 8
 
 int main(void) {
   printf("Shell starting...\n");
@@ -23,10 +27,24 @@ int main(void) {
         printf("\"%s\": chdir failed\n", command + 3);
     } else if (command[0] == '\0') {
       /* Empty command. */
+    } else if (strchr(command, '|') != NULL) {
+      run_pipeline(command);
     } else {
-      pid_t pid = exec(command);
+      char* argv[sizeof command / 2 + 1];
+      char* save_ptr;
+      char* token;
+      int argc = 0;
+      pid_t pid;
+
+      /* Split the command here, so exec needs no parsing. */
+      for (token = strtok_r(command, " ", &save_ptr); token != NULL;
+           token = strtok_r(NULL, " ", &save_ptr))
+        argv[argc++] = token;
+      argv[argc] = NULL;
+
+      pid = argc > 0 ? exec_argv(argv) : PID_ERROR;
       if (pid != PID_ERROR)
-        printf("\"%s\": exit code %d\n", command, wait(pid));
+        printf("\"%s\": exit code %d\n", argv[0], wait(pid));
       else
         printf("exec failed\n");
     }
@@ -36,6 +54,64 @@ int main(void) {
   return EXIT_SUCCESS;
 }
 
+/* Runs COMMAND, a series of commands separated by `|', with each
+   command's output going to the next one's input through a pipe,
+   and reports each one's exit code once all have exited. */
+static void run_pipeline(char* command) {
+  char* stages[MAX_STAGES];
+  pid_t pids[MAX_STAGES];
+  char* save_ptr;
+  char* token;
+  int stage_cnt = 0;
+  int in_fd = -1;
+  int i;
+
+  for (token = strtok_r(command, "|", &save_ptr); token != NULL;
+       token = strtok_r(NULL, "|", &save_ptr)) {
+    if (stage_cnt == MAX_STAGES) {
+      printf("too many commands in pipeline\n");
+      return;
+    }
+    stages[stage_cnt++] = token;
+  }
+
+  for (i = 0; i < stage_cnt; i++) {
+    struct spawn_fd fds[2];
+    size_t fd_cnt = 0;
+    int ends[2] = {-1, -1};
+
+    if (in_fd >= 0)
+      fds[fd_cnt++] = (struct spawn_fd){in_fd, STDIN_FILENO};
+    if (i + 1 < stage_cnt) {
+      if (pipe(ends) < 0) {
+        printf("pipe failed\n");
+        pids[i] = PID_ERROR;
+        break;
+      }
+      fds[fd_cnt++] = (struct spawn_fd){ends[1], STDOUT_FILENO};
+    }
+
+    pids[i] = spawn(stages[i], fds, fd_cnt);
+    if (pids[i] == PID_ERROR)
+      printf("\"%s\": exec failed\n", stages[i]);
+
+    /* Only the children may keep the pipes open, so that each
+       reader sees end of file once its writer exits. */
+    if (in_fd >= 0)
+      close(in_fd);
+    if (ends[1] >= 0)
+      close(ends[1]);
+    in_fd = ends[0];
+  }
+  if (in_fd >= 0)
+    close(in_fd);
+
+  stage_cnt = i;
+  for (i = 0; i < stage_cnt; i++)
+    if (pids[i] != PID_ERROR)
+      printf("\"%s\": exit code %d\n", stages[i], wait(pids[i]));
+}
+
 /* Reads a line of input from the user into LINE, which has room
    for SIZE bytes.  Handles backspace and Ctrl+U in the ways
    expected by Unix users.  On return, LINE will always be
@@ -43,8 +119,7 @@ int main(void) {
 static void read_line(char line[], size_t size) {
   char* pos = line;
   for (;;) {
-    char c;
-    read(STDIN_FILENO, &c, 1);
+    int c = getchar();
 
     switch (c) {
       case '\r':
@@ -0,0 +1,595 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stats.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
+
+/* Buffer cache.
+
+   Keeps the most recently used sectors of the file system device
+   in memory, so that the inode layer, directories and the free
+   map reread and rewrite them without going to the disk.  The
+   cache is write-back: a write only changes the cached copy,
+   which goes to disk at the next cache_flush() or when its entry
+   is evicted.  Entries are replaced with the clock algorithm.
+
+   The flusher thread calls cache_flush() every flush_interval
+   ticks, the cache.flush_interval tunable, so that evicting an entry seldom has to wait for a write.
+   cache_flush() writes dirty sectors in ascending order, with
+   runs of adjacent sectors combined into one transfer.
+
+   A write made with cache_write_owned_at() puts its entry on its
+   owner's list of dirty entries until the entry is written back,
+   so that cache_flush_owner() can write back one file's sectors
+   in time proportional to their number.
+
+   cache_hold() gives direct access to a cached sector's data, so
+   that a reader can copy it straight to where it is wanted, even
+   where that may fault, as user memory may.  A held entry is not
+   evicted, but it is not locked either.
+
+   cache_pin() keeps a sector's changes off the disk until
+   cache_unpin(), for the journal: a pinned entry is neither
+   written back nor evicted.
+
+   cache_prefetch() queues sectors for the read-ahead thread to
+   bring in, so that a sequential reader finds them cached instead
+   of waiting for the disk.  The queue is small, and requests that
+   do not fit are dropped: read-ahead is only a hint.
+
+   Each entry has a lock that serializes access to its data and
+   the disk I/O that fills or empties it.  cache_lock protects the
+   map from sectors to entries, each entry's SECTOR and ACCESSED,
+   and the clock hand.  Changing an entry's SECTOR takes both
+   locks, so either one is enough to read it.  No lock is held
+   across the I/O for one entry except that entry's own, so I/O on
+   different sectors proceeds in parallel.
+
+   Lock order: flush_lock, then cache_lock, then entry locks,
+   which are only ever tried while cache_lock is held.  Only
+   cache_flush() and cache_flush_owner() hold more than one entry
+   lock, and they take them in ascending sector order.  ra_lock
+   is never held with any other.  owner_lock, which protects the
+   owners' lists and each entry's OWNER, is taken last.  Callers
+   may hold any file system lock. */
+
+/* Number of sectors cached. */
+#ifndef CACHE_SECTORS
+#define CACHE_SECTORS 64
+#endif
+
+/* Number of lists in cache_map.  Must be a power of 2. */
+#define CACHE_BUCKETS 64
+
+/* Default ticks between runs of the flusher thread. */
+#define FLUSH_INTERVAL TIMER_FREQ
+static int flush_interval = FLUSH_INTERVAL;
+
+/* Most sectors cache_flush() writes in one transfer. */
+#define FLUSH_RUN 16
+
+/* Number of read-ahead requests that can be queued. */
+#define RA_QUEUE_SIZE 64
+
+/* Marks an entry that holds no sector. */
+#define NO_SECTOR ((block_sector_t)-1)
+
+/* A cached sector. */
+struct cache_entry {
+  struct list_elem elem;           /* Element in cache_map, if SECTOR is valid. */
+  block_sector_t sector;           /* Sector held, or NO_SECTOR. */
+  bool accessed;                   /* Used since the clock hand last passed. */
+  bool prefetched;                 /* Read ahead and not looked up since. */
+  struct lock lock;                /* Protects the members below. */
+  bool valid;                      /* DATA holds SECTOR's contents. */
+  bool dirty;                      /* DATA is newer than the disk. */
+  bool pinned;                     /* Must not be written back or evicted. */
+  int hold_cnt;                    /* Number of cache_hold() calls not yet undone. */
+  struct cache_owner* owner;       /* Owner whose list has this entry, if any. */
+  struct list_elem owner_elem;     /* Element in OWNER's list. */
+  uint8_t data[BLOCK_SECTOR_SIZE]; /* Sector contents. */
+};
+
+static struct cache_entry entries[CACHE_SECTORS];
+static struct lock owner_lock;
+static struct list cache_map[CACHE_BUCKETS]; /* Entries holding a sector, hashed by sector. */
+static size_t clock_hand;                    /* Next entry the clock looks at. */
+static struct lock cache_lock;
+
+/* Statistics, protected by cache_lock. */
+static unsigned long long hit_cnt;      /* Lookups that found their sector. */
+static unsigned long long miss_cnt;     /* Lookups that did not. */
+static unsigned long long evict_writes; /* Dirty victims written back. */
+static unsigned long long ra_reads;     /* Sectors read ahead. */
+static unsigned long long ra_used;      /* Of those, sectors looked up later. */
+static unsigned long long ra_unused;    /* Of those, sectors evicted unused. */
+
+/* Read-ahead queue, a circular buffer protected by ra_lock. */
+static block_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head;                /* Next request is queued here. */
+static size_t ra_tail;                /* Oldest request is here. */
+static struct lock ra_lock;
+static struct condition ra_nonempty;  /* Signaled when a request is queued. */
+static unsigned long long ra_dropped; /* Requests dropped because the queue was full. */
+
+/* A sector that cache_flush() may write, and the entry that held
+   it when cache_flush() looked. */
+struct flush_slot {
+  block_sector_t sector;
+  struct cache_entry* entry;
+};
+
+/* cache_flush() state, protected by flush_lock. */
+static struct lock flush_lock;
+static struct flush_slot flush_order[CACHE_SECTORS];     /* Cached sectors, sorted. */
+static struct cache_entry* flush_run[FLUSH_RUN];         /* Locked entries to write. */
+static uint8_t flush_buf[FLUSH_RUN * BLOCK_SECTOR_SIZE]; /* Data of FLUSH_RUN, gathered. */
+static unsigned long long flush_runs;                    /* Transfers made. */
+static unsigned long long flush_sectors;                 /* Sectors they wrote. */
+
+/* Flusher thread wakeups. */
+static struct timer_callout flush_callout;
+static struct semaphore flush_sema;
+
+static thread_func read_ahead_thread;
+static thread_func flusher_thread;
+
+/* Initializes the buffer cache. */
+void cache_init(void) {
+  size_t i;
+
+  lock_init_named(&cache_lock, "cache");
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    list_init(&cache_map[i]);
+  for (i = 0; i < CACHE_SECTORS; i++) {
+    struct cache_entry* e = &entries[i];
+    e->sector = NO_SECTOR;
+    e->accessed = false;
+    e->prefetched = false;
+    lock_init_named(&e->lock, "cache block");
+    e->valid = false;
+    e->dirty = false;
+    e->pinned = false;
+    e->hold_cnt = 0;
+    e->owner = NULL;
+  }
+  lock_init_named(&owner_lock, "cache owner");
+
+  lock_init_named(&ra_lock, "read-ahead");
+  cond_init(&ra_nonempty);
+  thread_create("read-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+
+  tunable_register_int("cache.flush_interval", &flush_interval, 1, 60 * TIMER_FREQ);
+  lock_init_named(&flush_lock, "flush");
+  sema_init(&flush_sema, 0);
+  thread_create("flusher", PRI_DEFAULT, flusher_thread, NULL);
+}
+
+/* Returns the list in cache_map for SECTOR. */
+static struct list* cache_bucket(block_sector_t sector) {
+  return &cache_map[hash_int(sector) & (CACHE_BUCKETS - 1)];
+}
+
+/* Returns the entry that holds SECTOR, or a null pointer if none
+   does.  The caller must hold cache_lock. */
+static struct cache_entry* cache_find(block_sector_t sector) {
+  struct list* bucket = cache_bucket(sector);
+  struct list_elem* elem;
+
+  ASSERT(lock_held_by_current_thread(&cache_lock));
+  for (elem = list_begin(bucket); elem != list_end(bucket); elem = list_next(elem)) {
+    struct cache_entry* e = list_entry(elem, struct cache_entry, elem);
+    if (e->sector == sector)
+      return e;
+  }
+  return NULL;
+}
+
+/* Takes locked entry E off its owner's list, if it is on one,
+   because it is about to be clean. */
+static void cache_disown(struct cache_entry* e) {
+  lock_acquire(&owner_lock);
+  if (e->owner != NULL) {
+    list_remove(&e->owner_elem);
+    e->owner = NULL;
+  }
+  lock_release(&owner_lock);
+}
+
+/* Chooses an entry to replace with the clock algorithm, locks it
+   and returns it.  Returns a null pointer if every entry is in
+   use.  The caller must hold cache_lock. */
+static struct cache_entry* cache_choose_victim(void) {
+  size_t i;
+
+  ASSERT(lock_held_by_current_thread(&cache_lock));
+  for (i = 0; i < 2 * CACHE_SECTORS; i++) {
+    struct cache_entry* e = &entries[clock_hand];
+
+    clock_hand = (clock_hand + 1) % CACHE_SECTORS;
+    if (e->accessed)
+      e->accessed = false;
+    else if (lock_try_acquire(&e->lock)) {
+      if (!e->pinned && e->hold_cnt == 0)
+        return e;
+      lock_release(&e->lock);
+    }
+  }
+  return NULL;
+}
+
+/* Returns the entry for SECTOR, locked, evicting another sector
+   to make room for it if necessary.  If READ is true, the entry's
+   data holds the sector's contents.  Otherwise it may not, and
+   the caller must overwrite all of it.  PREFETCH is true only for
+   the read-ahead thread, which keeps its own statistics. */
+static struct cache_entry* cache_lookup(block_sector_t sector, bool read, bool prefetch) {
+  struct cache_entry* e;
+
+  ASSERT(sector != NO_SECTOR);
+  for (;;) {
+    lock_acquire(&cache_lock);
+    e = cache_find(sector);
+    if (e != NULL) {
+      e->accessed = true;
+      if (!prefetch) {
+        hit_cnt++;
+        if (e->prefetched)
+          ra_used++;
+        e->prefetched = false;
+      }
+      lock_release(&cache_lock);
+
+      /* The entry may be given to another sector before we get
+         its lock. */
+      lock_acquire(&e->lock);
+      if (e->sector == sector)
+        break;
+      lock_release(&e->lock);
+      continue;
+    }
+
+    e = cache_choose_victim();
+    if (e == NULL) {
+      /* Every entry is busy.  Let their users finish. */
+      lock_release(&cache_lock);
+      thread_yield();
+      continue;
+    }
+    if (e->dirty) {
+      /* Write the victim back under its old sector, so that anyone
+         who wants that sector meanwhile waits for it, and then look
+         again. */
+      evict_writes++;
+      lock_release(&cache_lock);
+      block_write(fs_device, e->sector, e->data);
+      e->dirty = false;
+      cache_disown(e);
+      lock_release(&e->lock);
+      continue;
+    }
+
+    if (e->sector != NO_SECTOR)
+      list_remove(&e->elem);
+    if (e->prefetched)
+      ra_unused++;
+    e->sector = sector;
+    e->accessed = true;
+    e->prefetched = prefetch;
+    e->valid = false;
+    list_push_front(cache_bucket(sector), &e->elem);
+    if (prefetch)
+      ra_reads++;
+    else
+      miss_cnt++;
+    lock_release(&cache_lock);
+    break;
+  }
+
+  if (read && !e->valid) {
+    block_read(fs_device, sector, e->data);
+    e->valid = true;
+  }
+  return e;
+}
+
+/* Returns the entry for SECTOR, locked, as cache_lookup() does
+   for anyone but the read-ahead thread. */
+static struct cache_entry* cache_get(block_sector_t sector, bool read) {
+  return cache_lookup(sector, read, false);
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void cache_read(block_sector_t sector, void* buffer) {
+  cache_read_at(sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at byte offset OFS within sector
+   SECTOR into BUFFER. */
+void cache_read_at(block_sector_t sector, void* buffer, size_t ofs, size_t size) {
+  struct cache_entry* e;
+
+  ASSERT(ofs <= BLOCK_SECTOR_SIZE && size <= BLOCK_SECTOR_SIZE - ofs);
+  e = cache_get(sector, true);
+  memcpy(buffer, e->data + ofs, size);
+  lock_release(&e->lock);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to sector SECTOR. */
+void cache_write(block_sector_t sector, const void* buffer) {
+  cache_write_at(sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER to sector SECTOR, starting at byte
+   offset OFS within the sector.  Only a partial write has to read
+   the sector first. */
+void cache_write_at(block_sector_t sector, const void* buffer, size_t ofs, size_t size) {
+  struct cache_entry* e;
+
+  ASSERT(ofs <= BLOCK_SECTOR_SIZE && size <= BLOCK_SECTOR_SIZE - ofs);
+  e = cache_get(sector, size < BLOCK_SECTOR_SIZE);
+  memcpy(e->data + ofs, buffer, size);
+  e->valid = true;
+  e->dirty = true;
+  lock_release(&e->lock);
+}
+
+/* Initializes OWNER, with no dirty sectors. */
+void cache_owner_init(struct cache_owner* owner) { list_init(&owner->dirty); }
+
+/* Forgets which dirty sectors belong to OWNER, so that it can be
+   freed.  They are still written back as usual. */
+void cache_owner_done(struct cache_owner* owner) {
+  lock_acquire(&owner_lock);
+  while (!list_empty(&owner->dirty)) {
+    struct list_elem* elem = list_pop_front(&owner->dirty);
+    list_entry(elem, struct cache_entry, owner_elem)->owner = NULL;
+  }
+  lock_release(&owner_lock);
+}
+
+/* Like cache_write_at(), but also adds SECTOR to OWNER's dirty
+   sectors until it is written back. */
+void cache_write_owned_at(struct cache_owner* owner, block_sector_t sector, const void* buffer,
+                          size_t ofs, size_t size) {
+  struct cache_entry* e;
+
+  ASSERT(ofs <= BLOCK_SECTOR_SIZE && size <= BLOCK_SECTOR_SIZE - ofs);
+  e = cache_get(sector, size < BLOCK_SECTOR_SIZE);
+  memcpy(e->data + ofs, buffer, size);
+  e->valid = true;
+  e->dirty = true;
+  lock_acquire(&owner_lock);
+  if (e->owner != owner) {
+    if (e->owner != NULL)
+      list_remove(&e->owner_elem);
+    list_push_back(&owner->dirty, &e->owner_elem);
+    e->owner = owner;
+  }
+  lock_release(&owner_lock);
+  lock_release(&e->lock);
+}
+
+/* Returns the cached data of SECTOR, reading it first if
+   necessary, and keeps it in the cache until cache_unhold() is
+   called on the returned pointer.  The caller may read the
+   BLOCK_SECTOR_SIZE bytes there without holding any lock, but
+   they may change meanwhile if someone writes SECTOR. */
+const void* cache_hold(block_sector_t sector) {
+  struct cache_entry* e = cache_get(sector, true);
+  e->hold_cnt++;
+  lock_release(&e->lock);
+  return e->data;
+}
+
+/* Lets the cache evict the sector whose data, DATA, was returned
+   by cache_hold(). */
+void cache_unhold(const void* data) {
+  struct cache_entry* e = (struct cache_entry*)((uint8_t*)data - offsetof(struct cache_entry, data));
+
+  lock_acquire(&e->lock);
+  ASSERT(e->hold_cnt > 0);
+  e->hold_cnt--;
+  lock_release(&e->lock);
+}
+
+/* Pins SECTOR in the cache: from now until cache_unpin(), writes
+   to it stay in the cache, which does not write it back or evict
+   it.  Does not read it from disk. */
+void cache_pin(block_sector_t sector) {
+  struct cache_entry* e = cache_get(sector, false);
+  e->pinned = true;
+  lock_release(&e->lock);
+}
+
+/* Unpins SECTOR, which must be pinned, so that the cache writes
+   it back as usual. */
+void cache_unpin(block_sector_t sector) {
+  struct cache_entry* e = cache_get(sector, false);
+  ASSERT(e->pinned);
+  e->pinned = false;
+  lock_release(&e->lock);
+}
+
+/* Queues SECTOR to be read into the cache in the background, if
+   there is room in the queue. */
+void cache_prefetch(block_sector_t sector) {
+  lock_acquire(&ra_lock);
+  if ((ra_head + 1) % RA_QUEUE_SIZE != ra_tail) {
+    ra_queue[ra_head] = sector;
+    ra_head = (ra_head + 1) % RA_QUEUE_SIZE;
+    cond_signal(&ra_nonempty, &ra_lock);
+  } else
+    ra_dropped++;
+  lock_release(&ra_lock);
+}
+
+/* Thread function for the read-ahead thread, which reads the
+   sectors that cache_prefetch() queues, oldest first. */
+static void read_ahead_thread(void* aux UNUSED) {
+  for (;;) {
+    block_sector_t sector;
+
+    lock_acquire(&ra_lock);
+    while (ra_head == ra_tail)
+      cond_wait(&ra_nonempty, &ra_lock);
+    sector = ra_queue[ra_tail];
+    ra_tail = (ra_tail + 1) % RA_QUEUE_SIZE;
+    lock_release(&ra_lock);
+
+    lock_release(&cache_lookup(sector, true, true)->lock);
+  }
+}
+
+/* Timer callout that wakes the flusher thread. */
+static void flusher_wake(void* aux UNUSED) { sema_up(&flush_sema); }
+
+/* Thread function for the flusher thread, which writes dirty
+   sectors back every flush_interval ticks. */
+static void flusher_thread(void* aux UNUSED) {
+  for (;;) {
+    timer_add_callout(&flush_callout, flush_interval, flusher_wake, NULL);
+    sema_down(&flush_sema);
+    cache_flush();
+  }
+}
+
+/* Orders flush slots A and B by sector. */
+static int flush_slot_compare(const void* a_, const void* b_) {
+  const struct flush_slot* a = a_;
+  const struct flush_slot* b = b_;
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Writes the CNT locked entries in flush_run, which hold adjacent
+   sectors starting at SECTOR, to disk and unlocks them. */
+static void flush_write_run(block_sector_t sector, size_t cnt) {
+  size_t i;
+
+  if (cnt == 1)
+    block_write(fs_device, sector, flush_run[0]->data);
+  else {
+    for (i = 0; i < cnt; i++)
+      memcpy(flush_buf + i * BLOCK_SECTOR_SIZE, flush_run[i]->data, BLOCK_SECTOR_SIZE);
+    block_write_multiple(fs_device, sector, cnt, flush_buf);
+  }
+  for (i = 0; i < cnt; i++) {
+    flush_run[i]->dirty = false;
+    cache_disown(flush_run[i]);
+    lock_release(&flush_run[i]->lock);
+  }
+  flush_runs++;
+  flush_sectors += cnt;
+}
+
+/* Writes the dirty entries among the first CNT of flush_order,
+   except pinned ones, in ascending order and in runs of up to
+   FLUSH_RUN adjacent sectors.  The caller must hold flush_lock. */
+static void flush_slots(size_t cnt) {
+  block_sector_t run_start = 0;
+  size_t run_cnt = 0;
+  size_t i;
+
+  qsort(flush_order, cnt, sizeof *flush_order, flush_slot_compare);
+
+  for (i = 0; i < cnt; i++) {
+    struct flush_slot* s = &flush_order[i];
+
+    /* Finish the current run before waiting for an entry that
+       cannot join it. */
+    if (run_cnt > 0 && (run_cnt == FLUSH_RUN || s->sector != run_start + run_cnt)) {
+      flush_write_run(run_start, run_cnt);
+      run_cnt = 0;
+    }
+
+    /* The entry may have been given to another sector since we
+       looked. */
+    lock_acquire(&s->entry->lock);
+    if (s->entry->sector != s->sector || !s->entry->dirty || s->entry->pinned) {
+      lock_release(&s->entry->lock);
+      continue;
+    }
+    if (run_cnt == 0)
+      run_start = s->sector;
+    flush_run[run_cnt++] = s->entry;
+  }
+  if (run_cnt > 0)
+    flush_write_run(run_start, run_cnt);
+}
+
+/* Writes every dirty sector in the cache to disk, except pinned
+   ones. */
+void cache_flush(void) {
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire(&flush_lock);
+  lock_acquire(&cache_lock);
+  for (i = 0; i < CACHE_SECTORS; i++)
+    if (entries[i].sector != NO_SECTOR) {
+      flush_order[cnt].sector = entries[i].sector;
+      flush_order[cnt++].entry = &entries[i];
+    }
+  lock_release(&cache_lock);
+  flush_slots(cnt);
+  lock_release(&flush_lock);
+}
+
+/* Writes OWNER's dirty sectors to disk, except pinned ones.  Does
+   not look at any other entry. */
+void cache_flush_owner(struct cache_owner* owner) {
+  struct list_elem* elem;
+  size_t cnt = 0;
+
+  lock_acquire(&flush_lock);
+
+  /* An entry on OWNER's list is dirty, so it keeps its sector
+     until it is written back and taken off the list. */
+  lock_acquire(&owner_lock);
+  for (elem = list_begin(&owner->dirty); elem != list_end(&owner->dirty);
+       elem = list_next(elem)) {
+    struct cache_entry* e = list_entry(elem, struct cache_entry, owner_elem);
+    flush_order[cnt].sector = e->sector;
+    flush_order[cnt++].entry = e;
+  }
+  lock_release(&owner_lock);
+  flush_slots(cnt);
+  lock_release(&flush_lock);
+}
+
+/* Prints buffer cache statistics. */
+void cache_print_stats(void) {
+  printf("Cache: %llu hits, %llu misses\n", hit_cnt, miss_cnt);
+}
+
+/* Stores the buffer cache's statistics into the cache members of
+   STATS. */
+void cache_get_stats(struct fs_stats* stats) {
+  lock_acquire(&flush_lock);
+  stats->flush_runs = flush_runs;
+  stats->flush_sectors = flush_sectors;
+  lock_release(&flush_lock);
+
+  lock_acquire(&cache_lock);
+  stats->cache_hits = hit_cnt;
+  stats->cache_misses = miss_cnt;
+  stats->evict_writes = evict_writes;
+  stats->ra_reads = ra_reads;
+  stats->ra_used = ra_used;
+  stats->ra_unused = ra_unused;
+  lock_release(&cache_lock);
+
+  lock_acquire(&ra_lock);
+  stats->ra_dropped = ra_dropped;
+  lock_release(&ra_lock);
+}
@@ -0,0 +1,36 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <list.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+struct fs_stats;
+
+/* The dirty sectors of one file, so that they can be written back
+   without the rest of the cache.  Members are private to
+   cache.c. */
+struct cache_owner {
+  struct list dirty; /* Dirty entries written for this owner. */
+};
+
+void cache_init(void);
+void cache_read(block_sector_t, void*);
+void cache_read_at(block_sector_t, void*, size_t ofs, size_t size);
+void cache_write(block_sector_t, const void*);
+void cache_write_at(block_sector_t, const void*, size_t ofs, size_t size);
+void cache_owner_init(struct cache_owner*);
+void cache_owner_done(struct cache_owner*);
+void cache_write_owned_at(struct cache_owner*, block_sector_t, const void*, size_t ofs,
+                          size_t size);
+void cache_flush_owner(struct cache_owner*);
+const void* cache_hold(block_sector_t);
+void cache_unhold(const void*);
+void cache_pin(block_sector_t);
+void cache_unpin(block_sector_t);
+void cache_prefetch(block_sector_t);
+void cache_flush(void);
+void cache_print_stats(void);
+void cache_get_stats(struct fs_stats*);
+
+#endif /* filesys/cache.h */
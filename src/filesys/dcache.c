@@ -0,0 +1,147 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Remembers the results of recent directory lookups, keyed by the
+   directory's inode sector and the name looked up, so that
+   resolving the same names again reads no directory sectors.  The
+   result is the sector of the named file's inode, or 0 if the
+   directory has no such name, which is never an inode's sector
+   (see FREE_MAP_SECTOR).  directory.c keeps the cache current by
+   recording each change it makes to a directory's entries while
+   it holds the directory's lock.
+
+   Lock order: directory locks, then dcache_lock. */
+
+/* Number of lookups remembered. */
+#define DCACHE_SIZE 256
+
+/* A remembered lookup. */
+struct dcache_entry {
+  struct hash_elem hash_elem; /* Element in dcache_map, if IN_USE. */
+  struct list_elem lru_elem;  /* Element in lru_list. */
+  bool in_use;                /* Holds a lookup? */
+  block_sector_t dir;         /* Sector of the directory's inode. */
+  char name[NAME_MAX + 1];    /* Name looked up. */
+  block_sector_t sector;      /* Sector of NAME's inode, or 0 if none. */
+};
+
+static struct dcache_entry entries[DCACHE_SIZE];
+static struct hash dcache_map; /* Entries in use, by directory and name. */
+static struct list lru_list;   /* All entries, most recently used first. */
+static struct lock dcache_lock;
+
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+
+/* Initializes the directory entry cache. */
+void dcache_init(void) {
+  size_t i;
+
+  if (!hash_init_mode(&dcache_map, entry_hash, entry_less, NULL, HASH_INCREMENTAL))
+    PANIC("Failed to allocate the directory entry cache");
+  list_init(&lru_list);
+  for (i = 0; i < DCACHE_SIZE; i++) {
+    entries[i].in_use = false;
+    list_push_back(&lru_list, &entries[i].lru_elem);
+  }
+  lock_init_named(&dcache_lock, "dcache");
+}
+
+/* Hash function for dcache_map. */
+static unsigned entry_hash(const struct hash_elem* e_, void* aux UNUSED) {
+  const struct dcache_entry* e = hash_entry(e_, struct dcache_entry, hash_elem);
+  return hash_string(e->name) ^ hash_int(e->dir);
+}
+
+/* Comparison function for dcache_map. */
+static bool entry_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  const struct dcache_entry* a = hash_entry(a_, struct dcache_entry, hash_elem);
+  const struct dcache_entry* b = hash_entry(b_, struct dcache_entry, hash_elem);
+  return a->dir != b->dir ? a->dir < b->dir : strcmp(a->name, b->name) < 0;
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer if there
+   is none.  The caller must hold dcache_lock. */
+static struct dcache_entry* dcache_find(block_sector_t dir, const char* name) {
+  struct dcache_entry key;
+  struct hash_elem* e;
+
+  ASSERT(lock_held_by_current_thread(&dcache_lock));
+  key.dir = dir;
+  strlcpy(key.name, name, sizeof key.name);
+  e = hash_find(&dcache_map, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Looks up NAME in directory DIR in the cache.  If the result is
+   known, stores it into *SECTORP, which becomes 0 if DIR has no
+   file named NAME, and returns true.  Otherwise returns false. */
+bool dcache_lookup(block_sector_t dir, const char* name, block_sector_t* sectorp) {
+  struct dcache_entry* e;
+
+  if (strlen(name) > NAME_MAX)
+    return false;
+
+  lock_acquire(&dcache_lock);
+  e = dcache_find(dir, name);
+  if (e != NULL) {
+    list_remove(&e->lru_elem);
+    list_push_front(&lru_list, &e->lru_elem);
+    *sectorp = e->sector;
+  }
+  lock_release(&dcache_lock);
+  return e != NULL;
+}
+
+/* Records that NAME in directory DIR is the file whose inode is
+   in SECTOR, or that DIR has no file named NAME if SECTOR is 0,
+   replacing the least recently used lookup if necessary.  The
+   caller must hold DIR's lock. */
+void dcache_record(block_sector_t dir, const char* name, block_sector_t sector) {
+  struct dcache_entry* e;
+
+  if (strlen(name) > NAME_MAX)
+    return;
+
+  lock_acquire(&dcache_lock);
+  e = dcache_find(dir, name);
+  if (e == NULL) {
+    e = list_entry(list_back(&lru_list), struct dcache_entry, lru_elem);
+    if (e->in_use)
+      hash_delete(&dcache_map, &e->hash_elem);
+    e->in_use = true;
+    e->dir = dir;
+    strlcpy(e->name, name, sizeof e->name);
+    hash_insert(&dcache_map, &e->hash_elem);
+  }
+  e->sector = sector;
+  list_remove(&e->lru_elem);
+  list_push_front(&lru_list, &e->lru_elem);
+  lock_release(&dcache_lock);
+}
+
+/* Forgets every lookup in directory DIR.  Called when a new
+   directory is created in sector DIR, which may have held a
+   directory before. */
+void dcache_forget_dir(block_sector_t dir) {
+  size_t i;
+
+  lock_acquire(&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++) {
+    struct dcache_entry* e = &entries[i];
+    if (e->in_use && e->dir == dir) {
+      hash_delete(&dcache_map, &e->hash_elem);
+      e->in_use = false;
+      list_remove(&e->lru_elem);
+      list_push_back(&lru_list, &e->lru_elem);
+    }
+  }
+  lock_release(&dcache_lock);
+}
@@ -1,10 +1,18 @@
 #include "filesys/directory.h"
+#include <dirent.h>
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <packed.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/fsstat.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
@@ -19,10 +27,172 @@ struct dir_entry {
   bool in_use;                 /* In use or free? */
 };
 
+/* Hashed directories.
+
+   A directory made by dir_create() starts with a header sector,
+   followed by BUCKET_CNT bucket sectors.  An entry goes in the
+   bucket that its name hashes to or, if that one is full, the
+   first bucket after it that has room, wrapping around.  Each
+   full bucket passed on the way is marked as having overflowed,
+   so that a lookup knows where it can stop.  When the directory
+   gets 3/4 full, the number of buckets is doubled and every entry
+   hashed again.  Lookups, insertions and removals thus usually
+   touch the header and a single bucket.
+
+   A bucket packs variable-length records, each holding an inode
+   sector, a name length and the name without its null
+   terminator, from the start of its sector, and ends with a
+   struct bucket_tail.  Removing a record moves the ones after it
+   down, so a bucket never has holes.  The tail's summary has a
+   bit set for the hash of every name in the bucket, so a lookup
+   reads only the tail of a bucket that cannot hold the name.
+
+   A directory in the original format, a plain array of entries,
+   has no header and is still read and written as before.  A
+   header looks like an unused entry whose inode sector is
+   DIR_MAGIC, which can never be a real sector number. */
+
+/* Identifies a hashed directory. */
+#define DIR_MAGIC 0x43534944
+
+/* Start of a record in a bucket, followed by NAME_LEN bytes of
+   name. */
+struct dir_record {
+  block_sector_t inode_sector; /* Sector number of header. */
+  uint8_t name_len;            /* Length of the name. */
+} PACKED;
+
+/* End of a bucket's sector. */
+struct bucket_tail {
+  uint32_t summary;   /* name_bit() of every name in the bucket. */
+  uint16_t used;      /* Bytes of records at the start of the sector. */
+  uint8_t overflowed; /* Has an insertion passed this bucket by? */
+  uint8_t unused;     /* Not used. */
+};
+
+/* Bytes of records that fit in a bucket. */
+#define BUCKET_BYTES (BLOCK_SECTOR_SIZE - sizeof(struct bucket_tail))
+
+/* A bucket sector. */
+struct bucket {
+  uint8_t records[BUCKET_BYTES]; /* Records, then unused bytes. */
+  struct bucket_tail tail;       /* Summary and counts. */
+};
+
+/* Entries a bucket is counted as holding when deciding to grow
+   the directory, which assumes names of 8 characters. */
+#define BUCKET_ENTRIES (BUCKET_BYTES / (sizeof(struct dir_record) + 8))
+
+/* Positions in a hashed directory.  dir_readdir() reads each
+   bucket's records from the last one back, so that removing one
+   it has already returned moves none of those still to come.
+   The position is the bucket times POS_BUCKET plus POS_FRESH less
+   the number of its records still to read, so that 0 is the
+   start of the directory.  POS_FRESH is more than any bucket
+   holds. */
+#define POS_FRESH 127
+#define POS_BUCKET (POS_FRESH + 1)
+
+/* Start of a hashed directory.  The rest of its sector is zero. */
+struct dir_header {
+  uint32_t magic;      /* DIR_MAGIC. */
+  uint32_t bucket_cnt; /* Number of buckets. */
+  uint32_t entry_cnt;  /* Number of entries in use. */
+};
+
+/* Returns the number of buckets a hashed directory needs to hold
+   ENTRY_CNT entries without being more than 3/4 full. */
+static size_t buckets_for(size_t entry_cnt) {
+  size_t bucket_cnt = DIV_ROUND_UP(entry_cnt * 4, BUCKET_ENTRIES * 3);
+  return bucket_cnt > 0 ? bucket_cnt : 1;
+}
+
+/* Returns the offset of bucket BUCKET. */
+static off_t bucket_ofs(size_t bucket) { return (off_t)(bucket + 1) * BLOCK_SECTOR_SIZE; }
+
+/* Returns the offset of bucket BUCKET's tail. */
+static off_t tail_ofs(size_t bucket) { return bucket_ofs(bucket) + BUCKET_BYTES; }
+
+/* Returns the summary bit for a name whose hash is HASH.  Takes
+   the top bits, which usually do not choose the bucket. */
+static uint32_t name_bit(unsigned hash) { return (uint32_t)1 << (hash >> 27); }
+
+/* Returns the record at byte OFS in B. */
+static struct dir_record* record_at(struct bucket* b, size_t ofs) {
+  return (struct dir_record*)(b->records + ofs);
+}
+
+/* Returns the bytes that record R takes up. */
+static size_t record_size(const struct dir_record* r) { return sizeof *r + r->name_len; }
+
+/* Returns record R's name, which is not null-terminated. */
+static const char* record_name(const struct dir_record* r) { return (const char*)(r + 1); }
+
+/* Reads bucket BUCKET of directory INODE into *B.  Returns true
+   if successful, false on a disk error or if the records do not
+   add up to the bucket's USED bytes, which would mean the bucket
+   is corrupt. */
+static bool read_bucket(struct inode* inode, size_t bucket, struct bucket* b) {
+  size_t ofs;
+
+  if (inode_read_at(inode, b, sizeof *b, bucket_ofs(bucket)) != sizeof *b ||
+      b->tail.used > BUCKET_BYTES)
+    return false;
+  for (ofs = 0; ofs < b->tail.used; ofs += record_size(record_at(b, ofs)))
+    if (b->tail.used - ofs < sizeof(struct dir_record) || record_at(b, ofs)->name_len > NAME_MAX)
+      return false;
+  return ofs == b->tail.used;
+}
+
+/* Writes *B as bucket BUCKET of directory INODE.  Returns true if
+   successful, false on failure. */
+static bool write_bucket(struct inode* inode, size_t bucket, const struct bucket* b) {
+  return inode_write_at(inode, b, sizeof *b, bucket_ofs(bucket)) == sizeof *b;
+}
+
+/* Copies the record at OFS in B into *EP. */
+static void record_to_entry(struct bucket* b, size_t ofs, struct dir_entry* ep) {
+  const struct dir_record* r = record_at(b, ofs);
+
+  ep->inode_sector = r->inode_sector;
+  memcpy(ep->name, record_name(r), r->name_len);
+  ep->name[r->name_len] = '\0';
+  ep->in_use = true;
+}
+
+/* Reads the header of directory INODE into *H.  Returns true if
+   INODE is a hashed directory, false if it is in the original
+   format. */
+static bool read_header(struct inode* inode, struct dir_header* h) {
+  return inode_read_at(inode, h, sizeof *h, 0) == sizeof *h && h->magic == DIR_MAGIC;
+}
+
+/* Writes *H as the header of directory INODE.  Returns true if
+   successful, false on failure. */
+static bool write_header(struct inode* inode, const struct dir_header* h) {
+  return inode_write_at(inode, h, sizeof *h, 0) == sizeof *h;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool dir_create(block_sector_t sector, size_t entry_cnt) {
-  return inode_create(sector, entry_cnt * sizeof(struct dir_entry));
+  struct dir_header h;
+  struct inode* inode;
+  bool success;
+
+  h.magic = DIR_MAGIC;
+  h.bucket_cnt = buckets_for(entry_cnt);
+  h.entry_cnt = 0;
+  if (!inode_create(sector, (1 + h.bucket_cnt) * BLOCK_SECTOR_SIZE))
+    return false;
+  dcache_forget_dir(sector);
+  inode = inode_open(sector);
+  if (inode == NULL)
+    return false;
+  inode_set_metadata(inode);
+  success = write_header(inode, &h);
+  inode_close(inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -30,6 +200,7 @@ bool dir_create(block_sector_t sector, size_t entry_cnt) {
 struct dir* dir_open(struct inode* inode) {
   struct dir* dir = calloc(1, sizeof *dir);
   if (inode != NULL && dir != NULL) {
+    inode_set_metadata(inode);
     dir->inode = inode;
     dir->pos = 0;
     return dir;
@@ -59,44 +230,210 @@ void dir_close(struct dir* dir) {
 /* Returns the inode encapsulated by DIR. */
 struct inode* dir_get_inode(struct dir* dir) { return dir->inode; }
 
+/* Searches hashed directory INODE, whose header is *H, for NAME,
+   like lookup().  Reads the whole of a bucket only if its summary
+   allows that NAME is there. */
+static bool hashed_lookup(struct inode* inode, const struct dir_header* h, const char* name,
+                          struct dir_entry* ep, off_t* ofsp) {
+  unsigned hash = hash_string(name);
+  size_t first = hash % h->bucket_cnt;
+  size_t len = strlen(name);
+  struct bucket b;
+  size_t i, ofs;
+
+  for (i = 0; i < h->bucket_cnt; i++) {
+    size_t bucket = (first + i) % h->bucket_cnt;
+    struct bucket_tail tail;
+
+    if (inode_read_at(inode, &tail, sizeof tail, tail_ofs(bucket)) != sizeof tail)
+      break;
+    if ((tail.summary & name_bit(hash)) && read_bucket(inode, bucket, &b))
+      for (ofs = 0; ofs < b.tail.used; ofs += record_size(record_at(&b, ofs))) {
+        const struct dir_record* r = record_at(&b, ofs);
+        if (r->name_len == len && !memcmp(record_name(r), name, len)) {
+          record_to_entry(&b, ofs, ep);
+          *ofsp = bucket_ofs(bucket) + ofs;
+          return true;
+        }
+      }
+    if (!tail.overflowed)
+      break;
+  }
+  return false;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   The caller must hold DIR's inode_dir_lock(). */
 static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep, off_t* ofsp) {
+  struct dir_header h;
   struct dir_entry e;
-  size_t ofs;
+  bool found = false;
+  off_t ofs;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
-  for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
-    if (e.in_use && !strcmp(name, e.name)) {
-      if (ep != NULL)
-        *ep = e;
-      if (ofsp != NULL)
-        *ofsp = ofs;
-      return true;
+  if (read_header(dir->inode, &h))
+    found = hashed_lookup(dir->inode, &h, name, &e, &ofs);
+  else
+    for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
+      if (e.in_use && !strcmp(name, e.name)) {
+        found = true;
+        break;
+      }
+  if (!found)
+    return false;
+
+  if (ep != NULL)
+    *ep = e;
+  if (ofsp != NULL)
+    *ofsp = ofs;
+  return true;
+}
+
+/* Appends *E to the first bucket of hashed directory INODE, whose
+   header is *H, that has room for it, starting at the bucket that
+   E's name hashes to, and marks the full buckets before it as
+   overflowed.  B is scratch space.  Returns true if successful,
+   false if every bucket is full or a disk error occurs. */
+static bool hashed_insert(struct inode* inode, const struct dir_header* h,
+                          const struct dir_entry* e, struct bucket* b) {
+  unsigned hash = hash_string(e->name);
+  size_t first = hash % h->bucket_cnt;
+  size_t len = strlen(e->name);
+  size_t i;
+
+  for (i = 0; i < h->bucket_cnt; i++) {
+    size_t bucket = (first + i) % h->bucket_cnt;
+
+    if (!read_bucket(inode, bucket, b))
+      return false;
+    if (BUCKET_BYTES - b->tail.used >= sizeof(struct dir_record) + len) {
+      struct dir_record* r = record_at(b, b->tail.used);
+      r->inode_sector = e->inode_sector;
+      r->name_len = len;
+      memcpy(r + 1, e->name, len);
+      b->tail.used += record_size(r);
+      b->tail.summary |= name_bit(hash);
+      return write_bucket(inode, bucket, b);
+    }
+    if (!b->tail.overflowed) {
+      b->tail.overflowed = 1;
+      if (inode_write_at(inode, &b->tail, sizeof b->tail, tail_ofs(bucket)) != sizeof b->tail)
+        return false;
     }
+  }
   return false;
 }
 
+/* Removes the record at OFS in hashed directory INODE, moving the
+   records after it down and recomputing the bucket's summary.
+   Returns true if successful, false if memory is short or a disk
+   error occurs. */
+static bool hashed_erase(struct inode* inode, off_t ofs) {
+  size_t bucket = ofs / BLOCK_SECTOR_SIZE - 1;
+  size_t start = ofs % BLOCK_SECTOR_SIZE;
+  struct bucket* b = malloc(sizeof *b);
+  bool success = false;
+
+  if (b != NULL && read_bucket(inode, bucket, b) && start < b->tail.used) {
+    size_t size = record_size(record_at(b, start));
+    size_t i;
+
+    memmove(b->records + start, b->records + start + size, b->tail.used - start - size);
+    b->tail.used -= size;
+    memset(b->records + b->tail.used, 0, size);
+    b->tail.summary = 0;
+    for (i = 0; i < b->tail.used; i += record_size(record_at(b, i))) {
+      const struct dir_record* r = record_at(b, i);
+      b->tail.summary |= name_bit(hash_bytes(record_name(r), r->name_len));
+    }
+    success = write_bucket(inode, bucket, b);
+  }
+  free(b);
+  return success;
+}
+
+/* Rehashes the entries of hashed directory INODE, whose header is
+   *H, into BUCKET_CNT buckets, and updates *H to match.  B is
+   scratch space.  Returns true if successful.  On failure, which
+   occurs if memory or the disk is exhausted, leaves the directory
+   as it was. */
+static bool rehash(struct inode* inode, struct dir_header* h, size_t bucket_cnt,
+                   struct bucket* b) {
+  const struct bucket_tail empty = {0, 0, 0, 0};
+  struct dir_entry* entries;
+  size_t entry_cnt = 0;
+  size_t bucket, ofs, i;
+
+  /* Set aside disk space for the new buckets, so that nothing
+     below can fail for lack of it. */
+  entries = malloc((h->entry_cnt + 1) * sizeof *entries);
+  if (entries == NULL)
+    return false;
+  if (!inode_reserve(inode, 0, (1 + bucket_cnt) * BLOCK_SECTOR_SIZE) ||
+      inode_write_at(inode, &empty, sizeof empty, tail_ofs(bucket_cnt - 1)) != sizeof empty) {
+    free(entries);
+    return false;
+  }
+
+  /* Take the entries out of the old buckets. */
+  for (bucket = 0; bucket < h->bucket_cnt; bucket++) {
+    if (read_bucket(inode, bucket, b))
+      for (ofs = 0; ofs < b->tail.used && entry_cnt < h->entry_cnt;
+           ofs += record_size(record_at(b, ofs)))
+        record_to_entry(b, ofs, &entries[entry_cnt++]);
+    memset(b, 0, sizeof *b);
+    write_bucket(inode, bucket, b);
+  }
+
+  /* Put them back in the new ones. */
+  h->bucket_cnt = bucket_cnt;
+  for (i = 0; i < entry_cnt; i++)
+    hashed_insert(inode, h, &entries[i], b);
+  write_header(inode, h);
+  free(entries);
+  return true;
+}
+
+/* Returns the sector of the inode of the file named NAME in DIR,
+   or 0 if there is none, trying the directory entry cache first.
+   The caller must hold DIR's inode_dir_lock(). */
+static block_sector_t lookup_sector(const struct dir* dir, const char* name) {
+  block_sector_t dir_sector = inode_get_inumber(dir->inode);
+  block_sector_t sector;
+  struct dir_entry e;
+
+  if (!dcache_lookup(dir_sector, name, &sector)) {
+    sector = lookup(dir, name, &e, NULL) ? e.inode_sector : 0;
+    dcache_record(dir_sector, name, sector);
+  }
+  return sector;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
 bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode) {
-  struct dir_entry e;
+  uint64_t start = fsstat_start();
+  block_sector_t sector;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
-  if (lookup(dir, name, &e, NULL))
-    *inode = inode_open(e.inode_sector);
-  else
-    *inode = NULL;
+  /* Open the inode before letting go of the directory, so that
+     the file cannot be removed in between. */
+  lock_acquire(inode_dir_lock(dir->inode));
+  sector = lookup_sector(dir, name);
+  *inode = sector != 0 ? inode_open(sector) : NULL;
+  lock_release(inode_dir_lock(dir->inode));
 
+  fsstat_done(FS_LOOKUP, start);
   return *inode != NULL;
 }
 
@@ -107,7 +444,8 @@ bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode) {
    Fails if NAME is invalid (i.e. too long) or a disk or memory
    error occurs. */
 bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector) {
-  struct dir_entry e;
+  struct dir_header h;
+  struct dir_entry e, slot;
   off_t ofs;
   bool success = false;
 
@@ -119,9 +457,32 @@ bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector) {
     return false;
 
   /* Check that NAME is not in use. */
-  if (lookup(dir, name, NULL, NULL))
+  journal_begin();
+  lock_acquire(inode_dir_lock(dir->inode));
+  if (lookup_sector(dir, name) != 0)
     goto done;
 
+  e.in_use = true;
+  strlcpy(e.name, name, sizeof e.name);
+  e.inode_sector = inode_sector;
+
+  /* In a hashed directory, grow the table first if it would get
+     too full.  If that fails there may still be room. */
+  if (read_header(dir->inode, &h)) {
+    struct bucket* b = malloc(sizeof *b);
+
+    if (b != NULL) {
+      if (buckets_for(h.entry_cnt + 1) > h.bucket_cnt)
+        rehash(dir->inode, &h, h.bucket_cnt * 2, b);
+      if (hashed_insert(dir->inode, &h, &e, b)) {
+        h.entry_cnt++;
+        success = write_header(dir->inode, &h);
+      }
+      free(b);
+    }
+    goto done;
+  }
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -129,17 +490,19 @@ bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector) {
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
-    if (!e.in_use)
+  for (ofs = 0; inode_read_at(dir->inode, &slot, sizeof slot, ofs) == sizeof slot;
+       ofs += sizeof slot)
+    if (!slot.in_use)
       break;
 
   /* Write slot. */
-  e.in_use = true;
-  strlcpy(e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
   success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
 
 done:
+  if (success)
+    dcache_record(inode_get_inumber(dir->inode), name, inode_sector);
+  lock_release(inode_dir_lock(dir->inode));
+  journal_end();
   return success;
 }
 
@@ -147,6 +510,7 @@ done:
    Returns true if successful, false on failure,
    which occurs only if there is no file with the given NAME. */
 bool dir_remove(struct dir* dir, const char* name) {
+  struct dir_header h;
   struct dir_entry e;
   struct inode* inode = NULL;
   bool success = false;
@@ -156,6 +520,8 @@ bool dir_remove(struct dir* dir, const char* name) {
   ASSERT(name != NULL);
 
   /* Find directory entry. */
+  journal_begin();
+  lock_acquire(inode_dir_lock(dir->inode));
   if (!lookup(dir, name, &e, &ofs))
     goto done;
 
@@ -165,31 +531,131 @@ bool dir_remove(struct dir* dir, const char* name) {
     goto done;
 
   /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at(dir->inode, &e, sizeof e, ofs) != sizeof e)
-    goto done;
+  if (read_header(dir->inode, &h)) {
+    if (!hashed_erase(dir->inode, ofs))
+      goto done;
+    h.entry_cnt--;
+    write_header(dir->inode, &h);
+  } else {
+    e.in_use = false;
+    if (inode_write_at(dir->inode, &e, sizeof e, ofs) != sizeof e)
+      goto done;
+  }
 
   /* Remove inode. */
   inode_remove(inode);
+  dcache_record(inode_get_inumber(dir->inode), name, 0);
   success = true;
 
 done:
+  lock_release(inode_dir_lock(dir->inode));
   inode_close(inode);
+  journal_end();
   return success;
 }
 
+/* Reads up to CNT of the entries in DIR after the last one read
+   into ENTS, filling in their names and inode numbers, and
+   returns how many it read.  Reads a bucket, or a sector of a
+   directory in the original format, at a time. */
+static size_t read_entries(struct dir* dir, struct dirent* ents, size_t cnt) {
+  struct dir_header h;
+  size_t n = 0;
+  size_t i;
+
+  lock_acquire(inode_dir_lock(dir->inode));
+  if (read_header(dir->inode, &h)) {
+    struct bucket b;
+    uint16_t offsets[POS_FRESH];
+
+    while (n < cnt && (size_t)dir->pos / POS_BUCKET < h.bucket_cnt) {
+      size_t bucket = dir->pos / POS_BUCKET;
+      size_t left = POS_FRESH - dir->pos % POS_BUCKET;
+      size_t rec_cnt = 0;
+      size_t ofs;
+
+      if (!read_bucket(dir->inode, bucket, &b))
+        break;
+      for (ofs = 0; ofs < b.tail.used; ofs += record_size(record_at(&b, ofs)))
+        offsets[rec_cnt++] = ofs;
+      if (left > rec_cnt)
+        left = rec_cnt;
+      for (; left > 0 && n < cnt; n++) {
+        const struct dir_record* r = record_at(&b, offsets[--left]);
+        ents[n].inumber = r->inode_sector;
+        memcpy(ents[n].name, record_name(r), r->name_len);
+        ents[n].name[r->name_len] = '\0';
+      }
+      dir->pos = left > 0 ? bucket * POS_BUCKET + (POS_FRESH - left) : (bucket + 1) * POS_BUCKET;
+    }
+  } else {
+    struct dir_entry buf[BLOCK_SECTOR_SIZE / sizeof(struct dir_entry)];
+
+    while (n < cnt) {
+      size_t slot_cnt = inode_read_at(dir->inode, buf, sizeof buf, dir->pos) / sizeof *buf;
+
+      if (slot_cnt == 0)
+        break;
+      for (i = 0; i < slot_cnt && n < cnt; i++) {
+        dir->pos += sizeof *buf;
+        if (buf[i].in_use) {
+          ents[n].inumber = buf[i].inode_sector;
+          strlcpy(ents[n].name, buf[i].name, sizeof ents[n].name);
+          n++;
+        }
+      }
+    }
+  }
+  lock_release(inode_dir_lock(dir->inode));
+  return n;
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
 bool dir_readdir(struct dir* dir, char name[NAME_MAX + 1]) {
-  struct dir_entry e;
+  struct dirent ent;
 
-  while (inode_read_at(dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
-    dir->pos += sizeof e;
-    if (e.in_use) {
-      strlcpy(name, e.name, NAME_MAX + 1);
-      return true;
-    }
+  if (read_entries(dir, &ent, 1) == 0)
+    return false;
+  strlcpy(name, ent.name, NAME_MAX + 1);
+  return true;
+}
+
+/* Fills in ENT's size and type from its inode.  A directory is
+   recognized by its header, as read_header() does. */
+static void stat_entry(struct dirent* ent) {
+  struct inode* inode = inode_open(ent->inumber);
+  struct dir_header h;
+
+  ent->size = 0;
+  ent->type = DT_REG;
+  if (inode != NULL) {
+    ent->size = inode_length(inode);
+    if (ent->inumber == ROOT_DIR_SECTOR || read_header(inode, &h))
+      ent->type = DT_DIR;
+    inode_close(inode);
   }
-  return false;
 }
+
+/* Reads up to CNT of the entries in DIR after the last one read
+   into ENTS, and returns how many it read, 0 at the end of the
+   directory.  Unlike dir_readdir(), reads a whole bucket or
+   sector of entries at once and takes the directory's lock once
+   for all of them.  Each entry's inode is then opened, with the
+   lock released, for its size and type. */
+size_t dir_readdir_batch(struct dir* dir, struct dirent* ents, size_t cnt) {
+  size_t n = read_entries(dir, ents, cnt);
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    stat_entry(&ents[i]);
+  return n;
+}
+
+/* Sets DIR's position to POS, a value dir_tell() returned, or 0
+   for the first entry. */
+void dir_seek(struct dir* dir, off_t pos) { dir->pos = pos; }
+
+/* Returns DIR's position, for dir_seek(). */
+off_t dir_tell(const struct dir* dir) { return dir->pos; }
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
@@ -11,6 +12,7 @@
    retained, but much longer full path names must be allowed. */
 #define NAME_MAX 14
 
+struct dirent;
 struct inode;
 
 /* Opening and closing directories. */
@@ -26,5 +28,8 @@ bool dir_lookup(const struct dir*, const char* name, struct inode**);
 bool dir_add(struct dir*, const char* name, block_sector_t);
 bool dir_remove(struct dir*, const char* name);
 bool dir_readdir(struct dir*, char name[NAME_MAX + 1]);
+size_t dir_readdir_batch(struct dir*, struct dirent*, size_t cnt);
+void dir_seek(struct dir*, off_t pos);
+off_t dir_tell(const struct dir*);
 
 #endif /* filesys/directory.h */
@@ -0,0 +1,189 @@
+#include "filesys/eventfd.h"
+#include <debug.h>
+#include <poll.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* An event counter: a 64-bit count that write() adds to and
+   read() takes, all of it at once, leaving 0.  Reading waits
+   while the count is 0, and poll() reports the counter readable
+   while it is not, so one thread can wait for notifications from
+   other threads and processes along with its other descriptors.
+   Like a pipe, it is a struct file, passed on by fork() and
+   spawn().
+
+   A timer is an event counter that the timer interrupt adds to
+   each time it expires, instead of write(), so that read()
+   returns the number of expiries since the last read.
+   eventfd_settime() arms it to expire once, after some ticks,
+   and then periodically if it has an interval.  A late callout
+   counts every expiry it missed, so periodic expiries do not
+   drift.
+
+   The callout runs in interrupt context, so the members are
+   protected by turning interrupts off instead of by a lock.
+   Changes advance io_events, which read() and poll() wait
+   on. */
+struct eventfd {
+  uint64_t count;               /* Events not yet read. */
+  bool timer;                   /* Counts expiries rather than writes? */
+  struct timer_callout callout; /* Next expiry, if armed. */
+  int64_t next;                 /* Tick of the next expiry. */
+  int64_t interval;             /* Ticks between expiries, 0 to expire once. */
+};
+
+/* Largest count.  As in Linux, UINT64_MAX is left out. */
+#define COUNT_MAX (UINT64_MAX - 1)
+
+static timer_callout_func expire;
+
+/* Creates an event counter that starts at COUNT, or a disarmed
+   timer if TIMER, and returns a file for it.  Returns a null
+   pointer if memory allocation fails. */
+struct file* eventfd_open(uint64_t count, bool timer) {
+  struct eventfd* ev = malloc(sizeof *ev);
+  struct file* file;
+
+  if (ev == NULL)
+    return NULL;
+  ev->count = timer ? 0 : count;
+  ev->timer = timer;
+  ev->callout.pending = false;
+  ev->next = 0;
+  ev->interval = 0;
+
+  file = file_open_eventfd(ev);
+  if (file == NULL)
+    free(ev);
+  return file;
+}
+
+/* Disarms EV and frees it.  Called when its file is closed for
+   the last time. */
+void eventfd_close(struct eventfd* ev) {
+  timer_cancel_callout(&ev->callout);
+  free(ev);
+}
+
+/* Waits until EV's count is nonzero, then moves it into BUFFER
+   with COPY, as a uint64_t, resets it to 0 and returns 8, the
+   size of the count.  Returns 0 without waiting if SIZE is too
+   small for the count, or -1 if COPY fails, leaving the count
+   as it was.  A null COPY copies with memcpy(). */
+off_t eventfd_read(struct eventfd* ev, void* buffer, off_t size, inode_copy_func* copy) {
+  enum intr_level old_level;
+  uint64_t count;
+  bool ok;
+
+  if (size < (off_t)sizeof count)
+    return 0;
+
+  for (;;) {
+    unsigned seen = eventcount_read(&io_events);
+
+    old_level = intr_disable();
+    count = ev->count;
+    ev->count = 0;
+    intr_set_level(old_level);
+    if (count > 0)
+      break;
+    eventcount_await(&io_events, seen, -1);
+  }
+
+  ok = true;
+  if (copy != NULL)
+    ok = copy(buffer, &count, sizeof count);
+  else
+    memcpy(buffer, &count, sizeof count);
+  if (!ok) {
+    old_level = intr_disable();
+    ev->count += count;
+    intr_set_level(old_level);
+    return -1;
+  }
+  eventcount_advance(&io_events);
+  return sizeof count;
+}
+
+/* Adds the uint64_t in BUFFER to EV's count and returns 8, the
+   size of the count.  Returns 0 without adding anything if SIZE
+   is too small, if EV is a timer, or if the count would pass
+   COUNT_MAX. */
+off_t eventfd_write(struct eventfd* ev, const void* buffer, off_t size) {
+  enum intr_level old_level;
+  uint64_t n;
+  bool ok;
+
+  if (size < (off_t)sizeof n || ev->timer)
+    return 0;
+  memcpy(&n, buffer, sizeof n);
+
+  old_level = intr_disable();
+  ok = n <= COUNT_MAX - ev->count;
+  if (ok)
+    ev->count += n;
+  intr_set_level(old_level);
+  if (!ok)
+    return 0;
+
+  eventcount_advance(&io_events);
+  return sizeof n;
+}
+
+/* Returns POLLIN if EV's count is nonzero, plus POLLOUT if it is
+   not a timer and a write of 1 would succeed. */
+int eventfd_poll(struct eventfd* ev) {
+  enum intr_level old_level = intr_disable();
+  int events = 0;
+
+  if (ev->count > 0)
+    events |= POLLIN;
+  if (!ev->timer && ev->count < COUNT_MAX)
+    events |= POLLOUT;
+  intr_set_level(old_level);
+  return events;
+}
+
+/* Arms timer EV to expire TICKS timer ticks from now, and then
+   every INTERVAL ticks if INTERVAL is positive, or disarms it if
+   TICKS is 0.  Either way, forgets expiries not yet read.
+   Returns false if EV is not a timer. */
+bool eventfd_settime(struct eventfd* ev, int64_t ticks, int64_t interval) {
+  enum intr_level old_level;
+
+  ASSERT(ticks >= 0);
+  ASSERT(interval >= 0);
+
+  if (!ev->timer)
+    return false;
+
+  old_level = intr_disable();
+  timer_cancel_callout(&ev->callout);
+  ev->count = 0;
+  ev->interval = interval;
+  if (ticks > 0) {
+    ev->next = timer_ticks() + ticks;
+    timer_add_callout(&ev->callout, ticks, expire, ev);
+  }
+  intr_set_level(old_level);
+  return true;
+}
+
+/* Timer callout for an armed timer EV_.  Counts the expiries up
+   to now and arms the next one, if the timer is periodic. */
+static void expire(void* ev_) {
+  struct eventfd* ev = ev_;
+  int64_t now = timer_ticks();
+  uint64_t expiries = 1;
+
+  if (ev->interval > 0) {
+    expiries += (now - ev->next) / ev->interval;
+    ev->next += expiries * ev->interval;
+    timer_add_callout(&ev->callout, ev->next - now, expire, ev);
+  }
+  ev->count = expiries <= COUNT_MAX - ev->count ? ev->count + expiries : COUNT_MAX;
+  eventcount_advance(&io_events);
+}
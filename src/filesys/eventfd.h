@@ -0,0 +1,18 @@
+#ifndef FILESYS_EVENTFD_H
+#define FILESYS_EVENTFD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/file.h"
+#include "filesys/off_t.h"
+
+struct eventfd;
+
+struct file* eventfd_open(uint64_t count, bool timer);
+void eventfd_close(struct eventfd*);
+off_t eventfd_read(struct eventfd*, void*, off_t size, inode_copy_func*);
+off_t eventfd_write(struct eventfd*, const void*, off_t size);
+int eventfd_poll(struct eventfd*);
+bool eventfd_settime(struct eventfd*, int64_t ticks, int64_t interval);
+
+#endif /* filesys/eventfd.h */
@@ -1,53 +1,198 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <poll.h>
+#include "devices/block.h"
+#include "filesys/directory.h"
+#include "filesys/eventfd.h"
+#include "filesys/fsstat.h"
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "filesys/pipe.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/tunable.h"
 
-/* An open file. */
+/* An open file.  Threads of a process, and processes that fork()
+   or spawn() passes it on to, may use it at once, so LOCK
+   protects its position and its counts.  Reads and writes at an
+   explicit offset need no lock.
+
+   file_read() watches for sequential reading.  Each read that
+   starts where the last one ended doubles the read-ahead window,
+   up to ra_max_window, and asks the buffer cache to fetch that
+   far past the new position in the background.  Any other read
+   turns read-ahead off until reading is sequential again.
+
+   A file may instead be one end of a pipe, or an event counter
+   (see eventfd.c), in which case it has no inode and only
+   reading, writing, polling and closing apply to it.
+
+   A file opened with file_open_dir() is a directory.  Its
+   position is the directory's, for file_readdir(), and writing
+   it fails, since only the directory module may change it. */
 struct file {
-  struct inode* inode; /* File's inode. */
-  off_t pos;           /* Current position. */
-  bool deny_write;     /* Has file_deny_write() been called? */
-  int ref_count;       /* Number of file descriptors referencing this file. */
+  struct inode* inode;     /* File's inode, or null for a pipe or event counter. */
+  struct pipe* pipe;       /* Pipe this is an end of, or null. */
+  bool pipe_writer;        /* True for a pipe's write end. */
+  struct eventfd* eventfd; /* Event counter this is, or null. */
+  bool dir;                /* Opened as a directory? */
+  struct lock lock;        /* Protects the members below. */
+  off_t pos;               /* Current position. */
+  bool deny_write;         /* Has file_deny_write() been called? */
+  int ref_count;           /* Number of file descriptors referencing this file. */
+  off_t ra_next;           /* Where a sequential read would start. */
+  off_t ra_end;            /* End of what read-ahead has been asked for. */
+  off_t ra_window;         /* Bytes to keep read ahead, 0 when not sequential. */
 };
 
+/* Read-ahead window limits, in bytes.  The maximum is the
+   file.readahead_max tunable. */
+#define RA_MIN_WINDOW (2 * BLOCK_SECTOR_SIZE)
+#define RA_MAX_WINDOW (32 * BLOCK_SECTOR_SIZE)
+static int ra_max_window = RA_MAX_WINDOW;
+
+/* Cache of struct file objects. */
+static struct kmem_cache* file_cache;
+
+/* Initializes the file module. */
+void file_init(void) {
+  file_cache = kmem_cache_create("file", sizeof(struct file), NULL);
+  tunable_register_int("file.readahead_max", &ra_max_window, RA_MIN_WINDOW,
+                       256 * BLOCK_SECTOR_SIZE);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file* file_open(struct inode* inode) {
-  struct file* file = calloc(1, sizeof *file);
+  struct file* file = kmem_cache_alloc(file_cache);
   if (inode != NULL && file != NULL) {
     file->inode = inode;
+    file->pipe = NULL;
+    file->pipe_writer = false;
+    file->eventfd = NULL;
+    file->dir = false;
+    lock_init_named(&file->lock, "file");
     file->pos = 0;
     file->deny_write = false;
     file->ref_count = 1;
+    file->ra_next = 0;
+    file->ra_end = 0;
+    file->ra_window = 0;
     return file;
   } else {
     inode_close(inode);
-    free(file);
+    kmem_cache_free(file_cache, file);
     return NULL;
   }
 }
 
+/* Opens and returns a file for the read end of PIPE, or its
+   write end if WRITER, which takes over one of PIPE's references
+   to that end.  Returns a null pointer if allocation fails. */
+struct file* file_open_pipe(struct pipe* pipe, bool writer) {
+  struct file* file = kmem_cache_alloc(file_cache);
+  if (file != NULL) {
+    file->inode = NULL;
+    file->pipe = pipe;
+    file->pipe_writer = writer;
+    file->eventfd = NULL;
+    file->dir = false;
+    lock_init_named(&file->lock, "file");
+    file->pos = 0;
+    file->deny_write = false;
+    file->ref_count = 1;
+    file->ra_next = 0;
+    file->ra_end = 0;
+    file->ra_window = 0;
+  }
+  return file;
+}
+
+/* Opens and returns a file for event counter EVENTFD, which it
+   takes over.  Returns a null pointer if allocation fails. */
+struct file* file_open_eventfd(struct eventfd* eventfd) {
+  struct file* file = kmem_cache_alloc(file_cache);
+  if (file != NULL) {
+    file->inode = NULL;
+    file->pipe = NULL;
+    file->pipe_writer = false;
+    file->eventfd = eventfd;
+    file->dir = false;
+    lock_init_named(&file->lock, "file");
+    file->pos = 0;
+    file->deny_write = false;
+    file->ref_count = 1;
+    file->ra_next = 0;
+    file->ra_end = 0;
+    file->ra_window = 0;
+  }
+  return file;
+}
+
+/* Opens a file for directory INODE, of which it takes ownership,
+   as file_open() does. */
+struct file* file_open_dir(struct inode* inode) {
+  struct file* file = file_open(inode);
+  if (file != NULL)
+    file->dir = true;
+  return file;
+}
+
+/* Returns true if FILE is an end of a pipe. */
+bool file_is_pipe(const struct file* file) { return file->pipe != NULL; }
+
+/* Returns true if FILE has no inode, being a pipe end or an
+   event counter, and so no position, length or inode number. */
+bool file_is_stream(const struct file* file) { return file->inode == NULL; }
+
+/* Returns true if FILE was opened as a directory. */
+bool file_is_dir(const struct file* file) { return file->dir; }
+
+/* Returns the poll() events among EVENTS that are ready on FILE.
+   Reading and writing an inode never waits, so both are always
+   ready. */
+int file_poll(struct file* file, int events) {
+  if (file->pipe != NULL)
+    return pipe_poll(file->pipe, file->pipe_writer) & (events | POLLERR | POLLHUP);
+  if (file->eventfd != NULL)
+    return eventfd_poll(file->eventfd) & events;
+  return events & (POLLIN | POLLOUT);
+}
+
 /* Opens and returns a new file for the same inode as FILE.
    Returns a null pointer if unsuccessful. */
-struct file* file_reopen(struct file* file) { return file_open(inode_reopen(file->inode)); }
+struct file* file_reopen(struct file* file) {
+  struct inode* inode = inode_reopen(file->inode);
+  return file->dir ? file_open_dir(inode) : file_open(inode);
+}
 
 /* Increments the reference count for FILE. */
 void file_ref(struct file* file) {
   if (file != NULL) {
+    lock_acquire(&file->lock);
     file->ref_count++;
+    lock_release(&file->lock);
   }
 }
 
 /* Decrements the reference count for FILE and closes it if count reaches 0. */
 void file_close(struct file* file) {
   if (file != NULL) {
-    file->ref_count--;
-    if (file->ref_count <= 0) {
-      file_allow_write(file);
-      inode_close(file->inode);
-      free(file);
+    bool last;
+
+    lock_acquire(&file->lock);
+    last = --file->ref_count <= 0;
+    lock_release(&file->lock);
+    if (last) {
+      if (file->pipe != NULL)
+        pipe_close(file->pipe, file->pipe_writer);
+      else if (file->eventfd != NULL)
+        eventfd_close(file->eventfd);
+      else {
+        file_allow_write(file);
+        inode_close(file->inode);
+      }
+      kmem_cache_free(file_cache, file);
     }
   }
 }
@@ -55,58 +200,225 @@ void file_close(struct file* file) {
 /* Returns the inode encapsulated by FILE. */
 struct inode* file_get_inode(struct file* file) { return file->inode; }
 
+/* Returns the event counter that FILE is, or a null pointer. */
+struct eventfd* file_get_eventfd(struct file* file) { return file->eventfd; }
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
    Advances FILE's position by the number of bytes read. */
 off_t file_read(struct file* file, void* buffer, off_t size) {
-  off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+  return file_read_copy(file, buffer, size, NULL);
+}
+
+/* Advances FILE's position past BYTES_READ bytes just read there
+   and keeps read-ahead going if reading is sequential.  The caller
+   must hold FILE's lock. */
+static void file_advance(struct file* file, off_t bytes_read) {
+  if (file->pos != file->ra_next)
+    file->ra_window = 0;
+  else if (file->ra_window == 0)
+    file->ra_window = RA_MIN_WINDOW;
+  else if (file->ra_window < ra_max_window)
+    file->ra_window = file->ra_window * 2 < ra_max_window ? file->ra_window * 2 : ra_max_window;
+
   file->pos += bytes_read;
+  file->ra_next = file->pos;
+
+  if (file->ra_window > 0) {
+    off_t start = file->ra_end > file->pos ? file->ra_end : file->pos;
+    off_t end = file->pos + file->ra_window;
+    if (start < end) {
+      inode_read_ahead(file->inode, start, end - start);
+      file->ra_end = end;
+    }
+  } else
+    file->ra_end = 0;
+}
+
+/* Like file_read(), but moves the data into BUFFER with COPY, as
+   inode_read_copy() does.  Returns -1 if COPY fails, leaving the
+   position alone.  Reading a pipe's read end waits for data, as
+   pipe_read() does; reading its write end returns 0.  Reading an
+   event counter waits for events, as eventfd_read() does. */
+off_t file_read_copy(struct file* file, void* buffer, off_t size, inode_copy_func* copy) {
+  uint64_t start;
+  off_t bytes_read;
+
+  if (file->pipe != NULL)
+    return file->pipe_writer ? 0 : pipe_read(file->pipe, buffer, size, copy);
+  if (file->eventfd != NULL)
+    return eventfd_read(file->eventfd, buffer, size, copy);
+
+  start = fsstat_start();
+  lock_acquire(&file->lock);
+  bytes_read = inode_read_copy(file->inode, buffer, size, file->pos, copy);
+  if (bytes_read >= 0)
+    file_advance(file, bytes_read);
+  lock_release(&file->lock);
+  fsstat_done(FS_READ, start);
   return bytes_read;
 }
 
+/* Passes up to SIZE bytes of FILE, starting at the file's current
+   position, to FUNC along with AUX, as inode_read_each() does.
+   Advances FILE's position past the bytes FUNC accepted and
+   returns their number. */
+off_t file_read_each(struct file* file, off_t size, inode_read_func* func, void* aux) {
+  uint64_t start = fsstat_start();
+  off_t bytes_read;
+
+  lock_acquire(&file->lock);
+  bytes_read = inode_read_each(file->inode, size, file->pos, func, aux);
+  file_advance(file, bytes_read);
+  lock_release(&file->lock);
+  fsstat_done(FS_READ, start);
+  return bytes_read;
+}
+
+/* Where file_copy() writes. */
+struct copy_dest {
+  struct inode* inode; /* File being written. */
+  off_t pos;           /* Offset of the next write. */
+};
+
+/* inode_read_func for file_copy(). */
+static bool copy_piece(const void* data, size_t size, void* dest_) {
+  struct copy_dest* dest = dest_;
+  off_t bytes_written = inode_write_at(dest->inode, data, size, dest->pos);
+
+  dest->pos += bytes_written;
+  return bytes_written == (off_t)size;
+}
+
+/* Copies up to SIZE bytes from IN, starting at its current
+   position, to OUT, starting at its current position, straight
+   from one file's buffer cache sectors to the other's.  Advances
+   both positions by the number of bytes copied and returns it,
+   which is less than SIZE if IN ends or OUT cannot grow.  The
+   copy is not atomic with respect to other writes to OUT. */
+off_t file_copy(struct file* out, struct file* in, off_t size) {
+  struct copy_dest dest;
+  off_t bytes_copied;
+
+  if (out->dir)
+    return 0;
+  lock_acquire(&out->lock);
+  dest.pos = out->pos;
+  lock_release(&out->lock);
+  dest.inode = out->inode;
+
+  bytes_copied = file_read_each(in, size, copy_piece, &dest);
+
+  lock_acquire(&out->lock);
+  out->pos += bytes_copied;
+  lock_release(&out->lock);
+  return bytes_copied;
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
    The file's current position is unaffected. */
 off_t file_read_at(struct file* file, void* buffer, off_t size, off_t file_ofs) {
-  return inode_read_at(file->inode, buffer, size, file_ofs);
+  uint64_t start = fsstat_start();
+  off_t bytes_read = inode_read_at(file->inode, buffer, size, file_ofs);
+
+  fsstat_done(FS_READ, start);
+  return bytes_read;
+}
+
+/* Like file_read_at(), but moves the data into BUFFER with COPY,
+   as inode_read_copy() does.  Returns -1 if COPY fails. */
+off_t file_read_at_copy(struct file* file, void* buffer, off_t size, off_t file_ofs,
+                        inode_copy_func* copy) {
+  uint64_t start = fsstat_start();
+  off_t bytes_read = inode_read_copy(file->inode, buffer, size, file_ofs, copy);
+
+  fsstat_done(FS_READ, start);
+  return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
-   Advances FILE's position by the number of bytes read. */
+   which may be less than SIZE if the file cannot grow enough.
+   Advances FILE's position by the number of bytes read.
+   Writing a pipe's write end waits for room, as pipe_write()
+   does; writing its read end, or a directory, returns 0.
+   Writing an event counter adds to it, as eventfd_write()
+   does. */
 off_t file_write(struct file* file, const void* buffer, off_t size) {
-  off_t bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
+  uint64_t start;
+  off_t bytes_written;
+
+  if (file->pipe != NULL)
+    return file->pipe_writer ? pipe_write(file->pipe, buffer, size) : 0;
+  if (file->eventfd != NULL)
+    return eventfd_write(file->eventfd, buffer, size);
+  if (file->dir)
+    return 0;
+
+  start = fsstat_start();
+  lock_acquire(&file->lock);
+  bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
   file->pos += bytes_written;
+  lock_release(&file->lock);
+  fsstat_done(FS_WRITE, start);
   return bytes_written;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
-   The file's current position is unaffected. */
+   which may be less than SIZE if the file cannot grow enough.
+   The file's current position is unaffected.  Writing a
+   directory returns 0. */
 off_t file_write_at(struct file* file, const void* buffer, off_t size, off_t file_ofs) {
-  return inode_write_at(file->inode, buffer, size, file_ofs);
+  uint64_t start;
+  off_t bytes_written;
+
+  if (file->dir)
+    return 0;
+  start = fsstat_start();
+  bytes_written = inode_write_at(file->inode, buffer, size, file_ofs);
+  fsstat_done(FS_WRITE, start);
+  return bytes_written;
+}
+
+/* Reads up to CNT entries of directory FILE into ENTS, starting
+   at FILE's position, as dir_readdir_batch() does, and moves the
+   position past them.  Returns the number of entries read, 0 at
+   the end of the directory. */
+size_t file_readdir(struct file* file, struct dirent* ents, size_t cnt) {
+  struct dir* dir;
+  size_t n;
+
+  ASSERT(file->dir);
+  dir = dir_open(inode_reopen(file->inode));
+  if (dir == NULL)
+    return 0;
+  lock_acquire(&file->lock);
+  dir_seek(dir, file->pos);
+  n = dir_readdir_batch(dir, ents, cnt);
+  file->pos = dir_tell(dir);
+  lock_release(&file->lock);
+  dir_close(dir);
+  return n;
 }
 
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void file_deny_write(struct file* file) {
   ASSERT(file != NULL);
+  lock_acquire(&file->lock);
   if (!file->deny_write) {
     file->deny_write = true;
     inode_deny_write(file->inode);
   }
+  lock_release(&file->lock);
 }
 
 /* Re-enables write operations on FILE's underlying inode.
@@ -114,10 +426,12 @@ void file_deny_write(struct file* file) {
    same inode open.) */
 void file_allow_write(struct file* file) {
   ASSERT(file != NULL);
+  lock_acquire(&file->lock);
   if (file->deny_write) {
     file->deny_write = false;
     inode_allow_write(file->inode);
   }
+  lock_release(&file->lock);
 }
 
 /* Returns the size of FILE in bytes. */
@@ -131,12 +445,19 @@ off_t file_length(struct file* file) {
 void file_seek(struct file* file, off_t new_pos) {
   ASSERT(file != NULL);
   ASSERT(new_pos >= 0);
+  lock_acquire(&file->lock);
   file->pos = new_pos;
+  lock_release(&file->lock);
 }
 
 /* Returns the current position in FILE as a byte offset from the
    start of the file. */
 off_t file_tell(struct file* file) {
+  off_t pos;
+
   ASSERT(file != NULL);
-  return file->pos;
+  lock_acquire(&file->lock);
+  pos = file->pos;
+  lock_release(&file->lock);
+  return pos;
 }
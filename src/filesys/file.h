@@ -1,22 +1,40 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include "filesys/inode.h"
 #include "filesys/off_t.h"
 
-struct inode;
+struct dirent;
+struct eventfd;
+struct pipe;
+
+void file_init(void);
 
 /* Opening and closing files. */
 struct file* file_open(struct inode*);
+struct file* file_open_pipe(struct pipe*, bool writer);
+struct file* file_open_eventfd(struct eventfd*);
+struct file* file_open_dir(struct inode*);
 struct file* file_reopen(struct file*);
 void file_ref(struct file*);
 void file_close(struct file*);
 struct inode* file_get_inode(struct file*);
+struct eventfd* file_get_eventfd(struct file*);
+bool file_is_pipe(const struct file*);
+bool file_is_stream(const struct file*);
+bool file_is_dir(const struct file*);
+int file_poll(struct file*, int events);
 
 /* Reading and writing. */
 off_t file_read(struct file*, void*, off_t);
 off_t file_read_at(struct file*, void*, off_t size, off_t start);
+off_t file_read_copy(struct file*, void*, off_t, inode_copy_func*);
+off_t file_read_at_copy(struct file*, void*, off_t size, off_t start, inode_copy_func*);
+off_t file_read_each(struct file*, off_t size, inode_read_func*, void* aux);
+off_t file_copy(struct file* out, struct file* in, off_t size);
 off_t file_write(struct file*, const void*, off_t);
 off_t file_write_at(struct file*, const void*, off_t size, off_t start);
+size_t file_readdir(struct file*, struct dirent*, size_t cnt);
 
 /* Preventing writes. */
 void file_deny_write(struct file*);
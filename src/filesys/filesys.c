@@ -1,50 +1,158 @@
 #include "filesys/filesys.h"
 #include <debug.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
+#include "filesys/fsstat.h"
+#include "filesys/initramfs.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/orphan.h"
+#include "filesys/procfs.h"
 #include "filesys/directory.h"
+#include "threads/vaddr.h"
+
+/* Identifies the superblock. */
+#define SUPER_MAGIC 0x52505553
+
+/* On-disk superblock, which records the choices made when the
+   file system was formatted.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct super_block {
+  unsigned magic;         /* SUPER_MAGIC. */
+  uint32_t block_sectors; /* Sectors in an allocation block. */
+  uint32_t flags;         /* SUPER_LOG. */
+  uint32_t unused[125];   /* Not used. */
+};
+
+/* Set in the superblock's FLAGS if appended file data is written
+   to log segments, see free-map.c. */
+#define SUPER_LOG 0x1
 
 /* Partition that contains the file system. */
 struct block* fs_device;
 
 static void do_format(void);
 
+/* Returns true if BLOCK_SECTORS is a valid number of sectors for
+   an allocation block: a power of 2 no larger than a page. */
+static bool valid_block_sectors(uint32_t block_sectors) {
+  return block_sectors > 0 && block_sectors <= PGSIZE / BLOCK_SECTOR_SIZE &&
+         (block_sectors & (block_sectors - 1)) == 0;
+}
+
+/* Writes a superblock for a file system with allocation blocks
+   of BLOCK_SIZE bytes, in log mode if LOG is true, if FORMAT is
+   true, or reads the superblock from disk otherwise, and tells
+   the free map what it says. */
+static void super_init(bool format, unsigned block_size, bool log) {
+  static struct super_block super;
+
+  ASSERT(sizeof super == BLOCK_SECTOR_SIZE);
+
+  if (format) {
+    memset(&super, 0, sizeof super);
+    super.magic = SUPER_MAGIC;
+    super.block_sectors = block_size / BLOCK_SECTOR_SIZE;
+    super.flags = log ? SUPER_LOG : 0;
+    if (block_size % BLOCK_SECTOR_SIZE != 0 || !valid_block_sectors(super.block_sectors))
+      PANIC("bad file system block size %u", block_size);
+    journal_begin();
+    journal_write(SUPER_SECTOR, &super);
+    journal_end();
+  } else {
+    cache_read(SUPER_SECTOR, &super);
+    if (super.magic != SUPER_MAGIC || !valid_block_sectors(super.block_sectors))
+      PANIC("file system has no superblock (reformat with -f)");
+  }
+  free_map_set_block_sectors(super.block_sectors);
+  free_map_set_log((super.flags & SUPER_LOG) != 0);
+}
+
 /* Initializes the file system module.
-   If FORMAT is true, reformats the file system. */
-void filesys_init(bool format) {
+   If FORMAT is true, reformats the file system with allocation
+   blocks of BLOCK_SIZE bytes, a power of 2 from BLOCK_SECTOR_SIZE
+   up to PGSIZE, and in log mode if LOG is true. */
+void filesys_init(bool format, unsigned block_size, bool log) {
   fs_device = block_get_role(BLOCK_FILESYS);
   if (fs_device == NULL)
     PANIC("No file system device found, can't initialize file system.");
 
+  cache_init();
+  journal_init(format);
   inode_init();
+  file_init();
+  dcache_init();
   free_map_init();
+  super_init(format, block_size, log);
+  orphan_init(format);
 
   if (format)
     do_format();
 
   free_map_open();
+  if (!format)
+    orphan_recover();
 }
 
 /* Shuts down the file system module, writing any unwritten data
    to disk. */
-void filesys_done(void) { free_map_close(); }
+void filesys_done(void) {
+  inode_reclaim_wait();
+  free_map_close();
+  filesys_sync();
+  fsstat_print();
+}
+
+/* Writes all unwritten data and metadata to disk. */
+void filesys_sync(void) {
+  journal_commit();
+  cache_flush();
+  block_flush(fs_device);
+}
+
+/* Returns BASE, or the root directory if BASE is null, for the
+   functions below.  Pass the result to put_dir() when done. */
+static struct dir* get_dir(struct dir* base) { return base != NULL ? base : dir_open_root(); }
+
+/* Releases DIR, which get_dir(BASE) returned. */
+static void put_dir(struct dir* dir, struct dir* base) {
+  if (dir != base)
+    dir_close(dir);
+}
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
    or if internal memory allocation fails. */
 bool filesys_create(const char* name, off_t initial_size) {
+  return filesys_create_at(NULL, name, initial_size);
+}
+
+/* Like filesys_create(), but creates NAME in directory BASE, or
+   in the root directory if BASE is null. */
+bool filesys_create_at(struct dir* base, const char* name, off_t initial_size) {
+  uint64_t start = fsstat_start();
   block_sector_t inode_sector = 0;
-  struct dir* dir = dir_open_root();
-  bool success = (dir != NULL && free_map_allocate(1, &inode_sector) &&
-                  inode_create(inode_sector, initial_size) && dir_add(dir, name, inode_sector));
+  struct dir* dir;
+  bool success;
+
+  journal_begin();
+  dir = get_dir(base);
+  success = (dir != NULL &&
+             free_map_allocate_inode(inode_get_inumber(dir_get_inode(dir)), false,
+                                     &inode_sector) &&
+             inode_create(inode_sector, initial_size) && dir_add(dir, name, inode_sector));
   if (!success && inode_sector != 0)
     free_map_release(inode_sector, 1);
-  dir_close(dir);
+  put_dir(dir, base);
+  journal_end();
 
+  fsstat_done(FS_CREATE, start);
   return success;
 }
 
@@ -52,27 +160,110 @@ bool filesys_create(const char* name, off_t initial_size) {
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
-struct file* filesys_open(const char* name) {
-  struct dir* dir = dir_open_root();
+   or if an internal memory allocation fails.
+   "/" and "." name the root directory, which is opened as a
+   directory for file_readdir(). */
+struct file* filesys_open(const char* name) { return filesys_open_at(NULL, name); }
+
+/* Like filesys_open(), but looks NAME up in directory BASE, or in
+   the root directory if BASE is null.  "." names BASE itself.
+   Names in the root directory are looked up among the statistics
+   files under /proc first, then in the in-memory archive, if one
+   is loaded. */
+struct file* filesys_open_at(struct dir* base, const char* name) {
+  uint64_t start = fsstat_start();
+  struct dir* dir;
   struct inode* inode = NULL;
+  struct file* file;
+
+  if (!strcmp(name, "/") || (!strcmp(name, ".") && base == NULL)) {
+    file = file_open_dir(inode_open(ROOT_DIR_SECTOR));
+    fsstat_done(FS_OPEN, start);
+    return file;
+  } else if (!strcmp(name, ".")) {
+    file = file_open_dir(inode_reopen(dir_get_inode(base)));
+    fsstat_done(FS_OPEN, start);
+    return file;
+  }
 
+  if (name[0] == '/' || base == NULL || inode_get_inumber(dir_get_inode(base)) == ROOT_DIR_SECTOR) {
+    file = procfs_open(name);
+    if (file == NULL && initramfs_enabled)
+      file = initramfs_open(name);
+    if (file != NULL) {
+      fsstat_done(FS_OPEN, start);
+      return file;
+    }
+  }
+
+  dir = get_dir(base);
   if (dir != NULL)
     dir_lookup(dir, name, &inode);
-  dir_close(dir);
+  put_dir(dir, base);
+  file = file_open(inode);
 
-  return file_open(inode);
+  fsstat_done(FS_OPEN, start);
+  return file;
 }
 
 /* Deletes the file named NAME.
    Returns true if successful, false on failure.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
-bool filesys_remove(const char* name) {
-  struct dir* dir = dir_open_root();
+bool filesys_remove(const char* name) { return filesys_remove_at(NULL, name); }
+
+/* Like filesys_remove(), but removes NAME from directory BASE, or
+   from the root directory if BASE is null. */
+bool filesys_remove_at(struct dir* base, const char* name) {
+  uint64_t start = fsstat_start();
+  struct dir* dir = get_dir(base);
   bool success = dir != NULL && dir_remove(dir, name);
-  dir_close(dir);
+  put_dir(dir, base);
+
+  fsstat_done(FS_REMOVE, start);
+  return success;
+}
+
+/* Creates a file named DST_NAME in directory BASE, or in the root
+   directory if BASE is null, that is a clone of the file named
+   SRC_NAME there: it has the same data, but shares its sectors
+   with the original until either is written (see inode_clone()).
+   Returns true if successful, false on failure.  Fails if no file
+   named SRC_NAME exists, if SRC_NAME is a directory, if a file
+   named DST_NAME already exists, or if memory or the disk is
+   exhausted. */
+bool filesys_clone_at(struct dir* base, const char* src_name, const char* dst_name) {
+  block_sector_t inode_sector = 0;
+  struct inode* src = NULL;
+  struct dir* dir = get_dir(base);
+  bool success;
+
+  success = (dir != NULL && dir_lookup(dir, src_name, &src) &&
+             free_map_allocate_inode(inode_get_inumber(dir_get_inode(dir)), false,
+                                     &inode_sector));
+  if (success && !inode_clone(src, inode_sector)) {
+    free_map_release(inode_sector, 1);
+    success = false;
+  }
+  inode_close(src);
 
+  /* Link the clone in, and take it off the orphan list in the same
+     transaction.  If that fails, free it as a removed file. */
+  if (success) {
+    journal_begin();
+    success = dir_add(dir, dst_name, inode_sector);
+    if (success)
+      orphan_remove(inode_sector);
+    journal_end();
+    if (!success) {
+      struct inode* inode = inode_open(inode_sector);
+      if (inode != NULL) {
+        inode_remove(inode);
+        inode_close(inode);
+      }
+    }
+  }
+  put_dir(dir, base);
   return success;
 }
 
@@ -4,17 +4,27 @@
 #include <stdbool.h>
 #include "filesys/off_t.h"
 
+struct dir;
+
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0 /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1 /* Root directory file inode sector. */
+#define ORPHAN_SECTOR 2   /* Orphan list sector. */
+#define SHARE_MAP_SECTOR 3 /* Share map file inode sector. */
+#define SUPER_SECTOR 4     /* Superblock sector. */
 
 /* Block device that contains the file system. */
 extern struct block* fs_device;
 
-void filesys_init(bool format);
+void filesys_init(bool format, unsigned block_size, bool log);
 void filesys_done(void);
+void filesys_sync(void);
 bool filesys_create(const char* name, off_t initial_size);
 struct file* filesys_open(const char* name);
 bool filesys_remove(const char* name);
+bool filesys_create_at(struct dir*, const char* name, off_t initial_size);
+struct file* filesys_open_at(struct dir*, const char* name);
+bool filesys_remove_at(struct dir*, const char* name);
+bool filesys_clone_at(struct dir*, const char* src_name, const char* dst_name);
 
 #endif /* filesys/filesys.h */
@@ -1,20 +1,340 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdint.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Block groups.  The disk is divided into groups of
+   GROUP_SECTORS sectors, and sectors that are used together are
+   kept in the same group: an inode goes in its directory's group
+   (see free_map_allocate_inode()), its data and extent blocks
+   follow it there, and new directories go to whichever group has
+   the most room, so that they and their files spread out over the
+   disk.  That keeps seeks between an inode, its data and its
+   directory short, and keeps allocations from piling up at the
+   front of the disk.  Each group's free count lets a search skip
+   full groups without reading their bits. */
+#define GROUP_SECTORS 1024
+
+/* Allocation blocks.  The file system may be formatted with
+   blocks of several sectors, up to a page, in which case runs of
+   file data are allocated in whole blocks that start at a
+   multiple of the block size (see take_run()), so that each page
+   of a file is one run of sectors on disk and reaches memory in
+   one transfer.  Single sectors, for inodes, extent blocks and
+   metadata files, go where a block is already partly used, so
+   that they do not break up whole free blocks.  The free map
+   still has one bit per sector, and one sector is still the unit
+   of the inode layer and the buffer cache. */
+
+/* Shared sectors.  inode_clone() lets files share data sectors,
+   and each sector has a count of the extra files that map it, one
+   byte per sector in the share map file, so that freeing a shared
+   sector in one file leaves it to the others.  A count of 0, as
+   nearly every sector has, means the sector has one owner, or
+   none.  Counts only change with the free map lock held, and are
+   written through the journal, in the same transaction as the
+   extents that gained or lost the sector. */
 
 static struct file* free_map_file; /* Free map file. */
 static struct bitmap* free_map;    /* Free map, one bit per sector. */
+static struct lock free_map_lock;  /* Protects the members below and the file. */
+
+/* Sectors that are allocated or reserved.  A reservation sets a
+   sector's bit here but not in free_map, so it is never written
+   to the free map file and is forgotten if the system stops
+   before the reserved sectors are claimed.  Searches look here,
+   so reserved sectors are not handed out twice. */
+static struct bitmap* taken;
+
+/* Extra owners of each sector, and the share map file that
+   holds them. */
+static uint8_t* shares;
+static struct file* share_file;
+
+/* Sectors that are not taken in each block group, so that a
+   search can pass over full groups without looking at them, and
+   in total, so that a hopeless search need not begin. */
+static uint16_t* group_free;
+static size_t group_cnt;
+static size_t free_cnt;
+
+/* Sectors in an allocation block, a power of 2. */
+static size_t block_sectors = 1;
+
+/* Log mode.  A file system formatted with -fslog gives the data
+   that every file appends from one segment of LOG_SEGMENT sectors
+   at a time, in the order it is written, instead of from a window
+   per file (see inode.c), so that appends to many files at once
+   reach the disk as one sequential stream when cache_flush()
+   writes dirty sectors in ascending order.  Each segment is
+   reserved where the last one ended and its sectors are claimed
+   in the free map as they are handed out, so a crash loses none.
+   Files written this way are interleaved on disk, which costs
+   their readers seeks: the mode suits logs that are mostly
+   written and seldom read back. */
+#define LOG_SEGMENT 256
+
+static bool log_mode;    /* Formatted with -fslog? */
+static size_t log_start; /* First sector left in the segment. */
+static size_t log_cnt;   /* Sectors left in the segment. */
+static size_t log_next;  /* Where the next segment is looked for. */
+
+/* Sector after the last run allocated.  Searches start here and
+   wrap around, rather than always rescanning the full beginning
+   of the disk. */
+static size_t next_fit;
+
+/* Sets taken to match the free map, dropping any reservations,
+   and recomputes the free counts from it. */
+static void count_free(void) {
+  size_t sector_cnt = bitmap_size(free_map);
+  size_t r, s;
+
+  bitmap_set_all(taken, false);
+  for (s = 0; (s = bitmap_scan(free_map, s, 1, true)) != BITMAP_ERROR;) {
+    size_t end = bitmap_scan(free_map, s, 1, false);
+    if (end == BITMAP_ERROR)
+      end = sector_cnt;
+    bitmap_set_multiple(taken, s, end - s, true);
+    s = end;
+  }
+
+  free_cnt = 0;
+  for (r = 0; r < group_cnt; r++) {
+    size_t start = r * GROUP_SECTORS;
+    size_t cnt = start + GROUP_SECTORS <= sector_cnt ? GROUP_SECTORS : sector_cnt - start;
+    group_free[r] = bitmap_count(taken, start, cnt, false);
+    free_cnt += group_free[r];
+  }
+}
+
+/* Marks the CNT sectors starting at SECTOR as taken if USED is
+   true, or as not taken otherwise, keeping the free counts
+   current.  The sectors must all be in the opposite state
+   already.  free_map is left to the caller. */
+static void mark(size_t sector, size_t cnt, bool used) {
+  size_t end = sector + cnt;
+  size_t s;
+
+  bitmap_set_multiple(taken, sector, cnt, used);
+  for (s = sector; s < end; s = (s / GROUP_SECTORS + 1) * GROUP_SECTORS) {
+    size_t group_end = (s / GROUP_SECTORS + 1) * GROUP_SECTORS;
+    size_t n = (group_end < end ? group_end : end) - s;
+    if (used)
+      group_free[s / GROUP_SECTORS] -= n;
+    else
+      group_free[s / GROUP_SECTORS] += n;
+  }
+  if (used)
+    free_cnt -= cnt;
+  else
+    free_cnt += cnt;
+}
+
+/* Returns the first sector of the first run of CNT free sectors
+   at or after START that starts at a multiple of ALIGN, or
+   BITMAP_ERROR if there is none. */
+static size_t scan_aligned_from(size_t start, size_t cnt, size_t align) {
+  for (;;) {
+    size_t r = start / GROUP_SECTORS;
+    size_t sector;
+
+    while (r < group_cnt && group_free[r] == 0)
+      r++;
+    if (r == group_cnt)
+      return BITMAP_ERROR;
+    if (r * GROUP_SECTORS > start)
+      start = r * GROUP_SECTORS;
+    start = ROUND_UP(start, align);
+    sector = bitmap_scan(taken, start, cnt, false);
+    if (sector == BITMAP_ERROR || sector % align == 0)
+      return sector;
+    start = ROUND_UP(sector, align);
+  }
+}
+
+/* Returns the first sector of the first run of CNT free sectors
+   at or after START, or BITMAP_ERROR if there is none. */
+static size_t scan_from(size_t start, size_t cnt) { return scan_aligned_from(start, cnt, 1); }
+
+/* Returns the first sector of a run of CNT free sectors that
+   starts at a multiple of ALIGN, looking from next_fit to the end
+   of the disk and then from its start, or BITMAP_ERROR if there
+   is none. */
+static size_t scan_aligned(size_t cnt, size_t align) {
+  size_t sector;
+
+  if (free_cnt < cnt)
+    return BITMAP_ERROR;
+  sector = scan_aligned_from(next_fit, cnt, align);
+  if (sector == BITMAP_ERROR && next_fit != 0)
+    sector = scan_aligned_from(0, cnt, align);
+  return sector;
+}
+
+/* Returns the first sector of a run of CNT free sectors, looking
+   from next_fit to the end of the disk and then from its start,
+   or BITMAP_ERROR if there is none. */
+static size_t scan(size_t cnt) { return scan_aligned(cnt, 1); }
+
+/* Returns a free sector at or after START, in START's block
+   group, whose allocation block is partly taken already, or
+   BITMAP_ERROR if there is none. */
+static size_t scan_partial(size_t start) {
+  size_t end = (start / GROUP_SECTORS + 1) * GROUP_SECTORS;
+  size_t s = start;
+
+  if (end > bitmap_size(taken))
+    end = bitmap_size(taken);
+  while (s < end && (s = bitmap_scan(taken, s, 1, false)) != BITMAP_ERROR && s < end) {
+    size_t block = ROUND_DOWN(s, block_sectors);
+    size_t cnt = block + block_sectors <= end ? block_sectors : end - block;
+
+    if (!bitmap_none(taken, block, cnt))
+      return s;
+    s = block + block_sectors;
+  }
+  return BITMAP_ERROR;
+}
+
+/* Writes the part of the free map that covers the CNT sectors
+   starting at SECTOR to the free map file, if it is open.  Only
+   the free map sectors that changed pass through the buffer
+   cache. */
+static bool write_back(size_t sector, size_t cnt) {
+  return free_map_file == NULL || bitmap_write_range(free_map, free_map_file, sector, cnt);
+}
+
+/* Writes the share counts of the CNT sectors starting at SECTOR
+   to the share map file, if it is open. */
+static bool share_write_back(size_t sector, size_t cnt) {
+  return share_file == NULL ||
+         file_write_at(share_file, shares + sector, cnt, sector) == (off_t)cnt;
+}
+
+/* Finds up to CNT consecutive sectors that are not taken, at
+   least one, as free_map_allocate_run() describes, marks them
+   taken and stores the first into *SECTORP.  A run of at least a
+   block goes in whole, aligned blocks where it can, and a shorter
+   one in a block already partly in use.  Returns the number of
+   sectors, which is 0 if the disk is full.  The caller must hold
+   free_map_lock. */
+static size_t take_run(block_sector_t hint, size_t cnt, size_t* sectorp) {
+  size_t goal = hint < bitmap_size(taken) ? hint : 0;
+  size_t align = block_sectors > 1 && cnt >= block_sectors ? block_sectors : 1;
+  size_t sector = BITMAP_ERROR;
+  size_t end, n;
+
+  if (hint >= bitmap_size(taken) || bitmap_test(taken, hint))
+    hint = 0;
+  if (hint != 0 && hint + cnt <= bitmap_size(taken) && bitmap_none(taken, hint, cnt))
+    sector = hint;
+  else {
+    if (block_sectors > 1 && cnt < block_sectors)
+      sector = scan_partial(goal);
+    if (sector == BITMAP_ERROR && goal != 0)
+      sector = scan_aligned_from(goal, cnt, align);
+    if (sector == BITMAP_ERROR)
+      sector = scan_aligned(cnt, align);
+    if (sector == BITMAP_ERROR && align > 1 && hint == 0)
+      sector = scan_aligned(align, align);
+    if (sector == BITMAP_ERROR)
+      sector = hint != 0 ? hint : scan(1);
+  }
+  if (sector == BITMAP_ERROR)
+    return 0;
+
+  end = sector + cnt < bitmap_size(taken) ? sector + cnt : bitmap_size(taken);
+  n = bitmap_scan(taken, sector, 1, true);
+  n = (n != BITMAP_ERROR && n < end ? n : end) - sector;
+  if (align > 1 && n > align)
+    n = ROUND_DOWN(n, align);
+  mark(sector, n, true);
+  next_fit = sector + n;
+  *sectorp = sector;
+  return n;
+}
 
 /* Initializes the free map. */
 void free_map_init(void) {
   free_map = bitmap_create(block_size(fs_device));
-  if (free_map == NULL)
+  taken = bitmap_create(block_size(fs_device));
+  shares = calloc(1, block_size(fs_device));
+  if (free_map == NULL || taken == NULL || shares == NULL)
     PANIC("bitmap creation failed--file system device is too large");
+  group_cnt = DIV_ROUND_UP(bitmap_size(free_map), GROUP_SECTORS);
+  group_free = malloc(group_cnt * sizeof *group_free);
+  if (group_free == NULL)
+    PANIC("bitmap creation failed--file system device is too large");
+  lock_init_named(&free_map_lock, "free_map");
   bitmap_mark(free_map, FREE_MAP_SECTOR);
   bitmap_mark(free_map, ROOT_DIR_SECTOR);
+  bitmap_mark(free_map, ORPHAN_SECTOR);
+  bitmap_mark(free_map, SHARE_MAP_SECTOR);
+  bitmap_mark(free_map, SUPER_SECTOR);
+  bitmap_set_multiple(free_map, journal_start(), JOURNAL_SECTORS, true);
+  count_free();
+}
+
+/* Sets the number of sectors in an allocation block to CNT, as
+   the superblock records it. */
+void free_map_set_block_sectors(size_t cnt) { block_sectors = cnt; }
+
+/* Returns the number of sectors in an allocation block. */
+size_t free_map_block_sectors(void) { return block_sectors; }
+
+/* Sets whether appended file data comes from log segments, as
+   the superblock records it. */
+void free_map_set_log(bool log) { log_mode = log; }
+
+/* Returns true if appended file data comes from log segments. */
+bool free_map_log_mode(void) { return log_mode; }
+
+/* Allocates up to CNT consecutive sectors, at least one, from the
+   current log segment, reserving a new segment first if it is
+   used up, and stores the first into *SECTORP.  Falls back to
+   allocating just what is wanted, as near the last segment as it
+   can, if no segment can be reserved.  Returns the number of
+   sectors allocated, which is 0 if the disk is full or the free
+   map file could not be written. */
+size_t free_map_log_take(size_t cnt, block_sector_t* sectorp) {
+  size_t sector;
+  size_t n;
+
+  ASSERT(cnt > 0);
+  journal_begin();
+  lock_acquire(&free_map_lock);
+  if (log_cnt == 0 && LOG_SEGMENT <= free_cnt / 8) {
+    log_cnt = take_run(log_next, LOG_SEGMENT, &log_start);
+    log_next = log_start + log_cnt;
+  }
+  if (log_cnt > 0) {
+    sector = log_start;
+    n = cnt < log_cnt ? cnt : log_cnt;
+    log_start += n;
+    log_cnt -= n;
+  } else
+    n = take_run(log_next, cnt, &sector);
+  if (n > 0) {
+    bitmap_set_multiple(free_map, sector, n, true);
+    if (!write_back(sector, n)) {
+      bitmap_set_multiple(free_map, sector, n, false);
+      mark(sector, n, false);
+      n = 0;
+    }
+  }
+  lock_release(&free_map_lock);
+  journal_end();
+  if (n > 0)
+    *sectorp = sector;
+  return n;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -23,21 +343,231 @@ void free_map_init(void) {
    sectors were available or if the free_map file could not be
    written. */
 bool free_map_allocate(size_t cnt, block_sector_t* sectorp) {
-  block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR && free_map_file != NULL && !bitmap_write(free_map, free_map_file)) {
+  size_t sector;
+
+  journal_begin();
+  lock_acquire(&free_map_lock);
+  sector = scan(cnt);
+  if (sector != BITMAP_ERROR) {
+    mark(sector, cnt, true);
+    bitmap_set_multiple(free_map, sector, cnt, true);
+    if (write_back(sector, cnt))
+      next_fit = sector + cnt;
+    else {
+      bitmap_set_multiple(free_map, sector, cnt, false);
+      mark(sector, cnt, false);
+      sector = BITMAP_ERROR;
+    }
+  }
+  lock_release(&free_map_lock);
+  journal_end();
+  if (sector != BITMAP_ERROR)
+    *sectorp = sector;
+  return sector != BITMAP_ERROR;
+}
+
+/* Allocates up to CNT consecutive sectors, at least one, and
+   stores the first into *SECTORP.  Prefers, in order, a run of
+   all CNT sectors that starts at HINT, so that a file can keep
+   growing in place; the first run of all CNT sectors after HINT,
+   which is usually in HINT's block group; a run of all CNT
+   sectors anywhere; a shorter run at HINT; and a shorter run at
+   the first free sector.  HINT of 0 means no preference.
+   Returns the number of sectors allocated, which is 0 if the
+   disk is full or the free_map file could not be written. */
+size_t free_map_allocate_run(block_sector_t hint, size_t cnt, block_sector_t* sectorp) {
+  size_t sector;
+  size_t n;
+
+  ASSERT(cnt > 0);
+  journal_begin();
+  lock_acquire(&free_map_lock);
+  n = take_run(hint, cnt, &sector);
+  if (n > 0) {
+    bitmap_set_multiple(free_map, sector, n, true);
+    if (!write_back(sector, n)) {
+      bitmap_set_multiple(free_map, sector, n, false);
+      mark(sector, n, false);
+      n = 0;
+    }
+  }
+  lock_release(&free_map_lock);
+  journal_end();
+  if (n > 0)
+    *sectorp = sector;
+  return n;
+}
+
+/* Reserves up to CNT consecutive sectors, at least one, choosing
+   them as free_map_allocate_run() does, and stores the first into
+   *SECTORP.  Reserved sectors are not handed out again, but are
+   not allocated on disk until free_map_claim() claims them.
+   Refuses to reserve more than an eighth of the free sectors, so
+   that reservations do not crowd out allocations on a disk that
+   is filling up.
+   Returns the number of sectors reserved, which is 0 if there are
+   not enough free sectors. */
+size_t free_map_reserve(block_sector_t hint, size_t cnt, block_sector_t* sectorp) {
+  size_t sector;
+  size_t n = 0;
+
+  ASSERT(cnt > 0);
+  lock_acquire(&free_map_lock);
+  if (cnt <= free_cnt / 8)
+    n = take_run(hint, cnt, &sector);
+  lock_release(&free_map_lock);
+  if (n > 0)
+    *sectorp = sector;
+  return n;
+}
+
+/* Allocates the CNT reserved sectors starting at SECTOR.  Returns
+   false, leaving them reserved, if the free map file could not be
+   written. */
+bool free_map_claim(block_sector_t sector, size_t cnt) {
+  bool success;
+
+  journal_begin();
+  lock_acquire(&free_map_lock);
+  ASSERT(bitmap_all(taken, sector, cnt) && bitmap_none(free_map, sector, cnt));
+  bitmap_set_multiple(free_map, sector, cnt, true);
+  success = write_back(sector, cnt);
+  if (!success)
     bitmap_set_multiple(free_map, sector, cnt, false);
-    sector = BITMAP_ERROR;
+  lock_release(&free_map_lock);
+  journal_end();
+  return success;
+}
+
+/* Gives up the reservation of the CNT sectors starting at
+   SECTOR, which were never claimed. */
+void free_map_unreserve(block_sector_t sector, size_t cnt) {
+  lock_acquire(&free_map_lock);
+  ASSERT(bitmap_all(taken, sector, cnt) && bitmap_none(free_map, sector, cnt));
+  mark(sector, cnt, false);
+  lock_release(&free_map_lock);
+}
+
+/* Returns the block group with the most free sectors, the first
+   of them if several tie.  The caller must hold free_map_lock. */
+static size_t roomiest_group(void) {
+  size_t best = 0;
+  size_t g;
+
+  for (g = 1; g < group_cnt; g++)
+    if (group_free[g] > group_free[best])
+      best = g;
+  return best;
+}
+
+/* Allocates a sector for a new inode in directory PARENT, a
+   directory itself if DIR is true, and stores it into *SECTORP.
+   A file's inode goes in PARENT's block group, unless that group
+   has less than half the average group's free sectors, and a
+   directory's in the group with the most free sectors, so that
+   directories spread out and their files stay near them.
+   Returns true if successful, false if the disk is full or the
+   free_map file could not be written. */
+bool free_map_allocate_inode(block_sector_t parent, bool dir, block_sector_t* sectorp) {
+  size_t group, sector;
+
+  journal_begin();
+  lock_acquire(&free_map_lock);
+  group = parent / GROUP_SECTORS;
+  if (dir || group >= group_cnt || group_free[group] * 2 * group_cnt < free_cnt)
+    group = roomiest_group();
+  sector = BITMAP_ERROR;
+  if (free_cnt > 0 && block_sectors > 1)
+    sector = scan_partial(group * GROUP_SECTORS);
+  if (free_cnt > 0 && sector == BITMAP_ERROR)
+    sector = scan_from(group * GROUP_SECTORS, 1);
+  if (sector == BITMAP_ERROR)
+    sector = scan(1);
+  if (sector != BITMAP_ERROR) {
+    mark(sector, 1, true);
+    bitmap_mark(free_map, sector);
+    if (!write_back(sector, 1)) {
+      bitmap_reset(free_map, sector);
+      mark(sector, 1, false);
+      sector = BITMAP_ERROR;
+    }
   }
+  lock_release(&free_map_lock);
+  journal_end();
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors starting at SECTOR available for use, except
+   that a sector shared with other files only loses one of its
+   owners. */
 void free_map_release(block_sector_t sector, size_t cnt) {
+  size_t end = sector + cnt;
+  size_t s, e, i;
+
+  journal_begin();
+  lock_acquire(&free_map_lock);
+  ASSERT(bitmap_all(free_map, sector, cnt));
+  for (s = sector; s < end; s = e) {
+    bool shared = shares[s] > 0;
+
+    for (e = s + 1; e < end && (shares[e] > 0) == shared; e++)
+      continue;
+    if (shared) {
+      for (i = s; i < e; i++)
+        shares[i]--;
+      share_write_back(s, e - s);
+    } else {
+      bitmap_set_multiple(free_map, s, e - s, false);
+      mark(s, e - s, false);
+      write_back(s, e - s);
+    }
+  }
+  lock_release(&free_map_lock);
+  journal_end();
+}
+
+/* Adds an owner to each of the CNT allocated sectors starting at
+   SECTOR, for a file that is to share them.  Returns false,
+   changing nothing, if one of them already has as many owners as
+   a count can hold or the share map file could not be written. */
+bool free_map_share(block_sector_t sector, size_t cnt) {
+  bool success = true;
+  size_t i;
+
+  journal_begin();
+  lock_acquire(&free_map_lock);
   ASSERT(bitmap_all(free_map, sector, cnt));
-  bitmap_set_multiple(free_map, sector, cnt, false);
-  bitmap_write(free_map, free_map_file);
+  for (i = 0; i < cnt && success; i++)
+    success = shares[sector + i] < UINT8_MAX;
+  if (success) {
+    for (i = 0; i < cnt; i++)
+      shares[sector + i]++;
+    success = share_write_back(sector, cnt);
+    if (!success)
+      for (i = 0; i < cnt; i++)
+        shares[sector + i]--;
+  }
+  lock_release(&free_map_lock);
+  journal_end();
+  return success;
+}
+
+/* Returns how many of the CNT sectors starting at SECTOR, at
+   least one, are shared by more than one file if the first is,
+   or are not shared if the first is not, and sets *SHARED to
+   which. */
+size_t free_map_share_run(block_sector_t sector, size_t cnt, bool* shared) {
+  size_t n;
+
+  ASSERT(cnt > 0);
+  lock_acquire(&free_map_lock);
+  *shared = shares[sector] > 0;
+  for (n = 1; n < cnt && (shares[sector + n] > 0) == *shared; n++)
+    continue;
+  lock_release(&free_map_lock);
+  return n;
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -45,24 +575,59 @@ void free_map_open(void) {
   free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC("can't open free map");
+  inode_set_metadata(file_get_inode(free_map_file));
   if (!bitmap_read(free_map, free_map_file))
     PANIC("can't read free map");
+  count_free();
+
+  share_file = file_open(inode_open(SHARE_MAP_SECTOR));
+  if (share_file == NULL)
+    PANIC("can't open share map");
+  inode_set_metadata(file_get_inode(share_file));
+  if (file_read_at(share_file, shares, block_size(fs_device), 0) != (off_t)block_size(fs_device))
+    PANIC("can't read share map");
 }
 
-/* Writes the free map to disk and closes the free map file. */
-void free_map_close(void) { file_close(free_map_file); }
+/* Writes the free map to disk and closes the free map and share
+   map files. */
+void free_map_close(void) {
+  file_close(share_file);
+  share_file = NULL;
+  file_close(free_map_file);
+}
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
 void free_map_create(void) {
-  /* Create inode. */
+  struct inode* inode;
+
+  /* Create inode.  Its sectors must all be allocated before
+     free_map_file is set, or writing the free map could need to
+     allocate sectors, which writes the free map. */
   if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map)))
     PANIC("free map creation failed");
+  inode = inode_open(FREE_MAP_SECTOR);
+  if (inode == NULL)
+    PANIC("free map creation failed");
+  inode_set_metadata(inode);
+  if (!inode_reserve(inode, 0, bitmap_file_size(free_map)))
+    PANIC("free map creation failed");
 
   /* Write bitmap to file. */
-  free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
+  free_map_file = file_open(inode);
   if (free_map_file == NULL)
     PANIC("can't open free map");
   if (!bitmap_write(free_map, free_map_file))
     PANIC("can't write free map");
+
+  /* Likewise the share map, in which every count starts at 0. */
+  if (!inode_create(SHARE_MAP_SECTOR, block_size(fs_device)))
+    PANIC("share map creation failed");
+  inode = inode_open(SHARE_MAP_SECTOR);
+  if (inode == NULL)
+    PANIC("share map creation failed");
+  inode_set_metadata(inode);
+  if (!inode_reserve(inode, 0, block_size(fs_device)))
+    PANIC("share map creation failed");
+  inode_close(inode);
 }
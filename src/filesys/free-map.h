@@ -10,8 +10,21 @@ void free_map_read(void);
 void free_map_create(void);
 void free_map_open(void);
 void free_map_close(void);
+void free_map_set_block_sectors(size_t);
+size_t free_map_block_sectors(void);
+void free_map_set_log(bool);
+bool free_map_log_mode(void);
+size_t free_map_log_take(size_t cnt, block_sector_t* sectorp);
 
 bool free_map_allocate(size_t, block_sector_t*);
+size_t free_map_allocate_run(block_sector_t hint, size_t cnt, block_sector_t* sectorp);
+bool free_map_allocate_inode(block_sector_t parent, bool dir, block_sector_t* sectorp);
 void free_map_release(block_sector_t, size_t);
+bool free_map_share(block_sector_t, size_t);
+size_t free_map_share_run(block_sector_t, size_t cnt, bool* shared);
+
+size_t free_map_reserve(block_sector_t hint, size_t cnt, block_sector_t* sectorp);
+bool free_map_claim(block_sector_t, size_t);
+void free_map_unreserve(block_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
@@ -0,0 +1,84 @@
+#include "filesys/fsstat.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "threads/interrupt.h"
+#include "threads/tsc.h"
+
+/* File system statistics.
+
+   Each timed operation brackets itself with fsstat_start() and
+   fsstat_done(), which charge its TSC cycles to the operation's
+   counters and latency histogram.  The buffer cache keeps its own
+   counters, which fsstat_get() collects.  An operation's counters
+   are updated with interrupts off, which is cheaper than a lock
+   for a few additions. */
+
+static struct fs_op_stats ops[FS_OP_CNT];
+
+/* Names of the operations, for fsstat_print(). */
+static const char* op_names[FS_OP_CNT] = {"open",  "lookup", "read",
+                                          "write", "create", "remove"};
+
+/* Returns the time at which an operation starts, to be passed to
+   fsstat_done() when it is done. */
+uint64_t fsstat_start(void) { return rdtsc(); }
+
+/* Charges an operation OP that began at START, as returned by
+   fsstat_start(), and has just finished. */
+void fsstat_done(enum fs_op op, uint64_t start) {
+  uint64_t cycles = rdtsc() - start;
+  int bucket = 63 - __builtin_clzll(cycles | 1);
+  enum intr_level old_level;
+
+  if (bucket >= FS_LATENCY_BUCKETS)
+    bucket = FS_LATENCY_BUCKETS - 1;
+
+  old_level = intr_disable();
+  ops[op].cnt++;
+  ops[op].cycles += cycles;
+  ops[op].latency_hist[bucket]++;
+  intr_set_level(old_level);
+}
+
+/* Stores the file system's statistics into STATS. */
+void fsstat_get(struct fs_stats* stats) {
+  enum intr_level old_level = intr_disable();
+  memcpy(stats->ops, ops, sizeof ops);
+  intr_set_level(old_level);
+
+  cache_get_stats(stats);
+}
+
+/* Prints file system statistics. */
+void fsstat_print(void) {
+  static struct fs_stats stats;
+  int op;
+
+  fsstat_get(&stats);
+  for (op = 0; op < FS_OP_CNT; op++) {
+    const struct fs_op_stats* s = &stats.ops[op];
+    int last;
+
+    if (s->cnt == 0)
+      continue;
+    printf("Filesys %s: %" PRIu64 " calls, %" PRIu64 " cycles average", op_names[op], s->cnt,
+           s->cycles / s->cnt);
+
+    /* Latency histogram, omitting empty buckets at the end. */
+    for (last = FS_LATENCY_BUCKETS - 1; s->latency_hist[last] == 0; last--)
+      continue;
+    printf(", latency (log2 cycles:count):");
+    for (int i = 0; i <= last; i++)
+      if (s->latency_hist[i] != 0)
+        printf(" %d:%" PRIu32, i, s->latency_hist[i]);
+    printf("\n");
+  }
+  printf("Read-ahead: %" PRIu64 " sectors read, %" PRIu64 " used, %" PRIu64 " unused, %" PRIu64
+         " requests dropped\n",
+         stats.ra_reads, stats.ra_used, stats.ra_unused, stats.ra_dropped);
+  printf("Write-back: %" PRIu64 " transfers of %" PRIu64 " sectors, %" PRIu64
+         " evictions of dirty sectors\n",
+         stats.flush_runs, stats.flush_sectors, stats.evict_writes);
+}
@@ -0,0 +1,12 @@
+#ifndef FILESYS_FSSTAT_H
+#define FILESYS_FSSTAT_H
+
+#include <stats.h>
+#include <stdint.h>
+
+uint64_t fsstat_start(void);
+void fsstat_done(enum fs_op, uint64_t start);
+void fsstat_get(struct fs_stats*);
+void fsstat_print(void);
+
+#endif /* filesys/fsstat.h */
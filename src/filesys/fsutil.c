@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,8 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/initramfs.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -60,25 +63,42 @@ void fsutil_rm(char** argv) {
     PANIC("%s: delete failed\n", file_name);
 }
 
+/* Pages in the buffer that fsutil_extract() and fsutil_append()
+   move file data through. */
+#define TRANSFER_PAGES 4
+
+/* Bytes moved to or from the scratch device at a time. */
+#define TRANSFER_SIZE (TRANSFER_PAGES * PGSIZE)
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.  Each file is allocated in
+   full before it is written, so that it lands in as few runs of
+   sectors as possible, and its data moves in transfers of up to
+   TRANSFER_SIZE bytes.  With -initramfs, the archive is kept in
+   memory instead, as initramfs_load() describes, and left on the
+   scratch device. */
 void fsutil_extract(char** argv UNUSED) {
   static block_sector_t sector = 0;
 
   struct block* src;
   void *header, *data;
 
-  /* Allocate buffers. */
-  header = malloc(BLOCK_SECTOR_SIZE);
-  data = malloc(BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
-    PANIC("couldn't allocate buffers");
-
   /* Open source block device. */
   src = block_get_role(BLOCK_SCRATCH);
   if (src == NULL)
     PANIC("couldn't open scratch device");
 
+  if (initramfs_enabled) {
+    initramfs_load(src);
+    return;
+  }
+
+  /* Allocate buffers. */
+  header = malloc(BLOCK_SECTOR_SIZE);
+  data = palloc_get_multiple(0, TRANSFER_PAGES);
+  if (header == NULL || data == NULL)
+    PANIC("couldn't allocate buffers");
+
   printf("Extracting ustar archive from scratch device "
          "into file system...\n");
 
@@ -105,16 +125,21 @@ void fsutil_extract(char** argv UNUSED) {
       printf("Putting '%s' into the file system...\n", file_name);
 
       /* Create destination file. */
-      if (!filesys_create(file_name, size))
+      if (!filesys_create(file_name, 0))
         PANIC("%s: create failed", file_name);
       dst = filesys_open(file_name);
       if (dst == NULL)
         PANIC("%s: open failed", file_name);
+      if (size > 0 && !inode_fallocate(file_get_inode(dst), 0, size))
+        PANIC("%s: out of space for %d bytes", file_name, size);
 
       /* Do copy. */
       while (size > 0) {
-        int chunk_size = (size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size);
-        block_read(src, sector++, data);
+        int chunk_size = size > TRANSFER_SIZE ? TRANSFER_SIZE : size;
+        size_t sector_cnt = DIV_ROUND_UP(chunk_size, BLOCK_SECTOR_SIZE);
+
+        block_read_multiple(src, sector, sector_cnt, data);
+        sector += sector_cnt;
         if (file_write(dst, data, chunk_size) != chunk_size)
           PANIC("%s: write failed with %d bytes unwritten", file_name, size);
         size -= chunk_size;
@@ -134,7 +159,7 @@ void fsutil_extract(char** argv UNUSED) {
   block_write(src, 0, header);
   block_write(src, 1, header);
 
-  free(data);
+  palloc_free_multiple(data, TRANSFER_PAGES);
   free(header);
 }
 
@@ -145,7 +170,8 @@ void fsutil_extract(char** argv UNUSED) {
    beginning of the scratch device.  Later calls advance across
    the device.  This position is independent of that used for
    fsutil_extract(), so `extract' should precede all
-   `append's. */
+   `append's.  Data moves in transfers of up to TRANSFER_SIZE
+   bytes. */
 void fsutil_append(char** argv) {
   static block_sector_t sector = 0;
 
@@ -158,7 +184,7 @@ void fsutil_append(char** argv) {
   printf("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc(BLOCK_SECTOR_SIZE);
+  buffer = palloc_get_multiple(0, TRANSFER_PAGES);
   if (buffer == NULL)
     PANIC("couldn't allocate buffer");
 
@@ -180,13 +206,16 @@ void fsutil_append(char** argv) {
 
   /* Do copy. */
   while (size > 0) {
-    int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-    if (sector >= block_size(dst))
+    int chunk_size = size > TRANSFER_SIZE ? TRANSFER_SIZE : size;
+    size_t sector_cnt = DIV_ROUND_UP(chunk_size, BLOCK_SECTOR_SIZE);
+
+    if (sector + sector_cnt > block_size(dst))
       PANIC("%s: out of space on scratch device", file_name);
     if (file_read(src, buffer, chunk_size) != chunk_size)
       PANIC("%s: read failed with %" PROTd " bytes unread", file_name, size);
-    memset(buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-    block_write(dst, sector++, buffer);
+    memset(buffer + chunk_size, 0, sector_cnt * BLOCK_SECTOR_SIZE - chunk_size);
+    block_write_multiple(dst, sector, sector_cnt, buffer);
+    sector += sector_cnt;
     size -= chunk_size;
   }
 
@@ -199,5 +228,5 @@ void fsutil_append(char** argv) {
 
   /* Finish up. */
   file_close(src);
-  free(buffer);
+  palloc_free_multiple(buffer, TRANSFER_PAGES);
 }
@@ -0,0 +1,119 @@
+#include "filesys/initramfs.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include <ustar.h>
+#include "devices/block.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* In-memory archive.
+
+   With -initramfs, the `extract' action reads the ustar archive
+   on the scratch device into memory instead of copying each file
+   into the file system, where every exec would read it back
+   through the buffer cache.  Each file becomes a read-only
+   in-memory inode (see inode_open_mem()) whose data starts on a
+   page boundary, so that a page of an executable is a page of
+   the archive, copied once into the page cache and shared from
+   there.  filesys_open() looks names up in the archive before
+   the root directory, so archived files hide files of the same
+   name on disk, and they cannot be written or removed.
+
+   The archive is loaded before any process runs and never
+   changes afterward, so lookups take no lock. */
+
+/* A file in the archive. */
+struct initramfs_file {
+  struct list_elem elem; /* Element in `files'. */
+  char name[100];        /* File name, without leading slashes. */
+  struct inode* inode;   /* In-memory inode holding the data. */
+};
+
+bool initramfs_enabled;
+
+/* Files in the archive. */
+static struct list files = LIST_INITIALIZER(files);
+
+/* Returns NAME past any leading slashes. */
+static const char* strip_slashes(const char* name) {
+  while (*name == '/')
+    name++;
+  return name;
+}
+
+/* Reads the ustar archive on block device SRC into memory, for
+   initramfs_open() to find its files.  Panics if the archive is
+   malformed or memory runs out. */
+void initramfs_load(struct block* src) {
+  block_sector_t sector = 0;
+  void* header;
+
+  header = malloc(BLOCK_SECTOR_SIZE);
+  if (header == NULL)
+    PANIC("couldn't allocate buffer");
+
+  printf("Loading ustar archive from scratch device into memory...\n");
+
+  for (;;) {
+    const char* file_name;
+    const char* error;
+    enum ustar_type type;
+    int size;
+
+    /* Read and parse ustar header. */
+    block_read(src, sector++, header);
+    error = ustar_parse_header(header, &file_name, &type, &size);
+    if (error != NULL)
+      PANIC("bad ustar header in sector %" PRDSNu " (%s)", sector - 1, error);
+
+    if (type == USTAR_EOF)
+      break;
+    else if (type == USTAR_DIRECTORY)
+      printf("ignoring directory %s\n", file_name);
+    else if (type == USTAR_REGULAR) {
+      size_t page_cnt = size > 0 ? DIV_ROUND_UP(size, PGSIZE) : 1;
+      size_t sector_cnt = DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE);
+      struct initramfs_file* f;
+      void* data;
+
+      printf("Keeping '%s' in memory...\n", file_name);
+
+      f = malloc(sizeof *f);
+      data = palloc_get_multiple(PAL_ZERO, page_cnt);
+      if (f == NULL || data == NULL)
+        PANIC("%s: out of memory for %d bytes", file_name, size);
+      if (sector_cnt > 0)
+        block_read_multiple(src, sector, sector_cnt, data);
+      sector += sector_cnt;
+
+      strlcpy(f->name, strip_slashes(file_name), sizeof f->name);
+      f->inode = inode_open_mem(data, size);
+      if (f->inode == NULL)
+        PANIC("%s: out of memory", file_name);
+      list_push_back(&files, &f->elem);
+    }
+  }
+
+  free(header);
+}
+
+/* Opens and returns the archived file named NAME, relative to
+   the root directory, or returns a null pointer if the archive
+   has no such file. */
+struct file* initramfs_open(const char* name) {
+  struct list_elem* e;
+
+  name = strip_slashes(name);
+  for (e = list_begin(&files); e != list_end(&files); e = list_next(e)) {
+    struct initramfs_file* f = list_entry(e, struct initramfs_file, elem);
+    if (!strcmp(f->name, name))
+      return file_open(inode_reopen(f->inode));
+  }
+  return NULL;
+}
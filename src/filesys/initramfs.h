@@ -0,0 +1,15 @@
+#ifndef FILESYS_INITRAMFS_H
+#define FILESYS_INITRAMFS_H
+
+#include <stdbool.h>
+
+struct block;
+
+/* -initramfs: Keep extracted files in memory instead of copying
+   them into the file system? */
+extern bool initramfs_enabled;
+
+void initramfs_load(struct block*);
+struct file* initramfs_open(const char* name);
+
+#endif /* filesys/initramfs.h */
@@ -1,128 +1,993 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/orphan.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of consecutive sectors in a file. */
+struct extent {
+  block_sector_t start; /* First sector, or 0 for a hole. */
+  uint32_t cnt;         /* Number of sectors, plus EXTENT_UNWRITTEN. */
+};
+
+/* Set in an extent's CNT on disk if its sectors are allocated but
+   not yet written, see inode_fallocate(). */
+#define EXTENT_UNWRITTEN 0x80000000u
+
+/* Number of extents in an inode and in an extent block. */
+#define DIRECT_EXTENTS 61
+#define BLOCK_EXTENTS 63
+
+/* Set in an inode's FLAGS on disk if its data is in the inode, in
+   place of its extents, which holds up to INLINE_MAX bytes. */
+#define INODE_INLINE 0x1
+#define INLINE_MAX (DIRECT_EXTENTS * (off_t)sizeof(struct extent))
+
+/* Set in an inode's FLAGS on disk if some of its data sectors may
+   be shared with another file, see inode_clone().  Until it is
+   set, writes need not ask the free map which sectors are. */
+#define INODE_SHARED 0x2
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   A file's data is a list of extents, in file order, that
+   together cover every sector up to its length.  The first
+   DIRECT_EXTENTS are in the inode and the rest in a chain of
+   extent blocks that starts at EXTENT_BLOCK.  An extent that
+   starts at sector 0, which is never a data sector (see
+   FREE_MAP_SECTOR), is a hole: its sectors take no disk space and
+   read as zeros.  Seeking past the end of a file and writing
+   leaves one.  An unwritten extent also reads as zeros, but its
+   sectors are allocated, so writing there needs no allocation
+   and keeps the file where inode_fallocate() placed it.
+
+   A file that has never been longer than INLINE_MAX bytes has no
+   extents at all.  Its data is kept in the inode, where EXTENTS
+   would be, so that it takes no sector of its own and reading it
+   costs no disk access beyond the inode.  It moves to a sector of
+   its own, for good, once the file grows past INLINE_MAX or needs
+   sectors reserved.
+
+   Files made by inode_clone() share written extents with the file
+   they were cloned from, and with each other, until one of them
+   writes there and gets sectors of its own (see inode_unshare()).
+   The free map counts the owners of each shared sector. */
 struct inode_disk {
-  block_sector_t start; /* First data sector. */
-  off_t length;         /* File size in bytes. */
-  unsigned magic;       /* Magic number. */
-  uint32_t unused[125]; /* Not used. */
+  off_t length;                          /* File size in bytes. */
+  unsigned magic;                        /* Magic number. */
+  uint32_t flags;                        /* INODE_INLINE, INODE_SHARED. */
+  uint32_t extent_cnt;                   /* Number of extents. */
+  block_sector_t extent_block;           /* First extent block, or 0. */
+  uint32_t unused;                       /* Not used. */
+  struct extent extents[DIRECT_EXTENTS]; /* First extents, or data. */
 };
 
+/* On-disk block of the extents that do not fit in the inode.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct extent_block {
+  block_sector_t next;                  /* Next extent block, or 0. */
+  uint32_t unused;                      /* Not used. */
+  struct extent extents[BLOCK_EXTENTS]; /* Extents. */
+};
+
+/* An extent of an open inode, and where it is in the file. */
+struct inode_extent {
+  size_t ofs;      /* First file sector it covers. */
+  struct extent e; /* The extent, without EXTENT_UNWRITTEN. */
+  bool unwritten;  /* Allocated but reads as zeros? */
+};
+
+/* How inode_allocate() prepares sectors it allocates. */
+enum alloc_mode {
+  ALLOC_ZERO,      /* Fill them with zeros. */
+  ALLOC_OVERWRITE, /* Leave to the caller those it will overwrite. */
+  ALLOC_UNWRITTEN  /* Mark them unwritten. */
+};
+
+/* Reservation windows.  Sectors for a write past the end of a
+   file come from a run of sectors reserved for the file in
+   memory, so that files written at the same time, such as by many
+   processes appending at once, do not take turns at the next free
+   sector and end up interleaved on disk.  Each time a file uses up
+   its window, it reserves one twice as large, from RESV_MIN up to
+   RESV_MAX sectors.  Sectors are claimed from the window, and only
+   then allocated on disk, as they are written, so a window that a
+   file does not use up never reaches the free map file; what is
+   left of it is given back when the file is closed for the last
+   time, or earlier if the disk is full. */
+#define RESV_MIN 8
+#define RESV_MAX 128
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t bytes_to_sectors(off_t size) { return DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE); }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   ELEM and OPEN_CNT are protected by open_inodes_lock, REMOVED,
+   DENY_WRITE_CNT and GENERATION by LOCK, the extents and the rest
+   of DATA by EXTENT_LOCK, and DATA.LENGTH and META_DIRTY by
+   LENGTH_LOCK, which is also held while DATA is written out so
+   that the copy is consistent.  DATA.LENGTH only grows, after the
+   data beyond the old end is written, so it is read without a
+   lock, and extending a file does not hold up readers the way
+   EXTENT_LOCK would.  Once an extent maps a file sector to a disk
+   sector, it always does, unless the sector is shared and a write
+   gives the file a copy, so a reader only holds EXTENT_LOCK while
+   it looks up an extent and not while data moves to or from the
+   buffer cache.  (A reader that looked up a shared sector just
+   before a write copied it may still read the shared sector,
+   which the other files keep.)  A writer holds the sectors it writes in
+   WRITING, so that writes to overlapping ranges happen one
+   at a time while those to disjoint ranges go ahead together.
+   Readers take no range and only wait for writers on the cache
+   entries of the sectors they share.  DIR_LOCK is for
+   directory.c, which uses it to serialize changes to the entries
+   of a directory.
+
+   Locks are taken in the order WRITING, the journal (see
+   journal_begin()), EXTENT_LOCK, LENGTH_LOCK.
+
+   The members that inode_open() compares and that every read
+   uses to find its sectors come first, so that they share a cache
+   line or two.  DATA, a whole sector that most accesses only read
+   the first few bytes of, comes last.
+
+   An inode opened with inode_open_mem() is not on disk at all.
+   Its data is MEM, DATA.LENGTH bytes of memory that never change,
+   and it has no extents, so reads copy straight from MEM and
+   writes fail.  If MEM_PAGES is nonzero, MEM is that many pages
+   that the inode frees when it is closed for the last time. */
 struct inode {
-  struct list_elem elem;  /* Element in inode list. */
-  block_sector_t sector;  /* Sector number of disk location. */
-  int open_cnt;           /* Number of openers. */
-  bool removed;           /* True if deleted, false otherwise. */
-  int deny_write_cnt;     /* 0: writes ok, >0: deny writes. */
-  struct inode_disk data; /* Inode content. */
+  struct hash_elem elem;        /* Element in open_inodes. */
+  block_sector_t sector;        /* Sector number of disk location. */
+  int open_cnt;                 /* Number of openers. */
+  bool metadata;                /* Data is journaled, see inode_set_metadata(). */
+  const uint8_t* mem;           /* Data of an in-memory inode, or null. */
+  size_t mem_pages;             /* Pages of MEM to free with the inode. */
+  struct rw_lock extent_lock;   /* Protects the members below. */
+  struct inode_extent* extents; /* Extents, in file order. */
+  size_t extent_cnt;            /* Number of extents. */
+  size_t extent_cap;            /* Number of extents EXTENTS has room for. */
+  block_sector_t* blocks;       /* Sectors of the extent blocks, in order. */
+  size_t block_cnt;             /* Number of extent blocks. */
+  block_sector_t resv_start;    /* First sector reserved to grow into. */
+  size_t resv_cnt;              /* Number of sectors reserved there. */
+  size_t resv_window;           /* Sectors the next reservation asks for. */
+  struct lock length_lock;      /* Protects the member below and writing DATA. */
+  bool meta_dirty;              /* Extents or length changed since inode_sync()? */
+  struct cache_owner dirty;     /* Dirty data sectors, see inode_sync(). */
+  struct range_lock writing;    /* Sectors being written. */
+  struct lock lock;             /* Protects the members below. */
+  bool removed;                 /* True if deleted, false otherwise. */
+  int deny_write_cnt;           /* 0: writes ok, >0: deny writes. */
+  unsigned generation;          /* Incremented after each write. */
+  struct lock dir_lock;         /* Serializes directory changes. */
+  struct work reclaim_work;     /* Queued on reclaim_wq once removed and closed. */
+  struct inode_disk data;       /* Inode content. */
 };
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
-static block_sector_t byte_to_sector(const struct inode* inode, off_t pos) {
-  ASSERT(inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+/* If these fail, an on-disk structure is not exactly one sector
+   in size, and you should fix that. */
+_Static_assert(sizeof(struct inode_disk) == BLOCK_SECTOR_SIZE, "struct inode_disk is not a sector");
+_Static_assert(sizeof(struct extent_block) == BLOCK_SECTOR_SIZE,
+               "struct extent_block is not a sector");
+
+/* A sector of zeros. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/* Inode numbers of in-memory inodes count up from here, far
+   beyond the last sector of any disk, so that they never collide
+   with on-disk inodes in the page cache. */
+#define MEM_INUMBER_BASE 0xf0000000
+static block_sector_t next_mem_inumber = MEM_INUMBER_BASE;
+
+/* Writes SIZE bytes from BUFFER to data sector SECTOR of INODE,
+   starting at byte offset OFS within the sector, through the
+   journal if INODE's data is metadata. */
+static void inode_write_sector(struct inode* inode, block_sector_t sector, const void* buffer,
+                               size_t ofs, size_t size) {
+  if (inode->metadata)
+    journal_write_at(sector, buffer, ofs, size);
   else
-    return -1;
+    cache_write_owned_at(&inode->dirty, sector, buffer, ofs, size);
+}
+
+/* Returns where the data of INODE is kept if it is inline. */
+static uint8_t* inline_data(struct inode* inode) { return (uint8_t*)inode->data.extents; }
+
+/* Returns true if INODE's data is inline.  Without INODE's
+   extent_lock, the answer may already be out of date when it is
+   true, but never when it is false. */
+static bool inode_is_inline(const struct inode* inode) {
+  return (inode->data.flags & INODE_INLINE) != 0;
+}
+
+/* Returns the number of file sectors that INODE's extents cover.
+   The caller must hold INODE's extent_lock. */
+static size_t extents_end(const struct inode* inode) {
+  const struct inode_extent* last;
+
+  if (inode->extent_cnt == 0)
+    return 0;
+  last = &inode->extents[inode->extent_cnt - 1];
+  return last->ofs + last->e.cnt;
+}
+
+/* Returns the index of the extent of INODE that covers file
+   sector IDX, or INODE's number of extents if none does.  The
+   caller must hold INODE's extent_lock. */
+static size_t extent_find(const struct inode* inode, size_t idx) {
+  size_t lo = 0;
+  size_t hi = inode->extent_cnt;
+
+  if (idx >= extents_end(inode))
+    return inode->extent_cnt;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (inode->extents[mid].ofs <= idx)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* Returns the sector that holds file sector IDX of INODE, or 0 if
+   IDX is in a hole or an unwritten extent or past INODE's
+   extents.  Stores into *RUN the number of file sectors, starting
+   at IDX, that lie in the same extent and so are in consecutive
+   sectors or in the same hole, which is at least 1. */
+static block_sector_t inode_map(struct inode* inode, size_t idx, size_t* run) {
+  block_sector_t sector = 0;
+  size_t i;
+
+  *run = 1;
+  rw_lock_acquire(&inode->extent_lock, RW_READER);
+  i = extent_find(inode, idx);
+  if (i < inode->extent_cnt) {
+    const struct inode_extent* x = &inode->extents[i];
+    *run = x->ofs + x->e.cnt - idx;
+    if (x->e.start != 0 && !x->unwritten)
+      sector = x->e.start + (idx - x->ofs);
+  }
+  rw_lock_release(&inode->extent_lock, RW_READER);
+  return sector;
+}
+
+/* Reads the extents of INODE, whose DATA is already read, into
+   memory.  Returns false if memory is exhausted. */
+static bool extents_load(struct inode* inode) {
+  block_sector_t block = inode->data.extent_block;
+  size_t cnt = inode->data.extent_cnt;
+  size_t ofs = 0;
+  size_t i;
+
+  inode->extents = NULL;
+  inode->extent_cnt = inode->extent_cap = 0;
+  inode->blocks = NULL;
+  inode->block_cnt = 0;
+
+  while (block != 0) {
+    block_sector_t* blocks = realloc(inode->blocks, (inode->block_cnt + 1) * sizeof *blocks);
+    if (blocks == NULL)
+      return false;
+    inode->blocks = blocks;
+    blocks[inode->block_cnt++] = block;
+    cache_read_at(block, &block, offsetof(struct extent_block, next), sizeof block);
+  }
+
+  if (cnt > 0) {
+    inode->extents = malloc(cnt * sizeof *inode->extents);
+    if (inode->extents == NULL)
+      return false;
+    inode->extent_cap = cnt;
+  }
+  for (i = 0; i < cnt; i++) {
+    struct inode_extent* x = &inode->extents[i];
+    if (i < DIRECT_EXTENTS)
+      x->e = inode->data.extents[i];
+    else {
+      size_t j = i - DIRECT_EXTENTS;
+      cache_read_at(inode->blocks[j / BLOCK_EXTENTS], &x->e,
+                    offsetof(struct extent_block, extents) + j % BLOCK_EXTENTS * sizeof x->e,
+                    sizeof x->e);
+    }
+    x->unwritten = (x->e.cnt & EXTENT_UNWRITTEN) != 0;
+    x->e.cnt &= ~EXTENT_UNWRITTEN;
+    x->ofs = ofs;
+    ofs += x->e.cnt;
+  }
+  inode->extent_cnt = cnt;
+  return true;
+}
+
+/* Writes the extents of INODE from index FROM on, and its on-disk
+   inode, to the buffer cache.  The caller must hold INODE's
+   extent_lock as writer. */
+static void extents_store(struct inode* inode, size_t from) {
+  size_t i;
+
+  for (i = from; i < inode->extent_cnt; i++) {
+    struct extent e = inode->extents[i].e;
+    if (inode->extents[i].unwritten)
+      e.cnt |= EXTENT_UNWRITTEN;
+    if (i < DIRECT_EXTENTS)
+      inode->data.extents[i] = e;
+    else {
+      size_t j = i - DIRECT_EXTENTS;
+      journal_write_at(inode->blocks[j / BLOCK_EXTENTS], &e,
+                       offsetof(struct extent_block, extents) + j % BLOCK_EXTENTS * sizeof e,
+                       sizeof e);
+    }
+  }
+  lock_acquire(&inode->length_lock);
+  inode->data.extent_cnt = inode->extent_cnt;
+  inode->meta_dirty = true;
+  journal_write(inode->sector, &inode->data);
+  lock_release(&inode->length_lock);
+}
+
+/* Makes room for INODE to have CNT extents, in memory and in
+   extent blocks on disk.  Returns false if memory or the disk is
+   exhausted.  The caller must hold INODE's extent_lock as
+   writer. */
+static bool extents_reserve(struct inode* inode, size_t cnt) {
+  if (cnt > inode->extent_cap) {
+    size_t cap = inode->extent_cap * 2 > cnt ? inode->extent_cap * 2 : cnt;
+    struct inode_extent* extents = realloc(inode->extents, cap * sizeof *extents);
+    if (extents == NULL)
+      return false;
+    inode->extents = extents;
+    inode->extent_cap = cap;
+  }
+
+  while (cnt > DIRECT_EXTENTS + inode->block_cnt * BLOCK_EXTENTS) {
+    block_sector_t* blocks = realloc(inode->blocks, (inode->block_cnt + 1) * sizeof *blocks);
+    block_sector_t block;
+
+    if (blocks == NULL)
+      return false;
+    inode->blocks = blocks;
+    if (free_map_allocate_run(inode->sector, 1, &block) == 0)
+      return false;
+
+    /* Zero the block, so that its NEXT is 0, and link it in. */
+    journal_write(block, zeros);
+    if (inode->block_cnt == 0)
+      inode->data.extent_block = block;
+    else
+      journal_write_at(inode->blocks[inode->block_cnt - 1], &block,
+                       offsetof(struct extent_block, next), sizeof block);
+    blocks[inode->block_cnt++] = block;
+  }
+  return true;
+}
+
+/* Returns true if extent B, which follows A in a file, can be
+   merged into A. */
+static bool extents_joinable(const struct inode_extent* a, const struct inode_extent* b) {
+  if (a->unwritten != b->unwritten)
+    return false;
+  if (a->e.start == 0 || b->e.start == 0)
+    return a->e.start == b->e.start;
+  return a->e.start + a->e.cnt == b->e.start;
+}
+
+/* Initializes X to map the CNT file sectors starting at OFS to
+   the sectors starting at START, which are UNWRITTEN or not. */
+static void piece_init(struct inode_extent* x, size_t ofs, block_sector_t start, size_t cnt,
+                       bool unwritten) {
+  x->ofs = ofs;
+  x->e.start = start;
+  x->e.cnt = cnt;
+  x->unwritten = unwritten;
+}
+
+/* Maps the CNT file sectors of INODE starting at POS to the CNT
+   sectors starting at START, or to a hole if START is 0, which
+   are UNWRITTEN or not.  The file sectors must either all be in
+   one extent, which is a hole or unwritten unless it is being
+   unshared, or start right after INODE's last extent.  Does not
+   free sectors that it unmaps.  Returns false if memory or the
+   disk is exhausted.  The caller must hold INODE's extent_lock as
+   writer. */
+static bool extent_set(struct inode* inode, size_t pos, size_t cnt, block_sector_t start,
+                       bool unwritten) {
+  struct inode_extent pieces[3];
+  size_t piece_cnt = 0;
+  size_t replaced = 0;
+  size_t i = extent_find(inode, pos);
+  struct inode_extent old;
+  size_t first, j;
+
+  piece_init(&old, pos, 0, 0, false);
+  if (i < inode->extent_cnt) {
+    old = inode->extents[i];
+    ASSERT(pos + cnt <= old.ofs + old.e.cnt);
+    replaced = 1;
+  } else
+    ASSERT(pos == extents_end(inode));
+
+  /* Split the old extent around the new one. */
+  if (old.ofs < pos)
+    piece_init(&pieces[piece_cnt++], old.ofs, old.e.start, pos - old.ofs, old.unwritten);
+  piece_init(&pieces[piece_cnt++], pos, start, cnt, unwritten);
+  if (pos + cnt < old.ofs + old.e.cnt)
+    piece_init(&pieces[piece_cnt++], pos + cnt,
+               old.e.start != 0 ? old.e.start + (pos + cnt - old.ofs) : 0,
+               old.ofs + old.e.cnt - (pos + cnt), old.unwritten);
+
+  if (!extents_reserve(inode, inode->extent_cnt - replaced + piece_cnt))
+    return false;
+  memmove(&inode->extents[i + piece_cnt], &inode->extents[i + replaced],
+          (inode->extent_cnt - i - replaced) * sizeof *inode->extents);
+  memcpy(&inode->extents[i], pieces, piece_cnt * sizeof *pieces);
+  inode->extent_cnt += piece_cnt - replaced;
+
+  /* Merge the new extents with each other and their neighbours
+     where they join up. */
+  first = i > 0 ? i - 1 : 0;
+  j = i + piece_cnt < inode->extent_cnt ? i + piece_cnt : inode->extent_cnt - 1;
+  for (; j > first; j--) {
+    struct inode_extent* a = &inode->extents[j - 1];
+    struct inode_extent* b = &inode->extents[j];
+    if (extents_joinable(a, b)) {
+      a->e.cnt += b->e.cnt;
+      memmove(b, b + 1, (inode->extent_cnt - j - 1) * sizeof *b);
+      inode->extent_cnt--;
+    }
+  }
+
+  extents_store(inode, first);
+  return true;
+}
+
+/* Prepares the CNT consecutive sectors starting at START for
+   file sectors POS onward of INODE, as inode_allocate() does for
+   MODE, writing zeros to those that need them. */
+static void prepare_sectors(struct inode* inode, size_t pos, block_sector_t start, size_t cnt,
+                            off_t ofs, off_t size, enum alloc_mode mode) {
+  size_t k;
+
+  if (mode == ALLOC_UNWRITTEN)
+    return;
+  for (k = 0; k < cnt; k++) {
+    off_t sector_ofs = (off_t)(pos + k) * BLOCK_SECTOR_SIZE;
+    if (mode == ALLOC_ZERO || sector_ofs < ofs || sector_ofs + BLOCK_SECTOR_SIZE > ofs + size ||
+        sector_ofs < inode->data.length)
+      inode_write_sector(inode, start + k, zeros, 0, BLOCK_SECTOR_SIZE);
+    thread_yield_if_needed();
+  }
+}
+
+/* Moves the data of INODE, which is inline, to an allocation
+   block of its own, so that INODE can have extents.  Returns false if memory
+   or the disk is exhausted, leaving INODE as it was.  The caller
+   must hold INODE's extent_lock as writer. */
+static bool inline_move_out(struct inode* inode) {
+  off_t length = inode_length(inode);
+  uint8_t* buffer;
+  block_sector_t start = 0;
+  size_t cnt = 0;
+  size_t k;
+
+  ASSERT(inode_is_inline(inode));
+  ASSERT(inode->extent_cnt == 0);
+
+  buffer = calloc(1, BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    return false;
+  memcpy(buffer, inline_data(inode), INLINE_MAX);
+  if (length > 0) {
+    cnt = free_map_allocate_run(inode->sector, inode->metadata ? 1 : free_map_block_sectors(),
+                                &start);
+    if (cnt == 0) {
+      free(buffer);
+      return false;
+    }
+    inode_write_sector(inode, start, buffer, 0, BLOCK_SECTOR_SIZE);
+    for (k = 1; k < cnt; k++)
+      inode_write_sector(inode, start + k, zeros, 0, BLOCK_SECTOR_SIZE);
+  }
+
+  lock_acquire(&inode->length_lock);
+  inode->data.flags &= ~INODE_INLINE;
+  memset(inode->data.extents, 0, sizeof inode->data.extents);
+  lock_release(&inode->length_lock);
+  if (length == 0)
+    extents_store(inode, 0);
+  else if (!extent_set(inode, 0, cnt, start, false)) {
+    lock_acquire(&inode->length_lock);
+    inode->data.flags |= INODE_INLINE;
+    memcpy(inline_data(inode), buffer, INLINE_MAX);
+    lock_release(&inode->length_lock);
+    free_map_release(start, cnt);
+    free(buffer);
+    return false;
+  }
+  free(buffer);
+  return true;
+}
+
+/* Gives back the sectors still reserved for INODE.  The caller
+   must hold INODE's extent_lock as writer, unless no one else can
+   use INODE. */
+static void inode_unreserve(struct inode* inode) {
+  if (inode->resv_cnt > 0)
+    free_map_unreserve(inode->resv_start, inode->resv_cnt);
+  inode->resv_cnt = 0;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Allocates up to WANT sectors, at least one, for INODE to grow
+   into past the end of its extents, from its reservation window
+   if HINT, the sector after its last one, is where the window
+   starts, or if INODE has no sectors yet.  Otherwise, or if the
+   window is used up, reserves a new window first, as near HINT
+   or else INODE's own sector as it can, falling back to
+   allocating just what is wanted if the free map refuses.
+   Stores the first sector into *START.  Returns the number of
+   sectors allocated, which is 0 if the disk is full.  The caller
+   must hold INODE's extent_lock as writer. */
+static size_t inode_take(struct inode* inode, block_sector_t hint, size_t want,
+                         block_sector_t* start) {
+  size_t n;
+
+  if (inode->resv_cnt > 0 && hint != 0 && hint != inode->resv_start)
+    inode_unreserve(inode);
+  if (inode->resv_cnt == 0) {
+    size_t window = inode->resv_window > RESV_MIN ? inode->resv_window : RESV_MIN;
+    block_sector_t goal = hint != 0 ? hint : inode->sector;
+    inode->resv_cnt = free_map_reserve(goal, want > window ? want : window, &inode->resv_start);
+    if (inode->resv_cnt == 0)
+      return free_map_allocate_run(goal, want, start);
+    inode->resv_window = window * 2 < RESV_MAX ? window * 2 : RESV_MAX;
+  }
+
+  n = want < inode->resv_cnt ? want : inode->resv_cnt;
+  if (!free_map_claim(inode->resv_start, n)) {
+    inode_unreserve(inode);
+    return 0;
+  }
+  *start = inode->resv_start;
+  inode->resv_start += n;
+  inode->resv_cnt -= n;
+  return n;
+}
+
+/* Allocates any missing sectors under the SIZE bytes of INODE
+   starting at OFS, preferring for each the sector after the one
+   that holds the file sector before it, so that files stay
+   contiguous.  Depending on MODE, new sectors and those of
+   unwritten extents in the range are filled with zeros, or with
+   zeros except for those sectors that the caller promises to
+   overwrite, which lie entirely within the range and past the end
+   of the file, so no one can read them yet; or new sectors are
+   marked unwritten and unwritten extents left alone.  Returns
+   false if memory or the disk is exhausted, leaving any sectors
+   allocated so far in place.  Inline data needs no sectors as
+   long as the range fits in the inode, and otherwise is moved out
+   first.  File data is allocated in whole allocation blocks, so
+   the range is widened to block boundaries.  The caller must hold
+   INODE's extent_lock as writer. */
+static bool inode_allocate(struct inode* inode, off_t ofs, off_t size, enum alloc_mode mode) {
+  size_t block = inode->metadata ? 1 : free_map_block_sectors();
+  size_t pos = ROUND_DOWN(ofs / BLOCK_SECTOR_SIZE, block);
+  size_t end = ROUND_UP(bytes_to_sectors(ofs + size), block);
+  bool unwritten = mode == ALLOC_UNWRITTEN;
+
+  if (inode_is_inline(inode)) {
+    if (ofs + size <= INLINE_MAX)
+      return true;
+    if (!inline_move_out(inode))
+      return false;
+  }
+
+  /* Cover any gap after the last extent with a hole. */
+  if (pos > extents_end(inode) &&
+      !extent_set(inode, extents_end(inode), pos - extents_end(inode), 0, false))
+    return false;
+
+  while (pos < end) {
+    size_t i = extent_find(inode, pos);
+    size_t want = end - pos;
+    block_sector_t hint = 0;
+    block_sector_t start;
+    size_t got;
+
+    if (i < inode->extent_cnt) {
+      const struct inode_extent* x = &inode->extents[i];
+      if (x->ofs + x->e.cnt - pos < want)
+        want = x->ofs + x->e.cnt - pos;
+      if (x->e.start != 0 && (!x->unwritten || unwritten)) {
+        pos = x->ofs + x->e.cnt;
+        continue;
+      }
+      if (x->e.start != 0) {
+        /* The sectors are already there: just start using them. */
+        start = x->e.start + (pos - x->ofs);
+        prepare_sectors(inode, pos, start, want, ofs, size, mode);
+        if (!extent_set(inode, pos, want, start, false))
+          return false;
+        pos += want;
+        continue;
+      }
+    }
+    if (pos > 0) {
+      const struct inode_extent* prev = &inode->extents[extent_find(inode, pos - 1)];
+      if (prev->e.start != 0)
+        hint = prev->e.start + (pos - prev->ofs);
+    }
+
+    /* Grow at the end from the reservation window, or from the
+       log segment in log mode.  Data that is journaled, and
+       unwritten extents, which inode_fallocate() allocates in runs
+       as long as it can anyway, do without. */
+    if (i == inode->extent_cnt && !inode->metadata && !unwritten && free_map_log_mode())
+      got = free_map_log_take(want, &start);
+    else if (i == inode->extent_cnt && !inode->metadata && !unwritten)
+      got = inode_take(inode, hint, want, &start);
+    else
+      got = free_map_allocate_run(hint != 0 ? hint : inode->sector, want, &start);
+    if (got == 0 && inode->resv_cnt > 0) {
+      /* The disk is full.  Try again without our window. */
+      inode_unreserve(inode);
+      continue;
+    }
+    if (got == 0)
+      return false;
+    prepare_sectors(inode, pos, start, got, ofs, size, mode);
+    if (!extent_set(inode, pos, got, start, unwritten)) {
+      free_map_release(start, got);
+      return false;
+    }
+    pos += got;
+  }
+  return true;
+}
+
+/* Returns true if every sector under the SIZE bytes of INODE
+   starting at OFS is allocated, which is never the case if its
+   data is inline. */
+static bool inode_allocated(struct inode* inode, off_t ofs, off_t size) {
+  size_t pos = ofs / BLOCK_SECTOR_SIZE;
+  size_t end = bytes_to_sectors(ofs + size);
+  size_t run;
+
+  for (; pos < end; pos += run)
+    if (inode_map(inode, pos, &run) == 0)
+      return false;
+  return true;
+}
+
+/* Gives INODE sectors of its own for those under the SIZE bytes
+   starting at OFS that it shares with other files, copying their
+   data, so that writing there leaves the other files alone.  Each
+   shared sector loses INODE as an owner.  Returns false if memory
+   or the disk is exhausted, leaving the sectors copied so far in
+   place.  The caller must hold INODE's extent_lock as writer. */
+static bool inode_unshare(struct inode* inode, off_t ofs, off_t size) {
+  size_t pos = ofs / BLOCK_SECTOR_SIZE;
+  size_t end = bytes_to_sectors(ofs + size);
+  uint8_t* buffer = NULL;
+  bool success = true;
+
+  while (pos < end && success) {
+    size_t i = extent_find(inode, pos);
+    const struct inode_extent* x;
+    block_sector_t old, start;
+    size_t want, got, k;
+    bool shared;
+
+    if (i == inode->extent_cnt)
+      break;
+    x = &inode->extents[i];
+    want = x->ofs + x->e.cnt - pos < end - pos ? x->ofs + x->e.cnt - pos : end - pos;
+    if (x->e.start == 0 || x->unwritten) {
+      pos += want;
+      continue;
+    }
+    old = x->e.start + (pos - x->ofs);
+    want = free_map_share_run(old, want, &shared);
+    if (!shared) {
+      pos += want;
+      continue;
+    }
+
+    if (buffer == NULL)
+      buffer = malloc(BLOCK_SECTOR_SIZE);
+    got = buffer != NULL ? free_map_allocate_run(old, want, &start) : 0;
+    if (got == 0) {
+      success = false;
+      break;
+    }
+    for (k = 0; k < got; k++) {
+      cache_read(old + k, buffer);
+      inode_write_sector(inode, start + k, buffer, 0, BLOCK_SECTOR_SIZE);
+      thread_yield_if_needed();
+    }
+    if (!extent_set(inode, pos, got, start, false)) {
+      free_map_release(start, got);
+      success = false;
+      break;
+    }
+    free_map_release(old, got);
+    pos += got;
+  }
+  free(buffer);
+  return success;
+}
+
+/* Frees the data sectors and extent blocks of INODE. */
+static void inode_release_data(struct inode* inode) {
+  size_t i;
+
+  for (i = 0; i < inode->extent_cnt; i++) {
+    if (inode->extents[i].e.start != 0)
+      free_map_release(inode->extents[i].e.start, inode->extents[i].e.cnt);
+    thread_yield_if_needed();
+  }
+  for (i = 0; i < inode->block_cnt; i++)
+    free_map_release(inode->blocks[i], 1);
+  inode->extent_cnt = 0;
+  inode->block_cnt = 0;
+}
+
+/* Open inodes, indexed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+/* Cache of struct inode objects. */
+static struct kmem_cache* inode_cache;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+
+/* Removed inodes that no one has open any more, whose sectors
+   this work queue frees in the background, so that neither the
+   last close nor removing a big file waits for that.  Until then,
+   they stay on the orphan list (see orphan.c).  One at a time,
+   because each frees its sectors inside a journal handle. */
+static struct workqueue* reclaim_wq;
+
+static work_func inode_free;
 
 /* Initializes the inode module. */
-void inode_init(void) { list_init(&open_inodes); }
+void inode_init(void) {
+  inode_cache = kmem_cache_create("inode", sizeof(struct inode), NULL);
+  if (!hash_init_mode(&open_inodes, inode_hash, inode_less, NULL, HASH_INCREMENTAL))
+    PANIC("Failed to allocate the open inode table");
+  lock_init_named(&open_inodes_lock, "open_inodes");
+
+  reclaim_wq = wq_create("reclaim", PRI_DEFAULT, 1);
+}
+
+/* Frees the sectors of removed inode INODE_ and then INODE_
+   itself.  Runs on reclaim_wq. */
+static void inode_free(void* inode_) {
+  struct inode* inode = inode_;
+
+#ifdef VM
+  frame_forget_shared(inode->sector, 0, inode_length(inode));
+#endif
+  journal_begin();
+  free_map_release(inode->sector, 1);
+  inode_release_data(inode);
+  orphan_remove(inode->sector);
+  journal_end();
+
+  cache_owner_done(&inode->dirty);
+  free(inode->extents);
+  free(inode->blocks);
+  kmem_cache_free(inode_cache, inode);
+}
+
+/* Waits until the reclaimer has freed every removed inode that
+   was closed for the last time before the call. */
+void inode_reclaim_wait(void) { wq_flush(reclaim_wq); }
+
+/* Called after an allocation for a write fails inside the
+   calling thread's outermost journal handle.  If removed inodes
+   are waiting to be freed, which may make room, ends the handle,
+   waits for them, begins a new handle and returns true, so that
+   the caller can try again.  Otherwise, returns false. */
+static bool reclaim_retry(void) {
+  if (thread_current()->journal_depth != 1 || !wq_busy(reclaim_wq))
+    return false;
+  journal_end();
+  inode_reclaim_wait();
+  journal_begin();
+  return true;
+}
+
+/* Hash function for open_inodes. */
+static unsigned inode_hash(const struct hash_elem* e, void* aux UNUSED) {
+  return hash_int(hash_entry(e, struct inode, elem)->sector);
+}
+
+/* Comparison function for open_inodes. */
+static bool inode_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
+  return hash_entry(a, struct inode, elem)->sector < hash_entry(b, struct inode, elem)->sector;
+}
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The data starts out as a hole, which reads as zeros,
+   and sectors are only allocated as they are written, so the
+   disk may fill up before the file does.  Use inode_reserve() to
+   allocate them in advance.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails. */
 bool inode_create(block_sector_t sector, off_t length) {
   struct inode_disk* disk_inode = NULL;
-  bool success = false;
 
   ASSERT(length >= 0);
 
-  /* If this assertion fails, the inode structure is not exactly
-     one sector in size, and you should fix that. */
-  ASSERT(sizeof *disk_inode == BLOCK_SECTOR_SIZE);
-
   disk_inode = calloc(1, sizeof *disk_inode);
-  if (disk_inode != NULL) {
-    size_t sectors = bytes_to_sectors(length);
-    disk_inode->length = length;
-    disk_inode->magic = INODE_MAGIC;
-    if (free_map_allocate(sectors, &disk_inode->start)) {
-      block_write(fs_device, sector, disk_inode);
-      if (sectors > 0) {
-        static char zeros[BLOCK_SECTOR_SIZE];
-        size_t i;
-
-        for (i = 0; i < sectors; i++)
-          block_write(fs_device, disk_inode->start + i, zeros);
-      }
-      success = true;
-    }
-    free(disk_inode);
+  if (disk_inode == NULL)
+    return false;
+  disk_inode->length = length;
+  disk_inode->magic = INODE_MAGIC;
+  if (length <= INLINE_MAX)
+    disk_inode->flags = INODE_INLINE;
+  else {
+    disk_inode->extent_cnt = 1;
+    disk_inode->extents[0].cnt = bytes_to_sectors(length);
   }
-  return success;
+  journal_write(sector, disk_inode);
+  free(disk_inode);
+  return true;
 }
 
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode* inode_open(block_sector_t sector) {
-  struct list_elem* e;
+  static struct inode key; /* Too big for the stack, protected by open_inodes_lock. */
+  struct hash_elem* e;
   struct inode* inode;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e)) {
-    inode = list_entry(e, struct inode, elem);
-    if (inode->sector == sector) {
-      inode_reopen(inode);
-      return inode;
-    }
+  lock_acquire(&open_inodes_lock);
+  key.sector = sector;
+  e = hash_find(&open_inodes, &key.elem);
+  if (e != NULL) {
+    inode = hash_entry(e, struct inode, elem);
+    inode->open_cnt++;
+    lock_release(&open_inodes_lock);
+    return inode;
   }
 
   /* Allocate memory. */
-  inode = malloc(sizeof *inode);
-  if (inode == NULL)
+  inode = kmem_cache_alloc(inode_cache);
+  if (inode == NULL) {
+    lock_release(&open_inodes_lock);
     return NULL;
+  }
 
-  /* Initialize. */
-  list_push_front(&open_inodes, &inode->elem);
+  /* Initialize.  Read the inode before anyone else can find it. */
   inode->sector = sector;
+  inode->metadata = false;
+  inode->mem = NULL;
+  inode->open_cnt = 1;
+  lock_init_named(&inode->lock, "inode");
+  inode->deny_write_cnt = 0;
+  inode->removed = false;
+  inode->generation = 0;
+  lock_init_named(&inode->dir_lock, "inode dir");
+  range_lock_init(&inode->writing);
+  rw_lock_init_named(&inode->extent_lock, "inode extent");
+  lock_init_named(&inode->length_lock, "inode length");
+  inode->meta_dirty = false;
+  inode->resv_cnt = 0;
+  inode->resv_window = 0;
+  cache_owner_init(&inode->dirty);
+  cache_read(inode->sector, &inode->data);
+  if (!extents_load(inode)) {
+    lock_release(&open_inodes_lock);
+    free(inode->extents);
+    free(inode->blocks);
+    kmem_cache_free(inode_cache, inode);
+    return NULL;
+  }
+  hash_insert(&open_inodes, &inode->elem);
+  lock_release(&open_inodes_lock);
+  return inode;
+}
+
+/* Opens and returns a read-only inode whose data is the LENGTH
+   bytes at DATA, which must stay valid and unchanged until the
+   inode is closed for the last time.  The inode is not on disk
+   and inode_open() never returns it, but it can be read, mapped
+   and executed like any other.  Returns a null pointer if memory
+   allocation fails. */
+struct inode* inode_open_mem(const void* data, off_t length) {
+  struct inode* inode;
+
+  ASSERT(data != NULL);
+  ASSERT(length >= 0);
+
+  inode = kmem_cache_alloc(inode_cache);
+  if (inode == NULL)
+    return NULL;
+
+  memset(&inode->data, 0, sizeof inode->data);
+  inode->data.length = length;
+  inode->data.magic = INODE_MAGIC;
+  inode->mem = data;
+  inode->mem_pages = 0;
+  lock_acquire(&open_inodes_lock);
+  inode->sector = next_mem_inumber++;
+  lock_release(&open_inodes_lock);
+  inode->metadata = false;
   inode->open_cnt = 1;
+  lock_init_named(&inode->lock, "inode");
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read(fs_device, inode->sector, &inode->data);
+  inode->generation = 0;
+  lock_init_named(&inode->dir_lock, "inode dir");
+  range_lock_init(&inode->writing);
+  rw_lock_init_named(&inode->extent_lock, "inode extent");
+  lock_init_named(&inode->length_lock, "inode length");
+  inode->meta_dirty = false;
+  inode->extents = NULL;
+  inode->extent_cnt = 0;
+  inode->extent_cap = 0;
+  inode->blocks = NULL;
+  inode->block_cnt = 0;
+  inode->resv_cnt = 0;
+  inode->resv_window = 0;
+  cache_owner_init(&inode->dirty);
+  return inode;
+}
+
+/* Like inode_open_mem(), but the inode owns the PAGE_CNT pages
+   at PAGES, obtained from palloc_get_multiple(), whose first
+   LENGTH bytes are its data, and frees them when it is closed for
+   the last time.  Frees them at once if memory allocation
+   fails. */
+struct inode* inode_open_mem_pages(void* pages, size_t page_cnt, off_t length) {
+  struct inode* inode;
+
+  ASSERT(page_cnt > 0);
+  ASSERT((size_t)length <= page_cnt * PGSIZE);
+
+  inode = inode_open_mem(pages, length);
+  if (inode == NULL)
+    palloc_free_multiple(pages, page_cnt);
+  else
+    inode->mem_pages = page_cnt;
   return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode* inode_reopen(struct inode* inode) {
-  if (inode != NULL)
+  if (inode != NULL) {
+    lock_acquire(&open_inodes_lock);
     inode->open_cnt++;
+    lock_release(&open_inodes_lock);
+  }
   return inode;
 }
 
@@ -133,22 +998,40 @@ block_sector_t inode_get_inumber(const struct inode* inode) { return inode->sect
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
 void inode_close(struct inode* inode) {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0) {
-    /* Remove from inode list and release lock. */
-    list_remove(&inode->elem);
+  lock_acquire(&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last && inode->mem == NULL)
+    hash_delete(&open_inodes, &inode->elem);
+  lock_release(&open_inodes_lock);
+
+  if (last && inode->mem != NULL) {
+    if (inode->mem_pages > 0)
+      palloc_free_multiple((void*)inode->mem, inode->mem_pages);
+    kmem_cache_free(inode_cache, inode);
+    return;
+  }
 
-    /* Deallocate blocks if removed. */
+  /* Release resources if this was the last opener.  No one else
+     can find INODE any more.  Leave freeing a removed inode's
+     sectors to the reclaimer. */
+  if (last) {
+    inode_unreserve(inode);
     if (inode->removed) {
-      free_map_release(inode->sector, 1);
-      free_map_release(inode->data.start, bytes_to_sectors(inode->data.length));
+      work_init(&inode->reclaim_work, inode_free, inode);
+      wq_queue(reclaim_wq, &inode->reclaim_work);
+      return;
     }
 
-    free(inode);
+    cache_owner_done(&inode->dirty);
+    free(inode->extents);
+    free(inode->blocks);
+    kmem_cache_free(inode_cache, inode);
   }
 }
 
@@ -156,20 +1039,282 @@ void inode_close(struct inode* inode) {
    has it open. */
 void inode_remove(struct inode* inode) {
   ASSERT(inode != NULL);
+  orphan_add(inode->sector);
+  lock_acquire(&inode->lock);
   inode->removed = true;
+  lock_release(&inode->lock);
+}
+
+/* Allocates, and fills with zeros, any sectors under the SIZE
+   bytes of INODE starting at OFFSET that are not yet allocated,
+   so that writing there cannot run out of disk space.  Does not
+   change INODE's length.
+   Returns false if memory or the disk is exhausted, leaving any
+   sectors allocated so far in place. */
+bool inode_reserve(struct inode* inode, off_t offset, off_t size) {
+  bool success;
+
+  if (inode->mem != NULL)
+    return false;
+  journal_begin();
+  rw_lock_acquire(&inode->extent_lock, RW_WRITER);
+  success = inode_allocate(inode, offset, size, ALLOC_ZERO);
+  rw_lock_release(&inode->extent_lock, RW_WRITER);
+  journal_end();
+  return success;
+}
+
+/* Allocates any sectors under the SIZE bytes of INODE starting at
+   OFFSET that are not yet allocated, in as few runs as the free
+   map allows, and extends INODE to cover them.  The new sectors
+   are marked unwritten, so they read as zeros without being
+   written first, and later writes there need no allocation.
+   Returns false if writes to INODE are denied or if memory or the
+   disk is exhausted, in which case INODE's length is unchanged
+   but any sectors allocated so far stay in place. */
+bool inode_fallocate(struct inode* inode, off_t offset, off_t size) {
+  bool success;
+
+  lock_acquire(&inode->lock);
+  success = inode->deny_write_cnt == 0 && inode->mem == NULL;
+  lock_release(&inode->lock);
+  if (!success)
+    return false;
+
+  journal_begin();
+  do {
+    rw_lock_acquire(&inode->extent_lock, RW_WRITER);
+    success = inode_allocate(inode, offset, size, ALLOC_UNWRITTEN);
+    lock_acquire(&inode->length_lock);
+    if (success && offset + size > inode->data.length) {
+      inode->data.length = offset + size;
+      inode->meta_dirty = true;
+      journal_write(inode->sector, &inode->data);
+    }
+    lock_release(&inode->length_lock);
+    rw_lock_release(&inode->extent_lock, RW_WRITER);
+  } while (!success && reclaim_retry());
+  journal_end();
+  return success;
+}
+
+/* Makes the inode at SECTOR, which must be allocated, a clone of
+   SRC: a file with the same length and data, whose written
+   extents are shared with SRC instead of copied, so that cloning
+   costs no data sectors and no data is read or written.  The
+   first write to a shared sector by either file gives that file a
+   copy of its own.  Unwritten extents become holes in the clone.
+   The new inode is put on the orphan list, so that it is freed if
+   the system crashes before the caller links it into a directory
+   and calls orphan_remove().  Returns false if SRC is metadata,
+   such as a directory, if memory or the disk is exhausted, or if
+   a sector already has as many owners as the free map counts, in
+   which case the caller should free SECTOR, which is off the
+   orphan list again. */
+bool inode_clone(struct inode* src, block_sector_t sector) {
+  struct inode* dst;
+  struct range range;
+  bool success = true;
+  size_t i;
+
+  if (src->metadata)
+    return false;
+
+  /* Hold off writers to SRC, so that its data cannot change while
+     it is cloned. */
+  range_lock_acquire(&src->writing, &range, 0, UINT32_MAX);
+  journal_begin();
+  if (!inode_create(sector, 0) || (dst = inode_open(sector)) == NULL) {
+    journal_end();
+    range_lock_release(&src->writing, &range);
+    return false;
+  }
+  orphan_add(sector);
+
+  /* No one else has DST open yet, so taking its extent_lock after
+     SRC's cannot deadlock. */
+  rw_lock_acquire(&src->extent_lock, RW_WRITER);
+  rw_lock_acquire(&dst->extent_lock, RW_WRITER);
+  if (inode_is_inline(src))
+    memcpy(inline_data(dst), inline_data(src), INLINE_MAX);
+  else {
+    lock_acquire(&dst->length_lock);
+    dst->data.flags &= ~INODE_INLINE;
+    memset(dst->data.extents, 0, sizeof dst->data.extents);
+    lock_release(&dst->length_lock);
+    extents_store(dst, 0);
+    for (i = 0; i < src->extent_cnt && success; i++) {
+      const struct inode_extent* x = &src->extents[i];
+      bool written = x->e.start != 0 && !x->unwritten;
+
+      if (written && !free_map_share(x->e.start, x->e.cnt))
+        success = false;
+      else if (!extent_set(dst, x->ofs, x->e.cnt, written ? x->e.start : 0, false)) {
+        if (written)
+          free_map_release(x->e.start, x->e.cnt);
+        success = false;
+      }
+      thread_yield_if_needed();
+    }
+  }
+
+  if (success) {
+    lock_acquire(&src->length_lock);
+    if (!inode_is_inline(src)) {
+      src->data.flags |= INODE_SHARED;
+      src->meta_dirty = true;
+      journal_write(src->sector, &src->data);
+    }
+    lock_release(&src->length_lock);
+
+    lock_acquire(&dst->length_lock);
+    dst->data.length = src->data.length;
+    if (!inode_is_inline(dst))
+      dst->data.flags |= INODE_SHARED;
+    dst->meta_dirty = true;
+    journal_write(dst->sector, &dst->data);
+    lock_release(&dst->length_lock);
+  } else {
+    inode_release_data(dst);
+    orphan_remove(sector);
+  }
+  rw_lock_release(&dst->extent_lock, RW_WRITER);
+  rw_lock_release(&src->extent_lock, RW_WRITER);
+  journal_end();
+  range_lock_release(&src->writing, &range);
+
+  inode_close(dst);
+  return success;
+}
+
+/* Copies into BUFFER up to SIZE bytes of INODE starting at
+   OFFSET, if INODE's data is inline, and returns how many, which
+   is 0 at the end of the file.  Returns -1 if the data is not
+   inline. */
+static off_t inline_read(struct inode* inode, void* buffer, off_t size, off_t offset) {
+  off_t n = -1;
+
+  rw_lock_acquire(&inode->extent_lock, RW_READER);
+  if (inode_is_inline(inode)) {
+    n = inode_length(inode) - offset;
+    if (n > size)
+      n = size;
+    if (n > 0)
+      memcpy(buffer, inline_data(inode) + offset, n);
+    else
+      n = 0;
+  }
+  rw_lock_release(&inode->extent_lock, RW_READER);
+  return n;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   extending INODE if the write goes past its end, if INODE's data
+   is inline and stays so.  Otherwise, returns false without
+   writing anything. */
+static bool inline_write(struct inode* inode, const void* buffer, off_t size, off_t offset) {
+  bool success;
+
+  rw_lock_acquire(&inode->extent_lock, RW_WRITER);
+  success = inode_is_inline(inode) && offset + size <= INLINE_MAX;
+  if (success) {
+    lock_acquire(&inode->length_lock);
+    memcpy(inline_data(inode) + offset, buffer, size);
+    if (offset + size > inode->data.length)
+      inode->data.length = offset + size;
+    inode->meta_dirty = true;
+    journal_write(inode->sector, &inode->data);
+    lock_release(&inode->length_lock);
+  }
+  rw_lock_release(&inode->extent_lock, RW_WRITER);
+  return success;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
-off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset) {
-  uint8_t* buffer = buffer_;
+off_t inode_read_at(struct inode* inode, void* buffer, off_t size, off_t offset) {
+  return inode_read_copy(inode, buffer, size, offset, NULL);
+}
+
+/* State for copy_piece(). */
+struct copy_state {
+  uint8_t* buffer;       /* Where the next piece goes. */
+  inode_copy_func* copy; /* How to copy it there, or a null pointer. */
+  bool ok;               /* False once COPY has failed. */
+};
+
+/* inode_read_func for inode_read_copy(). */
+static bool copy_piece(const void* data, size_t size, void* s_) {
+  struct copy_state* s = s_;
+
+  if (s->copy != NULL)
+    s->ok = s->copy(s->buffer, data, size);
+  else
+    memcpy(s->buffer, data, size);
+  s->buffer += size;
+  return s->ok;
+}
+
+/* Like inode_read_at(), but moves the data into BUFFER with COPY,
+   straight from the buffer cache and without holding any lock,
+   so that COPY may fault.  If COPY fails, stops and returns -1.
+   A null COPY copies with memcpy(). */
+off_t inode_read_copy(struct inode* inode, void* buffer, off_t size, off_t offset,
+                      inode_copy_func* copy) {
+  struct copy_state s;
+  off_t bytes_read;
+
+  s.buffer = buffer;
+  s.copy = copy;
+  s.ok = true;
+  bytes_read = inode_read_each(inode, size, offset, copy_piece, &s);
+  return s.ok ? bytes_read : -1;
+}
+
+/* Passes the SIZE bytes of INODE starting at OFFSET, or as many of
+   them as come before the end of the file, to FUNC along with AUX,
+   at most a sector at a time and straight from the buffer cache,
+   or, for a page that a process has mapped, from its frame in the
+   page cache.  A hole is passed as zeros.  No lock is held while FUNC runs, so
+   it may fault or write to other files, but the data it is given
+   may change meanwhile if someone writes it.  Stops early if FUNC
+   returns false.  Returns the number of bytes FUNC accepted. */
+off_t inode_read_each(struct inode* inode, off_t size, off_t offset, inode_read_func* func,
+                      void* aux) {
   off_t bytes_read = 0;
-  uint8_t* bounce = NULL;
+  block_sector_t sector_idx = 0;
+  size_t run = 0; /* Sectors left in SECTOR_IDX's extent, counting it. */
+#ifdef VM
+  uint8_t* page = NULL; /* Page cache frame for the page at PAGE_OFS. */
+  off_t page_ofs = -1;  /* Offset of the page last looked up, or -1. */
+#endif
+
+  /* In-memory data never moves or changes. */
+  if (inode->mem != NULL) {
+    off_t n = inode_length(inode) - offset;
+    if (n > size)
+      n = size;
+    return n > 0 && func(inode->mem + offset, n, aux) ? n : 0;
+  }
+
+  /* Inline data can move out at any time, so copy it out under
+     INODE's extent_lock, a piece at a time, before FUNC sees it. */
+  while (size > 0 && inode_is_inline(inode)) {
+    uint8_t piece[128];
+    off_t n = inline_read(inode, piece, size < (off_t)sizeof piece ? size : (off_t)sizeof piece,
+                          offset);
+    if (n < 0)
+      break;
+    if (n == 0 || !func(piece, n, aux))
+      return bytes_read;
+    size -= n;
+    offset += n;
+    bytes_read += n;
+  }
 
   while (size > 0) {
-    /* Disk sector to read, starting byte offset within sector. */
-    block_sector_t sector_idx = byte_to_sector(inode, offset);
+    /* Starting byte offset within sector. */
     int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
     /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -179,108 +1324,249 @@ off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset
 
     /* Number of bytes to actually copy out of this sector. */
     int chunk_size = size < min_left ? size : min_left;
+    bool ok;
+
     if (chunk_size <= 0)
       break;
 
-    if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-      /* Read full sector directly into caller's buffer. */
-      block_read(fs_device, sector_idx, buffer + bytes_read);
-    } else {
-      /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-      if (bounce == NULL) {
-        bounce = malloc(BLOCK_SECTOR_SIZE);
-        if (bounce == NULL)
-          break;
-      }
-      block_read(fs_device, sector_idx, bounce);
-      memcpy(buffer + bytes_read, bounce + sector_ofs, chunk_size);
+#ifdef VM
+    /* Look in the page cache once per page.  Our reference keeps
+       the frame from being reused while FUNC reads it. */
+    if (ROUND_DOWN(offset, PGSIZE) != page_ofs && !inode->metadata) {
+      if (page != NULL)
+        palloc_free_page(page);
+      page_ofs = ROUND_DOWN(offset, PGSIZE);
+      page = frame_find_shared(inode->sector, page_ofs);
     }
+    if (page != NULL) {
+      ok = func(page + offset % PGSIZE, chunk_size, aux);
+      run = 0;
+    } else
+#endif
+    {
+      /* Disk sector to read, looked up once per extent. */
+      if (run == 0)
+        sector_idx = inode_map(inode, offset / BLOCK_SECTOR_SIZE, &run);
+      if (sector_idx != 0) {
+        const uint8_t* data = cache_hold(sector_idx);
+        ok = func(data + sector_ofs, chunk_size, aux);
+        cache_unhold(data);
+      } else
+        ok = func(zeros, chunk_size, aux);
+    }
+    if (!ok)
+      break;
 
     /* Advance. */
     size -= chunk_size;
     offset += chunk_size;
     bytes_read += chunk_size;
+    if (offset % BLOCK_SECTOR_SIZE == 0 && run > 0) {
+      run--;
+      if (sector_idx != 0)
+        sector_idx++;
+    }
   }
-  free(bounce);
 
+#ifdef VM
+  if (page != NULL)
+    palloc_free_page(page);
+#endif
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+/* Asks the buffer cache to read the sectors that hold the SIZE
+   bytes of INODE starting at OFFSET in the background, as far as
+   INODE has data there. */
+void inode_read_ahead(struct inode* inode, off_t offset, off_t size) {
+  off_t end = offset + size < inode_length(inode) ? offset + size : inode_length(inode);
+  size_t end_idx = bytes_to_sectors(end);
+  size_t idx, run;
+
+  if (inode->mem != NULL)
+    return;
+  for (idx = offset / BLOCK_SECTOR_SIZE; idx < end_idx; idx += run) {
+    block_sector_t sector = inode_map(inode, idx, &run);
+    size_t i;
+
+    for (i = 0; sector != 0 && i < run && idx + i < end_idx; i++)
+      cache_prefetch(sector + i);
+  }
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   extending INODE if the write goes past its end.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs. */
 off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t offset) {
   const uint8_t* buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t* bounce = NULL;
+  block_sector_t sector_idx = 0;
+  size_t run = 0; /* Sectors left in SECTOR_IDX's extent, counting it. */
+  struct range range;
+  bool ranged = size > 0;
+  bool denied;
 
-  if (inode->deny_write_cnt)
+  lock_acquire(&inode->lock);
+  denied = inode->deny_write_cnt > 0 || inode->mem != NULL;
+  lock_release(&inode->lock);
+  if (denied)
     return 0;
 
+  /* Keep out other writers of the same sectors, so that
+     overlapping writes do not interleave. */
+  if (ranged)
+    range_lock_acquire(&inode->writing, &range, offset / BLOCK_SECTOR_SIZE,
+                       bytes_to_sectors(offset + size));
+  journal_begin();
+
+#ifdef VM
+  /* Processes that run this file from now on must see the new
+     contents. */
+  frame_forget_shared(inode->sector, offset, size);
+#endif
+
+  /* A file small enough stays in its inode. */
+  if (size > 0 && inline_write(inode, buffer, size, offset)) {
+    bytes_written = size;
+    offset += size;
+    size = 0;
+  }
+
+  /* Allocate whatever sectors the write needs up front.  If the
+     disk fills up, we write as far as we can below. */
+  if (size > 0 && !inode_allocated(inode, offset, size)) {
+    bool allocated;
+
+    do {
+      rw_lock_acquire(&inode->extent_lock, RW_WRITER);
+      allocated = inode_allocate(inode, offset, size, ALLOC_OVERWRITE);
+      rw_lock_release(&inode->extent_lock, RW_WRITER);
+    } while (!allocated && reclaim_retry());
+  }
+
+  /* Copy sectors shared with other files before writing over
+     them.  If that fails, even in part, write nothing, since the
+     loop below would write into the shared copy. */
+  if (size > 0 && (inode->data.flags & INODE_SHARED) != 0) {
+    bool unshared;
+
+    do {
+      rw_lock_acquire(&inode->extent_lock, RW_WRITER);
+      unshared = inode_unshare(inode, offset, size);
+      rw_lock_release(&inode->extent_lock, RW_WRITER);
+    } while (!unshared && reclaim_retry());
+    if (!unshared)
+      size = 0;
+  }
+
   while (size > 0) {
-    /* Sector to write, starting byte offset within sector. */
-    block_sector_t sector_idx = byte_to_sector(inode, offset);
+    /* Starting byte offset within sector. */
     int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-    /* Bytes left in inode, bytes left in sector, lesser of the two. */
-    off_t inode_left = inode_length(inode) - offset;
+    /* Number of bytes to actually write into this sector. */
     int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-    int min_left = inode_left < sector_left ? inode_left : sector_left;
+    int chunk_size = size < sector_left ? size : sector_left;
 
-    /* Number of bytes to actually write into this sector. */
-    int chunk_size = size < min_left ? size : min_left;
-    if (chunk_size <= 0)
+    /* Disk sector to write, looked up once per extent. */
+    if (run == 0)
+      sector_idx = inode_map(inode, offset / BLOCK_SECTOR_SIZE, &run);
+    if (sector_idx == 0)
       break;
-
-    if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-      /* Write full sector directly to disk. */
-      block_write(fs_device, sector_idx, buffer + bytes_written);
-    } else {
-      /* We need a bounce buffer. */
-      if (bounce == NULL) {
-        bounce = malloc(BLOCK_SECTOR_SIZE);
-        if (bounce == NULL)
-          break;
-      }
-
-      /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-      if (sector_ofs > 0 || chunk_size < sector_left)
-        block_read(fs_device, sector_idx, bounce);
-      else
-        memset(bounce, 0, BLOCK_SECTOR_SIZE);
-      memcpy(bounce + sector_ofs, buffer + bytes_written, chunk_size);
-      block_write(fs_device, sector_idx, bounce);
-    }
+    inode_write_sector(inode, sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
 
     /* Advance. */
     size -= chunk_size;
     offset += chunk_size;
     bytes_written += chunk_size;
+    if (offset % BLOCK_SECTOR_SIZE == 0) {
+      run--;
+      sector_idx++;
+    }
   }
-  free(bounce);
 
+  /* Extend INODE over what was written. */
+  if (bytes_written > 0 && offset > inode_length(inode)) {
+    lock_acquire(&inode->length_lock);
+    if (offset > inode->data.length) {
+      inode->data.length = offset;
+      inode->meta_dirty = true;
+      journal_write(inode->sector, &inode->data);
+    }
+    lock_release(&inode->length_lock);
+  }
+  journal_end();
+  if (ranged)
+    range_lock_release(&inode->writing, &range);
+
+  if (bytes_written > 0) {
+    lock_acquire(&inode->lock);
+    inode->generation++;
+    lock_release(&inode->lock);
+  }
   return bytes_written;
 }
 
+/* Makes INODE's data durable, writing back just its own dirty
+   sectors and then flushing the disk's write cache.  Unless
+   DATA_ONLY is true, or INODE's extents or length changed since
+   the last call, which a reader would need to find the data,
+   also commits the journal, which makes the rest of INODE, and
+   all other metadata changed so far, durable too. */
+void inode_sync(struct inode* inode, bool data_only) {
+  bool commit;
+
+  if (inode->mem != NULL)
+    return;
+  cache_flush_owner(&inode->dirty);
+  lock_acquire(&inode->length_lock);
+  commit = !data_only || inode->meta_dirty;
+  inode->meta_dirty = false;
+  lock_release(&inode->length_lock);
+  if (commit)
+    journal_commit();
+  block_flush(fs_device);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void inode_deny_write(struct inode* inode) {
+  lock_acquire(&inode->lock);
   inode->deny_write_cnt++;
   ASSERT(inode->deny_write_cnt <= inode->open_cnt);
+  lock_release(&inode->lock);
 }
 
 /* Re-enables writes to INODE.
    Must be called once by each inode opener who has called
    inode_deny_write() on the inode, before closing the inode. */
 void inode_allow_write(struct inode* inode) {
+  lock_acquire(&inode->lock);
   ASSERT(inode->deny_write_cnt > 0);
   ASSERT(inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release(&inode->lock);
+}
+
+/* Marks INODE's data as file system metadata, which is written
+   through the journal like the inode itself.  Directories and
+   the free map call this before they write to their inodes. */
+void inode_set_metadata(struct inode* inode) { inode->metadata = true; }
+
+/* Returns the lock that directory.c holds while it changes the
+   entries of directory INODE. */
+struct lock* inode_dir_lock(struct inode* inode) { return &inode->dir_lock; }
+
+/* Returns INODE's generation, which changes after every write to
+   it.  Data read from INODE after this call is still current if
+   the generation is still the same. */
+unsigned inode_generation(struct inode* inode) {
+  unsigned generation;
+
+  lock_acquire(&inode->lock);
+  generation = inode->generation;
+  lock_release(&inode->lock);
+  return generation;
 }
 
 /* Returns the length, in bytes, of INODE's data. */
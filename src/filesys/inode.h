@@ -2,22 +2,45 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 
 struct bitmap;
+struct lock;
+
+/* Copies SIZE bytes from SRC to DST, returning false if that
+   fails, as copy_to_user() does. */
+typedef bool inode_copy_func(void* dst, const void* src, size_t size);
+
+/* Receives SIZE bytes of file data at DATA, for inode_read_each().
+   Returns false to stop reading. */
+typedef bool inode_read_func(const void* data, size_t size, void* aux);
 
 void inode_init(void);
 bool inode_create(block_sector_t, off_t);
 struct inode* inode_open(block_sector_t);
+struct inode* inode_open_mem(const void*, off_t length);
+struct inode* inode_open_mem_pages(void* pages, size_t page_cnt, off_t length);
 struct inode* inode_reopen(struct inode*);
 block_sector_t inode_get_inumber(const struct inode*);
 void inode_close(struct inode*);
 void inode_remove(struct inode*);
+void inode_reclaim_wait(void);
 off_t inode_read_at(struct inode*, void*, off_t size, off_t offset);
+off_t inode_read_copy(struct inode*, void*, off_t size, off_t offset, inode_copy_func*);
+off_t inode_read_each(struct inode*, off_t size, off_t offset, inode_read_func*, void* aux);
 off_t inode_write_at(struct inode*, const void*, off_t size, off_t offset);
+void inode_read_ahead(struct inode*, off_t offset, off_t size);
+bool inode_reserve(struct inode*, off_t offset, off_t size);
+bool inode_fallocate(struct inode*, off_t offset, off_t size);
+bool inode_clone(struct inode* src, block_sector_t);
+void inode_sync(struct inode*, bool data_only);
 void inode_deny_write(struct inode*);
 void inode_allow_write(struct inode*);
 off_t inode_length(const struct inode*);
+unsigned inode_generation(struct inode*);
+void inode_set_metadata(struct inode*);
+struct lock* inode_dir_lock(struct inode*);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,286 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata journal.
+
+   A file system operation that changes several metadata sectors,
+   such as an inode, an extent block, a free map sector and a
+   directory sector, brackets its changes with journal_begin()
+   and journal_end() and makes them with journal_write(), so that
+   after a crash either all of them or none of them are on disk.
+   File data is not journaled.
+
+   Writes made inside a transaction go to the buffer cache as
+   usual, but their sectors are pinned there, so that they cannot
+   reach their home locations yet, and listed in the running
+   transaction.  Many operations share one running transaction.
+   Every JOURNAL_INTERVAL ticks, or sooner if it fills up, the
+   journal thread commits it:
+
+      1. It waits until no operation is inside the transaction,
+         and holds new ones off until step 5 is done.
+
+      2. It flushes the cache, so that the data that the new
+         metadata refers to is on disk before the metadata.
+
+      3. It copies the transaction's sectors into the log and then
+         writes the header that lists them, which is the commit
+         point: a transaction counts once its header is on disk,
+         and the header is a single sector, written atomically.
+
+      4. It unpins the sectors and flushes the cache again, which
+         writes them to their home locations.
+
+      5. It clears the header, so that the log is never replayed
+         over sectors that have been reused since.
+
+   The disk may hold writes in a write cache and reorder them, so
+   both header writes are barriers (see block_write_barrier()):
+   the data and log images written in steps 2 and 3 are durable
+   before the header that commits them, and the home locations
+   written in step 4 before the header that lets them be reused.
+   The other writes need not wait for each other.
+
+   journal_init() replays a committed transaction that a crash
+   interrupted between steps 3 and 5 by copying its sectors from
+   the log to their home locations again.
+
+   The log occupies the last JOURNAL_SECTORS sectors of the file
+   system device: the header, then up to JOURNAL_MAX images.  Each
+   operation reserves JOURNAL_CREDITS sectors of the running
+   transaction when it begins.  One that writes more than that,
+   which only rehashing a large directory does, may find the
+   transaction full, and its remaining writes then go to the cache
+   unpinned, without the guarantee.
+
+   Lock order: any file system lock, then journal_lock, then the
+   buffer cache's locks.  commit_lock is only held by the
+   committer, before journal_lock and without file system locks. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4c4e524a
+
+/* Sectors that an operation reserves when it begins. */
+#define JOURNAL_CREDITS 8
+
+/* Ticks between commits of the running transaction. */
+#define JOURNAL_INTERVAL (TIMER_FREQ / 2)
+
+/* On-disk journal header.  Must be exactly BLOCK_SECTOR_SIZE
+   bytes long. */
+struct journal_header {
+  uint32_t magic;                      /* JOURNAL_MAGIC. */
+  uint32_t seq;                        /* Sequence number of the transaction. */
+  uint32_t cnt;                        /* Number of sectors logged, 0 if none. */
+  block_sector_t sectors[JOURNAL_MAX]; /* Home sector of each logged image. */
+  uint8_t unused[BLOCK_SECTOR_SIZE - 12 - 4 * JOURNAL_MAX];
+};
+
+static block_sector_t log_start; /* First sector of the journal. */
+
+/* Running transaction, protected by journal_lock. */
+static struct lock journal_lock;
+static block_sector_t txn_sectors[JOURNAL_MAX]; /* Sectors written, pinned in the cache. */
+static size_t txn_cnt;                          /* Number of TXN_SECTORS. */
+static int handle_cnt;                          /* Operations inside the transaction. */
+static size_t reserved;                         /* Sectors that those operations reserved. */
+static bool committing;                         /* Commit holding new operations off? */
+static struct condition drained;                /* Signaled when HANDLE_CNT drops to 0. */
+static struct condition admitted;               /* Signaled when operations may begin. */
+static uint32_t seq;                            /* Sequence number of the transaction. */
+
+/* Commit state, protected by commit_lock. */
+static struct lock commit_lock;
+static struct journal_header header;
+static uint8_t log_buf[JOURNAL_MAX * BLOCK_SECTOR_SIZE]; /* Images, gathered. */
+
+/* Journal thread wakeups. */
+static struct timer_callout commit_callout;
+static struct semaphore commit_sema;
+
+static thread_func journal_thread;
+static void write_header(uint32_t cnt);
+
+/* Initializes the journal.  If FORMAT is true, empties it.
+   Otherwise, completes any transaction that was committed but
+   not yet written to its home locations.  Must be called before
+   anything else reads through the buffer cache. */
+void journal_init(bool format) {
+  if (block_size(fs_device) < 2 * JOURNAL_SECTORS)
+    PANIC("file system device too small for the journal");
+  ASSERT(sizeof header == BLOCK_SECTOR_SIZE);
+  log_start = block_size(fs_device) - JOURNAL_SECTORS;
+
+  lock_init_named(&journal_lock, "journal");
+  cond_init(&drained);
+  cond_init(&admitted);
+  lock_init_named(&commit_lock, "commit");
+
+  block_read(fs_device, log_start, &header);
+  if (format || header.magic != JOURNAL_MAGIC)
+    seq = 0;
+  else {
+    size_t i;
+
+    seq = header.seq + 1;
+    if (header.cnt > 0 && header.cnt <= JOURNAL_MAX) {
+      block_read_multiple(fs_device, log_start + 1, header.cnt, log_buf);
+      for (i = 0; i < header.cnt; i++)
+        block_write(fs_device, header.sectors[i], log_buf + i * BLOCK_SECTOR_SIZE);
+    }
+  }
+  write_header(0);
+
+  sema_init(&commit_sema, 0);
+  thread_create("journal", PRI_DEFAULT, journal_thread, NULL);
+}
+
+/* Returns the first sector of the journal, which takes up
+   JOURNAL_SECTORS sectors of the file system device. */
+block_sector_t journal_start(void) { return log_start; }
+
+/* Begins an operation whose metadata writes must reach the disk
+   together, waiting first for room in the running transaction.
+   Nests: only the outermost journal_begin() and journal_end() of
+   a thread count, so that file system layers can each bracket
+   their own work. */
+void journal_begin(void) {
+  struct thread* t = thread_current();
+
+  if (t->journal_depth++ > 0)
+    return;
+
+  lock_acquire(&journal_lock);
+  while (committing || txn_cnt + reserved + JOURNAL_CREDITS > JOURNAL_MAX) {
+    if (!committing)
+      sema_up(&commit_sema);
+    cond_wait(&admitted, &journal_lock);
+  }
+  handle_cnt++;
+  reserved += JOURNAL_CREDITS;
+  lock_release(&journal_lock);
+}
+
+/* Ends an operation begun with journal_begin().  Its writes reach
+   the disk with the next commit. */
+void journal_end(void) {
+  struct thread* t = thread_current();
+
+  ASSERT(t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire(&journal_lock);
+  reserved -= JOURNAL_CREDITS;
+  if (--handle_cnt == 0)
+    cond_signal(&drained, &journal_lock);
+  lock_release(&journal_lock);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to metadata sector
+   SECTOR as part of the running transaction. */
+void journal_write(block_sector_t sector, const void* buffer) {
+  journal_write_at(sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER to metadata sector SECTOR,
+   starting at byte offset OFS within the sector, as part of the
+   running transaction.  Outside of a transaction, as while
+   formatting, just writes to the buffer cache. */
+void journal_write_at(block_sector_t sector, const void* buffer, size_t ofs, size_t size) {
+  if (thread_current()->journal_depth > 0) {
+    size_t i;
+
+    lock_acquire(&journal_lock);
+    for (i = 0; i < txn_cnt; i++)
+      if (txn_sectors[i] == sector)
+        break;
+    if (i == txn_cnt && txn_cnt < JOURNAL_MAX) {
+      txn_sectors[txn_cnt++] = sector;
+      cache_pin(sector);
+    }
+    lock_release(&journal_lock);
+  }
+  cache_write_at(sector, buffer, ofs, size);
+}
+
+/* Writes a journal header that lists the first CNT sectors of
+   txn_sectors, which must be logged already.  The caller must
+   hold commit_lock or be journal_init(). */
+static void write_header(uint32_t cnt) {
+  memset(&header, 0, sizeof header);
+  header.magic = JOURNAL_MAGIC;
+  header.seq = seq;
+  header.cnt = cnt;
+  memcpy(header.sectors, txn_sectors, cnt * sizeof *txn_sectors);
+  block_write_barrier(fs_device, log_start, &header);
+}
+
+/* Commits the running transaction and writes its sectors to their
+   home locations, as described at the top of this file.  Returns
+   once they are on disk. */
+void journal_commit(void) {
+  size_t cnt, i;
+
+  ASSERT(thread_current()->journal_depth == 0);
+  lock_acquire(&commit_lock);
+
+  /* 1. */
+  lock_acquire(&journal_lock);
+  committing = true;
+  while (handle_cnt > 0)
+    cond_wait(&drained, &journal_lock);
+  cnt = txn_cnt;
+  lock_release(&journal_lock);
+
+  if (cnt > 0) {
+    /* 2. */
+    cache_flush();
+
+    /* 3. */
+    for (i = 0; i < cnt; i++)
+      cache_read(txn_sectors[i], log_buf + i * BLOCK_SECTOR_SIZE);
+    block_write_multiple(fs_device, log_start + 1, cnt, log_buf);
+    write_header(cnt);
+
+    /* 4. */
+    for (i = 0; i < cnt; i++)
+      cache_unpin(txn_sectors[i]);
+    cache_flush();
+
+    /* 5. */
+    write_header(0);
+  }
+
+  lock_acquire(&journal_lock);
+  txn_cnt = 0;
+  if (cnt > 0)
+    seq++;
+  committing = false;
+  cond_broadcast(&admitted, &journal_lock);
+  lock_release(&journal_lock);
+
+  lock_release(&commit_lock);
+}
+
+/* Timer callout that wakes the journal thread. */
+static void journal_wake(void* aux UNUSED) { sema_up(&commit_sema); }
+
+/* Thread function for the journal thread, which commits the
+   running transaction every JOURNAL_INTERVAL ticks, or when an
+   operation finds it full. */
+static void journal_thread(void* aux UNUSED) {
+  for (;;) {
+    timer_add_callout(&commit_callout, JOURNAL_INTERVAL, journal_wake, NULL);
+    sema_down(&commit_sema);
+    timer_cancel_callout(&commit_callout);
+    journal_commit();
+  }
+}
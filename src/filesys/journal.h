@@ -0,0 +1,22 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Most sectors one transaction can log. */
+#define JOURNAL_MAX 48
+
+/* Sectors the journal takes up on the file system device. */
+#define JOURNAL_SECTORS (JOURNAL_MAX + 1)
+
+void journal_init(bool format);
+block_sector_t journal_start(void);
+void journal_begin(void);
+void journal_end(void);
+void journal_write(block_sector_t, const void*);
+void journal_write_at(block_sector_t, const void*, size_t ofs, size_t size);
+void journal_commit(void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,123 @@
+#include "filesys/orphan.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+
+/* Orphan list.
+
+   An orphan is an inode that has been removed from its directory
+   but whose sectors have not been freed yet, because it is still
+   open or because inode.c's reclaimer has not got to it.  The
+   list of orphans lives in ORPHAN_SECTOR and changes through the
+   journal, in the same transaction as the directory entry that
+   goes away and the sectors that are freed, so that a crash can
+   never leave an inode that no directory names and no one will
+   free: at the next boot, orphan_recover() frees every inode
+   still on the list.
+
+   The list has room for ORPHAN_MAX inodes.  If more are removed
+   while open, the extra ones are still freed on their last close,
+   just not after a crash.
+
+   Lock order: any file system lock, then orphan_lock, then the
+   journal's lock. */
+
+/* Identifies the orphan list. */
+#define ORPHAN_MAGIC 0x4e414850
+
+/* Number of orphans the list has room for. */
+#define ORPHAN_MAX 126
+
+/* On-disk orphan list.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct orphan_list {
+  unsigned magic;                     /* ORPHAN_MAGIC. */
+  uint32_t cnt;                       /* Number of orphans. */
+  block_sector_t sectors[ORPHAN_MAX]; /* Their inode sectors, in no order. */
+};
+
+static struct orphan_list orphans; /* Copy of ORPHAN_SECTOR. */
+static struct lock orphan_lock;    /* Protects ORPHANS. */
+
+/* Initializes the orphan list, emptying it if FORMAT is true and
+   otherwise reading it from disk. */
+void orphan_init(bool format) {
+  ASSERT(sizeof orphans == BLOCK_SECTOR_SIZE);
+
+  lock_init_named(&orphan_lock, "orphan");
+  if (format) {
+    memset(&orphans, 0, sizeof orphans);
+    orphans.magic = ORPHAN_MAGIC;
+    journal_begin();
+    journal_write(ORPHAN_SECTOR, &orphans);
+    journal_end();
+  } else {
+    cache_read(ORPHAN_SECTOR, &orphans);
+    if (orphans.magic != ORPHAN_MAGIC || orphans.cnt > ORPHAN_MAX)
+      PANIC("orphan list is corrupt");
+  }
+}
+
+/* Returns the index of SECTOR in the list, or the number of
+   orphans if it is not there.  The caller must hold orphan_lock. */
+static size_t find(block_sector_t sector) {
+  size_t i;
+
+  for (i = 0; i < orphans.cnt; i++)
+    if (orphans.sectors[i] == sector)
+      break;
+  return i;
+}
+
+/* Adds the inode in SECTOR to the list, unless it is already
+   there or the list is full. */
+void orphan_add(block_sector_t sector) {
+  journal_begin();
+  lock_acquire(&orphan_lock);
+  if (find(sector) == orphans.cnt && orphans.cnt < ORPHAN_MAX) {
+    orphans.sectors[orphans.cnt++] = sector;
+    journal_write(ORPHAN_SECTOR, &orphans);
+  }
+  lock_release(&orphan_lock);
+  journal_end();
+}
+
+/* Removes the inode in SECTOR from the list, if it is there. */
+void orphan_remove(block_sector_t sector) {
+  size_t i;
+
+  journal_begin();
+  lock_acquire(&orphan_lock);
+  i = find(sector);
+  if (i < orphans.cnt) {
+    orphans.sectors[i] = orphans.sectors[--orphans.cnt];
+    journal_write(ORPHAN_SECTOR, &orphans);
+  }
+  lock_release(&orphan_lock);
+  journal_end();
+}
+
+/* Frees the inodes left on the list by a crash.  They are only
+   handed to the reclaimer, so this returns before they are
+   freed. */
+void orphan_recover(void) {
+  struct orphan_list left;
+  size_t i;
+
+  lock_acquire(&orphan_lock);
+  left = orphans;
+  lock_release(&orphan_lock);
+
+  for (i = 0; i < left.cnt; i++) {
+    struct inode* inode = inode_open(left.sectors[i]);
+    if (inode == NULL)
+      PANIC("out of memory recovering orphan inode %" PRDSNu, left.sectors[i]);
+    inode_remove(inode);
+    inode_close(inode);
+  }
+}
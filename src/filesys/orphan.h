@@ -0,0 +1,12 @@
+#ifndef FILESYS_ORPHAN_H
+#define FILESYS_ORPHAN_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void orphan_init(bool format);
+void orphan_add(block_sector_t);
+void orphan_remove(block_sector_t);
+void orphan_recover(void);
+
+#endif /* filesys/orphan.h */
@@ -0,0 +1,219 @@
+#include "filesys/pipe.h"
+#include <debug.h>
+#include <poll.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A pipe: a ring buffer of bytes that one or more writers put
+   data into and one or more readers take it out of, in order.
+   Each end is a struct file, so that pipes live in the file
+   descriptor table with everything else and are passed on by
+   fork() and spawn() the same way.
+
+   The ring starts as one page and doubles, up to PIPE_MAX_PAGES,
+   whenever a writer finds it full, so that a writer running
+   ahead of its reader blocks only after a burst that large.  The
+   size is always a power of two, so positions wrap with a mask.
+
+   Readers block until there is data or no writer is left, in
+   which case they see end of file.  Writers block until there is
+   room, and stop early once no reader is left. */
+struct pipe {
+  struct lock lock;          /* Protects the members below. */
+  struct condition readable; /* Data arrived or the last writer closed. */
+  struct condition writable; /* Room appeared or the last reader closed. */
+  uint8_t* buf;              /* Ring buffer. */
+  size_t size;               /* Bytes in BUF, a power of two. */
+  size_t head;               /* Offset of the oldest byte in BUF. */
+  size_t used;               /* Number of bytes in BUF. */
+  int readers;               /* Open read ends. */
+  int writers;               /* Open write ends. */
+};
+
+/* Most pages a pipe's ring may grow to. */
+#define PIPE_MAX_PAGES 16
+
+/* Creates a pipe and returns its two ends in *READ_END and
+   *WRITE_END.  Returns false if memory allocation fails. */
+bool pipe_open(struct file** read_end, struct file** write_end) {
+  struct pipe* pipe = malloc(sizeof *pipe);
+
+  if (pipe == NULL)
+    return false;
+  pipe->buf = palloc_get_page(0);
+  if (pipe->buf == NULL) {
+    free(pipe);
+    return false;
+  }
+  lock_init_named(&pipe->lock, "pipe");
+  cond_init(&pipe->readable);
+  cond_init(&pipe->writable);
+  pipe->size = PGSIZE;
+  pipe->head = pipe->used = 0;
+  pipe->readers = pipe->writers = 1;
+
+  *read_end = file_open_pipe(pipe, false);
+  *write_end = file_open_pipe(pipe, true);
+  if (*read_end == NULL || *write_end == NULL) {
+    /* Closing an end closes its side of the pipe, so close the
+       sides that did not get one by hand. */
+    if (*read_end != NULL)
+      file_close(*read_end);
+    else
+      pipe_close(pipe, false);
+    if (*write_end != NULL)
+      file_close(*write_end);
+    else
+      pipe_close(pipe, true);
+    return false;
+  }
+  return true;
+}
+
+/* Closes one read end of PIPE, or one write end if WRITER, and
+   frees PIPE once both sides are closed. */
+void pipe_close(struct pipe* pipe, bool writer) {
+  bool last;
+
+  lock_acquire(&pipe->lock);
+  if (writer) {
+    if (--pipe->writers == 0)
+      cond_broadcast(&pipe->readable, &pipe->lock);
+  } else {
+    if (--pipe->readers == 0)
+      cond_broadcast(&pipe->writable, &pipe->lock);
+  }
+  last = pipe->readers == 0 && pipe->writers == 0;
+  lock_release(&pipe->lock);
+  eventcount_advance(&io_events);
+
+  if (last) {
+    palloc_free_multiple(pipe->buf, pipe->size / PGSIZE);
+    free(pipe);
+  }
+}
+
+/* Doubles PIPE's ring, keeping its contents, if it may grow and
+   memory allows.  Returns true if it grew.  The caller must hold
+   PIPE's lock. */
+static bool pipe_grow(struct pipe* pipe) {
+  size_t pages = pipe->size / PGSIZE;
+  size_t first = pipe->size - pipe->head;
+  uint8_t* buf;
+
+  if (pages >= PIPE_MAX_PAGES)
+    return false;
+  buf = palloc_get_multiple(0, pages * 2);
+  if (buf == NULL)
+    return false;
+
+  /* Straighten the ring out at the start of the new buffer. */
+  if (first > pipe->used)
+    first = pipe->used;
+  memcpy(buf, pipe->buf + pipe->head, first);
+  memcpy(buf + first, pipe->buf, pipe->used - first);
+  palloc_free_multiple(pipe->buf, pages);
+  pipe->buf = buf;
+  pipe->size *= 2;
+  pipe->head = 0;
+  return true;
+}
+
+/* Reads up to SIZE bytes from PIPE into BUFFER, using COPY to
+   move them if it is nonnull.  Waits until there is something to
+   read, then reads only what is there.  Returns the number of
+   bytes read, which is 0 at end of file, once no writer is left,
+   or -1 if COPY fails, in which case nothing is taken. */
+off_t pipe_read(struct pipe* pipe, void* buffer, off_t size, inode_copy_func* copy) {
+  uint8_t* dst = buffer;
+  size_t cnt, first;
+  bool ok = true;
+
+  if (size <= 0)
+    return 0;
+
+  lock_acquire(&pipe->lock);
+  while (pipe->used == 0 && pipe->writers > 0)
+    cond_wait(&pipe->readable, &pipe->lock);
+
+  cnt = pipe->used < (size_t)size ? pipe->used : (size_t)size;
+  first = pipe->size - pipe->head < cnt ? pipe->size - pipe->head : cnt;
+  if (copy != NULL)
+    ok = copy(dst, pipe->buf + pipe->head, first) &&
+         copy(dst + first, pipe->buf, cnt - first);
+  else {
+    memcpy(dst, pipe->buf + pipe->head, first);
+    memcpy(dst + first, pipe->buf, cnt - first);
+  }
+  if (ok && cnt > 0) {
+    pipe->head = (pipe->head + cnt) & (pipe->size - 1);
+    pipe->used -= cnt;
+    cond_broadcast(&pipe->writable, &pipe->lock);
+  }
+  lock_release(&pipe->lock);
+  if (ok && cnt > 0)
+    eventcount_advance(&io_events);
+
+  return ok ? (off_t)cnt : -1;
+}
+
+/* Writes SIZE bytes from BUFFER into PIPE, waiting for room as
+   needed.  Returns the number of bytes written, which is short,
+   possibly 0, only if no reader is left. */
+off_t pipe_write(struct pipe* pipe, const void* buffer, off_t size) {
+  const uint8_t* src = buffer;
+  size_t done = 0;
+
+  if (size <= 0)
+    return 0;
+
+  lock_acquire(&pipe->lock);
+  while (done < (size_t)size && pipe->readers > 0) {
+    size_t tail, cnt, first;
+
+    if (pipe->used == pipe->size && !pipe_grow(pipe)) {
+      cond_wait(&pipe->writable, &pipe->lock);
+      continue;
+    }
+
+    tail = (pipe->head + pipe->used) & (pipe->size - 1);
+    cnt = pipe->size - pipe->used;
+    if (cnt > (size_t)size - done)
+      cnt = (size_t)size - done;
+    first = pipe->size - tail < cnt ? pipe->size - tail : cnt;
+    memcpy(pipe->buf + tail, src + done, first);
+    memcpy(pipe->buf, src + done + first, cnt - first);
+    pipe->used += cnt;
+    done += cnt;
+    cond_broadcast(&pipe->readable, &pipe->lock);
+    eventcount_advance(&io_events);
+  }
+  lock_release(&pipe->lock);
+
+  return done;
+}
+
+/* Returns the poll() events ready on a read end of PIPE, or on a
+   write end if WRITER: POLLIN if a read would not wait, with
+   POLLHUP once no writer is left, and POLLOUT if a write would
+   not wait, or POLLERR once no reader is left. */
+int pipe_poll(struct pipe* pipe, bool writer) {
+  int events = 0;
+
+  lock_acquire(&pipe->lock);
+  if (!writer) {
+    if (pipe->used > 0 || pipe->writers == 0)
+      events |= POLLIN;
+    if (pipe->writers == 0)
+      events |= POLLHUP;
+  } else if (pipe->readers == 0)
+    events |= POLLERR;
+  else if (pipe->used < pipe->size || pipe->size / PGSIZE < PIPE_MAX_PAGES)
+    events |= POLLOUT;
+  lock_release(&pipe->lock);
+
+  return events;
+}
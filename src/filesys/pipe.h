@@ -0,0 +1,16 @@
+#ifndef FILESYS_PIPE_H
+#define FILESYS_PIPE_H
+
+#include <stdbool.h>
+#include "filesys/file.h"
+#include "filesys/off_t.h"
+
+struct pipe;
+
+bool pipe_open(struct file** read_end, struct file** write_end);
+void pipe_close(struct pipe*, bool writer);
+off_t pipe_read(struct pipe*, void*, off_t size, inode_copy_func*);
+off_t pipe_write(struct pipe*, const void*, off_t size);
+int pipe_poll(struct pipe*, bool writer);
+
+#endif /* filesys/pipe.h */
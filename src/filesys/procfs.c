@@ -0,0 +1,149 @@
+#include "filesys/procfs.h"
+#include <console.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/ide.h"
+#include "devices/kbd.h"
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/file.h"
+#include "filesys/fsstat.h"
+#include "filesys/inode.h"
+#include "threads/fpu.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#include "userprog/exception.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/mq.h"
+#include "vm/swap.h"
+#endif
+
+/* Statistics files.
+
+   Every name under /proc is a read-only file that holds the
+   statistics of one subsystem, as text, so that a user program
+   such as `cat' can read them while the kernel runs rather than
+   only at power off.  Opening one calls the function that prints
+   the subsystem's statistics at shutdown, with its output going
+   into memory instead of the console (see console_capture()),
+   and the file is an in-memory inode over that output.  A file
+   is thus a snapshot taken when it was opened, and reading it
+   again means opening it again.  "/proc" itself is a file that
+   lists the names.
+
+   /proc names hide files of the same names on disk.  Output past
+   PROCFS_PAGES pages is dropped. */
+
+/* Most pages of output in a file. */
+#define PROCFS_PAGES 4
+
+static void print_self(void);
+static void print_index(void);
+
+/* A statistics file. */
+struct procfs_entry {
+  const char* name;   /* Name under /proc. */
+  void (*show)(void); /* Prints the file's contents. */
+};
+
+/* Statistics files, in the order that shutdown prints them. */
+static const struct procfs_entry entries[] = {
+    {"timer", timer_print_stats},
+    {"threads", thread_print_stats},
+    {"fpu", fpu_print_stats},
+    {"locks", lock_print_stats},
+    {"palloc", palloc_print_stats},
+    {"malloc", malloc_print_stats},
+    {"kmem", kmem_print_stats},
+    {"workqueues", wq_print_stats},
+    {"rcu", rcu_print_stats},
+    {"block", block_print_stats},
+    {"ide", ide_print_stats},
+    {"cache", cache_print_stats},
+    {"fsstat", fsstat_print},
+    {"console", console_print_stats},
+    {"kbd", kbd_print_stats},
+    {"exceptions", exception_print_stats},
+    {"syscalls", syscall_print_stats},
+    {"pagedir", pagedir_print_stats},
+#ifdef VM
+    {"frames", frame_print_stats},
+    {"swap", swap_print_stats},
+    {"mq", mq_print_stats},
+#endif
+    {"self", print_self},
+};
+#define ENTRY_CNT (sizeof entries / sizeof *entries)
+
+/* Prints the resource usage and system calls of the process that
+   is opening the file. */
+static void print_self(void) {
+  struct process* pcb = thread_current()->pcb;
+  const struct rusage* u;
+
+  if (pcb == NULL)
+    return;
+  u = &pcb->usage;
+  printf("%s: %lld user ticks, %lld kernel ticks, %" PRIu32 " system calls\n", pcb->process_name,
+         u->user_ticks, u->kernel_ticks, u->syscalls);
+  printf("%s: %" PRIu32 " page faults (%" PRIu32 " minor, %" PRIu32 " major), %" PRIu32
+         " evictions\n",
+         pcb->process_name, u->page_faults, u->minor_faults, u->major_faults, u->evictions);
+  printf("%s: %" PRIu64 " sectors read, %" PRIu64 " sectors written\n", pcb->process_name,
+         u->block_reads, u->block_writes);
+  syscall_print_process_stats(pcb);
+}
+
+/* Prints the names of the statistics files, one per line. */
+static void print_index(void) {
+  size_t i;
+
+  for (i = 0; i < ENTRY_CNT; i++)
+    printf("%s\n", entries[i].name);
+}
+
+/* Returns a new file that holds what SHOW prints, or a null
+   pointer if memory allocation fails. */
+static struct file* open_output(void (*show)(void)) {
+  void* pages = palloc_get_multiple(0, PROCFS_PAGES);
+  size_t len;
+
+  if (pages == NULL)
+    return NULL;
+  len = console_capture(show, pages, PROCFS_PAGES * PGSIZE);
+  return file_open(inode_open_mem_pages(pages, PROCFS_PAGES, len));
+}
+
+/* Opens and returns the statistics file named NAME, relative to
+   the root directory, or returns a null pointer if NAME is not
+   under /proc or if memory allocation fails. */
+struct file* procfs_open(const char* name) {
+  size_t i;
+
+  while (*name == '/')
+    name++;
+  if (strstr(name, "proc") != name || (name[4] != '\0' && name[4] != '/'))
+    return NULL;
+  name += 4;
+  while (*name == '/')
+    name++;
+  if (*name == '\0')
+    return open_output(print_index);
+
+  for (i = 0; i < ENTRY_CNT; i++)
+    if (!strcmp(entries[i].name, name))
+      return open_output(entries[i].show);
+  return NULL;
+}
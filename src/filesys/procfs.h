@@ -0,0 +1,6 @@
+#ifndef FILESYS_PROCFS_H
+#define FILESYS_PROCFS_H
+
+struct file* procfs_open(const char* name);
+
+#endif /* filesys/procfs.h */
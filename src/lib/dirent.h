@@ -0,0 +1,30 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+#include <stdint.h>
+
+/* Directory entries for getdents().  Shared between the kernel
+   and user programs. */
+
+/* Directory descriptor that names the current directory, for
+   openat(), createat() and unlinkat(). */
+#define AT_FDCWD -100
+
+/* Longest name in a directory entry, the file system's
+   NAME_MAX. */
+#define DIRENT_NAME_MAX 14
+
+/* File types, for struct dirent's TYPE. */
+#define DT_REG 1 /* Ordinary file. */
+#define DT_DIR 2 /* Directory. */
+
+/* One entry of a directory, with the size and type that would
+   otherwise take opening the file to learn. */
+struct dirent {
+  uint32_t inumber;               /* Inode number. */
+  uint32_t size;                  /* Length in bytes. */
+  uint8_t type;                   /* DT_REG or DT_DIR. */
+  char name[DIRENT_NAME_MAX + 1]; /* Null-terminated name. */
+};
+
+#endif /* lib/dirent.h */
@@ -50,6 +50,58 @@ static inline elem_type last_mask(const struct bitmap* b) {
   return last_bits ? ((elem_type)1 << last_bits) - 1 : (elem_type)-1;
 }
 
+/* Returns an elem_type in which the bits corresponding to bits
+   START through END - 1 are turned on, where both must fall in
+   the same element and END must exceed START. */
+static inline elem_type range_mask(size_t start, size_t end) {
+  elem_type high = ((end - 1) % ELEM_BITS == ELEM_BITS - 1 ? (elem_type)-1
+                                                           : bit_mask(end) - 1);
+  return high & ~(bit_mask(start) - 1);
+}
+
+/* Returns the number of bits set in E. */
+static inline int elem_popcount(elem_type e) {
+  /* Count bits in pairs, then nibbles, then bytes, and add up
+     the bytes with a multiply, rather than calling
+     __builtin_popcountl(), which needs libgcc on i686. */
+  e = e - ((e >> 1) & (elem_type)0x55555555);
+  e = (e & (elem_type)0x33333333) + ((e >> 2) & (elem_type)0x33333333);
+  e = (e + (e >> 4)) & (elem_type)0x0f0f0f0f;
+  return (e * (elem_type)0x01010101) >> 24;
+}
+
+/* Returns the index of the first bit in B at or after START and
+   before END that is set to VALUE, or END if there is none.
+   Examines a whole element at a time, and skips over runs of
+   elements with no such bit four at a time. */
+static size_t find_bit(const struct bitmap* b, size_t start, size_t end, bool value) {
+  elem_type flip = value ? 0 : (elem_type)-1;
+  size_t idx = elem_idx(start);
+  size_t last;
+  elem_type e;
+
+  if (start >= end)
+    return end;
+  last = elem_idx(end - 1);
+  e = (b->bits[idx] ^ flip) & ~(bit_mask(start) - 1);
+  if (e == 0) {
+    idx++;
+    while (idx + 4 <= last + 1 && ((b->bits[idx] ^ flip) | (b->bits[idx + 1] ^ flip) |
+                                   (b->bits[idx + 2] ^ flip) | (b->bits[idx + 3] ^ flip)) == 0)
+      idx += 4;
+    if (idx > last)
+      return end;
+    e = b->bits[idx] ^ flip;
+  }
+  while (e == 0) {
+    if (++idx > last)
+      return end;
+    e = b->bits[idx] ^ flip;
+  }
+  start = idx * ELEM_BITS + __builtin_ctzl(e);
+  return start < end ? start : end;
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -165,47 +217,58 @@ void bitmap_set_all(struct bitmap* b, bool value) {
   bitmap_set_multiple(b, 0, bitmap_size(b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, as by bitmap_mark() and
+   bitmap_reset(). */
 void bitmap_set_multiple(struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i;
+  size_t end = start + cnt;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set(b, start + i, value);
+  while (start < end) {
+    size_t elem_end = (elem_idx(start) + 1) * ELEM_BITS;
+    size_t stop = elem_end < end ? elem_end : end;
+    elem_type* e = &b->bits[elem_idx(start)];
+    elem_type mask = range_mask(start, stop);
+
+    if (value)
+      asm("orl %1, %0" : "=m"(*e) : "r"(mask), "m"(*e) : "cc");
+    else
+      asm("andl %1, %0" : "=m"(*e) : "r"(~mask), "m"(*e) : "cc");
+    start = stop;
+  }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t bitmap_count(const struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test(b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  while (start < end) {
+    size_t elem_end = (elem_idx(start) + 1) * ELEM_BITS;
+    size_t stop = elem_end < end ? elem_end : end;
+    value_cnt += elem_popcount(b->bits[elem_idx(start)] & range_mask(start, stop));
+    start = stop;
+  }
+  return value ? value_cnt : cnt - value_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool bitmap_contains(const struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i;
-
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test(b, start + i) == value)
-      return true;
-  return false;
+  return find_bit(b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -236,12 +299,25 @@ size_t bitmap_scan(const struct bitmap* b, size_t start, size_t cnt, bool value)
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) {
     size_t last = b->bit_cnt - cnt;
-    size_t i;
-    for (i = start; i <= last; i++)
-      if (!bitmap_contains(b, i, cnt, !value))
+    size_t i = start;
+
+    /* Find the next bit set to VALUE, then see how far the run
+       that it starts goes.  A short run is skipped entirely. */
+    while (i <= last) {
+      size_t end;
+
+      i = find_bit(b, i, last + 1, value);
+      if (i > last)
+        break;
+      end = find_bit(b, i, i + cnt, !value);
+      if (end == i + cnt)
         return i;
+      i = end;
+    }
   }
   return BITMAP_ERROR;
 }
@@ -284,6 +360,22 @@ bool bitmap_write(const struct bitmap* b, struct file* file) {
   off_t size = byte_cnt(b->bit_cnt);
   return file_write_at(file, b->bits, size, 0) == size;
 }
+
+/* Writes to FILE just the part of B that holds the CNT bits
+   starting at START, as whole elements.  Returns true if
+   successful, false otherwise. */
+bool bitmap_write_range(const struct bitmap* b, struct file* file, size_t start, size_t cnt) {
+  size_t first, last;
+  off_t size;
+
+  ASSERT(start + cnt <= b->bit_cnt);
+  if (cnt == 0)
+    return true;
+  first = elem_idx(start);
+  last = elem_idx(start + cnt - 1);
+  size = (last - first + 1) * sizeof(elem_type);
+  return file_write_at(file, b->bits + first, size, first * sizeof(elem_type)) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -1,13 +1,17 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/percpu.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 
-static void vprintf_helper(char, void*);
+static void vprintf_helper(const char*, size_t, void*);
+static void putbuf_have_lock(const char*, size_t);
 static void putchar_have_lock(uint8_t c);
 
 /* The console lock.
@@ -57,21 +61,75 @@ static bool use_console_lock;
 static int console_lock_depth;
 
 /* Number of characters written to console. */
-static int64_t write_cnt;
+static struct percpu_counter write_cnt;
+
+/* Output capture.  While console_capture() runs a function, what
+   the thread that called it writes to the console goes into
+   CAPTURE_BUF instead, except from interrupt handlers.  Other
+   threads' output still goes to the console.  capture_lock
+   allows one capture at a time. */
+static struct lock capture_lock;
+static struct thread* capture_thread; /* Thread whose output is captured, or null. */
+static char* capture_buf;             /* Buffer for the output. */
+static size_t capture_size;           /* Size of CAPTURE_BUF. */
+static size_t capture_len;            /* Bytes of output in CAPTURE_BUF. */
 
 /* Enable console locking. */
 void console_init(void) {
-  lock_init(&console_lock);
+  lock_init_named(&console_lock, "console");
+  lock_init_named(&capture_lock, "console capture");
   use_console_lock = true;
 }
 
+/* Calls FUNC with what the running thread writes to the console
+   meanwhile, such as with printf(), going into the SIZE bytes at
+   BUF instead, and returns the number of bytes written there.
+   Output beyond SIZE bytes is dropped.  Used to read the
+   statistics that the *_print_stats() functions print. */
+size_t console_capture(void (*func)(void), char* buf, size_t size) {
+  size_t len;
+
+  lock_acquire(&capture_lock);
+  capture_buf = buf;
+  capture_size = size;
+  capture_len = 0;
+  capture_thread = thread_current();
+  func();
+  capture_thread = NULL;
+  len = capture_len;
+  lock_release(&capture_lock);
+  return len;
+}
+
+/* Returns true if the running thread's output is being
+   captured. */
+static bool capturing(void) {
+  return capture_thread != NULL && !intr_context() && capture_thread == thread_current();
+}
+
+/* Appends the N bytes at BUFFER to the capture buffer, as far as
+   there is room. */
+static void capture(const char* buffer, size_t n) {
+  size_t room = capture_size - capture_len;
+
+  if (n > room)
+    n = room;
+  memcpy(capture_buf + capture_len, buffer, n);
+  capture_len += n;
+}
+
 /* Notifies the console that a kernel panic is underway,
    which warns it to avoid trying to take the console lock from
-   now on. */
-void console_panic(void) { use_console_lock = false; }
+   now on, and the serial port to stop buffering. */
+void console_panic(void) {
+  use_console_lock = false;
+  serial_panic();
+}
 
 /* Prints console statistics. */
-void console_print_stats(void) { printf("Console: %lld characters output\n", write_cnt); }
+void console_print_stats(void) {
+  printf("Console: %lld characters output\n", percpu_counter_sum(&write_cnt));
+}
 
 /* Acquires the console lock. */
 static void acquire_console(void) {
@@ -106,7 +164,7 @@ int vprintf(const char* format, va_list args) {
   int char_cnt = 0;
 
   acquire_console();
-  __vprintf(format, args, vprintf_helper, &char_cnt);
+  __vprintf_chunked(format, args, vprintf_helper, &char_cnt);
   release_console();
 
   return char_cnt;
@@ -124,11 +182,12 @@ int puts(const char* s) {
   return 0;
 }
 
-/* Writes the N characters in BUFFER to the console. */
+/* Writes the N characters in BUFFER to the console.  The serial
+   port gets them all at once, so in the usual case this only
+   copies them into its transmit buffer. */
 void putbuf(const char* buffer, size_t n) {
   acquire_console();
-  while (n-- > 0)
-    putchar_have_lock(*buffer++);
+  putbuf_have_lock(buffer, n);
   release_console();
 }
 
@@ -142,10 +201,24 @@ int putchar(int c) {
 }
 
 /* Helper function for vprintf(). */
-static void vprintf_helper(char c, void* char_cnt_) {
+static void vprintf_helper(const char* buffer, size_t n, void* char_cnt_) {
   int* char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock(c);
+  *char_cnt += n;
+  putbuf_have_lock(buffer, n);
+}
+
+/* Writes the N characters in BUFFER to the vga display and serial
+   port.  The caller has already acquired the console lock if
+   appropriate. */
+static void putbuf_have_lock(const char* buffer, size_t n) {
+  ASSERT(console_locked_by_current_thread());
+  if (capturing()) {
+    capture(buffer, n);
+    return;
+  }
+  percpu_counter_add(&write_cnt, n);
+  serial_putbuf((const uint8_t*)buffer, n);
+  vga_putbuf(buffer, n);
 }
 
 /* Writes C to the vga display and serial port.
@@ -153,7 +226,11 @@ static void vprintf_helper(char c, void* char_cnt_) {
    appropriate. */
 static void putchar_have_lock(uint8_t c) {
   ASSERT(console_locked_by_current_thread());
-  write_cnt++;
+  if (capturing()) {
+    capture((const char*)&c, 1);
+    return;
+  }
+  percpu_counter_inc(&write_cnt);
   serial_putc(c);
   vga_putc(c);
 }
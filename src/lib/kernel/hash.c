@@ -16,18 +16,41 @@ static struct hash_elem* find_elem(struct hash*, struct list*, struct hash_elem*
 static void insert_elem(struct hash*, struct list*, struct hash_elem*);
 static void remove_elem(struct hash*, struct hash_elem*);
 static void rehash(struct hash*);
+static size_t find_slot(struct hash*, struct hash_elem*);
+static void remove_slot(struct hash*, size_t slot);
+static bool rehash_open(struct hash*, bool inserting);
+static struct list* first_bucket(struct hash*);
+static struct list* next_bucket(struct hash*, struct list*);
 
 /* Initializes hash table H to compute hash values using HASH and
-   compare hash elements using LESS, given auxiliary data AUX. */
+   compare hash elements using LESS, given auxiliary data AUX.
+   The table is chained and resizes all at once. */
 bool hash_init(struct hash* h, hash_hash_func* hash, hash_less_func* less, void* aux) {
+  return hash_init_mode(h, hash, less, aux, HASH_CHAINED);
+}
+
+/* Initializes hash table H like hash_init(), but organized as
+   MODE says (see hash.h). */
+bool hash_init_mode(struct hash* h, hash_hash_func* hash, hash_less_func* less, void* aux,
+                    enum hash_mode mode) {
   h->elem_cnt = 0;
   h->bucket_cnt = 4;
-  h->buckets = malloc(sizeof *h->buckets * h->bucket_cnt);
+  h->buckets = NULL;
+  h->slots = NULL;
+  h->mode = mode;
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->move_idx = 0;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
 
-  if (h->buckets != NULL) {
+  if (mode == HASH_OPEN)
+    h->slots = malloc(sizeof *h->slots * h->bucket_cnt);
+  else
+    h->buckets = malloc(sizeof *h->buckets * h->bucket_cnt);
+
+  if (h->buckets != NULL || h->slots != NULL) {
     hash_clear(h, NULL);
     return true;
   } else
@@ -46,6 +69,27 @@ bool hash_init(struct hash* h, hash_hash_func* hash, hash_less_func* less, void*
 void hash_clear(struct hash* h, hash_action_func* destructor) {
   size_t i;
 
+  if (h->mode == HASH_OPEN) {
+    for (i = 0; i < h->bucket_cnt; i++) {
+      if (destructor != NULL && h->slots[i] != NULL)
+        destructor(h->slots[i], h->aux);
+      h->slots[i] = NULL;
+    }
+    h->elem_cnt = 0;
+    return;
+  }
+
+  if (h->old_buckets != NULL) {
+    if (destructor != NULL)
+      for (i = h->move_idx; i < h->old_bucket_cnt; i++) {
+        struct list* bucket = &h->old_buckets[i];
+        while (!list_empty(bucket))
+          destructor(list_elem_to_hash_elem(list_pop_front(bucket)), h->aux);
+      }
+    free(h->old_buckets);
+    h->old_buckets = NULL;
+  }
+
   for (i = 0; i < h->bucket_cnt; i++) {
     struct list* bucket = &h->buckets[i];
 
@@ -76,6 +120,8 @@ void hash_destroy(struct hash* h, hash_action_func* destructor) {
   if (destructor != NULL)
     hash_clear(h, destructor);
   free(h->buckets);
+  free(h->slots);
+  free(h->old_buckets);
 }
 
 /* Inserts NEW into hash table H and returns a null pointer, if
@@ -83,9 +129,22 @@ void hash_destroy(struct hash* h, hash_action_func* destructor) {
    If an equal element is already in the table, returns it
    without inserting NEW. */
 struct hash_elem* hash_insert(struct hash* h, struct hash_elem* new) {
-  struct list* bucket = find_bucket(h, new);
-  struct hash_elem* old = find_elem(h, bucket, new);
+  struct list* bucket;
+  struct hash_elem* old;
+
+  if (h->mode == HASH_OPEN) {
+    size_t slot = find_slot(h, new);
+    if (h->slots[slot] != NULL)
+      return h->slots[slot];
+    if (rehash_open(h, true))
+      slot = find_slot(h, new);
+    h->slots[slot] = new;
+    h->elem_cnt++;
+    return NULL;
+  }
 
+  bucket = find_bucket(h, new);
+  old = find_elem(h, bucket, new);
   if (old == NULL)
     insert_elem(h, bucket, new);
 
@@ -97,9 +156,17 @@ struct hash_elem* hash_insert(struct hash* h, struct hash_elem* new) {
 /* Inserts NEW into hash table H, replacing any equal element
    already in the table, which is returned. */
 struct hash_elem* hash_replace(struct hash* h, struct hash_elem* new) {
-  struct list* bucket = find_bucket(h, new);
-  struct hash_elem* old = find_elem(h, bucket, new);
+  struct list* bucket;
+  struct hash_elem* old;
+
+  if (h->mode == HASH_OPEN) {
+    old = hash_delete(h, new);
+    hash_insert(h, new);
+    return old;
+  }
 
+  bucket = find_bucket(h, new);
+  old = find_elem(h, bucket, new);
   if (old != NULL)
     remove_elem(h, old);
   insert_elem(h, bucket, new);
@@ -112,6 +179,8 @@ struct hash_elem* hash_replace(struct hash* h, struct hash_elem* new) {
 /* Finds and returns an element equal to E in hash table H, or a
    null pointer if no equal element exists in the table. */
 struct hash_elem* hash_find(struct hash* h, struct hash_elem* e) {
+  if (h->mode == HASH_OPEN)
+    return h->slots[find_slot(h, e)];
   return find_elem(h, find_bucket(h, e), e);
 }
 
@@ -123,7 +192,20 @@ struct hash_elem* hash_find(struct hash* h, struct hash_elem* e) {
    or own resources that are, then it is the caller's
    responsibility to deallocate them. */
 struct hash_elem* hash_delete(struct hash* h, struct hash_elem* e) {
-  struct hash_elem* found = find_elem(h, find_bucket(h, e), e);
+  struct hash_elem* found;
+
+  if (h->mode == HASH_OPEN) {
+    size_t slot = find_slot(h, e);
+    found = h->slots[slot];
+    if (found != NULL) {
+      remove_slot(h, slot);
+      h->elem_cnt--;
+      rehash_open(h, false);
+    }
+    return found;
+  }
+
+  found = find_elem(h, find_bucket(h, e), e);
   if (found != NULL) {
     remove_elem(h, found);
     rehash(h);
@@ -138,12 +220,19 @@ struct hash_elem* hash_delete(struct hash* h, struct hash_elem* e) {
    hash_insert(), hash_replace(), or hash_delete(), yields
    undefined behavior, whether done from ACTION or elsewhere. */
 void hash_apply(struct hash* h, hash_action_func* action) {
+  struct list* bucket;
   size_t i;
 
   ASSERT(action != NULL);
 
-  for (i = 0; i < h->bucket_cnt; i++) {
-    struct list* bucket = &h->buckets[i];
+  if (h->mode == HASH_OPEN) {
+    for (i = 0; i < h->bucket_cnt; i++)
+      if (h->slots[i] != NULL)
+        action(h->slots[i], h->aux);
+    return;
+  }
+
+  for (bucket = first_bucket(h); bucket != NULL; bucket = next_bucket(h, bucket)) {
     struct list_elem *elem, *next;
 
     for (elem = list_begin(bucket); elem != list_end(bucket); elem = next) {
@@ -175,8 +264,14 @@ void hash_first(struct hash_iterator* i, struct hash* h) {
   ASSERT(h != NULL);
 
   i->hash = h;
-  i->bucket = i->hash->buckets;
-  i->elem = list_elem_to_hash_elem(list_head(i->bucket));
+  i->slot = 0;
+  if (h->mode == HASH_OPEN) {
+    i->bucket = NULL;
+    i->elem = NULL;
+  } else {
+    i->bucket = first_bucket(h);
+    i->elem = list_elem_to_hash_elem(list_head(i->bucket));
+  }
 }
 
 /* Advances I to the next element in the hash table and returns
@@ -190,9 +285,18 @@ void hash_first(struct hash_iterator* i, struct hash* h) {
 struct hash_elem* hash_next(struct hash_iterator* i) {
   ASSERT(i != NULL);
 
+  if (i->hash->mode == HASH_OPEN) {
+    struct hash* h = i->hash;
+    while (i->slot < h->bucket_cnt && h->slots[i->slot] == NULL)
+      i->slot++;
+    i->elem = i->slot < h->bucket_cnt ? h->slots[i->slot++] : NULL;
+    return i->elem;
+  }
+
   i->elem = list_elem_to_hash_elem(list_next(&i->elem->list_elem));
   while (i->elem == list_elem_to_hash_elem(list_end(i->bucket))) {
-    if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt) {
+    i->bucket = next_bucket(i->hash, i->bucket);
+    if (i->bucket == NULL) {
       i->elem = NULL;
       break;
     }
@@ -249,10 +353,35 @@ unsigned hash_string(const char* s_) {
 /* Returns a hash of integer I. */
 unsigned hash_int(int i) { return hash_bytes(&i, sizeof i); }
 
-/* Returns the bucket in H that E belongs in. */
+/* Returns the bucket in H that E belongs in.  While H is being
+   resized incrementally, that is its old bucket, unless that has
+   already been moved. */
 static struct list* find_bucket(struct hash* h, struct hash_elem* e) {
-  size_t bucket_idx = h->hash(e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  unsigned hash = h->hash(e, h->aux);
+
+  if (h->old_buckets != NULL) {
+    size_t old_idx = hash & (h->old_bucket_cnt - 1);
+    if (old_idx >= h->move_idx)
+      return &h->old_buckets[old_idx];
+  }
+  return &h->buckets[hash & (h->bucket_cnt - 1)];
+}
+
+/* Returns the first bucket of chained hash table H to iterate
+   over: the first old bucket that has not been moved, if H is
+   being resized, otherwise its first bucket. */
+static struct list* first_bucket(struct hash* h) {
+  return h->old_buckets != NULL ? &h->old_buckets[h->move_idx] : h->buckets;
+}
+
+/* Returns the bucket of chained hash table H that follows BUCKET
+   in iteration order, or a null pointer if BUCKET is the last.
+   The old buckets not yet moved come before the new buckets. */
+static struct list* next_bucket(struct hash* h, struct list* bucket) {
+  if (h->old_buckets != NULL && bucket >= h->old_buckets &&
+      bucket < h->old_buckets + h->old_bucket_cnt)
+    return ++bucket < h->old_buckets + h->old_bucket_cnt ? bucket : h->buckets;
+  return ++bucket < h->buckets + h->bucket_cnt ? bucket : NULL;
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -279,10 +408,42 @@ static inline size_t is_power_of_2(size_t x) { return x != 0 && turn_off_least_1
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET 4  /* Elems/bucket > 4: increase # of buckets. */
 
+/* Old buckets moved per insertion or deletion while a
+   HASH_INCREMENTAL table is being resized.  Each operation adds
+   or removes one element, so moving more than one bucket each
+   time is enough to finish before the new array needs resizing
+   in turn. */
+#define MOVE_STEP 4
+
+/* Moves up to CNT of the old buckets of hash table H that have
+   not yet been moved into its new buckets, and frees the old
+   bucket array once they all have been. */
+static void move_buckets(struct hash* h, size_t cnt) {
+  while (cnt-- > 0 && h->move_idx < h->old_bucket_cnt) {
+    struct list* old_bucket = &h->old_buckets[h->move_idx++];
+
+    while (!list_empty(old_bucket)) {
+      struct list_elem* elem = list_pop_front(old_bucket);
+      unsigned hash = h->hash(list_elem_to_hash_elem(elem), h->aux);
+      list_push_front(&h->buckets[hash & (h->bucket_cnt - 1)], elem);
+    }
+  }
+
+  if (h->move_idx >= h->old_bucket_cnt) {
+    free(h->old_buckets);
+    h->old_buckets = NULL;
+  }
+}
+
 /* Changes the number of buckets in hash table H to match the
    ideal.  This function can fail because of an out-of-memory
    condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+   we can still continue.
+
+   A HASH_CHAINED table moves all of its elements to the new
+   buckets at once.  A HASH_INCREMENTAL table moves only MOVE_STEP
+   buckets now and as many on each later call, until they are all
+   moved; only then does it consider resizing again. */
 static void rehash(struct hash* h) {
   size_t old_bucket_cnt, new_bucket_cnt;
   struct list *new_buckets, *old_buckets;
@@ -290,6 +451,12 @@ static void rehash(struct hash* h) {
 
   ASSERT(h != NULL);
 
+  /* Finish a resize in progress before starting another. */
+  if (h->old_buckets != NULL) {
+    move_buckets(h, MOVE_STEP);
+    return;
+  }
+
   /* Save old bucket info for later use. */
   old_buckets = h->buckets;
   old_bucket_cnt = h->bucket_cnt;
@@ -322,22 +489,88 @@ static void rehash(struct hash* h) {
   /* Install new bucket info. */
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
+  h->old_buckets = old_buckets;
+  h->old_bucket_cnt = old_bucket_cnt;
+  h->move_idx = 0;
 
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) {
-    struct list* old_bucket;
-    struct list_elem *elem, *next;
+  /* Move old elements into the appropriate new buckets. */
+  move_buckets(h, h->mode == HASH_INCREMENTAL ? MOVE_STEP : old_bucket_cnt);
+}
 
-    old_bucket = &old_buckets[i];
-    for (elem = list_begin(old_bucket); elem != list_end(old_bucket); elem = next) {
-      struct list* new_bucket = find_bucket(h, list_elem_to_hash_elem(elem));
-      next = list_next(elem);
-      list_remove(elem);
-      list_push_front(new_bucket, elem);
+/* Returns the slot in HASH_OPEN table H that holds an element
+   equal to E, or if there is none, the empty slot where E would
+   go. */
+static size_t find_slot(struct hash* h, struct hash_elem* e) {
+  size_t mask = h->bucket_cnt - 1;
+  size_t slot = h->hash(e, h->aux) & mask;
+
+  for (;; slot = (slot + 1) & mask) {
+    struct hash_elem* s = h->slots[slot];
+    if (s == NULL || (!h->less(s, e, h->aux) && !h->less(e, s, h->aux)))
+      return slot;
+  }
+}
+
+/* Empties SLOT in HASH_OPEN table H, then moves back any
+   elements after it in the same probe run that would no longer
+   be found past the gap. */
+static void remove_slot(struct hash* h, size_t slot) {
+  size_t mask = h->bucket_cnt - 1;
+  size_t next;
+
+  h->slots[slot] = NULL;
+  for (next = (slot + 1) & mask; h->slots[next] != NULL; next = (next + 1) & mask) {
+    size_t home = h->hash(h->slots[next], h->aux) & mask;
+
+    /* The element at NEXT can fill the gap at SLOT unless its
+       home slot lies cyclically in (SLOT, NEXT]. */
+    if (((next - home) & mask) >= ((next - slot) & mask)) {
+      h->slots[slot] = h->slots[next];
+      h->slots[next] = NULL;
+      slot = next;
     }
   }
+}
+
+/* Resizes the slot array of HASH_OPEN table H, if needed, so that
+   it stays between 1/8 and 3/4 full, counting one more element
+   if INSERTING.  Returns true if it was resized.  If memory for a
+   bigger array can't be had, the table carries on fuller than
+   that, but it panics rather than fill its last slot, since a
+   completely full table would make unsuccessful lookups loop
+   forever. */
+static bool rehash_open(struct hash* h, bool inserting) {
+  size_t elem_cnt = h->elem_cnt + inserting;
+  size_t old_cnt = h->bucket_cnt, new_cnt;
+  struct hash_elem** old_slots = h->slots;
+  struct hash_elem** new_slots;
+  size_t i;
+
+  if (elem_cnt * 4 <= old_cnt * 3 && (elem_cnt * 8 >= old_cnt || old_cnt <= 4))
+    return false;
 
-  free(old_buckets);
+  /* Aim for half full. */
+  for (new_cnt = 4; new_cnt < elem_cnt * 2; new_cnt *= 2)
+    continue;
+  if (new_cnt == old_cnt)
+    return false;
+
+  new_slots = malloc(sizeof *new_slots * new_cnt);
+  if (new_slots == NULL) {
+    if (elem_cnt >= old_cnt)
+      PANIC("hash table full and out of memory");
+    return false;
+  }
+  for (i = 0; i < new_cnt; i++)
+    new_slots[i] = NULL;
+
+  h->slots = new_slots;
+  h->bucket_cnt = new_cnt;
+  for (i = 0; i < old_cnt; i++)
+    if (old_slots[i] != NULL)
+      h->slots[find_slot(h, old_slots[i])] = old_slots[i];
+  free(old_slots);
+  return true;
 }
 
 /* Inserts E into BUCKET (in hash table H). */
@@ -18,7 +18,18 @@
    conversion from a struct hash_elem back to a structure object
    that contains it.  This is the same technique used in the
    linked list implementation.  Refer to lib/kernel/list.h for a
-   detailed explanation. */
+   detailed explanation.
+
+   A table initialized with hash_init() resizes itself all at
+   once, moving every element, whenever its load strays too far
+   from the ideal.  hash_init_mode() offers two alternatives.
+   HASH_INCREMENTAL keeps the old bucket array around after a
+   resize and moves a few of its buckets to the new one on each
+   later insertion or deletion, so that no single operation pays
+   for the whole move.  HASH_OPEN does without chains: the table
+   is an array of pointers to elements, probed linearly from the
+   hash value, which suits small tables with cheap keys because a
+   lookup touches one array instead of a list of elements. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -51,25 +62,39 @@ typedef bool hash_less_func(const struct hash_elem* a, const struct hash_elem* b
    data AUX. */
 typedef void hash_action_func(struct hash_elem* e, void* aux);
 
+/* How a hash table is organized. */
+enum hash_mode {
+  HASH_CHAINED,     /* Chained, resized all at once. */
+  HASH_INCREMENTAL, /* Chained, resized a few buckets at a time. */
+  HASH_OPEN         /* Open addressing with linear probing. */
+};
+
 /* Hash table. */
 struct hash {
-  size_t elem_cnt;      /* Number of elements in table. */
-  size_t bucket_cnt;    /* Number of buckets, a power of 2. */
-  struct list* buckets; /* Array of `bucket_cnt' lists. */
-  hash_hash_func* hash; /* Hash function. */
-  hash_less_func* less; /* Comparison function. */
-  void* aux;            /* Auxiliary data for `hash' and `less'. */
+  size_t elem_cnt;          /* Number of elements in table. */
+  size_t bucket_cnt;        /* Number of buckets or slots, a power of 2. */
+  struct list* buckets;     /* Array of `bucket_cnt' lists, if chained. */
+  struct hash_elem** slots; /* Array of `bucket_cnt' slots, if HASH_OPEN. */
+  enum hash_mode mode;      /* How the table is organized. */
+  struct list* old_buckets; /* Buckets being moved from, or null. */
+  size_t old_bucket_cnt;    /* Number of old buckets, a power of 2. */
+  size_t move_idx;          /* Old buckets below this have been moved. */
+  hash_hash_func* hash;     /* Hash function. */
+  hash_less_func* less;     /* Comparison function. */
+  void* aux;                /* Auxiliary data for `hash' and `less'. */
 };
 
 /* A hash table iterator. */
 struct hash_iterator {
   struct hash* hash;      /* The hash table. */
-  struct list* bucket;    /* Current bucket. */
+  struct list* bucket;    /* Current bucket, if chained. */
+  size_t slot;            /* Next slot to look at, if HASH_OPEN. */
   struct hash_elem* elem; /* Current hash element in current bucket. */
 };
 
 /* Basic life cycle. */
 bool hash_init(struct hash*, hash_hash_func*, hash_less_func*, void* aux);
+bool hash_init_mode(struct hash*, hash_hash_func*, hash_less_func*, void* aux, enum hash_mode);
 void hash_clear(struct hash*, hash_action_func*);
 void hash_destroy(struct hash*, hash_action_func*);
 
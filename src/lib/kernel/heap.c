@@ -0,0 +1,155 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* This is a pairing heap, as described by Fredman, Sedgewick,
+   Sleator and Tarjan, "The Pairing Heap: A New Form of
+   Self-Adjusting Heap", Algorithmica 1 (1986).  The heap is a
+   tree in which every node is no greater than its children,
+   which are kept in a doubly linked list.  Linking two trees
+   makes the one with the greater root the first child of the
+   other.  Removing the root leaves a list of subtrees, which are
+   linked in pairs from left to right and then the pairs are
+   linked from right to left. */
+
+static struct heap_elem* link(struct heap*, struct heap_elem*, struct heap_elem*);
+static struct heap_elem* merge_pairs(struct heap*, struct heap_elem* first);
+static void cut(struct heap_elem*);
+
+/* Initializes HEAP as an empty heap that orders its elements
+   using LESS given auxiliary data AUX. */
+void heap_init(struct heap* heap, heap_less_func* less, void* aux) {
+  ASSERT(heap != NULL);
+  ASSERT(less != NULL);
+
+  heap->root = NULL;
+  heap->size = 0;
+  heap->less = less;
+  heap->aux = aux;
+}
+
+/* Inserts E into HEAP.  E must not already be in a heap. */
+void heap_insert(struct heap* heap, struct heap_elem* e) {
+  ASSERT(heap != NULL);
+  ASSERT(e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  heap->root = heap->root != NULL ? link(heap, heap->root, e) : e;
+  heap->size++;
+}
+
+/* Removes E from HEAP.  E must be in HEAP. */
+void heap_remove(struct heap* heap, struct heap_elem* e) {
+  struct heap_elem* rest;
+
+  ASSERT(heap != NULL);
+  ASSERT(e != NULL);
+  ASSERT(heap->size > 0);
+
+  if (e == heap->root) {
+    heap_pop_min(heap);
+    return;
+  }
+
+  cut(e);
+  rest = merge_pairs(heap, e->child);
+  if (rest != NULL)
+    heap->root = link(heap, heap->root, rest);
+  heap->size--;
+}
+
+/* Moves E, which must be in HEAP, to its proper place in HEAP
+   after its value has changed. */
+void heap_update(struct heap* heap, struct heap_elem* e) {
+  heap_remove(heap, e);
+  heap_insert(heap, e);
+}
+
+/* Removes and returns the smallest element in HEAP, which must
+   not be empty. */
+struct heap_elem* heap_pop_min(struct heap* heap) {
+  struct heap_elem* min;
+
+  ASSERT(heap != NULL);
+  ASSERT(heap->size > 0);
+
+  min = heap->root;
+  heap->root = merge_pairs(heap, min->child);
+  heap->size--;
+  return min;
+}
+
+/* Returns the smallest element in HEAP, or a null pointer if
+   HEAP is empty.  If several elements are equally small, returns
+   any one of them. */
+struct heap_elem* heap_min(const struct heap* heap) { return heap->root; }
+
+/* Returns the number of elements in HEAP. */
+size_t heap_size(const struct heap* heap) { return heap->size; }
+
+/* Returns true if HEAP contains no elements, false otherwise. */
+bool heap_empty(const struct heap* heap) { return heap->root == NULL; }
+
+/* Links the trees rooted at A and B, which must not have
+   siblings or parents, and returns the root of the result. */
+static struct heap_elem* link(struct heap* heap, struct heap_elem* a, struct heap_elem* b) {
+  if (heap->less(b, a, heap->aux)) {
+    struct heap_elem* t = a;
+    a = b;
+    b = t;
+  }
+
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  return a;
+}
+
+/* Links the sibling trees starting at FIRST into one tree and
+   returns its root, or a null pointer if FIRST is null. */
+static struct heap_elem* merge_pairs(struct heap* heap, struct heap_elem* first) {
+  struct heap_elem* pairs = NULL; /* Linked pairs, last first. */
+  struct heap_elem* root = NULL;
+
+  /* Link the trees in pairs from left to right, stacking the
+     results through their `next' members. */
+  while (first != NULL) {
+    struct heap_elem* a = first;
+    struct heap_elem* b = a->next;
+
+    a->prev = a->next = NULL;
+    if (b != NULL) {
+      first = b->next;
+      b->prev = b->next = NULL;
+      a = link(heap, a, b);
+    } else
+      first = NULL;
+    a->next = pairs;
+    pairs = a;
+  }
+
+  /* Link the pairs from right to left. */
+  while (pairs != NULL) {
+    struct heap_elem* next = pairs->next;
+    pairs->next = NULL;
+    root = root != NULL ? link(heap, root, pairs) : pairs;
+    pairs = next;
+  }
+
+  if (root != NULL)
+    root->prev = root->next = NULL;
+  return root;
+}
+
+/* Detaches the subtree rooted at E, which must not be the root
+   of its heap, from its parent and siblings. */
+static void cut(struct heap_elem* e) {
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  e->prev = e->next = NULL;
+}
@@ -0,0 +1,67 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Min-heap.
+
+   A priority queue that hands out its smallest element, by a
+   caller-supplied comparison function, in constant time.
+   Insertion takes constant time, and removing the smallest
+   element or an arbitrary one takes O(lg n) amortized time.
+   Unlike a red-black tree, a heap does not keep its elements in
+   order, so it cannot be iterated or searched; it is the cheaper
+   choice where only the smallest element is ever wanted.
+
+   Like the list and hash implementations, the heap does not use
+   dynamic allocation.  Each structure that can be in a heap must
+   embed a struct heap_elem member, and heap_entry() converts a
+   pointer to that member back into a pointer to the enclosing
+   structure.  Refer to lib/kernel/list.h for a detailed
+   explanation of the technique.
+
+   Elements that compare equal come out in no particular order.
+   To change the value of an element in a heap, call
+   heap_update() afterward. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem {
+  struct heap_elem* child; /* First child, or null. */
+  struct heap_elem* next;  /* Next sibling, or null. */
+  struct heap_elem* prev;  /* Previous sibling, else parent, else null. */
+};
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)                                                      \
+  ((STRUCT*)((uint8_t*)&(HEAP_ELEM)->child - offsetof(STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func(const struct heap_elem* a, const struct heap_elem* b, void* aux);
+
+/* Min-heap. */
+struct heap {
+  struct heap_elem* root; /* Smallest element, or null if empty. */
+  size_t size;            /* Number of elements. */
+  heap_less_func* less;   /* Comparison function. */
+  void* aux;              /* Auxiliary data for `less'. */
+};
+
+void heap_init(struct heap*, heap_less_func*, void* aux);
+
+void heap_insert(struct heap*, struct heap_elem*);
+void heap_remove(struct heap*, struct heap_elem*);
+void heap_update(struct heap*, struct heap_elem*);
+struct heap_elem* heap_pop_min(struct heap*);
+
+struct heap_elem* heap_min(const struct heap*);
+size_t heap_size(const struct heap*);
+bool heap_empty(const struct heap*);
+
+#endif /* lib/kernel/heap.h */
@@ -0,0 +1,158 @@
+#include "lz.h"
+#include <string.h>
+#include "../debug.h"
+
+/* Returns the 4 bytes at P as an integer. */
+static uint32_t read32(const uint8_t* p) {
+  uint32_t x;
+  memcpy(&x, p, sizeof x);
+  return x;
+}
+
+/* Returns the hash table index for the 4 bytes X, by Knuth's
+   multiplicative method. */
+static size_t hash32(uint32_t x) { return (x * 2654435761u) >> (32 - LZ_HASH_BITS); }
+
+/* Appends length LEN, less the 15 that its token field already
+   holds, to the output at *OP as extra length bytes.  Assumes
+   there is room. */
+static void put_extra(uint8_t** op, size_t len) {
+  for (len -= 15; len >= 255; len -= 255)
+    *(*op)++ = 255;
+  *(*op)++ = len;
+}
+
+/* Appends a sequence of LIT_LEN literal bytes from LIT, followed
+   by a match of MATCH_LEN bytes at OFFSET bytes back, to the
+   output at *OP, which ends at END.  A MATCH_LEN of 0 ends the
+   output with the literals.  Returns false if there is not room
+   for the sequence. */
+static bool put_sequence(uint8_t** op, uint8_t* end, const uint8_t* lit, size_t lit_len,
+                         size_t offset, size_t match_len) {
+  size_t ml = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+  size_t need = 1 + lit_len + (lit_len >= 15 ? lit_len / 255 + 1 : 0);
+  uint8_t* token;
+
+  if (match_len > 0)
+    need += 2 + (ml >= 15 ? ml / 255 + 1 : 0);
+  if (need > (size_t)(end - *op))
+    return false;
+
+  token = (*op)++;
+  *token = (lit_len < 15 ? lit_len : 15) << 4;
+  if (lit_len >= 15)
+    put_extra(op, lit_len);
+  memcpy(*op, lit, lit_len);
+  *op += lit_len;
+
+  if (match_len > 0) {
+    *token |= ml < 15 ? ml : 15;
+    *(*op)++ = offset & 0xff;
+    *(*op)++ = offset >> 8;
+    if (ml >= 15)
+      put_extra(op, ml);
+  }
+  return true;
+}
+
+/* Compresses the SRC_LEN bytes at SRC, at most LZ_MAX_INPUT, into
+   the DST_CAP bytes at DST.  TABLE is scratch space of
+   LZ_HASH_SIZE entries, which need not be initialized.  Returns
+   the compressed size, or 0 if it would exceed DST_CAP, in which
+   case DST's contents are unspecified. */
+size_t lz_compress(const void* src_, size_t src_len, void* dst_, size_t dst_cap,
+                   uint16_t table[LZ_HASH_SIZE]) {
+  const uint8_t* src = src_;
+  uint8_t* op = dst_;
+  uint8_t* end = op + dst_cap;
+  size_t anchor = 0;
+  size_t ip = 0;
+
+  ASSERT(src_len <= LZ_MAX_INPUT);
+
+  /* Stale entries are harmless: every candidate is checked. */
+  memset(table, 0, LZ_HASH_SIZE * sizeof *table);
+  while (ip + LZ_MIN_MATCH <= src_len) {
+    uint32_t x = read32(src + ip);
+    size_t h = hash32(x);
+    size_t ref = table[h];
+
+    table[h] = ip;
+    if (ref < ip && read32(src + ref) == x) {
+      size_t len = LZ_MIN_MATCH;
+
+      while (ip + len < src_len && src[ref + len] == src[ip + len])
+        len++;
+      if (!put_sequence(&op, end, src + anchor, ip - anchor, ip - ref, len))
+        return 0;
+      ip += len;
+      anchor = ip;
+    } else
+      ip++;
+  }
+  if (!put_sequence(&op, end, src + anchor, src_len - anchor, 0, 0))
+    return 0;
+  return op - (uint8_t*)dst_;
+}
+
+/* Reads an extra length field from the input at *IP, which ends
+   at END, adding it to *LEN.  Returns false if the input ends
+   first. */
+static bool get_extra(const uint8_t** ip, const uint8_t* end, size_t* len) {
+  uint8_t b;
+
+  do {
+    if (*ip >= end)
+      return false;
+    b = *(*ip)++;
+    *len += b;
+  } while (b == 255);
+  return true;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC, produced by
+   lz_compress(), into exactly DST_LEN bytes at DST.  Returns
+   false if SRC is corrupt or does not decompress to DST_LEN
+   bytes, without writing past DST_LEN. */
+bool lz_decompress(const void* src_, size_t src_len, void* dst_, size_t dst_len) {
+  const uint8_t* ip = src_;
+  const uint8_t* in_end = ip + src_len;
+  uint8_t* dst = dst_;
+  uint8_t* op = dst;
+  uint8_t* out_end = dst + dst_len;
+
+  for (;;) {
+    size_t lit_len, match_len, offset;
+    uint8_t token;
+
+    if (ip >= in_end)
+      return false;
+    token = *ip++;
+
+    lit_len = token >> 4;
+    if (lit_len == 15 && !get_extra(&ip, in_end, &lit_len))
+      return false;
+    if (lit_len > (size_t)(in_end - ip) || lit_len > (size_t)(out_end - op))
+      return false;
+    memcpy(op, ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+    if (ip == in_end)
+      return op == out_end;
+
+    if (in_end - ip < 2)
+      return false;
+    offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    match_len = token & 15;
+    if (match_len == 15 && !get_extra(&ip, in_end, &match_len))
+      return false;
+    match_len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > (size_t)(op - dst) || match_len > (size_t)(out_end - op))
+      return false;
+
+    /* Byte by byte, since the match may overlap its own output. */
+    for (; match_len > 0; match_len--, op++)
+      *op = op[-offset];
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ77 compression.
+
+   A small, fast compressor in the style of LZ4, meant for
+   squeezing pages of memory rather than for files: it finds
+   repeats with a single hash probe per position and no entropy
+   coding, so it compresses much less tightly than deflate, but
+   compresses and decompresses a page in a few tens of
+   microseconds.
+
+   The compressed form is a series of sequences.  Each starts with
+   a token byte whose high 4 bits give the number of literal bytes
+   that follow and whose low 4 bits give the length of the match
+   after them, less LZ_MIN_MATCH.  A field of 15 is followed by
+   extra bytes that are added on, each 255 meaning another byte
+   follows.  After the literals come the match's offset back into
+   the output, as 2 bytes little-endian, and then any extra match
+   length bytes.  The last sequence ends after its literals.
+
+   Neither function allocates memory, so both may be called while
+   the system is out of it. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shortest match worth encoding. */
+#define LZ_MIN_MATCH 4
+
+/* Longest input lz_compress() accepts, the farthest an offset can
+   reach. */
+#define LZ_MAX_INPUT 65535
+
+/* Entries in the hash table the compressor works in. */
+#define LZ_HASH_BITS 12
+#define LZ_HASH_SIZE (1u << LZ_HASH_BITS)
+
+size_t lz_compress(const void* src, size_t src_len, void* dst, size_t dst_cap,
+                   uint16_t table[LZ_HASH_SIZE]);
+bool lz_decompress(const void* src, size_t src_len, void* dst, size_t dst_len);
+
+#endif /* lib/kernel/lz.h */
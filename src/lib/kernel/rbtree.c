@@ -0,0 +1,326 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* This is the classic red-black tree of Cormen, Leiserson,
+   Rivest and Stein, "Introduction to Algorithms", chapter 13,
+   except that missing children are represented by null pointers
+   instead of a shared sentinel node.  Null children count as
+   black.  Because the removal fixup may then have to start from
+   a null node, it tracks that node's parent separately. */
+
+static void rotate_left(struct rb_tree*, struct rb_elem*);
+static void rotate_right(struct rb_tree*, struct rb_elem*);
+static void replace_child(struct rb_tree*, struct rb_elem* parent, struct rb_elem* old,
+                          struct rb_elem* new);
+static void insert_fixup(struct rb_tree*, struct rb_elem*);
+static void remove_fixup(struct rb_tree*, struct rb_elem*, struct rb_elem* parent);
+static struct rb_elem* leftmost(struct rb_elem*);
+static struct rb_elem* rightmost(struct rb_elem*);
+
+/* Returns true if E is a red node.  Null nodes are black. */
+static inline bool is_red(const struct rb_elem* e) { return e != NULL && e->red; }
+
+/* Initializes TREE as an empty tree that orders its elements
+   using LESS given auxiliary data AUX. */
+void rb_init(struct rb_tree* tree, rb_less_func* less, void* aux) {
+  ASSERT(tree != NULL);
+  ASSERT(less != NULL);
+
+  tree->root = NULL;
+  tree->min = NULL;
+  tree->size = 0;
+  tree->less = less;
+  tree->aux = aux;
+}
+
+/* Inserts E into TREE, after any elements that compare equal to
+   it.  E must not already be in a tree. */
+void rb_insert(struct rb_tree* tree, struct rb_elem* e) {
+  struct rb_elem** link = &tree->root;
+  struct rb_elem* parent = NULL;
+
+  ASSERT(tree != NULL);
+  ASSERT(e != NULL);
+
+  while (*link != NULL) {
+    parent = *link;
+    link = tree->less(e, parent, tree->aux) ? &parent->left : &parent->right;
+  }
+
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+
+  if (tree->min == NULL || tree->less(e, tree->min, tree->aux))
+    tree->min = e;
+  tree->size++;
+
+  insert_fixup(tree, e);
+}
+
+/* Removes E from TREE.  E must be in TREE. */
+void rb_remove(struct rb_tree* tree, struct rb_elem* e) {
+  struct rb_elem* y; /* Node actually unlinked from its position. */
+  struct rb_elem* x; /* Child that takes y's place, possibly null. */
+  struct rb_elem* x_parent;
+  bool removed_red;
+
+  ASSERT(tree != NULL);
+  ASSERT(e != NULL);
+  ASSERT(tree->size > 0);
+
+  if (tree->min == e)
+    tree->min = rb_next(e);
+
+  /* Find a node with at most one child to splice out: E itself,
+     or else E's successor, which then takes over E's place. */
+  y = (e->left == NULL || e->right == NULL) ? e : leftmost(e->right);
+  x = y->left != NULL ? y->left : y->right;
+  x_parent = y->parent;
+  removed_red = y->red;
+
+  if (x != NULL)
+    x->parent = y->parent;
+  replace_child(tree, y->parent, y, x);
+
+  if (y != e) {
+    if (x_parent == e)
+      x_parent = y;
+    y->left = e->left;
+    y->right = e->right;
+    y->parent = e->parent;
+    y->red = e->red;
+    if (y->left != NULL)
+      y->left->parent = y;
+    if (y->right != NULL)
+      y->right->parent = y;
+    replace_child(tree, y->parent, e, y);
+  }
+
+  tree->size--;
+  if (!removed_red)
+    remove_fixup(tree, x, x_parent);
+}
+
+/* Returns the smallest element in TREE, or a null pointer if
+   TREE is empty.  Takes constant time. */
+struct rb_elem* rb_min(const struct rb_tree* tree) {
+  return tree->min;
+}
+
+/* Returns the largest element in TREE, or a null pointer if
+   TREE is empty. */
+struct rb_elem* rb_max(const struct rb_tree* tree) {
+  return tree->root != NULL ? rightmost(tree->root) : NULL;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the largest. */
+struct rb_elem* rb_next(struct rb_elem* e) {
+  ASSERT(e != NULL);
+
+  if (e->right != NULL)
+    return leftmost(e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element that precedes E in its tree, or a null
+   pointer if E is the smallest. */
+struct rb_elem* rb_prev(struct rb_elem* e) {
+  ASSERT(e != NULL);
+
+  if (e->left != NULL)
+    return rightmost(e->left);
+  while (e->parent != NULL && e == e->parent->left)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the first element in TREE that is not less than KEY,
+   or a null pointer if there is none.  KEY need not be in the
+   tree; typically it is a stack-allocated structure with just
+   the fields that the comparison function examines filled in. */
+struct rb_elem* rb_lower_bound(const struct rb_tree* tree, const struct rb_elem* key) {
+  struct rb_elem* e = tree->root;
+  struct rb_elem* found = NULL;
+
+  while (e != NULL) {
+    if (tree->less(e, key, tree->aux))
+      e = e->right;
+    else {
+      found = e;
+      e = e->left;
+    }
+  }
+  return found;
+}
+
+/* Returns the number of elements in TREE. */
+size_t rb_size(const struct rb_tree* tree) { return tree->size; }
+
+/* Returns true if TREE contains no elements, false otherwise. */
+bool rb_empty(const struct rb_tree* tree) { return tree->root == NULL; }
+
+/* Returns the leftmost node in the subtree rooted at E. */
+static struct rb_elem* leftmost(struct rb_elem* e) {
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Returns the rightmost node in the subtree rooted at E. */
+static struct rb_elem* rightmost(struct rb_elem* e) {
+  while (e->right != NULL)
+    e = e->right;
+  return e;
+}
+
+/* Makes NEW take OLD's place as a child of PARENT, or as the
+   root of TREE if PARENT is null.  Does not update NEW's parent
+   pointer. */
+static void replace_child(struct rb_tree* tree, struct rb_elem* parent, struct rb_elem* old,
+                          struct rb_elem* new) {
+  if (parent == NULL)
+    tree->root = new;
+  else if (parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+}
+
+/* Rotates the subtree rooted at X to the left, so that X's right
+   child takes its place. */
+static void rotate_left(struct rb_tree* tree, struct rb_elem* x) {
+  struct rb_elem* y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  y->parent = x->parent;
+  replace_child(tree, x->parent, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Rotates the subtree rooted at X to the right, so that X's left
+   child takes its place. */
+static void rotate_right(struct rb_tree* tree, struct rb_elem* x) {
+  struct rb_elem* y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  y->parent = x->parent;
+  replace_child(tree, x->parent, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Restores the red-black properties after red node E has been
+   inserted into TREE. */
+static void insert_fixup(struct rb_tree* tree, struct rb_elem* e) {
+  struct rb_elem* p;
+
+  while ((p = e->parent) != NULL && p->red) {
+    struct rb_elem* g = p->parent;
+
+    if (p == g->left) {
+      struct rb_elem* u = g->right;
+      if (is_red(u)) {
+        p->red = u->red = false;
+        g->red = true;
+        e = g;
+        continue;
+      }
+      if (e == p->right) {
+        rotate_left(tree, p);
+        e = p;
+        p = e->parent;
+      }
+      p->red = false;
+      g->red = true;
+      rotate_right(tree, g);
+    } else {
+      struct rb_elem* u = g->left;
+      if (is_red(u)) {
+        p->red = u->red = false;
+        g->red = true;
+        e = g;
+        continue;
+      }
+      if (e == p->left) {
+        rotate_right(tree, p);
+        e = p;
+        p = e->parent;
+      }
+      p->red = false;
+      g->red = true;
+      rotate_left(tree, g);
+    }
+  }
+  tree->root->red = false;
+}
+
+/* Restores the red-black properties after a black node has been
+   removed from TREE.  X, which may be null, is the node that
+   took the removed node's place, and PARENT is X's parent. */
+static void remove_fixup(struct rb_tree* tree, struct rb_elem* x, struct rb_elem* parent) {
+  while (x != tree->root && !is_red(x)) {
+    if (x == parent->left) {
+      struct rb_elem* w = parent->right;
+      if (w->red) {
+        w->red = false;
+        parent->red = true;
+        rotate_left(tree, parent);
+        w = parent->right;
+      }
+      if (!is_red(w->left) && !is_red(w->right)) {
+        w->red = true;
+        x = parent;
+        parent = x->parent;
+      } else {
+        if (!is_red(w->right)) {
+          w->left->red = false;
+          w->red = true;
+          rotate_right(tree, w);
+          w = parent->right;
+        }
+        w->red = parent->red;
+        parent->red = false;
+        w->right->red = false;
+        rotate_left(tree, parent);
+        x = tree->root;
+      }
+    } else {
+      struct rb_elem* w = parent->left;
+      if (w->red) {
+        w->red = false;
+        parent->red = true;
+        rotate_right(tree, parent);
+        w = parent->left;
+      }
+      if (!is_red(w->left) && !is_red(w->right)) {
+        w->red = true;
+        x = parent;
+        parent = x->parent;
+      } else {
+        if (!is_red(w->left)) {
+          w->right->red = false;
+          w->red = true;
+          rotate_left(tree, w);
+          w = parent->left;
+        }
+        w->red = parent->red;
+        parent->red = false;
+        w->left->red = false;
+        rotate_right(tree, parent);
+        x = tree->root;
+      }
+    }
+  }
+  if (x != NULL)
+    x->red = false;
+}
@@ -0,0 +1,71 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A balanced binary search tree that keeps its elements ordered
+   by a caller-supplied comparison function.  Insertion, removal
+   of an arbitrary element, and lookup all take O(lg n) time.
+   The tree also caches its minimum element, so rb_min() takes
+   constant time, which makes it suitable as a priority queue
+   whose elements can also be removed from the middle.
+
+   Like the list and hash implementations, the tree does not use
+   dynamic allocation.  Each structure that can be in a tree
+   must embed a struct rb_elem member, and rb_entry() converts a
+   pointer to that member back into a pointer to the enclosing
+   structure.  Refer to lib/kernel/list.h for a detailed
+   explanation of the technique.
+
+   Elements that compare equal are kept in insertion order: a
+   newly inserted element is placed after all elements equal to
+   it. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Red-black tree element. */
+struct rb_elem {
+  struct rb_elem* parent; /* Parent, or null for the root. */
+  struct rb_elem* left;   /* Left child, or null. */
+  struct rb_elem* right;  /* Right child, or null. */
+  bool red;               /* Node color. */
+};
+
+/* Converts pointer to tree element RB_ELEM into a pointer to
+   the structure that RB_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)                                                          \
+  ((STRUCT*)((uint8_t*)&(RB_ELEM)->parent - offsetof(STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func(const struct rb_elem* a, const struct rb_elem* b, void* aux);
+
+/* Red-black tree. */
+struct rb_tree {
+  struct rb_elem* root; /* Root node, or null if empty. */
+  struct rb_elem* min;  /* Leftmost node, or null if empty. */
+  size_t size;          /* Number of elements. */
+  rb_less_func* less;   /* Comparison function. */
+  void* aux;            /* Auxiliary data for `less'. */
+};
+
+void rb_init(struct rb_tree*, rb_less_func*, void* aux);
+
+void rb_insert(struct rb_tree*, struct rb_elem*);
+void rb_remove(struct rb_tree*, struct rb_elem*);
+
+struct rb_elem* rb_min(const struct rb_tree*);
+struct rb_elem* rb_max(const struct rb_tree*);
+struct rb_elem* rb_next(struct rb_elem*);
+struct rb_elem* rb_prev(struct rb_elem*);
+struct rb_elem* rb_lower_bound(const struct rb_tree*, const struct rb_elem* key);
+
+size_t rb_size(const struct rb_tree*);
+bool rb_empty(const struct rb_tree*);
+
+#endif /* lib/kernel/rbtree.h */
@@ -0,0 +1,17 @@
+#ifndef __LIB_MMAN_H
+#define __LIB_MMAN_H
+
+/* Advice for madvise().  Shared between the kernel and user
+   programs. */
+
+#define MADV_NORMAL 0     /* No special treatment. */
+#define MADV_RANDOM 1     /* Expect random access: read only the faulting page. */
+#define MADV_SEQUENTIAL 2 /* Expect sequential access: read far ahead. */
+#define MADV_WILLNEED 3   /* Expect access soon: read the pages now. */
+
+/* Eviction priorities for set_evict_priority(). */
+#define EVICT_PRI_LOW 0    /* Evicted first, even if recently used. */
+#define EVICT_PRI_NORMAL 1 /* Evicted when the clock finds them idle. */
+#define EVICT_PRI_HIGH 2   /* Evicted only after staying idle for longer. */
+
+#endif /* lib/mman.h */
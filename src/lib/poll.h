@@ -0,0 +1,26 @@
+#ifndef __LIB_POLL_H
+#define __LIB_POLL_H
+
+/* Descriptor sets for poll().  Shared between the kernel and
+   user programs. */
+
+/* Most descriptors that one poll() may watch. */
+#define POLL_MAX 16
+
+/* Events in struct pollfd's EVENTS and REVENTS. */
+#define POLLIN 0x01   /* Reading will not block. */
+#define POLLOUT 0x04  /* Writing will not block. */
+#define POLLERR 0x08  /* Pipe has no reader left (REVENTS only). */
+#define POLLHUP 0x10  /* Pipe has no writer left (REVENTS only). */
+#define POLLNVAL 0x20 /* FD is not open (REVENTS only). */
+
+/* One descriptor to watch: FD, for the EVENTS that the caller
+   wants.  poll() sets REVENTS to those that are ready.  A
+   negative FD is skipped. */
+struct pollfd {
+  int fd;
+  short events;
+  short revents;
+};
+
+#endif /* lib/poll.h */
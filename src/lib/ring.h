@@ -0,0 +1,53 @@
+#ifndef __LIB_RING_H
+#define __LIB_RING_H
+
+#include <stdint.h>
+
+/* Rings for batched file I/O.  Shared between the kernel and user
+   programs.
+
+   A process queues operations in the submission queue of a
+   struct io_ring in its own memory, then hands all of them to the
+   kernel with one ring_enter() system call, which runs them in
+   order and posts a completion for each to the completion queue.
+   The process only moves SQ_TAIL and CQ_HEAD, the kernel only
+   SQ_HEAD and CQ_TAIL.  All four count up freely and are taken
+   modulo RING_SIZE to index the queues. */
+
+/* Entries in each queue.  Must be a power of 2. */
+#define RING_SIZE 32
+
+/* Operations, each of which does what the system call of the
+   same name does. */
+enum ring_op {
+  RING_READ,  /* read(FD, BUF, SIZE). */
+  RING_WRITE, /* write(FD, BUF, SIZE). */
+  RING_SEEK,  /* seek(FD, SIZE). */
+  RING_CLOSE  /* close(FD). */
+};
+
+/* A submission queue entry. */
+struct ring_sqe {
+  int op;             /* One of enum ring_op. */
+  int fd;             /* File descriptor. */
+  void* buf;          /* Buffer for RING_READ and RING_WRITE. */
+  unsigned size;      /* Byte count, or position for RING_SEEK. */
+  uint32_t user_data; /* Passed through to the completion. */
+};
+
+/* A completion queue entry. */
+struct ring_cqe {
+  uint32_t user_data; /* From the submission. */
+  int result;         /* Bytes read or written, 0 for RING_SEEK and
+                         RING_CLOSE, or -1 on error. */
+};
+
+/* A submission queue and a completion queue. */
+struct io_ring {
+  unsigned sq_head, sq_tail; /* Next entry the kernel runs, next one to queue. */
+  unsigned cq_head, cq_tail; /* Next entry to reap, next one the kernel posts. */
+  struct ring_sqe sq[RING_SIZE];
+  struct ring_cqe cq[RING_SIZE];
+};
+
+#endif /* lib/ring.h */
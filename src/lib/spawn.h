@@ -0,0 +1,19 @@
+#ifndef __LIB_SPAWN_H
+#define __LIB_SPAWN_H
+
+/* File descriptors for spawn().  Shared between the kernel and
+   user programs. */
+
+/* Most file descriptors that one spawn() may pass on. */
+#define SPAWN_FD_MAX 16
+
+/* Makes file descriptor CHILD_FD in the new process refer to the
+   same open file, including its position, as PARENT_FD does in
+   the process calling spawn().  A CHILD_FD of STDIN_FILENO or
+   STDOUT_FILENO replaces the child's keyboard or console. */
+struct spawn_fd {
+  int parent_fd;
+  int child_fd;
+};
+
+#endif /* lib/spawn.h */
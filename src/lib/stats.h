@@ -0,0 +1,146 @@
+#ifndef __LIB_STATS_H
+#define __LIB_STATS_H
+
+#include <stdint.h>
+
+/* Statistics that the kernel reports to user programs through
+   system calls.  Shared between the kernel and user programs. */
+
+/* Number of buckets in the wakeup latency histogram.  Bucket N
+   counts wakeups whose latency was in [2**N, 2**(N+1)) TSC
+   cycles; the last bucket also counts longer ones. */
+#define SCHED_LATENCY_BUCKETS 32
+
+/* Scheduler statistics, as returned by sched_stats(). */
+struct sched_stats {
+  /* For the calling thread. */
+  uint64_t run_cycles;           /* TSC cycles spent running. */
+  uint64_t ready_cycles;         /* TSC cycles spent ready but not running. */
+  uint32_t voluntary_switches;   /* Times it blocked. */
+  uint32_t involuntary_switches; /* Times it was preempted or yielded. */
+  uint32_t time_slice;           /* Its current time slice, in timer ticks. */
+  uint32_t slices_used_up;       /* Times it was preempted after its whole slice. */
+  uint32_t deadline_throttles;   /* Times it ran out of its deadline budget. */
+  uint32_t deadline_misses;      /* Times it ran out past its deadline. */
+  uint64_t block_read_bytes;     /* Bytes it asked block devices for. */
+  uint64_t block_write_bytes;    /* Bytes it gave block devices. */
+  uint64_t block_wait_cycles;    /* TSC cycles it waited for them. */
+
+  /* System-wide: time from thread_unblock() until the woken
+     thread actually runs. */
+  uint32_t latency_hist[SCHED_LATENCY_BUCKETS];
+};
+
+/* Resources used by a process, as returned by getrusage().
+   Counts cover all of the process's threads. */
+struct rusage {
+  int64_t user_ticks;   /* Timer ticks spent in user mode. */
+  int64_t kernel_ticks; /* Timer ticks spent in the kernel on its behalf. */
+  uint32_t page_faults; /* Page faults taken. */
+  uint32_t syscalls;    /* System calls made. */
+  uint64_t block_reads;       /* Sectors read from block devices. */
+  uint64_t block_writes;      /* Sectors written to block devices. */
+  uint64_t block_wait_cycles; /* TSC cycles spent waiting for them. */
+
+  /* Virtual memory.  Every page fault that maps a page is minor
+     or major; copy-on-write and stack growth faults are minor
+     faults counted again by cause. */
+  uint32_t minor_faults; /* Faults that mapped a page without I/O. */
+  uint32_t major_faults; /* Faults that read a file or swap. */
+  uint32_t cow_faults;   /* Writes that copied a page shared by fork(). */
+  uint32_t stack_faults; /* Faults that grew a stack. */
+  uint32_t evictions;    /* Pages evicted to free their frames. */
+  uint32_t swap_ins;     /* Pages read back from swap. */
+  uint32_t swap_outs;    /* Pages written to swap. */
+  uint32_t working_set;  /* Pages used in the last sampling period. */
+
+  /* Quotas set by set_quota(), 0 for none, and how often they
+     held the process back. */
+  uint32_t cpu_quota;        /* Percent of the CPU it may use. */
+  uint32_t io_quota;         /* Block I/O bytes per second it may transfer. */
+  uint32_t cpu_throttles;    /* Times it used up its CPU quota. */
+  int64_t io_throttle_ticks; /* Ticks it slept to stay within its I/O quota. */
+};
+
+/* System call numbers that per-call statistics cover.  Calls
+   with higher numbers are not counted. */
+#define SYSCALL_STAT_CNT 80
+
+/* Statistics for one system call number. */
+struct syscall_stat {
+  uint64_t cnt;        /* Times called. */
+  uint64_t cycles;     /* TSC cycles spent in the kernel on them, in all. */
+  uint64_t max_cycles; /* TSC cycles taken by the longest. */
+};
+
+/* Statistics for every system call, indexed by SYS_* number, as
+   returned by syscall_stats().  A call that does not return to
+   its caller, such as exit(), is counted but not timed. */
+struct syscall_stats {
+  struct syscall_stat calls[SYSCALL_STAT_CNT];
+};
+
+/* Number of buckets in each block device latency histogram,
+   which are like those of struct sched_stats. */
+#define BLOCK_LATENCY_BUCKETS 32
+
+/* Number of buckets in each block device queue depth histogram.
+   Bucket N counts requests that found N requests queued or in
+   flight ahead of them; the last bucket also counts more. */
+#define BLOCK_DEPTH_BUCKETS 16
+
+/* Statistics for one block device, as returned by blkstat().
+   Queue time runs from submission until the driver starts on a
+   request, service time from then until the driver is done. */
+struct block_stats {
+  char name[16];                                /* Device name, e.g. "hda1". */
+  uint64_t read_sectors;                        /* Sectors read. */
+  uint64_t write_sectors;                       /* Sectors written. */
+  uint64_t requests;                            /* Requests completed. */
+  uint64_t queue_cycles;                        /* TSC cycles queued, in all. */
+  uint64_t service_cycles;                      /* TSC cycles in service, in all. */
+  uint32_t queue_hist[BLOCK_LATENCY_BUCKETS];   /* Queue times, by log2 cycles. */
+  uint32_t service_hist[BLOCK_LATENCY_BUCKETS]; /* Service times, by log2 cycles. */
+  uint32_t depth_hist[BLOCK_DEPTH_BUCKETS];     /* Queue depths at submission. */
+  uint64_t urgent;                              /* Requests started ahead of order. */
+};
+
+/* File system operations that fs_stats() times. */
+enum fs_op {
+  FS_OPEN,   /* Opening a file by name. */
+  FS_LOOKUP, /* Looking up a name in a directory. */
+  FS_READ,   /* Reading from a file. */
+  FS_WRITE,  /* Writing to a file. */
+  FS_CREATE, /* Creating a file. */
+  FS_REMOVE, /* Removing a file. */
+  FS_OP_CNT  /* Number of operations. */
+};
+
+/* Number of buckets in each operation's latency histogram, which
+   are like those of struct sched_stats. */
+#define FS_LATENCY_BUCKETS 32
+
+/* Statistics for one file system operation. */
+struct fs_op_stats {
+  uint64_t cnt;                              /* Times performed. */
+  uint64_t cycles;                           /* TSC cycles taken in all. */
+  uint32_t latency_hist[FS_LATENCY_BUCKETS]; /* Latencies, by log2 cycles. */
+};
+
+/* System-wide file system statistics, as returned by fs_stats(). */
+struct fs_stats {
+  struct fs_op_stats ops[FS_OP_CNT]; /* Indexed by enum fs_op. */
+
+  /* Buffer cache. */
+  uint64_t cache_hits;    /* Lookups that found their sector. */
+  uint64_t cache_misses;  /* Lookups that did not. */
+  uint64_t evict_writes;  /* Dirty sectors written back to make room. */
+  uint64_t ra_reads;      /* Sectors read ahead. */
+  uint64_t ra_used;       /* Sectors read ahead and then looked up. */
+  uint64_t ra_unused;     /* Sectors read ahead and evicted unused. */
+  uint64_t ra_dropped;    /* Read-ahead requests dropped as the queue was full. */
+  uint64_t flush_runs;    /* Transfers made to write back dirty sectors. */
+  uint64_t flush_sectors; /* Sectors written back by those transfers. */
+};
+
+#endif /* lib/stats.h */
@@ -12,7 +12,7 @@ struct vsnprintf_aux {
   int max_length; /* Max length of output string. */
 };
 
-static void vsnprintf_helper(char, void*);
+static void vsnprintf_helper(const char*, size_t, void*);
 
 /* Like vprintf(), except that output is stored into BUFFER,
    which must have space for BUF_SIZE characters.  Writes at most
@@ -29,7 +29,7 @@ int vsnprintf(char* buffer, size_t buf_size, const char* format, va_list args) {
   aux.max_length = buf_size > 0 ? buf_size - 1 : 0;
 
   /* Do most of the work. */
-  __vprintf(format, args, vsnprintf_helper, &aux);
+  __vprintf_chunked(format, args, vsnprintf_helper, &aux);
 
   /* Add null terminator. */
   if (buf_size > 0)
@@ -39,11 +39,16 @@ int vsnprintf(char* buffer, size_t buf_size, const char* format, va_list args) {
 }
 
 /* Helper function for vsnprintf(). */
-static void vsnprintf_helper(char ch, void* aux_) {
+static void vsnprintf_helper(const char* buffer, size_t n, void* aux_) {
   struct vsnprintf_aux* aux = aux_;
+  int room = aux->max_length - aux->length;
 
-  if (aux->length++ < aux->max_length)
-    *aux->p++ = ch;
+  if (room > 0) {
+    size_t copy = n < (size_t)room ? n : (size_t)room;
+    memcpy(aux->p, buffer, copy);
+    aux->p += copy;
+  }
+  aux->length += n;
 }
 
 /* Like printf(), except that output is stored into BUFFER,
@@ -129,28 +134,90 @@ static const struct integer_base base_X = {16, "0123456789ABCDEF", 'X', 4};
 static const int powers[16] = {0,      10,      100,      1000,      10000,
                                100000, 1000000, 10000000, 100000000, 1000000000};
 
+/* Pairs of decimal digits "00" through "99", so that decimal
+   conversions need only one division for every two digits. */
+static const char digit_pairs[] = "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+                                  "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+/* Output buffer for __vprintf_chunked().  Collects literal text
+   and formatted fields, so that a typical call hands its whole
+   output to the OUTPUT function at once. */
+struct printf_output {
+  void (*output)(const char*, size_t, void*); /* Output function. */
+  void* aux;                                  /* Its auxiliary data. */
+  size_t len;                                 /* Bytes in BUF. */
+  char buf[128];                              /* Pending output. */
+};
+
 static const char* parse_conversion(const char* format, struct printf_conversion*, va_list*);
 static void format_integer(uintmax_t value, bool is_signed, bool negative,
                            const struct integer_base*, const struct printf_conversion*,
-                           void (*output)(char, void*), void* aux);
-static void output_dup(char ch, size_t cnt, void (*output)(char, void*), void* aux);
+                           struct printf_output*);
 static void format_string(const char* string, int length, struct printf_conversion*,
-                          void (*output)(char, void*), void* aux);
+                          struct printf_output*);
+static void output_flush(struct printf_output*);
+static void output_chars(struct printf_output*, const char*, size_t);
+static void output_dup(struct printf_output*, char ch, size_t cnt);
+
+/* Adds CH to OUT. */
+static inline void output_char(struct printf_output* out, char ch) {
+  if (out->len >= sizeof out->buf)
+    output_flush(out);
+  out->buf[out->len++] = ch;
+}
+
+/* Auxiliary data for vprintf_char_helper(). */
+struct vprintf_char_aux {
+  void (*output)(char, void*); /* Character output function. */
+  void* aux;                   /* Its auxiliary data. */
+};
+
+/* Passes the N bytes in BUFFER one at a time to the character
+   output function in AUX_. */
+static void vprintf_char_helper(const char* buffer, size_t n, void* aux_) {
+  struct vprintf_char_aux* aux = aux_;
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    aux->output(buffer[i], aux->aux);
+}
 
+/* Formats FORMAT with ARGS, passing the output one character at
+   a time to OUTPUT with auxiliary data AUX.  Callers that can
+   accept more than one character at a time should use
+   __vprintf_chunked() instead. */
 void __vprintf(const char* format, va_list args, void (*output)(char, void*), void* aux) {
+  struct vprintf_char_aux char_aux = {output, aux};
+  __vprintf_chunked(format, args, vprintf_char_helper, &char_aux);
+}
+
+/* Formats FORMAT with ARGS, passing the output to OUTPUT with
+   auxiliary data AUX in runs of one or more characters. */
+void __vprintf_chunked(const char* format, va_list args,
+                       void (*output)(const char*, size_t, void*), void* aux) {
+  struct printf_output out_;
+  struct printf_output* out = &out_;
+
+  out->output = output;
+  out->aux = aux;
+  out->len = 0;
   for (; *format != '\0'; format++) {
     struct printf_conversion c;
 
-    /* Literally copy non-conversions to output. */
+    /* Literally copy runs of non-conversions to output. */
     if (*format != '%') {
-      output(*format, aux);
+      const char* run = format;
+
+      while (format[1] != '\0' && format[1] != '%')
+        format++;
+      output_chars(out, run, format - run + 1);
       continue;
     }
     format++;
 
     /* %% => %. */
     if (*format == '%') {
-      output('%', aux);
+      output_char(out, '%');
       continue;
     }
 
@@ -195,7 +262,7 @@ void __vprintf(const char* format, va_list args, void (*output)(char, void*), vo
             NOT_REACHED();
         }
 
-        format_integer(value < 0 ? -value : value, true, value < 0, &base_d, &c, output, aux);
+        format_integer(value < 0 ? -value : value, true, value < 0, &base_d, &c, out);
       } break;
 
       case 'o':
@@ -255,13 +322,13 @@ void __vprintf(const char* format, va_list args, void (*output)(char, void*), vo
             NOT_REACHED();
         }
 
-        format_integer(value, false, false, b, &c, output, aux);
+        format_integer(value, false, false, b, &c, out);
       } break;
 
       case 'c': {
         /* Treat character as single-character string. */
         char ch = va_arg(args, int);
-        format_string(&ch, 1, &c, output, aux);
+        format_string(&ch, 1, &c, out);
       } break;
 
       case 's': {
@@ -273,7 +340,7 @@ void __vprintf(const char* format, va_list args, void (*output)(char, void*), vo
         /* Limit string length according to precision.
                Note: if c.precision == -1 then strnlen() will get
                SIZE_MAX for MAXLEN, which is just what we want. */
-        format_string(s, strnlen(s, c.precision), &c, output, aux);
+        format_string(s, strnlen(s, c.precision), &c, out);
       } break;
 
       case 'p': {
@@ -282,7 +349,7 @@ void __vprintf(const char* format, va_list args, void (*output)(char, void*), vo
         void* p = va_arg(args, void*);
 
         c.flags = POUND;
-        format_integer((uintptr_t)p, false, false, &base_x, &c, output, aux);
+        format_integer((uintptr_t)p, false, false, &base_x, &c, out);
       } break;
 
       case 'f': {
@@ -308,15 +375,15 @@ void __vprintf(const char* format, va_list args, void (*output)(char, void*), vo
         // Use arbitrary precision length
         int precision = c.precision;
         c.precision = -1;
-        format_integer(first < 0 ? -first : first, true, d < 0, &base_d, &c, output, aux);
+        format_integer(first < 0 ? -first : first, true, d < 0, &base_d, &c, out);
 
         // Print the decimal place
-        output('.', aux);
+        output_char(out, '.');
 
         // Print after the decmial
         // Use the correct precision
         c.precision = precision == 0 ? 1 : precision;
-        format_integer(rest < 0 ? -rest : rest, false, false, &base_d, &c, output, aux);
+        format_integer(rest < 0 ? -rest : rest, false, false, &base_d, &c, out);
       } break;
 
       case 'e':
@@ -326,14 +393,19 @@ void __vprintf(const char* format, va_list args, void (*output)(char, void*), vo
       case 'n':
         /* We don't support printing exponentials,
              and %n can be part of a security hole. */
-        __printf("<<no %%%c in kernel>>", output, aux, *format);
+        output_chars(out, "<<no %", 6);
+        output_char(out, *format);
+        output_chars(out, " in kernel>>", 12);
         break;
 
       default:
-        __printf("<<no %%%c conversion>>", output, aux, *format);
+        output_chars(out, "<<no %", 6);
+        output_char(out, *format);
+        output_chars(out, " conversion>>", 13);
         break;
     }
   }
+  output_flush(out);
 }
 
 /* Parses conversion option characters starting at FORMAT and
@@ -446,17 +518,53 @@ not_a_flag:
   return format;
 }
 
-/* Performs an integer conversion, writing output to OUTPUT with
-   auxiliary data AUX.  The integer converted has absolute value
-   VALUE.  If IS_SIGNED is true, does a signed conversion with
-   NEGATIVE indicating a negative value; otherwise does an
-   unsigned conversion and ignores NEGATIVE.  The output is done
-   according to the provided base B.  Details of the conversion
-   are in C. */
+/* Writes the digits of VALUE in base B into the buffer that ends
+   just before CP, without leading zeros, and returns a pointer to
+   the first digit.  Writes nothing if VALUE is 0. */
+static char* format_digits(uintmax_t value, const struct integer_base* b, char* cp) {
+  if (b->base == 10) {
+    uint32_t v;
+
+    /* Two digits at a time, in 32-bit arithmetic once the value
+       fits, since 64-bit division is a library call on i386. */
+    while (value > UINT32_MAX) {
+      unsigned pair = value % 100;
+      value /= 100;
+      cp -= 2;
+      cp[0] = digit_pairs[pair * 2];
+      cp[1] = digit_pairs[pair * 2 + 1];
+    }
+    for (v = value; v >= 10; v /= 100) {
+      unsigned pair = v % 100;
+      cp -= 2;
+      cp[0] = digit_pairs[pair * 2];
+      cp[1] = digit_pairs[pair * 2 + 1];
+    }
+    if (v > 0)
+      *--cp = '0' + v;
+  } else {
+    /* Bases 8 and 16 are powers of 2: shift instead of divide. */
+    int shift = b->base == 16 ? 4 : 3;
+
+    while (value > 0) {
+      *--cp = b->digits[value & (b->base - 1)];
+      value >>= shift;
+    }
+  }
+  return cp;
+}
+
+/* Performs an integer conversion, writing output to OUT.  The
+   integer converted has absolute value VALUE.  If IS_SIGNED is
+   true, does a signed conversion with NEGATIVE indicating a
+   negative value; otherwise does an unsigned conversion and
+   ignores NEGATIVE.  The output is done according to the provided
+   base B.  Details of the conversion are in C. */
 static void format_integer(uintmax_t value, bool is_signed, bool negative,
                            const struct integer_base* b, const struct printf_conversion* c,
-                           void (*output)(char, void*), void* aux) {
-  char buf[64], *cp; /* Buffer and current position. */
+                           struct printf_output* out) {
+  char buf[64], *cp; /* Buffer and position of first digit. */
+  char* end;         /* End of digits in buffer. */
   int x;             /* `x' character to use or 0 if none. */
   int sign;          /* Sign character or 0 if none. */
   int precision;     /* Rendered precision. */
@@ -481,70 +589,97 @@ static void format_integer(uintmax_t value, bool is_signed, bool negative,
      nonzero value with the # flag. */
   x = (c->flags & POUND) && value ? b->x : 0;
 
-  /* Accumulate digits into buffer.
-     This algorithm produces digits in reverse order, so later we
-     will output the buffer's content in reverse. */
-  cp = buf;
-  digit_cnt = 0;
-  while (value > 0) {
-    if ((c->flags & GROUP) && digit_cnt > 0 && digit_cnt % b->group == 0)
-      *cp++ = ',';
-    *cp++ = b->digits[value % b->base];
-    value /= b->base;
-    digit_cnt++;
-  }
+  /* Accumulate digits into the end of the buffer, from least to
+     most significant. */
+  cp = end = buf + sizeof buf;
+  if (c->flags & GROUP) {
+    digit_cnt = 0;
+    while (value > 0) {
+      if (digit_cnt > 0 && digit_cnt % b->group == 0)
+        *--cp = ',';
+      *--cp = b->digits[value % b->base];
+      value /= b->base;
+      digit_cnt++;
+    }
+  } else
+    cp = format_digits(value, b, cp);
 
-  /* Append enough zeros to match precision.
+  /* Prepend enough zeros to match precision.
      If requested precision is 0, then a value of zero is
      rendered as a null string, otherwise as "0".
      If the # flag is used with base 8, the result must always
      begin with a zero. */
   precision = c->precision < 0 ? 1 : c->precision;
-  while (cp - buf < precision && cp < buf + sizeof buf - 1)
-    *cp++ = '0';
-  if ((c->flags & POUND) && b->base == 8 && (cp == buf || cp[-1] != '0'))
-    *cp++ = '0';
+  while (end - cp < precision && cp > buf + 1)
+    *--cp = '0';
+  if ((c->flags & POUND) && b->base == 8 && (cp == end || *cp != '0'))
+    *--cp = '0';
 
   /* Calculate number of pad characters to fill field width. */
-  pad_cnt = c->width - (cp - buf) - (x ? 2 : 0) - (sign != 0);
+  pad_cnt = c->width - (end - cp) - (x ? 2 : 0) - (sign != 0);
   if (pad_cnt < 0)
     pad_cnt = 0;
 
   /* Do output. */
   if ((c->flags & (MINUS | ZERO)) == 0)
-    output_dup(' ', pad_cnt, output, aux);
+    output_dup(out, ' ', pad_cnt);
   if (sign)
-    output(sign, aux);
+    output_char(out, sign);
   if (x) {
-    output('0', aux);
-    output(x, aux);
+    output_char(out, '0');
+    output_char(out, x);
   }
   if (c->flags & ZERO)
-    output_dup('0', pad_cnt, output, aux);
-  while (cp > buf)
-    output(*--cp, aux);
+    output_dup(out, '0', pad_cnt);
+  output_chars(out, cp, end - cp);
   if (c->flags & MINUS)
-    output_dup(' ', pad_cnt, output, aux);
+    output_dup(out, ' ', pad_cnt);
 }
 
-/* Writes CH to OUTPUT with auxiliary data AUX, CNT times. */
-static void output_dup(char ch, size_t cnt, void (*output)(char, void*), void* aux) {
-  while (cnt-- > 0)
-    output(ch, aux);
+/* Passes the output buffered in OUT to its output function. */
+static void output_flush(struct printf_output* out) {
+  if (out->len > 0)
+    out->output(out->buf, out->len, out->aux);
+  out->len = 0;
+}
+
+/* Adds the N bytes in BUFFER to OUT.  Runs too long to buffer go
+   straight to the output function. */
+static void output_chars(struct printf_output* out, const char* buffer, size_t n) {
+  if (n > sizeof out->buf - out->len) {
+    output_flush(out);
+    if (n >= sizeof out->buf) {
+      out->output(buffer, n, out->aux);
+      return;
+    }
+  }
+  memcpy(out->buf + out->len, buffer, n);
+  out->len += n;
+}
+
+/* Adds CH to OUT, CNT times. */
+static void output_dup(struct printf_output* out, char ch, size_t cnt) {
+  while (cnt > 0) {
+    size_t n;
+
+    if (out->len >= sizeof out->buf)
+      output_flush(out);
+    n = sizeof out->buf - out->len < cnt ? sizeof out->buf - out->len : cnt;
+    memset(out->buf + out->len, ch, n);
+    out->len += n;
+    cnt -= n;
+  }
 }
 
 /* Formats the LENGTH characters starting at STRING according to
-   the conversion specified in C.  Writes output to OUTPUT with
-   auxiliary data AUX. */
+   the conversion specified in C.  Writes output to OUT. */
 static void format_string(const char* string, int length, struct printf_conversion* c,
-                          void (*output)(char, void*), void* aux) {
-  int i;
+                          struct printf_output* out) {
   if (c->width > length && (c->flags & MINUS) == 0)
-    output_dup(' ', c->width - length, output, aux);
-  for (i = 0; i < length; i++)
-    output(string[i], aux);
+    output_dup(out, ' ', c->width - length);
+  output_chars(out, string, length);
   if (c->width > length && (c->flags & MINUS) != 0)
-    output_dup(' ', c->width - length, output, aux);
+    output_dup(out, ' ', c->width - length);
 }
 
 /* Wrapper for __vprintf() that converts varargs into a
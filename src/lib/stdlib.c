@@ -3,6 +3,7 @@
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Converts a string representation of a signed decimal integer
    in S into an `int', which is returned. */
@@ -47,26 +48,41 @@ static int compare_thunk(const void* a, const void* b, void* aux) {
    using COMPARE.  When COMPARE is passed a pair of elements A
    and B, respectively, it must return a strcmp()-type result,
    i.e. less than zero if A < B, zero if A == B, greater than
-   zero if A > B.  Runs in O(n lg n) time and O(1) space in
+   zero if A > B.  Runs in O(n lg n) time and O(lg n) space in
    CNT. */
 void qsort(void* array, size_t cnt, size_t size, int (*compare)(const void*, const void*)) {
   sort(array, cnt, size, compare_thunk, &compare);
 }
 
-/* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
-   with elements of SIZE bytes each. */
-static void do_swap(unsigned char* array, size_t a_idx, size_t b_idx, size_t size) {
-  unsigned char* a = array + (a_idx - 1) * size;
-  unsigned char* b = array + (b_idx - 1) * size;
+/* Swaps the SIZE-byte elements at A and B, a word at a time if
+   both are word-aligned and SIZE is a multiple of a word. */
+static void swap_elems(unsigned char* a, unsigned char* b, size_t size) {
   size_t i;
 
-  for (i = 0; i < size; i++) {
-    unsigned char t = a[i];
-    a[i] = b[i];
-    b[i] = t;
+  if ((((uintptr_t)a | (uintptr_t)b | size) & (sizeof(uint32_t) - 1)) == 0) {
+    uint32_t* wa = (uint32_t*)a;
+    uint32_t* wb = (uint32_t*)b;
+
+    for (i = 0; i < size / sizeof(uint32_t); i++) {
+      uint32_t t = wa[i];
+      wa[i] = wb[i];
+      wb[i] = t;
+    }
+  } else {
+    for (i = 0; i < size; i++) {
+      unsigned char t = a[i];
+      a[i] = b[i];
+      b[i] = t;
+    }
   }
 }
 
+/* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
+   with elements of SIZE bytes each. */
+static void do_swap(unsigned char* array, size_t a_idx, size_t b_idx, size_t size) {
+  swap_elems(array + (a_idx - 1) * size, array + (b_idx - 1) * size, size);
+}
+
 /* Compares elements with 1-based indexes A_IDX and B_IDX in
    ARRAY with elements of SIZE bytes each, using COMPARE to
    compare elements, passing AUX as auxiliary data, and returns a
@@ -103,29 +119,256 @@ static void heapify(unsigned char* array, size_t i, size_t cnt, size_t size,
   }
 }
 
+/* Heapsorts ARRAY of CNT elements of SIZE bytes each.  Used
+   where quicksort keeps choosing bad pivots, since it needs no
+   stack and takes O(n lg n) time whatever the input. */
+static void heap_sort(unsigned char* array, size_t cnt, size_t size,
+                      int (*compare)(const void*, const void*, void* aux), void* aux) {
+  size_t i;
+
+  /* Build a heap. */
+  for (i = cnt / 2; i > 0; i--)
+    heapify(array, i, cnt, size, compare, aux);
+
+  /* Sort the heap. */
+  for (i = cnt; i > 1; i--) {
+    do_swap(array, 1, i, size);
+    heapify(array, 1, i - 1, size, compare, aux);
+  }
+}
+
+/* Quicksort leaves ranges with fewer elements than this to
+   insertion sort. */
+#define INSERTION_SORT_MAX 16
+
+/* Ranges with more elements than this take their pivot from the
+   median of three medians of three, instead of one. */
+#define NINTHER_MIN 128
+
+/* Most element moves partial_insertion_sort() makes before it
+   gives up. */
+#define PARTIAL_INSERTION_MAX 8
+
+/* Element with 0-based index IDX in ARRAY of SIZE-byte
+   elements. */
+#define ELEM(ARRAY, IDX) ((ARRAY) + (IDX) * size)
+
+/* Sorts ARRAY of CNT elements of SIZE bytes each by insertion. */
+static void insertion_sort(unsigned char* array, size_t cnt, size_t size,
+                           int (*compare)(const void*, const void*, void* aux), void* aux) {
+  size_t i, j;
+
+  for (i = 1; i < cnt; i++)
+    for (j = i; j > 0 && compare(ELEM(array, j - 1), ELEM(array, j), aux) > 0; j--)
+      swap_elems(ELEM(array, j - 1), ELEM(array, j), size);
+}
+
+/* Tries to sort ARRAY of CNT elements of SIZE bytes each by
+   insertion, giving up after PARTIAL_INSERTION_MAX moves.
+   Returns true if ARRAY is now sorted.  Either way, ARRAY holds
+   the same elements. */
+static bool partial_insertion_sort(unsigned char* array, size_t cnt, size_t size,
+                                   int (*compare)(const void*, const void*, void* aux),
+                                   void* aux) {
+  size_t moves = 0;
+  size_t i, j;
+
+  for (i = 1; i < cnt; i++) {
+    for (j = i; j > 0 && compare(ELEM(array, j - 1), ELEM(array, j), aux) > 0; j--) {
+      if (++moves > PARTIAL_INSERTION_MAX)
+        return false;
+      swap_elems(ELEM(array, j - 1), ELEM(array, j), size);
+    }
+  }
+  return true;
+}
+
+/* Orders the elements at A, B and C so that *A <= *B <= *C. */
+static void sort3(unsigned char* a, unsigned char* b, unsigned char* c, size_t size,
+                  int (*compare)(const void*, const void*, void* aux), void* aux) {
+  if (compare(a, b, aux) > 0)
+    swap_elems(a, b, size);
+  if (compare(b, c, aux) > 0) {
+    swap_elems(b, c, size);
+    if (compare(a, b, aux) > 0)
+      swap_elems(a, b, size);
+  }
+}
+
+/* Partitions ARRAY of CNT elements of SIZE bytes each around the
+   pivot in element 0: elements less than the pivot end up before
+   it, the rest after it.  Returns the pivot's new index.  Sets
+   *ALREADY to true if no element had to be moved.
+
+   Some element after the pivot must not be less than it, which
+   choosing the pivot by median of three ensures.  That and the
+   pivot itself stop the scans without bounds checks. */
+static size_t partition_right(unsigned char* array, size_t cnt, size_t size,
+                              int (*compare)(const void*, const void*, void* aux), void* aux,
+                              bool* already) {
+  unsigned char* pivot = array;
+  size_t i = 0;
+  size_t j = cnt;
+
+  while (compare(ELEM(array, ++i), pivot, aux) < 0)
+    continue;
+  if (i == 1)
+    while (i < j && compare(ELEM(array, --j), pivot, aux) >= 0)
+      continue;
+  else
+    while (compare(ELEM(array, --j), pivot, aux) >= 0)
+      continue;
+
+  *already = i >= j;
+  while (i < j) {
+    swap_elems(ELEM(array, i), ELEM(array, j), size);
+    while (compare(ELEM(array, ++i), pivot, aux) < 0)
+      continue;
+    while (compare(ELEM(array, --j), pivot, aux) >= 0)
+      continue;
+  }
+
+  swap_elems(pivot, ELEM(array, i - 1), size);
+  return i - 1;
+}
+
+/* Partitions ARRAY of CNT elements of SIZE bytes each around the
+   pivot in element 0: elements not greater than the pivot end up
+   before it, the rest after it.  Returns the pivot's new index.
+   Used when the pivot equals the element just before ARRAY, so
+   that everything ending up before the pivot equals it and need
+   not be sorted further.  This keeps runs of equal elements from
+   costing quadratic time. */
+static size_t partition_left(unsigned char* array, size_t cnt, size_t size,
+                             int (*compare)(const void*, const void*, void* aux), void* aux) {
+  unsigned char* pivot = array;
+  size_t i = 0;
+  size_t j = cnt;
+
+  while (compare(pivot, ELEM(array, --j), aux) < 0)
+    continue;
+  if (j + 1 == cnt)
+    while (i < j && compare(pivot, ELEM(array, ++i), aux) >= 0)
+      continue;
+  else
+    while (compare(pivot, ELEM(array, ++i), aux) >= 0)
+      continue;
+
+  while (i < j) {
+    swap_elems(ELEM(array, i), ELEM(array, j), size);
+    while (compare(pivot, ELEM(array, --j), aux) < 0)
+      continue;
+    while (compare(pivot, ELEM(array, ++i), aux) >= 0)
+      continue;
+  }
+
+  swap_elems(pivot, ELEM(array, j), size);
+  return j;
+}
+
+/* Sorts ARRAY of CNT elements of SIZE bytes each.  LEFTMOST is
+   true if ARRAY starts the whole array being sorted; otherwise,
+   the element just before ARRAY is not greater than any element
+   in it.  After BAD_ALLOWED badly unbalanced partitions, gives up
+   on quicksort and heapsorts what is left.
+
+   Recurses only on the smaller side of each partition, so the
+   recursion is at most lg CNT deep. */
+static void pdq_sort(unsigned char* array, size_t cnt, size_t size,
+                     int (*compare)(const void*, const void*, void* aux), void* aux,
+                     int bad_allowed, bool leftmost) {
+  for (;;) {
+    size_t mid = cnt / 2;
+    size_t pivot, left_cnt, right_cnt;
+    bool already;
+
+    if (cnt < INSERTION_SORT_MAX) {
+      insertion_sort(array, cnt, size, compare, aux);
+      return;
+    }
+
+    /* Move the pivot to element 0. */
+    if (cnt > NINTHER_MIN) {
+      sort3(ELEM(array, 0), ELEM(array, mid), ELEM(array, cnt - 1), size, compare, aux);
+      sort3(ELEM(array, 1), ELEM(array, mid - 1), ELEM(array, cnt - 2), size, compare, aux);
+      sort3(ELEM(array, 2), ELEM(array, mid + 1), ELEM(array, cnt - 3), size, compare, aux);
+      sort3(ELEM(array, mid - 1), ELEM(array, mid), ELEM(array, mid + 1), size, compare, aux);
+      swap_elems(ELEM(array, 0), ELEM(array, mid), size);
+    } else
+      sort3(ELEM(array, mid), ELEM(array, 0), ELEM(array, cnt - 1), size, compare, aux);
+
+    /* If the pivot equals the previous range's pivot, put the
+       elements equal to it on the left and skip them. */
+    if (!leftmost && compare(array - size, array, aux) >= 0) {
+      pivot = partition_left(array, cnt, size, compare, aux);
+      array = ELEM(array, pivot + 1);
+      cnt -= pivot + 1;
+      continue;
+    }
+
+    pivot = partition_right(array, cnt, size, compare, aux, &already);
+    left_cnt = pivot;
+    right_cnt = cnt - pivot - 1;
+
+    if (left_cnt < cnt / 8 || right_cnt < cnt / 8) {
+      /* Badly unbalanced.  Give up if this keeps happening,
+         otherwise swap some elements around to break up whatever
+         pattern caused it. */
+      if (--bad_allowed == 0) {
+        heap_sort(array, cnt, size, compare, aux);
+        return;
+      }
+      if (left_cnt >= INSERTION_SORT_MAX) {
+        swap_elems(ELEM(array, 0), ELEM(array, left_cnt / 4), size);
+        swap_elems(ELEM(array, pivot - 1), ELEM(array, pivot - left_cnt / 4), size);
+      }
+      if (right_cnt >= INSERTION_SORT_MAX) {
+        swap_elems(ELEM(array, pivot + 1), ELEM(array, pivot + 1 + right_cnt / 4), size);
+        swap_elems(ELEM(array, cnt - 1), ELEM(array, cnt - right_cnt / 4), size);
+      }
+    } else if (already &&
+               partial_insertion_sort(array, left_cnt, size, compare, aux) &&
+               partial_insertion_sort(ELEM(array, pivot + 1), right_cnt, size, compare, aux)) {
+      /* The range looked sorted, and it was. */
+      return;
+    }
+
+    if (left_cnt < right_cnt) {
+      pdq_sort(array, left_cnt, size, compare, aux, bad_allowed, leftmost);
+      array = ELEM(array, pivot + 1);
+      cnt = right_cnt;
+      leftmost = false;
+    } else {
+      pdq_sort(ELEM(array, pivot + 1), right_cnt, size, compare, aux, bad_allowed, false);
+      cnt = left_cnt;
+    }
+  }
+}
+
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
    using COMPARE to compare elements, passing AUX as auxiliary
    data.  When COMPARE is passed a pair of elements A and B,
    respectively, it must return a strcmp()-type result, i.e. less
    than zero if A < B, zero if A == B, greater than zero if A >
-   B.  Runs in O(n lg n) time and O(1) space in CNT. */
+   B.  Runs in O(n lg n) time and O(lg n) space in CNT.
+
+   This is a pattern-defeating quicksort: quicksort with
+   insertion sort for short ranges, which notices sorted and
+   nearly sorted input, runs of equal elements, and inputs that
+   defeat its pivot choice, falling back to heapsort for the
+   last. */
 void sort(void* array, size_t cnt, size_t size, int (*compare)(const void*, const void*, void* aux),
           void* aux) {
-  size_t i;
+  int bad_allowed = 1;
+  size_t n;
 
   ASSERT(array != NULL || cnt == 0);
   ASSERT(compare != NULL);
   ASSERT(size > 0);
 
-  /* Build a heap. */
-  for (i = cnt / 2; i > 0; i--)
-    heapify(array, i, cnt, size, compare, aux);
-
-  /* Sort the heap. */
-  for (i = cnt; i > 1; i--) {
-    do_swap(array, 1, i, size);
-    heapify(array, 1, i - 1, size, compare, aux);
-  }
+  for (n = cnt; n > 1; n /= 2)
+    bad_allowed++;
+  pdq_sort(array, cnt, size, compare, aux, bad_allowed, true);
 }
 
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
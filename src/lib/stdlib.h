@@ -8,6 +8,10 @@ int atoi(const char*);
 void qsort(void* array, size_t cnt, size_t size, int (*compare)(const void*, const void*));
 void* bsearch(const void* key, const void* array, size_t cnt, size_t size,
               int (*compare)(const void*, const void*));
+void* malloc(size_t) __attribute__((malloc));
+void* calloc(size_t, size_t) __attribute__((malloc));
+void* realloc(void*, size_t);
+void free(void*);
 
 /* Nonstandard functions. */
 void sort(void* array, size_t cnt, size_t size, int (*compare)(const void*, const void*, void* aux),
@@ -1,10 +1,66 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
 // GCC erroneously emits a nonnull-compare error in the expansion of the ASSERT
 // macro in many places where it is used in this file, even though nothing is
 // marked as nonnull.
 #pragma GCC diagnostic ignored "-Wnonnull-compare"
 
+/* The block move and compare functions below work a 32-bit word
+   at a time with the x86 string instructions once their
+   destination is word-aligned, and fall back to one byte at a
+   time only for the unaligned head and the tail.  Short
+   operations, below WORD_MIN bytes, go a byte at a time
+   throughout, since the setup would cost more than it saves.
+
+   SSE would be faster still for big blocks, but the kernel does
+   not save the SSE registers across interrupts or thread
+   switches, so it must not touch them. */
+#define WORD_MIN 16
+
+/* Copies SIZE bytes from SRC upward to DST, which must not
+   overlap it from above. */
+static inline void copy_up(unsigned char* dst, const unsigned char* src, size_t size) {
+  if (size >= WORD_MIN) {
+    size_t head = -(uintptr_t)dst & 3;
+    size_t words;
+
+    size -= head;
+    words = size / 4;
+    size %= 4;
+    asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(head) : : "memory");
+    asm volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(words) : : "memory");
+  }
+  asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(size) : : "memory");
+}
+
+/* Copies SIZE bytes from SRC downward to DST, starting from the
+   last byte, so that DST may overlap SRC from above.  The
+   direction flag is set only inside this function; interrupt
+   entry clears it for the handler. */
+static inline void copy_down(unsigned char* dst, const unsigned char* src, size_t size) {
+  unsigned char* d = dst + size - 1;
+  const unsigned char* s = src + size - 1;
+
+  asm volatile("std" : : : "cc");
+  if (size >= WORD_MIN) {
+    size_t tail = (uintptr_t)(d + 1) & 3;
+    size_t words;
+
+    size -= tail;
+    words = size / 4;
+    size %= 4;
+    asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(tail) : : "memory");
+    d -= 3;
+    s -= 3;
+    asm volatile("rep movsl" : "+D"(d), "+S"(s), "+c"(words) : : "memory");
+    d += 3;
+    s += 3;
+  }
+  asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(size) : : "memory");
+  asm volatile("cld" : : : "cc");
+}
+
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
 void* memcpy(void* dst_, const void* src_, size_t size) {
@@ -14,8 +70,7 @@ void* memcpy(void* dst_, const void* src_, size_t size) {
   ASSERT(dst != NULL || size == 0);
   ASSERT(src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
+  copy_up(dst, src, size);
 
   return dst_;
 }
@@ -29,17 +84,12 @@ void* memmove(void* dst_, const void* src_, size_t size) {
   ASSERT(dst != NULL || size == 0);
   ASSERT(src != NULL || size == 0);
 
-  if (dst < src) {
-    while (size-- > 0)
-      *dst++ = *src++;
-  } else {
-    dst += size;
-    src += size;
-    while (size-- > 0)
-      *--dst = *--src;
-  }
+  if (dst < src || dst >= src + size)
+    copy_up(dst, src, size);
+  else if (dst > src)
+    copy_down(dst, src, size);
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -53,6 +103,11 @@ int memcmp(const void* a_, const void* b_, size_t size) {
   ASSERT(a != NULL || size == 0);
   ASSERT(b != NULL || size == 0);
 
+  /* Skip equal words, then find the differing byte. */
+  for (; size >= 4 && *(const uint32_t*)a == *(const uint32_t*)b; size -= 4) {
+    a += 4;
+    b += 4;
+  }
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -251,8 +306,18 @@ void* memset(void* dst_, int value, size_t size) {
 
   ASSERT(dst != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = value;
+  if (size >= WORD_MIN) {
+    size_t head = -(uintptr_t)dst & 3;
+    uint32_t word = (unsigned char)value * 0x01010101u;
+    size_t words;
+
+    size -= head;
+    words = size / 4;
+    size %= 4;
+    asm volatile("rep stosb" : "+D"(dst), "+c"(head) : "a"(word) : "memory");
+    asm volatile("rep stosl" : "+D"(dst), "+c"(words) : "a"(word) : "memory");
+  }
+  asm volatile("rep stosb" : "+D"(dst), "+c"(size) : "a"(value) : "memory");
 
   return dst_;
 }
@@ -263,8 +328,20 @@ size_t strlen(const char* string) {
 
   ASSERT(string != NULL);
 
-  for (p = string; *p != '\0'; p++)
-    continue;
+  /* Go a byte at a time up to a word boundary, then a word at a
+     time until a word has a zero byte.  An aligned word never
+     crosses into the next page, so this never reads memory that
+     a byte-at-a-time loop would not. */
+  for (p = string; (uintptr_t)p % 4 != 0; p++)
+    if (*p == '\0')
+      return p - string;
+  for (;; p += 4) {
+    uint32_t w = *(const uint32_t*)p;
+    if (((w - 0x01010101u) & ~w & 0x80808080u) != 0)
+      break;
+  }
+  while (*p != '\0')
+    p++;
   return p - string;
 }
 
@@ -8,6 +8,7 @@ enum {
   SYS_EXIT,         /* Terminate this process. */
   SYS_EXEC,         /* Start another process. */
   SYS_WAIT,         /* Wait for a child process to die. */
+  SYS_WAIT_ANY,     /* Wait for whichever child process dies first. */
   SYS_CREATE,       /* Create a file. */
   SYS_REMOVE,       /* Delete a file. */
   SYS_OPEN,         /* Open a file. */
@@ -18,21 +19,39 @@ enum {
   SYS_TELL,         /* Report current position in a file. */
   SYS_CLOSE,        /* Close a file. */
   SYS_PRACTICE,     /* Returns arg incremented by 1 */
+  SYS_COMPUTE_E,    /* Computes e using the FPU in the kernel */
   SYS_PT_CREATE,    /* Creates a new thread */
   SYS_PT_EXIT,      /* Exits the current thread */
   SYS_PT_JOIN,      /* Waits for thread to finish */
-  SYS_LOCK_INIT,    /* Initializes a lock */
-  SYS_LOCK_ACQUIRE, /* Acquires a lock */
-  SYS_LOCK_RELEASE, /* Releases a lock */
-  SYS_SEMA_INIT,    /* Initializes a semaphore */
-  SYS_SEMA_DOWN,    /* Downs a semaphore */
-  SYS_SEMA_UP,      /* Ups a semaphore */
+  SYS_FUTEX_WAIT,   /* Sleeps on a futex if it holds a value */
+  SYS_FUTEX_WAKE,   /* Wakes threads sleeping on a futex */
   SYS_GET_TID,      /* Gets TID of the current thread */
+  SYS_SET_TLS,      /* Sets the base of the thread's %gs segment */
   SYS_FORK,         /* Creates a copy of the process */
+  SYS_SPAWN,        /* Starts another process with some open files */
+  SYS_SBRK,         /* Moves the end of the heap */
+  SYS_RING_ENTER,   /* Runs the operations queued in an I/O ring */
+  SYS_READV,        /* Reads from a file into several buffers */
+  SYS_WRITEV,       /* Writes several buffers to a file */
+  SYS_PREAD,        /* Reads from a file at an offset */
+  SYS_PWRITE,       /* Writes to a file at an offset */
+  SYS_EXEC_ARGV,    /* Start another process with split arguments */
+  SYS_COPY_RANGE,   /* Copies from one file to another */
+  SYS_SENDFILE,     /* Copies from a file to a file or the console */
+  SYS_FALLOCATE,    /* Allocates space for part of a file */
+  SYS_POLL,         /* Waits for file descriptors to be ready */
+  SYS_PIPE,         /* Creates a pipe */
 
   /* Project 3 and optionally project 4. */
-  SYS_MMAP,   /* Map a file into memory. */
-  SYS_MUNMAP, /* Remove a memory mapping. */
+  SYS_MMAP,       /* Map a file into memory. */
+  SYS_MUNMAP,     /* Remove a memory mapping. */
+  SYS_MADVISE,    /* Give advice about use of memory. */
+  SYS_SHM_CREATE, /* Create a shared memory region. */
+  SYS_SHM_ATTACH, /* Map a shared memory region. */
+  SYS_SHM_DETACH, /* Unmap a shared memory region. */
+  SYS_MQ_CREATE,  /* Create a message queue. */
+  SYS_MQ_SEND,    /* Queue a message. */
+  SYS_MQ_RECEIVE, /* Take a message out of a queue. */
 
   /* Project 3 only. */
   SYS_CHDIR,   /* Change the current directory. */
@@ -40,6 +59,49 @@ enum {
   SYS_READDIR, /* Reads a directory entry. */
   SYS_ISDIR,   /* Tests if a fd represents a directory. */
   SYS_INUMBER, /* Returns the inode number for a fd. */
+
+  /* Durability. */
+  SYS_FSYNC,     /* Writes a file's data and metadata to disk. */
+  SYS_FDATASYNC, /* Writes a file's data to disk. */
+  SYS_SYNC,      /* Writes everything to disk. */
+
+  /* Statistics. */
+  SYS_SCHED_STATS, /* Reports scheduler statistics. */
+  SYS_GETRUSAGE,   /* Reports the process's resource usage. */
+  SYS_FSSTAT,      /* Reports file system statistics. */
+  SYS_BLKSTAT,     /* Reports a block device's statistics. */
+  SYS_SYSCALL_STATS, /* Reports system call counts and times. */
+
+  /* Time. */
+  SYS_CLOCK_GETTIME, /* Reads a clock. */
+
+  /* Scheduling. */
+  SYS_SET_DEADLINE, /* Reserves CPU time in every period. */
+  SYS_SET_QUOTA,    /* Limits the process's CPU and block I/O use. */
+
+  /* Directories. */
+  SYS_GETDENTS,   /* Reads many directory entries at once. */
+  SYS_OPENAT,     /* Opens a file in a directory given by fd. */
+  SYS_CREATEAT,   /* Creates a file in a directory given by fd. */
+  SYS_UNLINKAT,   /* Removes a file from a directory given by fd. */
+  SYS_CLONE_FILE, /* Copies a file by sharing its data. */
+
+  /* Memory locking. */
+  SYS_MLOCK,              /* Keeps pages in memory. */
+  SYS_MUNLOCK,            /* Lets locked pages be evicted again. */
+  SYS_SET_EVICT_PRIORITY, /* Sets how readily the process's pages are evicted. */
+
+  /* Event notification. */
+  SYS_EVENTFD,         /* Creates an event counter. */
+  SYS_TIMERFD_CREATE,  /* Creates a timer. */
+  SYS_TIMERFD_SETTIME, /* Arms or disarms a timer. */
+
+  /* Tuning. */
+  SYS_SYSCTL, /* Reads or sets a kernel tunable. */
+
+  /* Scheduling hints. */
+  SYS_SCHED_YIELD_TO, /* Gives the rest of the time slice to a thread. */
+  SYS_FUTEX_WAKE_ALL, /* Wakes every thread sleeping on a futex at once. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,87 @@
+#ifndef __LIB_TIME_H
+#define __LIB_TIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Clocks for clock_gettime() and the clock page.  Shared between
+   the kernel and user programs. */
+
+/* Clocks that clock_gettime() can read. */
+enum clock_id {
+  CLOCK_REALTIME,  /* Time since the Unix epoch, from the CMOS clock. */
+  CLOCK_MONOTONIC, /* Time since the kernel booted, never set back. */
+};
+
+/* A time, as seconds plus nanoseconds. */
+struct timespec {
+  int64_t tv_sec;  /* Whole seconds. */
+  int32_t tv_nsec; /* Nanoseconds, 0...999,999,999. */
+};
+
+/* Settings for timerfd_settime(): the first expiry, relative to
+   now, or 0 to disarm, and the period after that, or 0 to expire
+   only once. */
+struct itimerspec {
+  struct timespec it_interval; /* Period. */
+  struct timespec it_value;    /* Time to the first expiry. */
+};
+
+/* User virtual address of the clock page, which the kernel maps
+   read-only into every process, just below the user stacks, so
+   that clock_gettime() can read the time without a system
+   call. */
+#define CLOCK_PAGE_ADDR 0x7ff7f000
+
+/* The kernel's time snapshot, kept in the clock page.  The
+   kernel makes SEQ odd, updates the other members and makes SEQ
+   even again, with interrupts off, so a reader that sees the same
+   even SEQ before and after its reads has a consistent copy. */
+struct clock_page {
+  uint32_t seq;      /* Odd while being updated. */
+  uint32_t mult;     /* Nanoseconds per TSC cycle times 2**SHIFT, or 0 if not calibrated. */
+  uint32_t shift;    /* Scale of MULT, at most 32. */
+  int64_t tick_ns;   /* Nanoseconds per timer tick. */
+  int64_t ticks;     /* Timer ticks since boot. */
+  uint64_t tsc_base; /* TSC value at BASE_NS. */
+  int64_t base_ns;   /* Nanoseconds since boot when the TSC read TSC_BASE. */
+  int64_t boot_time; /* Seconds since the Unix epoch at boot. */
+};
+
+/* Converts CYCLES TSC cycles to nanoseconds at MULT and SHIFT,
+   as in struct clock_page, in two halves so that the product
+   cannot overflow. */
+static inline int64_t clock_page_cycles_to_ns(uint64_t cycles, uint32_t mult, uint32_t shift) {
+  uint64_t hi = (cycles >> 32) * mult;
+  uint64_t lo = (cycles & 0xffffffff) * mult;
+  return (int64_t)((hi << (32 - shift)) + (lo >> shift));
+}
+
+/* Reads CP and returns the number of nanoseconds since boot,
+   measured with the TSC if it is calibrated and in whole timer
+   ticks otherwise.  Stores the boot time into *BOOT_TIME if
+   BOOT_TIME is nonnull. */
+static inline int64_t clock_page_read(const volatile struct clock_page* cp, int64_t* boot_time) {
+  uint32_t seq;
+  int64_t ns, boot;
+
+  do {
+    seq = cp->seq;
+    asm volatile("" : : : "memory");
+    if (cp->mult == 0)
+      ns = cp->ticks * cp->tick_ns;
+    else {
+      uint64_t tsc;
+      asm volatile("rdtsc" : "=A"(tsc));
+      ns = cp->base_ns + clock_page_cycles_to_ns(tsc - cp->tsc_base, cp->mult, cp->shift);
+    }
+    boot = cp->boot_time;
+    asm volatile("" : : : "memory");
+  } while ((seq & 1) != 0 || seq != cp->seq);
+
+  if (boot_time != NULL)
+    *boot_time = boot;
+  return ns;
+}
+
+#endif /* lib/time.h */
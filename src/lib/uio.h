@@ -0,0 +1,18 @@
+#ifndef __LIB_UIO_H
+#define __LIB_UIO_H
+
+#include <stddef.h>
+
+/* Buffers for readv() and writev().  Shared between the kernel
+   and user programs. */
+
+/* Most buffers that one readv() or writev() may take. */
+#define IOV_MAX 16
+
+/* One buffer: IOV_LEN bytes at IOV_BASE. */
+struct iovec {
+  void* iov_base;
+  size_t iov_len;
+};
+
+#endif /* lib/uio.h */
@@ -5,7 +5,7 @@
 
 /* The standard vprintf() function,
    which is like printf() but uses a va_list. */
-int vprintf(const char* format, va_list args) { return vhprintf(STDOUT_FILENO, format, args); }
+int vprintf(const char* format, va_list args) { return vfprintf(stdout, format, args); }
 
 /* Like printf(), but writes output to the given HANDLE. */
 int hprintf(int handle, const char* format, ...) {
@@ -19,31 +19,30 @@ int hprintf(int handle, const char* format, ...) {
   return retval;
 }
 
-/* Writes string S to the console, followed by a new-line
+/* Writes string S to stdout, followed by a new-line
    character. */
 int puts(const char* s) {
-  write(STDOUT_FILENO, s, strlen(s));
-  putchar('\n');
-
+  if (fputs(s, stdout) == EOF || fputc('\n', stdout) == EOF)
+    return EOF;
   return 0;
 }
 
-/* Writes C to the console. */
-int putchar(int c) {
-  char c2 = c;
-  write(STDOUT_FILENO, &c2, 1);
-  return c;
-}
+/* Writes C to stdout. */
+int putchar(int c) { return fputc(c, stdout); }
 
-/* Auxiliary data for vhprintf_helper(). */
+/* Auxiliary data for vhprintf_helper().  The buffer holds a
+   page, so most calls make just one write() system call, and when
+   it fills up only whole lines are written out, so that output
+   from different threads or processes is not mixed within a
+   line. */
 struct vhprintf_aux {
-  char buf[64]; /* Character buffer. */
+  char buf[4096]; /* Character buffer. */
   char* p;      /* Current position in buffer. */
   int char_cnt; /* Total characters written so far. */
   int handle;   /* Output file handle. */
 };
 
-static void add_char(char, void*);
+static void add_chars(const char*, size_t, void*);
 static void flush(struct vhprintf_aux*);
 
 /* Formats the printf() format specification FORMAT with
@@ -51,22 +50,48 @@ static void flush(struct vhprintf_aux*);
    HANDLE. */
 int vhprintf(int handle, const char* format, va_list args) {
   struct vhprintf_aux aux;
+
+  /* Keep the order of output that also went through stdout. */
+  if (handle == STDOUT_FILENO)
+    fflush(stdout);
+
   aux.p = aux.buf;
   aux.char_cnt = 0;
   aux.handle = handle;
-  __vprintf(format, args, add_char, &aux);
+  __vprintf_chunked(format, args, add_chars, &aux);
   flush(&aux);
   return aux.char_cnt;
 }
 
-/* Adds C to the buffer in AUX, flushing it if the buffer fills
-   up. */
-static void add_char(char c, void* aux_) {
+/* Adds the N bytes in BUFFER to the buffer in AUX.  Whenever the
+   buffer fills up, writes out its complete lines, or all of it if
+   it holds just part of one line. */
+static void add_chars(const char* buffer, size_t n, void* aux_) {
   struct vhprintf_aux* aux = aux_;
-  *aux->p++ = c;
-  if (aux->p >= aux->buf + sizeof aux->buf)
-    flush(aux);
-  aux->char_cnt++;
+
+  aux->char_cnt += n;
+  while (n > 0) {
+    size_t room = aux->buf + sizeof aux->buf - aux->p;
+    size_t chunk = n < room ? n : room;
+
+    memcpy(aux->p, buffer, chunk);
+    aux->p += chunk;
+    buffer += chunk;
+    n -= chunk;
+    if (aux->p >= aux->buf + sizeof aux->buf) {
+      char* end = aux->p;
+
+      while (end > aux->buf && end[-1] != '\n')
+        end--;
+      if (end == aux->buf)
+        flush(aux);
+      else {
+        write(aux->handle, aux->buf, end - aux->buf);
+        memmove(aux->buf, end, aux->p - end);
+        aux->p = aux->buf + (aux->p - end);
+      }
+    }
+  }
 }
 
 /* Flushes the buffer in AUX. */
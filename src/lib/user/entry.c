@@ -2,5 +2,16 @@
 
 int main(int, char*[]);
 void _start(int argc, char* argv[]);
+void _syscall_init(void);
+void _malloc_init(void);
+void _stdio_init(void);
 
-void _start(int argc, char* argv[]) { exit(main(argc, argv)); }
+void _start(int argc, char* argv[]) {
+  static struct pthread_tls main_tls;
+
+  _syscall_init();
+  _pthread_tls_init(&main_tls);
+  _malloc_init();
+  _stdio_init();
+  exit(main(argc, argv));
+}
@@ -0,0 +1,5 @@
+/* Linked into programs built against the shared user library.
+   The linker puts the .interp section in a PT_INTERP header,
+   which tells the kernel's loader to map libc.so into the process
+   beside the program (see load_library() in userprog/process.c). */
+const char _interp[] __attribute__((section(".interp"))) = "/libc.so";
@@ -0,0 +1,343 @@
+#include <stdlib.h>
+#include <debug.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* User memory allocator.
+
+   Blocks of up to SMALL_MAX bytes, counting an 8-byte header,
+   come in size classes that are powers of two from 16 bytes.
+   Each thread keeps a cache of free blocks of each class, found
+   through its stack slot, so most calls to malloc() and free()
+   touch no shared state and take no lock.  A thread's cache
+   refills from, and spills into, a free list per class that all
+   threads share, which gets new blocks by cutting up whole pages.
+
+   Bigger blocks are runs of whole pages.  Free runs are kept in
+   address order and merged with their neighbours, and a free run
+   at the end of the heap is given back with sbrk().  New pages
+   come from sbrk(), which the kernel backs with zeroed pages that,
+   under VM, only take a frame once they are touched.
+
+   Lock order: heap_lock, then nothing. */
+
+#define PAGE_SIZE 4096
+
+#define MIN_CLASS 4                          /* log2 of smallest block. */
+#define CLASS_CNT 8                          /* 16, 32, ..., 2048 bytes. */
+#define SMALL_MAX (1 << (MIN_CLASS + CLASS_CNT - 1)) /* Largest small block. */
+
+#define CACHE_SLOTS 128 /* Stack slots per process, see userprog/process.h. */
+#define CACHE_MAX 64    /* Most blocks a thread caches per class. */
+#define CACHE_BATCH 16  /* Blocks moved between a cache and its class at once. */
+
+#define HEADER_MAGIC 0x6d616c6c /* Marks an allocated block. */
+
+/* Header in front of each block. */
+struct header {
+  size_t size;    /* Size of the block, including the header. */
+  unsigned magic; /* HEADER_MAGIC while allocated. */
+};
+
+/* A free small block of some class. */
+struct free_block {
+  struct free_block* next;
+};
+
+/* A free run of pages. */
+struct run {
+  size_t size;      /* Size in bytes, a multiple of PAGE_SIZE. */
+  struct run* next; /* Next free run, at a higher address. */
+};
+
+/* A thread's cache of free small blocks. */
+struct cache {
+  struct free_block* blocks[CLASS_CNT]; /* Free blocks of each class. */
+  int cnt[CLASS_CNT];                   /* Number of blocks in BLOCKS. */
+};
+
+static struct cache caches[CACHE_SLOTS]; /* Indexed by stack slot. */
+
+/* Shared state, protected by heap_lock. */
+static lock_t heap_lock;
+static struct free_block* class_blocks[CLASS_CNT]; /* Free blocks of each class. */
+static struct run* free_runs;                      /* Free page runs in address order. */
+
+/* Called from _start(), before any other thread exists. */
+void _malloc_init(void);
+void _malloc_init(void) { lock_init(&heap_lock); }
+
+/* Returns the class of blocks of SIZE bytes, which must be at most
+   SMALL_MAX. */
+static int size_class(size_t size) {
+  int c = 0;
+  while ((size_t)1 << (MIN_CLASS + c) < size)
+    c++;
+  return c;
+}
+
+/* Returns the running thread's cache, or a null pointer if its
+   stack slot has none. */
+static struct cache* thread_cache(void) {
+  int slot = pthread_slot();
+  return slot >= 0 && slot < CACHE_SLOTS ? &caches[slot] : NULL;
+}
+
+/* Extends the heap by PAGE_CNT pages and returns the first one,
+   or a null pointer if the kernel refuses.  The caller must hold
+   heap_lock. */
+static void* more_pages(size_t page_cnt) {
+  uint8_t* brk = sbrk(0);
+  size_t pad;
+
+  /* Someone else may have moved the break by a partial page. */
+  pad = (PAGE_SIZE - (uintptr_t)brk % PAGE_SIZE) % PAGE_SIZE;
+  if (brk == (void*)-1 || sbrk(pad + page_cnt * PAGE_SIZE) == (void*)-1)
+    return NULL;
+  return brk + pad;
+}
+
+/* Returns a run of SIZE bytes, a multiple of PAGE_SIZE, taken from
+   the first free run that is big enough or from new pages.
+   Returns a null pointer if memory is exhausted.  The caller must
+   hold heap_lock. */
+static void* alloc_run(size_t size) {
+  struct run** rp;
+
+  for (rp = &free_runs; *rp != NULL; rp = &(*rp)->next) {
+    struct run* r = *rp;
+    if (r->size == size) {
+      *rp = r->next;
+      return r;
+    } else if (r->size > size) {
+      /* Keep the front of R free and hand out its tail. */
+      r->size -= size;
+      return (uint8_t*)r + r->size;
+    }
+  }
+  return more_pages(size / PAGE_SIZE);
+}
+
+/* Frees the SIZE-byte run at R, merging it with free neighbours,
+   and gives it back to the kernel if it ends up at the end of the
+   heap.  The caller must hold heap_lock. */
+static void free_run(void* r_, size_t size) {
+  struct run* r = r_;
+  struct run** rp;
+  struct run* prev = NULL;
+
+  for (rp = &free_runs; *rp != NULL && *rp < r; rp = &(*rp)->next)
+    prev = *rp;
+  r->size = size;
+  r->next = *rp;
+  *rp = r;
+
+  if (r->next != NULL && (uint8_t*)r + r->size == (uint8_t*)r->next) {
+    r->size += r->next->size;
+    r->next = r->next->next;
+  }
+  if (prev != NULL && (uint8_t*)prev + prev->size == (uint8_t*)r) {
+    prev->size += r->size;
+    prev->next = r->next;
+    r = prev;
+  }
+
+  if (r->next == NULL && (uint8_t*)r + r->size == sbrk(0)) {
+    for (rp = &free_runs; *rp != r; rp = &(*rp)->next)
+      continue;
+    if (sbrk(-(intptr_t)r->size) != (void*)-1)
+      *rp = NULL;
+  }
+}
+
+/* Makes sure the shared list of class C is not empty, cutting up
+   a new page if it is.  Returns false if memory is exhausted.  The
+   caller must hold heap_lock. */
+static bool fill_class(int c) {
+  size_t size = (size_t)1 << (MIN_CLASS + c);
+  uint8_t* page;
+  size_t ofs;
+
+  if (class_blocks[c] != NULL)
+    return true;
+  page = alloc_run(PAGE_SIZE);
+  if (page == NULL)
+    return false;
+  for (ofs = PAGE_SIZE; ofs >= size; ofs -= size) {
+    struct free_block* b = (struct free_block*)(page + ofs - size);
+    b->next = class_blocks[c];
+    class_blocks[c] = b;
+  }
+  return true;
+}
+
+/* Moves up to CACHE_BATCH free blocks of class C from the shared
+   list into cache CACHE.  Returns false if memory is exhausted. */
+static bool refill(struct cache* cache, int c) {
+  int i;
+
+  lock_acquire(&heap_lock);
+  if (!fill_class(c)) {
+    lock_release(&heap_lock);
+    return false;
+  }
+  for (i = 0; i < CACHE_BATCH && class_blocks[c] != NULL; i++) {
+    struct free_block* b = class_blocks[c];
+    class_blocks[c] = b->next;
+    b->next = cache->blocks[c];
+    cache->blocks[c] = b;
+    cache->cnt[c]++;
+  }
+  lock_release(&heap_lock);
+  return true;
+}
+
+/* Moves CACHE_BATCH blocks of class C from cache CACHE back to the
+   shared list. */
+static void spill(struct cache* cache, int c) {
+  int i;
+
+  lock_acquire(&heap_lock);
+  for (i = 0; i < CACHE_BATCH; i++) {
+    struct free_block* b = cache->blocks[c];
+    cache->blocks[c] = b->next;
+    cache->cnt[c]--;
+    b->next = class_blocks[c];
+    class_blocks[c] = b;
+  }
+  lock_release(&heap_lock);
+}
+
+/* Returns a new block of at least SIZE bytes, or a null pointer
+   if memory is exhausted or SIZE is 0. */
+void* malloc(size_t size) {
+  struct header* h;
+  size_t block_size;
+
+  if (size == 0 || size > SIZE_MAX - PAGE_SIZE - sizeof *h)
+    return NULL;
+  block_size = size + sizeof *h;
+
+  if (block_size <= SMALL_MAX) {
+    int c = size_class(block_size);
+    struct cache* cache = thread_cache();
+    struct free_block* b;
+
+    block_size = (size_t)1 << (MIN_CLASS + c);
+    if (cache != NULL) {
+      if (cache->blocks[c] == NULL && !refill(cache, c))
+        return NULL;
+      b = cache->blocks[c];
+      cache->blocks[c] = b->next;
+      cache->cnt[c]--;
+    } else {
+      /* No cache: go straight to the shared list. */
+      lock_acquire(&heap_lock);
+      if (!fill_class(c)) {
+        lock_release(&heap_lock);
+        return NULL;
+      }
+      b = class_blocks[c];
+      class_blocks[c] = b->next;
+      lock_release(&heap_lock);
+    }
+    h = (struct header*)b;
+  } else {
+    block_size = (block_size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    lock_acquire(&heap_lock);
+    h = alloc_run(block_size);
+    lock_release(&heap_lock);
+    if (h == NULL)
+      return NULL;
+  }
+
+  h->size = block_size;
+  h->magic = HEADER_MAGIC;
+  return h + 1;
+}
+
+/* Returns a new block of CNT elements of SIZE bytes each, all set
+   to zero, or a null pointer if memory is exhausted. */
+void* calloc(size_t cnt, size_t size) {
+  void* p;
+
+  if (size != 0 && cnt > SIZE_MAX / size)
+    return NULL;
+  p = malloc(cnt * size);
+  if (p != NULL)
+    memset(p, 0, cnt * size);
+  return p;
+}
+
+/* Returns the header of block P, exiting the process if P was not
+   returned by malloc() or has already been freed. */
+static struct header* block_header(void* p) {
+  struct header* h = (struct header*)p - 1;
+  if (h->magic != HEADER_MAGIC)
+    exit(1);
+  return h;
+}
+
+/* Changes the size of block OLD_BLOCK to NEW_SIZE bytes, which may
+   move it, and returns the block.  As with malloc(), a null
+   OLD_BLOCK allocates a new block, and NEW_SIZE of 0 frees it and
+   returns a null pointer.  If memory is exhausted, returns a null
+   pointer and leaves OLD_BLOCK alone. */
+void* realloc(void* old_block, size_t new_size) {
+  struct header* h;
+  void* new_block;
+
+  if (old_block == NULL)
+    return malloc(new_size);
+  if (new_size == 0) {
+    free(old_block);
+    return NULL;
+  }
+
+  h = block_header(old_block);
+  if (new_size <= h->size - sizeof *h)
+    return old_block;
+  new_block = malloc(new_size);
+  if (new_block != NULL) {
+    memcpy(new_block, old_block, h->size - sizeof *h);
+    free(old_block);
+  }
+  return new_block;
+}
+
+/* Frees block P, which must have been returned by malloc(),
+   calloc() or realloc().  Does nothing if P is null. */
+void free(void* p) {
+  struct header* h;
+  size_t size;
+
+  if (p == NULL)
+    return;
+
+  h = block_header(p);
+  size = h->size;
+  h->magic = 0;
+  if (size <= SMALL_MAX) {
+    int c = size_class(size);
+    struct cache* cache = thread_cache();
+    struct free_block* b = (struct free_block*)h;
+
+    if (cache != NULL) {
+      b->next = cache->blocks[c];
+      cache->blocks[c] = b;
+      if (++cache->cnt[c] > CACHE_MAX)
+        spill(cache, c);
+    } else {
+      lock_acquire(&heap_lock);
+      b->next = class_blocks[c];
+      class_blocks[c] = b;
+      lock_release(&heap_lock);
+    }
+  } else {
+    lock_acquire(&heap_lock);
+    free_run(h, size);
+    lock_release(&heap_lock);
+  }
+}
@@ -1,6 +1,14 @@
 #include <pthread.h>
+#include <stdint.h>
+#include <string.h>
 #include <syscall.h>
 
+/* User stack layout, which must match userprog/process.c.  Each
+   thread's stack lies in its own slot of this size below
+   PHYS_BASE. */
+#define STACK_TOP 0xc0000000
+#define STACK_SLOT_SIZE ((8 * 1024 + 4) * 1024)
+
 void _pthread_start_stub(pthread_fun fun, void* arg);
 
 /* Creates a new thread running fun with the given arg.
@@ -20,10 +28,29 @@ void pthread_exit() {
    Returns false if an error occurred. */
 bool pthread_join(tid_t tid) { return sys_pthread_join(tid) != TID_ERROR; }
 
+/* Returns the index of the running thread's stack slot, a small
+   nonnegative number that is unique among the live threads of
+   the process.  Unlike get_tid(), needs no system call. */
+int pthread_slot(void) {
+  char here;
+  return (STACK_TOP - (uintptr_t)&here) / STACK_SLOT_SIZE;
+}
+
+/* Makes TLS the running thread's thread-local storage block, with
+   all of its slots null.  TLS must last as long as the thread. */
+void _pthread_tls_init(struct pthread_tls* tls) {
+  memset(tls, 0, sizeof *tls);
+  tls->self = tls;
+  set_tls(tls);
+}
+
 /* OS jumps to this function when a new thread is created.
    OS is required to setup the stack for this function and
    set %eip to point to the start of this function */
 void _pthread_start_stub(pthread_fun fun, void* arg) {
+  struct pthread_tls tls; // Lives as long as the thread
+
+  _pthread_tls_init(&tls);
   (*fun)(arg);    // Invoke the thread function
   pthread_exit(); // Call pthread_exit
 }
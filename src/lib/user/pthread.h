@@ -13,5 +13,69 @@ typedef int tid_t;
 tid_t pthread_create(pthread_fun fun, void* arg);
 void pthread_exit(void) NO_RETURN;
 bool pthread_join(tid_t);
+int pthread_slot(void);
+
+/* Thread-local storage.  Each thread's %gs segment begins at its
+   TLS block, whose first member points to the block itself, so
+   that pthread_tls() finds the block without a system call. */
+#define PTHREAD_TLS_SLOTS 16 /* Pointer-sized slots per thread. */
+
+struct pthread_tls {
+  struct pthread_tls* self;       /* This block. */
+  void* slots[PTHREAD_TLS_SLOTS]; /* For the program's use, initially null. */
+};
+
+void _pthread_tls_init(struct pthread_tls*);
+
+/* Returns the running thread's PTHREAD_TLS_SLOTS thread-local
+   slots. */
+static inline void** pthread_tls(void) {
+  struct pthread_tls* tls;
+  asm("movl %%gs:0, %0" : "=r"(tls));
+  return tls->slots;
+}
+
+/* Synchronization types, implemented in lib/user/synch.c on top
+   of futexes.  The members are private to the implementation. */
+typedef struct {
+  int state;      /* 0 if free, 1 if held, 2 if held with waiters. */
+  int owner;      /* Holding thread's key (see synch.c), 0 if free. */
+  unsigned magic; /* Detects uninitialized mutexes. */
+} pthread_mutex_t;
+typedef struct {
+  int seq;        /* Incremented by every signal and broadcast. */
+  int waiters;    /* Number of threads in pthread_cond_wait(). */
+  unsigned magic; /* Detects uninitialized condition variables. */
+} pthread_cond_t;
+typedef struct {
+  int state;           /* Readers holding the lock, or -1 for a writer. */
+  int waiters;         /* Number of threads that may sleep on STATE. */
+  int writers_waiting; /* Number of those that want to write. */
+  unsigned magic;      /* Detects uninitialized rwlocks. */
+} pthread_rwlock_t;
+typedef struct {
+  int count;      /* Number of threads that must arrive. */
+  int arrived;    /* Number arrived so far in this round. */
+  int seq;        /* Incremented when a round completes. */
+  unsigned magic; /* Detects uninitialized barriers. */
+} pthread_barrier_t;
+
+bool pthread_mutex_init(pthread_mutex_t*);
+void pthread_mutex_lock(pthread_mutex_t*);
+bool pthread_mutex_trylock(pthread_mutex_t*);
+void pthread_mutex_unlock(pthread_mutex_t*);
+
+bool pthread_cond_init(pthread_cond_t*);
+void pthread_cond_wait(pthread_cond_t*, pthread_mutex_t*);
+void pthread_cond_signal(pthread_cond_t*);
+void pthread_cond_broadcast(pthread_cond_t*);
+
+bool pthread_rwlock_init(pthread_rwlock_t*);
+void pthread_rwlock_rdlock(pthread_rwlock_t*);
+void pthread_rwlock_wrlock(pthread_rwlock_t*);
+void pthread_rwlock_unlock(pthread_rwlock_t*);
+
+bool pthread_barrier_init(pthread_barrier_t*, int count);
+bool pthread_barrier_wait(pthread_barrier_t*);
 
 #endif /* lib/user/pthread.h */
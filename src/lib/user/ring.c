@@ -0,0 +1,37 @@
+#include <ring.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Initializes RING with empty queues. */
+void ring_init(struct io_ring* ring) { memset(ring, 0, sizeof *ring); }
+
+/* Queues operation OP on file descriptor FD in RING's submission
+   queue, with buffer BUF and byte count or position SIZE as
+   described in <ring.h>.  The completion will carry USER_DATA.
+   Nothing happens until ring_enter().  Returns false if the
+   submission queue is full. */
+bool ring_queue(struct io_ring* ring, enum ring_op op, int fd, void* buf, unsigned size,
+                uint32_t user_data) {
+  struct ring_sqe* sqe;
+
+  if (ring->sq_tail - ring->sq_head >= RING_SIZE)
+    return false;
+  sqe = &ring->sq[ring->sq_tail % RING_SIZE];
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buf = buf;
+  sqe->size = size;
+  sqe->user_data = user_data;
+  ring->sq_tail++;
+  return true;
+}
+
+/* Takes the oldest completion from RING into *CQE.  Returns false
+   if the completion queue is empty. */
+bool ring_reap(struct io_ring* ring, struct ring_cqe* cqe) {
+  if (ring->cq_head == ring->cq_tail)
+    return false;
+  *cqe = ring->cq[ring->cq_head % RING_SIZE];
+  ring->cq_head++;
+  return true;
+}
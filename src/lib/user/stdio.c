@@ -0,0 +1,568 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Buffered streams.
+
+   A stream collects the reads and writes of a file descriptor in
+   a BUFSIZ-byte buffer, allocated on first use, so that most calls
+   make no system call at all.  Streams that fopen() and fdopen()
+   return are fully buffered: their output is written when the
+   buffer fills, on fflush(), and on fclose().  stdout is line
+   buffered: it is also written at the end of every call that
+   outputs a new-line, and when the buffer fills, only its complete
+   lines are written, so that lines from different threads or
+   processes do not mix.
+
+   stdin reads the keyboard one byte at a time, because a read
+   from the console waits for every byte that it asks for, and
+   flushes stdout first, so that a prompt appears before the
+   program waits for an answer.
+
+   exit() flushes every stream.  Each stream has a lock, so that
+   threads may share it. */
+
+/* Stream flags. */
+#define S_READ 0x01    /* Open for reading. */
+#define S_WRITE 0x02   /* Open for writing. */
+#define S_LINE 0x04    /* Line buffered. */
+#define S_UNBUF 0x08   /* Unbuffered, or no memory for a buffer. */
+#define S_CONSOLE 0x10 /* Reads the keyboard. */
+#define S_EOF 0x20     /* End of file reached. */
+#define S_ERR 0x40     /* An error occurred. */
+#define S_STATIC 0x80  /* stdin or stdout, which is never freed. */
+
+/* A stream. */
+struct FILE {
+  int fd;            /* File descriptor. */
+  int flags;         /* S_* flags. */
+  char* buf;         /* BUFSIZ-byte buffer, or null. */
+  size_t pos;        /* Offset of the next byte of input in BUF. */
+  size_t len;        /* Bytes of input or output in BUF. */
+  bool writing;      /* BUF holds output rather than input? */
+  lock_t lock;       /* Serializes use of the stream. */
+  struct FILE* next; /* Next in open_streams. */
+};
+
+static FILE stdout_stream = {.fd = STDOUT_FILENO, .flags = S_WRITE | S_LINE | S_STATIC};
+static FILE stdin_stream = {
+    .fd = STDIN_FILENO, .flags = S_READ | S_CONSOLE | S_STATIC, .next = &stdout_stream};
+FILE* stdin = &stdin_stream;
+FILE* stdout = &stdout_stream;
+
+/* Every open stream, for fflush(NULL).  Lock order: streams_lock,
+   then a stream's lock, then stdout's. */
+static FILE* open_streams = &stdin_stream;
+static lock_t streams_lock;
+
+/* True between _stdio_init() and _stdio_exit(). */
+static bool stdio_ready;
+
+/* Initializes the streams library.  Called by _start() before
+   main(). */
+void _stdio_init(void) {
+  lock_init(&streams_lock);
+  lock_init(&stdin->lock);
+  lock_init(&stdout->lock);
+  stdio_ready = true;
+}
+
+/* Flushes every stream.  Called by exit().  Does nothing before
+   _stdio_init(), or if the flush itself exits. */
+void _stdio_exit(void) {
+  if (stdio_ready) {
+    stdio_ready = false;
+    fflush(NULL);
+  }
+}
+
+/* Returns true if S has a buffer, allocating one if it is
+   buffered but does not have one yet.  A stream for which there
+   is no memory becomes unbuffered. */
+static bool has_buf(FILE* s) {
+  if (s->buf == NULL && !(s->flags & S_UNBUF)) {
+    s->buf = malloc(BUFSIZ);
+    if (s->buf == NULL)
+      s->flags |= S_UNBUF;
+  }
+  return s->buf != NULL;
+}
+
+/* Writes all of the SIZE bytes in DATA to S's file descriptor.
+   Returns the number of bytes written, which is short only on
+   error. */
+static size_t write_fully(FILE* s, const char* data, size_t size) {
+  size_t done = 0;
+
+  while (done < size) {
+    int n = write(s->fd, data + done, size - done);
+    if (n <= 0) {
+      s->flags |= S_ERR;
+      break;
+    }
+    done += n;
+  }
+  return done;
+}
+
+/* Writes out the first N bytes of the output in S's buffer and
+   moves the rest to the start of the buffer.  Returns false on
+   error, discarding the output. */
+static bool write_out(FILE* s, size_t n) {
+  if (write_fully(s, s->buf, n) != n) {
+    s->len = 0;
+    return false;
+  }
+  memmove(s->buf, s->buf + n, s->len - n);
+  s->len -= n;
+  return true;
+}
+
+/* Empties S's buffer, by writing out its output or by giving back
+   its unread input: the file position moves back over it, except
+   on the console.  Returns false on error. */
+static bool drain(FILE* s) {
+  bool ok = true;
+
+  if (s->writing)
+    ok = write_out(s, s->len);
+  else if (s->pos < s->len && !(s->flags & S_CONSOLE))
+    seek(s->fd, tell(s->fd) - (s->len - s->pos));
+  s->pos = s->len = 0;
+  return ok;
+}
+
+/* Makes room in S's full buffer.  A line buffered stream writes
+   out only its complete lines, if it has any. */
+static bool make_room(FILE* s) {
+  size_t n = s->len;
+
+  if (s->flags & S_LINE) {
+    while (n > 0 && s->buf[n - 1] != '\n')
+      n--;
+    if (n == 0)
+      n = s->len;
+  }
+  return write_out(s, n);
+}
+
+/* Gets S ready for output.  Returns false if S is not open for
+   writing or an error occurs. */
+static bool start_output(FILE* s) {
+  if (!(s->flags & S_WRITE)) {
+    s->flags |= S_ERR;
+    return false;
+  }
+  if (!s->writing) {
+    if (!drain(s))
+      return false;
+    s->writing = true;
+  }
+  return true;
+}
+
+/* Adds the SIZE bytes in DATA to S's output.  Returns the number
+   of bytes taken, which is short only on error. */
+static size_t put_bytes(FILE* s, const char* data, size_t size) {
+  size_t done = 0;
+
+  if (!has_buf(s))
+    return write_fully(s, data, size);
+  while (done < size) {
+    size_t chunk;
+
+    if (s->len == BUFSIZ && !make_room(s))
+      break;
+    chunk = size - done < BUFSIZ - s->len ? size - done : BUFSIZ - s->len;
+    memcpy(s->buf + s->len, data + done, chunk);
+    s->len += chunk;
+    done += chunk;
+  }
+  return done;
+}
+
+/* Finishes an output call on S, which output a new-line if
+   NEWLINE is true.  Returns false if S has had an error. */
+static bool end_output(FILE* s, bool newline) {
+  if (newline && (s->flags & S_LINE))
+    drain(s);
+  return !(s->flags & S_ERR);
+}
+
+/* Gets S ready for input.  Returns false if S is not open for
+   reading or an error occurs. */
+static bool start_input(FILE* s) {
+  if (!(s->flags & S_READ)) {
+    s->flags |= S_ERR;
+    return false;
+  }
+  if (s->writing) {
+    if (!drain(s))
+      return false;
+    s->writing = false;
+  }
+  if (s->flags & S_CONSOLE)
+    fflush(stdout);
+  return true;
+}
+
+/* Reads up to SIZE bytes from S into DST.  Returns the number of
+   bytes read, which is short only at end of file or on error. */
+static size_t get_bytes(FILE* s, char* dst, size_t size) {
+  size_t done = 0;
+
+  while (done < size) {
+    size_t chunk;
+
+    if (s->pos == s->len) {
+      /* Reads of a buffer or more, and reads when there is no
+         buffer, go straight to the caller's memory.  A console
+         read returns the keys typed so far, so it may be short. */
+      bool direct = !has_buf(s) || (size - done >= BUFSIZ && !(s->flags & S_CONSOLE));
+      int n = read(s->fd, direct ? dst + done : s->buf, direct ? size - done : BUFSIZ);
+      if (n <= 0) {
+        s->flags |= n == 0 ? S_EOF : S_ERR;
+        break;
+      }
+      if (direct) {
+        done += n;
+        continue;
+      }
+      s->pos = 0;
+      s->len = n;
+    }
+    chunk = size - done < s->len - s->pos ? size - done : s->len - s->pos;
+    memcpy(dst + done, s->buf + s->pos, chunk);
+    s->pos += chunk;
+    done += chunk;
+  }
+  return done;
+}
+
+/* Returns the next byte of input from S, or EOF. */
+static int get_char(FILE* s) {
+  unsigned char c;
+
+  if (s->pos < s->len)
+    return (unsigned char)s->buf[s->pos++];
+  return get_bytes(s, (char*)&c, 1) == 1 ? c : EOF;
+}
+
+/* Parses fopen() mode MODE into S_* flags in *FLAGS.  Returns
+   false if MODE is not valid. */
+static bool parse_mode(const char* mode, int* flags) {
+  const char* p;
+
+  if (mode[0] == 'r')
+    *flags = S_READ;
+  else if (mode[0] == 'w' || mode[0] == 'a')
+    *flags = S_WRITE;
+  else
+    return false;
+  for (p = mode + 1; *p != '\0'; p++)
+    if (*p == '+')
+      *flags |= S_READ | S_WRITE;
+    else if (*p != 'b')
+      return false;
+  return true;
+}
+
+/* Returns a new fully buffered stream for file descriptor FD with
+   S_* flags FLAGS, or a null pointer if memory is short. */
+static FILE* new_stream(int fd, int flags) {
+  FILE* s = malloc(sizeof *s);
+
+  if (s == NULL)
+    return NULL;
+  s->fd = fd;
+  s->flags = flags;
+  s->buf = NULL;
+  s->pos = s->len = 0;
+  s->writing = false;
+  lock_init(&s->lock);
+
+  lock_acquire(&streams_lock);
+  s->next = open_streams;
+  open_streams = s;
+  lock_release(&streams_lock);
+  return s;
+}
+
+/* Opens the file named NAME as a stream, according to MODE: "r"
+   to read an existing file, "w" to write a new, empty file that
+   replaces any old one, or "a" to write at the end of a file,
+   creating it if necessary.  A '+' in MODE opens the stream for
+   both reading and writing, and a 'b' is ignored.  Returns the
+   new stream, or a null pointer on failure. */
+FILE* fopen(const char* name, const char* mode) {
+  FILE* s;
+  int flags;
+  int fd;
+
+  if (!parse_mode(mode, &flags))
+    return NULL;
+  if (mode[0] == 'r')
+    fd = open(name);
+  else if (mode[0] == 'w') {
+    remove(name);
+    fd = create(name, 0) ? open(name) : -1;
+  } else {
+    fd = open(name);
+    if (fd < 0 && create(name, 0))
+      fd = open(name);
+    if (fd >= 0)
+      seek(fd, filesize(fd));
+  }
+  if (fd < 0)
+    return NULL;
+
+  s = new_stream(fd, flags);
+  if (s == NULL)
+    close(fd);
+  return s;
+}
+
+/* Returns a new stream for open file descriptor FD, which MODE,
+   as for fopen(), says how to use, or a null pointer on failure.
+   Closing the stream closes FD. */
+FILE* fdopen(int fd, const char* mode) {
+  int flags;
+
+  if (fd < 0 || !parse_mode(mode, &flags))
+    return NULL;
+  return new_stream(fd, flags);
+}
+
+/* Flushes and closes stream S.  stdin and stdout are only flushed
+   and stay open.  Returns 0 if successful, EOF on error. */
+int fclose(FILE* s) {
+  FILE** p;
+  bool ok;
+
+  if (s->flags & S_STATIC)
+    return fflush(s);
+
+  lock_acquire(&streams_lock);
+  for (p = &open_streams; *p != NULL; p = &(*p)->next)
+    if (*p == s) {
+      *p = s->next;
+      break;
+    }
+  lock_release(&streams_lock);
+
+  lock_acquire(&s->lock);
+  ok = drain(s) && !(s->flags & S_ERR);
+  lock_release(&s->lock);
+  close(s->fd);
+  free(s->buf);
+  free(s);
+  return ok ? 0 : EOF;
+}
+
+/* Writes out S's buffered output, or if S is a null pointer, that
+   of every open stream.  Returns 0 if successful, EOF on error. */
+int fflush(FILE* s) {
+  bool ok = true;
+
+  if (s == NULL) {
+    lock_acquire(&streams_lock);
+    for (s = open_streams; s != NULL; s = s->next) {
+      /* Skipping streams that cannot write also keeps exit() from
+         waiting on a thread blocked reading the keyboard. */
+      if (!(s->flags & S_WRITE))
+        continue;
+      lock_acquire(&s->lock);
+      if (s->writing && !drain(s))
+        ok = false;
+      lock_release(&s->lock);
+    }
+    lock_release(&streams_lock);
+  } else {
+    lock_acquire(&s->lock);
+    ok = drain(s);
+    lock_release(&s->lock);
+  }
+  return ok ? 0 : EOF;
+}
+
+/* Sets how stream S buffers its output to MODE: _IOFBF, _IOLBF,
+   or _IONBF.  Only streams' own buffers are supported, so BUF
+   must be a null pointer, and SIZE is ignored.  Returns 0 if
+   successful, nonzero if BUF or MODE is not valid. */
+int setvbuf(FILE* s, char* buf, int mode, size_t size UNUSED) {
+  if (buf != NULL || mode < _IOFBF || mode > _IONBF)
+    return -1;
+
+  lock_acquire(&s->lock);
+  drain(s);
+  s->flags &= ~(S_LINE | S_UNBUF);
+  if (mode == _IOLBF)
+    s->flags |= S_LINE;
+  else if (mode == _IONBF) {
+    s->flags |= S_UNBUF;
+    free(s->buf);
+    s->buf = NULL;
+  }
+  lock_release(&s->lock);
+  return 0;
+}
+
+/* Reads up to CNT elements of SIZE bytes each from stream S into
+   BUFFER.  Returns the number of whole elements read, which is
+   short only at end of file or on error. */
+size_t fread(void* buffer, size_t size, size_t cnt, FILE* s) {
+  size_t done = 0;
+
+  if (size == 0 || cnt == 0)
+    return 0;
+  lock_acquire(&s->lock);
+  if (start_input(s))
+    done = get_bytes(s, buffer, size * cnt);
+  lock_release(&s->lock);
+  return done / size;
+}
+
+/* Writes CNT elements of SIZE bytes each from BUFFER to stream
+   S.  Returns the number of whole elements written, which is
+   short only on error. */
+size_t fwrite(const void* buffer, size_t size, size_t cnt, FILE* s) {
+  size_t done = 0;
+
+  if (size == 0 || cnt == 0)
+    return 0;
+  lock_acquire(&s->lock);
+  if (start_output(s)) {
+    done = put_bytes(s, buffer, size * cnt);
+    end_output(s, memchr(buffer, '\n', done) != NULL);
+  }
+  lock_release(&s->lock);
+  return done / size;
+}
+
+/* Reads and returns the next byte from stream S, or EOF at end
+   of file or on error. */
+int fgetc(FILE* s) {
+  int c = EOF;
+
+  lock_acquire(&s->lock);
+  if (start_input(s))
+    c = get_char(s);
+  lock_release(&s->lock);
+  return c;
+}
+
+/* Reads a line from stream S into the SIZE bytes at LINE, up to
+   and including its new-line, or as much of it as fits along with
+   a null terminator.  Returns LINE, or a null pointer if nothing
+   could be read because of end of file or an error. */
+char* fgets(char* line, int size, FILE* s) {
+  int len = 0;
+
+  if (size <= 0)
+    return NULL;
+  lock_acquire(&s->lock);
+  if (start_input(s))
+    while (len < size - 1) {
+      int c = get_char(s);
+      if (c == EOF)
+        break;
+      line[len++] = c;
+      if (c == '\n')
+        break;
+    }
+  lock_release(&s->lock);
+
+  if (len == 0 && size > 1)
+    return NULL;
+  line[len] = '\0';
+  return line;
+}
+
+/* Writes C, converted to unsigned char, to stream S.  Returns C
+   as written, or EOF on error. */
+int fputc(int c, FILE* s) {
+  unsigned char byte = c;
+  bool ok = false;
+
+  lock_acquire(&s->lock);
+  if (start_output(s)) {
+    if (s->buf != NULL && s->len < BUFSIZ)
+      s->buf[s->len++] = byte;
+    else
+      put_bytes(s, (const char*)&byte, 1);
+    ok = end_output(s, byte == '\n');
+  }
+  lock_release(&s->lock);
+  return ok ? byte : EOF;
+}
+
+/* Writes string STRING to stream S, without a new-line.  Returns
+   0 if successful, EOF on error. */
+int fputs(const char* string, FILE* s) {
+  size_t len = strlen(string);
+  return len == 0 || fwrite(string, len, 1, s) == 1 ? 0 : EOF;
+}
+
+/* Reads and returns the next byte from stdin, or EOF. */
+int getchar(void) { return fgetc(stdin); }
+
+/* Auxiliary data for vfprintf_helper(). */
+struct vfprintf_aux {
+  FILE* stream; /* Output stream. */
+  int char_cnt; /* Characters output so far. */
+  bool newline; /* Output a new-line? */
+};
+
+/* Adds the N bytes in BUFFER to the stream in AUX. */
+static void vfprintf_helper(const char* buffer, size_t n, void* aux_) {
+  struct vfprintf_aux* aux = aux_;
+
+  put_bytes(aux->stream, buffer, n);
+  if (!aux->newline && memchr(buffer, '\n', n) != NULL)
+    aux->newline = true;
+  aux->char_cnt += n;
+}
+
+/* Formats the printf() format specification FORMAT with
+   arguments given in ARGS and writes the output to stream S.
+   Returns the number of characters output, or -1 on error. */
+int vfprintf(FILE* s, const char* format, va_list args) {
+  struct vfprintf_aux aux;
+  bool ok = false;
+
+  aux.stream = s;
+  aux.char_cnt = 0;
+  aux.newline = false;
+  lock_acquire(&s->lock);
+  if (start_output(s)) {
+    __vprintf_chunked(format, args, vfprintf_helper, &aux);
+    ok = end_output(s, aux.newline);
+  }
+  lock_release(&s->lock);
+  return ok ? aux.char_cnt : -1;
+}
+
+/* Like printf(), but writes output to stream S. */
+int fprintf(FILE* s, const char* format, ...) {
+  va_list args;
+  int retval;
+
+  va_start(args, format);
+  retval = vfprintf(s, format, args);
+  va_end(args);
+
+  return retval;
+}
+
+/* Returns nonzero if stream S has reached end of file. */
+int feof(FILE* s) { return (s->flags & S_EOF) != 0; }
+
+/* Returns nonzero if stream S has had an error. */
+int ferror(FILE* s) { return (s->flags & S_ERR) != 0; }
+
+/* Clears stream S's end of file and error indicators. */
+void clearerr(FILE* s) { s->flags &= ~(S_EOF | S_ERR); }
+
+/* Returns the file descriptor of stream S. */
+int fileno(FILE* s) { return s->fd; }
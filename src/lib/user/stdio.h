@@ -4,4 +4,45 @@
 int hprintf(int, const char*, ...) PRINTF_FORMAT(2, 3);
 int vhprintf(int, const char*, va_list) PRINTF_FORMAT(2, 0);
 
+/* Buffered streams, implemented in lib/user/stdio.c. */
+typedef struct FILE FILE;
+
+extern FILE* stdin;
+extern FILE* stdout;
+
+#define EOF (-1)    /* Returned at end of file or on error. */
+#define BUFSIZ 4096 /* Size of a stream's buffer. */
+
+/* Buffering modes for setvbuf(). */
+#define _IOFBF 0 /* Fully buffered. */
+#define _IOLBF 1 /* Line buffered. */
+#define _IONBF 2 /* Unbuffered. */
+
+FILE* fopen(const char* name, const char* mode);
+FILE* fdopen(int fd, const char* mode);
+int fclose(FILE*);
+int fflush(FILE*);
+int setvbuf(FILE*, char* buf, int mode, size_t size);
+
+size_t fread(void*, size_t size, size_t cnt, FILE*);
+size_t fwrite(const void*, size_t size, size_t cnt, FILE*);
+int fgetc(FILE*);
+char* fgets(char*, int size, FILE*);
+int fputc(int, FILE*);
+int fputs(const char*, FILE*);
+int getchar(void);
+int fprintf(FILE*, const char*, ...) PRINTF_FORMAT(2, 3);
+int vfprintf(FILE*, const char*, va_list) PRINTF_FORMAT(2, 0);
+
+int feof(FILE*);
+int ferror(FILE*);
+void clearerr(FILE*);
+int fileno(FILE*);
+
+#define getc(STREAM) fgetc(STREAM)
+#define putc(C, STREAM) fputc(C, STREAM)
+
+void _stdio_init(void);
+void _stdio_exit(void);
+
 #endif /* lib/user/stdio.h */
@@ -0,0 +1,331 @@
+#include <limits.h>
+#include <pthread.h>
+#include <syscall.h>
+
+/* Locks and semaphores for user threads.
+
+   Both keep their state in an int that threads update with atomic
+   instructions, so acquiring a free lock, releasing a lock nobody
+   waits for, and downing a positive semaphore or upping one with
+   no waiters never enter the kernel.  Only a thread that has to
+   wait traps, into futex_wait(), and the thread that lets it
+   continue calls futex_wake().
+
+   The lock is the three-state mutex from Ulrich Drepper,
+   "Futexes Are Tricky": its state is 0 when free, 1 when held,
+   and 2 when held and some thread may be sleeping on it, so that
+   release only makes a system call in the last case.  A lock_t
+   is a pthread_mutex_t, and the pthread_mutex_*() functions are
+   another name for the lock functions.
+
+   The pthread condition variables, reader-writer locks, and
+   barriers below work the same way: waiters sleep in the kernel
+   only once the int they wait on says they must, and wakers trap
+   only when someone may be asleep.  The last thread to reach a
+   barrier releases the rest with futex_wake_all(), which makes
+   them all ready at once at its own priority, so the next phase
+   starts together.
+
+   Unlike mutexes on a multiprocessor, these do not spin before
+   sleeping: with one CPU, the holder of a lock cannot run while
+   a waiter spins, so spinning would only delay it.  The kernel
+   wakes futex sleepers highest priority first. */
+
+#define LOCK_MAGIC 0x4c6f634b    /* Marks an initialized lock_t. */
+#define SEMA_MAGIC 0x53656d61    /* Marks an initialized sema_t. */
+#define COND_MAGIC 0x436f6e64    /* Marks an initialized pthread_cond_t. */
+#define RWLOCK_MAGIC 0x52774c6b  /* Marks an initialized pthread_rwlock_t. */
+#define BARRIER_MAGIC 0x42617272 /* Marks an initialized pthread_barrier_t. */
+
+/* Returns a nonzero number that identifies the running thread
+   among the live threads of this process. */
+static int thread_key(void) { return pthread_slot() + 1; }
+
+/* Initializes LOCK.  Returns false if LOCK is null. */
+bool lock_init(lock_t* lock) {
+  if (lock == NULL)
+    return false;
+  lock->state = 0;
+  lock->owner = 0;
+  lock->magic = LOCK_MAGIC;
+  return true;
+}
+
+/* Acquires LOCK, sleeping until it becomes available if
+   necessary.  Exits the process if LOCK is not initialized or the
+   running thread already holds it. */
+void lock_acquire(lock_t* lock) {
+  int self = thread_key();
+  int c = 0;
+
+  if (lock->magic != LOCK_MAGIC || lock->owner == self)
+    exit(1);
+
+  if (!__atomic_compare_exchange_n(&lock->state, &c, 1, false, __ATOMIC_ACQUIRE,
+                                   __ATOMIC_RELAXED)) {
+    /* Contended.  Mark the lock so that the holder wakes us when
+       it releases it, and sleep until we get it. */
+    if (c != 2)
+      c = __atomic_exchange_n(&lock->state, 2, __ATOMIC_ACQUIRE);
+    while (c != 0) {
+      futex_wait(&lock->state, 2);
+      c = __atomic_exchange_n(&lock->state, 2, __ATOMIC_ACQUIRE);
+    }
+  }
+  lock->owner = self;
+}
+
+/* Releases LOCK.  Exits the process if LOCK is not initialized or
+   the running thread does not hold it. */
+void lock_release(lock_t* lock) {
+  if (lock->magic != LOCK_MAGIC || lock->owner != thread_key())
+    exit(1);
+
+  lock->owner = 0;
+  if (__atomic_exchange_n(&lock->state, 0, __ATOMIC_RELEASE) == 2)
+    futex_wake(&lock->state, 1);
+}
+
+/* Initializes SEMA to VAL.  Returns false if SEMA is null or VAL
+   is negative. */
+bool sema_init(sema_t* sema, int val) {
+  if (sema == NULL || val < 0)
+    return false;
+  sema->value = val;
+  sema->waiters = 0;
+  sema->magic = SEMA_MAGIC;
+  return true;
+}
+
+/* Waits for SEMA to become positive and then decrements it.
+   Exits the process if SEMA is not initialized. */
+void sema_down(sema_t* sema) {
+  if (sema->magic != SEMA_MAGIC)
+    exit(1);
+
+  for (;;) {
+    int v = __atomic_load_n(&sema->value, __ATOMIC_RELAXED);
+    if (v > 0) {
+      if (__atomic_compare_exchange_n(&sema->value, &v, v - 1, false, __ATOMIC_ACQUIRE,
+                                      __ATOMIC_RELAXED))
+        return;
+      continue;
+    }
+
+    /* Announce ourselves before sleeping, so that sema_up() knows
+       to wake us.  futex_wait() returns at once if an up came in
+       between. */
+    __atomic_fetch_add(&sema->waiters, 1, __ATOMIC_SEQ_CST);
+    futex_wait(&sema->value, 0);
+    __atomic_fetch_sub(&sema->waiters, 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+/* Increments SEMA and wakes up one thread waiting for it, if any.
+   Exits the process if SEMA is not initialized. */
+void sema_up(sema_t* sema) {
+  if (sema->magic != SEMA_MAGIC)
+    exit(1);
+
+  __atomic_fetch_add(&sema->value, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&sema->waiters, __ATOMIC_SEQ_CST) > 0)
+    futex_wake(&sema->value, 1);
+}
+
+/* Initializes mutex M.  Returns false if M is null. */
+bool pthread_mutex_init(pthread_mutex_t* m) { return lock_init(m); }
+
+/* Acquires mutex M, as lock_acquire() does. */
+void pthread_mutex_lock(pthread_mutex_t* m) { lock_acquire(m); }
+
+/* Acquires mutex M if it is free, without waiting.  Returns true
+   if successful, false if another thread holds M.  Exits the
+   process if M is not initialized or the running thread already
+   holds it. */
+bool pthread_mutex_trylock(pthread_mutex_t* m) {
+  int self = thread_key();
+  int c = 0;
+
+  if (m->magic != LOCK_MAGIC || m->owner == self)
+    exit(1);
+  if (!__atomic_compare_exchange_n(&m->state, &c, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return false;
+  m->owner = self;
+  return true;
+}
+
+/* Releases mutex M, as lock_release() does. */
+void pthread_mutex_unlock(pthread_mutex_t* m) { lock_release(m); }
+
+/* Initializes condition variable COND.  Returns false if COND is
+   null. */
+bool pthread_cond_init(pthread_cond_t* cond) {
+  if (cond == NULL)
+    return false;
+  cond->seq = 0;
+  cond->waiters = 0;
+  cond->magic = COND_MAGIC;
+  return true;
+}
+
+/* Atomically releases mutex M, which the running thread must
+   hold, and waits for COND to be signaled, then reacquires M
+   before returning.  As with any condition variable, the caller
+   must recheck its condition after a wakeup.  Exits the process
+   if COND is not initialized. */
+void pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* m) {
+  int seq;
+
+  if (cond->magic != COND_MAGIC)
+    exit(1);
+
+  /* A signal that comes after M is released changes SEQ, so
+     futex_wait() returns at once instead of missing it. */
+  seq = __atomic_load_n(&cond->seq, __ATOMIC_SEQ_CST);
+  __atomic_fetch_add(&cond->waiters, 1, __ATOMIC_SEQ_CST);
+  lock_release(m);
+  futex_wait(&cond->seq, seq);
+  __atomic_fetch_sub(&cond->waiters, 1, __ATOMIC_SEQ_CST);
+  lock_acquire(m);
+}
+
+/* Wakes one thread waiting on COND, if any.  Exits the process
+   if COND is not initialized. */
+void pthread_cond_signal(pthread_cond_t* cond) {
+  if (cond->magic != COND_MAGIC)
+    exit(1);
+
+  __atomic_fetch_add(&cond->seq, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&cond->waiters, __ATOMIC_SEQ_CST) > 0)
+    futex_wake(&cond->seq, 1);
+}
+
+/* Wakes all threads waiting on COND.  Exits the process if COND
+   is not initialized. */
+void pthread_cond_broadcast(pthread_cond_t* cond) {
+  if (cond->magic != COND_MAGIC)
+    exit(1);
+
+  __atomic_fetch_add(&cond->seq, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&cond->waiters, __ATOMIC_SEQ_CST) > 0)
+    futex_wake(&cond->seq, INT_MAX);
+}
+
+/* Initializes reader-writer lock RW.  Returns false if RW is
+   null. */
+bool pthread_rwlock_init(pthread_rwlock_t* rw) {
+  if (rw == NULL)
+    return false;
+  rw->state = 0;
+  rw->waiters = 0;
+  rw->writers_waiting = 0;
+  rw->magic = RWLOCK_MAGIC;
+  return true;
+}
+
+/* Sleeps until RW's state may have changed from S.  WRITER says
+   whether the caller wants to write. */
+static void rwlock_sleep(pthread_rwlock_t* rw, int s, bool writer) {
+  __atomic_fetch_add(&rw->waiters, 1, __ATOMIC_SEQ_CST);
+  if (writer)
+    __atomic_fetch_add(&rw->writers_waiting, 1, __ATOMIC_SEQ_CST);
+  futex_wait(&rw->state, s);
+  if (writer)
+    __atomic_fetch_sub(&rw->writers_waiting, 1, __ATOMIC_SEQ_CST);
+  __atomic_fetch_sub(&rw->waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Acquires RW for reading, which any number of threads may do at
+   once, waiting while a writer holds it or wants it, so that
+   writers are not starved.  Exits the process if RW is not
+   initialized. */
+void pthread_rwlock_rdlock(pthread_rwlock_t* rw) {
+  if (rw->magic != RWLOCK_MAGIC)
+    exit(1);
+
+  for (;;) {
+    int s = __atomic_load_n(&rw->state, __ATOMIC_SEQ_CST);
+    if (s >= 0 && __atomic_load_n(&rw->writers_waiting, __ATOMIC_SEQ_CST) == 0) {
+      if (__atomic_compare_exchange_n(&rw->state, &s, s + 1, false, __ATOMIC_ACQUIRE,
+                                      __ATOMIC_RELAXED))
+        return;
+      continue;
+    }
+    rwlock_sleep(rw, s, false);
+  }
+}
+
+/* Acquires RW for writing, waiting until no other thread holds
+   it.  Exits the process if RW is not initialized. */
+void pthread_rwlock_wrlock(pthread_rwlock_t* rw) {
+  if (rw->magic != RWLOCK_MAGIC)
+    exit(1);
+
+  for (;;) {
+    int s = 0;
+    if (__atomic_compare_exchange_n(&rw->state, &s, -1, false, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_RELAXED))
+      return;
+    rwlock_sleep(rw, s, true);
+  }
+}
+
+/* Releases RW, which the running thread holds for reading or for
+   writing.  Exits the process if RW is not initialized or not
+   held. */
+void pthread_rwlock_unlock(pthread_rwlock_t* rw) {
+  int s;
+
+  if (rw->magic != RWLOCK_MAGIC)
+    exit(1);
+
+  s = __atomic_load_n(&rw->state, __ATOMIC_SEQ_CST);
+  if (s == 0)
+    exit(1);
+  else if (s < 0)
+    __atomic_store_n(&rw->state, 0, __ATOMIC_SEQ_CST);
+  else
+    s = __atomic_sub_fetch(&rw->state, 1, __ATOMIC_SEQ_CST);
+
+  /* Once RW is free, every sleeper gets to retry: readers that
+     waited behind a writer may all proceed together. */
+  if (s <= 0 && __atomic_load_n(&rw->waiters, __ATOMIC_SEQ_CST) > 0)
+    futex_wake(&rw->state, INT_MAX);
+}
+
+/* Initializes barrier B for COUNT threads.  Returns false if B is
+   null or COUNT is not positive. */
+bool pthread_barrier_init(pthread_barrier_t* b, int count) {
+  if (b == NULL || count <= 0)
+    return false;
+  b->count = count;
+  b->arrived = 0;
+  b->seq = 0;
+  b->magic = BARRIER_MAGIC;
+  return true;
+}
+
+/* Waits until B's count of threads have called this function,
+   then lets them all continue and resets B for another round.
+   Returns true in exactly one of the threads, the last to
+   arrive, and false in the others.  Exits the process if B is not
+   initialized. */
+bool pthread_barrier_wait(pthread_barrier_t* b) {
+  int seq;
+
+  if (b->magic != BARRIER_MAGIC)
+    exit(1);
+
+  /* No thread can arrive for the next round until this one ends,
+     which is after ARRIVED is reset. */
+  seq = __atomic_load_n(&b->seq, __ATOMIC_SEQ_CST);
+  if (__atomic_add_fetch(&b->arrived, 1, __ATOMIC_SEQ_CST) == b->count) {
+    __atomic_store_n(&b->arrived, 0, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&b->seq, 1, __ATOMIC_SEQ_CST);
+    futex_wake_all(&b->seq);
+    return true;
+  }
+  while (__atomic_load_n(&b->seq, __ATOMIC_SEQ_CST) == seq)
+    futex_wait(&b->seq, seq);
+  return false;
+}
@@ -1,16 +1,34 @@
 #include <syscall.h>
 #include "../syscall-nr.h"
 #include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Set by _syscall_init() if the CPU has SYSENTER, which the
+   kernel then always accepts. */
+bool _syscall_sysenter;
+
+/* Traps into the kernel with the syscall number and its
+   arguments on top of the stack.  SYSENTER skips most of the
+   work of an interrupt, but saves neither the stack pointer nor
+   the return address, so they are passed in ECX and EDX, which
+   the kernel does not give back.  The kernel returns with
+   SYSEXIT to the label after `int $0x30'. */
+#define SYSCALL_TRAP                                                                               \
+  "cmpb $0, _syscall_sysenter; je 1f; "                                                            \
+  "movl %%esp, %%ecx; movl $2f, %%edx; sysenter; "                                                 \
+  "1: int $0x30; 2: "
 
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                                                           \
   ({                                                                                               \
     int retval;                                                                                    \
-    asm volatile("pushl %[number]; int $0x30; addl $4, %%esp"                                      \
+    asm volatile("pushl %[number]; " SYSCALL_TRAP "addl $4, %%esp"                                 \
                  : "=a"(retval)                                                                    \
                  : [number] "i"(NUMBER)                                                            \
-                 : "memory");                                                                      \
+                 : "ecx", "edx", "memory");                                                        \
     retval;                                                                                        \
   })
 
@@ -19,10 +37,10 @@
 #define syscall1(NUMBER, ARG0)                                                                     \
   ({                                                                                               \
     int retval;                                                                                    \
-    asm volatile("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp"                       \
+    asm volatile("pushl %[arg0]; pushl %[number]; " SYSCALL_TRAP "addl $8, %%esp"                  \
                  : "=a"(retval)                                                                    \
                  : [number] "i"(NUMBER), [arg0] "g"(ARG0)                                          \
-                 : "memory");                                                                      \
+                 : "ecx", "edx", "memory");                                                        \
     retval;                                                                                        \
   })
 
@@ -31,10 +49,10 @@
 #define syscall1f(NUMBER, ARG0)                                                                    \
   ({                                                                                               \
     float retval;                                                                                  \
-    asm volatile("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp"                       \
+    asm volatile("pushl %[arg0]; pushl %[number]; " SYSCALL_TRAP "addl $8, %%esp"                  \
                  : "=a"(retval)                                                                    \
                  : [number] "i"(NUMBER), [arg0] "g"(ARG0)                                          \
-                 : "memory");                                                                      \
+                 : "ecx", "edx", "memory");                                                        \
     retval;                                                                                        \
   })
 
@@ -44,10 +62,10 @@
   ({                                                                                               \
     int retval;                                                                                    \
     asm volatile("pushl %[arg1]; pushl %[arg0]; "                                                  \
-                 "pushl %[number]; int $0x30; addl $12, %%esp"                                     \
+                 "pushl %[number]; " SYSCALL_TRAP "addl $12, %%esp"                                \
                  : "=a"(retval)                                                                    \
                  : [number] "i"(NUMBER), [arg0] "r"(ARG0), [arg1] "r"(ARG1)                        \
-                 : "memory");                                                                      \
+                 : "ecx", "edx", "memory");                                                        \
     retval;                                                                                        \
   })
 
@@ -57,29 +75,100 @@
   ({                                                                                               \
     int retval;                                                                                    \
     asm volatile("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "                                   \
-                 "pushl %[number]; int $0x30; addl $16, %%esp"                                     \
+                 "pushl %[number]; " SYSCALL_TRAP "addl $16, %%esp"                                \
                  : "=a"(retval)                                                                    \
                  : [number] "i"(NUMBER), [arg0] "r"(ARG0), [arg1] "r"(ARG1), [arg2] "r"(ARG2)      \
-                 : "memory");                                                                      \
+                 : "ecx", "edx", "memory");                                                        \
+    retval;                                                                                        \
+  })
+
+/* Called from _start(), before any other system call.  Uses the
+   same test for SYSENTER as the kernel's tss_init(): CPUID
+   function 1 reports it in bit 11 of EDX, except that the first
+   Pentium Pros claim it but lack it.  See [IA32-v2b] "SYSENTER". */
+void _syscall_init(void);
+void _syscall_init(void) {
+  uint32_t eax = 1, ebx, ecx, edx;
+  int family, model, stepping;
+
+  asm("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+  family = (eax >> 8) & 0xf;
+  model = (eax >> 4) & 0xf;
+  stepping = eax & 0xf;
+  _syscall_sysenter = (edx & (1 << 11)) != 0 && !(family == 6 && model < 3 && stepping < 3);
+}
+
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                                                   \
+  ({                                                                                               \
+    int retval;                                                                                    \
+    asm volatile("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "                    \
+                 "pushl %[number]; " SYSCALL_TRAP "addl $20, %%esp"                                \
+                 : "=a"(retval)                                                                    \
+                 : [number] "i"(NUMBER), [arg0] "r"(ARG0), [arg1] "r"(ARG1), [arg2] "r"(ARG2),     \
+                   [arg3] "r"(ARG3)                                                                \
+                 : "ecx", "edx", "memory");                                                        \
     retval;                                                                                        \
   })
 
 int practice(int i) { return syscall1(SYS_PRACTICE, i); }
 
+/* The kernel returns the bits of a float, since system calls
+   return integers. */
+double compute_e(int n) {
+  int bits = syscall1(SYS_COMPUTE_E, n);
+  float e;
+
+  memcpy(&e, &bits, sizeof e);
+  return e;
+}
+
 void halt(void) {
   syscall0(SYS_HALT);
   NOT_REACHED();
 }
 
 void exit(int status) {
+  _stdio_exit();
   syscall1(SYS_EXIT, status);
   NOT_REACHED();
 }
 
 pid_t exec(const char* file) { return (pid_t)syscall1(SYS_EXEC, file); }
 
+pid_t exec_argv(char* const argv[]) { return (pid_t)syscall1(SYS_EXEC_ARGV, argv); }
+
+int copy_file_range(int in_fd, int out_fd, unsigned length) {
+  return syscall3(SYS_COPY_RANGE, in_fd, out_fd, length);
+}
+
+int sendfile(int out_fd, int in_fd, unsigned length) {
+  return syscall3(SYS_SENDFILE, out_fd, in_fd, length);
+}
+
+int fallocate(int fd, unsigned offset, unsigned length) {
+  return syscall3(SYS_FALLOCATE, fd, offset, length);
+}
+
+int pipe(int fds[2]) { return syscall1(SYS_PIPE, fds); }
+
+int poll(struct pollfd* fds, size_t cnt, int timeout) {
+  return syscall3(SYS_POLL, fds, cnt, timeout);
+}
+
+int eventfd(unsigned count) { return syscall1(SYS_EVENTFD, count); }
+
+int timerfd_create(void) { return syscall0(SYS_TIMERFD_CREATE); }
+
+int timerfd_settime(int fd, const struct itimerspec* spec) {
+  return syscall2(SYS_TIMERFD_SETTIME, fd, spec);
+}
+
 int wait(pid_t pid) { return syscall1(SYS_WAIT, pid); }
 
+pid_t wait_any(int* status) { return (pid_t)syscall1(SYS_WAIT_ANY, status); }
+
 bool create(const char* file, unsigned initial_size) {
   return syscall2(SYS_CREATE, file, initial_size);
 }
@@ -96,6 +185,22 @@ int write(int fd, const void* buffer, unsigned size) {
   return syscall3(SYS_WRITE, fd, buffer, size);
 }
 
+int readv(int fd, const struct iovec* iov, size_t iov_cnt) {
+  return syscall3(SYS_READV, fd, iov, iov_cnt);
+}
+
+int writev(int fd, const struct iovec* iov, size_t iov_cnt) {
+  return syscall3(SYS_WRITEV, fd, iov, iov_cnt);
+}
+
+int pread(int fd, void* buffer, unsigned size, unsigned offset) {
+  return syscall4(SYS_PREAD, fd, buffer, size, offset);
+}
+
+int pwrite(int fd, const void* buffer, unsigned size, unsigned offset) {
+  return syscall4(SYS_PWRITE, fd, buffer, size, offset);
+}
+
 void seek(int fd, unsigned position) { syscall2(SYS_SEEK, fd, position); }
 
 unsigned tell(int fd) { return syscall1(SYS_TELL, fd); }
@@ -106,6 +211,32 @@ mapid_t mmap(int fd, void* addr) { return syscall2(SYS_MMAP, fd, addr); }
 
 void munmap(mapid_t mapid) { syscall1(SYS_MUNMAP, mapid); }
 
+bool madvise(void* addr, size_t length, int advice) {
+  return syscall3(SYS_MADVISE, addr, length, advice);
+}
+
+bool mlock(void* addr, size_t length) { return syscall2(SYS_MLOCK, addr, length); }
+
+bool munlock(void* addr, size_t length) { return syscall2(SYS_MUNLOCK, addr, length); }
+
+bool set_evict_priority(int priority) { return syscall1(SYS_SET_EVICT_PRIORITY, priority); }
+
+shmid_t shm_create(size_t size) { return syscall1(SYS_SHM_CREATE, size); }
+
+void* shm_attach(shmid_t id, void* addr) { return (void*)syscall2(SYS_SHM_ATTACH, id, addr); }
+
+bool shm_detach(void* addr) { return syscall1(SYS_SHM_DETACH, addr); }
+
+mqid_t mq_create(void) { return syscall0(SYS_MQ_CREATE); }
+
+int mq_send(mqid_t id, const void* buf, size_t size) {
+  return syscall3(SYS_MQ_SEND, id, buf, size);
+}
+
+int mq_receive(mqid_t id, void* buf, size_t size) {
+  return syscall3(SYS_MQ_RECEIVE, id, buf, size);
+}
+
 bool chdir(const char* dir) { return syscall1(SYS_CHDIR, dir); }
 
 bool mkdir(const char* dir) { return syscall1(SYS_MKDIR, dir); }
@@ -116,6 +247,26 @@ bool isdir(int fd) { return syscall1(SYS_ISDIR, fd); }
 
 int inumber(int fd) { return syscall1(SYS_INUMBER, fd); }
 
+int getdents(int fd, struct dirent* buf, unsigned size) {
+  return syscall3(SYS_GETDENTS, fd, buf, size);
+}
+
+int openat(int dirfd, const char* file) { return syscall2(SYS_OPENAT, dirfd, file); }
+
+bool createat(int dirfd, const char* file, unsigned initial_size) {
+  return syscall3(SYS_CREATEAT, dirfd, file, initial_size);
+}
+
+bool unlinkat(int dirfd, const char* file) { return syscall2(SYS_UNLINKAT, dirfd, file); }
+
+bool clone_file(const char* src, const char* dst) { return syscall2(SYS_CLONE_FILE, src, dst); }
+
+int fsync(int fd) { return syscall1(SYS_FSYNC, fd); }
+
+int fdatasync(int fd) { return syscall1(SYS_FDATASYNC, fd); }
+
+void sync(void) { syscall0(SYS_SYNC); }
+
 tid_t sys_pthread_create(stub_fun sfun, pthread_fun tfun, const void* arg) {
   return syscall3(SYS_PT_CREATE, sfun, tfun, arg);
 }
@@ -127,34 +278,68 @@ void sys_pthread_exit() {
 
 tid_t sys_pthread_join(tid_t tid) { return syscall1(SYS_PT_JOIN, tid); }
 
-bool lock_init(lock_t* lock) { return syscall1(SYS_LOCK_INIT, lock); }
+bool futex_wait(int* uaddr, int val) { return syscall2(SYS_FUTEX_WAIT, uaddr, val); }
 
-void lock_acquire(lock_t* lock) {
-  bool success = syscall1(SYS_LOCK_ACQUIRE, lock);
-  if (!success)
-    exit(1);
-}
+int futex_wake(int* uaddr, int cnt) { return syscall2(SYS_FUTEX_WAKE, uaddr, cnt); }
+
+int futex_wake_all(int* uaddr) { return syscall1(SYS_FUTEX_WAKE_ALL, uaddr); }
 
-void lock_release(lock_t* lock) {
-  bool success = syscall1(SYS_LOCK_RELEASE, lock);
-  if (!success)
-    exit(1);
+bool sched_yield_to(tid_t tid) { return syscall1(SYS_SCHED_YIELD_TO, tid); }
+
+tid_t get_tid(void) { return syscall0(SYS_GET_TID); }
+
+bool set_tls(void* base) { return syscall1(SYS_SET_TLS, base); }
+
+pid_t fork(void) { return syscall0(SYS_FORK); }
+
+pid_t spawn(const char* cmd_line, const struct spawn_fd* fds, size_t fd_cnt) {
+  return (pid_t)syscall3(SYS_SPAWN, cmd_line, fds, fd_cnt);
 }
 
-bool sema_init(sema_t* sema, int val) { return syscall2(SYS_SEMA_INIT, sema, val); }
+void* sbrk(intptr_t increment) { return (void*)syscall1(SYS_SBRK, increment); }
+
+int ring_enter(struct io_ring* ring) { return syscall1(SYS_RING_ENTER, ring); }
 
-void sema_down(sema_t* sema) {
-  bool success = syscall1(SYS_SEMA_DOWN, sema);
-  if (!success)
-    exit(1);
+bool sched_stats(struct sched_stats* stats) { return syscall1(SYS_SCHED_STATS, stats); }
+
+bool getrusage(struct rusage* usage) { return syscall1(SYS_GETRUSAGE, usage); }
+
+bool fsstat(struct fs_stats* stats) { return syscall1(SYS_FSSTAT, stats); }
+
+bool blkstat(int idx, struct block_stats* stats) { return syscall2(SYS_BLKSTAT, idx, stats); }
+
+bool syscall_stats(bool global, struct syscall_stats* stats) {
+  return syscall2(SYS_SYSCALL_STATS, (int)global, stats);
 }
 
-void sema_up(sema_t* sema) {
-  bool success = syscall1(SYS_SEMA_UP, sema);
-  if (!success)
-    exit(1);
+bool sysctl(const char* name, int* old_value, const int* new_value) {
+  return syscall3(SYS_SYSCTL, name, old_value, new_value);
 }
 
-tid_t get_tid(void) { return syscall0(SYS_GET_TID); }
+/* Reads the kernel's clock page instead of making a system
+   call. */
+int clock_gettime(enum clock_id clock, struct timespec* ts) {
+  int64_t boot_time;
+  int64_t ns = clock_page_read((const struct clock_page*)CLOCK_PAGE_ADDR, &boot_time);
+
+  switch (clock) {
+    case CLOCK_REALTIME:
+      ts->tv_sec = boot_time + ns / 1000000000;
+      break;
+    case CLOCK_MONOTONIC:
+      ts->tv_sec = ns / 1000000000;
+      break;
+    default:
+      return -1;
+  }
+  ts->tv_nsec = ns % 1000000000;
+  return 0;
+}
+
+bool set_deadline(unsigned period_ms, unsigned budget_ms) {
+  return syscall2(SYS_SET_DEADLINE, period_ms, budget_ms);
+}
 
-pid_t fork(void) { return syscall0(SYS_FORK); }
\ No newline at end of file
+bool set_quota(unsigned cpu_percent, unsigned io_rate) {
+  return syscall2(SYS_SET_QUOTA, cpu_percent, io_rate);
+}
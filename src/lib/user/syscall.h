@@ -3,21 +3,46 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <dirent.h>
+#include <mman.h>
+#include <poll.h>
 #include <pthread.h>
+#include <ring.h>
+#include <spawn.h>
+#include <stats.h>
 #include <stdlib.h>
+#include <time.h>
+#include <uio.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) - 1)
 
-/* Synchronization Types */
-typedef char lock_t;
-typedef char sema_t;
+/* Synchronization types, implemented in lib/user/synch.c on top
+   of futexes.  The members are private to the implementation.  A
+   lock is a pthread mutex. */
+typedef pthread_mutex_t lock_t;
+typedef struct {
+  int value;      /* Current value. */
+  int waiters;    /* Number of threads in sema_down() that may sleep. */
+  unsigned magic; /* Detects uninitialized semaphores. */
+} sema_t;
 
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) - 1)
 
+/* Shared memory region identifier. */
+typedef int shmid_t;
+#define SHM_FAILED ((shmid_t) - 1)
+
+/* Message queue identifier. */
+typedef int mqid_t;
+#define MQ_FAILED ((mqid_t) - 1)
+
+/* Largest message, in bytes. */
+#define MQ_MSG_MAX (64 * 1024)
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -29,13 +54,27 @@ typedef int mapid_t;
 void halt(void) NO_RETURN;
 void exit(int status) NO_RETURN;
 pid_t exec(const char* file);
+pid_t exec_argv(char* const argv[]);
 int wait(pid_t);
+pid_t wait_any(int* status);
 bool create(const char* file, unsigned initial_size);
 bool remove(const char* file);
 int open(const char* file);
 int filesize(int fd);
 int read(int fd, void* buffer, unsigned length);
 int write(int fd, const void* buffer, unsigned length);
+int readv(int fd, const struct iovec* iov, size_t iov_cnt);
+int writev(int fd, const struct iovec* iov, size_t iov_cnt);
+int pread(int fd, void* buffer, unsigned length, unsigned offset);
+int pwrite(int fd, const void* buffer, unsigned length, unsigned offset);
+int copy_file_range(int in_fd, int out_fd, unsigned length);
+int sendfile(int out_fd, int in_fd, unsigned length);
+int fallocate(int fd, unsigned offset, unsigned length);
+int pipe(int fds[2]);
+int poll(struct pollfd* fds, size_t cnt, int timeout);
+int eventfd(unsigned count);
+int timerfd_create(void);
+int timerfd_settime(int fd, const struct itimerspec* spec);
 void seek(int fd, unsigned position);
 unsigned tell(int fd);
 void close(int fd);
@@ -50,11 +89,26 @@ void lock_release(lock_t* lock);
 bool sema_init(sema_t* sema, int val);
 void sema_down(sema_t* sema);
 void sema_up(sema_t* sema);
+bool futex_wait(int* uaddr, int val);
+int futex_wake(int* uaddr, int cnt);
+int futex_wake_all(int* uaddr);
+bool sched_yield_to(tid_t tid);
 tid_t get_tid(void);
+bool set_tls(void* base);
 
 /* Project 3 and optionally project 4. */
 mapid_t mmap(int fd, void* addr);
 void munmap(mapid_t);
+bool madvise(void* addr, size_t length, int advice);
+bool mlock(void* addr, size_t length);
+bool munlock(void* addr, size_t length);
+bool set_evict_priority(int priority);
+shmid_t shm_create(size_t size);
+void* shm_attach(shmid_t, void* addr);
+bool shm_detach(void* addr);
+mqid_t mq_create(void);
+int mq_send(mqid_t, const void* buf, size_t size);
+int mq_receive(mqid_t, void* buf, size_t size);
 
 /* Project 4 only. */
 bool chdir(const char* dir);
@@ -62,7 +116,43 @@ bool mkdir(const char* dir);
 bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
+int getdents(int fd, struct dirent* buf, unsigned size);
+int openat(int dirfd, const char* file);
+bool createat(int dirfd, const char* file, unsigned initial_size);
+bool unlinkat(int dirfd, const char* file);
+bool clone_file(const char* src, const char* dst);
+
+/* Durability. */
+int fsync(int fd);
+int fdatasync(int fd);
+void sync(void);
 
 pid_t fork(void);
+pid_t spawn(const char* cmd_line, const struct spawn_fd* fds, size_t fd_cnt);
+void* sbrk(intptr_t increment);
+
+/* Batched I/O, see <ring.h>. */
+int ring_enter(struct io_ring* ring);
+void ring_init(struct io_ring* ring);
+bool ring_queue(struct io_ring* ring, enum ring_op op, int fd, void* buf, unsigned size,
+                uint32_t user_data);
+bool ring_reap(struct io_ring* ring, struct ring_cqe* cqe);
+
+/* Statistics. */
+bool sched_stats(struct sched_stats* stats);
+bool getrusage(struct rusage* usage);
+bool fsstat(struct fs_stats* stats);
+bool blkstat(int idx, struct block_stats* stats);
+bool syscall_stats(bool global, struct syscall_stats* stats);
+
+/* Tuning. */
+bool sysctl(const char* name, int* old_value, const int* new_value);
+
+/* Time. */
+int clock_gettime(enum clock_id clock, struct timespec* ts);
+
+/* Scheduling. */
+bool set_deadline(unsigned period_ms, unsigned budget_ms);
+bool set_quota(unsigned cpu_percent, unsigned io_rate);
 
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,351 @@
+#include <task.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <syscall.h>
+
+/* Each worker owns a work-stealing deque from David Chase and
+   Yossi Lev, "Dynamic Circular Work-Stealing Deque", with the
+   memory orderings of Lê, Pop, Cohen and Zappa Nardelli,
+   "Correct and Efficient Work-Stealing for Weak Memory Models".
+   The owner pushes and takes tasks at the bottom without any
+   locked instruction except when one task is left; other workers
+   steal from the top with a compare-and-swap.  Unlike the paper's
+   deque, ours does not grow: a task that does not fit simply runs
+   at once in the thread that spawned it.
+
+   A worker that finds no work anywhere goes to sleep on the
+   wake_gen futex.  It first counts itself in idle_cnt and then
+   looks once more, so a task pushed in between is either found
+   by that second look or, because the spawner sees idle_cnt
+   nonzero, wakes it. */
+
+#define DEQUE_SIZE 256   /* Tasks per deque, a power of 2. */
+#define STACK_SLOTS 128  /* Stack slots per process, see userprog/process.h. */
+
+/* A worker's deque of tasks. */
+struct deque {
+  unsigned top;    /* Index of the oldest task, advanced by thieves. */
+  unsigned bottom; /* Index one past the newest task, owner only. */
+  struct task* tasks[DEQUE_SIZE];
+};
+
+/* A worker thread. */
+struct worker {
+  struct deque deque; /* Tasks spawned by this worker. */
+  unsigned rand;      /* State for choosing whom to steal from. */
+  tid_t tid;          /* Thread, unused for the initial thread. */
+};
+
+static struct worker workers[TASK_MAX_WORKERS];
+static int worker_cnt;
+
+/* Worker running on each stack slot, or null. */
+static struct worker* slot_workers[STACK_SLOTS];
+
+static int stopping; /* Nonzero when the workers should exit. */
+static int idle_cnt; /* Workers that may be sleeping on wake_gen. */
+static int wake_gen; /* Futex bumped to wake sleeping workers. */
+
+static void worker_main(void* worker);
+
+/* Returns the worker that the running thread is, or a null
+   pointer if it is not one. */
+static struct worker* current_worker(void) {
+  int slot = pthread_slot();
+  return slot >= 0 && slot < STACK_SLOTS ? slot_workers[slot] : NULL;
+}
+
+/* Pushes T on the bottom of D, which the running thread must
+   own.  Returns false if D is full. */
+static bool deque_push(struct deque* d, struct task* t) {
+  unsigned b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  unsigned top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+  if (b - top >= DEQUE_SIZE)
+    return false;
+  __atomic_store_n(&d->tasks[b % DEQUE_SIZE], t, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+/* Takes the newest task from D, which the running thread must
+   own.  Returns a null pointer if D is empty. */
+static struct task* deque_take(struct deque* d) {
+  unsigned b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+  unsigned top;
+  struct task* t = NULL;
+
+  __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+  if ((int)(b - top) >= 0) {
+    t = __atomic_load_n(&d->tasks[b % DEQUE_SIZE], __ATOMIC_RELAXED);
+    if (b == top) {
+      /* Last task: race the thieves for it. */
+      if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, false, __ATOMIC_SEQ_CST,
+                                       __ATOMIC_RELAXED))
+        t = NULL;
+      __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+  } else
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+  return t;
+}
+
+/* Steals the oldest task from D, which another worker owns.
+   Returns a null pointer if D is empty or another thread got the
+   task first. */
+static struct task* deque_steal(struct deque* d) {
+  unsigned top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  unsigned b;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+  if ((int)(b - top) > 0) {
+    struct task* t = __atomic_load_n(&d->tasks[top % DEQUE_SIZE], __ATOMIC_RELAXED);
+    if (__atomic_compare_exchange_n(&d->top, &top, top + 1, false, __ATOMIC_SEQ_CST,
+                                    __ATOMIC_RELAXED))
+      return t;
+  }
+  return NULL;
+}
+
+/* Returns a task for SELF to run, from its own deque if possible
+   and otherwise stolen from another worker, or a null pointer if
+   none was found. */
+static struct task* find_task(struct worker* self) {
+  struct task* t = deque_take(&self->deque);
+  int start, i;
+
+  if (t != NULL)
+    return t;
+
+  /* Start at a random victim, so that thieves spread out. */
+  self->rand = self->rand * 1103515245 + 12345;
+  start = (self->rand >> 16) % worker_cnt;
+  for (i = 0; i < worker_cnt; i++) {
+    struct worker* victim = &workers[(start + i) % worker_cnt];
+    if (victim != self && (t = deque_steal(&victim->deque)) != NULL)
+      return t;
+  }
+  return NULL;
+}
+
+/* Runs T and marks it finished in its group. */
+static void run_task(struct task* t) {
+  struct task_group* group = t->group;
+
+  t->func(t->aux);
+
+  /* Once pending reaches zero, task_wait() may return and GROUP
+     go out of scope, so reading `waiting' afterward can see
+     garbage.  At worst that causes a spurious wakeup, which every
+     futex_wait() caller tolerates. */
+  if (__atomic_sub_fetch(&group->pending, 1, __ATOMIC_SEQ_CST) == 0 &&
+      __atomic_load_n(&group->waiting, __ATOMIC_SEQ_CST))
+    futex_wake(&group->pending, INT_MAX);
+}
+
+/* Starts the task runtime with WORKER_CNT workers, counting the
+   running thread as the first one, and limited to 1 through
+   TASK_MAX_WORKERS.  Returns false if not all of the workers
+   could be started, in which case the runtime still works with
+   those that were. */
+bool task_runtime_init(int cnt) {
+  int i;
+
+  if (cnt < 1)
+    cnt = 1;
+  if (cnt > TASK_MAX_WORKERS)
+    cnt = TASK_MAX_WORKERS;
+
+  stopping = idle_cnt = wake_gen = 0;
+  for (i = 0; i < cnt; i++) {
+    workers[i].deque.top = workers[i].deque.bottom = 0;
+    workers[i].rand = i + 1;
+  }
+  worker_cnt = cnt;
+  slot_workers[pthread_slot()] = &workers[0];
+
+  for (i = 1; i < cnt; i++) {
+    workers[i].tid = pthread_create(worker_main, &workers[i]);
+    if (workers[i].tid == TID_ERROR) {
+      worker_cnt = i;
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Stops the workers started by task_runtime_init() and waits for
+   them to exit.  No tasks may be pending. */
+void task_runtime_shutdown(void) {
+  int i;
+
+  __atomic_store_n(&stopping, 1, __ATOMIC_SEQ_CST);
+  __atomic_fetch_add(&wake_gen, 1, __ATOMIC_SEQ_CST);
+  futex_wake(&wake_gen, INT_MAX);
+  for (i = 1; i < worker_cnt; i++)
+    pthread_join(workers[i].tid);
+
+  slot_workers[pthread_slot()] = NULL;
+  worker_cnt = 0;
+}
+
+/* Returns the number of workers, including the initial thread. */
+int task_worker_cnt(void) { return worker_cnt; }
+
+/* Runs tasks until told to stop. */
+static void worker_main(void* worker_) {
+  struct worker* self = worker_;
+
+  slot_workers[pthread_slot()] = self;
+  for (;;) {
+    struct task* t = find_task(self);
+
+    if (t == NULL) {
+      int gen;
+
+      __atomic_fetch_add(&idle_cnt, 1, __ATOMIC_SEQ_CST);
+      gen = __atomic_load_n(&wake_gen, __ATOMIC_SEQ_CST);
+      t = find_task(self);
+      if (t == NULL && !__atomic_load_n(&stopping, __ATOMIC_SEQ_CST))
+        futex_wait(&wake_gen, gen);
+      __atomic_fetch_sub(&idle_cnt, 1, __ATOMIC_SEQ_CST);
+    }
+
+    if (t != NULL)
+      run_task(t);
+    else if (__atomic_load_n(&stopping, __ATOMIC_SEQ_CST))
+      break;
+  }
+  slot_workers[pthread_slot()] = NULL;
+}
+
+/* Initializes GROUP as a group with no tasks. */
+void task_group_init(struct task_group* group) {
+  group->pending = 0;
+  group->waiting = 0;
+}
+
+/* Spawns T, which will call FUNC given AUX, as a member of GROUP.
+   T must stay valid until task_wait() on GROUP returns.  Called
+   from a thread that is not a worker, or when the worker's deque
+   is full, runs the task at once instead. */
+void task_spawn(struct task_group* group, struct task* t, task_func* func, void* aux) {
+  struct worker* self = current_worker();
+
+  t->func = func;
+  t->aux = aux;
+  t->group = group;
+  __atomic_fetch_add(&group->pending, 1, __ATOMIC_SEQ_CST);
+
+  if (self == NULL || !deque_push(&self->deque, t)) {
+    run_task(t);
+    return;
+  }
+
+  /* Let a sleeping worker come and steal the task.  The fence
+     orders the push before reading idle_cnt; see the comment at
+     the top of the file. */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&idle_cnt, __ATOMIC_SEQ_CST) > 0) {
+    __atomic_fetch_add(&wake_gen, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&wake_gen, 1);
+  }
+}
+
+/* Waits until every task in GROUP has finished.  While waiting,
+   a worker runs other tasks, its own first, so it only sleeps
+   when there is nothing left that it could do. */
+void task_wait(struct task_group* group) {
+  struct worker* self = current_worker();
+
+  for (;;) {
+    struct task* t;
+    int pending;
+
+    if (__atomic_load_n(&group->pending, __ATOMIC_SEQ_CST) == 0)
+      return;
+
+    t = self != NULL ? find_task(self) : NULL;
+    if (t != NULL) {
+      run_task(t);
+      continue;
+    }
+
+    __atomic_store_n(&group->waiting, 1, __ATOMIC_SEQ_CST);
+    pending = __atomic_load_n(&group->pending, __ATOMIC_SEQ_CST);
+    if (pending == 0)
+      return;
+    futex_wait(&group->pending, pending);
+  }
+}
+
+/* A parallel loop. */
+struct pfor {
+  parallel_for_func* body;
+  void* aux;
+  int grain;
+};
+
+/* A subrange of a parallel loop, spawned as a task. */
+struct pfor_range {
+  struct task task;
+  const struct pfor* pfor;
+  int begin, end;
+};
+
+static void pfor_split(const struct pfor*, int begin, int end);
+
+/* Runs the subrange in RANGE_. */
+static void pfor_task(void* range_) {
+  struct pfor_range* range = range_;
+  pfor_split(range->pfor, range->begin, range->end);
+}
+
+/* Runs P over [BEGIN, END), splitting the range in half and
+   spawning the upper half as a task until it is no longer than
+   the loop's grain. */
+static void pfor_split(const struct pfor* p, int begin, int end) {
+  struct task_group group;
+  struct pfor_range upper;
+  int mid;
+
+  if (end - begin <= p->grain) {
+    if (begin < end)
+      p->body(begin, end, p->aux);
+    return;
+  }
+
+  mid = begin + (end - begin) / 2;
+  upper.pfor = p;
+  upper.begin = mid;
+  upper.end = end;
+  task_group_init(&group);
+  task_spawn(&group, &upper.task, pfor_task, &upper);
+  pfor_split(p, begin, mid);
+  task_wait(&group);
+}
+
+/* Calls BODY given AUX on subranges that together cover [BEGIN,
+   END) exactly once, in parallel on the workers.  No subrange is
+   longer than GRAIN; if GRAIN is not positive, picks one that
+   gives each worker several pieces.  Returns once all have been
+   run. */
+void parallel_for(int begin, int end, int grain, parallel_for_func* body, void* aux) {
+  struct pfor p;
+
+  if (grain <= 0) {
+    int workers = worker_cnt > 0 ? worker_cnt : 1;
+    grain = (end - begin) / (8 * workers);
+    if (grain < 1)
+      grain = 1;
+  }
+  p.body = body;
+  p.aux = aux;
+  p.grain = grain;
+  pfor_split(&p, begin, end);
+}
@@ -0,0 +1,54 @@
+#ifndef __LIB_USER_TASK_H
+#define __LIB_USER_TASK_H
+
+#include <stdbool.h>
+
+/* Task runtime.
+
+   Runs many small tasks on a fixed pool of worker threads, so
+   that parallel code does not pay for a kernel thread and a user
+   stack per unit of work.  Each worker keeps its own deque of
+   tasks and takes work from the deques of other workers when its
+   own runs dry.
+
+   Like the kernel's lists, the runtime allocates nothing:
+   task_spawn() takes a struct task supplied by the caller, which
+   must stay valid until task_wait() on its group returns.
+   Typically both live in the spawning function's stack frame.
+
+   Only the thread that called task_runtime_init() and the tasks
+   themselves may spawn and wait for tasks.  Tasks spawned by any
+   other thread simply run at once. */
+
+/* Maximum number of workers, including the initial thread. */
+#define TASK_MAX_WORKERS 16
+
+/* A function run as a task, given auxiliary data AUX. */
+typedef void task_func(void* aux);
+
+/* A set of tasks that can be waited for together. */
+struct task_group {
+  int pending; /* Tasks spawned but not yet finished. */
+  int waiting; /* Nonzero if task_wait() may be sleeping. */
+};
+
+/* A spawned task.  Members are private to the runtime. */
+struct task {
+  task_func* func;
+  void* aux;
+  struct task_group* group;
+};
+
+bool task_runtime_init(int worker_cnt);
+void task_runtime_shutdown(void);
+int task_worker_cnt(void);
+
+void task_group_init(struct task_group*);
+void task_spawn(struct task_group*, struct task*, task_func*, void* aux);
+void task_wait(struct task_group*);
+
+/* Body of a parallel loop, run on the subrange [BEGIN, END). */
+typedef void parallel_for_func(int begin, int end, void* aux);
+void parallel_for(int begin, int end, int grain, parallel_for_func*, void* aux);
+
+#endif /* lib/user/task.h */
@@ -0,0 +1,17 @@
+#include "tests/bench/bench.h"
+#include <stdio.h>
+#include <syscall.h>
+#include <time.h>
+#include "tests/lib.h"
+
+/* Returns the current time in nanoseconds. */
+int64_t bench_now(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    fail("clock_gettime(CLOCK_MONOTONIC) failed");
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Reports VALUE as this benchmark's result for KEY. */
+void bench_report(const char* key, int64_t value) { printf("%s.%s=%lld\n", test_name, key, value); }
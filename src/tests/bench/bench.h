@@ -0,0 +1,17 @@
+#ifndef TESTS_BENCH_BENCH_H
+#define TESTS_BENCH_BENCH_H
+
+#include <stdint.h>
+
+/* Helpers for the benchmarks, which are built into the kernel
+   (tests/bench/kernel) or as user programs (tests/bench).
+
+   A benchmark reports each result as a line of the form
+   NAME.KEY=VALUE, where NAME is the benchmark's name, so that
+   "make bench" can collect the results of every benchmark into
+   one file.  Times are in nanoseconds. */
+
+int64_t bench_now(void);
+void bench_report(const char* key, int64_t value);
+
+#endif /* tests/bench/bench.h */
@@ -0,0 +1,18 @@
+# Checks that benchmark $test ran cleanly and reported a value
+# for each of KEYS.
+sub check_bench {
+    my (@keys) = @_;
+    our ($test);
+
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+
+    my ($name) = $test =~ m%([^/]+)$%;
+    foreach my $key (@keys) {
+	fail "$name did not report $key.\n"
+	  if !grep (/^\Q$name.$key\E=-?\d+$/, @output);
+    }
+    pass;
+}
+
+1;
@@ -0,0 +1,3 @@
+/* Child process for the proc benchmark, which only exits. */
+
+int main(void) { return 0; }
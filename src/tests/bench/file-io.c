@@ -0,0 +1,52 @@
+/* Measures file creation and sequential reads and writes of a
+   file in 1 kB chunks. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE 1024
+#define FILE_KB 64
+#define CREATE_ITERS 20
+
+static char buf[CHUNK_SIZE];
+
+void test_main(void) {
+  char name[16];
+  int64_t start;
+  int fd, i;
+
+  start = bench_now();
+  for (i = 0; i < CREATE_ITERS; i++) {
+    snprintf(name, sizeof name, "empty%d", i);
+    if (!create(name, 0))
+      fail("create \"%s\" failed", name);
+  }
+  bench_report("create_ns", (bench_now() - start) / CREATE_ITERS);
+  for (i = 0; i < CREATE_ITERS; i++) {
+    snprintf(name, sizeof name, "empty%d", i);
+    remove(name);
+  }
+
+  if (!create("data", 0) || (fd = open("data")) < 2)
+    fail("create \"data\" failed");
+  memset(buf, 'x', sizeof buf);
+  start = bench_now();
+  for (i = 0; i < FILE_KB; i++)
+    if (write(fd, buf, sizeof buf) != CHUNK_SIZE)
+      fail("write failed at %d kB", i);
+  bench_report("write_ns_per_kb", (bench_now() - start) / FILE_KB);
+
+  seek(fd, 0);
+  start = bench_now();
+  for (i = 0; i < FILE_KB; i++)
+    if (read(fd, buf, sizeof buf) != CHUNK_SIZE)
+      fail("read failed at %d kB", i);
+  bench_report("read_ns_per_kb", (bench_now() - start) / FILE_KB);
+
+  close(fd);
+  remove("data");
+}
@@ -0,0 +1,4 @@
+# -*- perl -*-
+use tests::tests;
+use tests::bench::bench;
+check_bench (qw(create_ns write_ns_per_kb read_ns_per_kb));
@@ -0,0 +1,44 @@
+/* Measures the throughput of malloc() and free() for small and
+   mixed-size blocks and of palloc_get_page() and
+   palloc_free_page(). */
+
+#include <random.h>
+#include "tests/bench/bench.h"
+#include "tests/bench/kernel/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+
+#define SMALL_ITERS 20000
+#define BATCH_SIZE 256
+#define BATCH_ROUNDS 40
+#define PAGE_ITERS 2000
+
+static void* blocks[BATCH_SIZE];
+
+void bench_alloc(void) {
+  int64_t start;
+  int i, j;
+
+  start = bench_now();
+  for (i = 0; i < SMALL_ITERS; i++)
+    free(malloc(64));
+  bench_report("malloc64_ns", (bench_now() - start) / SMALL_ITERS);
+
+  /* Many live blocks of sizes up to 2 kB, freed in a different
+     order than they were allocated. */
+  random_init(0);
+  start = bench_now();
+  for (i = 0; i < BATCH_ROUNDS; i++) {
+    for (j = 0; j < BATCH_SIZE; j++)
+      if ((blocks[j] = malloc(random_ulong() % 2048 + 1)) == NULL)
+        fail("out of memory");
+    for (j = 0; j < BATCH_SIZE; j++)
+      free(blocks[(j * 7) % BATCH_SIZE]);
+  }
+  bench_report("malloc_mixed_ns", (bench_now() - start) / (BATCH_ROUNDS * BATCH_SIZE));
+
+  start = bench_now();
+  for (i = 0; i < PAGE_ITERS; i++)
+    palloc_free_page(palloc_get_page(0));
+  bench_report("palloc_ns", (bench_now() - start) / PAGE_ITERS);
+}
@@ -0,0 +1,4 @@
+# -*- perl -*-
+use tests::tests;
+use tests::bench::bench;
+check_bench (qw(malloc64_ns malloc_mixed_ns palloc_ns));
@@ -0,0 +1,37 @@
+/* Measures the cost of a context switch by passing control back
+   and forth between two threads through a pair of semaphores. */
+
+#include "tests/bench/bench.h"
+#include "tests/bench/kernel/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define ROUND_TRIPS 10000
+
+static struct semaphore ping, pong;
+
+static void ponger(void* aux UNUSED) {
+  int i;
+
+  for (i = 0; i < ROUND_TRIPS; i++) {
+    sema_down(&ping);
+    sema_up(&pong);
+  }
+}
+
+void bench_ctx_switch(void) {
+  int64_t start;
+  int i;
+
+  sema_init(&ping, 0);
+  sema_init(&pong, 0);
+  thread_create("ponger", thread_get_priority(), ponger, NULL);
+
+  /* Each round trip switches to the ponger and back. */
+  start = bench_now();
+  for (i = 0; i < ROUND_TRIPS; i++) {
+    sema_up(&ping);
+    sema_down(&pong);
+  }
+  bench_report("switch_ns", (bench_now() - start) / (2 * ROUND_TRIPS));
+}
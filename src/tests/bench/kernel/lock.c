@@ -0,0 +1,61 @@
+/* Measures lock_acquire() and lock_release(), first with the
+   lock always free, then with another thread always waiting for
+   it. */
+
+#include "tests/bench/bench.h"
+#include "tests/bench/kernel/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define UNCONTENDED_ITERS 100000
+#define CONTENDED_ITERS 5000
+
+static struct lock lock;
+static struct semaphore done;
+static bool stop;
+
+/* Keeps trying to take LOCK until told to stop. */
+static void contender(void* aux UNUSED) {
+  for (;;) {
+    lock_acquire(&lock);
+    if (stop)
+      break;
+    thread_yield();
+    lock_release(&lock);
+  }
+  lock_release(&lock);
+  sema_up(&done);
+}
+
+void bench_lock(void) {
+  int64_t start;
+  int i;
+
+  lock_init(&lock);
+  sema_init(&done, 0);
+
+  start = bench_now();
+  for (i = 0; i < UNCONTENDED_ITERS; i++) {
+    lock_acquire(&lock);
+    lock_release(&lock);
+  }
+  bench_report("uncontended_ns", (bench_now() - start) / UNCONTENDED_ITERS);
+
+  /* Yielding while holding the lock lets the contender run and
+     block in lock_acquire(), so every release has a waiter to
+     wake. */
+  stop = false;
+  thread_create("contender", thread_get_priority(), contender, NULL);
+  start = bench_now();
+  for (i = 0; i < CONTENDED_ITERS; i++) {
+    lock_acquire(&lock);
+    thread_yield();
+    lock_release(&lock);
+  }
+  bench_report("contended_ns", (bench_now() - start) / CONTENDED_ITERS);
+
+  lock_acquire(&lock);
+  stop = true;
+  lock_release(&lock);
+  sema_down(&done);
+}
@@ -0,0 +1,38 @@
+#include "tests/bench/kernel/tests.h"
+#include <test-lib.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "tests/bench/bench.h"
+
+static const struct test bench_tests[] = {
+    {"ctx-switch", bench_ctx_switch},
+    {"lock", bench_lock},
+    {"timer-jitter", bench_timer_jitter},
+    {"alloc", bench_alloc},
+};
+
+/* Runs the kernel benchmark named NAME. */
+void run_bench_test(const char* name) {
+  const struct test* t;
+
+  for (t = bench_tests; t < bench_tests + sizeof bench_tests / sizeof *bench_tests; t++)
+    if (!strcmp(name, t->name)) {
+      test_name = name;
+      msg("begin");
+      t->function();
+      msg("end");
+      return;
+    }
+  PANIC("no benchmark named \"%s\"", name);
+}
+
+/* Returns the current time in nanoseconds. */
+int64_t bench_now(void) { return clock_ns(); }
+
+/* Reports VALUE as this benchmark's result for KEY. */
+void bench_report(const char* key, int64_t value) {
+  printf("%s.%s=%" PRId64 "\n", test_name, key, value);
+}
@@ -0,0 +1,13 @@
+#ifndef TESTS_BENCH_KERNEL_TESTS_H
+#define TESTS_BENCH_KERNEL_TESTS_H
+
+#include <test-lib.h>
+
+void run_bench_test(const char*);
+
+extern test_func bench_ctx_switch;
+extern test_func bench_lock;
+extern test_func bench_timer_jitter;
+extern test_func bench_alloc;
+
+#endif /* tests/bench/kernel/tests.h */
@@ -0,0 +1,43 @@
+/* Measures how late timer_sleep() and timer_usleep() wake up
+   compared with the time asked for. */
+
+#include "devices/timer.h"
+#include "tests/bench/bench.h"
+#include "tests/bench/kernel/tests.h"
+#include "threads/thread.h"
+
+#define SAMPLES 50
+#define NS_PER_TICK (1000000000LL / TIMER_FREQ)
+#define USLEEP_US 200
+
+/* Sleeps SAMPLES times by calling SLEEP with ARG and reports the
+   mean and maximum amount by which each sleep overshot NS
+   nanoseconds under KEY_MEAN and KEY_MAX. */
+static void measure(void (*sleep)(int64_t), int64_t arg, int64_t ns, const char* key_mean,
+                    const char* key_max) {
+  int64_t total = 0, max = 0;
+  int i;
+
+  for (i = 0; i < SAMPLES; i++) {
+    int64_t start = bench_now();
+    int64_t late;
+
+    sleep(arg);
+    late = bench_now() - start - ns;
+    if (late < 0)
+      late = -late;
+    total += late;
+    if (late > max)
+      max = late;
+  }
+  bench_report(key_mean, total / SAMPLES);
+  bench_report(key_max, max);
+}
+
+void bench_timer_jitter(void) {
+  /* Line up with a tick boundary, so that each one-tick sleep
+     after it should take exactly one tick. */
+  timer_sleep(1);
+  measure(timer_sleep, 1, NS_PER_TICK, "tick_mean_ns", "tick_max_ns");
+  measure(timer_usleep, USLEEP_US, USLEEP_US * 1000LL, "usleep_mean_ns", "usleep_max_ns");
+}
@@ -0,0 +1,4 @@
+# -*- perl -*-
+use tests::tests;
+use tests::bench::bench;
+check_bench (qw(tick_mean_ns tick_max_ns usleep_mean_ns usleep_max_ns));
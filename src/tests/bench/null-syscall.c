@@ -0,0 +1,20 @@
+/* Measures the cost of the cheapest system call, practice(),
+   which only adds 1 to its argument. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITERS 20000
+
+void test_main(void) {
+  int64_t start;
+  int i;
+
+  start = bench_now();
+  for (i = 0; i < ITERS; i++)
+    if (practice(i) != i + 1)
+      fail("practice(%d) returned the wrong value", i);
+  bench_report("syscall_ns", (bench_now() - start) / ITERS);
+}
@@ -0,0 +1,39 @@
+/* Measures process creation round trips: fork() of a child that
+   exits at once, and exec() of a trivial program, each followed
+   by wait(). */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FORK_ITERS 20
+#define EXEC_ITERS 10
+
+void test_main(void) {
+  int64_t start;
+  pid_t pid;
+  int i;
+
+  start = bench_now();
+  for (i = 0; i < FORK_ITERS; i++) {
+    pid = fork();
+    if (pid == 0)
+      exit(0);
+    if (pid < 0)
+      fail("fork failed");
+    if (wait(pid) != 0)
+      fail("forked child did not exit cleanly");
+  }
+  bench_report("fork_wait_ns", (bench_now() - start) / FORK_ITERS);
+
+  start = bench_now();
+  for (i = 0; i < EXEC_ITERS; i++) {
+    pid = exec("child-exit");
+    if (pid < 0)
+      fail("exec \"child-exit\" failed");
+    if (wait(pid) != 0)
+      fail("\"child-exit\" did not exit cleanly");
+  }
+  bench_report("exec_wait_ns", (bench_now() - start) / EXEC_ITERS);
+}
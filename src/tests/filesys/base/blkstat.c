@@ -0,0 +1,65 @@
+/* Checks that blkstat() reports the requests that an fsync()
+   sends to the disk, and that getrusage() and sched_stats()
+   charge them to this process and thread. */
+
+#include <stats.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 2048
+
+static char buf[FILE_SIZE];
+static struct block_stats stats;
+
+/* Returns the number of requests completed by all block
+   devices. */
+static uint64_t total_requests(void) {
+  uint64_t total = 0;
+  int i;
+
+  for (i = 0; blkstat(i, &stats); i++) {
+    if (stats.name[0] == '\0')
+      fail("block device %d has no name", i);
+    total += stats.requests;
+  }
+  return total;
+}
+
+void test_main(void) {
+  struct rusage usage_before, usage_after;
+  struct sched_stats sched_before, sched_after;
+  uint64_t requests;
+  int fd;
+
+  CHECK(!blkstat(-1, &stats), "blkstat(-1) fails");
+  CHECK(!blkstat(1000, &stats), "blkstat(1000) fails");
+
+  CHECK(create("counted", 0), "create \"counted\"");
+  CHECK((fd = open("counted")) > 1, "open \"counted\"");
+  memset(buf, 'b', sizeof buf);
+  CHECK(write(fd, buf, sizeof buf) == FILE_SIZE, "write \"counted\"");
+
+  requests = total_requests();
+  getrusage(&usage_before);
+  sched_stats(&sched_before);
+  CHECK(fsync(fd) == 0, "fsync \"counted\"");
+  getrusage(&usage_after);
+  sched_stats(&sched_after);
+
+  if (total_requests() <= requests)
+    fail("fsync completed no block requests");
+  if (usage_after.block_writes <= usage_before.block_writes)
+    fail("fsync charged no sector writes to the process");
+  if (usage_after.block_wait_cycles <= usage_before.block_wait_cycles)
+    fail("fsync charged no I/O wait to the process");
+  if (sched_after.block_write_bytes - sched_before.block_write_bytes <
+      (usage_after.block_writes - usage_before.block_writes) * 512)
+    fail("fsync charged %llu bytes to the thread, expected %llu",
+         sched_after.block_write_bytes - sched_before.block_write_bytes,
+         (usage_after.block_writes - usage_before.block_writes) * 512);
+
+  msg("close \"counted\"");
+  close(fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(blkstat) begin
+(blkstat) blkstat(-1) fails
+(blkstat) blkstat(1000) fails
+(blkstat) create "counted"
+(blkstat) open "counted"
+(blkstat) write "counted"
+(blkstat) fsync "counted"
+(blkstat) close "counted"
+(blkstat) end
+EOF
+pass;
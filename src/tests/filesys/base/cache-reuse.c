@@ -0,0 +1,37 @@
+/* Reads a small file twice and checks that the second read is
+   served from the buffer cache, without reading the disk. */
+
+#include <stats.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 1024
+
+static char buf[FILE_SIZE];
+
+void test_main(void) {
+  struct rusage before, after;
+  int fd;
+
+  CHECK(create("cached", FILE_SIZE), "create \"cached\"");
+  CHECK((fd = open("cached")) > 1, "open \"cached\"");
+  memset(buf, 'c', sizeof buf);
+  CHECK(write(fd, buf, sizeof buf) == FILE_SIZE, "write \"cached\"");
+
+  msg("read \"cached\" twice");
+  seek(fd, 0);
+  if (read(fd, buf, sizeof buf) != FILE_SIZE)
+    fail("first read failed");
+  seek(fd, 0);
+  getrusage(&before);
+  if (read(fd, buf, sizeof buf) != FILE_SIZE)
+    fail("second read failed");
+  getrusage(&after);
+  if (after.block_reads != before.block_reads)
+    fail("second read went to disk for %llu sectors", after.block_reads - before.block_reads);
+
+  msg("close \"cached\"");
+  close(fd);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-reuse) begin
+(cache-reuse) create "cached"
+(cache-reuse) open "cached"
+(cache-reuse) write "cached"
+(cache-reuse) read "cached" twice
+(cache-reuse) close "cached"
+(cache-reuse) end
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Clones a file with clone_file(), writes into the middle of the
+   clone and checks that the original is unchanged, then removes
+   the original and checks that the clone still reads back. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 20000
+#define PATCH_OFS 6000
+#define PATCH_SIZE 1000
+
+static char buf[FILE_SIZE];
+static char patched[FILE_SIZE];
+
+void test_main(void) {
+  int fd;
+
+  random_init(0);
+  random_bytes(buf, sizeof buf);
+  CHECK(create("orig", 0), "create \"orig\"");
+  CHECK((fd = open("orig")) > 1, "open \"orig\"");
+  CHECK(write(fd, buf, sizeof buf) == FILE_SIZE, "write \"orig\"");
+  msg("close \"orig\"");
+  close(fd);
+
+  CHECK(clone_file("orig", "clone"), "clone_file \"orig\" to \"clone\"");
+  check_file("clone", buf, sizeof buf);
+  CHECK(!clone_file("orig", "clone"), "clone_file to existing \"clone\" fails");
+  CHECK(!clone_file("missing", "other"), "clone_file of missing file fails");
+
+  memcpy(patched, buf, sizeof buf);
+  memset(patched + PATCH_OFS, 0x5a, PATCH_SIZE);
+  CHECK((fd = open("clone")) > 1, "open \"clone\"");
+  seek(fd, PATCH_OFS);
+  CHECK(write(fd, patched + PATCH_OFS, PATCH_SIZE) == PATCH_SIZE, "write into \"clone\"");
+  msg("close \"clone\"");
+  close(fd);
+  check_file("orig", buf, sizeof buf);
+  check_file("clone", patched, sizeof patched);
+
+  CHECK(remove("orig"), "remove \"orig\"");
+  check_file("clone", patched, sizeof patched);
+}
@@ -0,0 +1,32 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(clone) begin
+(clone) create "orig"
+(clone) open "orig"
+(clone) write "orig"
+(clone) close "orig"
+(clone) clone_file "orig" to "clone"
+(clone) open "clone" for verification
+(clone) verified contents of "clone"
+(clone) close "clone"
+(clone) clone_file to existing "clone" fails
+(clone) clone_file of missing file fails
+(clone) open "clone"
+(clone) write into "clone"
+(clone) close "clone"
+(clone) open "orig" for verification
+(clone) verified contents of "orig"
+(clone) close "orig"
+(clone) open "clone" for verification
+(clone) verified contents of "clone"
+(clone) close "clone"
+(clone) remove "orig"
+(clone) open "clone" for verification
+(clone) verified contents of "clone"
+(clone) close "clone"
+(clone) end
+EOF
+pass;
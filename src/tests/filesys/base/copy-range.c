@@ -0,0 +1,50 @@
+/* Copies a file with copy_file_range() and part of it with
+   sendfile(), then checks both copies and that bad fds are
+   rejected. */
+
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 5000
+#define PART_SIZE 1500
+
+static char buf[FILE_SIZE];
+
+void test_main(void) {
+  int in_fd, out_fd;
+
+  random_init(0);
+  random_bytes(buf, sizeof buf);
+  CHECK(create("source", 0), "create \"source\"");
+  CHECK((in_fd = open("source")) > 1, "open \"source\"");
+  CHECK(write(in_fd, buf, sizeof buf) == FILE_SIZE, "write \"source\"");
+
+  seek(in_fd, 0);
+  CHECK(create("copy", 0), "create \"copy\"");
+  CHECK((out_fd = open("copy")) > 1, "open \"copy\"");
+  CHECK(copy_file_range(in_fd, out_fd, FILE_SIZE + 100) == FILE_SIZE, "copy_file_range");
+  CHECK(copy_file_range(in_fd, out_fd, 100) == 0, "copy_file_range at end of file");
+  CHECK(tell(out_fd) == FILE_SIZE, "tell \"copy\"");
+  msg("close \"copy\"");
+  close(out_fd);
+  check_file("copy", buf, sizeof buf);
+
+  seek(in_fd, 0);
+  CHECK(create("part", 0), "create \"part\"");
+  CHECK((out_fd = open("part")) > 1, "open \"part\"");
+  CHECK(sendfile(out_fd, in_fd, PART_SIZE) == PART_SIZE, "sendfile");
+  CHECK(tell(in_fd) == PART_SIZE, "tell \"source\"");
+  msg("close \"part\"");
+  close(out_fd);
+  check_file("part", buf, PART_SIZE);
+
+  CHECK(copy_file_range(in_fd, STDOUT_FILENO, 10) == -1, "copy_file_range to console");
+  CHECK(copy_file_range(1234, in_fd, 10) == -1, "copy_file_range bad fd");
+  CHECK(sendfile(-1, in_fd, 10) == -1, "sendfile bad fd");
+  msg("close \"source\"");
+  close(in_fd);
+}
@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-range) begin
+(copy-range) create "source"
+(copy-range) open "source"
+(copy-range) write "source"
+(copy-range) create "copy"
+(copy-range) open "copy"
+(copy-range) copy_file_range
+(copy-range) copy_file_range at end of file
+(copy-range) tell "copy"
+(copy-range) close "copy"
+(copy-range) open "copy" for verification
+(copy-range) verified contents of "copy"
+(copy-range) close "copy"
+(copy-range) create "part"
+(copy-range) open "part"
+(copy-range) sendfile
+(copy-range) tell "source"
+(copy-range) close "part"
+(copy-range) open "part" for verification
+(copy-range) verified contents of "part"
+(copy-range) close "part"
+(copy-range) copy_file_range to console
+(copy-range) copy_file_range bad fd
+(copy-range) sendfile bad fd
+(copy-range) close "source"
+(copy-range) end
+EOF
+pass;
@@ -0,0 +1,39 @@
+/* Allocates space for a file with fallocate(), checks that the
+   file grew and reads back as zeros, then writes into part of it
+   and checks that the rest still reads as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 8192
+#define WRITE_OFS 1000
+#define WRITE_SIZE 3000
+
+static char buf[FILE_SIZE];
+static char expected[FILE_SIZE];
+
+void test_main(void) {
+  int fd;
+
+  CHECK(create("prealloc", 0), "create \"prealloc\"");
+  CHECK((fd = open("prealloc")) > 1, "open \"prealloc\"");
+  CHECK(fallocate(fd, 0, FILE_SIZE) == 0, "fallocate \"prealloc\"");
+  CHECK(filesize(fd) == FILE_SIZE, "filesize \"prealloc\"");
+  CHECK(read(fd, buf, sizeof buf) == FILE_SIZE, "read \"prealloc\"");
+  if (memcmp(buf, expected, sizeof buf))
+    fail("fallocated data is not zero");
+
+  memset(expected + WRITE_OFS, 'f', WRITE_SIZE);
+  seek(fd, WRITE_OFS);
+  CHECK(write(fd, expected + WRITE_OFS, WRITE_SIZE) == WRITE_SIZE, "write \"prealloc\"");
+  CHECK(fallocate(fd, 0, 100) == 0, "fallocate inside \"prealloc\"");
+  CHECK(filesize(fd) == FILE_SIZE, "filesize \"prealloc\"");
+
+  CHECK(fallocate(fd, 0, 0) == -1, "fallocate nothing");
+  CHECK(fallocate(1234, 0, 100) == -1, "fallocate bad fd");
+  msg("close \"prealloc\"");
+  close(fd);
+  check_file("prealloc", expected, sizeof expected);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fallocate) begin
+(fallocate) create "prealloc"
+(fallocate) open "prealloc"
+(fallocate) fallocate "prealloc"
+(fallocate) filesize "prealloc"
+(fallocate) read "prealloc"
+(fallocate) write "prealloc"
+(fallocate) fallocate inside "prealloc"
+(fallocate) filesize "prealloc"
+(fallocate) fallocate nothing
+(fallocate) fallocate bad fd
+(fallocate) close "prealloc"
+(fallocate) open "prealloc" for verification
+(fallocate) verified contents of "prealloc"
+(fallocate) close "prealloc"
+(fallocate) end
+EOF
+pass;
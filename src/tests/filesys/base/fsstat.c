@@ -0,0 +1,44 @@
+/* Checks that fsstat() counts the file system operations this
+   process performs. */
+
+#include <stats.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static struct fs_stats before, after;
+static char buf[1024];
+
+/* Fails unless operation OP was counted at least CNT more times
+   in AFTER than in BEFORE. */
+static void check_op(enum fs_op op, const char* name, uint64_t cnt) {
+  if (after.ops[op].cnt - before.ops[op].cnt < cnt)
+    fail("%s counted %llu times, expected at least %llu", name,
+         after.ops[op].cnt - before.ops[op].cnt, cnt);
+}
+
+void test_main(void) {
+  int fd;
+
+  CHECK(fsstat(&before), "fsstat");
+  CHECK(create("counted", 0), "create \"counted\"");
+  CHECK((fd = open("counted")) > 1, "open \"counted\"");
+  memset(buf, 'c', sizeof buf);
+  CHECK(write(fd, buf, sizeof buf) == sizeof buf, "write \"counted\"");
+  seek(fd, 0);
+  CHECK(read(fd, buf, sizeof buf) == sizeof buf, "read \"counted\"");
+  msg("close \"counted\"");
+  close(fd);
+  CHECK(remove("counted"), "remove \"counted\"");
+  CHECK(fsstat(&after), "fsstat");
+
+  check_op(FS_CREATE, "create", 1);
+  check_op(FS_OPEN, "open", 1);
+  check_op(FS_LOOKUP, "lookup", 1);
+  check_op(FS_WRITE, "write", 1);
+  check_op(FS_READ, "read", 1);
+  check_op(FS_REMOVE, "remove", 1);
+  if (after.cache_hits + after.cache_misses <= before.cache_hits + before.cache_misses)
+    fail("no cache lookups counted");
+}
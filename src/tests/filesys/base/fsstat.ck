@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsstat) begin
+(fsstat) fsstat
+(fsstat) create "counted"
+(fsstat) open "counted"
+(fsstat) write "counted"
+(fsstat) read "counted"
+(fsstat) close "counted"
+(fsstat) remove "counted"
+(fsstat) fsstat
+(fsstat) end
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* Writes a file, makes it durable with fsync(), and checks that
+   fdatasync() then has nothing left to write for it.  Also checks
+   that sync() works and that both calls reject a bad fd. */
+
+#include <stats.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 2048
+
+static char buf[FILE_SIZE];
+
+void test_main(void) {
+  struct rusage before, after;
+  int fd;
+
+  CHECK(create("synced", 0), "create \"synced\"");
+  CHECK((fd = open("synced")) > 1, "open \"synced\"");
+  memset(buf, 's', sizeof buf);
+  CHECK(write(fd, buf, sizeof buf) == FILE_SIZE, "write \"synced\"");
+  CHECK(fsync(fd) == 0, "fsync \"synced\"");
+
+  getrusage(&before);
+  CHECK(fdatasync(fd) == 0, "fdatasync \"synced\"");
+  getrusage(&after);
+  if (after.block_writes != before.block_writes)
+    fail("fdatasync of a clean file wrote %llu sectors", after.block_writes - before.block_writes);
+
+  msg("sync");
+  sync();
+
+  CHECK(fsync(-1) == -1, "fsync bad fd");
+  CHECK(fdatasync(1234) == -1, "fdatasync bad fd");
+
+  msg("close \"synced\"");
+  close(fd);
+  check_file("synced", buf, sizeof buf);
+}
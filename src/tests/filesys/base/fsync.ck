@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsync) begin
+(fsync) create "synced"
+(fsync) open "synced"
+(fsync) write "synced"
+(fsync) fsync "synced"
+(fsync) fdatasync "synced"
+(fsync) sync
+(fsync) fsync bad fd
+(fsync) fdatasync bad fd
+(fsync) close "synced"
+(fsync) open "synced" for verification
+(fsync) verified contents of "synced"
+(fsync) close "synced"
+(fsync) end
+EOF
+pass;
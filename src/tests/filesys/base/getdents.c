@@ -0,0 +1,76 @@
+/* Creates a directory's worth of files and lists the root
+   directory with getdents(), checking that every file turns up
+   exactly once with its size, type and inode number, that a few
+   calls are enough to list them all, and that the directory
+   cannot be written. */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 40
+
+/* Entries returned by one getdents() call. */
+#define BATCH 16
+
+static int seen[FILE_CNT];
+
+void test_main(void) {
+  struct dirent ents[BATCH];
+  char name[16];
+  int calls = 0;
+  int size;
+  int fd;
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++) {
+    snprintf(name, sizeof name, "f%d", i);
+    if (!create(name, i * 10))
+      fail("create \"%s\"", name);
+  }
+  msg("created %d files", FILE_CNT);
+
+  CHECK((fd = open("/")) > 1, "open \"/\"");
+  CHECK(isdir(fd), "isdir \"/\"");
+  CHECK(write(fd, "x", 1) == 0, "write \"/\" writes nothing");
+
+  while ((size = getdents(fd, ents, sizeof ents)) > 0) {
+    calls++;
+    if (size % sizeof *ents != 0)
+      fail("getdents returned %d bytes, not a whole number of entries", size);
+    for (i = 0; i < size / (int)sizeof *ents; i++) {
+      struct dirent* e = &ents[i];
+      int n, file_fd;
+
+      if (e->name[0] != 'f')
+        continue;
+      n = atoi(e->name + 1);
+      snprintf(name, sizeof name, "f%d", n);
+      if (n < 0 || n >= FILE_CNT || strcmp(name, e->name))
+        continue;
+      if (seen[n]++)
+        fail("\"%s\" listed twice", e->name);
+      if (e->type != DT_REG || e->size != (uint32_t)n * 10)
+        fail("\"%s\" listed as type %d, %u bytes", e->name, e->type, (unsigned)e->size);
+      file_fd = open(e->name);
+      if (file_fd < 2 || inumber(file_fd) != (int)e->inumber)
+        fail("\"%s\" listed with the wrong inode number", e->name);
+      close(file_fd);
+    }
+  }
+  if (size < 0)
+    fail("getdents failed");
+  for (i = 0; i < FILE_CNT; i++)
+    if (!seen[i])
+      fail("\"f%d\" not listed", i);
+  msg("listed %d files", FILE_CNT);
+  if (calls > FILE_CNT / BATCH + 2)
+    fail("took %d calls to list %d files", calls, FILE_CNT);
+  CHECK(getdents(fd, ents, sizeof ents) == 0, "getdents at end returns 0");
+  msg("close \"/\"");
+  close(fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(getdents) begin
+(getdents) created 40 files
+(getdents) open "/"
+(getdents) isdir "/"
+(getdents) write "/" writes nothing
+(getdents) listed 40 files
+(getdents) getdents at end returns 0
+(getdents) close "/"
+(getdents) end
+EOF
+pass;
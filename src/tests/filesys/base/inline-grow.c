@@ -0,0 +1,40 @@
+/* Writes a file small enough to stay in its inode, with a gap
+   that must read as zeros, checks it, then grows it past what the
+   inode holds and checks that nothing written before was lost. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SMALL_SIZE 20
+#define GAP_OFS 300
+#define FILE_SIZE 2000
+
+static char expected[FILE_SIZE];
+
+void test_main(void) {
+  int fd;
+
+  memset(expected, 'a', SMALL_SIZE);
+  memset(expected + GAP_OFS, 'b', SMALL_SIZE);
+  memset(expected + GAP_OFS + SMALL_SIZE, 'c', FILE_SIZE - GAP_OFS - SMALL_SIZE);
+
+  CHECK(create("tiny", 0), "create \"tiny\"");
+  CHECK((fd = open("tiny")) > 1, "open \"tiny\"");
+  CHECK(write(fd, expected, SMALL_SIZE) == SMALL_SIZE, "write \"tiny\"");
+  seek(fd, GAP_OFS);
+  CHECK(write(fd, expected + GAP_OFS, SMALL_SIZE) == SMALL_SIZE, "write \"tiny\" after gap");
+  msg("close \"tiny\"");
+  close(fd);
+  check_file("tiny", expected, GAP_OFS + SMALL_SIZE);
+
+  CHECK((fd = open("tiny")) > 1, "open \"tiny\"");
+  seek(fd, GAP_OFS + SMALL_SIZE);
+  CHECK(write(fd, expected + GAP_OFS + SMALL_SIZE, FILE_SIZE - GAP_OFS - SMALL_SIZE) ==
+            FILE_SIZE - GAP_OFS - SMALL_SIZE,
+        "grow \"tiny\"");
+  msg("close \"tiny\"");
+  close(fd);
+  check_file("tiny", expected, FILE_SIZE);
+}
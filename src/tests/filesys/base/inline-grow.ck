@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(inline-grow) begin
+(inline-grow) create "tiny"
+(inline-grow) open "tiny"
+(inline-grow) write "tiny"
+(inline-grow) write "tiny" after gap
+(inline-grow) close "tiny"
+(inline-grow) open "tiny" for verification
+(inline-grow) verified contents of "tiny"
+(inline-grow) close "tiny"
+(inline-grow) open "tiny"
+(inline-grow) grow "tiny"
+(inline-grow) close "tiny"
+(inline-grow) open "tiny" for verification
+(inline-grow) verified contents of "tiny"
+(inline-grow) close "tiny"
+(inline-grow) end
+EOF
+pass;
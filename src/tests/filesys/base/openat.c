@@ -0,0 +1,33 @@
+/* Creates, opens and removes a file relative to a directory
+   descriptor and to AT_FDCWD, and checks that a descriptor that
+   is not a directory is refused. */
+
+#include <dirent.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  int dir_fd, fd, dot_fd;
+
+  CHECK((dir_fd = open("/")) > 1, "open \"/\"");
+  CHECK(createat(dir_fd, "rel", 100), "createat \"rel\"");
+  CHECK((fd = openat(AT_FDCWD, "rel")) > 1, "openat AT_FDCWD \"rel\"");
+  CHECK(filesize(fd) == 100, "filesize \"rel\" is 100");
+  CHECK(!createat(fd, "nested", 0), "createat in a file fails");
+  CHECK(openat(fd, "rel") == -1, "openat in a file fails");
+  close(fd);
+
+  CHECK((fd = openat(dir_fd, "rel")) > 1, "openat \"rel\"");
+  CHECK(inumber(fd) > 0, "inumber \"rel\"");
+  close(fd);
+  CHECK((dot_fd = openat(dir_fd, ".")) > 1, "openat \".\"");
+  CHECK(isdir(dot_fd) && inumber(dot_fd) == inumber(dir_fd), "\".\" is the same directory");
+  close(dot_fd);
+
+  CHECK(unlinkat(dir_fd, "rel"), "unlinkat \"rel\"");
+  CHECK(open("rel") == -1, "open \"rel\" fails");
+  CHECK(!unlinkat(AT_FDCWD, "rel"), "unlinkat AT_FDCWD \"rel\" fails");
+  msg("close \"/\"");
+  close(dir_fd);
+}
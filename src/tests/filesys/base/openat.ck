@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(openat) begin
+(openat) open "/"
+(openat) createat "rel"
+(openat) openat AT_FDCWD "rel"
+(openat) filesize "rel" is 100
+(openat) createat in a file fails
+(openat) openat in a file fails
+(openat) openat "rel"
+(openat) inumber "rel"
+(openat) openat "."
+(openat) "." is the same directory
+(openat) unlinkat "rel"
+(openat) open "rel" fails
+(openat) unlinkat AT_FDCWD "rel" fails
+(openat) close "/"
+(openat) end
+EOF
+pass;
@@ -0,0 +1,64 @@
+/* Checks that set_quota() refuses bad and looser quotas, that the
+   quotas it sets show up in getrusage(), and that they hold the
+   process back: spinning uses up the CPU quota, and writing more
+   than the I/O quota's burst makes the writer sleep. */
+
+#include <stats.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CPU_PERCENT 50
+#define IO_RATE 8192
+#define FILE_SIZE 16384
+
+static char buf[FILE_SIZE];
+
+/* Returns the ticks the process has run. */
+static int64_t cpu_ticks(void) {
+  struct rusage usage;
+
+  getrusage(&usage);
+  return usage.user_ticks + usage.kernel_ticks;
+}
+
+void test_main(void) {
+  struct rusage before, after;
+  uint64_t sectors;
+  int64_t start;
+  int fd;
+
+  CHECK(!set_quota(101, 0), "set_quota(101, 0) fails");
+  CHECK(set_quota(0, 0), "set_quota(0, 0) changes nothing");
+  CHECK(set_quota(CPU_PERCENT, IO_RATE), "set_quota(%d, %d)", CPU_PERCENT, IO_RATE);
+  CHECK(!set_quota(CPU_PERCENT + 10, 0), "looser CPU quota fails");
+  CHECK(!set_quota(0, IO_RATE * 2), "looser I/O quota fails");
+
+  getrusage(&before);
+  if (before.cpu_quota != CPU_PERCENT || before.io_quota != IO_RATE)
+    fail("getrusage reports quotas of %u%% and %u bytes/s", before.cpu_quota, before.io_quota);
+
+  msg("spin");
+  start = cpu_ticks();
+  while (cpu_ticks() - start < 40)
+    continue;
+  getrusage(&after);
+  if (after.cpu_throttles == before.cpu_throttles)
+    fail("40 ticks of CPU time at %d%% were never throttled", CPU_PERCENT);
+
+  CHECK(create("limited", 0), "create \"limited\"");
+  CHECK((fd = open("limited")) > 1, "open \"limited\"");
+  memset(buf, 'q', sizeof buf);
+  getrusage(&before);
+  CHECK(write(fd, buf, sizeof buf) == FILE_SIZE, "write \"limited\"");
+  CHECK(fsync(fd) == 0, "fsync \"limited\"");
+  getrusage(&after);
+  sectors = (after.block_reads - before.block_reads) + (after.block_writes - before.block_writes);
+  if (sectors * 512 > IO_RATE / 4 && after.io_throttle_ticks == before.io_throttle_ticks)
+    fail("transferred %llu sectors at %d bytes/s without sleeping", sectors, IO_RATE);
+
+  msg("close \"limited\"");
+  close(fd);
+  check_file("limited", buf, sizeof buf);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(quota) begin
+(quota) set_quota(101, 0) fails
+(quota) set_quota(0, 0) changes nothing
+(quota) set_quota(50, 8192)
+(quota) looser CPU quota fails
+(quota) looser I/O quota fails
+(quota) spin
+(quota) create "limited"
+(quota) open "limited"
+(quota) write "limited"
+(quota) fsync "limited"
+(quota) close "limited"
+(quota) verified contents of "limited"
+(quota) end
+EOF
+pass;
@@ -0,0 +1,122 @@
+/* Test program and microbenchmark for scanning in
+   lib/kernel/bitmap.c.
+
+   Checks bitmap_scan() and bitmap_count() against simple
+   bit-at-a-time versions on random bitmaps, then times both
+   scanning a nearly full 64 K-bit map, the case that palloc and
+   the free map hit when memory or disk is nearly used up.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "threads/tsc.h"
+
+/* Bits in the benchmark bitmap. */
+#define BENCH_BITS 65536
+
+/* Free bits left in the benchmark bitmap. */
+#define BENCH_HOLES 64
+
+/* Buffer for the benchmark bitmap. */
+static char bench_buf[BENCH_BITS / 8 + 64];
+
+static size_t slow_scan(const struct bitmap*, size_t start, size_t cnt, bool value);
+static size_t slow_count(const struct bitmap*, size_t start, size_t cnt, bool value);
+static void check_random(void);
+static void bench(void);
+
+/* Tests and times bitmap scanning. */
+void test(void) {
+  check_random();
+  bench();
+  printf("bitmap: PASS\n");
+}
+
+/* Compares bitmap_scan() and bitmap_count() with slow_scan() and
+   slow_count() on bitmaps of many sizes and densities. */
+static void check_random(void) {
+  static char buf[1024];
+  size_t bit_cnt;
+
+  printf("testing scans:");
+  for (bit_cnt = 1; bit_cnt <= 300; bit_cnt += 7) {
+    struct bitmap* b = bitmap_create_in_buf(bit_cnt, buf, sizeof buf);
+    int density;
+
+    printf(" %zu", bit_cnt);
+    for (density = 0; density <= 8; density++) {
+      size_t i, cnt;
+
+      for (i = 0; i < bit_cnt; i++)
+        bitmap_set(b, i, (int)(random_ulong() % 8) < density);
+      for (cnt = 0; cnt <= bit_cnt + 1; cnt += 1 + cnt / 4) {
+        size_t start = random_ulong() % (bit_cnt + 1);
+        ASSERT(bitmap_scan(b, start, cnt, false) == slow_scan(b, start, cnt, false));
+        ASSERT(bitmap_scan(b, start, cnt, true) == slow_scan(b, start, cnt, true));
+        if (start + cnt <= bit_cnt)
+          ASSERT(bitmap_count(b, start, cnt, true) == slow_count(b, start, cnt, true));
+      }
+    }
+  }
+  printf(" done\n");
+}
+
+/* Times scans for runs of free bits in a bitmap with only a few
+   free bits left, scattered at random. */
+static void bench(void) {
+  struct bitmap* b = bitmap_create_in_buf(BENCH_BITS, bench_buf, sizeof bench_buf);
+  size_t cnts[] = {1, 2, 8};
+  size_t i;
+
+  bitmap_set_all(b, true);
+  for (i = 0; i < BENCH_HOLES; i++)
+    bitmap_reset(b, random_ulong() % BENCH_BITS);
+
+  for (i = 0; i < sizeof cnts / sizeof *cnts; i++) {
+    uint64_t t0, t1, t2;
+    size_t fast, slow;
+
+    t0 = rdtsc();
+    fast = bitmap_scan(b, BENCH_BITS / 2, cnts[i], false);
+    t1 = rdtsc();
+    slow = slow_scan(b, BENCH_BITS / 2, cnts[i], false);
+    t2 = rdtsc();
+    ASSERT(fast == slow);
+    printf("scan for %zu free of %d bits: %llu cycles, %llu bit at a time\n", cnts[i],
+           BENCH_BITS, t1 - t0, t2 - t1);
+  }
+}
+
+/* Returns the first index at or after START where CNT bits in B
+   are all VALUE, testing one candidate and one bit at a time. */
+static size_t slow_scan(const struct bitmap* b, size_t start, size_t cnt, bool value) {
+  size_t i, j;
+
+  if (cnt == 0)
+    return start;
+  for (i = start; i + cnt <= bitmap_size(b); i++) {
+    for (j = 0; j < cnt; j++)
+      if (bitmap_test(b, i + j) != value)
+        break;
+    if (j == cnt)
+      return i;
+  }
+  return BITMAP_ERROR;
+}
+
+/* Returns the number of bits in B between START and START + CNT
+   that are VALUE, testing one bit at a time. */
+static size_t slow_count(const struct bitmap* b, size_t start, size_t cnt, bool value) {
+  size_t i, n = 0;
+
+  for (i = start; i < start + cnt; i++)
+    n += bitmap_test(b, i) == value;
+  return n;
+}
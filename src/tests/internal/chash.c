@@ -0,0 +1,199 @@
+/* Test program and stress benchmark for threads/chash.c.
+
+   Checks a concurrent hash map against an array of flags under
+   random insertions and deletions, enough of them to make it grow
+   several times.  Then runs 1, 2, 4 and 8 threads that look up
+   random keys for a second each, while one more thread keeps
+   inserting and deleting keys so that lookups race with writers
+   and with growth, and prints the lookups per second for each
+   thread count.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/chash.h"
+#include "threads/malloc.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+#include "threads/test.h"
+#include "threads/thread.h"
+
+/* Number of distinct keys. */
+#define KEY_CNT 4096
+
+/* An element. */
+struct item {
+  struct chash_elem elem; /* Map element. */
+  int key;                /* Key. */
+  bool in;                /* In the map? */
+};
+
+/* State shared by the benchmark threads. */
+struct bench {
+  struct chash* map;          /* Map being searched. */
+  struct item* items;         /* KEY_CNT items. */
+  int64_t end;                /* Tick at which to stop. */
+  struct semaphore done;      /* Upped by each thread as it stops. */
+  unsigned long long lookups; /* Lookups done by all threads. */
+};
+
+static unsigned item_hash(const struct chash_elem*, void* aux);
+static bool item_equal(const struct chash_elem*, const struct chash_elem*, void* aux);
+static void check_random(void);
+static void bench(int thread_cnt);
+static thread_func reader;
+static thread_func writer;
+
+/* Tests and times the concurrent hash map. */
+void test(void) {
+  check_random();
+  bench(1);
+  bench(2);
+  bench(4);
+  bench(8);
+  printf("chash: PASS\n");
+}
+
+/* Performs random insertions and deletions on a map, checking
+   each against the items' IN flags and every key once per round
+   of KEY_CNT operations. */
+static void check_random(void) {
+  enum { OP_CNT = KEY_CNT * 16 };
+  struct item* items = malloc(sizeof *items * KEY_CNT);
+  struct chash map;
+  struct item key;
+  size_t size = 0;
+  int op, i;
+
+  ASSERT(items != NULL);
+  ASSERT(chash_init(&map, "chash-test", item_hash, item_equal, NULL));
+  for (i = 0; i < KEY_CNT; i++) {
+    items[i].key = i;
+    items[i].in = false;
+  }
+
+  printf("testing chash:");
+  for (op = 0; op < OP_CNT; op++) {
+    struct item* it = &items[random_ulong() % KEY_CNT];
+
+    if (!it->in) {
+      ASSERT(chash_insert(&map, &it->elem) == NULL);
+      it->in = true;
+      size++;
+    } else if (random_ulong() % 2) {
+      ASSERT(chash_insert(&map, &it->elem) == &it->elem);
+    } else {
+      key.key = it->key;
+      ASSERT(chash_delete(&map, &key.elem) == &it->elem);
+      it->in = false;
+      size--;
+    }
+    ASSERT(chash_size(&map) == size);
+
+    if (op % KEY_CNT == 0) {
+      rcu_read_lock();
+      for (i = 0; i < KEY_CNT; i++) {
+        struct chash_elem* e;
+
+        key.key = i;
+        e = chash_find(&map, &key.elem);
+        ASSERT(e == (items[i].in ? &items[i].elem : NULL));
+      }
+      rcu_read_unlock();
+      printf(" %d", op);
+    }
+  }
+  chash_destroy(&map, NULL);
+  printf(" done\n");
+  free(items);
+}
+
+/* Runs THREAD_CNT readers and one writer on a map for a second
+   and prints how many lookups the readers did. */
+static void bench(int thread_cnt) {
+  struct chash map;
+  struct bench b;
+  int i;
+
+  b.map = &map;
+  b.items = malloc(sizeof *b.items * KEY_CNT);
+  ASSERT(b.items != NULL);
+  ASSERT(chash_init(&map, "chash-bench", item_hash, item_equal, NULL));
+  for (i = 0; i < KEY_CNT; i++) {
+    b.items[i].key = i;
+    b.items[i].in = i % 2 == 0;
+    if (b.items[i].in)
+      chash_insert(&map, &b.items[i].elem);
+  }
+  sema_init(&b.done, 0);
+  b.lookups = 0;
+  b.end = timer_ticks() + TIMER_FREQ;
+
+  for (i = 0; i < thread_cnt; i++)
+    ASSERT(thread_create("reader", PRI_DEFAULT, reader, &b) != TID_ERROR);
+  ASSERT(thread_create("writer", PRI_DEFAULT, writer, &b) != TID_ERROR);
+  for (i = 0; i < thread_cnt + 1; i++)
+    sema_down(&b.done);
+
+  printf("%d threads: %llu lookups/s\n", thread_cnt, b.lookups);
+  chash_destroy(&map, NULL);
+  free(b.items);
+}
+
+/* Looks up random keys in B's map until B's end tick. */
+static void reader(void* b_) {
+  struct bench* b = b_;
+  unsigned long long cnt = 0;
+  struct item key;
+
+  while (timer_ticks() < b->end) {
+    int i;
+
+    rcu_read_lock();
+    for (i = 0; i < 64; i++) {
+      struct chash_elem* e;
+
+      key.key = random_ulong() % KEY_CNT;
+      e = chash_find(b->map, &key.elem);
+      ASSERT(e == NULL || chash_entry(e, struct item, elem)->key == key.key);
+    }
+    rcu_read_unlock();
+    cnt += 64;
+  }
+  __atomic_add_fetch(&b->lookups, cnt, __ATOMIC_RELAXED);
+  sema_up(&b->done);
+}
+
+/* Inserts and deletes random keys in B's map until B's end tick.
+   Deleted items are never freed before the map is, so readers
+   need not wait for a grace period. */
+static void writer(void* b_) {
+  struct bench* b = b_;
+
+  while (timer_ticks() < b->end) {
+    struct item* it = &b->items[random_ulong() % KEY_CNT];
+    struct chash_elem* e;
+
+    e = it->in ? chash_delete(b->map, &it->elem) : chash_insert(b->map, &it->elem);
+    ASSERT(e == (it->in ? &it->elem : NULL));
+    it->in = !it->in;
+  }
+  sema_up(&b->done);
+}
+
+/* Hashes an item's key. */
+static unsigned item_hash(const struct chash_elem* e, void* aux UNUSED) {
+  return hash_int(chash_entry(e, struct item, elem)->key);
+}
+
+/* Compares two items' keys. */
+static bool item_equal(const struct chash_elem* a, const struct chash_elem* b, void* aux UNUSED) {
+  return chash_entry(a, struct item, elem)->key == chash_entry(b, struct item, elem)->key;
+}
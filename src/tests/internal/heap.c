@@ -0,0 +1,175 @@
+/* Test program and microbenchmark for lib/kernel/heap.c and
+   lib/kernel/rbtree.c.
+
+   Checks a heap and a red-black tree against a sorted list under
+   random insertions and removals, then times filling each with
+   10, 100 and 10,000 random keys and emptying it smallest first,
+   against a list kept sorted by list_insert_ordered() and an
+   unsorted list searched with list_max().
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <heap.h>
+#include <list.h>
+#include <random.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/test.h"
+#include "threads/tsc.h"
+
+/* An element that can be in each kind of container at once. */
+struct item {
+  int key;
+  bool in;
+  struct list_elem list_elem;
+  struct heap_elem heap_elem;
+  struct rb_elem rb_elem;
+};
+
+static bool list_less(const struct list_elem*, const struct list_elem*, void* aux);
+static bool list_greater(const struct list_elem*, const struct list_elem*, void* aux);
+static bool heap_less(const struct heap_elem*, const struct heap_elem*, void* aux);
+static bool rb_less(const struct rb_elem*, const struct rb_elem*, void* aux);
+static void check_random(void);
+static void bench(size_t cnt);
+
+/* Tests and times the heap and red-black tree. */
+void test(void) {
+  check_random();
+  bench(10);
+  bench(100);
+  bench(10000);
+  printf("heap: PASS\n");
+}
+
+/* Performs random insertions and removals on a sorted list, a
+   heap and a red-black tree in lockstep, checking that all three
+   agree on the smallest element. */
+static void check_random(void) {
+  enum { ITEM_CNT = 200, OP_CNT = 20000 };
+  struct item* items = malloc(sizeof *items * ITEM_CNT);
+  struct list list;
+  struct heap heap;
+  struct rb_tree tree;
+  int op;
+
+  ASSERT(items != NULL);
+  list_init(&list);
+  heap_init(&heap, heap_less, NULL);
+  rb_init(&tree, rb_less, NULL);
+  for (op = 0; op < ITEM_CNT; op++)
+    items[op].in = false;
+
+  printf("testing heap and tree:");
+  for (op = 0; op < OP_CNT; op++) {
+    struct item* it = &items[random_ulong() % ITEM_CNT];
+
+    if (!it->in) {
+      it->key = random_ulong() % 100;
+      it->in = true;
+      list_insert_ordered(&list, &it->list_elem, list_less, NULL);
+      heap_insert(&heap, &it->heap_elem);
+      rb_insert(&tree, &it->rb_elem);
+    } else {
+      it->in = false;
+      list_remove(&it->list_elem);
+      heap_remove(&heap, &it->heap_elem);
+      rb_remove(&tree, &it->rb_elem);
+    }
+
+    ASSERT(heap_size(&heap) == list_size(&list));
+    ASSERT(rb_size(&tree) == list_size(&list));
+    if (!list_empty(&list)) {
+      int min = list_entry(list_front(&list), struct item, list_elem)->key;
+      ASSERT(heap_entry(heap_min(&heap), struct item, heap_elem)->key == min);
+      ASSERT(rb_entry(rb_min(&tree), struct item, rb_elem)->key == min);
+    }
+    if (op % 2000 == 0)
+      printf(" %d", op);
+  }
+
+  /* Equal keys may come out of the heap in any order, so compare
+     keys, not items, while emptying it. */
+  while (!heap_empty(&heap)) {
+    struct item* it = heap_entry(heap_pop_min(&heap), struct item, heap_elem);
+    ASSERT(it->key == list_entry(list_pop_front(&list), struct item, list_elem)->key);
+    rb_remove(&tree, &it->rb_elem);
+  }
+  ASSERT(list_empty(&list) && rb_empty(&tree));
+  printf(" done\n");
+  free(items);
+}
+
+/* Times inserting CNT random keys into each container and then
+   removing them smallest first. */
+static void bench(size_t cnt) {
+  struct item* items = malloc(sizeof *items * cnt);
+  struct list list;
+  struct heap heap;
+  struct rb_tree tree;
+  uint64_t t0, t1, t2, t3, t4;
+  size_t i;
+
+  ASSERT(items != NULL);
+  for (i = 0; i < cnt; i++)
+    items[i].key = random_ulong() % (cnt * 4);
+
+  t0 = rdtsc();
+  list_init(&list);
+  for (i = 0; i < cnt; i++)
+    list_insert_ordered(&list, &items[i].list_elem, list_less, NULL);
+  while (!list_empty(&list))
+    list_pop_front(&list);
+
+  t1 = rdtsc();
+  list_init(&list);
+  for (i = 0; i < cnt; i++)
+    list_push_back(&list, &items[i].list_elem);
+  while (!list_empty(&list))
+    list_remove(list_max(&list, list_greater, NULL));
+
+  t2 = rdtsc();
+  heap_init(&heap, heap_less, NULL);
+  for (i = 0; i < cnt; i++)
+    heap_insert(&heap, &items[i].heap_elem);
+  while (!heap_empty(&heap))
+    heap_pop_min(&heap);
+
+  t3 = rdtsc();
+  rb_init(&tree, rb_less, NULL);
+  for (i = 0; i < cnt; i++)
+    rb_insert(&tree, &items[i].rb_elem);
+  while (!rb_empty(&tree))
+    rb_remove(&tree, rb_min(&tree));
+  t4 = rdtsc();
+
+  printf("%zu elements: sorted list %llu, list_max %llu, heap %llu, rbtree %llu cycles\n", cnt,
+         t1 - t0, t2 - t1, t3 - t2, t4 - t3);
+  free(items);
+}
+
+/* Orders list elements by key. */
+static bool list_less(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED) {
+  return list_entry(a, struct item, list_elem)->key < list_entry(b, struct item, list_elem)->key;
+}
+
+/* Orders list elements by key, largest first, so that
+   list_max() finds the smallest. */
+static bool list_greater(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED) {
+  return list_less(b, a, NULL);
+}
+
+/* Orders heap elements by key. */
+static bool heap_less(const struct heap_elem* a, const struct heap_elem* b, void* aux UNUSED) {
+  return heap_entry(a, struct item, heap_elem)->key < heap_entry(b, struct item, heap_elem)->key;
+}
+
+/* Orders tree elements by key. */
+static bool rb_less(const struct rb_elem* a, const struct rb_elem* b, void* aux UNUSED) {
+  return rb_entry(a, struct item, rb_elem)->key < rb_entry(b, struct item, rb_elem)->key;
+}
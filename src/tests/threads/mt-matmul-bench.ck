@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# The report's timings vary from run to run.
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = grep (!/^matmul: /, @output);
+compare_output ("run", \@output, [<<'EOF']);
+(mt-matmul-bench) begin
+(mt-matmul-bench) Multiplying 128x128 matrices.
+(mt-matmul-bench) All kernels match.
+(mt-matmul-bench) end
+EOF
+pass;
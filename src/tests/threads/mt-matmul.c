@@ -2,14 +2,43 @@
    where A, B, and C are NxN matrices. */
 
 /* Based on UC Berkeley's RISC-V benchmark of the same name:
-   https://github.com/ucb-bar/riscv-benchmarks/tree/master/mt-matmul */
+   https://github.com/ucb-bar/riscv-benchmarks/tree/master/mt-matmul
 
+   mt-matmul-bench also times a cache-blocked kernel and, on CPUs
+   with MMX, a blocked kernel that does four multiply-adds per
+   instruction, on larger generated matrices, and reports TSC
+   cycles per multiply-add for each kernel with 1, 2, 4 and 16
+   threads. */
+
+#include <inttypes.h>
+#include <random.h>
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "tests/threads/tests.h"
 #include "tests/threads/matmul_data.h"
+#include "threads/cpu.h"
 #include "threads/init.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* Matrix dimension for mt-matmul-bench.  Matrices of shorts,
+   three of which should not fit in the L1 cache.  May be
+   overridden with -DMATMUL_BENCH_DIM. */
+#ifndef MATMUL_BENCH_DIM
+#define MATMUL_BENCH_DIM 128
+#endif
+
+/* Block size of the blocked kernels, in elements.  A row of a
+   block of B is a 64-byte cache line. */
+#define TILE 32
+
+#if MATMUL_BENCH_DIM % TILE != 0 || MATMUL_BENCH_DIM % 16 != 0
+#error "MATMUL_BENCH_DIM must be a multiple of 32"
+#endif
 
 void __attribute__((noinline)) matmul(const int tid, const int nthreads, const int lda,
                                       const short A[], const short B[], short C[]);
@@ -83,3 +112,164 @@ void test_mt_matmul_16(void) {
   msg("Executing blocked matmul with 16 threads...");
   test_mt_matmul(16);
 }
+
+/* Like matmul(), but goes through A and B in TILE x TILE blocks,
+   so that a block of B stays in the cache while every row of
+   this thread's part of C reuses it.  LDA must be a multiple of
+   TILE. */
+static void matmul_tiled(int tid, int nthreads, int lda, const short A[], const short B[],
+                         short C[]) {
+  int block = lda / nthreads;
+  int start = block * tid;
+  int i, j, k, ii, kk;
+
+  for (kk = 0; kk < lda; kk += TILE)
+    for (ii = 0; ii < lda; ii += TILE)
+      for (j = start; j < start + block; j++)
+        for (k = kk; k < kk + TILE; k++) {
+          short a = A[j * lda + k];
+          for (i = ii; i < ii + TILE; i++)
+            C[i + j * lda] += a * B[k * lda + i];
+        }
+}
+
+/* Adds A times each of the TILE shorts at B to the TILE shorts at
+   C, four at a time, in MMX registers.  Products wrap around to
+   16 bits as they do in C.  The caller must execute EMMS before
+   using the FPU again. */
+static void mac_tile_mmx(short* c, const short* b, short a) {
+  int cnt = TILE / 4;
+
+  asm volatile("movd %3, %%mm0\n\t"
+               "punpcklwd %%mm0, %%mm0\n\t" /* Copy A into all four words. */
+               "punpckldq %%mm0, %%mm0\n"
+               "1:\tmovq (%1), %%mm1\n\t"
+               "pmullw %%mm0, %%mm1\n\t"
+               "paddw (%0), %%mm1\n\t"
+               "movq %%mm1, (%0)\n\t"
+               "addl $8, %0\n\t"
+               "addl $8, %1\n\t"
+               "decl %2\n\t"
+               "jnz 1b"
+               : "+r"(c), "+r"(b), "+r"(cnt)
+               : "r"((int)a)
+               : "memory", "cc");
+}
+
+/* Like matmul_tiled(), but the innermost loop runs in MMX
+   registers.  Kernel threads may use the FPU, and with it MMX,
+   freely (see threads/fpu.c). */
+static void matmul_mmx(int tid, int nthreads, int lda, const short A[], const short B[],
+                       short C[]) {
+  int block = lda / nthreads;
+  int start = block * tid;
+  int j, k, ii, kk;
+
+  for (kk = 0; kk < lda; kk += TILE)
+    for (ii = 0; ii < lda; ii += TILE)
+      for (j = start; j < start + block; j++)
+        for (k = kk; k < kk + TILE; k++)
+          mac_tile_mmx(&C[ii + j * lda], &B[k * lda + ii], A[j * lda + k]);
+  asm volatile("emms");
+}
+
+/* Returns true if the CPU supports MMX. */
+static bool cpu_has_mmx(void) { return (cpuid(1).edx & CPUID_MMX) != 0; }
+
+/* A matrix multiplication kernel. */
+typedef void matmul_func(int tid, int nthreads, int lda, const short A[], const short B[],
+                         short C[]);
+
+/* A share of a timed multiplication. */
+struct bench_args {
+  matmul_func* func;      /* Kernel. */
+  int tid, n_threads;     /* This thread's share. */
+  const short *A, *B;     /* Inputs. */
+  short* C;               /* Output. */
+  struct semaphore* done; /* Upped when this share is done. */
+};
+
+static void bench_entry(void* aux) {
+  struct bench_args* args = aux;
+
+  args->func(args->tid, args->n_threads, MATMUL_BENCH_DIM, args->A, args->B, args->C);
+  sema_up(args->done);
+}
+
+/* Computes C = A x B with FUNC in N_THREADS threads and returns
+   the TSC cycles it took. */
+static uint64_t bench_run(matmul_func* func, int n_threads, const short A[], const short B[],
+                          short C[]) {
+  struct bench_args args[n_threads];
+  struct semaphore done;
+  uint64_t start;
+  int i;
+
+  memset(C, 0, MATMUL_BENCH_DIM * MATMUL_BENCH_DIM * sizeof *C);
+  sema_init(&done, 0);
+  start = rdtsc();
+  for (i = 0; i < n_threads; i++) {
+    args[i] = (struct bench_args){func, i, n_threads, A, B, C, &done};
+    thread_create("matmul", PRI_DEFAULT - 1, bench_entry, &args[i]);
+  }
+  for (i = 0; i < n_threads; i++)
+    sema_down(&done);
+  return rdtsc() - start;
+}
+
+void test_mt_matmul_bench(void) {
+  static const int thread_cnts[] = {1, 2, 4, 16};
+  static const struct {
+    const char* name;
+    matmul_func* func;
+  } kernels[] = {
+      {"naive", matmul},
+      {"tiled", matmul_tiled},
+      {"mmx", matmul_mmx},
+  };
+  const size_t elems = MATMUL_BENCH_DIM * MATMUL_BENCH_DIM;
+  const size_t pages = DIV_ROUND_UP(elems * sizeof(short), PGSIZE);
+  const uint64_t macs = (uint64_t)elems * MATMUL_BENCH_DIM;
+  short *A, *B, *C, *ref;
+  bool ok = true;
+  size_t i, k, t;
+
+  ASSERT(active_sched_policy == SCHED_PRIO);
+  ASSERT(thread_get_priority() == PRI_DEFAULT);
+
+  msg("Multiplying %dx%d matrices.", MATMUL_BENCH_DIM, MATMUL_BENCH_DIM);
+  A = palloc_get_multiple(PAL_ASSERT, pages);
+  B = palloc_get_multiple(PAL_ASSERT, pages);
+  C = palloc_get_multiple(PAL_ASSERT, pages);
+  ref = palloc_get_multiple(PAL_ASSERT, pages);
+  random_init(0);
+  for (i = 0; i < elems; i++) {
+    A[i] = random_ulong() % 4;
+    B[i] = random_ulong() % 4;
+  }
+  bench_run(matmul, 1, A, B, ref);
+
+  for (k = 0; k < sizeof kernels / sizeof *kernels; k++) {
+    if (kernels[k].func == matmul_mmx && !cpu_has_mmx()) {
+      printf("matmul: %s: not supported by this CPU\n", kernels[k].name);
+      continue;
+    }
+    for (t = 0; t < sizeof thread_cnts / sizeof *thread_cnts; t++) {
+      uint64_t cycles = bench_run(kernels[k].func, thread_cnts[t], A, B, C);
+
+      printf("matmul: %s, %2d threads: %" PRIu64 ".%02" PRIu64 " cycles per multiply-add\n",
+             kernels[k].name, thread_cnts[t], cycles / macs, cycles * 100 / macs % 100);
+      if (memcmp(C, ref, elems * sizeof *C)) {
+        msg("%s kernel with %d threads got a wrong result!", kernels[k].name, thread_cnts[t]);
+        ok = false;
+      }
+    }
+  }
+  if (ok)
+    msg("All kernels match.");
+
+  palloc_free_multiple(A, pages);
+  palloc_free_multiple(B, pages);
+  palloc_free_multiple(C, pages);
+  palloc_free_multiple(ref, pages);
+}
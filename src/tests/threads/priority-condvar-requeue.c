@@ -0,0 +1,66 @@
+/* Checks that cond_signal_n() signals as many waiters as asked
+   and cond_broadcast() the rest, and that each signaled waiter
+   blocks only once, in cond_wait(), instead of waking to block
+   again on the lock. */
+
+#include <stats.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define WAITER_CNT 5
+
+static thread_func waiter_thread;
+static struct lock lock;
+static struct condition condition;
+static int woken_cnt;
+static int extra_blocks;
+
+void test_priority_condvar_requeue(void) {
+  size_t signaled;
+  int i;
+
+  ASSERT(active_sched_policy == SCHED_PRIO);
+
+  lock_init(&lock);
+  cond_init(&condition);
+  for (i = 0; i < WAITER_CNT; i++) {
+    char name[16];
+    snprintf(name, sizeof name, "waiter %d", i);
+    thread_create(name, PRI_DEFAULT + 1, waiter_thread, NULL);
+  }
+
+  lock_acquire(&lock);
+  signaled = cond_signal_n(&condition, &lock, 2);
+  if (woken_cnt != 0)
+    fail("signaled waiters ran while the lock was held");
+  lock_release(&lock);
+  if (signaled != 2 || woken_cnt != 2)
+    fail("signaled %zu waiters and %d woke, not 2", signaled, woken_cnt);
+  msg("cond_signal_n() woke 2 waiters.");
+
+  lock_acquire(&lock);
+  cond_broadcast(&condition, &lock);
+  lock_release(&lock);
+  if (woken_cnt != WAITER_CNT)
+    fail("%d of %d waiters woke", woken_cnt, WAITER_CNT);
+  msg("cond_broadcast() woke the rest.");
+
+  if (extra_blocks != 0)
+    fail("waiters blocked %d extra times", extra_blocks);
+  msg("Each waiter blocked once.");
+}
+
+static void waiter_thread(void* aux UNUSED) {
+  struct sched_stats before, after;
+
+  lock_acquire(&lock);
+  thread_get_sched_stats(&before);
+  cond_wait(&condition, &lock);
+  thread_get_sched_stats(&after);
+  woken_cnt++;
+  extra_blocks += after.voluntary_switches - before.voluntary_switches - 1;
+  lock_release(&lock);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-condvar-requeue) begin
+(priority-condvar-requeue) cond_signal_n() woke 2 waiters.
+(priority-condvar-requeue) cond_broadcast() woke the rest.
+(priority-condvar-requeue) Each waiter blocked once.
+(priority-condvar-requeue) end
+EOF
+pass;
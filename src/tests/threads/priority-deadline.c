@@ -0,0 +1,98 @@
+/* Checks the deadline class.  A reservation that would take more
+   of the CPU than the class admits is refused.  Then a PRI_MIN
+   thread that reserves 3 ticks in every 10 runs ahead of a
+   PRI_MAX thread that never blocks, but only for its budget, and
+   meets all its deadlines. */
+
+#include <stats.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Reservation of the deadline thread. */
+#define PERIOD 10
+#define BUDGET 3
+
+/* Ticks to measure for. */
+#define SPIN_TICKS 100
+
+static thread_func deadline_thread;
+static thread_func hog_thread;
+
+static struct semaphore admitted;
+static struct semaphore done;
+static int64_t start, end;
+static int deadline_ticks, hog_ticks;
+static bool over_admitted;
+static struct sched_stats deadline_stats;
+
+/* Spins until END, returning the number of ticks from START on
+   during which it ran. */
+static int count_ticks(void) {
+  int64_t last = -1;
+  int64_t now;
+  int cnt = 0;
+
+  while ((now = timer_ticks()) < end)
+    if (now != last && now >= start) {
+      last = now;
+      cnt++;
+    }
+  return cnt;
+}
+
+void test_priority_deadline(void) {
+  ASSERT(active_sched_policy == SCHED_PRIO);
+
+  sema_init(&admitted, 0);
+  sema_init(&done, 0);
+
+  if (thread_set_deadline(PERIOD, PERIOD))
+    fail("reservation of the whole CPU admitted");
+  if (!thread_set_deadline(PERIOD, PERIOD - BUDGET - 1))
+    fail("reservation of %d%% of the CPU refused", (PERIOD - BUDGET - 1) * 100 / PERIOD);
+
+  start = timer_ticks() + 5;
+  end = start + SPIN_TICKS;
+  thread_create("deadline", PRI_DEFAULT + 1, deadline_thread, NULL);
+  sema_down(&admitted);
+  if (over_admitted)
+    fail("reservations of more than the CPU admitted");
+  msg("Reservations over the limit refused.");
+
+  thread_set_deadline(0, 0);
+  thread_create("hog", PRI_MAX, hog_thread, NULL);
+  sema_down(&done);
+  sema_down(&done);
+
+  if (deadline_ticks < SPIN_TICKS * BUDGET / PERIOD - 5 ||
+      deadline_ticks > SPIN_TICKS * BUDGET / PERIOD + 5)
+    fail("deadline thread ran %d of %d ticks", deadline_ticks, SPIN_TICKS);
+  msg("Deadline thread ran for its budget and no more.");
+  if (hog_ticks < SPIN_TICKS / 2)
+    fail("higher-priority thread ran %d of %d ticks", hog_ticks, SPIN_TICKS);
+  msg("Higher-priority thread ran the rest of the time.");
+  if (deadline_stats.deadline_misses != 0)
+    fail("%u deadlines missed", deadline_stats.deadline_misses);
+  msg("No deadlines missed.");
+}
+
+static void deadline_thread(void* aux UNUSED) {
+  over_admitted = thread_set_deadline(PERIOD, BUDGET + 1);
+  if (!thread_set_deadline(PERIOD, BUDGET))
+    fail("reservation of %d%% of the CPU refused", BUDGET * 100 / PERIOD);
+  thread_set_priority(PRI_MIN);
+  sema_up(&admitted);
+
+  deadline_ticks = count_ticks();
+  thread_get_sched_stats(&deadline_stats);
+  sema_up(&done);
+}
+
+static void hog_thread(void* aux UNUSED) {
+  hog_ticks = count_ticks();
+  sema_up(&done);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-deadline) begin
+(priority-deadline) Reservations over the limit refused.
+(priority-deadline) Deadline thread ran for its budget and no more.
+(priority-deadline) Higher-priority thread ran the rest of the time.
+(priority-deadline) No deadlines missed.
+(priority-deadline) end
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* The main thread makes itself the owner of a semaphore used as
+   a completion.  A higher-priority thread that waits on it
+   donates its priority to the main thread, so a medium-priority
+   thread created next does not run until the main thread ups the
+   semaphore, after which the waiter runs first. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func waiter_thread_func;
+static thread_func medium_thread_func;
+
+void test_priority_donate_owned(void) {
+  struct semaphore done;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT(active_sched_policy == SCHED_PRIO);
+
+  /* Make sure our priority is the default. */
+  ASSERT(thread_get_priority() == PRI_DEFAULT);
+
+  sema_init(&done, 0);
+  sema_set_owner(&done, thread_tid());
+  thread_create("waiter", PRI_DEFAULT + 2, waiter_thread_func, &done);
+  msg("This thread should have priority %d.  Actual priority: %d.", PRI_DEFAULT + 2,
+      thread_get_priority());
+  thread_create("medium", PRI_DEFAULT + 1, medium_thread_func, NULL);
+  msg("medium must not have run yet.");
+  sema_up(&done);
+  msg("waiter, medium must already have finished, in that order.");
+  msg("This thread should have priority %d.  Actual priority: %d.", PRI_DEFAULT,
+      thread_get_priority());
+}
+
+static void waiter_thread_func(void* done_) {
+  struct semaphore* done = done_;
+
+  sema_down(done);
+  msg("waiter: done");
+}
+
+static void medium_thread_func(void* aux UNUSED) { msg("medium: done"); }
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-owned) begin
+(priority-donate-owned) This thread should have priority 33.  Actual priority: 33.
+(priority-donate-owned) medium must not have run yet.
+(priority-donate-owned) waiter: done
+(priority-donate-owned) medium: done
+(priority-donate-owned) waiter, medium must already have finished, in that order.
+(priority-donate-owned) This thread should have priority 31.  Actual priority: 31.
+(priority-donate-owned) end
+EOF
+pass;
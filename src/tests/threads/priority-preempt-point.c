@@ -0,0 +1,48 @@
+/* Checks that thread_yield_if_needed() lets a higher-priority
+   thread that thread_unblock() woke without preempting run at
+   once, and does nothing when no such thread is ready. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+static thread_func high_thread;
+static struct thread* high;
+static volatile bool high_ran;
+
+void test_priority_preempt_point(void) {
+  enum intr_level old_level;
+  bool due;
+
+  ASSERT(active_sched_policy == SCHED_PRIO);
+
+  if (thread_resched_needed())
+    fail("reschedule due with nothing else ready");
+  thread_create("high", PRI_MAX, high_thread, NULL);
+
+  old_level = intr_disable();
+  thread_unblock(high);
+  due = thread_resched_needed();
+  intr_set_level(old_level);
+  if (!due)
+    fail("no reschedule due with a higher-priority thread ready");
+
+  thread_yield_if_needed();
+  if (!high_ran)
+    fail("higher-priority thread did not run at the preemption point");
+  msg("Higher-priority thread ran at the preemption point.");
+
+  thread_yield_if_needed();
+  msg("Preemption point with nothing to run returned.");
+}
+
+static void high_thread(void* aux UNUSED) {
+  enum intr_level old_level = intr_disable();
+
+  high = thread_current();
+  thread_block();
+  intr_set_level(old_level);
+  high_ran = true;
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-preempt-point) begin
+(priority-preempt-point) Higher-priority thread ran at the preemption point.
+(priority-preempt-point) Preemption point with nothing to run returned.
+(priority-preempt-point) end
+EOF
+pass;
@@ -0,0 +1,74 @@
+/* Checks that time slices adapt: a thread that keeps using up
+   its slice against another CPU-bound thread of the same
+   priority gets longer slices, one that sleeps goes back to the
+   minimum, and one woken from sleep runs within the minimum
+   slice even though the other thread has a long one. */
+
+#include <stats.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Ticks to compete with the hog for. */
+#define SPIN_TICKS 100
+
+/* Sleeps to time. */
+#define SLEEP_CNT 5
+
+static thread_func hog;
+static volatile bool done;
+
+/* Returns the running thread's time slice. */
+static unsigned current_slice(void) {
+  struct sched_stats stats;
+
+  thread_get_sched_stats(&stats);
+  return stats.time_slice;
+}
+
+void test_priority_slice(void) {
+  unsigned min_slice;
+  int64_t start, latency = 0;
+  int i;
+
+  ASSERT(active_sched_policy == SCHED_PRIO);
+
+  min_slice = current_slice();
+  thread_create("hog", thread_get_priority(), hog, NULL);
+
+  start = timer_ticks();
+  while (timer_elapsed(start) < SPIN_TICKS)
+    continue;
+  if (current_slice() <= min_slice)
+    fail("time slice stayed at %u ticks", current_slice());
+  msg("CPU-bound thread got a longer time slice.");
+
+  for (i = 0; i < SLEEP_CNT; i++) {
+    int64_t elapsed;
+
+    start = timer_ticks();
+    timer_sleep(1);
+    elapsed = timer_elapsed(start);
+    if (elapsed > latency)
+      latency = elapsed;
+  }
+  if (current_slice() != min_slice)
+    fail("time slice is %u ticks after sleeping, not %u", current_slice(), min_slice);
+  msg("Sleeping thread got the minimum time slice back.");
+
+  /* timer_sleep(1) wakes at the next tick.  The hog is preempted
+     at the tick after that, at the latest, for the woken thread. */
+  if (latency > min_slice)
+    fail("woken thread waited %lld ticks to run", latency);
+  msg("Woken thread ran within the minimum time slice.");
+
+  done = true;
+  timer_sleep(1);
+}
+
+static void hog(void* aux UNUSED) {
+  while (!done)
+    continue;
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-slice) begin
+(priority-slice) CPU-bound thread got a longer time slice.
+(priority-slice) Sleeping thread got the minimum time slice back.
+(priority-slice) Woken thread ran within the minimum time slice.
+(priority-slice) end
+EOF
+pass;
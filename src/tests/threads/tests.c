@@ -18,17 +18,23 @@ static const struct test threads_tests[] = {
     {"priority-donate-nest", test_priority_donate_nest},
     {"priority-donate-sema", test_priority_donate_sema},
     {"priority-donate-lower", test_priority_donate_lower},
+    {"priority-donate-owned", test_priority_donate_owned},
     {"priority-donate-chain", test_priority_donate_chain},
     {"priority-fifo", test_priority_fifo},
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"priority-condvar-requeue", test_priority_condvar_requeue},
     {"priority-starve", test_priority_starve},
     {"priority-starve-sema", test_priority_starve_sema},
+    {"priority-slice", test_priority_slice},
+    {"priority-deadline", test_priority_deadline},
+    {"priority-preempt-point", test_priority_preempt_point},
     {"st-matmul", test_mt_matmul_1},
     {"mt-matmul-2", test_mt_matmul_2},
     {"mt-matmul-4", test_mt_matmul_4},
     {"mt-matmul-16", test_mt_matmul_16},
+    {"mt-matmul-bench", test_mt_matmul_bench},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
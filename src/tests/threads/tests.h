@@ -19,17 +19,23 @@ extern test_func test_priority_donate_multiple2;
 extern test_func test_priority_donate_sema;
 extern test_func test_priority_donate_nest;
 extern test_func test_priority_donate_lower;
+extern test_func test_priority_donate_owned;
 extern test_func test_priority_donate_chain;
 extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_priority_condvar_requeue;
 extern test_func test_priority_starve;
 extern test_func test_priority_starve_sema;
+extern test_func test_priority_slice;
+extern test_func test_priority_deadline;
+extern test_func test_priority_preempt_point;
 extern test_func test_mt_matmul_1;
 extern test_func test_mt_matmul_2;
 extern test_func test_mt_matmul_4;
 extern test_func test_mt_matmul_16;
+extern test_func test_mt_matmul_bench;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
@@ -0,0 +1,38 @@
+/* Child process run by exec-pristine.  Checks that its data and
+   bss segments and its heap start out as loaded, whatever earlier
+   runs of the same program did to theirs, prints its argument,
+   and then scribbles over all of them. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+static int data = 42;
+static char bss[2 * 4096];
+
+int main(int argc, char* argv[]) {
+  char* heap;
+  size_t i;
+
+  test_name = "child-pristine";
+  if (argc != 2)
+    fail("argc is %d", argc);
+  if (data != 42)
+    fail("data is %d", data);
+  for (i = 0; i < sizeof bss; i++)
+    if (bss[i] != 0)
+      fail("bss[%zu] is %d", i, bss[i]);
+
+  heap = sbrk(4096);
+  if (heap == (char*)-1)
+    fail("sbrk failed");
+  for (i = 0; i < 4096; i++)
+    if (heap[i] != 0)
+      fail("heap[%zu] is %d", i, heap[i]);
+
+  msg("run %s", argv[1]);
+  data = 0;
+  memset(bss, 0xff, sizeof bss);
+  memset(heap, 0xff, 4096);
+  return 0;
+}
@@ -0,0 +1,27 @@
+/* Child process run by spawn-fd test.
+
+   The first command-line argument is a file descriptor that the
+   parent passed on, open on sample.txt, which the child reads.
+   The second is one that the parent did not pass on, which must
+   not be open in the child. */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+
+int main(int argc, char* argv[]) {
+  test_name = "child-spawn";
+
+  msg("begin");
+  if (argc != 3 || !isdigit(*argv[1]) || !isdigit(*argv[2]))
+    fail("bad command-line arguments");
+  check_file_handle(atoi(argv[1]), "sample.txt", sample, sizeof sample - 1);
+  if (filesize(atoi(argv[2])) != -1)
+    fail("fd %s was inherited", argv[2]);
+  msg("end");
+
+  return 0;
+}
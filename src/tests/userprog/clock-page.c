@@ -0,0 +1,42 @@
+/* Checks that clock_gettime() reads the clock page without
+   making system calls, that the page holds a sane snapshot, and
+   that writing to it kills the process. */
+
+#include <stats.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include <time.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CALL_CNT 100
+
+static struct syscall_stats before, after;
+
+void test_main(void) {
+  const volatile struct clock_page* cp = (const struct clock_page*)CLOCK_PAGE_ADDR;
+  struct timespec ts;
+  uint64_t calls;
+  int i;
+
+  CHECK(syscall_stats(false, &before), "syscall_stats(false)");
+  for (i = 0; i < CALL_CNT; i++)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+  CHECK(syscall_stats(false, &after), "syscall_stats(false)");
+  calls = after.calls[SYS_CLOCK_GETTIME].cnt - before.calls[SYS_CLOCK_GETTIME].cnt;
+  if (calls != 0)
+    fail("clock_gettime() made %lld system calls", calls);
+  msg("clock_gettime() made no system calls");
+
+  if (cp->tick_ns != 1000000000 / 100)
+    fail("clock page says a tick is %lld ns", cp->tick_ns);
+  if (cp->mult == 0 || cp->shift > 32)
+    fail("clock page has mult %u, shift %u", cp->mult, cp->shift);
+  if (cp->ticks * cp->tick_ns > clock_page_read(cp, NULL) + cp->tick_ns)
+    fail("clock page tick count is ahead of its clock");
+  msg("clock page is consistent");
+
+  msg("write to clock page");
+  *(volatile uint32_t*)CLOCK_PAGE_ADDR = 0;
+  fail("should have exited with -1");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(clock-page) begin
+(clock-page) syscall_stats(false)
+(clock-page) syscall_stats(false)
+(clock-page) clock_gettime() made no system calls
+(clock-page) clock page is consistent
+(clock-page) write to clock page
+clock-page: exit(-1)
+EOF
+pass;
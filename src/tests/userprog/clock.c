@@ -0,0 +1,47 @@
+/* Checks that clock_gettime() rejects unknown clocks, returns
+   well-formed times, and that CLOCK_MONOTONIC never goes
+   backward and advances with sub-tick resolution. */
+
+#include <syscall.h>
+#include <time.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Returns TS in nanoseconds. */
+static int64_t ts_ns(const struct timespec* ts) {
+  return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+void test_main(void) {
+  struct timespec ts, prev;
+  int64_t first, last;
+  int i;
+
+  CHECK(clock_gettime(-1, &ts) == -1, "clock_gettime(-1) fails");
+  CHECK(clock_gettime(1000, &ts) == -1, "clock_gettime(1000) fails");
+
+  CHECK(clock_gettime(CLOCK_REALTIME, &ts) == 0, "clock_gettime(CLOCK_REALTIME)");
+  if (ts.tv_sec < 946684800)
+    fail("real time %lld is before 2000", ts.tv_sec);
+  if (ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000)
+    fail("real time has %ld nanoseconds", (long)ts.tv_nsec);
+
+  CHECK(clock_gettime(CLOCK_MONOTONIC, &prev) == 0, "clock_gettime(CLOCK_MONOTONIC)");
+  first = ts_ns(&prev);
+  for (i = 0; i < 1000; i++) {
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    if (ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000)
+      fail("monotonic time has %ld nanoseconds", (long)ts.tv_nsec);
+    if (ts_ns(&ts) < ts_ns(&prev))
+      fail("monotonic time went backward");
+    prev = ts;
+  }
+  last = ts_ns(&prev);
+
+  /* 1000 calls take far less than one 10 ms timer tick, so a
+     clock that only counted ticks would usually not have moved
+     at all. */
+  if (last == first)
+    fail("monotonic time did not advance during 1000 calls");
+  msg("monotonic time advanced");
+}
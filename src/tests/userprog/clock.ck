@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(clock) begin
+(clock) clock_gettime(-1) fails
+(clock) clock_gettime(1000) fails
+(clock) clock_gettime(CLOCK_REALTIME)
+(clock) clock_gettime(CLOCK_MONOTONIC)
+(clock) monotonic time advanced
+(clock) end
+clock: exit(0)
+EOF
+pass;
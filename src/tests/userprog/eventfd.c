@@ -0,0 +1,38 @@
+/* Adds to an event counter within one process and from a forked
+   child, checking that a read takes the whole count, that poll()
+   reports the counter readable only while it is nonzero, and
+   that a read waits for the child's write. */
+
+#include <poll.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  struct pollfd pfd;
+  uint64_t n;
+  int fd, got;
+  pid_t pid;
+
+  CHECK((fd = eventfd(3)) > 1, "eventfd");
+  n = 4;
+  CHECK(write(fd, &n, sizeof n) == sizeof n, "add 4");
+  pfd = (struct pollfd){.fd = fd, .events = POLLIN | POLLOUT};
+  CHECK(poll(&pfd, 1, 0) == 1 && pfd.revents == (POLLIN | POLLOUT), "poll nonzero counter");
+  CHECK(read(fd, &n, sizeof n) == sizeof n && n == 7, "read 7");
+  CHECK(poll(&pfd, 1, 0) == 1 && pfd.revents == POLLOUT, "poll zero counter");
+  CHECK(read(fd, &n, sizeof n / 2) == 0, "short read reads nothing");
+  n = UINT64_MAX;
+  CHECK(write(fd, &n, sizeof n) == 0, "overflowing write adds nothing");
+
+  pid = fork();
+  if (pid == 0) {
+    n = 1;
+    exit(write(fd, &n, sizeof n) == sizeof n ? 0 : 1);
+  }
+  got = read(fd, &n, sizeof n);
+  CHECK(wait(pid) == 0, "wait for child");
+  CHECK(got == sizeof n && n == 1, "read child's event");
+  close(fd);
+}
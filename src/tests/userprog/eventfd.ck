@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(eventfd) begin
+(eventfd) eventfd
+(eventfd) add 4
+(eventfd) poll nonzero counter
+(eventfd) read 7
+(eventfd) poll zero counter
+(eventfd) short read reads nothing
+(eventfd) overflowing write adds nothing
+eventfd: exit(0)
+(eventfd) wait for child
+(eventfd) read child's event
+(eventfd) end
+eventfd: exit(0)
+EOF
+pass;
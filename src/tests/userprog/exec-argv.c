@@ -0,0 +1,15 @@
+/* Passes split arguments to a child process with exec_argv(),
+   including one that contains a space and so would have been
+   split in two by exec(). */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  char* argv[] = {"child-args", "one arg", "", "two", NULL};
+  pid_t pid = exec_argv(argv);
+
+  CHECK(pid != PID_ERROR, "exec_argv");
+  wait(pid);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(exec-argv) begin
+(exec-argv) exec_argv
+(args) begin
+(args) argc = 4
+(args) argv[0] = 'child-args'
+(args) argv[1] = 'one arg'
+(args) argv[2] = ''
+(args) argv[3] = 'two'
+(args) argv[4] = null
+(args) end
+child-args: exit(0)
+(exec-argv) end
+exec-argv: exit(0)
+EOF
+pass;
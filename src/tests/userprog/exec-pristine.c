@@ -0,0 +1,13 @@
+/* Runs the same program several times with different arguments,
+   each run changing its own data, bss and heap, and checks that
+   every run still starts from the program as loaded. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  CHECK(wait(exec("child-pristine one")) == 0, "wait for child-pristine one");
+  CHECK(wait(exec("child-pristine two")) == 0, "wait for child-pristine two");
+  CHECK(wait(exec("child-pristine three")) == 0, "wait for child-pristine three");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(exec-pristine) begin
+(exec-pristine) wait for child-pristine one
+(child-pristine) run one
+child-pristine: exit(0)
+(exec-pristine) wait for child-pristine two
+(child-pristine) run two
+child-pristine: exit(0)
+(exec-pristine) wait for child-pristine three
+(child-pristine) run three
+child-pristine: exit(0)
+(exec-pristine) end
+exec-pristine: exit(0)
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Forks while the parent has several pages of data, then has
+   both processes modify them, the child partly through read()
+   so that the kernel writes to a shared page on its behalf.
+   Each process must see only its own changes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BUF_SIZE (3 * 4096)
+
+static char buf[BUF_SIZE];
+
+/* Checks that every byte of BUF is C. */
+static void check_buf(char c, const char* who) {
+  for (int i = 0; i < BUF_SIZE; i++)
+    if (buf[i] != c)
+      fail("%s sees '%c' at offset %d, expected '%c'", who, buf[i], i, c);
+  msg("%s sees its own data", who);
+}
+
+void test_main(void) {
+  int fd;
+
+  memset(buf, 'p', BUF_SIZE);
+  CHECK((fd = open("sample.txt")) > 1, "open \"sample.txt\"");
+
+  pid_t pid = fork();
+  if (pid < 0)
+    fail("fork returned %d", pid);
+  else if (pid == 0) {
+    int size = filesize(fd);
+
+    /* Straddle the boundary between the first two pages. */
+    if (read(fd, buf + 4096 - 8, size) != size)
+      fail("read failed");
+    memset(buf, 'c', BUF_SIZE);
+    check_buf('c', "child");
+    exit(0);
+  } else {
+    wait(pid);
+    check_buf('p', "parent");
+    memset(buf, 'q', BUF_SIZE);
+    check_buf('q', "parent");
+  }
+}
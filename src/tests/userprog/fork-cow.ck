@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+(fork-cow) child sees its own data
+fork-cow: exit(0)
+(fork-cow) parent sees its own data
+(fork-cow) parent sees its own data
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Compresses pages of several kinds with lib/kernel/lz.c and
+   checks that each decompresses to the original, that a page of
+   noise does not fit in half a page, and that truncated input is
+   rejected rather than overrunning the output. */
+
+#include <lz.h>
+#include <random.h>
+#include <string.h>
+#include <debug.h>
+#include "tests/userprog/kernel/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+static uint16_t table[LZ_HASH_SIZE];
+
+/* Fills PAGE with pattern KIND. */
+static void fill(uint8_t* page, int kind) {
+  size_t i;
+
+  for (i = 0; i < PGSIZE; i++)
+    switch (kind) {
+      case 0: /* Zeros. */
+        page[i] = 0;
+        break;
+      case 1: /* Repeated text. */
+        page[i] = "the quick brown fox "[i % 20];
+        break;
+      case 2: /* Mostly zeros, some noise. */
+        page[i] = random_ulong() % 8 == 0 ? random_ulong() : 0;
+        break;
+      default: /* Noise. */
+        page[i] = random_ulong();
+        break;
+    }
+}
+
+void test_lz_round(void) {
+  uint8_t* src = palloc_get_page(PAL_ASSERT);
+  uint8_t* dst = palloc_get_multiple(PAL_ASSERT, 2);
+  uint8_t* back = palloc_get_page(PAL_ASSERT);
+  int kind;
+
+  random_init(0);
+  for (kind = 0; kind < 4; kind++) {
+    size_t len, cut;
+
+    fill(src, kind);
+    len = lz_compress(src, PGSIZE, dst, 2 * PGSIZE, table);
+    if (len == 0)
+      fail("kind %d: compression failed", kind);
+    if (!lz_decompress(dst, len, back, PGSIZE) || memcmp(src, back, PGSIZE))
+      fail("kind %d: round trip failed", kind);
+    if ((kind < 3) != (lz_compress(src, PGSIZE, dst, PGSIZE / 2, table) != 0))
+      fail("kind %d: wrong result with half a page of room", kind);
+
+    len = lz_compress(src, PGSIZE, dst, 2 * PGSIZE, table);
+    for (cut = 0; cut < len; cut += 7)
+      if (lz_decompress(dst, cut, back, PGSIZE))
+        fail("kind %d: accepted input truncated to %zu bytes", kind, cut);
+  }
+
+  palloc_free_page(back);
+  palloc_free_multiple(dst, 2);
+  palloc_free_page(src);
+  pass();
+}
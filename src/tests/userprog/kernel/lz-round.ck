@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(lz-round) begin
+(lz-round) PASS
+(lz-round) end
+EOF
+pass;
@@ -0,0 +1,57 @@
+/* Checks the guarantees readers get from threads/rcu.c: a
+   thread inside a read-side section is not preempted by a thread
+   of equal priority, even across several time slices, but yields
+   to it once the section ends, and a callback queued inside a
+   section runs only after the section ends. */
+
+#include <debug.h>
+#include "tests/userprog/kernel/tests.h"
+#include "devices/timer.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Ticks to spend inside the section, several time slices. */
+#define SPIN_TICKS 20
+
+static volatile bool other_ran;
+static volatile bool callback_ran;
+static struct semaphore callback_done;
+
+static void other(void* aux UNUSED) { other_ran = true; }
+
+static void callback(struct rcu_head* head UNUSED) {
+  callback_ran = true;
+  sema_up(&callback_done);
+}
+
+void test_rcu_defer(void) {
+  struct rcu_head head;
+  int64_t start;
+
+  sema_init(&callback_done, 0);
+  if (thread_create("other", thread_get_priority(), other, NULL) == TID_ERROR)
+    fail("thread_create() failed");
+
+  rcu_read_lock();
+  rcu_read_lock();
+  rcu_read_unlock();
+  if (!rcu_read_held())
+    fail("inner rcu_read_unlock() ended the outer section");
+  if (thread_get_by_tid(thread_tid()) != thread_current())
+    fail("thread_get_by_tid() did not find the running thread");
+  call_rcu(&head, callback);
+  start = timer_ticks();
+  while (timer_elapsed(start) < SPIN_TICKS)
+    barrier();
+  if (other_ran)
+    fail("preempted inside a read-side section");
+  if (callback_ran)
+    fail("callback ran inside a read-side section");
+  rcu_read_unlock();
+
+  if (!other_ran)
+    fail("did not yield at the end of the read-side section");
+  sema_down(&callback_done);
+  pass();
+}
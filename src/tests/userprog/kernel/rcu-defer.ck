@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rcu-defer) begin
+(rcu-defer) PASS
+(rcu-defer) end
+EOF
+pass;
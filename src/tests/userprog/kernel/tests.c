@@ -6,6 +6,8 @@
 static const struct test userprog_tests[] = {
     {"fp-kasm", test_fp_kasm},
     {"fp-kinit", test_fp_kinit},
+    {"lz-round", test_lz_round},
+    {"rcu-defer", test_rcu_defer},
 };
 
 /* Runs the userprog test named NAME. */
@@ -7,5 +7,7 @@ void run_userprog_test(const char*);
 
 extern test_func test_fp_kasm;
 extern test_func test_fp_kinit;
+extern test_func test_lz_round;
+extern test_func test_rcu_defer;
 
 #endif /* tests/userprog/kernel/tests.h */
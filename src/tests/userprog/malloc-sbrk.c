@@ -0,0 +1,65 @@
+/* Moves the program break with sbrk(), then allocates, checks
+   and frees many small and large blocks with malloc(), including
+   growing one with realloc(). */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 200
+
+static char* blocks[BLOCK_CNT];
+
+/* Returns the size of the Ith block: mostly small, some spanning
+   several pages. */
+static size_t block_size(int i) { return i % 10 == 0 ? 3 * 4096 + i : 1 + i * 7 % 2000; }
+
+void test_main(void) {
+  char* brk;
+  char* p;
+  int i;
+
+  brk = sbrk(0);
+  CHECK(brk != (void*)-1, "sbrk(0)");
+  CHECK(sbrk(8192) == brk, "grow heap by 2 pages");
+  memset(brk, 'x', 8192);
+  CHECK(sbrk(-8192) == brk + 8192, "shrink heap by 2 pages");
+  CHECK(sbrk(0) == brk, "break is back where it started");
+
+  for (i = 0; i < BLOCK_CNT; i++) {
+    blocks[i] = malloc(block_size(i));
+    if (blocks[i] == NULL)
+      fail("malloc of block %d failed", i);
+    memset(blocks[i], i, block_size(i));
+  }
+  for (i = 0; i < BLOCK_CNT; i++) {
+    size_t j;
+    for (j = 0; j < block_size(i); j++)
+      if (blocks[i][j] != (char)i)
+        fail("block %d corrupted at offset %zu", i, j);
+  }
+  msg("allocated and checked %d blocks", BLOCK_CNT);
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    free(blocks[i]);
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    free(blocks[i]);
+  msg("freed all blocks");
+
+  p = malloc(100);
+  memset(p, 'r', 100);
+  p = realloc(p, 10000);
+  CHECK(p != NULL, "realloc to 10000 bytes");
+  for (i = 0; i < 100; i++)
+    if (p[i] != 'r')
+      fail("realloc lost byte %d", i);
+  free(p);
+
+  p = calloc(1000, 10);
+  CHECK(p != NULL, "calloc 1000 x 10 bytes");
+  for (i = 0; i < 10000; i++)
+    if (p[i] != 0)
+      fail("calloc byte %d is not zero", i);
+  free(p);
+}
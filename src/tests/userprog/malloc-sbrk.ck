@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-sbrk) begin
+(malloc-sbrk) sbrk(0)
+(malloc-sbrk) grow heap by 2 pages
+(malloc-sbrk) shrink heap by 2 pages
+(malloc-sbrk) break is back where it started
+(malloc-sbrk) allocated and checked 200 blocks
+(malloc-sbrk) freed all blocks
+(malloc-sbrk) realloc to 10000 bytes
+(malloc-sbrk) calloc 1000 x 10 bytes
+(malloc-sbrk) end
+malloc-sbrk: exit(0)
+EOF
+pass;
@@ -0,0 +1,146 @@
+/* Exercises the pthread condition variables, reader-writer locks,
+   and barriers.  Producers and consumers pass items through a
+   bounded buffer guarded by a mutex and two condition variables,
+   readers and writers share a counter under a rwlock, and every
+   thread meets at a barrier between the phases. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+#include <syscall.h>
+#include <pthread.h>
+
+#define NUM_THREADS 4 /* Producers, and also consumers. */
+#define ITEMS 50      /* Items each producer makes. */
+#define SLOTS 3       /* Size of the bounded buffer. */
+
+static pthread_mutex_t mutex;
+static pthread_cond_t not_full, not_empty;
+static int buffer[SLOTS];
+static int head, count;
+static int consumed_sum;
+
+static pthread_rwlock_t rwlock;
+static volatile int shared_value;
+static bool torn;
+
+static pthread_barrier_t barrier;
+static int serial_cnt;
+
+/* Puts ITEM in the buffer, waiting while it is full. */
+static void put(int item) {
+  pthread_mutex_lock(&mutex);
+  while (count == SLOTS)
+    pthread_cond_wait(&not_full, &mutex);
+  buffer[(head + count++) % SLOTS] = item;
+  pthread_cond_signal(&not_empty);
+  pthread_mutex_unlock(&mutex);
+}
+
+/* Takes an item out of the buffer, waiting while it is empty. */
+static int get(void) {
+  int item;
+
+  pthread_mutex_lock(&mutex);
+  while (count == 0)
+    pthread_cond_wait(&not_empty, &mutex);
+  item = buffer[head];
+  head = (head + 1) % SLOTS;
+  count--;
+  pthread_cond_signal(&not_full);
+  pthread_mutex_unlock(&mutex);
+  return item;
+}
+
+/* Meets the other threads at the barrier, counting how many times
+   a thread is told it was the last to arrive. */
+static void meet(void) {
+  if (pthread_barrier_wait(&barrier)) {
+    pthread_mutex_lock(&mutex);
+    serial_cnt++;
+    pthread_mutex_unlock(&mutex);
+  }
+}
+
+static void producer(void* arg_) {
+  int id = (int)arg_;
+  int i;
+
+  meet();
+  for (i = 1; i <= ITEMS; i++)
+    put(id * 1000 + i);
+  meet();
+}
+
+static void consumer(void* arg_ UNUSED) {
+  int sum = 0;
+  int i;
+
+  meet();
+  for (i = 0; i < ITEMS; i++)
+    sum += get();
+  pthread_mutex_lock(&mutex);
+  consumed_sum += sum;
+  pthread_mutex_unlock(&mutex);
+  meet();
+
+  /* Every fifth pass, update the two halves of SHARED_VALUE one
+     at a time; readers must never see them differ. */
+  for (i = 0; i < ITEMS; i++) {
+    if (i % 5 == 0) {
+      pthread_rwlock_wrlock(&rwlock);
+      shared_value += 1;
+      shared_value += 0x10000;
+      pthread_rwlock_unlock(&rwlock);
+    } else {
+      pthread_rwlock_rdlock(&rwlock);
+      if ((shared_value & 0xffff) != (shared_value >> 16))
+        torn = true;
+      pthread_rwlock_unlock(&rwlock);
+    }
+  }
+}
+
+void test_main(void) {
+  tid_t tids[NUM_THREADS * 2];
+  int expected_sum = 0;
+  bool trylocked;
+  int i;
+
+  pthread_mutex_init(&mutex);
+  pthread_cond_init(&not_full);
+  pthread_cond_init(&not_empty);
+  pthread_rwlock_init(&rwlock);
+  pthread_barrier_init(&barrier, NUM_THREADS * 2);
+
+  pthread_mutex_lock(&mutex);
+  trylocked = pthread_mutex_trylock(&mutex);
+  pthread_mutex_unlock(&mutex);
+  if (trylocked)
+    fail("trylock acquired a held mutex");
+  if (!pthread_mutex_trylock(&mutex))
+    fail("trylock failed on a free mutex");
+  pthread_mutex_unlock(&mutex);
+
+  for (i = 0; i < NUM_THREADS; i++) {
+    tids[2 * i] = pthread_check_create(producer, (void*)(i + 1));
+    tids[2 * i + 1] = pthread_check_create(consumer, NULL);
+  }
+  for (i = 0; i < NUM_THREADS * 2; i++)
+    pthread_check_join(tids[i]);
+
+  for (i = 1; i <= NUM_THREADS; i++)
+    expected_sum += i * 1000 * ITEMS + ITEMS * (ITEMS + 1) / 2;
+  if (consumed_sum != expected_sum)
+    fail("consumers took items summing to %d, expected %d", consumed_sum, expected_sum);
+  msg("buffer passed all items");
+
+  if (torn)
+    fail("reader saw a half-written value");
+  if (shared_value != NUM_THREADS * (ITEMS / 5) * 0x10001)
+    fail("writers left value %#x", shared_value);
+  msg("rwlock kept readers and writers apart");
+
+  if (serial_cnt != 2)
+    fail("%d threads were last at the barrier, expected 2", serial_cnt);
+  msg("barrier held twice");
+}
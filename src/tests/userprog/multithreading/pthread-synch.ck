@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(pthread-synch) begin
+(pthread-synch) buffer passed all items
+(pthread-synch) rwlock kept readers and writers apart
+(pthread-synch) barrier held twice
+(pthread-synch) end
+pthread-synch: exit(0)
+EOF
+pass;
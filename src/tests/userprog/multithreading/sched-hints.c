@@ -0,0 +1,78 @@
+/* Exercises the scheduling hints.  Two threads are woken so that
+   the first woken would run last, and sched_yield_to() must make
+   it run first anyway.  Then several threads sleep on one futex
+   and futex_wake_all() must wake them all at once. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+#include <syscall.h>
+#include <pthread.h>
+#include <string.h>
+
+#define GANG_CNT 4 /* Threads woken together. */
+
+static sema_t go_first, go_second;
+static char order[3];
+static int order_cnt;
+
+static int gang_word;
+static int gang_ran;
+
+/* Waits for SEMA to be upped, then records NAME. */
+static void record(sema_t* sema, char name) {
+  sema_down(sema);
+  order[order_cnt++] = name;
+}
+
+static void first(void* arg_ UNUSED) { record(&go_first, 'A'); }
+
+static void second(void* arg_ UNUSED) { record(&go_second, 'B'); }
+
+/* Sleeps on GANG_WORD until it changes. */
+static void gang_member(void* arg_ UNUSED) {
+  while (__atomic_load_n(&gang_word, __ATOMIC_SEQ_CST) == 0)
+    futex_wait(&gang_word, 0);
+  __atomic_fetch_add(&gang_ran, 1, __ATOMIC_SEQ_CST);
+}
+
+void test_main(void) {
+  tid_t tids[GANG_CNT];
+  tid_t a, b;
+  int woken;
+  int i;
+
+  if (sched_yield_to(get_tid()))
+    fail("yielded to the running thread");
+  if (sched_yield_to(-1))
+    fail("yielded to a bad tid");
+
+  /* Both threads start and go to sleep.  Waking A and then B
+     puts B first in line, so only the hint lets A run first. */
+  sema_check_init(&go_first, 0);
+  sema_check_init(&go_second, 0);
+  a = pthread_check_create(first, NULL);
+  b = pthread_check_create(second, NULL);
+  sema_up(&go_first);
+  sema_up(&go_second);
+  if (!sched_yield_to(a))
+    fail("sched_yield_to() did not hand over the slice");
+  pthread_check_join(a);
+  pthread_check_join(b);
+  if (strcmp(order, "AB"))
+    fail("threads ran in order %s, expected AB", order);
+  msg("yielded to the chosen thread");
+  if (sched_yield_to(a))
+    fail("yielded to a thread that exited");
+
+  for (i = 0; i < GANG_CNT; i++)
+    tids[i] = pthread_check_create(gang_member, NULL);
+  __atomic_store_n(&gang_word, 1, __ATOMIC_SEQ_CST);
+  woken = futex_wake_all(&gang_word);
+  for (i = 0; i < GANG_CNT; i++)
+    pthread_check_join(tids[i]);
+  if (woken != GANG_CNT)
+    fail("futex_wake_all() woke %d threads, expected %d", woken, GANG_CNT);
+  if (gang_ran != GANG_CNT)
+    fail("%d gang members ran, expected %d", gang_ran, GANG_CNT);
+  msg("woke the whole gang at once");
+}
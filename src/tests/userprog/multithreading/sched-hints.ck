@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(sched-hints) begin
+(sched-hints) yielded to the chosen thread
+(sched-hints) woke the whole gang at once
+(sched-hints) end
+sched-hints: exit(0)
+EOF
+pass;
@@ -0,0 +1,72 @@
+/* Checks that each thread has its own thread-local storage, that
+   it starts out null, and that fork() gives the child's thread a
+   copy of the forking thread's. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+#include <syscall.h>
+#include <pthread.h>
+
+#define NUM_THREADS 4
+#define ROUNDS 20
+
+static sema_t started;
+static sema_t go;
+static int values[NUM_THREADS];
+
+/* Stores a pointer to its own slot of VALUES in TLS, then checks
+   after the other threads have done the same that it still reads
+   its own. */
+static void thread_function(void* arg_) {
+  int* value = arg_;
+  void** tls = pthread_tls();
+  int i;
+
+  if (tls[0] != NULL)
+    fail("new thread's TLS slot is not null");
+  tls[0] = value;
+  sema_up(&started);
+  sema_down(&go);
+
+  for (i = 0; i < ROUNDS; i++) {
+    if (pthread_tls()[0] != value)
+      fail("thread read another thread's TLS");
+    (*(int*)pthread_tls()[0])++;
+  }
+}
+
+void test_main(void) {
+  tid_t tids[NUM_THREADS];
+  int mine = 0;
+  pid_t pid;
+  int i;
+
+  sema_check_init(&started, 0);
+  sema_check_init(&go, 0);
+  pthread_tls()[0] = &mine;
+
+  for (i = 0; i < NUM_THREADS; i++)
+    tids[i] = pthread_check_create(thread_function, &values[i]);
+  for (i = 0; i < NUM_THREADS; i++)
+    sema_down(&started);
+  for (i = 0; i < NUM_THREADS; i++)
+    sema_up(&go);
+  for (i = 0; i < NUM_THREADS; i++)
+    pthread_check_join(tids[i]);
+
+  for (i = 0; i < NUM_THREADS; i++)
+    if (values[i] != ROUNDS)
+      fail("thread %d counted %d, expected %d", i, values[i], ROUNDS);
+  if (pthread_tls()[0] != &mine)
+    fail("main thread's TLS changed");
+  msg("threads kept their own TLS");
+
+  pid = fork();
+  if (pid == 0) {
+    if (pthread_tls()[0] != &mine)
+      fail("child lost the forking thread's TLS");
+    msg("child inherited TLS");
+    exit(0);
+  }
+  CHECK(wait(pid) == 0, "wait for child");
+}
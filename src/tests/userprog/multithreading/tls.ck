@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(tls) begin
+(tls) threads kept their own TLS
+(tls) child inherited TLS
+tls: exit(0)
+(tls) wait for child
+(tls) end
+tls: exit(0)
+EOF
+pass;
@@ -0,0 +1,32 @@
+/* Opens a file 100 times, which must give 100 different file
+   descriptors, then checks that closing descriptors makes open()
+   hand back the lowest one that is free. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OPEN_CNT 100
+
+void test_main(void) {
+  int fds[OPEN_CNT];
+  int i, fd;
+
+  for (i = 0; i < OPEN_CNT; i++)
+    if ((fds[i] = open("sample.txt")) < 2)
+      fail("open #%d returned %d", i, fds[i]);
+  for (i = 1; i < OPEN_CNT; i++)
+    if (fds[i] <= fds[i - 1])
+      fail("open #%d returned %d after %d", i, fds[i], fds[i - 1]);
+  msg("opened \"sample.txt\" %d times", OPEN_CNT);
+
+  close(fds[70]);
+  close(fds[10]);
+  CHECK((fd = open("sample.txt")) == fds[10], "open reuses lowest free descriptor");
+  CHECK((fd = open("sample.txt")) == fds[70], "open reuses next free descriptor");
+  CHECK(filesize(fds[70]) == filesize(fds[0]), "reused descriptor works");
+
+  for (i = 0; i < OPEN_CNT; i++)
+    close(fds[i]);
+  CHECK(open("sample.txt") == fds[0], "open after closing all");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-reuse) begin
+(open-reuse) opened "sample.txt" 100 times
+(open-reuse) open reuses lowest free descriptor
+(open-reuse) open reuses next free descriptor
+(open-reuse) reused descriptor works
+(open-reuse) open after closing all
+(open-reuse) end
+open-reuse: exit(0)
+EOF
+pass;
@@ -0,0 +1,74 @@
+/* Sends data through a pipe within one process, from a forked
+   child to its parent, and from a spawned child's console output
+   to its parent, checking that readers see end of file and
+   writers stop once the other side is closed. */
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* More than a pipe holds at most, so that the writer must wait
+   for the reader. */
+#define BIG_SIZE (100 * 1024)
+
+static char buf[4096];
+
+void test_main(void) {
+  struct pollfd pfd;
+  struct spawn_fd sfd;
+  int fds[2];
+  int total, n, i;
+  pid_t pid;
+
+  CHECK(pipe(fds) == 0, "pipe");
+  CHECK(write(fds[1], "hello", 5) == 5, "write 5 bytes");
+  pfd = (struct pollfd){.fd = fds[0], .events = POLLIN};
+  CHECK(poll(&pfd, 1, 0) == 1 && pfd.revents == POLLIN, "poll read end");
+  CHECK(read(fds[0], buf, sizeof buf) == 5 && !memcmp(buf, "hello", 5), "read 5 bytes");
+  seek(fds[0], 0);
+  CHECK(tell(fds[0]) == (unsigned)-1, "tell on pipe fails");
+  close(fds[0]);
+  CHECK(write(fds[1], "x", 1) == 0, "write with no reader writes nothing");
+  pfd = (struct pollfd){.fd = fds[1], .events = POLLOUT};
+  CHECK(poll(&pfd, 1, 0) == 1 && pfd.revents == POLLERR, "poll write end with no reader");
+  close(fds[1]);
+
+  CHECK(pipe(fds) == 0, "pipe");
+  pid = fork();
+  if (pid == 0) {
+    static char big[BIG_SIZE];
+
+    close(fds[0]);
+    for (i = 0; i < BIG_SIZE; i++)
+      big[i] = i % 251;
+    exit(write(fds[1], big, BIG_SIZE) == BIG_SIZE ? 0 : 1);
+  }
+  close(fds[1]);
+  total = 0;
+  while ((n = read(fds[0], buf, sizeof buf)) > 0) {
+    for (i = 0; i < n; i++)
+      if (buf[i] != (char)((total + i) % 251))
+        fail("byte %d is %d", total + i, buf[i]);
+    total += n;
+  }
+  CHECK(wait(pid) == 0, "wait for writer");
+  if (total != BIG_SIZE)
+    fail("read %d bytes, expected %d", total, BIG_SIZE);
+  msg("read %d bytes from child", total);
+  close(fds[0]);
+
+  CHECK(pipe(fds) == 0, "pipe");
+  sfd = (struct spawn_fd){fds[1], STDOUT_FILENO};
+  CHECK((pid = spawn("child-simple", &sfd, 1)) != PID_ERROR, "spawn child-simple");
+  close(fds[1]);
+  total = 0;
+  while ((n = read(fds[0], buf + total, sizeof buf - 1 - total)) > 0)
+    total += n;
+  buf[total] = '\0';
+  CHECK(wait(pid) == 81, "wait for child-simple");
+  CHECK(!strcmp(buf, "(child-simple) run\n"), "child-simple's output came through the pipe");
+  close(fds[0]);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe) begin
+(pipe) pipe
+(pipe) write 5 bytes
+(pipe) poll read end
+(pipe) read 5 bytes
+(pipe) tell on pipe fails
+(pipe) write with no reader writes nothing
+(pipe) poll write end with no reader
+(pipe) pipe
+pipe: exit(0)
+(pipe) wait for writer
+(pipe) read 102400 bytes from child
+(pipe) pipe
+(pipe) spawn child-simple
+child-simple: exit(81)
+(pipe) wait for child-simple
+(pipe) child-simple's output came through the pipe
+(pipe) end
+pipe: exit(0)
+EOF
+pass;
@@ -0,0 +1,54 @@
+/* Checks that poll() reports files and the console as ready for
+   the events asked for, marks a closed descriptor with POLLNVAL,
+   times out on a keyboard with nothing typed and rejects too many
+   descriptors. */
+
+#include <poll.h>
+#include <stdio.h>
+#include <syscall.h>
+#include <time.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Returns the monotonic clock in milliseconds. */
+static int64_t now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void test_main(void) {
+  struct pollfd fds[POLL_MAX + 1];
+  int64_t start;
+  int fd;
+
+  CHECK(create("poll.txt", 0), "create \"poll.txt\"");
+  CHECK((fd = open("poll.txt")) > 1, "open \"poll.txt\"");
+
+  fds[0] = (struct pollfd){.fd = fd, .events = POLLIN | POLLOUT};
+  fds[1] = (struct pollfd){.fd = STDOUT_FILENO, .events = POLLIN | POLLOUT};
+  fds[2] = (struct pollfd){.fd = -1, .events = POLLIN};
+  fds[3] = (struct pollfd){.fd = 1234, .events = POLLIN};
+  CHECK(poll(fds, 4, -1) == 3, "poll file, stdout, skipped and bad fds");
+  if (fds[0].revents != (POLLIN | POLLOUT))
+    fail("file revents %#x", fds[0].revents);
+  if (fds[1].revents != POLLOUT)
+    fail("stdout revents %#x", fds[1].revents);
+  if (fds[2].revents != 0)
+    fail("skipped fd revents %#x", fds[2].revents);
+  if (fds[3].revents != POLLNVAL)
+    fail("bad fd revents %#x", fds[3].revents);
+
+  /* Nothing is typed while the tests run. */
+  fds[0] = (struct pollfd){.fd = STDIN_FILENO, .events = POLLIN};
+  CHECK(poll(fds, 1, 0) == 0, "poll stdin without waiting");
+  start = now_ms();
+  CHECK(poll(fds, 1, 50) == 0, "poll stdin for 50 ms");
+  if (now_ms() - start < 40)
+    fail("poll returned after %lld ms", now_ms() - start);
+  if (fds[0].revents != 0)
+    fail("stdin revents %#x", fds[0].revents);
+
+  CHECK(poll(fds, POLL_MAX + 1, 0) == -1, "poll too many fds");
+}
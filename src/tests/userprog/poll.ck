@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll) begin
+(poll) create "poll.txt"
+(poll) open "poll.txt"
+(poll) poll file, stdout, skipped and bad fds
+(poll) poll stdin without waiting
+(poll) poll stdin for 50 ms
+(poll) poll too many fds
+(poll) end
+poll: exit(0)
+EOF
+pass;
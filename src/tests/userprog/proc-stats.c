@@ -0,0 +1,42 @@
+/* Reads statistics files under /proc, checking that each holds
+   what the kernel prints for it and that they cannot be
+   written. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[4096];
+
+/* Reads file NAME into buf, null-terminated, and returns its
+   length. */
+static int read_all(const char* name) {
+  int fd, len;
+
+  CHECK((fd = open(name)) > 1, "open \"%s\"", name);
+  len = read(fd, buf, sizeof buf - 1);
+  CHECK(len > 0, "read \"%s\"", name);
+  buf[len] = '\0';
+  close(fd);
+  return len;
+}
+
+void test_main(void) {
+  int fd;
+
+  read_all("/proc");
+  CHECK(strstr(buf, "timer\n") != NULL && strstr(buf, "self\n") != NULL, "index lists files");
+
+  read_all("/proc/timer");
+  CHECK(!memcmp(buf, "Timer: ", 7), "timer statistics");
+
+  read_all("/proc/self");
+  CHECK(!memcmp(buf, "proc-stats: ", 12), "own resource usage");
+
+  CHECK((fd = open("/proc/timer")) > 1, "open \"/proc/timer\"");
+  CHECK(write(fd, "x", 1) <= 0, "write refused");
+  close(fd);
+
+  CHECK(open("/proc/no-such-file") == -1, "open \"/proc/no-such-file\" fails");
+}
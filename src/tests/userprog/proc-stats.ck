@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(proc-stats) begin
+(proc-stats) open "/proc"
+(proc-stats) read "/proc"
+(proc-stats) index lists files
+(proc-stats) open "/proc/timer"
+(proc-stats) read "/proc/timer"
+(proc-stats) timer statistics
+(proc-stats) open "/proc/self"
+(proc-stats) read "/proc/self"
+(proc-stats) own resource usage
+(proc-stats) open "/proc/timer"
+(proc-stats) write refused
+(proc-stats) open "/proc/no-such-file" fails
+(proc-stats) end
+proc-stats: exit(0)
+EOF
+pass;
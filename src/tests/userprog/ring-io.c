@@ -0,0 +1,55 @@
+/* Writes a file, then seeks back, reads it and closes it, each
+   time submitting all of the operations with one ring_enter(),
+   and checks the completions. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char* const chunks[] = {"Batched ", "writes ", "through ", "one system call.\n"};
+#define CHUNK_CNT (sizeof chunks / sizeof *chunks)
+
+static struct io_ring ring;
+
+void test_main(void) {
+  char expected[128], buf[128];
+  struct ring_cqe cqe;
+  size_t i, len = 0;
+  int fd;
+
+  CHECK(create("ring.dat", 0), "create \"ring.dat\"");
+  CHECK((fd = open("ring.dat")) > 1, "open \"ring.dat\"");
+
+  ring_init(&ring);
+  expected[0] = '\0';
+  for (i = 0; i < CHUNK_CNT; i++) {
+    if (!ring_queue(&ring, RING_WRITE, fd, chunks[i], strlen(chunks[i]), i))
+      fail("ring_queue write %zu failed", i);
+    strlcat(expected, chunks[i], sizeof expected);
+  }
+  CHECK(ring_enter(&ring) == (int)CHUNK_CNT, "submit %zu writes", CHUNK_CNT);
+  for (i = 0; i < CHUNK_CNT; i++) {
+    if (!ring_reap(&ring, &cqe))
+      fail("missing completion for write %zu", i);
+    if (cqe.user_data != i || cqe.result != (int)strlen(chunks[i]))
+      fail("write %zu completed as %u with %d", i, cqe.user_data, cqe.result);
+    len += cqe.result;
+  }
+  CHECK(!ring_reap(&ring, &cqe), "no more completions");
+  CHECK(filesize(fd) == (int)len, "file is %zu bytes", len);
+
+  ring_queue(&ring, RING_SEEK, fd, NULL, 0, 10);
+  ring_queue(&ring, RING_READ, fd, buf, sizeof buf, 11);
+  ring_queue(&ring, RING_CLOSE, fd, NULL, 0, 12);
+  ring_queue(&ring, RING_READ, fd, buf, sizeof buf, 13);
+  CHECK(ring_enter(&ring) == 4, "submit seek, read, close, read");
+  CHECK(ring_reap(&ring, &cqe) && cqe.user_data == 10 && cqe.result == 0, "seek succeeded");
+  CHECK(ring_reap(&ring, &cqe) && cqe.user_data == 11 && cqe.result == (int)len,
+        "read %zu bytes", len);
+  if (memcmp(buf, expected, len))
+    fail("read back wrong data");
+  CHECK(ring_reap(&ring, &cqe) && cqe.user_data == 12 && cqe.result == 0, "close succeeded");
+  CHECK(ring_reap(&ring, &cqe) && cqe.user_data == 13 && cqe.result == -1,
+        "read after close failed");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-io) begin
+(ring-io) create "ring.dat"
+(ring-io) open "ring.dat"
+(ring-io) submit 4 writes
+(ring-io) no more completions
+(ring-io) file is 40 bytes
+(ring-io) submit seek, read, close, read
+(ring-io) seek succeeded
+(ring-io) read 40 bytes
+(ring-io) close succeeded
+(ring-io) read after close failed
+(ring-io) end
+ring-io: exit(0)
+EOF
+pass;
@@ -0,0 +1,32 @@
+/* Opens a file twice and spawns a subprocess that gets only the
+   second handle, under a different number.  The subprocess must
+   be able to read the file through that handle, but not through
+   the first one. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_FD 7
+
+void test_main(void) {
+  char child_cmd[128];
+  struct spawn_fd fds[1];
+  int kept, passed;
+
+  CHECK((kept = open("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK((passed = open("sample.txt")) > 1, "open \"sample.txt\"");
+
+  fds[0].parent_fd = passed;
+  fds[0].child_fd = CHILD_FD;
+  snprintf(child_cmd, sizeof child_cmd, "child-spawn %d %d", CHILD_FD, kept);
+  msg("wait(spawn()) = %d", wait(spawn(child_cmd, fds, 1)));
+
+  /* Passing a descriptor we do not have must fail. */
+  fds[0].parent_fd = passed + 10;
+  msg("spawn() with bad fd = %d", spawn(child_cmd, fds, 1));
+
+  check_file_handle(kept, "sample.txt", sample, sizeof sample - 1);
+}
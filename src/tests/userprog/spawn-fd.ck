@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(spawn-fd) begin
+(spawn-fd) open "sample.txt"
+(spawn-fd) open "sample.txt"
+(child-spawn) begin
+(child-spawn) verified contents of "sample.txt"
+(child-spawn) end
+child-spawn: exit(0)
+(spawn-fd) wait(spawn()) = 0
+(spawn-fd) spawn() with bad fd = -1
+(spawn-fd) verified contents of "sample.txt"
+(spawn-fd) end
+spawn-fd: exit(0)
+EOF
+pass;
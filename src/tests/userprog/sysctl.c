@@ -0,0 +1,27 @@
+/* Reads and sets a kernel tunable with sysctl(), checking that
+   a value out of bounds and an unknown name are refused without
+   changing anything. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  int orig, value, new_value;
+
+  CHECK(sysctl("sched.slice_min", &orig, NULL), "read sched.slice_min");
+  CHECK(orig >= 1, "sched.slice_min positive");
+
+  new_value = orig + 1;
+  CHECK(sysctl("sched.slice_min", &value, &new_value), "set sched.slice_min");
+  CHECK(value == orig, "old value returned");
+  CHECK(sysctl("sched.slice_min", &value, NULL) && value == orig + 1, "new value read back");
+
+  new_value = 0;
+  CHECK(!sysctl("sched.slice_min", &value, &new_value), "out-of-bounds value refused");
+  CHECK(sysctl("sched.slice_min", &value, NULL) && value == orig + 1, "value unchanged");
+
+  CHECK(!sysctl("no.such_tunable", &value, NULL), "unknown tunable refused");
+
+  CHECK(sysctl("sched.slice_min", NULL, &orig), "restore sched.slice_min");
+}
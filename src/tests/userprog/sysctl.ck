@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sysctl) begin
+(sysctl) read sched.slice_min
+(sysctl) sched.slice_min positive
+(sysctl) set sched.slice_min
+(sysctl) old value returned
+(sysctl) new value read back
+(sysctl) out-of-bounds value refused
+(sysctl) value unchanged
+(sysctl) unknown tunable refused
+(sysctl) restore sched.slice_min
+(sysctl) end
+sysctl: exit(0)
+EOF
+pass;
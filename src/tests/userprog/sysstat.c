@@ -0,0 +1,41 @@
+/* Checks that syscall_stats() counts each call to practice() in
+   both the process's and the global statistics, and that the
+   times it reports are consistent. */
+
+#include <stats.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CALL_CNT 100
+
+static struct syscall_stats before, after, global;
+
+void test_main(void) {
+  const struct syscall_stat* s;
+  int i;
+
+  CHECK(syscall_stats(false, &before), "syscall_stats(false)");
+  for (i = 0; i < CALL_CNT; i++)
+    practice(i);
+  CHECK(syscall_stats(false, &after), "syscall_stats(false)");
+  CHECK(syscall_stats(true, &global), "syscall_stats(true)");
+
+  s = &after.calls[SYS_PRACTICE];
+  if (s->cnt - before.calls[SYS_PRACTICE].cnt != CALL_CNT)
+    fail("practice() counted %lld times, expected %d",
+         s->cnt - before.calls[SYS_PRACTICE].cnt, CALL_CNT);
+  msg("practice() calls counted");
+
+  if (after.calls[SYS_SYSCALL_STATS].cnt < 2)
+    fail("syscall_stats() counted %lld times", after.calls[SYS_SYSCALL_STATS].cnt);
+  if (global.calls[SYS_PRACTICE].cnt < s->cnt)
+    fail("global practice() count %lld below process count %lld", global.calls[SYS_PRACTICE].cnt,
+         s->cnt);
+  msg("global count includes this process");
+
+  if (s->cycles == 0 || s->max_cycles > s->cycles)
+    fail("practice() took %lld cycles in all, %lld at most", s->cycles, s->max_cycles);
+  msg("practice() times consistent");
+}
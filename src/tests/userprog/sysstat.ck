@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sysstat) begin
+(sysstat) syscall_stats(false)
+(sysstat) syscall_stats(false)
+(sysstat) syscall_stats(true)
+(sysstat) practice() calls counted
+(sysstat) global count includes this process
+(sysstat) practice() times consistent
+(sysstat) end
+sysstat: exit(0)
+EOF
+pass;
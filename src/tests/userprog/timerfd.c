@@ -0,0 +1,53 @@
+/* Arms a periodic timer and waits for it with poll() and read(),
+   checking that the first expiry is not early, that expiries
+   missed while not reading are counted, and that a disarmed
+   timer stays quiet. */
+
+#include <poll.h>
+#include <stdint.h>
+#include <syscall.h>
+#include <time.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Returns the monotonic clock in milliseconds. */
+static int64_t now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void test_main(void) {
+  struct itimerspec spec;
+  struct pollfd pfd;
+  int64_t start;
+  uint64_t n;
+  int fd, efd;
+
+  CHECK((fd = timerfd_create()) > 1, "timerfd_create");
+  spec.it_value = (struct timespec){0, 50 * 1000 * 1000};
+  spec.it_interval = (struct timespec){0, 20 * 1000 * 1000};
+  start = now_ms();
+  CHECK(timerfd_settime(fd, &spec) == 0, "arm for 50 ms, then every 20 ms");
+  pfd = (struct pollfd){.fd = fd, .events = POLLIN | POLLOUT};
+  CHECK(poll(&pfd, 1, -1) == 1 && pfd.revents == POLLIN, "poll for first expiry");
+  if (now_ms() - start < 40)
+    fail("first expiry after %lld ms", now_ms() - start);
+  CHECK(read(fd, &n, sizeof n) == sizeof n && n >= 1, "read first expiry");
+
+  CHECK(poll(NULL, 0, 100) == 0, "sleep 100 ms");
+  CHECK(read(fd, &n, sizeof n) == sizeof n && n >= 4, "read expiries missed while asleep");
+
+  spec.it_value = (struct timespec){0, 0};
+  CHECK(timerfd_settime(fd, &spec) == 0, "disarm");
+  pfd = (struct pollfd){.fd = fd, .events = POLLIN};
+  CHECK(poll(&pfd, 1, 50) == 0, "disarmed timer stays quiet for 50 ms");
+  n = 1;
+  CHECK(write(fd, &n, sizeof n) == 0, "write to timer adds nothing");
+
+  CHECK((efd = eventfd(0)) > 1, "eventfd");
+  CHECK(timerfd_settime(efd, &spec) == -1, "timerfd_settime on eventfd fails");
+  close(efd);
+  close(fd);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(timerfd) begin
+(timerfd) timerfd_create
+(timerfd) arm for 50 ms, then every 20 ms
+(timerfd) poll for first expiry
+(timerfd) read first expiry
+(timerfd) sleep 100 ms
+(timerfd) read expiries missed while asleep
+(timerfd) disarm
+(timerfd) disarmed timer stays quiet for 50 ms
+(timerfd) write to timer adds nothing
+(timerfd) eventfd
+(timerfd) timerfd_settime on eventfd fails
+(timerfd) end
+timerfd: exit(0)
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Writes a file with writev(), reads and overwrites parts of it
+   with pread() and pwrite(), which must leave the file position
+   alone, and reads it back with readv(). */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  char head[] = "Gather ", body[] = "and scatter ", tail[] = "I/O.";
+  struct iovec out[] = {{head, 7}, {body, 12}, {tail, 4}};
+  char first[10], second[32], buf[16];
+  struct iovec in[] = {{first, sizeof first}, {second, sizeof second}};
+  int fd;
+
+  CHECK(create("vector.dat", 0), "create \"vector.dat\"");
+  CHECK((fd = open("vector.dat")) > 1, "open \"vector.dat\"");
+
+  CHECK(writev(fd, out, 3) == 23, "writev 3 buffers");
+  CHECK(tell(fd) == 23, "position after writev");
+
+  CHECK(pread(fd, buf, 7, 7) == 7 && !memcmp(buf, "and sca", 7), "pread at offset 7");
+  CHECK(pwrite(fd, "SCATTER", 7, 11) == 7, "pwrite at offset 11");
+  CHECK(pread(fd, buf, sizeof buf, 20) == 3 && !memcmp(buf, "/O.", 3),
+        "pread stops at end of file");
+  CHECK(tell(fd) == 23, "position unchanged");
+
+  seek(fd, 0);
+  memset(second, 0, sizeof second);
+  CHECK(readv(fd, in, 2) == 23, "readv 2 buffers");
+  if (memcmp(first, "Gather and", 10) || strcmp(second, " SCATTER I/O."))
+    fail("read back \"%.10s%s\"", first, second);
+  CHECK(pread(fd, buf, 1, 23) == 0, "pread at end of file");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(vector-io) begin
+(vector-io) create "vector.dat"
+(vector-io) open "vector.dat"
+(vector-io) writev 3 buffers
+(vector-io) position after writev
+(vector-io) pread at offset 7
+(vector-io) pwrite at offset 11
+(vector-io) pread stops at end of file
+(vector-io) position unchanged
+(vector-io) readv 2 buffers
+(vector-io) pread at end of file
+(vector-io) end
+vector-io: exit(0)
+EOF
+pass;
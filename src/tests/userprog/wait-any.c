@@ -0,0 +1,45 @@
+/* Forks several children and reaps them all with wait_any(),
+   checking that each pid comes back exactly once with its exit
+   status, that a reaped child cannot be waited for again, and
+   that wait_any() fails once no children are left. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 5
+
+void test_main(void) {
+  pid_t pids[CHILD_CNT];
+  bool reaped[CHILD_CNT] = {false};
+  int i;
+
+  /* The children may exit while we are still forking. */
+  quiet = true;
+  for (i = 0; i < CHILD_CNT; i++) {
+    pids[i] = fork();
+    if (pids[i] == 0)
+      exit(7);
+    CHECK(pids[i] > 0, "fork child %d", i);
+  }
+  quiet = false;
+
+  for (i = 0; i < CHILD_CNT; i++) {
+    int status = -1;
+    pid_t pid = wait_any(&status);
+    int j;
+
+    for (j = 0; j < CHILD_CNT; j++)
+      if (pids[j] == pid && !reaped[j])
+        break;
+    if (j == CHILD_CNT)
+      fail("wait_any() returned unexpected pid %d", pid);
+    if (status != 7)
+      fail("child %d exited with %d, expected 7", j, status);
+    reaped[j] = true;
+  }
+  msg("reaped all children");
+
+  CHECK(wait(pids[0]) == -1, "wait for reaped child fails");
+  CHECK(wait_any(NULL) == -1, "wait_any with no children fails");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(wait-any) begin
+wait-any: exit(7)
+wait-any: exit(7)
+wait-any: exit(7)
+wait-any: exit(7)
+wait-any: exit(7)
+(wait-any) reaped all children
+(wait-any) wait for reaped child fails
+(wait-any) wait_any with no children fails
+(wait-any) end
+wait-any: exit(0)
+EOF
+pass;
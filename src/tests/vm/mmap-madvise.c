@@ -0,0 +1,55 @@
+/* Maps a file of several pages, gives each kind of advice about
+   the mapping, and checks that reads through it still see the
+   file's data.  Also checks that bad advice is rejected. */
+
+#include <mman.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 12
+#define ACTUAL ((char*)0x10000000)
+
+static char buf[4096];
+
+/* Checks that page PAGE of the mapping holds its pattern. */
+static void check_page(int page) {
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    if (ACTUAL[page * 4096 + i] != (char)(page + i))
+      fail("byte %zu of page %d has value %02hhx", i, page, ACTUAL[page * 4096 + i]);
+}
+
+void test_main(void) {
+  int handle;
+  mapid_t map;
+  int page;
+  size_t i;
+
+  CHECK(create("pages", PAGE_CNT * 4096), "create \"pages\"");
+  CHECK((handle = open("pages")) > 1, "open \"pages\"");
+  for (page = 0; page < PAGE_CNT; page++) {
+    for (i = 0; i < sizeof buf; i++)
+      buf[i] = page + i;
+    if (write(handle, buf, sizeof buf) != sizeof buf)
+      fail("write page %d of \"pages\"", page);
+  }
+  CHECK((map = mmap(handle, ACTUAL)) != MAP_FAILED, "mmap \"pages\"");
+
+  CHECK(!madvise(ACTUAL + 1, 4096, MADV_NORMAL), "madvise unaligned address");
+  CHECK(!madvise(ACTUAL, (PAGE_CNT + 1) * 4096, MADV_NORMAL), "madvise past mapping");
+  CHECK(!madvise(ACTUAL, 4096, 42), "madvise bad advice");
+
+  CHECK(madvise(ACTUAL, 4 * 4096, MADV_RANDOM), "madvise pages 0-3 random");
+  CHECK(madvise(ACTUAL + 4 * 4096, 4 * 4096, MADV_SEQUENTIAL), "madvise pages 4-7 sequential");
+  CHECK(madvise(ACTUAL + 8 * 4096, 4 * 4096 - 1, MADV_WILLNEED), "madvise pages 8-11 willneed");
+
+  msg("read pages backward");
+  for (page = PAGE_CNT - 1; page >= 0; page--)
+    check_page(page);
+
+  munmap(map);
+  close(handle);
+}
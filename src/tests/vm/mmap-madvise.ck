@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-madvise) begin
+(mmap-madvise) create "pages"
+(mmap-madvise) open "pages"
+(mmap-madvise) mmap "pages"
+(mmap-madvise) madvise unaligned address
+(mmap-madvise) madvise past mapping
+(mmap-madvise) madvise bad advice
+(mmap-madvise) madvise pages 0-3 random
+(mmap-madvise) madvise pages 4-7 sequential
+(mmap-madvise) madvise pages 8-11 willneed
+(mmap-madvise) read pages backward
+(mmap-madvise) end
+EOF
+pass;
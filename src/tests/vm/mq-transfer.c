@@ -0,0 +1,57 @@
+/* Passes messages from a process's forked child to the process
+   through a message queue: page-aligned pages, which are handed
+   over rather than copied and so leave zeros behind in the
+   child, and a short message, which is copied.  The messages
+   outlive the child, which exits before the process receives
+   them. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 4096)
+
+static char buf[SIZE] __attribute__((aligned(4096)));
+
+/* Returns true if the SIZE bytes of BUF all equal C + their
+   offset, modulo 256. */
+static bool check_pattern(const char* p, char c) {
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (p[i] != (char)(c + i))
+      return false;
+  return true;
+}
+
+void test_main(void) {
+  char small[16];
+  mqid_t id;
+  pid_t pid;
+  size_t i;
+
+  CHECK((id = mq_create()) != MQ_FAILED, "mq_create");
+  CHECK(mq_send(id + 1, "x", 1) == -1, "mq_send to bad queue");
+
+  pid = fork();
+  if (pid < 0)
+    fail("fork returned %d", pid);
+  else if (pid == 0) {
+    for (i = 0; i < SIZE; i++)
+      buf[i] = 'a' + i;
+    CHECK(mq_send(id, buf, SIZE) == 0, "mq_send pages");
+    for (i = 0; i < SIZE; i++)
+      if (buf[i] != 0)
+        fail("sent buffer not zeroed at offset %zu", i);
+    CHECK(mq_send(id, "hello", 6) == 0, "mq_send short");
+  } else {
+    wait(pid);
+    CHECK(mq_receive(id, small, sizeof small) == -1, "mq_receive too small");
+    CHECK(mq_receive(id, buf, SIZE) == SIZE, "mq_receive pages");
+    if (!check_pattern(buf, 'a'))
+      fail("pages received incorrectly");
+    CHECK(mq_receive(id, small, sizeof small) == 6, "mq_receive short");
+    msg("received \"%s\"", small);
+  }
+}
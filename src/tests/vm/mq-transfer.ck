@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mq-transfer) begin
+(mq-transfer) mq_create
+(mq-transfer) mq_send to bad queue
+(mq-transfer) mq_send pages
+(mq-transfer) mq_send short
+(mq-transfer) end
+mq-transfer: exit(0)
+(mq-transfer) mq_receive too small
+(mq-transfer) mq_receive pages
+(mq-transfer) mq_receive short
+(mq-transfer) received "hello"
+(mq-transfer) end
+mq-transfer: exit(0)
+EOF
+pass;
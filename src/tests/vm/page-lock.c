@@ -0,0 +1,46 @@
+/* Locks a few pages with mlock(), then writes more memory than
+   the user pool holds, so that other pages must be evicted, and
+   checks that the locked pages and the rest kept their data.
+   Also checks that bad arguments to mlock() and
+   set_evict_priority() are rejected. */
+
+#include <mman.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define LOCKED_PAGES 8
+#define SIZE (2 * 1024 * 1024)
+
+static char locked[LOCKED_PAGES * PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static char buf[SIZE];
+
+void test_main(void) {
+  size_t i;
+
+  CHECK(!mlock(locked + 1, PAGE_SIZE), "mlock unaligned address");
+  CHECK(!mlock((void*)0x10000000, PAGE_SIZE), "mlock unmapped address");
+  CHECK(!set_evict_priority(42), "set_evict_priority bad priority");
+  CHECK(set_evict_priority(EVICT_PRI_HIGH), "set_evict_priority high");
+  CHECK(mlock(locked, sizeof locked), "mlock %d pages", LOCKED_PAGES);
+  for (i = 0; i < sizeof locked; i++)
+    locked[i] = i % 251;
+
+  msg("write %d MB", SIZE / 1024 / 1024);
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 253;
+
+  msg("check locked pages");
+  for (i = 0; i < sizeof locked; i++)
+    if (locked[i] != (char)(i % 251))
+      fail("byte %zu of locked pages has value %02hhx", i, locked[i]);
+
+  CHECK(munlock(locked, sizeof locked), "munlock %d pages", LOCKED_PAGES);
+  CHECK(set_evict_priority(EVICT_PRI_NORMAL), "set_evict_priority normal");
+
+  msg("check %d MB", SIZE / 1024 / 1024);
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char)(i % 253))
+      fail("byte %zu has value %02hhx", i, buf[i]);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-lock) begin
+(page-lock) mlock unaligned address
+(page-lock) mlock unmapped address
+(page-lock) set_evict_priority bad priority
+(page-lock) set_evict_priority high
+(page-lock) mlock 8 pages
+(page-lock) write 2 MB
+(page-lock) check locked pages
+(page-lock) munlock 8 pages
+(page-lock) set_evict_priority normal
+(page-lock) check 2 MB
+(page-lock) end
+EOF
+pass;
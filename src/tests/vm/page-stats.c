@@ -0,0 +1,65 @@
+/* Checks that getrusage() counts page faults by kind: writes to
+   fresh bss pages are minor faults, touching a large stack
+   object grows the stack, and a forked child's write to a page
+   it shares with its parent copies it. */
+
+#include <stats.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 64
+
+static char bss[PAGE_CNT * PAGE_SIZE];
+static char data[PAGE_SIZE] = "shared until written";
+
+/* Touches a stack object of several pages and returns a byte of
+   it, so that it is not optimized away. */
+static char __attribute__((noinline)) touch_stack(void) {
+  volatile char big[16 * PAGE_SIZE];
+  size_t i;
+
+  for (i = 0; i < sizeof big; i += PAGE_SIZE)
+    big[i] = i / PAGE_SIZE;
+  return big[PAGE_SIZE];
+}
+
+void test_main(void) {
+  struct rusage before, after;
+  pid_t pid;
+  size_t i;
+
+  CHECK(getrusage(&before), "getrusage");
+  for (i = 0; i < PAGE_CNT; i++)
+    bss[i * PAGE_SIZE] = 1;
+  CHECK(getrusage(&after), "getrusage");
+  if (after.minor_faults - before.minor_faults < PAGE_CNT)
+    fail("%u minor faults for %d new pages", after.minor_faults - before.minor_faults, PAGE_CNT);
+  if (after.page_faults - before.page_faults < after.minor_faults - before.minor_faults)
+    fail("more minor faults than page faults");
+  msg("bss writes are minor faults");
+
+  before = after;
+  touch_stack();
+  CHECK(getrusage(&after), "getrusage");
+  if (after.stack_faults == before.stack_faults)
+    fail("no stack growth faults for a 64 kB stack object");
+  msg("stack growth counted");
+
+  /* Bring the data page in before fork() shares it. */
+  data[1] = 'H';
+  pid = fork();
+  if (pid < 0)
+    fail("fork returned %d", pid);
+  else if (pid == 0) {
+    getrusage(&before);
+    data[0] = 'S';
+    getrusage(&after);
+    if (after.cow_faults == before.cow_faults)
+      fail("child's write to a shared page did not copy it");
+    msg("child's write counted as copy-on-write");
+  } else
+    wait(pid);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(page-stats) begin
+(page-stats) getrusage
+(page-stats) getrusage
+(page-stats) bss writes are minor faults
+(page-stats) getrusage
+(page-stats) stack growth counted
+(page-stats) child's write counted as copy-on-write
+(page-stats) end
+page-stats: exit(0)
+(page-stats) end
+page-stats: exit(0)
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Reads all of a 6 MB bss array, which must be zeros, then
+   writes to one byte in every 16 pages and checks that only those
+   pages changed.  More bss than the user pool holds can only be
+   read without swapping if untouched pages share one frame. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (6 * 1024 * 1024)
+#define STRIDE (16 * PAGE_SIZE)
+
+static char buf[SIZE];
+
+void test_main(void) {
+  size_t i;
+
+  msg("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0)
+      fail("byte %zu != 0", i);
+
+  msg("sparse write pass");
+  for (i = 0; i < SIZE; i += STRIDE)
+    buf[i + i / STRIDE] = 'z';
+
+  msg("check pass");
+  for (i = 0; i < SIZE; i++) {
+    char expected = i % STRIDE == i / STRIDE ? 'z' : 0;
+    if (buf[i] != expected)
+      fail("byte %zu is %d, expected %d", i, buf[i], expected);
+  }
+}
@@ -0,0 +1,40 @@
+/* Shares a region of memory between a process and its forked
+   child, which also attaches it a second time, and checks that
+   writes through any of the mappings show up in all of them. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ADDR ((char*)0x10000000)
+#define ALIAS ((char*)0x20000000)
+#define SIZE (2 * 4096)
+
+void test_main(void) {
+  shmid_t id;
+  pid_t pid;
+
+  CHECK((id = shm_create(SIZE)) != SHM_FAILED, "shm_create");
+  CHECK(shm_attach(id, ADDR + 1) == NULL, "shm_attach unaligned");
+  CHECK(shm_attach(id, ADDR) == ADDR, "shm_attach");
+  CHECK(shm_attach(id, ADDR + 4096) == NULL, "shm_attach overlapping");
+  strlcpy(ADDR, "from parent", 4096);
+
+  pid = fork();
+  if (pid < 0)
+    fail("fork returned %d", pid);
+  else if (pid == 0) {
+    msg("child sees \"%s\"", ADDR);
+    CHECK(shm_attach(id, ALIAS) == ALIAS, "shm_attach again");
+    strlcpy(ALIAS + 4096, "from child", 4096);
+    msg("child sees \"%s\" through first mapping", ADDR + 4096);
+    CHECK(shm_detach(ALIAS), "shm_detach");
+    CHECK(!shm_detach(ALIAS), "shm_detach again");
+  } else {
+    wait(pid);
+    msg("parent sees \"%s\"", ADDR + 4096);
+    CHECK(!shm_detach(ADDR + 4096), "shm_detach middle");
+    CHECK(shm_detach(ADDR), "shm_detach");
+  }
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-fork) begin
+(shm-fork) shm_create
+(shm-fork) shm_attach unaligned
+(shm-fork) shm_attach
+(shm-fork) shm_attach overlapping
+(shm-fork) child sees "from parent"
+(shm-fork) shm_attach again
+(shm-fork) child sees "from child" through first mapping
+(shm-fork) shm_detach
+(shm-fork) shm_detach again
+(shm-fork) end
+shm-fork: exit(0)
+(shm-fork) parent sees "from child"
+(shm-fork) shm_detach middle
+(shm-fork) shm_detach
+(shm-fork) end
+shm-fork: exit(0)
+EOF
+pass;
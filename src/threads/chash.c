@@ -0,0 +1,349 @@
+#include "threads/chash.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/rcu.h"
+
+/* Concurrent hash map.
+
+   lib/kernel/hash.c leaves locking to its caller, which for a
+   table shared by every thread means one lock around every
+   lookup.  This map is built for tables such as caches that many
+   threads search at once.
+
+   The map is an array of buckets, each a singly linked chain of
+   elements.  Bucket I belongs to lock stripe I % CHASH_STRIPES,
+   whose spinlock is held to add or remove elements in it, so
+   writers to different stripes proceed in parallel.  The number
+   of buckets is always a multiple of CHASH_STRIPES, so an element
+   stays in the same stripe however many buckets there are.
+
+   Lookups take no lock.  They run in an RCU read-side section,
+   following chains that writers change only with
+   rcu_assign_pointer(), so that a reader sees each element either
+   before or after a change and never a freed one.  An element
+   removed with chash_delete() may therefore still be seen by
+   readers until a grace period has passed, and must be freed with
+   call_rcu() unless no reader can have found it.
+
+   When the map holds more than CHASH_MAX_LOAD elements per
+   bucket, it allocates a bucket array twice as large and starts
+   moving elements to it, a few old buckets at a time, on each
+   later insertion and deletion, so that no one of them pays for
+   the whole move.  Until then, buckets below MOVE_IDX are looked
+   up in the new array and the rest in the old one.  Moving an
+   element from one chain to another could make a reader walking
+   the chain miss the rest of it, so a move happens with the
+   stripe's SEQ odd, and a reader that sees SEQ change under it
+   looks again, or, after CHASH_READ_RETRIES tries, takes the
+   stripe's lock.  The map never shrinks.
+
+   The map may be searched from interrupt context, but not
+   changed there, since growing it allocates memory. */
+
+/* Elements per bucket above which the map grows. */
+#define CHASH_MAX_LOAD 2
+
+/* Old buckets moved by each insertion or deletion while the map
+   grows. */
+#define CHASH_MOVE_BATCH 4
+
+/* Lock-free lookups tried before a reader takes the stripe's
+   lock. */
+#define CHASH_READ_RETRIES 4
+
+/* An array of buckets. */
+struct chash_table {
+  struct rcu_head rcu;          /* Frees the array once readers are done. */
+  size_t bucket_cnt;            /* Number of buckets, a multiple of CHASH_STRIPES. */
+  struct chash_elem* buckets[]; /* Chains of elements. */
+};
+
+static rcu_func free_table;
+
+/* Returns a bucket array with BUCKET_CNT empty buckets, or a
+   null pointer if memory is not available. */
+static struct chash_table* alloc_table(size_t bucket_cnt) {
+  struct chash_table* t = calloc(1, sizeof *t + bucket_cnt * sizeof *t->buckets);
+
+  if (t != NULL)
+    t->bucket_cnt = bucket_cnt;
+  return t;
+}
+
+/* Frees the bucket array that HEAD is embedded in. */
+static void free_table(struct rcu_head* head) { free(chash_entry(head, struct chash_table, rcu)); }
+
+/* Initializes H as an empty concurrent hash map, using HASH and
+   EQUAL with auxiliary data AUX to hash and compare elements, and
+   naming its locks NAME for statistics.  Returns false if memory
+   is not available. */
+bool chash_init(struct chash* h, const char* name, chash_hash_func* hash, chash_equal_func* equal,
+                void* aux) {
+  size_t i;
+
+  h->table = alloc_table(CHASH_STRIPES);
+  if (h->table == NULL)
+    return false;
+  h->old = NULL;
+  h->move_idx = 0;
+  h->elem_cnt = 0;
+  lock_init(&h->resize_lock);
+  for (i = 0; i < CHASH_STRIPES; i++) {
+    spin_init(&h->stripes[i].lock, name);
+    h->stripes[i].seq = 0;
+  }
+  h->hash = hash;
+  h->equal = equal;
+  h->aux = aux;
+  return true;
+}
+
+/* Calls ACTION, if nonnull, on each element of H and frees H's
+   buckets.  No other thread may be using H. */
+void chash_destroy(struct chash* h, chash_action_func* action) {
+  struct chash_table* tables[2] = {h->table, h->old};
+  size_t i, j;
+
+  for (i = 0; i < 2; i++) {
+    if (tables[i] == NULL)
+      continue;
+    for (j = 0; j < tables[i]->bucket_cnt; j++) {
+      struct chash_elem* e = tables[i]->buckets[j];
+      while (e != NULL) {
+        struct chash_elem* next = e->next;
+        if (action != NULL)
+          action(e, h->aux);
+        e = next;
+      }
+    }
+    free(tables[i]);
+  }
+}
+
+/* Returns the stripe for elements with hash value HASH. */
+static struct chash_stripe* stripe_for(struct chash* h, unsigned hash) {
+  return &h->stripes[hash & (CHASH_STRIPES - 1)];
+}
+
+/* Returns the head of the chain that elements with hash value
+   HASH are in.  The caller must hold the stripe's lock, or be a
+   reader that checks the stripe's sequence number. */
+static struct chash_elem** find_bucket(struct chash* h, unsigned hash) {
+  struct chash_table* old = rcu_dereference(h->old);
+  struct chash_table* t;
+
+  if (old != NULL) {
+    size_t i = hash & (old->bucket_cnt - 1);
+    if (i >= __atomic_load_n(&h->move_idx, __ATOMIC_ACQUIRE))
+      return &old->buckets[i];
+  }
+  t = rcu_dereference(h->table);
+  return &t->buckets[hash & (t->bucket_cnt - 1)];
+}
+
+/* Returns the link that points to the element of H equal to KEY,
+   whose hash value is HASH, or to the null pointer at the end of
+   its chain if there is none. */
+static struct chash_elem** find_link(struct chash* h, const struct chash_elem* key,
+                                     unsigned hash) {
+  struct chash_elem** link = find_bucket(h, hash);
+  struct chash_elem* e;
+
+  for (; (e = rcu_dereference(*link)) != NULL; link = &e->next)
+    if (e->hash == hash && h->equal(e, key, h->aux))
+      break;
+  return link;
+}
+
+/* Disables interrupts and acquires every stripe of H, in order,
+   and marks them as moving elements.  Returns the previous
+   interrupt level. */
+static enum intr_level lock_all_stripes(struct chash* h) {
+  enum intr_level old_level = intr_disable();
+  size_t i;
+
+  for (i = 0; i < CHASH_STRIPES; i++) {
+    spin_lock(&h->stripes[i].lock);
+    __atomic_store_n(&h->stripes[i].seq, h->stripes[i].seq + 1, __ATOMIC_RELAXED);
+  }
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  return old_level;
+}
+
+/* Releases every stripe of H, locked by lock_all_stripes(), and
+   sets the interrupt level to OLD_LEVEL. */
+static void unlock_all_stripes(struct chash* h, enum intr_level old_level) {
+  size_t i;
+
+  for (i = CHASH_STRIPES; i-- > 0;) {
+    __atomic_store_n(&h->stripes[i].seq, h->stripes[i].seq + 1, __ATOMIC_RELEASE);
+    spin_unlock(&h->stripes[i].lock);
+  }
+  intr_set_level(old_level);
+}
+
+/* Starts growing H, if it is overloaded and not already
+   growing. */
+static void maybe_grow(struct chash* h) {
+  size_t bucket_cnt = h->table->bucket_cnt;
+  struct chash_table* t;
+  enum intr_level old_level;
+
+  if (h->old != NULL || chash_size(h) <= bucket_cnt * CHASH_MAX_LOAD)
+    return;
+
+  /* The allocation may sleep, so happens before taking locks.
+     Another thread may have started growing H meanwhile. */
+  t = alloc_table(bucket_cnt * 2);
+  if (t == NULL)
+    return;
+  old_level = lock_all_stripes(h);
+  if (h->old == NULL && h->table->bucket_cnt == bucket_cnt) {
+    h->old = h->table;
+    h->move_idx = 0;
+    rcu_assign_pointer(h->table, t);
+    t = NULL;
+  }
+  unlock_all_stripes(h, old_level);
+  free(t);
+}
+
+/* Moves the elements of old bucket IDX of H, which the caller is
+   the one to move, to the new buckets. */
+static void move_bucket(struct chash* h, size_t idx) {
+  struct chash_table* old = h->old;
+  struct chash_table* t = h->table;
+  struct chash_stripe* s = stripe_for(h, idx);
+  struct chash_elem* e;
+  enum intr_level old_level;
+
+  old_level = spin_lock_irqsave(&s->lock);
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  while ((e = old->buckets[idx]) != NULL) {
+    struct chash_elem** head = &t->buckets[e->hash & (t->bucket_cnt - 1)];
+    rcu_assign_pointer(old->buckets[idx], e->next);
+    e->next = *head;
+    rcu_assign_pointer(*head, e);
+  }
+  __atomic_store_n(&h->move_idx, idx + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+  spin_unlock_irqrestore(&s->lock, old_level);
+}
+
+/* If H is growing and no other thread is moving its buckets,
+   moves up to CHASH_MOVE_BATCH more of them, and retires the old
+   bucket array once they are all moved. */
+static void move_some_buckets(struct chash* h) {
+  struct chash_table* old;
+  enum intr_level old_level;
+  size_t i;
+
+  if (h->old == NULL || !lock_try_acquire(&h->resize_lock))
+    return;
+
+  old = h->old;
+  if (old != NULL) {
+    for (i = 0; i < CHASH_MOVE_BATCH && h->move_idx < old->bucket_cnt; i++)
+      move_bucket(h, h->move_idx);
+    if (h->move_idx == old->bucket_cnt) {
+      old_level = lock_all_stripes(h);
+      h->old = NULL;
+      unlock_all_stripes(h, old_level);
+      call_rcu(&old->rcu, free_table);
+    }
+  }
+  lock_release(&h->resize_lock);
+}
+
+/* Inserts NEW into H, if no equal element is already there, and
+   returns a null pointer.  If an equal element is already in H,
+   returns it without inserting NEW.  Must not be called from
+   interrupt context. */
+struct chash_elem* chash_insert(struct chash* h, struct chash_elem* new) {
+  unsigned hash = h->hash(new, h->aux);
+  struct chash_stripe* s = stripe_for(h, hash);
+  struct chash_elem** link;
+  struct chash_elem* old;
+  enum intr_level old_level;
+
+  ASSERT(!intr_context());
+
+  new->hash = hash;
+  old_level = spin_lock_irqsave(&s->lock);
+  link = find_link(h, new, hash);
+  old = *link;
+  if (old == NULL) {
+    struct chash_elem** head = find_bucket(h, hash);
+    new->next = *head;
+    rcu_assign_pointer(*head, new);
+    __atomic_add_fetch(&h->elem_cnt, 1, __ATOMIC_RELAXED);
+  }
+  spin_unlock_irqrestore(&s->lock, old_level);
+
+  if (old == NULL)
+    maybe_grow(h);
+  move_some_buckets(h);
+  return old;
+}
+
+/* Finds and returns an element of H equal to KEY, or a null
+   pointer if none exists.  The caller must be in an RCU
+   read-side section, and may use the element only until that
+   section ends, unless it takes a reference of its own. */
+struct chash_elem* chash_find(struct chash* h, const struct chash_elem* key) {
+  unsigned hash = h->hash(key, h->aux);
+  struct chash_stripe* s = stripe_for(h, hash);
+  struct chash_elem* e;
+  enum intr_level old_level;
+  int try;
+
+  ASSERT(rcu_read_held());
+
+  for (try = 0; try < CHASH_READ_RETRIES; try++) {
+    unsigned seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue;
+    e = rcu_dereference(*find_link(h, key, hash));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq)
+      return e;
+  }
+
+  /* Elements keep moving under us.  Wait for the writer. */
+  old_level = spin_lock_irqsave(&s->lock);
+  e = *find_link(h, key, hash);
+  spin_unlock_irqrestore(&s->lock, old_level);
+  return e;
+}
+
+/* Removes the element of H equal to KEY and returns it, or
+   returns a null pointer if there is none.  Readers may still
+   see the element until a grace period has passed.  Must not be
+   called from interrupt context. */
+struct chash_elem* chash_delete(struct chash* h, const struct chash_elem* key) {
+  unsigned hash = h->hash(key, h->aux);
+  struct chash_stripe* s = stripe_for(h, hash);
+  struct chash_elem** link;
+  struct chash_elem* e;
+  enum intr_level old_level;
+
+  ASSERT(!intr_context());
+
+  old_level = spin_lock_irqsave(&s->lock);
+  link = find_link(h, key, hash);
+  e = *link;
+  if (e != NULL) {
+    rcu_assign_pointer(*link, e->next);
+    __atomic_sub_fetch(&h->elem_cnt, 1, __ATOMIC_RELAXED);
+  }
+  spin_unlock_irqrestore(&s->lock, old_level);
+
+  move_some_buckets(h);
+  return e;
+}
+
+/* Returns the number of elements in H, which may be out of date
+   by the time the caller looks at it. */
+size_t chash_size(const struct chash* h) { return __atomic_load_n(&h->elem_cnt, __ATOMIC_RELAXED); }
@@ -0,0 +1,66 @@
+#ifndef THREADS_CHASH_H
+#define THREADS_CHASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/spinlock.h"
+#include "threads/synch.h"
+
+/* Element of a concurrent hash map, embedded in the structure
+   that is in the map, like struct hash_elem. */
+struct chash_elem {
+  struct chash_elem* next; /* Next element in the bucket. */
+  unsigned hash;           /* Hash value, computed on insertion. */
+};
+
+/* Converts pointer to map element CHASH_ELEM into a pointer to
+   the structure that CHASH_ELEM is embedded inside, given the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the map element. */
+#define chash_entry(CHASH_ELEM, STRUCT, MEMBER)                                                    \
+  ((STRUCT*)((uint8_t*)(CHASH_ELEM) - offsetof(STRUCT, MEMBER)))
+
+/* Computes and returns the hash value for map element E, given
+   auxiliary data AUX. */
+typedef unsigned chash_hash_func(const struct chash_elem* e, void* aux);
+
+/* Returns true if map elements A and B have equal keys, given
+   auxiliary data AUX. */
+typedef bool chash_equal_func(const struct chash_elem* a, const struct chash_elem* b, void* aux);
+
+/* Performs some operation on map element E, given auxiliary
+   data AUX. */
+typedef void chash_action_func(struct chash_elem* e, void* aux);
+
+/* Number of lock stripes in a map, a power of 2. */
+#define CHASH_STRIPES 16
+
+/* A lock stripe, which protects every bucket whose index is
+   congruent to its own modulo CHASH_STRIPES. */
+struct chash_stripe {
+  struct spinlock lock; /* Held to change the stripe's buckets. */
+  unsigned seq;         /* Odd while elements move between buckets. */
+};
+
+/* Concurrent hash map. */
+struct chash {
+  struct chash_table* table;                  /* Buckets, published with RCU. */
+  struct chash_table* old;                    /* Buckets being moved from, or null. */
+  size_t move_idx;                            /* Old buckets below this have been moved. */
+  size_t elem_cnt;                            /* Number of elements, updated atomically. */
+  struct lock resize_lock;                    /* Held to move old buckets. */
+  struct chash_stripe stripes[CHASH_STRIPES]; /* Locks for the buckets. */
+  chash_hash_func* hash;                      /* Hash function. */
+  chash_equal_func* equal;                    /* Comparison function. */
+  void* aux;                                  /* Auxiliary data for `hash' and `equal'. */
+};
+
+bool chash_init(struct chash*, const char* name, chash_hash_func*, chash_equal_func*, void* aux);
+void chash_destroy(struct chash*, chash_action_func*);
+struct chash_elem* chash_insert(struct chash*, struct chash_elem*);
+struct chash_elem* chash_find(struct chash*, const struct chash_elem*);
+struct chash_elem* chash_delete(struct chash*, const struct chash_elem*);
+size_t chash_size(const struct chash*);
+
+#endif /* threads/chash.h */
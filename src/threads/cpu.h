@@ -0,0 +1,28 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdint.h>
+
+/* Identifying the CPU with the CPUID instruction.  See [IA32-v2a]
+   "CPUID". */
+
+/* Feature bits in EDX from CPUID function 1. */
+#define CPUID_PSE (1 << 3)  /* 4 MB pages. */
+#define CPUID_SEP (1 << 11) /* SYSENTER and SYSEXIT. */
+#define CPUID_PGE (1 << 13) /* Global pages. */
+#define CPUID_MMX (1 << 23) /* MMX instructions. */
+
+/* Registers that CPUID returns. */
+struct cpuid_regs {
+  uint32_t eax, ebx, ecx, edx;
+};
+
+/* Runs CPUID function FUNCTION and returns what it reports. */
+static inline struct cpuid_regs cpuid(uint32_t function) {
+  struct cpuid_regs r;
+
+  asm("cpuid" : "=a"(r.eax), "=b"(r.ebx), "=c"(r.ecx), "=d"(r.edx) : "a"(function), "c"(0));
+  return r;
+}
+
+#endif /* threads/cpu.h */
@@ -0,0 +1,230 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#endif
+
+/* Lazy FPU context switching.
+
+   Saving and restoring the x87 state on every thread switch
+   would cost every thread, although most never touch the FPU.
+   Instead, the FPU keeps the state of one thread, FPU_OWNER,
+   across switches.  thread_switch_tail() sets CR0.TS whenever it
+   switches to any other thread, so that thread's first FPU
+   instruction raises #NM (device not available).  The handler
+   saves the owner's registers into the owner's save area, loads
+   the faulting thread's, makes it the owner and clears TS.  A
+   thread that never uses the FPU never traps and never has its
+   state moved; one that uses it alone on a CPU traps only once.
+
+   A thread's save area is allocated at its first FPU instruction,
+   which starts from the state FNINIT sets up.  Save areas are
+   never returned to the allocator, since fpu_release() must work
+   with interrupts off.  A released area goes on FREE_AREAS for
+   the next thread that needs one.
+
+   Kernel code running on behalf of a thread that owns the FPU,
+   such as a system call, would corrupt that thread's registers.
+   It must use the FPU only between fpu_kernel_begin() and
+   fpu_kernel_end().  Kernel threads may use the FPU like user
+   threads.  Interrupt handlers may not use it at all.
+
+   The save area is the 108-byte FSAVE format.  The kernel does
+   not enable CR4.OSFXSR, so SSE registers are not in use. */
+
+/* Control register 0 bits. */
+#define CR0_MP 0x00000002 /* Monitor coprocessor: WAIT honors TS. */
+#define CR0_EM 0x00000004 /* Emulation: every FPU instruction traps. */
+#define CR0_TS 0x00000008 /* Task switched: next FPU instruction traps. */
+#define CR0_NE 0x00000020 /* Numeric error: report errors as #MF. */
+
+/* Size of an FSAVE save area. */
+#define FPU_SIZE 108
+
+/* Thread whose state is in the FPU, or null. */
+static struct thread* fpu_owner;
+
+/* Released save areas, linked through their first word. */
+static void* free_areas;
+
+/* Statistics. */
+static long long trap_cnt;   /* #NM traps taken. */
+static long long spill_cnt;  /* Owner states saved to make room. */
+static long long reload_cnt; /* States loaded from a save area. */
+static long long init_cnt;   /* Threads given a fresh state. */
+
+static intr_handler_func fpu_trap;
+
+static uint32_t read_cr0(void) {
+  uint32_t cr0;
+  asm volatile("movl %%cr0, %0" : "=r"(cr0));
+  return cr0;
+}
+
+static void write_cr0(uint32_t cr0) { asm volatile("movl %0, %%cr0" : : "r"(cr0) : "memory"); }
+
+/* Clears CR0.TS, so FPU instructions run. */
+static void clts(void) { asm volatile("clts" : : : "memory"); }
+
+/* Sets CR0.TS, so the next FPU instruction traps. */
+static void stts(void) { write_cr0(read_cr0() | CR0_TS); }
+
+/* Saves the FPU state into AREA and reinitializes the FPU. */
+static void fnsave(void* area) { asm volatile("fnsave (%0)" : : "r"(area) : "memory"); }
+
+/* Loads the FPU state from AREA. */
+static void frstor(void* area) { asm volatile("frstor (%0)" : : "r"(area) : "memory"); }
+
+/* Enables the FPU, with CR0.TS set so that its first use traps,
+   and installs the #NM handler. */
+void fpu_init(void) {
+  write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+  intr_register_int(7, 0, INTR_ON, fpu_trap, "#NM Device Not Available Exception");
+}
+
+/* Returns a save area, or a null pointer if memory is not
+   available. */
+static void* area_alloc(void) {
+  enum intr_level old_level = intr_disable();
+  void* area = free_areas;
+
+  if (area != NULL)
+    free_areas = *(void**)area;
+  intr_set_level(old_level);
+  return area != NULL ? area : malloc(FPU_SIZE);
+}
+
+/* Makes the FPU trap unless NEXT, which is about to run, owns
+   it.  Called by thread_switch_tail() with interrupts off. */
+void fpu_switch(struct thread* next) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (next == fpu_owner)
+    clts();
+  else
+    stts();
+}
+
+/* #NM handler: gives the FPU to the running thread. */
+static void fpu_trap(struct intr_frame* f UNUSED) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+  bool fresh = cur->fpu_state == NULL;
+
+  if (intr_context())
+    PANIC("FPU used in an interrupt handler");
+
+  if (fresh) {
+    cur->fpu_state = area_alloc();
+    if (cur->fpu_state == NULL) {
+#ifdef USERPROG
+      if (f->cs == SEL_UCSEG) {
+        printf("%s: dying due to lack of memory for FPU state.\n", thread_name());
+        process_exit();
+        NOT_REACHED();
+      }
+#endif
+      PANIC("out of memory for FPU state");
+    }
+  }
+
+  old_level = intr_disable();
+  trap_cnt++;
+  clts();
+  if (fpu_owner != cur) {
+    if (fpu_owner != NULL) {
+      fnsave(fpu_owner->fpu_state);
+      spill_cnt++;
+    }
+    if (fresh) {
+      asm volatile("fninit");
+      init_cnt++;
+    } else {
+      frstor(cur->fpu_state);
+      reload_cnt++;
+    }
+    fpu_owner = cur;
+  }
+  intr_set_level(old_level);
+}
+
+/* Gives the running thread, a new child of PARENT, a copy of
+   PARENT's FPU state.  Returns false if memory is not
+   available. */
+bool fpu_fork(struct thread* parent) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+  void* area;
+
+  if (parent->fpu_state == NULL)
+    return true;
+  area = area_alloc();
+  if (area == NULL)
+    return false;
+
+  old_level = intr_disable();
+  if (fpu_owner == parent) {
+    clts();
+    fnsave(parent->fpu_state);
+    fpu_owner = NULL;
+    stts();
+    spill_cnt++;
+  }
+  memcpy(area, parent->fpu_state, FPU_SIZE);
+  cur->fpu_state = area;
+  intr_set_level(old_level);
+  return true;
+}
+
+/* Forgets T's FPU state and recycles its save area.  T must not
+   run again. */
+void fpu_release(struct thread* t) {
+  enum intr_level old_level = intr_disable();
+
+  if (fpu_owner == t)
+    fpu_owner = NULL;
+  if (t->fpu_state != NULL) {
+    *(void**)t->fpu_state = free_areas;
+    free_areas = t->fpu_state;
+    t->fpu_state = NULL;
+  }
+  intr_set_level(old_level);
+}
+
+/* Lets the kernel use the FPU in the running thread until
+   fpu_kernel_end(), which must be passed the return value.
+   Saves the owner's state, if any, and starts from a fresh FPU.
+   Interrupts stay off in between, so the FPU is not switched
+   away. */
+enum intr_level fpu_kernel_begin(void) {
+  enum intr_level old_level = intr_disable();
+
+  clts();
+  if (fpu_owner != NULL) {
+    fnsave(fpu_owner->fpu_state);
+    fpu_owner = NULL;
+    spill_cnt++;
+  }
+  asm volatile("fninit");
+  return old_level;
+}
+
+/* Ends a section begun by fpu_kernel_begin(), given its return
+   value OLD_LEVEL.  The owner's state is reloaded at its next
+   FPU instruction. */
+void fpu_kernel_end(enum intr_level old_level) {
+  stts();
+  intr_set_level(old_level);
+}
+
+/* Prints FPU switching statistics. */
+void fpu_print_stats(void) {
+  printf("FPU: %lld traps, %lld spills, %lld reloads, %lld fresh states\n", trap_cnt, spill_cnt,
+         reload_cnt, init_cnt);
+}
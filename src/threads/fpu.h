@@ -0,0 +1,17 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+#include "threads/interrupt.h"
+
+struct thread;
+
+void fpu_init(void);
+void fpu_switch(struct thread* next);
+bool fpu_fork(struct thread* parent);
+void fpu_release(struct thread*);
+enum intr_level fpu_kernel_begin(void);
+void fpu_kernel_end(enum intr_level);
+void fpu_print_stats(void);
+
+#endif /* threads/fpu.h */
@@ -16,13 +16,23 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "tests/bench/kernel/tests.h"
+#include "threads/cpu.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
+#include "threads/tunable.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -37,17 +47,36 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/initramfs.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/mq.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
 uint32_t* init_page_dir;
 
+/* True if the CPU supports 4 MB pages and they are enabled. */
+bool init_large_pages;
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -fsblock: Allocation block size in bytes for a file system
+   being formatted. */
+static unsigned fs_block_size = BLOCK_SECTOR_SIZE;
+
+/* -fslog: Format the file system in log mode? */
+static bool fs_log;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char* filesys_bdev_name;
@@ -55,11 +84,68 @@ static const char* scratch_bdev_name;
 #ifdef VM
 static const char* swap_bdev_name;
 #endif
+
+/* -iosched: I/O schedulers to use, in the order given.  A null
+   BDEV_NAME stands for every block device. */
+#define IOSCHED_MAX 8
+static struct {
+  const char* bdev_name;
+  enum block_sched sched;
+} io_scheds[IOSCHED_MAX];
+static size_t io_sched_cnt;
+
+/* -ramdisk: RAM disks to create, before any other block device,
+   so that they come first in probe order. */
+#define RAMDISK_MAX 2
+static struct {
+  enum block_type type;
+  block_sector_t size;
+} ramdisks[RAMDISK_MAX];
+static size_t ramdisk_cnt;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef USERPROG
+/* -parallel: Number of "run" tasks to keep running at once, or 0
+   to run each to completion before the next action. */
+static int parallel_cnt;
+
+/* A "run" task started under -parallel. */
+#define TASK_MAX 32
+static struct task {
+  const char* cmd; /* Command line, from the kernel command line. */
+  char name[16];   /* Program name, which tags the task's output. */
+  pid_t pid;       /* Process, or TID_ERROR if it did not start. */
+  bool done;       /* Exited or did not start? */
+  int status;      /* Exit status, once done. */
+  int64_t start;   /* clock_ns() when started. */
+  int64_t end;     /* clock_ns() when it exited. */
+} tasks[TASK_MAX];
+static size_t task_cnt;  /* Tasks started so far. */
+static int running_cnt;  /* Tasks not done yet. */
+#endif
+
+/* -profile: Sample the running code on each timer tick? */
+static bool profile_enabled;
+
+/* -trace: Record tracepoints? */
+static bool trace_requested;
+
+/* -tsc: TSC rate in cycles per second, or 0 to measure it. */
+static uint64_t tsc_hz;
+
+/* Boot phases, in order, each with the TSC value at which it
+   ended, for print_boot_phases(). */
+#define BOOT_PHASE_MAX 8
+static struct {
+  const char* name;
+  uint64_t end;
+} boot_phases[BOOT_PHASE_MAX];
+static size_t boot_phase_cnt;
+static uint64_t boot_start;
+
 static void bss_init(void);
 static void paging_init(void);
 
@@ -67,10 +153,19 @@ static char** read_command_line(void);
 static char** parse_options(char** argv);
 static void run_actions(char** argv);
 static void usage(void);
+static uint64_t parse_hz(const char* value);
+static enum sched_policy parse_sched_policy(const char* value);
+static void parse_time_slice(char* value);
+static void boot_phase(const char* name);
+static void print_boot_phases(void);
 
 #ifdef FILESYS
 static void locate_block_devices(void);
-static void locate_block_device(enum block_type, const char* name);
+static void locate_block_device(enum block_type, const char* name, struct block* apart);
+static void parse_io_sched(char* value);
+static void parse_ramdisk(char* value);
+static void create_ramdisks(void);
+static void set_io_schedulers(void);
 #endif
 
 /* Pintos main program. */
@@ -79,6 +174,7 @@ int main(void) {
 
   /* Clear BSS. */
   bss_init();
+  boot_start = rdtsc();
 
   /* Break command line into arguments and parse options. */
   argv = read_command_line();
@@ -96,6 +192,7 @@ int main(void) {
   palloc_init(user_page_limit);
   malloc_init();
   paging_init();
+  boot_phase("memory");
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -105,18 +202,27 @@ int main(void) {
 
   /* Initialize interrupt handlers. */
   intr_init();
+  fpu_init();
   timer_init();
+  if (profile_enabled)
+    profile_init();
+  if (trace_requested)
+    trace_init();
   kbd_init();
   input_init();
 #ifdef USERPROG
   exception_init();
   syscall_init();
 #endif
+  boot_phase("interrupts");
 
   /* Start thread scheduler and enable interrupts. */
+  wq_init();
+  rcu_init();
   thread_start();
   serial_init_queue();
-  timer_calibrate();
+  timer_calibrate(tsc_hz);
+  boot_phase("calibrate");
 
 #ifdef USERPROG
   /* Give main thread a minimal PCB so it can launch the first process */
@@ -125,12 +231,28 @@ int main(void) {
 
 #ifdef FILESYS
   /* Initialize file system. */
+  create_ramdisks();
+  virtio_init(); /* Before IDE, so that its disks are preferred. */
   ide_init();
+  set_io_schedulers();
   locate_block_devices();
-  filesys_init(format_filesys);
+  boot_phase("disks");
+  filesys_init(format_filesys, fs_block_size, fs_log);
+  boot_phase("filesys");
+#endif
+
+#ifdef VM
+  /* Initialize virtual memory. */
+  frame_init();
+  swap_init();
+  shm_init();
+  mq_init();
+  boot_phase("vm");
 #endif
 
+  tunable_check_settings();
   printf("Boot complete.\n");
+  print_boot_phases();
 
   /* Run actions specified on kernel command line. */
   run_actions(argv);
@@ -151,14 +273,35 @@ static void bss_init(void) {
   memset(&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
-/* Populates the base page directory and page table with the
+/* CR4 bit that enables 4 MB pages.  See [IA32-v3a] 2.5 "Control
+   Registers". */
+#define CR4_PSE 0x00000010
+#define CR4_PGE 0x00000080
+
+/* Populates the base page directory and page tables with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports it, each 4 MB of RAM is mapped by a single
+   large page, which saves the page tables and a lot of TLB
+   entries.  4 MB regions that include kernel text, which must be
+   read-only, and a partial region at the end of RAM still use
+   page tables.
+
+   If the CPU supports global pages, the kernel mapping is marked
+   global.  Every page directory shares it, so its TLB entries
+   then survive the CR3 loads of process switches.  Nothing
+   changes the kernel mapping after this, so they never need to
+   be flushed. */
 static void paging_init(void) {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t features = cpuid(1).edx;
+  bool pse = (features & CPUID_PSE) != 0;
+  bool pge = (features & CPUID_PGE) != 0;
+  uint32_t global = pge ? PTE_G : 0;
 
   pd = init_page_dir = palloc_get_page(PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -169,12 +312,28 @@ static void paging_init(void) {
     size_t pte_idx = pt_no(vaddr);
     bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+    if (pse && pte_idx == 0 && page + PTSPAN / PGSIZE <= init_ram_pages &&
+        !(&_start < vaddr + PTSPAN && vaddr < &_end_kernel_text)) {
+      pd[pde_idx] = pde_create_kernel_large(vaddr, true) | global;
+      page += PTSPAN / PGSIZE - 1;
+      continue;
+    }
+
     if (pd[pde_idx] == 0) {
       pt = palloc_get_page(PAL_ASSERT | PAL_ZERO);
       pd[pde_idx] = pde_create(pt);
     }
 
-    pt[pte_idx] = pte_create_kernel(vaddr, !in_kernel_text);
+    pt[pte_idx] = pte_create_kernel(vaddr, !in_kernel_text) | global;
+  }
+
+  init_large_pages = pse;
+  if (pse || pge) {
+    uint32_t cr4;
+    asm volatile("movl %%cr4, %0" : "=r"(cr4));
+    asm volatile("movl %0, %%cr4"
+                 :
+                 : "r"(cr4 | (pse ? CR4_PSE : 0) | (pge ? CR4_PGE : 0)));
   }
 
   /* Store the physical address of the page directory into CR3
@@ -236,10 +395,20 @@ static char** parse_options(char** argv) {
 #ifdef FILESYS
     else if (!strcmp(name, "-f"))
       format_filesys = true;
+    else if (!strcmp(name, "-fsblock"))
+      fs_block_size = value != NULL ? atoi(value) : 0;
+    else if (!strcmp(name, "-fslog"))
+      fs_log = true;
     else if (!strcmp(name, "-filesys"))
       filesys_bdev_name = value;
     else if (!strcmp(name, "-scratch"))
       scratch_bdev_name = value;
+    else if (!strcmp(name, "-initramfs"))
+      initramfs_enabled = true;
+    else if (!strcmp(name, "-iosched"))
+      parse_io_sched(value);
+    else if (!strcmp(name, "-ramdisk"))
+      parse_ramdisk(value);
 #ifdef VM
     else if (!strcmp(name, "-swap"))
       swap_bdev_name = value;
@@ -247,21 +416,30 @@ static char** parse_options(char** argv) {
 #endif
     else if (!strcmp(name, "-rs"))
       random_init(atoi(value));
-    else if (!strcmp(name, "-sched")) {
-      if (!strcmp(value, "fifo"))
-        scheduler_flags[SCHED_FIFO] = 1;
-      else if (!strcmp(value, "prio"))
-        scheduler_flags[SCHED_PRIO] = 1;
-      else if (!strcmp(value, "fair"))
-        scheduler_flags[SCHED_FAIR] = 1;
-      else if (!strcmp(value, "mlfqs"))
-        scheduler_flags[SCHED_MLFQS] = 1;
-      else
-        PANIC("unknown scheduler option `%s' (use -h for help)", value);
-    }
+    else if (!strcmp(name, "-profile"))
+      profile_enabled = true;
+    else if (!strcmp(name, "-trace"))
+      trace_requested = true;
+    else if (!strcmp(name, "-lockstat"))
+      lockstat_enabled = true;
+    else if (!strcmp(name, "-tsc"))
+      tsc_hz = parse_hz(value);
+    else if (!strcmp(name, "-sched"))
+      scheduler_flags[parse_sched_policy(value)] = 1;
+    else if (!strcmp(name, "-slice"))
+      parse_time_slice(value);
+    else if (!strcmp(name, "-tune"))
+      tunable_parse(value);
 #ifdef USERPROG
     else if (!strcmp(name, "-ul"))
       user_page_limit = atoi(value);
+    else if (!strcmp(name, "-sysstat"))
+      sysstat_enabled = true;
+    else if (!strcmp(name, "-parallel")) {
+      parallel_cnt = atoi(value);
+      if (parallel_cnt <= 0)
+        PANIC("-parallel requires a positive number of tasks (use -h for help)");
+    }
 #endif
     else
       PANIC("unknown option `%s' (use -h for help)", name);
@@ -277,6 +455,11 @@ static char** parse_options(char** argv) {
   for (int i = 0; i < 8; i++) {
     sched_flags_set += scheduler_flags[i];
   }
+#ifdef SCHED_FIXED
+  /* The kernel was built for one policy and can run no other. */
+  if (sched_flags_set > 1 || (sched_flags_set == 1 && !scheduler_flags[active_sched_policy]))
+    PANIC("this kernel was built for one scheduler: rebuild without SCHED= to use -sched");
+#else
   if (sched_flags_set == 0)
     active_sched_policy = SCHED_DEFAULT;
   else if (sched_flags_set > 1)
@@ -292,6 +475,7 @@ static char** parse_options(char** argv) {
     active_sched_policy = SCHED_MLFQS;
   else
     PANIC("kernel bug in init.c: unreachable case");
+#endif
 
   /* Initialize the random number generator based on the system
      time.  This has no effect if an "-rs" option was specified.
@@ -306,10 +490,93 @@ static char** parse_options(char** argv) {
   return argv;
 }
 
-/* Runs the task specified in ARGV[1]. */
+#ifdef USERPROG
+/* Waits for one of the tasks started under -parallel to exit and
+   records its exit status and when it exited. */
+static void reap_task(void) {
+  for (;;) {
+    pid_t pid;
+    int status = process_wait_any(&pid);
+    int64_t now = clock_ns();
+    size_t i;
+
+    if (pid == TID_ERROR)
+      PANIC("%d task(s) running but no child to wait for", running_cnt);
+    for (i = 0; i < task_cnt; i++)
+      if (tasks[i].pid == pid && !tasks[i].done) {
+        tasks[i].done = true;
+        tasks[i].status = status;
+        tasks[i].end = now;
+        running_cnt--;
+        printf("Execution of '%s' complete.\n", tasks[i].cmd);
+        return;
+      }
+  }
+}
+
+/* Starts the task in CMD alongside the other tasks, first waiting
+   for one of them to exit if -parallel of them are running. */
+static void start_task(const char* cmd) {
+  struct task* t;
+
+  if (task_cnt >= TASK_MAX)
+    PANIC("too many tasks for -parallel (at most %d)", TASK_MAX);
+  while (running_cnt >= parallel_cnt)
+    reap_task();
+
+  t = &tasks[task_cnt++];
+  t->cmd = cmd;
+  strlcpy(t->name, cmd, sizeof t->name);
+  t->name[strcspn(t->name, " ")] = '\0';
+  printf("Executing '%s':\n", cmd);
+  process_set_console_tag(t->name);
+  t->start = clock_ns();
+  t->pid = process_execute(cmd);
+  process_set_console_tag(NULL);
+  t->done = t->pid == TID_ERROR;
+  if (t->done) {
+    t->status = -1;
+    t->end = t->start;
+  } else
+    running_cnt++;
+}
+
+/* Waits for every task started under -parallel to exit. */
+static void finish_tasks(void) {
+  while (running_cnt > 0)
+    reap_task();
+}
+
+/* Prints the exit status and wall time of each task started
+   under -parallel. */
+static void print_task_summary(void) {
+  size_t i;
+
+  if (task_cnt == 0)
+    return;
+  printf("Task summary:\n");
+  for (i = 0; i < task_cnt; i++) {
+    const struct task* t = &tasks[i];
+    if (t->pid == TID_ERROR)
+      printf("  %-15s did not start\n", t->name);
+    else
+      printf("  %-15s exit %4d, %10" PRId64 " us\n", t->name, t->status,
+             (t->end - t->start) / 1000);
+  }
+}
+#endif
+
+/* Runs the task specified in ARGV[1], or with -parallel, starts
+   it running alongside the other tasks. */
 static void run_task(char** argv) {
   const char* task = argv[1];
 
+#ifdef USERPROG
+  if (parallel_cnt > 0) {
+    start_task(task);
+    return;
+  }
+#endif
   printf("Executing '%s':\n", task);
 #ifdef USERPROG
   process_wait(process_execute(task));
@@ -328,6 +595,15 @@ static void run_userprog_kernel_task(char** argv) {
   printf("Execution of '%s' complete.\n", task);
 }
 
+/* Runs the kernel benchmark specified in ARGV[1]. */
+static void run_bench_kernel_task(char** argv) {
+  const char* task = argv[1];
+
+  printf("Executing '%s':\n", task);
+  run_bench_test(task);
+  printf("Execution of '%s' complete.\n", task);
+}
+
 #ifdef THREADS
 /* Runs the threads kernel task specified in ARGV[1]. */
 static void run_threads_kernel_task(char** argv) {
@@ -358,6 +634,7 @@ static void run_actions(char** argv) {
 #ifdef THREADS
       {"rtkt", 2, run_threads_kernel_task},
 #endif
+      {"rbkt", 2, run_bench_kernel_task},
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
@@ -384,10 +661,19 @@ static void run_actions(char** argv) {
       if (argv[i] == NULL)
         PANIC("action `%s' requires %d argument(s)", *argv, a->argc - 1);
 
-    /* Invoke action and advance. */
+    /* Invoke action and advance.  Tasks started under -parallel
+       finish before any other kind of action. */
+#ifdef USERPROG
+    if (a->function != run_task)
+      finish_tasks();
+#endif
     a->function(argv);
     argv += a->argc;
   }
+#ifdef USERPROG
+  finish_tasks();
+  print_task_summary();
+#endif
 }
 
 /* Prints a kernel command line help message and powers off the
@@ -404,6 +690,7 @@ static void usage(void) {
 #ifdef THREADS
          "  rtkt TEST          Run threads kernel test TEST.\n"
 #endif
+         "  rbkt BENCH         Run kernel benchmark BENCH.\n"
 #ifdef FILESYS
          "  ls                 List files in the root directory.\n"
          "  cat FILE           Print FILE to the console.\n"
@@ -418,13 +705,34 @@ static void usage(void) {
          "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
          "  -f                 Format file system device during startup.\n"
+         "  -fsblock=BYTES     Format with BYTES-byte allocation blocks, a power of 2\n"
+         "                     from 512 to 4096 (default 512).\n"
+         "  -fslog             Format so that appends to all files are written\n"
+         "                     sequentially to shared log segments.\n"
          "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
          "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+         "  -initramfs         Make `extract' keep the files in memory, read-only,\n"
+         "                     instead of copying them into the file system.\n"
+         "  -iosched=[BDEV:]SCHED  Use I/O scheduler SCHED (noop, clook or deadline)\n"
+         "                     for BDEV, or for all block devices.\n"
+         "  -ramdisk=ROLE:KB   Add a KB kB RAM disk for ROLE (scratch or swap).\n"
 #ifdef VM
          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif // VM
 #endif // FILESYS
          "  -rs=SEED           Set random number seed to SEED.\n"
+         "  -profile           Sample running code on each timer tick and print the\n"
+         "                     samples on power off, for `backtrace --profile'.\n"
+         "  -trace             Record tracepoints and print them on power off, for\n"
+         "                     utils/pintos-trace.\n"
+         "  -lockstat          Count waits for named locks and print them on power off.\n"
+         "  -tsc=HZ            Take HZ as the TSC rate, as printed by an earlier boot,\n"
+         "                     instead of timing it at startup.\n"
+         "  -slice=SCHED:MIN[:MAX]  Give threads time slices of MIN to MAX timer ticks\n"
+         "                     under scheduler SCHED (default 4:16 for fifo and prio,\n"
+         "                     4 for fair and mlfqs).\n"
+         "  -tune=KEY=VALUE    Set tunable KEY, such as sched.slice_min or\n"
+         "                     cache.flush_interval, to VALUE.\n"
          "  -sched-fair        Use alternate non-strict priority scheduler. Mutually exclusive "
          "with \"-sched-mlfqs\", \"-sched-prio\".\n"
          "  -sched-mlfqs       Use multi-level feedback queue scheduler. Mutually exclusive with "
@@ -433,26 +741,198 @@ static void usage(void) {
          "\"-sched-fair\", \"-sched-mlfqs\".\n"
 #ifdef USERPROG
          "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+         "  -sysstat           Print system call counts and times at process exit\n"
+         "                     and power off.\n"
+         "  -parallel=N        Run up to N 'run' tasks at once, tagging each line of\n"
+         "                     their output, and summarize them at the end.\n"
 #endif // USERPROG
   );
   shutdown_power_off();
 }
 
+/* Parses VALUE, a decimal number that may contain commas, as
+   printed for the TSC rate at startup. */
+static uint64_t parse_hz(const char* value) {
+  uint64_t hz = 0;
+  const char* p;
+
+  if (value == NULL || *value == '\0')
+    PANIC("-tsc requires a rate in cycles per second");
+  for (p = value; *p != '\0'; p++)
+    if (*p >= '0' && *p <= '9')
+      hz = hz * 10 + (*p - '0');
+    else if (*p != ',')
+      PANIC("bad TSC rate `%s' (use -h for help)", value);
+  return hz;
+}
+
+/* Returns the scheduling policy named VALUE. */
+static enum sched_policy parse_sched_policy(const char* value) {
+  if (value == NULL)
+    PANIC("missing scheduler name (use -h for help)");
+  if (!strcmp(value, "fifo"))
+    return SCHED_FIFO;
+  else if (!strcmp(value, "prio"))
+    return SCHED_PRIO;
+  else if (!strcmp(value, "fair"))
+    return SCHED_FAIR;
+  else if (!strcmp(value, "mlfqs"))
+    return SCHED_MLFQS;
+  else
+    PANIC("unknown scheduler option `%s' (use -h for help)", value);
+}
+
+/* Parses VALUE, the value of a -slice option, which is a
+   scheduler name, a colon, a minimum time slice in timer ticks
+   and optionally another colon and a maximum, and sets that
+   scheduler's time slices. */
+static void parse_time_slice(char* value) {
+  char* colon = value != NULL ? strchr(value, ':') : NULL;
+  char* max_colon;
+  int min, max;
+
+  if (colon == NULL)
+    PANIC("-slice requires SCHED:MIN[:MAX] (use -h for help)");
+  *colon = '\0';
+  max_colon = strchr(colon + 1, ':');
+  min = atoi(colon + 1);
+  max = max_colon != NULL ? atoi(max_colon + 1) : min;
+  if (min < 1 || max < min || max > TIMER_FREQ)
+    PANIC("bad time slice `%s' (use -h for help)", colon + 1);
+  thread_set_time_slice(parse_sched_policy(value), min, max);
+}
+
+/* Records that boot phase NAME has just ended. */
+static void boot_phase(const char* name) {
+  ASSERT(boot_phase_cnt < BOOT_PHASE_MAX);
+  boot_phases[boot_phase_cnt].name = name;
+  boot_phases[boot_phase_cnt].end = rdtsc();
+  boot_phase_cnt++;
+}
+
+/* Prints how long each boot phase took.  The TSC is calibrated
+   by then, so the cycle counts recorded before that can be
+   converted too. */
+static void print_boot_phases(void) {
+  uint64_t start = boot_start;
+  size_t i;
+
+  printf("Boot phases:");
+  for (i = 0; i < boot_phase_cnt; i++) {
+    printf(" %s %" PRId64 " us,", boot_phases[i].name,
+           clock_cycles_to_ns(boot_phases[i].end - start) / 1000);
+    start = boot_phases[i].end;
+  }
+  printf(" total %" PRId64 " us.\n", clock_cycles_to_ns(start - boot_start) / 1000);
+}
+
 #ifdef FILESYS
 /* Figure out what block devices to cast in the various Pintos roles. */
 static void locate_block_devices(void) {
-  locate_block_device(BLOCK_FILESYS, filesys_bdev_name);
-  locate_block_device(BLOCK_SCRATCH, scratch_bdev_name);
+  locate_block_device(BLOCK_FILESYS, filesys_bdev_name, NULL);
+  locate_block_device(BLOCK_SCRATCH, scratch_bdev_name, NULL);
 #ifdef VM
-  locate_block_device(BLOCK_SWAP, swap_bdev_name);
+  /* Keep swap traffic off the file system's channel if we can. */
+  locate_block_device(BLOCK_SWAP, swap_bdev_name, block_get_role(BLOCK_FILESYS));
 #endif
 }
 
+/* Parses VALUE, the value of an -iosched option, which is an
+   I/O scheduler name optionally preceded by a block device name
+   and a colon, and records it for set_io_schedulers(). */
+static void parse_io_sched(char* value) {
+  char* colon;
+  const char* sched_name;
+
+  if (value == NULL)
+    PANIC("-iosched requires a scheduler (use -h for help)");
+  if (io_sched_cnt >= IOSCHED_MAX)
+    PANIC("too many -iosched options");
+
+  colon = strchr(value, ':');
+  if (colon != NULL) {
+    *colon = '\0';
+    io_scheds[io_sched_cnt].bdev_name = value;
+    sched_name = colon + 1;
+  } else {
+    io_scheds[io_sched_cnt].bdev_name = NULL;
+    sched_name = value;
+  }
+  if (!block_sched_lookup(sched_name, &io_scheds[io_sched_cnt].sched))
+    PANIC("unknown I/O scheduler `%s' (use -h for help)", sched_name);
+  io_sched_cnt++;
+}
+
+/* Parses VALUE, the value of a -ramdisk option, which is a
+   block device role, "scratch" or "swap", a colon and a size in
+   kB, and records it for create_ramdisks(). */
+static void parse_ramdisk(char* value) {
+  char* colon = value != NULL ? strchr(value, ':') : NULL;
+  int kb;
+
+  if (colon == NULL)
+    PANIC("-ramdisk requires ROLE:KB (use -h for help)");
+  if (ramdisk_cnt >= RAMDISK_MAX)
+    PANIC("too many -ramdisk options");
+
+  *colon = '\0';
+  if (!strcmp(value, block_type_name(BLOCK_SCRATCH)))
+    ramdisks[ramdisk_cnt].type = BLOCK_SCRATCH;
+  else if (!strcmp(value, block_type_name(BLOCK_SWAP)))
+    ramdisks[ramdisk_cnt].type = BLOCK_SWAP;
+  else
+    PANIC("unknown RAM disk role `%s' (use -h for help)", value);
+
+  kb = atoi(colon + 1);
+  if (kb <= 0)
+    PANIC("bad RAM disk size `%s'", colon + 1);
+  ramdisks[ramdisk_cnt].size = kb * (1024 / BLOCK_SECTOR_SIZE);
+  ramdisk_cnt++;
+}
+
+/* Creates the RAM disks asked for by -ramdisk options. */
+static void create_ramdisks(void) {
+  size_t i;
+
+  for (i = 0; i < ramdisk_cnt; i++)
+    ramdisk_create(ramdisks[i].type, ramdisks[i].size);
+}
+
+/* Applies the -iosched options, in the order given, so that a
+   later option overrides an earlier one. */
+static void set_io_schedulers(void) {
+  size_t i;
+
+  for (i = 0; i < io_sched_cnt; i++) {
+    struct block* block;
+
+    if (io_scheds[i].bdev_name == NULL) {
+      for (block = block_first(); block != NULL; block = block_next(block))
+        block_set_sched(block, io_scheds[i].sched);
+      continue;
+    }
+
+    block = block_get_by_name(io_scheds[i].bdev_name);
+    if (block == NULL)
+      PANIC("No such block device \"%s\"", io_scheds[i].bdev_name);
+    block_set_sched(block, io_scheds[i].sched);
+    printf("%s: using %s I/O scheduler\n", block_name(block),
+           block_sched_name(io_scheds[i].sched));
+  }
+}
+
+/* Returns true if blocks A and B are known to be on the same
+   controller channel, so that they cannot be used at once. */
+static bool same_channel(struct block* a, struct block* b) {
+  return a != NULL && b != NULL && block_channel(a) != -1 && block_channel(a) == block_channel(b);
+}
+
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
    otherwise the first block device in probe order of type
-   ROLE. */
-static void locate_block_device(enum block_type role, const char* name) {
+   ROLE, preferring one that is not on the same channel as
+   APART, if APART is non-null. */
+static void locate_block_device(enum block_type role, const char* name, struct block* apart) {
   struct block* block = NULL;
 
   if (name != NULL) {
@@ -460,9 +940,17 @@ static void locate_block_device(enum block_type role, const char* name) {
     if (block == NULL)
       PANIC("No such block device \"%s\"", name);
   } else {
-    for (block = block_first(); block != NULL; block = block_next(block))
-      if (block_type(block) == role)
-        break;
+    struct block* b;
+
+    for (b = block_first(); b != NULL; b = block_next(b))
+      if (block_type(b) == role) {
+        if (block == NULL)
+          block = b;
+        if (!same_channel(b, apart)) {
+          block = b;
+          break;
+        }
+      }
   }
 
   if (block != NULL) {
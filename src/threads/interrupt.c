@@ -6,6 +6,7 @@
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/rcu.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
@@ -46,10 +47,22 @@ static unsigned int unexpected_cnt[INTR_CNT];
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
+   interrupt returns.
+
+   Deferred work runs after the outermost external interrupt's
+   handler, with interrupts on.  An external interrupt that nests
+   inside it only queues more work, which the outer loop picks
+   up, and leaves yielding to the outer interrupt too. */
 static bool in_external_intr; /* Are we processing an external interrupt? */
+static bool in_deferred_work; /* Are we running deferred work? */
 static bool yield_on_return;  /* Should we yield on interrupt return? */
 
+/* Queued `struct intr_work's.  Interrupts must be off to touch
+   it. */
+static struct list deferred_work = LIST_INITIALIZER(deferred_work);
+
+static void run_deferred_work(void);
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init(void);
 static void pic_end_of_interrupt(int irq);
@@ -82,10 +95,12 @@ enum intr_level intr_set_level(enum intr_level level) {
   return level == INTR_ON ? intr_enable() : intr_disable();
 }
 
-/* Enables interrupts and returns the previous interrupt status. */
+/* Enables interrupts and returns the previous interrupt status.
+   Deferred interrupt work may do this, but not an external
+   interrupt handler. */
 enum intr_level intr_enable(void) {
   enum intr_level old_level = intr_get_level();
-  ASSERT(!intr_context());
+  ASSERT(!in_external_intr);
 
   /* Enable interrupts by setting the interrupt flag.
 
@@ -192,9 +207,9 @@ void intr_register_int(uint8_t vec_no, int dpl, enum intr_level level, intr_hand
   register_handler(vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
-bool intr_context(void) { return in_external_intr; }
+/* Returns true during processing of an external interrupt,
+   including its deferred work, and false at all other times. */
+bool intr_context(void) { return in_external_intr || in_deferred_work; }
 
 /* During processing of an external interrupt, directs the
    interrupt handler to yield to a new process just before
@@ -205,6 +220,45 @@ void intr_yield_on_return(void) {
   yield_on_return = true;
 }
 
+/* Initializes W to call FN with AUX when deferred. */
+void intr_work_init(struct intr_work* w, intr_work_func* fn, void* aux) {
+  ASSERT(w != NULL && fn != NULL);
+
+  w->fn = fn;
+  w->aux = aux;
+  w->pending = false;
+}
+
+/* Queues W to run once the current external interrupt's handler
+   returns, unless it is already queued.  Work queued outside an
+   external interrupt runs on the next one.  Interrupts must be
+   off. */
+void intr_defer(struct intr_work* w) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (!w->pending) {
+    w->pending = true;
+    list_push_back(&deferred_work, &w->elem);
+  }
+}
+
+/* Runs queued work, in order, with interrupts on, until none is
+   left.  Called with interrupts off, and returns with them off. */
+static void run_deferred_work(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  in_deferred_work = true;
+  while (!list_empty(&deferred_work)) {
+    struct intr_work* w = list_entry(list_pop_front(&deferred_work), struct intr_work, elem);
+
+    w->pending = false;
+    intr_enable();
+    w->fn(w->aux);
+    intr_disable();
+  }
+  in_deferred_work = false;
+}
+
 /* 8259A Programmable Interrupt Controller. */
 
 /* Initializes the PICs.  Refer to [8259A] for details.
@@ -305,7 +359,7 @@ static inline uint64_t make_idtr_operand(uint16_t limit, void* base) {
 
 /* Returns true if this trap to the OS was from userspace */
 #ifdef USERPROG
-static inline bool is_trap_from_userspace(struct intr_frame* frame) {
+bool is_trap_from_userspace(struct intr_frame* frame) {
   return (frame->cs == SEL_UCSEG) && (frame->ss == SEL_UDSEG);
 }
 #endif
@@ -323,14 +377,17 @@ void intr_handler(struct intr_frame* frame) {
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
-     An external interrupt handler cannot sleep. */
+     An external interrupt handler cannot sleep.  One may
+     interrupt deferred work, in which case the yield decision
+     belongs to the interrupt that the work runs for. */
   external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
   if (external) {
     ASSERT(intr_get_level() == INTR_OFF);
-    ASSERT(!intr_context());
+    ASSERT(!in_external_intr);
 
     in_external_intr = true;
-    yield_on_return = false;
+    if (!in_deferred_work)
+      yield_on_return = false;
   }
 
   /* Invoke the interrupt's handler. */
@@ -352,8 +409,12 @@ void intr_handler(struct intr_frame* frame) {
     in_external_intr = false;
     pic_end_of_interrupt(frame->vec_no);
 
-    if (yield_on_return)
-      thread_yield();
+    if (!in_deferred_work) {
+      if (!list_empty(&deferred_work))
+        run_deferred_work();
+      if (yield_on_return && !rcu_defer_yield())
+        thread_yield();
+    }
   }
 }
 
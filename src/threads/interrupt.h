@@ -1,6 +1,7 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <list.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -61,6 +62,31 @@ void intr_register_int(uint8_t vec, int dpl, enum intr_level, intr_handler_func*
 bool intr_context(void);
 void intr_yield_on_return(void);
 
+/* Deferred interrupt work.
+
+   An external interrupt handler that has more to do than talking
+   to its device can queue that part with intr_defer().  It runs
+   on the way out of the interrupt, after the PIC is acknowledged,
+   with interrupts on, so that other interrupts are not held off
+   while it runs.  Like an interrupt handler, it runs in
+   interrupt context: it must not sleep, but it may call
+   intr_yield_on_return(), which takes effect once all deferred
+   work is done. */
+typedef void intr_work_func(void* aux);
+
+struct intr_work {
+  intr_work_func* fn;    /* Function to call. */
+  void* aux;             /* Argument to FN. */
+  bool pending;          /* Queued and not yet run? */
+  struct list_elem elem; /* Element in the deferred work list. */
+};
+
+void intr_work_init(struct intr_work*, intr_work_func*, void* aux);
+void intr_defer(struct intr_work*);
+#ifdef USERPROG
+bool is_trap_from_userspace(struct intr_frame*);
+#endif
+
 void intr_dump_frame(const struct intr_frame*);
 const char* intr_name(uint8_t vec);
 
@@ -5,17 +5,19 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
+   The size of each request, in bytes, is rounded up to the next
+   size class and assigned to the "descriptor" that manages blocks
+   of that size.  Size classes start at 16 bytes and grow by about
+   a quarter each, in multiples of 8 bytes, so that a request
+   wastes less of its block than it would with powers of 2.  The
+   descriptor keeps a list of free blocks.  If the free list is
+   nonempty, one of its blocks is used to satisfy the request.
 
    Otherwise, a new page of memory, called an "arena", is
    obtained from the page allocator (if none is available,
@@ -31,15 +33,31 @@
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   with the page allocator, without any header: such a "big
+   block" is the only kind that starts on a page boundary, and
+   the page allocator remembers how many pages it has
+   (palloc_page_cnt()).  realloc() grows or shrinks a big block in
+   place when the page allocator can do so with palloc_resize().
+
+   The free lists are protected by turning interrupts off instead
+   of by locks: the work done with them off is a few pointer
+   updates, cheaper than taking a lock, and it lets malloc() and
+   free() be used with interrupts off too.  Only creating or
+   releasing an arena takes longer.
+
+   Each block is charged to the tag its caller passes (see
+   mem-tag.h), which the arena records in a byte per block ahead
+   of the blocks themselves, so that malloc_print_stats() can
+   report the bytes each subsystem holds and has held at most.
+   Arena pages are charged to MEM_MALLOC in the page allocator's
+   accounting, and big blocks to their caller's tag. */
 
 /* Descriptor. */
 struct desc {
   size_t block_size;       /* Size of each element in bytes. */
   size_t blocks_per_arena; /* Number of blocks in an arena. */
+  size_t first_ofs;        /* Offset of the first block in an arena. */
   struct list free_list;   /* List of free blocks. */
-  struct lock lock;        /* Lock. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -48,8 +66,9 @@ struct desc {
 /* Arena. */
 struct arena {
   unsigned magic;    /* Always set to ARENA_MAGIC. */
-  struct desc* desc; /* Owning descriptor, null for big block. */
-  size_t free_cnt;   /* Free blocks; pages in big block. */
+  struct desc* desc; /* Owning descriptor. */
+  size_t free_cnt;   /* Free blocks. */
+  uint8_t tags[];    /* Tag of each block, while in use. */
 };
 
 /* Free block. */
@@ -57,33 +76,72 @@ struct block {
   struct list_elem free_elem; /* Free list element. */
 };
 
+/* Size classes are multiples of CLASS_ALIGN bytes. */
+#define CLASS_ALIGN 8
+
+/* Bytes of small blocks charged to one tag. */
+struct tag_usage {
+  size_t bytes;    /* Bytes held now. */
+  size_t peak;     /* Most bytes held at once. */
+  size_t failures; /* Requests that could not be satisfied. */
+};
+
+/* Bytes charged to each tag, protected by turning interrupts
+   off. */
+static struct tag_usage usage[MEM_TAG_CNT];
+
 /* Our set of descriptors. */
-static struct desc descs[10]; /* Descriptors. */
+static struct desc descs[32]; /* Descriptors. */
 static size_t desc_cnt;       /* Number of descriptors. */
 
+/* Smallest descriptor for each request size, in units of
+   CLASS_ALIGN bytes, rounded up, or null if too big. */
+static struct desc* size_descs[PGSIZE / 2 / CLASS_ALIGN + 1];
+
 static struct arena* block_to_arena(struct block*);
 static struct block* arena_to_block(struct arena*, size_t idx);
+static size_t block_idx(struct arena*, struct block*);
+
+/* Adds a descriptor for blocks of BLOCK_SIZE bytes. */
+static void add_desc(size_t block_size) {
+  struct desc* d = &descs[desc_cnt++];
+  ASSERT(desc_cnt <= sizeof descs / sizeof *descs);
+  d->block_size = block_size;
+  d->blocks_per_arena = (PGSIZE - sizeof(struct arena) - (CLASS_ALIGN - 1)) / (block_size + 1);
+  d->first_ofs = ROUND_UP(sizeof(struct arena) + d->blocks_per_arena, CLASS_ALIGN);
+  list_init(&d->free_list);
+}
 
 /* Initializes the malloc() descriptors. */
 void malloc_init(void) {
-  size_t block_size;
-
-  for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
-    struct desc* d = &descs[desc_cnt++];
-    ASSERT(desc_cnt <= sizeof descs / sizeof *descs);
-    d->block_size = block_size;
-    d->blocks_per_arena = (PGSIZE - sizeof(struct arena)) / block_size;
-    list_init(&d->free_list);
-    lock_init(&d->lock);
+  /* The last size class is the biggest that still fits two
+     blocks, and their tags, in an arena. */
+  size_t max_size =
+      ROUND_DOWN((PGSIZE - sizeof(struct arena) - (CLASS_ALIGN - 1)) / 2 - 1, CLASS_ALIGN);
+  size_t block_size, i;
+
+  for (block_size = 16; block_size < max_size;
+       block_size = ROUND_UP(block_size * 5 / 4, CLASS_ALIGN))
+    add_desc(block_size);
+  add_desc(max_size);
+
+  for (i = 0; i < sizeof size_descs / sizeof *size_descs; i++) {
+    struct desc* d;
+    for (d = descs; d < descs + desc_cnt; d++)
+      if (d->block_size >= i * CLASS_ALIGN)
+        break;
+    size_descs[i] = d < descs + desc_cnt ? d : NULL;
   }
 }
 
-/* Obtains and returns a new block of at least SIZE bytes.
-   Returns a null pointer if memory is not available. */
-void* malloc(size_t size) {
+/* Obtains and returns a new block of at least SIZE bytes,
+   charged to TAG.  Returns a null pointer if memory is not
+   available.  malloc() passes the caller's MEM_TAG. */
+void* malloc_tagged(size_t size, enum mem_tag tag) {
   struct desc* d;
   struct block* b;
   struct arena* a;
+  enum intr_level old_level;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -91,35 +149,24 @@ void* malloc(size_t size) {
 
   /* Find the smallest descriptor that satisfies a SIZE-byte
      request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
-  if (d == descs + desc_cnt) {
+  d = size < PGSIZE / 2 ? size_descs[DIV_ROUND_UP(size, CLASS_ALIGN)] : NULL;
+  if (d == NULL) {
     /* SIZE is too big for any descriptor.
-         Allocate enough pages to hold SIZE plus an arena. */
-    size_t page_cnt = DIV_ROUND_UP(size + sizeof *a, PGSIZE);
-    a = palloc_get_multiple(0, page_cnt);
-    if (a == NULL)
-      return NULL;
-
-    /* Initialize the arena to indicate a big block of PAGE_CNT
-         pages, and return it. */
-    a->magic = ARENA_MAGIC;
-    a->desc = NULL;
-    a->free_cnt = page_cnt;
-    return a + 1;
+       Allocate enough pages to hold SIZE, as a big block. */
+    return palloc_get_tagged(0, DIV_ROUND_UP(size, PGSIZE), tag);
   }
 
-  lock_acquire(&d->lock);
+  old_level = intr_disable();
 
   /* If the free list is empty, create a new arena. */
   if (list_empty(&d->free_list)) {
     size_t i;
 
     /* Allocate a page. */
-    a = palloc_get_page(0);
+    a = palloc_get_tagged(0, 1, MEM_MALLOC);
     if (a == NULL) {
-      lock_release(&d->lock);
+      usage[tag].failures++;
+      intr_set_level(old_level);
       return NULL;
     }
 
@@ -137,13 +184,18 @@ void* malloc(size_t size) {
   b = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
   a = block_to_arena(b);
   a->free_cnt--;
-  lock_release(&d->lock);
+  a->tags[block_idx(a, b)] = tag;
+  usage[tag].bytes += d->block_size;
+  if (usage[tag].bytes > usage[tag].peak)
+    usage[tag].peak = usage[tag].bytes;
+  intr_set_level(old_level);
   return b;
 }
 
-/* Allocates and return A times B bytes initialized to zeroes.
-   Returns a null pointer if memory is not available. */
-void* calloc(size_t a, size_t b) {
+/* Allocates and return A times B bytes initialized to zeroes,
+   charged to TAG.  Returns a null pointer if memory is not
+   available.  calloc() passes the caller's MEM_TAG. */
+void* calloc_tagged(size_t a, size_t b, enum mem_tag tag) {
   void* p;
   size_t size;
 
@@ -153,83 +205,102 @@ void* calloc(size_t a, size_t b) {
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc(size);
+  p = malloc_tagged(size, tag);
   if (p != NULL)
     memset(p, 0, size);
 
   return p;
 }
 
+/* Returns true if BLOCK is a big block, false if it is in an
+   arena. */
+static bool is_big_block(void* block) { return pg_ofs(block) == 0; }
+
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t block_size(void* block) {
-  struct block* b = block;
-  struct arena* a = block_to_arena(b);
-  struct desc* d = a->desc;
-
-  return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs(block);
+  if (is_big_block(block))
+    return PGSIZE * palloc_page_cnt(block);
+  return block_to_arena(block)->desc->block_size;
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
-   null pointer.
+   null pointer.  A new block is charged to TAG; realloc() passes
+   the caller's MEM_TAG.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
-void* realloc(void* old_block, size_t new_size) {
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+   A block stays where it is if NEW_SIZE still fits its size
+   class, or if it is a big block that the page allocator can
+   grow or shrink in place and NEW_SIZE still needs a big
+   block. */
+void* realloc_tagged(void* old_block, size_t new_size, enum mem_tag tag) {
+  void* new_block;
+
   if (new_size == 0) {
     free(old_block);
     return NULL;
-  } else {
-    void* new_block = malloc(new_size);
-    if (old_block != NULL && new_block != NULL) {
-      size_t old_size = block_size(old_block);
-      size_t min_size = new_size < old_size ? new_size : old_size;
-      memcpy(new_block, old_block, min_size);
-      free(old_block);
-    }
-    return new_block;
   }
+
+  if (old_block != NULL && is_big_block(old_block)) {
+    if (new_size > descs[desc_cnt - 1].block_size &&
+        palloc_resize(old_block, palloc_page_cnt(old_block), DIV_ROUND_UP(new_size, PGSIZE)))
+      return old_block;
+  } else if (old_block != NULL) {
+    struct desc* d = block_to_arena(old_block)->desc;
+    if (new_size <= d->block_size && (d == descs || new_size > d[-1].block_size))
+      return old_block;
+  }
+
+  new_block = malloc_tagged(new_size, tag);
+  if (old_block != NULL && new_block != NULL) {
+    size_t old_size = block_size(old_block);
+    size_t min_size = new_size < old_size ? new_size : old_size;
+    memcpy(new_block, old_block, min_size);
+    free(old_block);
+  }
+  return new_block;
 }
 
 /* Frees block P, which must have been previously allocated with
    malloc(), calloc(), or realloc(). */
 void free(void* p) {
-  if (p != NULL) {
+  if (p != NULL && is_big_block(p)) {
+    /* It's a big block.  Free its pages. */
+    palloc_free_multiple(p, palloc_page_cnt(p));
+  } else if (p != NULL) {
+    /* It's a normal block.  We handle it here. */
     struct block* b = p;
     struct arena* a = block_to_arena(b);
     struct desc* d = a->desc;
-
-    if (d != NULL) {
-      /* It's a normal block.  We handle it here. */
+    enum intr_level old_level;
 
 #ifndef NDEBUG
-      /* Clear the block to help detect use-after-free bugs. */
-      memset(b, 0xcc, d->block_size);
+    /* Clear the block to help detect use-after-free bugs. */
+    memset(b, 0xcc, d->block_size);
 #endif
 
-      lock_acquire(&d->lock);
+    old_level = intr_disable();
 
-      /* Add block to free list. */
-      list_push_front(&d->free_list, &b->free_elem);
+    /* Take the block off its tag. */
+    usage[a->tags[block_idx(a, b)]].bytes -= d->block_size;
 
-      /* If the arena is now entirely unused, free it. */
-      if (++a->free_cnt >= d->blocks_per_arena) {
-        size_t i;
+    /* Add block to free list. */
+    list_push_front(&d->free_list, &b->free_elem);
 
-        ASSERT(a->free_cnt == d->blocks_per_arena);
-        for (i = 0; i < d->blocks_per_arena; i++) {
-          struct block* b = arena_to_block(a, i);
-          list_remove(&b->free_elem);
-        }
-        palloc_free_page(a);
-      }
+    /* If the arena is now entirely unused, free it. */
+    if (++a->free_cnt >= d->blocks_per_arena) {
+      size_t i;
 
-      lock_release(&d->lock);
-    } else {
-      /* It's a big block.  Free its pages. */
-      palloc_free_multiple(a, a->free_cnt);
-      return;
+      ASSERT(a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) {
+        struct block* b = arena_to_block(a, i);
+        list_remove(&b->free_elem);
+      }
+      palloc_free_page(a);
     }
+
+    intr_set_level(old_level);
   }
 }
 
@@ -242,8 +313,8 @@ static struct arena* block_to_arena(struct block* b) {
   ASSERT(a->magic == ARENA_MAGIC);
 
   /* Check that the block is properly aligned for the arena. */
-  ASSERT(a->desc == NULL || (pg_ofs(b) - sizeof *a) % a->desc->block_size == 0);
-  ASSERT(a->desc != NULL || pg_ofs(b) == sizeof *a);
+  ASSERT(pg_ofs(b) >= a->desc->first_ofs);
+  ASSERT((pg_ofs(b) - a->desc->first_ofs) % a->desc->block_size == 0);
 
   return a;
 }
@@ -253,5 +324,32 @@ static struct block* arena_to_block(struct arena* a, size_t idx) {
   ASSERT(a != NULL);
   ASSERT(a->magic == ARENA_MAGIC);
   ASSERT(idx < a->desc->blocks_per_arena);
-  return (struct block*)((uint8_t*)a + sizeof *a + idx * a->desc->block_size);
+  return (struct block*)((uint8_t*)a + a->desc->first_ofs + idx * a->desc->block_size);
+}
+
+/* Returns the index of block B within arena A. */
+static size_t block_idx(struct arena* a, struct block* b) {
+  return (pg_ofs(b) - a->desc->first_ofs) / a->desc->block_size;
+}
+
+/* Prints the bytes in small blocks by tag, as now/peak, with the
+   number of failed requests for tags that had any.  Big blocks
+   show up in the page allocator's statistics instead. */
+void malloc_print_stats(void) {
+  struct tag_usage copy[MEM_TAG_CNT];
+  enum intr_level old_level;
+  int tag;
+
+  old_level = intr_disable();
+  memcpy(copy, usage, sizeof copy);
+  intr_set_level(old_level);
+
+  printf("Malloc: bytes in small blocks by tag:");
+  for (tag = 0; tag < MEM_TAG_CNT; tag++)
+    if (copy[tag].peak > 0 || copy[tag].failures > 0) {
+      printf(" %s %zu/%zu", mem_tag_name(tag), copy[tag].bytes, copy[tag].peak);
+      if (copy[tag].failures > 0)
+        printf(" (%zu failed)", copy[tag].failures);
+    }
+  printf("\n");
 }
@@ -3,11 +3,18 @@
 
 #include <debug.h>
 #include <stddef.h>
+#include "threads/mem-tag.h"
 
 void malloc_init(void);
-void* malloc(size_t) __attribute__((malloc));
-void* calloc(size_t, size_t) __attribute__((malloc));
-void* realloc(void*, size_t);
+void* malloc_tagged(size_t, enum mem_tag) __attribute__((malloc));
+void* calloc_tagged(size_t, size_t, enum mem_tag) __attribute__((malloc));
+void* realloc_tagged(void*, size_t, enum mem_tag);
 void free(void*);
+void malloc_print_stats(void);
+
+/* Allocate memory charged to the calling file's MEM_TAG. */
+#define malloc(SIZE) malloc_tagged(SIZE, MEM_TAG)
+#define calloc(CNT, SIZE) calloc_tagged(CNT, SIZE, MEM_TAG)
+#define realloc(BLOCK, SIZE) realloc_tagged(BLOCK, SIZE, MEM_TAG)
 
 #endif /* threads/malloc.h */
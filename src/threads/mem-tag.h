@@ -0,0 +1,36 @@
+#ifndef THREADS_MEM_TAG_H
+#define THREADS_MEM_TAG_H
+
+/* Subsystems that kernel memory is charged to.
+
+   palloc_get_page(), palloc_get_multiple(), malloc(), calloc()
+   and realloc() are macros that pass MEM_TAG, the tag of the
+   source file they are called from, to the allocator, which
+   keeps track of how much memory each tag holds and has held at
+   most.  Makefile.build sets MEM_TAG for each directory of the
+   kernel; files outside of those get MEM_OTHER. */
+enum mem_tag {
+  MEM_OTHER,   /* Libraries and tests. */
+  MEM_THREAD,  /* threads/. */
+  MEM_DEVICE,  /* devices/. */
+  MEM_SYSCALL, /* userprog/, except page directories. */
+  MEM_PAGEDIR, /* userprog/pagedir.c. */
+  MEM_VM,      /* vm/. */
+  MEM_FILESYS, /* filesys/. */
+  MEM_MALLOC,  /* Arenas of small malloc() blocks. */
+  MEM_SLAB,    /* Slabs of object caches. */
+  MEM_TAG_CNT  /* Number of tags. */
+};
+
+#ifndef MEM_TAG
+#define MEM_TAG MEM_OTHER
+#endif
+
+/* Returns the name of TAG, for statistics. */
+static inline const char* mem_tag_name(enum mem_tag tag) {
+  static const char* names[MEM_TAG_CNT] = {"other", "thread", "device", "syscall", "pagedir",
+                                           "vm", "filesys", "malloc", "slab"};
+  return tag < MEM_TAG_CNT ? names[tag] : "?";
+}
+
+#endif /* threads/mem-tag.h */
@@ -2,14 +2,20 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -23,20 +29,119 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   A user page can be shared, for example between a process and
+   the child it forks: palloc_share_page() adds a reference to
+   it, and palloc_free_page() then only drops a reference until
+   the last one is gone.  One page of the user pool, the zero
+   page, holds only zeros and is shared by every page of user
+   memory that has never been written.
+
+   Each pool is a binary buddy allocator.  Free memory is kept in
+   blocks of 2**ORDER pages, aligned to their size relative to
+   the pool base, on one free list per order.  A request for N
+   pages splits the smallest big enough block in halves until it
+   has a block of the next power of two at or above N, and gives
+   back the tail beyond N.  Freeing merges a block with its
+   buddy, the other half of the block it was split from, for as
+   long as the buddy is free too.  Both take O(log n) steps, and
+   freed memory coalesces, so mixing single-page and multi-page
+   requests does not break up the pool the way first fit did.
+
+   Frees can come from the scheduler with interrupts off, when a
+   dying thread's page is released, so the free lists are
+   protected by turning interrupts off rather than by a lock.
+   That is cheap, since no operation takes more than a few dozen
+   steps.
+
+   Single pages, by far the most common request, are served from
+   a magazine in front of the buddy allocator: a small stack of
+   free pages per pool, refilled from and drained to the free
+   lists MAG_BATCH pages at a time.  (With one CPU there is one
+   magazine per pool.)  The idle thread also keeps up to
+   ZERO_RESERVE pages per pool zeroed ahead of time, so a
+   PAL_ZERO request for a single page usually costs no memset().
+
+   Every allocation is charged to the tag that its caller passes
+   (see mem-tag.h), page by page, so that palloc_print_stats() can
+   tell which subsystems hold each pool's pages, the most they
+   held at once, and how many of their requests failed. */
+
+/* Number of block orders: blocks range from 1 page to
+   2**(PALLOC_ORDERS - 1) pages. */
+#define PALLOC_ORDERS 20
+
+/* Magazine capacity, and pages moved to or from the free lists
+   at a time when it runs empty or full. */
+#define MAG_SIZE 32
+#define MAG_BATCH 16
+
+/* Pre-zeroed pages kept per pool by the idle thread. */
+#define ZERO_RESERVE 16
+
+/* Pages of a pool charged to one tag. */
+struct tag_usage {
+  size_t pages;    /* Pages held now. */
+  size_t peak;     /* Most pages held at once. */
+  size_t failures; /* Requests that could not be satisfied. */
+};
+
+/* Header at the start of each free block. */
+struct free_block {
+  struct list_elem elem; /* Element in pool's free_lists. */
+};
 
 /* A memory pool. */
 struct pool {
-  struct lock lock;        /* Mutual exclusion. */
+  struct lock lock;        /* Protects ref_cnts. */
   struct bitmap* used_map; /* Bitmap of free pages. */
   uint8_t* base;           /* Base of pool. */
+  uint16_t* ref_cnts;      /* References to each page, or null. */
+  uint16_t* run_cnts;      /* Pages in the allocation each page starts. */
+  uint8_t* tags;           /* Tag that each allocated page is charged to. */
+  const char* name;        /* Name, for statistics. */
+
+  /* Buddy allocator, protected by turning interrupts off. */
+  uint8_t* orders;                        /* Order + 1 at head of each free block, else 0. */
+  struct list free_lists[PALLOC_ORDERS];  /* Free blocks of each order. */
+  size_t free_cnt;                        /* Free pages. */
+  size_t frag_failures;                   /* Failures with enough pages free. */
+
+  /* Single pages held back from the buddy allocator, also
+     protected by turning interrupts off. */
+  void* mag[MAG_SIZE];        /* Free pages, most recently freed last. */
+  size_t mag_cnt;             /* Number of pages in mag. */
+  void* zeroed[ZERO_RESERVE]; /* Free pages already zeroed. */
+  size_t zeroed_cnt;          /* Number of pages in zeroed. */
+  size_t mag_hits;            /* Single pages served by mag. */
+  size_t zeroed_hits;         /* PAL_ZERO pages served by zeroed. */
+
+  /* Accounting, also protected by turning interrupts off. */
+  struct tag_usage usage[MEM_TAG_CNT]; /* Pages charged to each tag. */
+  size_t used_cnt;                     /* Pages allocated. */
+  size_t peak_used;                    /* Most pages allocated at once. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
-static void init_pool(struct pool*, void* base, size_t page_cnt, const char* name);
+/* Page of zeros in the user pool.  Holds a reference of its own,
+   so that it is never freed. */
+static void* zero_page;
+
+static void init_pool(struct pool*, void* base, size_t page_cnt, bool ref_cnts,
+                      const char* name);
 static bool page_from_pool(const struct pool*, void* page);
+static struct pool* pool_of(void* pages);
+static void take_range(struct pool*, size_t page_idx, size_t page_cnt);
+static size_t pool_alloc(struct pool*, size_t page_cnt);
+static void pool_drain(struct pool*);
+static void pool_free(struct pool*, size_t page_idx, size_t page_cnt);
+static void* pool_get(struct pool*, size_t page_cnt, bool zero, bool* zeroed);
+static void pool_put_page(struct pool*, void* page);
+static void charge(struct pool*, size_t page_idx, size_t page_cnt, enum mem_tag);
+static void uncharge(struct pool*, size_t page_idx, size_t page_cnt);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -52,8 +157,10 @@ void palloc_init(size_t user_page_limit) {
   kernel_pages = free_pages - user_pages;
 
   /* Give half of memory to kernel, half to user. */
-  init_pool(&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool(&user_pool, free_start + kernel_pages * PGSIZE, user_pages, "user pool");
+  init_pool(&kernel_pool, free_start, kernel_pages, false, "kernel pool");
+  init_pool(&user_pool, free_start + kernel_pages * PGSIZE, user_pages, true, "user pool");
+
+  zero_page = palloc_get_page(PAL_USER | PAL_ZERO);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -61,43 +168,116 @@ void palloc_init(size_t user_page_limit) {
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void* palloc_get_multiple(enum palloc_flags flags, size_t page_cnt) {
+   FLAGS, in which case the kernel panics.  The pages are charged
+   to TAG.  palloc_get_multiple() passes the caller's MEM_TAG. */
+void* palloc_get_tagged(enum palloc_flags flags, size_t page_cnt, enum mem_tag tag) {
   struct pool* pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  bool zero = (flags & PAL_ZERO) != 0;
+  bool zeroed = false;
   void* pages;
-  size_t page_idx;
 
+  ASSERT(tag < MEM_TAG_CNT);
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire(&pool->lock);
-  page_idx = bitmap_scan_and_flip(pool->used_map, 0, page_cnt, false);
-  lock_release(&pool->lock);
+  pages = pool_get(pool, page_cnt, zero, &zeroed);
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+#ifdef VM
+  /* Out of user pages: evict one to make room, and try again.
+     Several contiguous pages may instead be only too scattered,
+     so move user pages out of the way to make a run of them. */
+  while (pages == NULL && pool == &user_pool && page_cnt == 1 && !(flags & PAL_NOEVICT) &&
+         frame_evict())
+    pages = pool_get(pool, page_cnt, zero, &zeroed);
+  if (pages == NULL && pool == &user_pool && page_cnt > 1 && !(flags & PAL_NOEVICT) &&
+      frame_compact(page_cnt))
+    pages = pool_get(pool, page_cnt, zero, &zeroed);
+#endif
 
   if (pages != NULL) {
-    if (flags & PAL_ZERO)
+    size_t page_idx = pg_no(pages) - pg_no(pool->base);
+    pool->run_cnts[page_idx] = page_cnt;
+    if (pool->ref_cnts != NULL) {
+      size_t i;
+      for (i = 0; i < page_cnt; i++)
+        pool->ref_cnts[page_idx + i] = 1;
+    }
+    charge(pool, page_idx, page_cnt, tag);
+    if (zero && !zeroed)
       memset(pages, 0, PGSIZE * page_cnt);
   } else {
+    enum intr_level old_level = intr_disable();
+    pool->usage[tag].failures++;
+    intr_set_level(old_level);
     if (flags & PAL_ASSERT)
-      PANIC("palloc_get: out of pages");
+      PANIC("palloc_get: out of pages for %s", mem_tag_name(tag));
   }
 
   return pages;
 }
 
-/* Obtains a single free page and returns its kernel virtual
-   address.
-   If PAL_USER is set, the page is obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the page is filled with zeros.  If no pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void* palloc_get_page(enum palloc_flags flags) { return palloc_get_multiple(flags, 1); }
+/* Returns the index of the first page of a free run of PAGE_CNT
+   pages in POOL whose physical page number is a multiple of
+   ALIGN, after taking the run, or BITMAP_ERROR if there is none.
+   Unlike pool_alloc(), which aligns blocks only relative to the
+   pool base, this scans the bitmap. */
+static size_t pool_alloc_aligned(struct pool* pool, size_t page_cnt, size_t align) {
+  size_t pool_cnt = bitmap_size(pool->used_map);
+  size_t page_idx = BITMAP_ERROR;
+  size_t idx = ROUND_UP(pg_no(pool->base), align) - pg_no(pool->base);
+  enum intr_level old_level = intr_disable();
+
+  for (; idx + page_cnt <= pool_cnt; idx += align)
+    if (!bitmap_any(pool->used_map, idx, page_cnt)) {
+      take_range(pool, idx, page_cnt);
+      bitmap_set_multiple(pool->used_map, idx, page_cnt, true);
+      pool->free_cnt -= page_cnt;
+      page_idx = idx;
+      break;
+    }
+  intr_set_level(old_level);
+  return page_idx;
+}
+
+/* Obtains PAGE_CNT contiguous free pages whose physical address
+   is a multiple of ALIGN pages, as palloc_get_tagged() does, for
+   mapping with a single large page.  The pages are not an
+   allocation of their own: each of them is freed with
+   palloc_free_page(), one at a time or in any order, and may be
+   shared like any single page.  Never evicts and never
+   panics; returns a null pointer if there is no such run. */
+void* palloc_get_aligned_tagged(enum palloc_flags flags, size_t page_cnt, size_t align,
+                                enum mem_tag tag) {
+  struct pool* pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  size_t page_idx, i;
+  void* pages;
+
+  ASSERT(tag < MEM_TAG_CNT);
+  ASSERT(page_cnt > 0 && align > 0);
+
+  page_idx = pool_alloc_aligned(pool, page_cnt, align);
+  if (page_idx == BITMAP_ERROR && (pool->mag_cnt > 0 || pool->zeroed_cnt > 0)) {
+    pool_drain(pool);
+    page_idx = pool_alloc_aligned(pool, page_cnt, align);
+  }
+  if (page_idx == BITMAP_ERROR) {
+    enum intr_level old_level = intr_disable();
+    pool->usage[tag].failures++;
+    intr_set_level(old_level);
+    return NULL;
+  }
+
+  pages = pool->base + PGSIZE * page_idx;
+  for (i = 0; i < page_cnt; i++) {
+    pool->run_cnts[page_idx + i] = 1;
+    if (pool->ref_cnts != NULL)
+      pool->ref_cnts[page_idx + i] = 1;
+  }
+  charge(pool, page_idx, page_cnt, tag);
+  if (flags & PAL_ZERO)
+    memset(pages, 0, PGSIZE * page_cnt);
+  return pages;
+}
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void palloc_free_multiple(void* pages, size_t page_cnt) {
@@ -108,43 +288,525 @@ void palloc_free_multiple(void* pages, size_t page_cnt) {
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool(&kernel_pool, pages))
-    pool = &kernel_pool;
-  else if (page_from_pool(&user_pool, pages))
-    pool = &user_pool;
-  else
-    NOT_REACHED();
+  pool = pool_of(pages);
 
   page_idx = pg_no(pages) - pg_no(pool->base);
 
+  /* Drop a reference to a shared page. */
+  if (pool->ref_cnts != NULL && page_cnt == 1) {
+    bool shared;
+
+    lock_acquire(&pool->lock);
+    ASSERT(pool->ref_cnts[page_idx] > 0);
+    shared = --pool->ref_cnts[page_idx] > 0;
+    lock_release(&pool->lock);
+    if (shared)
+      return;
+  }
+
 #ifndef NDEBUG
   memset(pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+  uncharge(pool, page_idx, page_cnt);
+  if (page_cnt == 1)
+    pool_put_page(pool, pages);
+  else
+    pool_free(pool, page_idx, page_cnt);
 }
 
-/* Frees the page at PAGE. */
+/* Frees the page at PAGE, or drops a reference to it if it is
+   shared. */
 void palloc_free_page(void* page) { palloc_free_multiple(page, 1); }
 
+/* qsort() comparison function for page addresses. */
+static int compare_pages(const void* a_, const void* b_) {
+  const uint8_t* a = *(void* const*)a_;
+  const uint8_t* b = *(void* const*)b_;
+  return a < b ? -1 : a > b;
+}
+
+/* Calls palloc_free_page() on each of the CNT pages in PAGES, in
+   fewer steps: references to shared pages are dropped under one
+   acquisition of the user pool's lock, and the pages whose last
+   reference is gone are sorted, so that each run of adjacent
+   pages goes back to the buddy allocator at once rather than
+   page by page through the magazine.  Meant for tearing down a
+   whole address space.  Reorders PAGES. */
+void palloc_free_pages(void* pages[], size_t cnt) {
+  size_t free_cnt = 0;
+  size_t i, run;
+
+  /* Drop references, keeping only the pages to free. */
+  lock_acquire(&user_pool.lock);
+  for (i = 0; i < cnt; i++) {
+    struct pool* pool = pool_of(pages[i]);
+
+    ASSERT(pg_ofs(pages[i]) == 0);
+    if (pool->ref_cnts != NULL) {
+      size_t page_idx = pg_no(pages[i]) - pg_no(pool->base);
+      ASSERT(pool->ref_cnts[page_idx] > 0);
+      if (--pool->ref_cnts[page_idx] > 0)
+        continue;
+    }
+    pages[free_cnt++] = pages[i];
+  }
+  lock_release(&user_pool.lock);
+
+  qsort(pages, free_cnt, sizeof *pages, compare_pages);
+  for (i = 0; i < free_cnt; i += run) {
+    struct pool* pool = pool_of(pages[i]);
+    size_t page_idx = pg_no(pages[i]) - pg_no(pool->base);
+
+    for (run = 1; i + run < free_cnt; run++)
+      if ((uint8_t*)pages[i + run] != (uint8_t*)pages[i] + PGSIZE * run ||
+          !page_from_pool(pool, pages[i + run]))
+        break;
+
+#ifndef NDEBUG
+    memset(pages[i], 0xcc, PGSIZE * run);
+#endif
+    uncharge(pool, page_idx, run);
+    if (run == 1)
+      pool_put_page(pool, pages[i]);
+    else
+      pool_free(pool, page_idx, run);
+  }
+}
+
+/* Returns the pool that PAGES came from. */
+static struct pool* pool_of(void* pages) {
+  if (page_from_pool(&kernel_pool, pages))
+    return &kernel_pool;
+  else if (page_from_pool(&user_pool, pages))
+    return &user_pool;
+  NOT_REACHED();
+}
+
+/* Returns the number of pages obtained by the
+   palloc_get_multiple() call that returned PAGES (or by the last
+   palloc_resize() of them). */
+size_t palloc_page_cnt(void* pages) {
+  struct pool* pool;
+
+  ASSERT(pg_ofs(pages) == 0);
+  pool = pool_of(pages);
+  return pool->run_cnts[pg_no(pages) - pg_no(pool->base)];
+}
+
+/* Changes the OLD_CNT pages at PAGES, as obtained from
+   palloc_get_multiple(), into NEW_CNT pages at the same address,
+   and returns true if successful.  Shrinking always succeeds and
+   frees the pages past NEW_CNT.  Growing succeeds only if the
+   pages just past the old ones are free, and then takes them; the
+   new pages are not zeroed.  Neither may be used on shared
+   pages. */
+bool palloc_resize(void* pages, size_t old_cnt, size_t new_cnt) {
+  struct pool* pool;
+  size_t page_idx, i;
+  enum intr_level old_level;
+  bool success = false;
+
+  ASSERT(pg_ofs(pages) == 0);
+  ASSERT(old_cnt > 0 && new_cnt > 0);
+  pool = pool_of(pages);
+  page_idx = pg_no(pages) - pg_no(pool->base);
+  ASSERT(pool->run_cnts[page_idx] == old_cnt);
+
+  if (new_cnt <= old_cnt) {
+    if (new_cnt < old_cnt) {
+      uint8_t* tail = (uint8_t*)pages + PGSIZE * new_cnt;
+#ifndef NDEBUG
+      memset(tail, 0xcc, PGSIZE * (old_cnt - new_cnt));
+#endif
+      uncharge(pool, page_idx + new_cnt, old_cnt - new_cnt);
+      pool_free(pool, page_idx + new_cnt, old_cnt - new_cnt);
+      pool->run_cnts[page_idx] = new_cnt;
+    }
+    return true;
+  }
+
+  old_level = intr_disable();
+  if (page_idx + new_cnt <= bitmap_size(pool->used_map) &&
+      !bitmap_any(pool->used_map, page_idx + old_cnt, new_cnt - old_cnt)) {
+    take_range(pool, page_idx + old_cnt, new_cnt - old_cnt);
+    bitmap_set_multiple(pool->used_map, page_idx + old_cnt, new_cnt - old_cnt, true);
+    pool->free_cnt -= new_cnt - old_cnt;
+    pool->run_cnts[page_idx] = new_cnt;
+    if (pool->ref_cnts != NULL)
+      for (i = old_cnt; i < new_cnt; i++)
+        pool->ref_cnts[page_idx + i] = 1;
+    charge(pool, page_idx + old_cnt, new_cnt - old_cnt, pool->tags[page_idx]);
+    success = true;
+  }
+  intr_set_level(old_level);
+
+  return success;
+}
+
+/* Adds a reference to PAGE, which must be a page from the user
+   pool, so that it takes one more palloc_free_page() to free
+   it. */
+void palloc_share_page(void* page) {
+  size_t page_idx;
+
+  ASSERT(pg_ofs(page) == 0);
+  ASSERT(page_from_pool(&user_pool, page));
+
+  page_idx = pg_no(page) - pg_no(user_pool.base);
+  lock_acquire(&user_pool.lock);
+  ASSERT(user_pool.ref_cnts[page_idx] > 0 && user_pool.ref_cnts[page_idx] < UINT16_MAX);
+  user_pool.ref_cnts[page_idx]++;
+  lock_release(&user_pool.lock);
+}
+
+/* Returns the number of references to PAGE, which must be a page
+   from the user pool. */
+size_t palloc_page_refs(void* page) {
+  ASSERT(pg_ofs(page) == 0);
+  ASSERT(page_from_pool(&user_pool, page));
+
+  return user_pool.ref_cnts[pg_no(page) - pg_no(user_pool.base)];
+}
+
+/* Adds a reference to the zero page and returns it, or returns a
+   null pointer if it already has so many references that it
+   might run out of room for more.  The page must never be
+   written.  palloc_free_page() drops the reference. */
+void* palloc_get_zero_page(void) {
+  void* page = NULL;
+  size_t page_idx;
+
+  if (zero_page == NULL)
+    return NULL;
+
+  /* Leave plenty of room for others, such as pagedir_break_cow(),
+     to add temporary references with palloc_share_page(). */
+  page_idx = pg_no(zero_page) - pg_no(user_pool.base);
+  lock_acquire(&user_pool.lock);
+  if (user_pool.ref_cnts[page_idx] < UINT16_MAX / 2) {
+    user_pool.ref_cnts[page_idx]++;
+    page = zero_page;
+  }
+  lock_release(&user_pool.lock);
+  return page;
+}
+
+/* Returns true if PAGE is the zero page. */
+bool palloc_is_zero_page(const void* page) { return page == zero_page && page != NULL; }
+
+/* Returns true if user pool page PAGE is free in the buddy
+   allocator.  Pages held in the magazine or the zeroed reserve
+   count as in use.  The answer may be out of date by the time the
+   caller looks at it. */
+bool palloc_user_page_free(const void* page) {
+  ASSERT(pg_ofs(page) == 0);
+  ASSERT(page_from_pool(&user_pool, (void*)page));
+
+  return !bitmap_test(user_pool.used_map, pg_no(page) - pg_no(user_pool.base));
+}
+
+/* Stores the number of free pages in the user pool in *FREE_CNT
+   and the number of pages in its largest free block, the longest
+   run that palloc_get_multiple() can hand out without merging,
+   in *LARGEST. */
+void palloc_user_free(size_t* free_cnt, size_t* largest) {
+  enum intr_level old_level = intr_disable();
+  int order;
+
+  *free_cnt = user_pool.free_cnt + user_pool.mag_cnt + user_pool.zeroed_cnt;
+  *largest = 0;
+  for (order = PALLOC_ORDERS - 1; order >= 0; order--)
+    if (!list_empty(&user_pool.free_lists[order])) {
+      *largest = (size_t)1 << order;
+      break;
+    }
+  intr_set_level(old_level);
+}
+
+/* Stores the address of the first page in the user pool in
+   *BASE and the number of pages in it in *PAGE_CNT. */
+void palloc_user_pool(uint8_t** base, size_t* page_cnt) {
+  *base = user_pool.base;
+  *page_cnt = bitmap_size(user_pool.used_map);
+}
+
+/* Returns the user pool's magazine and zeroed reserve to the
+   buddy allocator, so that the pages in them can merge, as after
+   freeing many pages that should form a run. */
+void palloc_user_drain(void) { pool_drain(&user_pool); }
+
+/* Zeroes one page ahead of time for a later PAL_ZERO request, if
+   a pool's reserve of zeroed pages is short and it has free
+   pages to spare.  Called by the idle thread with interrupts
+   off. */
+void palloc_zero_one(void) {
+  struct pool* pools[] = {&kernel_pool, &user_pool};
+  size_t i;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++) {
+    struct pool* pool = pools[i];
+    void* page;
+
+    if (pool->zeroed_cnt >= ZERO_RESERVE)
+      continue;
+    if (pool->mag_cnt > 0)
+      page = pool->mag[--pool->mag_cnt];
+    else {
+      size_t page_idx = pool_alloc(pool, 1);
+      if (page_idx == BITMAP_ERROR)
+        continue;
+      page = pool->base + PGSIZE * page_idx;
+    }
+    pg_zero(page);
+    pool->zeroed[pool->zeroed_cnt++] = page;
+    return;
+  }
+}
+
+/* Prints the pages in use in POOL by tag, as now/peak, with the
+   number of failed requests for tags that had any, and the most
+   pages ever in use at once. */
+static void print_usage(struct pool* pool) {
+  struct tag_usage usage[MEM_TAG_CNT];
+  size_t peak_used;
+  enum intr_level old_level;
+  int tag;
+
+  old_level = intr_disable();
+  memcpy(usage, pool->usage, sizeof usage);
+  peak_used = pool->peak_used;
+  intr_set_level(old_level);
+
+  printf("Palloc: %s: at most %zu pages in use; pages by tag:", pool->name, peak_used);
+  for (tag = 0; tag < MEM_TAG_CNT; tag++)
+    if (usage[tag].peak > 0 || usage[tag].failures > 0) {
+      printf(" %s %zu/%zu", mem_tag_name(tag), usage[tag].pages, usage[tag].peak);
+      if (usage[tag].failures > 0)
+        printf(" (%zu failed)", usage[tag].failures);
+    }
+  printf("\n");
+}
+
+/* Prints the free memory in POOL and how it is broken up. */
+static void print_pool_stats(struct pool* pool) {
+  size_t blocks[PALLOC_ORDERS];
+  size_t largest = 0;
+  size_t free_cnt;
+  enum intr_level old_level;
+  int order;
+
+  old_level = intr_disable();
+  free_cnt = pool->free_cnt + pool->mag_cnt + pool->zeroed_cnt;
+  for (order = 0; order < PALLOC_ORDERS; order++) {
+    blocks[order] = list_size(&pool->free_lists[order]);
+    if (blocks[order] > 0)
+      largest = (size_t)1 << order;
+  }
+  intr_set_level(old_level);
+
+  printf("Palloc: %s: %zu of %zu pages free, largest free block %zu pages, "
+         "%zu failures from fragmentation\n",
+         pool->name, free_cnt, bitmap_size(pool->used_map), largest,
+         pool->frag_failures);
+  printf("Palloc: %s: %zu single pages from magazine, %zu zeroed ahead of time\n", pool->name,
+         pool->mag_hits, pool->zeroed_hits);
+  printf("Palloc: %s: free blocks by order:", pool->name);
+  for (order = 0; order < PALLOC_ORDERS; order++)
+    if (blocks[order] > 0)
+      printf(" %d:%zu", order, blocks[order]);
+  printf("\n");
+  print_usage(pool);
+}
+
+/* Prints page allocator statistics. */
+void palloc_print_stats(void) {
+  print_pool_stats(&kernel_pool);
+  print_pool_stats(&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
-static void init_pool(struct pool* p, void* base, size_t page_cnt, const char* name) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP(bitmap_buf_size(page_cnt), PGSIZE);
+   naming it NAME for debugging purposes.  If REF_CNTS is true,
+   the pool also keeps reference counts for its pages. */
+static void init_pool(struct pool* p, void* base, size_t page_cnt, bool ref_cnts,
+                      const char* name) {
+  /* We'll put the pool's used_map at its base, followed by its
+     reference counts, its allocation sizes, its page tags and its
+     block orders.
+     Calculate the space needed for them and subtract it from the
+     pool's size.  Reserving enough for PAGE_CNT pages leaves a
+     little slack. */
+  size_t bm_bytes = ROUND_UP(bitmap_buf_size(page_cnt), sizeof(uint16_t));
+  size_t rc_bytes = ref_cnts ? page_cnt * sizeof(uint16_t) : 0;
+  size_t run_bytes = page_cnt * sizeof(uint16_t);
+  size_t bm_pages = DIV_ROUND_UP(bm_bytes + rc_bytes + run_bytes + page_cnt * 2, PGSIZE);
+  int order;
   if (bm_pages > page_cnt)
     PANIC("Not enough memory in %s for bitmap.", name);
+  ASSERT(page_cnt <= UINT16_MAX);
   page_cnt -= bm_pages;
 
   printf("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init(&p->lock);
-  p->used_map = bitmap_create_in_buf(page_cnt, base, bm_pages * PGSIZE);
+  lock_init_named(&p->lock, "palloc");
+  p->used_map = bitmap_create_in_buf(page_cnt, base, bm_bytes);
+  p->ref_cnts = ref_cnts ? (uint16_t*)((uint8_t*)base + bm_bytes) : NULL;
+  p->run_cnts = (uint16_t*)((uint8_t*)base + bm_bytes + rc_bytes);
+  p->tags = (uint8_t*)base + bm_bytes + rc_bytes + run_bytes;
+  p->orders = p->tags + page_cnt;
   p->base = base + bm_pages * PGSIZE;
+  p->name = name;
+  for (order = 0; order < PALLOC_ORDERS; order++)
+    list_init(&p->free_lists[order]);
+  memset(p->orders, 0, page_cnt);
+  p->free_cnt = 0;
+  p->frag_failures = 0;
+  p->mag_cnt = p->zeroed_cnt = 0;
+  p->mag_hits = p->zeroed_hits = 0;
+  memset(p->usage, 0, sizeof p->usage);
+  p->used_cnt = p->peak_used = 0;
+
+  /* Hand the whole pool to the buddy allocator as if it had all
+     been allocated. */
+  bitmap_set_all(p->used_map, true);
+  pool_free(p, 0, page_cnt);
+}
+
+/* Returns the order of the smallest block that holds PAGE_CNT
+   pages. */
+static int order_for(size_t page_cnt) {
+  int order = 0;
+  while (((size_t)1 << order) < page_cnt)
+    order++;
+  return order;
+}
+
+/* Returns the header of the free block that starts at page
+   PAGE_IDX in POOL. */
+static struct free_block* block_at(struct pool* pool, size_t page_idx) {
+  return (struct free_block*)(pool->base + PGSIZE * page_idx);
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+   it with its buddy for as long as the buddy is free. */
+static void free_block(struct pool* pool, size_t page_idx, int order) {
+  size_t page_cnt = bitmap_size(pool->used_map);
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  while (order < PALLOC_ORDERS - 1) {
+    size_t buddy = page_idx ^ ((size_t)1 << order);
+    if (buddy + ((size_t)1 << order) > page_cnt || pool->orders[buddy] != order + 1)
+      break;
+    list_remove(&block_at(pool, buddy)->elem);
+    pool->orders[buddy] = 0;
+    if (buddy < page_idx)
+      page_idx = buddy;
+    order++;
+  }
+  pool->orders[page_idx] = order + 1;
+  list_push_front(&pool->free_lists[order], &block_at(pool, page_idx)->elem);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, breaking
+   them up into the largest aligned blocks they hold. */
+static void free_range(struct pool* pool, size_t page_idx, size_t page_cnt) {
+  while (page_cnt > 0) {
+    int order = 0;
+    while (order < PALLOC_ORDERS - 1 && (page_idx & ((size_t)1 << order)) == 0 &&
+           ((size_t)2 << order) <= page_cnt)
+      order++;
+    free_block(pool, page_idx, order);
+    page_idx += (size_t)1 << order;
+    page_cnt -= (size_t)1 << order;
+  }
+}
+
+/* Removes the PAGE_CNT pages starting at PAGE_IDX in POOL, which
+   must all be free, from the free blocks that hold them, giving
+   back the parts of those blocks outside the range. */
+static void take_range(struct pool* pool, size_t page_idx, size_t page_cnt) {
+  size_t end = page_idx + page_cnt;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  while (page_idx < end) {
+    size_t head = page_idx, block_end;
+    int order;
+
+    /* Find the free block that holds PAGE_IDX. */
+    for (order = 0; order < PALLOC_ORDERS; order++) {
+      head = page_idx & ~(((size_t)1 << order) - 1);
+      if (pool->orders[head] == order + 1)
+        break;
+    }
+    ASSERT(order < PALLOC_ORDERS);
+    block_end = head + ((size_t)1 << order);
+    ASSERT(block_end > page_idx);
+
+    list_remove(&block_at(pool, head)->elem);
+    pool->orders[head] = 0;
+    free_range(pool, head, page_idx - head);
+    if (block_end > end) {
+      free_range(pool, end, block_end - end);
+      block_end = end;
+    }
+    page_idx = block_end;
+  }
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if there is no free
+   block big enough. */
+static size_t pool_alloc(struct pool* pool, size_t page_cnt) {
+  int want = order_for(page_cnt);
+  size_t page_idx = BITMAP_ERROR;
+  enum intr_level old_level;
+  int order;
+
+  if (want >= PALLOC_ORDERS)
+    return BITMAP_ERROR;
+
+  old_level = intr_disable();
+  for (order = want; order < PALLOC_ORDERS; order++)
+    if (!list_empty(&pool->free_lists[order]))
+      break;
+  if (order < PALLOC_ORDERS) {
+    struct free_block* b = list_entry(list_pop_front(&pool->free_lists[order]),
+                                      struct free_block, elem);
+    page_idx = pg_no(b) - pg_no(pool->base);
+    pool->orders[page_idx] = 0;
+
+    /* Split down to the order we want, then give back the tail
+       beyond PAGE_CNT. */
+    while (order > want) {
+      order--;
+      free_block(pool, page_idx + ((size_t)1 << order), order);
+    }
+    free_range(pool, page_idx + page_cnt, ((size_t)1 << want) - page_cnt);
+
+    ASSERT(!bitmap_any(pool->used_map, page_idx, page_cnt));
+    bitmap_set_multiple(pool->used_map, page_idx, page_cnt, true);
+    pool->free_cnt -= page_cnt;
+  } else if (pool->free_cnt >= page_cnt)
+    pool->frag_failures++;
+  intr_set_level(old_level);
+
+  return page_idx;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL. */
+static void pool_free(struct pool* pool, size_t page_idx, size_t page_cnt) {
+  enum intr_level old_level = intr_disable();
+
+  ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+  free_range(pool, page_idx, page_cnt);
+  pool->free_cnt += page_cnt;
+  intr_set_level(old_level);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -156,3 +818,115 @@ static bool page_from_pool(const struct pool* pool, void* page) {
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns every page in POOL's magazine and zeroed reserve to
+   the buddy allocator, so that they can merge into bigger
+   blocks. */
+static void pool_drain(struct pool* pool) {
+  enum intr_level old_level = intr_disable();
+  while (pool->mag_cnt > 0)
+    pool_free(pool, pg_no(pool->mag[--pool->mag_cnt]) - pg_no(pool->base), 1);
+  while (pool->zeroed_cnt > 0)
+    pool_free(pool, pg_no(pool->zeroed[--pool->zeroed_cnt]) - pg_no(pool->base), 1);
+  intr_set_level(old_level);
+}
+
+/* Obtains PAGE_CNT contiguous pages from POOL and returns the
+   first, or a null pointer if there are not enough.  If ZERO is
+   true, tries to find a page that has already been zeroed, and
+   sets *ZEROED to true if it does. */
+static void* pool_get(struct pool* pool, size_t page_cnt, bool zero, bool* zeroed) {
+  enum intr_level old_level;
+  void* page = NULL;
+  size_t page_idx;
+
+  if (page_cnt > 1) {
+    page_idx = pool_alloc(pool, page_cnt);
+    if (page_idx == BITMAP_ERROR && (pool->mag_cnt > 0 || pool->zeroed_cnt > 0)) {
+      pool_drain(pool);
+      page_idx = pool_alloc(pool, page_cnt);
+    }
+    return page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+  }
+
+  old_level = intr_disable();
+  if (zero && pool->zeroed_cnt > 0) {
+    page = pool->zeroed[--pool->zeroed_cnt];
+    pool->zeroed_hits++;
+    *zeroed = true;
+  } else {
+    /* Refill an empty magazine with a batch of pages. */
+    if (pool->mag_cnt == 0)
+      while (pool->mag_cnt < MAG_BATCH) {
+        page_idx = pool_alloc(pool, 1);
+        if (page_idx == BITMAP_ERROR)
+          break;
+        pool->mag[pool->mag_cnt++] = pool->base + PGSIZE * page_idx;
+      }
+    else
+      pool->mag_hits++;
+
+    if (pool->mag_cnt > 0)
+      page = pool->mag[--pool->mag_cnt];
+    else if (pool->zeroed_cnt > 0) {
+      page = pool->zeroed[--pool->zeroed_cnt];
+      *zeroed = true;
+    }
+  }
+  intr_set_level(old_level);
+
+  return page;
+}
+
+/* Returns PAGE to POOL's magazine, first draining a batch of the
+   least recently freed pages to the buddy allocator if it is
+   full. */
+static void pool_put_page(struct pool* pool, void* page) {
+  enum intr_level old_level = intr_disable();
+
+  ASSERT(bitmap_test(pool->used_map, pg_no(page) - pg_no(pool->base)));
+
+  if (pool->mag_cnt == MAG_SIZE) {
+    size_t i;
+    for (i = 0; i < MAG_BATCH; i++)
+      pool_free(pool, pg_no(pool->mag[i]) - pg_no(pool->base), 1);
+    memmove(pool->mag, pool->mag + MAG_BATCH, (MAG_SIZE - MAG_BATCH) * sizeof *pool->mag);
+    pool->mag_cnt -= MAG_BATCH;
+  }
+  pool->mag[pool->mag_cnt++] = page;
+  intr_set_level(old_level);
+}
+
+/* Charges the PAGE_CNT pages starting at PAGE_IDX in POOL, just
+   allocated, to TAG. */
+static void charge(struct pool* pool, size_t page_idx, size_t page_cnt, enum mem_tag tag) {
+  struct tag_usage* u = &pool->usage[tag];
+  enum intr_level old_level;
+
+  memset(pool->tags + page_idx, tag, page_cnt);
+
+  old_level = intr_disable();
+  u->pages += page_cnt;
+  if (u->pages > u->peak)
+    u->peak = u->pages;
+  pool->used_cnt += page_cnt;
+  if (pool->used_cnt > pool->peak_used)
+    pool->peak_used = pool->used_cnt;
+  intr_set_level(old_level);
+}
+
+/* Takes the PAGE_CNT pages starting at PAGE_IDX in POOL, about to
+   be freed, off the tags they were charged to. */
+static void uncharge(struct pool* pool, size_t page_idx, size_t page_cnt) {
+  enum intr_level old_level;
+  size_t i;
+
+  old_level = intr_disable();
+  for (i = 0; i < page_cnt; i++) {
+    struct tag_usage* u = &pool->usage[pool->tags[page_idx + i]];
+    ASSERT(u->pages > 0);
+    u->pages--;
+  }
+  pool->used_cnt -= page_cnt;
+  intr_set_level(old_level);
+}
@@ -1,19 +1,42 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include "threads/mem-tag.h"
 
 /* How to allocate pages. */
 enum palloc_flags {
   PAL_ASSERT = 001, /* Panic on failure. */
   PAL_ZERO = 002,   /* Zero page contents. */
-  PAL_USER = 004    /* User page. */
+  PAL_USER = 004,   /* User page. */
+  PAL_NOEVICT = 010 /* Fail rather than evict a user page. */
 };
 
 void palloc_init(size_t user_page_limit);
-void* palloc_get_page(enum palloc_flags);
-void* palloc_get_multiple(enum palloc_flags, size_t page_cnt);
+void* palloc_get_tagged(enum palloc_flags, size_t page_cnt, enum mem_tag);
+void* palloc_get_aligned_tagged(enum palloc_flags, size_t page_cnt, size_t align, enum mem_tag);
 void palloc_free_page(void*);
 void palloc_free_multiple(void*, size_t page_cnt);
+void palloc_free_pages(void* pages[], size_t cnt);
+size_t palloc_page_cnt(void*);
+bool palloc_resize(void*, size_t old_cnt, size_t new_cnt);
+void palloc_share_page(void*);
+size_t palloc_page_refs(void*);
+void* palloc_get_zero_page(void);
+bool palloc_is_zero_page(const void*);
+bool palloc_user_page_free(const void*);
+void palloc_user_free(size_t* free_cnt, size_t* largest);
+void palloc_user_drain(void);
+void palloc_user_pool(uint8_t** base, size_t* page_cnt);
+void palloc_zero_one(void);
+void palloc_print_stats(void);
+
+/* Allocate pages charged to the calling file's MEM_TAG. */
+#define palloc_get_page(FLAGS) palloc_get_tagged(FLAGS, 1, MEM_TAG)
+#define palloc_get_multiple(FLAGS, PAGE_CNT) palloc_get_tagged(FLAGS, PAGE_CNT, MEM_TAG)
+#define palloc_get_aligned(FLAGS, PAGE_CNT, ALIGN)                                              \
+  palloc_get_aligned_tagged(FLAGS, PAGE_CNT, ALIGN, MEM_TAG)
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,85 @@
+#ifndef THREADS_PERCPU_H
+#define THREADS_PERCPU_H
+
+#include <stdint.h>
+
+/* Per-CPU statistics counters.
+
+   A counter that code on every CPU bumps, such as the number of
+   page faults, would move its cache line from CPU to CPU on
+   every update, and the instrumentation would become a
+   bottleneck of its own.  A struct percpu_counter has one slot
+   per CPU instead, each on its own cache line.  A CPU only adds
+   to its own slot, and readers sum the slots.  Reading is slower
+   and may miss updates in flight, which suits statistics that
+   are printed or reported now and then.
+
+   percpu_counter_add() updates its slot with an add and an
+   add-with-carry on memory.  An interrupt handler that updates
+   the same slot in between does a complete update of its own,
+   and the carry still lands on top of it, so counters may be
+   bumped from interrupt context without a lock or disabling
+   interrupts.
+
+   The kernel runs on one CPU, so a counter is a single 64-bit
+   slot, without padding. */
+
+/* Number of CPUs the kernel supports. */
+#define CPU_CNT 1
+
+/* Bytes in a cache line. */
+#define CACHE_LINE_SIZE 64
+
+/* Returns the index of the running CPU, less than CPU_CNT. */
+static inline unsigned cpu_index(void) { return 0; }
+
+/* One CPU's share of a counter. */
+struct percpu_slot {
+  int64_t value; /* Sum of this CPU's updates. */
+#if CPU_CNT > 1
+  uint8_t pad[CACHE_LINE_SIZE - sizeof(int64_t)]; /* Keeps slots on separate lines. */
+#endif
+}
+#if CPU_CNT > 1
+__attribute__((aligned(CACHE_LINE_SIZE)))
+#endif
+;
+
+/* A statistics counter.  Zero-initialized storage is a counter
+   at 0. */
+struct percpu_counter {
+  struct percpu_slot slots[CPU_CNT];
+};
+
+/* Adds N to counter C. */
+static inline void percpu_counter_add(struct percpu_counter* c, int64_t n) {
+  uint32_t* w = (uint32_t*)&c->slots[cpu_index()].value;
+
+  asm("addl %2, %0\n\tadcl %3, %1"
+      : "+m"(w[0]), "+m"(w[1])
+      : "ri"((uint32_t)n), "ri"((uint32_t)((uint64_t)n >> 32))
+      : "cc");
+}
+
+/* Adds 1 to counter C. */
+static inline void percpu_counter_inc(struct percpu_counter* c) { percpu_counter_add(c, 1); }
+
+/* Returns the value of counter C, the sum of its slots. */
+static inline int64_t percpu_counter_sum(const struct percpu_counter* c) {
+  int64_t sum = 0;
+  unsigned i;
+
+  for (i = 0; i < CPU_CNT; i++)
+    sum += c->slots[i].value;
+  return sum;
+}
+
+/* Sets counter C to 0.  Updates in flight may survive. */
+static inline void percpu_counter_reset(struct percpu_counter* c) {
+  unsigned i;
+
+  for (i = 0; i < CPU_CNT; i++)
+    c->slots[i].value = 0;
+}
+
+#endif /* threads/percpu.h */
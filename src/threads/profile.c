@@ -0,0 +1,111 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* A sampling profiler, enabled by the -profile option.
+
+   On each timer tick, thread_tick() calls profile_sample() with
+   the interrupted code's frame, which records the interrupted
+   instruction, the running thread's tid and, for kernel code, the
+   return addresses of up to PROFILE_DEPTH callers, found by
+   following saved frame pointers up the thread's kernel stack.
+   User code gets no backtrace: its stack might not be mapped, and
+   an interrupt handler must not page fault.
+
+   Samples go into a ring of PROFILE_PAGES pages, which keeps the
+   most recent ones if it fills up.  At shutdown the samples are
+   printed, one per line, for `backtrace --profile' to turn into a
+   flat profile and a call graph. */
+
+/* Saved callers per sample. */
+#define PROFILE_DEPTH 6
+
+/* Pages for the sample ring. */
+#define PROFILE_PAGES 32
+
+/* One sample. */
+struct sample {
+  void* pcs[PROFILE_DEPTH + 1]; /* Interrupted code, then its callers. */
+  tid_t tid;                    /* Running thread. */
+  uint8_t depth;                /* Number of valid pcs. */
+  bool user;                    /* Interrupted user code? */
+};
+
+/* Sample ring, or null if not profiling. */
+static struct sample* samples;
+static size_t sample_cap;   /* Number of samples that fit. */
+static uint64_t sample_cnt; /* Samples taken. */
+static bool sampling;       /* Taking more samples? */
+
+/* Starts profiling. */
+void profile_init(void) {
+  samples = palloc_get_multiple(0, PROFILE_PAGES);
+  if (samples == NULL) {
+    printf("profile: not enough memory for samples, not profiling\n");
+    return;
+  }
+  sample_cap = PROFILE_PAGES * PGSIZE / sizeof *samples;
+  sampling = true;
+}
+
+/* Records a sample of the code interrupted with frame F.  Must be
+   called from the timer interrupt. */
+void profile_sample(struct intr_frame* f) {
+  struct thread* t;
+  struct sample* s;
+  void** frame;
+
+  if (!sampling)
+    return;
+
+  t = thread_current();
+  s = &samples[sample_cnt++ % sample_cap];
+  s->pcs[0] = (void*)f->eip;
+  s->tid = t->tid;
+  s->depth = 1;
+#ifdef USERPROG
+  s->user = is_trap_from_userspace(f);
+#else
+  s->user = false;
+#endif
+  if (s->user)
+    return;
+
+  /* Follow the frame pointers for as long as they stay inside the
+     thread's kernel stack and go up it. */
+  for (frame = (void**)f->ebp; s->depth <= PROFILE_DEPTH; frame = frame[0]) {
+    if ((uint8_t*)frame < (uint8_t*)(t + 1) || (uint8_t*)(frame + 2) > (uint8_t*)t + PGSIZE)
+      break;
+    s->pcs[s->depth++] = frame[1];
+    if ((void**)frame[0] <= frame)
+      break;
+  }
+}
+
+/* Stops profiling and prints the samples taken, oldest first. */
+void profile_print_stats(void) {
+  uint64_t first, i;
+
+  if (samples == NULL)
+    return;
+  sampling = false;
+
+  first = sample_cnt > sample_cap ? sample_cnt - sample_cap : 0;
+  printf("Profile: %llu samples at %d Hz, %llu oldest overwritten; "
+         "feed them to `backtrace --profile'\n",
+         sample_cnt, TIMER_FREQ, first);
+  for (i = first; i < sample_cnt; i++) {
+    struct sample* s = &samples[i % sample_cap];
+    int j;
+
+    printf("Profile: tid %d %s", s->tid, s->user ? "user" : "kernel");
+    for (j = 0; j < s->depth; j++)
+      printf(" %p", s->pcs[j]);
+    printf("\n");
+  }
+}
@@ -0,0 +1,10 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include "threads/interrupt.h"
+
+void profile_init(void);
+void profile_sample(struct intr_frame*);
+void profile_print_stats(void);
+
+#endif /* threads/profile.h */
@@ -47,7 +47,9 @@ static inline uintptr_t pd_no(const void* va) { return (uintptr_t)va >> PDSHIFT;
    |         Physical Address           |         Flags          |
    +------------------------------------+------------------------+
 
-   In a PDE, the physical address points to a page table.
+   In a PDE, the physical address points to a page table, unless
+   PTE_PS is set, in which case the PDE maps a 4 MB "large" page
+   by itself and the physical address must be 4 MB aligned.
    In a PTE, the physical address points to a data or code page.
    The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
@@ -61,7 +63,11 @@ static inline uintptr_t pd_no(const void* va) { return (uintptr_t)va >> PDSHIFT;
 #define PTE_W 0x2            /* 1=read/write, 0=read-only. */
 #define PTE_U 0x4            /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20           /* 1=accessed, 0=not acccessed. */
-#define PTE_D 0x40           /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_D 0x40           /* 1=dirty, 0=not dirty (PTEs and large PDEs). */
+#define PTE_PS 0x80          /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G 0x100          /* 1=global, kept in the TLB across CR3 loads. */
+#define PTE_COW 0x200        /* 1=copy-on-write (PTEs only, in PTE_AVL). */
+#define PTE_SHARED 0x400     /* 1=shared memory, never copy-on-write (PTEs only, in PTE_AVL). */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create(uint32_t* pt) {
@@ -73,9 +79,35 @@ static inline uint32_t pde_create(uint32_t* pt) {
    PDE, which must "present", points to. */
 static inline uint32_t* pde_get_pt(uint32_t pde) {
   ASSERT(pde & PTE_P);
+  ASSERT(!(pde & PTE_PS));
   return ptov(pde & PTE_ADDR);
 }
 
+/* Returns a PDE that maps the 4 MB of memory starting at PAGE,
+   which must be 4 MB aligned, as one large page.  Like
+   pte_create_kernel(), the memory is readable, writable if
+   WRITABLE is true, and usable only by ring 0 code.  Requires
+   CR4.PSE to be set. */
+static inline uint32_t pde_create_kernel_large(void* page, bool writable) {
+  ASSERT(((uintptr_t)page & (PTSPAN - 1)) == 0);
+  return vtop(page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
+/* Returns a PDE that maps the 4 MB of memory starting at PAGE,
+   which must be 4 MB aligned, as one large page that is
+   readable, writable if WRITABLE is true, and usable by both user
+   and kernel code.  Requires CR4.PSE to be set. */
+static inline uint32_t pde_create_user_large(void* page, bool writable) {
+  return pde_create_kernel_large(page, writable) | PTE_U;
+}
+
+/* Returns a pointer to the 4 MB of memory that large page PDE
+   maps. */
+static inline void* pde_get_large_page(uint32_t pde) {
+  ASSERT(pde & PTE_PS);
+  return ptov(pde & ~(uint32_t)(PTSPAN - 1));
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
@@ -0,0 +1,184 @@
+#include "threads/rcu.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Read-copy-update.
+
+   Some kernel tables, such as the thread table and the list of
+   block devices, are looked up far more often than they change.
+   A reader brackets its lookup with rcu_read_lock() and
+   rcu_read_unlock(), which only count a nesting depth in the
+   running thread: no lock, no interrupt toggling, no write to
+   shared memory.  Writers still exclude each other as before.  A
+   writer publishes a new object only once it is initialized,
+   with rcu_assign_pointer() or list_insert_rcu(), and may
+   unpublish an old one at any time, but must not free it while a
+   reader may still hold it.  It hands the object to call_rcu(),
+   which calls back after a grace period, or waits for one in
+   synchronize_rcu().
+
+   A grace period ends once every CPU has passed through a
+   quiescent state, a point outside any read-side section.
+   Read-side sections may not sleep, and preemption is held off
+   until the outermost rcu_read_unlock(), so every call to
+   schedule() is a quiescent state.  With one CPU, as here, a
+   thread that is outside a read-side section also knows that no
+   other thread is inside one, since each was switched away from
+   outside one.  So synchronize_rcu() only has to count a grace
+   period, and callbacks run from the "rcu" work queue, whose
+   worker is such a thread.  call_rcu() does not run them itself
+   because its caller may be a reader, may hold a lock the
+   callback wants, or may be an interrupt handler.
+
+   Interrupt handlers may read, since they run to completion on
+   top of the thread they interrupt, and may call call_rcu(). */
+
+/* Callbacks waiting for a grace period, oldest first.
+   Interrupts off. */
+static struct list pending = LIST_INITIALIZER(pending);
+
+/* Runs the pending callbacks. */
+static struct workqueue* rcu_wq;
+static struct work rcu_work;
+
+/* Statistics. */
+static long long gp_cnt;       /* Quiescent states counted. */
+static long long callback_cnt; /* Callbacks run. */
+static long long defer_cnt;    /* Preemptions held off until a section ended. */
+
+static work_func run_callbacks;
+
+/* Initializes RCU.  Work queues must have been initialized. */
+void rcu_init(void) {
+  rcu_wq = wq_create("rcu", PRI_DEFAULT, 1);
+  work_init(&rcu_work, run_callbacks, NULL);
+}
+
+/* Begins a read-side section.  Sections nest.  Until the
+   matching rcu_read_unlock(), objects found through RCU-published
+   pointers stay allocated, and the caller must not sleep. */
+void rcu_read_lock(void) {
+  thread_current()->rcu_depth++;
+  barrier();
+}
+
+/* Ends a read-side section.  Ending the outermost one yields, if
+   an interrupt asked to preempt the thread in the meantime and
+   interrupts are on. */
+void rcu_read_unlock(void) {
+  struct thread* cur = thread_current();
+
+  barrier();
+  ASSERT(cur->rcu_depth > 0);
+  if (--cur->rcu_depth == 0 && cur->rcu_yield && !intr_context() &&
+      intr_get_level() == INTR_ON) {
+    cur->rcu_yield = false;
+    thread_yield();
+  }
+}
+
+/* Returns true if the running thread is inside a read-side
+   section. */
+bool rcu_read_held(void) { return thread_current()->rcu_depth > 0; }
+
+/* Called by the interrupt handler before it preempts the running
+   thread.  Returns true, and has that thread yield at the end of
+   its outermost read-side section instead, if it is inside one. */
+bool rcu_defer_yield(void) {
+  struct thread* cur = thread_current();
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (cur->rcu_depth == 0)
+    return false;
+  cur->rcu_yield = true;
+  defer_cnt++;
+  return true;
+}
+
+/* Counts a quiescent state for CUR, which schedule() is about to
+   switch away from.  Interrupts must be off. */
+void rcu_quiescent(struct thread* cur) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(cur->rcu_depth == 0);
+
+  cur->rcu_yield = false;
+  gp_cnt++;
+}
+
+/* Arranges for FN to be called with HEAD once no reader can
+   still hold what the caller has just unpublished.  May be
+   called from a read-side section or from interrupt context. */
+void call_rcu(struct rcu_head* head, rcu_func* fn) {
+  enum intr_level old_level;
+
+  head->fn = fn;
+  old_level = intr_disable();
+  list_push_back(&pending, &head->elem);
+  intr_set_level(old_level);
+  wq_queue(rcu_wq, &rcu_work);
+}
+
+/* Waits until no reader can still hold what the caller has just
+   unpublished.  The caller must not be a reader. */
+void synchronize_rcu(void) {
+  enum intr_level old_level;
+
+  ASSERT(!intr_context());
+  ASSERT(!rcu_read_held());
+
+  old_level = intr_disable();
+  gp_cnt++;
+  intr_set_level(old_level);
+}
+
+/* Work function that calls every pending callback.  The worker
+   is outside any read-side section, so a grace period has passed
+   for each of them. */
+static void run_callbacks(void* aux UNUSED) {
+  struct list ready;
+  enum intr_level old_level;
+
+  ASSERT(!rcu_read_held());
+
+  list_init(&ready);
+  old_level = intr_disable();
+  if (!list_empty(&pending))
+    list_splice(list_end(&ready), list_begin(&pending), list_end(&pending));
+  gp_cnt++;
+  intr_set_level(old_level);
+
+  while (!list_empty(&ready)) {
+    struct rcu_head* head = list_entry(list_pop_front(&ready), struct rcu_head, elem);
+    callback_cnt++;
+    head->fn(head);
+  }
+}
+
+/* Inserts ELEM just before BEFORE, which may be an interior
+   element or a tail, so that a reader walking forward sees
+   either the old list or the new one with ELEM complete.  ELEM
+   must be initialized first.  Writers must exclude each other. */
+void list_insert_rcu(struct list_elem* before, struct list_elem* elem) {
+  elem->prev = before->prev;
+  elem->next = before;
+  barrier();
+  before->prev->next = elem;
+  before->prev = elem;
+}
+
+/* Inserts ELEM at the end of LIST as list_insert_rcu() does.
+   list_remove() already leaves a removed element's forward link
+   intact for readers that stand on it. */
+void list_push_back_rcu(struct list* list, struct list_elem* elem) {
+  list_insert_rcu(list_end(list), elem);
+}
+
+/* Prints RCU statistics. */
+void rcu_print_stats(void) {
+  printf("RCU: %lld quiescent states, %lld callbacks, %lld preemptions deferred\n", gp_cnt,
+         callback_cnt, defer_cnt);
+}
@@ -0,0 +1,47 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <list.h>
+#include <stdbool.h>
+#include "threads/synch.h"
+
+struct rcu_head;
+struct thread;
+
+/* Frees or otherwise finishes off the object HEAD is embedded
+   in, once no reader can see it any more. */
+typedef void rcu_func(struct rcu_head* head);
+
+/* Deferred work for an object that has been unpublished, usually
+   embedded in that object.  Owned by rcu.c from call_rcu() until
+   its function is called. */
+struct rcu_head {
+  struct list_elem elem; /* Element in the pending list. */
+  rcu_func* fn;          /* Function to call. */
+};
+
+/* Publishes V through the pointer P: everything written to *V
+   beforehand becomes visible to readers no later than V itself. */
+#define rcu_assign_pointer(P, V)                                                                   \
+  do {                                                                                             \
+    barrier();                                                                                     \
+    (P) = (V);                                                                                     \
+  } while (0)
+
+/* Reads the published pointer P inside a read-side section. */
+#define rcu_dereference(P) (*(__typeof__(P) volatile*)&(P))
+
+void rcu_init(void);
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+bool rcu_read_held(void);
+bool rcu_defer_yield(void);
+void rcu_quiescent(struct thread*);
+void call_rcu(struct rcu_head*, rcu_func*);
+void synchronize_rcu(void);
+void rcu_print_stats(void);
+
+void list_insert_rcu(struct list_elem* before, struct list_elem*);
+void list_push_back_rcu(struct list*, struct list_elem*);
+
+#endif /* threads/rcu.h */
@@ -0,0 +1,221 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A slab allocator for objects of one type.
+
+   malloc() rounds every request up to a power of 2, which wastes
+   up to half of each block for structures whose size falls just
+   past one, and it serializes every request of a size class on
+   one lock.  An object cache instead carves pages, called slabs,
+   into objects of exactly its own size (rounded up only for
+   alignment), and has a lock of its own.
+
+   Each slab keeps a stack of its free objects, and the cache
+   keeps a list of the slabs that have any.  Allocation takes the
+   top object of the first such slab; freeing pushes the object
+   back onto its slab, found by rounding its address down to a
+   page.  A slab whose objects are all free goes back to the page
+   allocator, unless it is the cache's only slab with free
+   objects, which is kept to avoid allocating and freeing a page
+   for an object that comes and goes.
+
+   A cache may have a constructor.  It runs once for each object
+   when its slab is created, not on every allocation, so objects
+   must be freed in their constructed state.  Such objects keep
+   their free-stack link after the object rather than in it. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51abcafe
+
+/* An object cache. */
+struct kmem_cache {
+  const char* name;      /* Name, for statistics. */
+  size_t size;           /* Size of an object as requested. */
+  size_t stride;         /* Bytes between objects in a slab. */
+  size_t link_ofs;       /* Offset of free-stack link in an object. */
+  size_t per_slab;       /* Objects in a slab. */
+  kmem_ctor* ctor;       /* Constructor, or null. */
+  struct lock lock;      /* Protects the members below. */
+  struct list partial;   /* Slabs with free objects. */
+  size_t slab_cnt;       /* Slabs. */
+  size_t in_use;         /* Objects allocated. */
+  size_t peak;           /* Most objects ever allocated at once. */
+  struct list_elem elem; /* Element in all_caches. */
+};
+
+/* Slab header, at the start of its page. */
+struct slab {
+  unsigned magic;           /* Always set to SLAB_MAGIC. */
+  struct kmem_cache* cache; /* Owning cache. */
+  struct list_elem elem;    /* Element in cache's partial list. */
+  uint8_t* free;            /* Top of free-object stack, or null. */
+  size_t in_use;            /* Objects allocated. */
+};
+
+/* Offset of the first object in a slab. */
+#define SLAB_OBJS ROUND_UP(sizeof(struct slab), sizeof(void*))
+
+/* Every cache, for statistics.  Caches are created while the
+   kernel initializes and never destroyed, so this needs no
+   lock. */
+static struct list all_caches = LIST_INITIALIZER(all_caches);
+
+static struct slab* obj_to_slab(struct kmem_cache*, void*);
+static uint8_t** obj_link(struct kmem_cache*, void*);
+
+/* Creates and returns an object cache named NAME for objects of
+   SIZE bytes, which must be well under a page.  If CTOR is
+   nonnull, it initializes each object once when its slab is
+   created.  Panics if memory is not available, since caches are
+   created while the kernel initializes. */
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, kmem_ctor* ctor) {
+  struct kmem_cache* c;
+
+  ASSERT(size > 0);
+
+  c = malloc(sizeof *c);
+  if (c == NULL)
+    PANIC("kmem_cache_create: out of memory for %s cache", name);
+
+  c->name = name;
+  c->size = size;
+  c->ctor = ctor;
+  if (ctor != NULL) {
+    c->link_ofs = ROUND_UP(size, sizeof(void*));
+    c->stride = c->link_ofs + sizeof(void*);
+  } else {
+    c->link_ofs = 0;
+    c->stride = ROUND_UP(size, sizeof(void*));
+  }
+  c->per_slab = (PGSIZE - SLAB_OBJS) / c->stride;
+  ASSERT(c->per_slab >= 2);
+  lock_init_named(&c->lock, "slab");
+  list_init(&c->partial);
+  c->slab_cnt = c->in_use = c->peak = 0;
+  list_push_back(&all_caches, &c->elem);
+
+  return c;
+}
+
+/* Adds a new slab to cache C, which must be locked, and returns
+   it, or returns a null pointer if memory is not available. */
+static struct slab* new_slab(struct kmem_cache* c) {
+  struct slab* s = palloc_get_tagged(0, 1, MEM_SLAB);
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free = NULL;
+  s->in_use = 0;
+  for (i = c->per_slab; i-- > 0;) {
+    uint8_t* obj = (uint8_t*)s + SLAB_OBJS + i * c->stride;
+    if (c->ctor != NULL)
+      c->ctor(obj);
+    *obj_link(c, obj) = s->free;
+    s->free = obj;
+  }
+  list_push_front(&c->partial, &s->elem);
+  c->slab_cnt++;
+  return s;
+}
+
+/* Obtains and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void* kmem_cache_alloc(struct kmem_cache* c) {
+  struct slab* s;
+  uint8_t* obj;
+
+  lock_acquire(&c->lock);
+  if (list_empty(&c->partial) && new_slab(c) == NULL) {
+    lock_release(&c->lock);
+    return NULL;
+  }
+
+  s = list_entry(list_front(&c->partial), struct slab, elem);
+  obj = s->free;
+  s->free = *obj_link(c, obj);
+  if (s->free == NULL)
+    list_remove(&s->elem);
+  s->in_use++;
+  if (++c->in_use > c->peak)
+    c->peak = c->in_use;
+  lock_release(&c->lock);
+
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from cache C, to C.
+   A null OBJ is ignored. */
+void kmem_cache_free(struct kmem_cache* c, void* obj) {
+  struct slab* s;
+
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab(c, obj);
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     it must stay constructed. */
+  if (c->ctor == NULL)
+    memset(obj, 0xcc, c->size);
+#endif
+
+  lock_acquire(&c->lock);
+  if (s->free == NULL)
+    list_push_front(&c->partial, &s->elem);
+  *obj_link(c, obj) = s->free;
+  s->free = obj;
+  s->in_use--;
+  c->in_use--;
+
+  /* Give back an entirely free slab, unless it's the only one
+     left with room. */
+  if (s->in_use == 0 && list_begin(&c->partial) != list_rbegin(&c->partial)) {
+    list_remove(&s->elem);
+    c->slab_cnt--;
+    palloc_free_page(s);
+  }
+  lock_release(&c->lock);
+}
+
+/* Prints how many objects and slabs each cache uses. */
+void kmem_print_stats(void) {
+  struct list_elem* e;
+
+  for (e = list_begin(&all_caches); e != list_end(&all_caches); e = list_next(e)) {
+    struct kmem_cache* c = list_entry(e, struct kmem_cache, elem);
+    printf("Slab: %s: %zu objects of %zu bytes in use (peak %zu), %zu slabs of %zu\n", c->name,
+           c->in_use, c->size, c->peak, c->slab_cnt, c->per_slab);
+  }
+}
+
+/* Returns the slab that OBJ, from cache C, is inside. */
+static struct slab* obj_to_slab(struct kmem_cache* c, void* obj) {
+  struct slab* s = pg_round_down(obj);
+
+  /* Check that the slab is valid and belongs to C. */
+  ASSERT(s->magic == SLAB_MAGIC);
+  ASSERT(s->cache == c);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT((pg_ofs(obj) - SLAB_OBJS) % c->stride == 0);
+
+  return s;
+}
+
+/* Returns the location of OBJ's free-stack link in cache C. */
+static uint8_t** obj_link(struct kmem_cache* c, void* obj) {
+  return (uint8_t**)((uint8_t*)obj + c->link_ofs);
+}
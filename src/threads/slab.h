@@ -0,0 +1,15 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Object constructor: puts a newly carved object into the state
+   that kmem_cache_alloc() hands out. */
+typedef void kmem_ctor(void* obj);
+
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, kmem_ctor*);
+void* kmem_cache_alloc(struct kmem_cache*) __attribute__((malloc));
+void kmem_cache_free(struct kmem_cache*, void*);
+void kmem_print_stats(void);
+
+#endif /* threads/slab.h */
@@ -0,0 +1,254 @@
+#include "threads/spinlock.h"
+#include <debug.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Spinlocks.
+
+   A struct lock puts its waiters to sleep, which costs two thread
+   switches and cannot be done in an interrupt handler.  For
+   critical sections of a few instructions, such as a free list or
+   a hash bucket, a spinlock is cheaper: a waiter busy-waits until
+   the holder is done.  Two kinds are provided.  struct spinlock
+   is a ticket lock, two counters that serve waiters in arrival
+   order.  struct mcs_lock queues its waiters, each spinning on a
+   struct mcs_node of its own instead of on the shared lock, which
+   matters once many CPUs contend.
+
+   A spinlock is only held with interrupts off, so that neither an
+   interrupt handler that wants it nor a preempting thread can run
+   on the holder's CPU and spin forever.  spin_lock() and
+   mcs_acquire() require the caller to have turned interrupts off
+   already; spin_lock_irqsave() and mcs_acquire_irqsave() do it
+   for the caller and return the old level to restore.
+
+   With one CPU, as here, interrupts off already excludes
+   everything else, so a spinlock never actually spins and costs
+   little more than intr_disable().  Code that uses one says what
+   it protects in a way that keeps working with more CPUs.
+
+   The scheduler takes spinlocks while it switches away from a
+   thread that is no longer THREAD_RUNNING, so a lock's holder is
+   the running_thread(), not the thread_current() that insists on
+   that state.
+
+   Each lock is checked as it is used: acquiring one that the
+   running thread holds, releasing one that it does not, spinning
+   implausibly long, and sleeping while holding any, all panic.
+   With -lockstat, a lock's acquisitions, waits and hold times are
+   counted under its name, along with the named struct locks, in
+   lock_print_stats(). */
+
+/* Spins after which a waiter gives up and panics, since the lock
+   cannot be coming free. */
+#define SPIN_PATIENCE (1u << 30)
+
+/* Spinlocks held on this CPU, for spin_any_held(). */
+static int held_cnt;
+
+/* Tells the CPU that this is a busy-wait loop. */
+static inline void cpu_relax(void) { asm volatile("pause" : : : "memory"); }
+
+/* Checks that the running thread may acquire the spinlock NAME,
+   held by HOLDER. */
+static void check_acquire(const char* name, struct thread* holder) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (holder == running_thread())
+    PANIC("spinlock %s acquired again by its holder", name);
+}
+
+/* Counts one more spin on the lock NAME, which has been spun on
+   SPINS times before, and panics if it has gone on too long. */
+static void check_spin(const char* name, unsigned spins) {
+  if (spins >= SPIN_PATIENCE)
+    PANIC("spinlock %s: deadlock", name);
+  cpu_relax();
+}
+
+/* Records that the running thread acquired a lock with statistics
+   STAT, after spinning since START if CONTENDED, and stores the
+   time into *ACQUIRED. */
+static void note_acquired(struct lock_stat* stat, uint64_t* acquired, bool contended,
+                          uint64_t start) {
+  held_cnt++;
+  if (stat != NULL) {
+    uint64_t now = rdtsc();
+    stat->acquisitions++;
+    if (contended) {
+      uint64_t wait = now - start;
+      stat->contended++;
+      stat->wait_cycles += wait;
+      if (wait > stat->max_wait)
+        stat->max_wait = wait;
+    }
+    *acquired = now;
+  }
+}
+
+/* Records that the running thread is releasing a lock with
+   statistics STAT, acquired at time ACQUIRED. */
+static void note_released(struct lock_stat* stat, uint64_t acquired) {
+  ASSERT(held_cnt > 0);
+  held_cnt--;
+  if (stat != NULL)
+    stat->hold_cycles += rdtsc() - acquired;
+}
+
+/* Initializes L as a free ticket spinlock named NAME, which must
+   stay valid forever. */
+void spin_init(struct spinlock* l, const char* name) {
+  ASSERT(l != NULL);
+  ASSERT(name != NULL);
+
+  l->next = 0;
+  l->owner = 0;
+  l->holder = NULL;
+  l->name = name;
+  l->stat = lockstat_enabled ? lock_stat_for(name) : NULL;
+  l->acquired = 0;
+}
+
+/* Acquires L, spinning until it is free.  Interrupts must be
+   off, and stay off until spin_unlock(). */
+void spin_lock(struct spinlock* l) {
+  unsigned ticket, spins = 0;
+  uint64_t start = 0;
+
+  check_acquire(l->name, l->holder);
+  ticket = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+  while (__atomic_load_n(&l->owner, __ATOMIC_ACQUIRE) != ticket) {
+    if (spins == 0)
+      start = rdtsc();
+    check_spin(l->name, spins++);
+  }
+  l->holder = running_thread();
+  note_acquired(l->stat, &l->acquired, spins > 0, start);
+}
+
+/* Acquires L if it is free and returns true, or returns false
+   without waiting.  Interrupts must be off. */
+bool spin_trylock(struct spinlock* l) {
+  unsigned owner;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  owner = __atomic_load_n(&l->owner, __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&l->next, &owner, owner + 1, false, __ATOMIC_ACQUIRE,
+                                   __ATOMIC_RELAXED))
+    return false;
+  l->holder = running_thread();
+  note_acquired(l->stat, &l->acquired, false, 0);
+  return true;
+}
+
+/* Releases L, which the running thread must hold, and serves the
+   next waiter. */
+void spin_unlock(struct spinlock* l) {
+  ASSERT(spin_held(l));
+
+  note_released(l->stat, l->acquired);
+  l->holder = NULL;
+  __atomic_store_n(&l->owner, l->owner + 1, __ATOMIC_RELEASE);
+}
+
+/* Returns true if the running thread holds L. */
+bool spin_held(const struct spinlock* l) { return l->holder == running_thread(); }
+
+/* Turns interrupts off, acquires L, and returns the previous
+   interrupt level, to be passed to spin_unlock_irqrestore(). */
+enum intr_level spin_lock_irqsave(struct spinlock* l) {
+  enum intr_level old_level = intr_disable();
+  spin_lock(l);
+  return old_level;
+}
+
+/* Releases L and sets the interrupt level to OLD_LEVEL, as
+   returned by spin_lock_irqsave(). */
+void spin_unlock_irqrestore(struct spinlock* l, enum intr_level old_level) {
+  spin_unlock(l);
+  intr_set_level(old_level);
+}
+
+/* Initializes L as a free MCS lock named NAME, which must stay
+   valid forever. */
+void mcs_init(struct mcs_lock* l, const char* name) {
+  ASSERT(l != NULL);
+  ASSERT(name != NULL);
+
+  l->tail = NULL;
+  l->holder = NULL;
+  l->name = name;
+  l->stat = lockstat_enabled ? lock_stat_for(name) : NULL;
+  l->acquired = 0;
+}
+
+/* Acquires L, queuing NODE and spinning on it until L is free.
+   NODE must stay valid until mcs_release(L, NODE).  Interrupts
+   must be off, and stay off until then. */
+void mcs_acquire(struct mcs_lock* l, struct mcs_node* node) {
+  struct mcs_node* prev;
+  unsigned spins = 0;
+  uint64_t start = 0;
+
+  check_acquire(l->name, l->holder);
+  node->next = NULL;
+  node->locked = true;
+  prev = __atomic_exchange_n(&l->tail, node, __ATOMIC_ACQ_REL);
+  if (prev != NULL) {
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+    start = rdtsc();
+    while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+      check_spin(l->name, spins++);
+  }
+  l->holder = running_thread();
+  note_acquired(l->stat, &l->acquired, prev != NULL, start);
+}
+
+/* Releases L, which the running thread must hold through NODE,
+   and hands it to the next waiter, if any. */
+void mcs_release(struct mcs_lock* l, struct mcs_node* node) {
+  struct mcs_node* next;
+  unsigned spins = 0;
+
+  ASSERT(mcs_held(l));
+
+  note_released(l->stat, l->acquired);
+  l->holder = NULL;
+  next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+  if (next == NULL) {
+    struct mcs_node* expected = node;
+    if (__atomic_compare_exchange_n(&l->tail, &expected, NULL, false, __ATOMIC_RELEASE,
+                                    __ATOMIC_RELAXED))
+      return;
+
+    /* A waiter has swapped itself in but not yet linked up. */
+    while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == NULL)
+      check_spin(l->name, spins++);
+  }
+  __atomic_store_n(&next->locked, false, __ATOMIC_RELEASE);
+}
+
+/* Returns true if the running thread holds L. */
+bool mcs_held(const struct mcs_lock* l) { return l->holder == running_thread(); }
+
+/* Turns interrupts off, acquires L through NODE, and returns the
+   previous interrupt level, to be passed to
+   mcs_release_irqrestore(). */
+enum intr_level mcs_acquire_irqsave(struct mcs_lock* l, struct mcs_node* node) {
+  enum intr_level old_level = intr_disable();
+  mcs_acquire(l, node);
+  return old_level;
+}
+
+/* Releases L, held through NODE, and sets the interrupt level to
+   OLD_LEVEL, as returned by mcs_acquire_irqsave(). */
+void mcs_release_irqrestore(struct mcs_lock* l, struct mcs_node* node,
+                            enum intr_level old_level) {
+  mcs_release(l, node);
+  intr_set_level(old_level);
+}
+
+/* Returns true if any spinlock is held on this CPU, in which case
+   the running thread must not sleep. */
+bool spin_any_held(void) { return held_cnt > 0; }
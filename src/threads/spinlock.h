@@ -0,0 +1,58 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+struct lock_stat;
+struct thread;
+
+/* Ticket spinlock.  Waiters are served in the order they
+   arrived. */
+struct spinlock {
+  unsigned next;          /* Next ticket to hand out. */
+  unsigned owner;         /* Ticket being served. */
+  struct thread* holder;  /* Thread holding the lock, for debugging. */
+  const char* name;       /* Name, for debugging. */
+  struct lock_stat* stat; /* Statistics, or null without -lockstat. */
+  uint64_t acquired;      /* Time-stamp counter when acquired, if STAT. */
+};
+
+void spin_init(struct spinlock*, const char* name);
+void spin_lock(struct spinlock*);
+bool spin_trylock(struct spinlock*);
+void spin_unlock(struct spinlock*);
+bool spin_held(const struct spinlock*);
+enum intr_level spin_lock_irqsave(struct spinlock*);
+void spin_unlock_irqrestore(struct spinlock*, enum intr_level);
+
+/* A waiter for an MCS lock, usually in its caller's stack frame.
+   Each waiter spins on its own node, so a release touches only
+   the next waiter's cache line. */
+struct mcs_node {
+  struct mcs_node* next; /* Next waiter, or null. */
+  bool locked;           /* Still waiting for the lock? */
+};
+
+/* MCS spinlock: a queue of waiters, each spinning on its own
+   struct mcs_node.  Served in arrival order, like struct
+   spinlock, but scales to many waiters. */
+struct mcs_lock {
+  struct mcs_node* tail;  /* Last waiter, or null if free. */
+  struct thread* holder;  /* Thread holding the lock, for debugging. */
+  const char* name;       /* Name, for debugging. */
+  struct lock_stat* stat; /* Statistics, or null without -lockstat. */
+  uint64_t acquired;      /* Time-stamp counter when acquired, if STAT. */
+};
+
+void mcs_init(struct mcs_lock*, const char* name);
+void mcs_acquire(struct mcs_lock*, struct mcs_node*);
+void mcs_release(struct mcs_lock*, struct mcs_node*);
+bool mcs_held(const struct mcs_lock*);
+enum intr_level mcs_acquire_irqsave(struct mcs_lock*, struct mcs_node*);
+void mcs_release_irqrestore(struct mcs_lock*, struct mcs_node*, enum intr_level);
+
+bool spin_any_held(void);
+
+#endif /* threads/spinlock.h */
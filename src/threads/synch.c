@@ -26,12 +26,115 @@
    MODIFICATIONS.
 */
 
-#include "threads/malloc.h"
 #include "threads/synch.h"
 #include <stdio.h>
+#include <string.h>
 #include "list.h"
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
+
+static bool wait_queue_elem_less(const struct rb_elem* a_, const struct rb_elem* b_,
+                                 void* aux UNUSED);
+
+/* Initializes wait queue Q as empty. */
+void wait_queue_init(struct wait_queue* q) {
+  ASSERT(q != NULL);
+
+  rb_init(&q->waiters, wait_queue_elem_less, NULL);
+}
+
+/* Returns true if no thread is waiting in Q. */
+bool wait_queue_empty(const struct wait_queue* q) { return rb_empty(&q->waiters); }
+
+/* Returns the sort key to use for thread T under the active
+   scheduling policy. */
+static int wait_queue_priority(struct thread* t) {
+  if (active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS)
+    return thread_get_priority_of(t);
+  return PRI_MIN;
+}
+
+/* Orders wait queue elements by descending priority.  The tree
+   keeps equal elements in insertion order. */
+static bool wait_queue_elem_less(const struct rb_elem* a_, const struct rb_elem* b_,
+                                 void* aux UNUSED) {
+  const struct wait_queue_elem* a = rb_entry(a_, struct wait_queue_elem, elem);
+  const struct wait_queue_elem* b = rb_entry(b_, struct wait_queue_elem, elem);
+
+  return a->priority > b->priority;
+}
+
+/* Adds T to the back of Q's waiters of its priority, using E as
+   its entry.
+
+   A thread's position matters in at most one queue at a time.
+   If T is already in one (cond_wait() queues T on the condition
+   variable, then on a private semaphore that only T waits on),
+   only the first is reordered when T's priority changes. */
+void wait_queue_push(struct wait_queue* q, struct wait_queue_elem* e, struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(q != NULL && e != NULL && t != NULL);
+
+  e->thread = t;
+  e->queue = q;
+  e->priority = wait_queue_priority(t);
+  rb_insert(&q->waiters, &e->elem);
+  if (t->wait_elem == NULL)
+    t->wait_elem = e;
+}
+
+/* Removes and returns the waiter in Q that should be woken
+   first.  Q must not be empty. */
+struct wait_queue_elem* wait_queue_pop(struct wait_queue* q) {
+  struct wait_queue_elem* e = wait_queue_front(q);
+
+  ASSERT(e != NULL);
+  wait_queue_remove(e);
+  return e;
+}
+
+/* Removes E from the wait queue it is in. */
+void wait_queue_remove(struct wait_queue_elem* e) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(e->queue != NULL);
+
+  rb_remove(&e->queue->waiters, &e->elem);
+  e->queue = NULL;
+  if (e->thread->wait_elem == e)
+    e->thread->wait_elem = NULL;
+}
+
+/* Moves E to the position matching its thread's current
+   priority, if that has changed. */
+void wait_queue_update(struct wait_queue_elem* e) {
+  int priority = wait_queue_priority(e->thread);
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(e->queue != NULL);
+
+  if (priority == e->priority)
+    return;
+  rb_remove(&e->queue->waiters, &e->elem);
+  e->priority = priority;
+  rb_insert(&e->queue->waiters, &e->elem);
+}
+
+/* Returns the waiter in Q that should be woken first, or a null
+   pointer if Q is empty. */
+struct wait_queue_elem* wait_queue_front(struct wait_queue* q) {
+  struct rb_elem* e = rb_min(&q->waiters);
+  return e != NULL ? rb_entry(e, struct wait_queue_elem, elem) : NULL;
+}
+
+/* Returns the waiter that would be woken after E, or a null
+   pointer if E is the last. */
+struct wait_queue_elem* wait_queue_next(struct wait_queue_elem* e) {
+  struct rb_elem* next = rb_next(&e->elem);
+  return next != NULL ? rb_entry(next, struct wait_queue_elem, elem) : NULL;
+}
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -46,7 +149,52 @@ void sema_init(struct semaphore* sema, unsigned value) {
   ASSERT(sema != NULL);
 
   sema->value = value;
-  list_init(&sema->waiters);
+  wait_queue_init(&sema->waiters);
+  sema->owner = TID_ERROR;
+}
+
+/* Makes T, waiting on SEMA, donate its priority to SEMA's owner,
+   if it has one that is alive.  Interrupts must be off. */
+static void sema_donate(struct semaphore* sema, struct thread* t) {
+  struct thread* owner;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (active_sched_policy != SCHED_PRIO || sema->owner == TID_ERROR)
+    return;
+  owner = thread_get_by_tid(sema->owner);
+  if (owner != NULL && owner != t && t->donating_to == NULL)
+    thread_donate_priority(t, owner, sema);
+}
+
+/* Withdraws the donation T made while waiting on SEMA, if any.
+   Interrupts must be off. */
+static void sema_revoke(struct semaphore* sema, struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (t->donating_to != NULL && t->donation.resource == sema)
+    thread_revoke_made_donations(t);
+}
+
+/* Names the thread whose tid is OWNER, or none if OWNER is
+   TID_ERROR, as the one that will up SEMA.  Under SCHED_PRIO,
+   threads waiting on SEMA donate their priority to it, now and
+   when they start waiting, until they are woken.  OWNER must up
+   SEMA before it exits, or threads still waiting then stop
+   donating to anyone. */
+void sema_set_owner(struct semaphore* sema, int owner) {
+  struct wait_queue_elem* e;
+  enum intr_level old_level;
+
+  ASSERT(sema != NULL);
+
+  old_level = intr_disable();
+  sema->owner = owner;
+  for (e = wait_queue_front(&sema->waiters); e != NULL; e = wait_queue_next(e)) {
+    sema_revoke(sema, e->thread);
+    sema_donate(sema, e->thread);
+  }
+  intr_set_level(old_level);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -64,7 +212,9 @@ void sema_down(struct semaphore* sema) {
 
   old_level = intr_disable();
   while (sema->value == 0) {
-    list_push_back(&sema->waiters, &thread_current()->elem);
+    struct wait_queue_elem waiter;
+    wait_queue_push(&sema->waiters, &waiter, thread_current());
+    sema_donate(sema, thread_current());
     thread_block();
   }
   sema->value--;
@@ -103,23 +253,21 @@ void sema_up(struct semaphore* sema) {
   ASSERT(sema != NULL);
 
   int max_waiter_prio = PRI_MIN;
+  bool deadline_preempts = false;
 
   old_level = intr_disable();
-  if (!list_empty(&sema->waiters)) {
-    if (active_sched_policy == SCHED_PRIO) {
-      struct list_elem* to_unblock = list_max(&sema->waiters, thread_priority_less, NULL);
-      list_remove(to_unblock);
-      struct thread* thread_to_unblock = list_entry(to_unblock, struct thread, elem);
-      thread_unblock(thread_to_unblock);
+  if (!wait_queue_empty(&sema->waiters)) {
+    struct thread* thread_to_unblock = wait_queue_pop(&sema->waiters)->thread;
+    sema_revoke(sema, thread_to_unblock);
+    thread_unblock(thread_to_unblock);
+    if (active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS)
       max_waiter_prio = thread_get_priority_of(thread_to_unblock);
-    } else {
-      thread_unblock(list_entry(list_pop_front(&sema->waiters), struct thread, elem));
-    }
+    deadline_preempts = thread_deadline_preempts(thread_to_unblock);
   }
   sema->value++;
   intr_set_level(old_level);
 
-  if (max_waiter_prio > thread_get_priority_of(thread_current())) {
+  if (deadline_preempts || max_waiter_prio > thread_get_priority_of(thread_current())) {
     if (intr_context()) {
       intr_yield_on_return();
     } else {
@@ -164,21 +312,221 @@ static void sema_test_helper(void* sema_) {
    is, it is an error for the thread currently holding a lock to
    try to acquire that lock.
 
-   A lock is a specialization of a semaphore with an initial
-   value of 1.  The difference between a lock and such a
-   semaphore is twofold.  First, a semaphore can have a value
-   greater than 1, but a lock can only be owned by a single
-   thread at a time.  Second, a semaphore does not have an owner,
-   meaning that one thread can "down" the semaphore and then
-   another one "up" it, but with a lock the same thread must both
-   acquire and release it.  When these restrictions prove
-   onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   A lock is like a semaphore with an initial value of 1.  The
+   difference between a lock and such a semaphore is twofold.
+   First, a semaphore can have a value greater than 1, but a lock
+   can only be owned by a single thread at a time.  Second, a
+   semaphore does not have an owner, meaning that one thread can
+   "down" the semaphore and then another one "up" it, but with a
+   lock the same thread must both acquire and release it.  When
+   these restrictions prove onerous, it's a good sign that a
+   semaphore should be used, instead of a lock.
+
+   The lock is free when its holder is null.  A thread acquires a
+   free lock by swapping itself in as holder with one atomic
+   compare-and-exchange, without disabling interrupts or looking
+   at the waiters.  Only a thread that finds the lock held goes
+   on to lock_acquire_contended(), which spins for a while if the
+   holder is running on another CPU, since it is then likely to
+   release the lock soon, and otherwise donates its priority and
+   sleeps in WAITERS. */
 void lock_init(struct lock* lock) {
   ASSERT(lock != NULL);
 
   lock->holder = NULL;
-  sema_init(&lock->semaphore, 1);
+  wait_queue_init(&lock->waiters);
+  lock->stat = NULL;
+  lock->acquired = 0;
+}
+
+/* Lock statistics.
+
+   With the -lockstat option, every lock initialized with
+   lock_init_named() counts its acquisitions, how many of them had
+   to wait, how long they waited and how long the lock was held,
+   in a struct lock_stat shared by all the locks of that name, so
+   that, say, every process's children_lock adds up to one line of
+   lock_print_stats().  Without it, named locks are like any
+   other. */
+
+/* Distinct lock names with statistics. */
+#define LOCK_STAT_CNT 64
+
+/* Collect statistics for named locks? */
+bool lockstat_enabled;
+
+static struct lock_stat lock_stats[LOCK_STAT_CNT];
+static size_t lock_stat_cnt;
+
+/* Returns the statistics for locks named NAME, creating them if
+   there are none yet, or a null pointer if there is no room for
+   more names. */
+struct lock_stat* lock_stat_for(const char* name) {
+  struct lock_stat* s;
+  enum intr_level old_level;
+
+  old_level = intr_disable();
+  for (s = lock_stats; s < lock_stats + lock_stat_cnt; s++)
+    if (!strcmp(s->name, name))
+      break;
+  if (s == lock_stats + lock_stat_cnt) {
+    if (lock_stat_cnt < LOCK_STAT_CNT) {
+      lock_stat_cnt++;
+      s->name = name;
+    } else
+      s = NULL;
+  }
+  intr_set_level(old_level);
+  return s;
+}
+
+/* Initializes LOCK like lock_init(), naming it NAME for
+   statistics.  NAME must stay valid forever. */
+void lock_init_named(struct lock* lock, const char* name) {
+  ASSERT(name != NULL);
+
+  lock_init(lock);
+  if (lockstat_enabled)
+    lock->stat = lock_stat_for(name);
+}
+
+/* Records that the current thread acquired LOCK, a named lock,
+   after waiting since START if CONTENDED. */
+static void lock_stat_acquired(struct lock* lock, bool contended, uint64_t start) {
+  struct lock_stat* s = lock->stat;
+  uint64_t now = rdtsc();
+  enum intr_level old_level;
+
+  old_level = intr_disable();
+  s->acquisitions++;
+  if (contended) {
+    uint64_t wait = now - start;
+    s->contended++;
+    s->wait_cycles += wait;
+    if (wait > s->max_wait)
+      s->max_wait = wait;
+  }
+  intr_set_level(old_level);
+  lock->acquired = now;
+}
+
+/* Records that the current thread is releasing LOCK, a named
+   lock. */
+static void lock_stat_released(struct lock* lock) {
+  uint64_t held = rdtsc() - lock->acquired;
+  enum intr_level old_level;
+
+  old_level = intr_disable();
+  lock->stat->hold_cycles += held;
+  intr_set_level(old_level);
+}
+
+/* Prints the statistics of named locks, those whose threads
+   waited longest in total first. */
+void lock_print_stats(void) {
+  struct lock_stat* sorted[LOCK_STAT_CNT];
+  size_t i, j;
+
+  if (lock_stat_cnt == 0)
+    return;
+
+  for (i = 0; i < lock_stat_cnt; i++) {
+    for (j = i; j > 0 && sorted[j - 1]->wait_cycles < lock_stats[i].wait_cycles; j--)
+      sorted[j] = sorted[j - 1];
+    sorted[j] = &lock_stats[i];
+  }
+
+  for (i = 0; i < lock_stat_cnt; i++) {
+    struct lock_stat* s = sorted[i];
+    printf("Lock %s: %llu acquired, %llu contended, %llu cycles waiting (%llu max), "
+           "%llu cycles held\n",
+           s->name, s->acquisitions, s->contended, s->wait_cycles, s->max_wait, s->hold_cycles);
+  }
+}
+
+/* Times a thread checks a held lock before it sleeps, while the
+   holder is running on another CPU. */
+#define LOCK_SPIN_CNT 1000
+
+/* Makes CUR the holder of LOCK and returns true if LOCK is free,
+   or returns false if it is held, in one atomic operation. */
+static bool lock_claim(struct lock* lock, struct thread* cur) {
+  struct thread* expected = NULL;
+
+  return __atomic_compare_exchange_n(&lock->holder, &expected, cur, false, __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED);
+}
+
+/* Has the threads waiting for LOCK, which CUR has just acquired,
+   donate their priorities to CUR.  Whoever released the lock
+   withdrew the donations they made for it.  Interrupts must be
+   off. */
+static void lock_inherit_waiters(struct lock* lock, struct thread* cur) {
+  struct wait_queue_elem* e;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  for (e = wait_queue_front(&lock->waiters); e != NULL; e = wait_queue_next(e))
+    thread_donate_priority(e->thread, cur, lock);
+}
+
+/* Tries to acquire LOCK for CUR while its holder is running,
+   which it can only be on another CPU, up to LOCK_SPIN_CNT times.
+   Returns true if successful, or false as soon as the holder is
+   not running.  With a single CPU, the holder never runs while
+   CUR does, so this gives up at once. */
+static bool lock_spin(struct lock* lock, struct thread* cur) {
+  int i;
+
+  for (i = 0; i < LOCK_SPIN_CNT; i++) {
+    struct thread* holder = __atomic_load_n(&lock->holder, __ATOMIC_RELAXED);
+    if (holder == NULL) {
+      if (lock_claim(lock, cur))
+        return true;
+    } else if (holder->status != THREAD_RUNNING)
+      return false;
+    asm volatile("pause" : : : "memory");
+  }
+  return false;
+}
+
+/* Acquires LOCK for CUR after finding it held: spins while the
+   holder is running, then sleeps until LOCK is released, donating
+   CUR's priority to the holder each time it goes to sleep.
+   However CUR gets LOCK, the threads still waiting for it then
+   donate to CUR. */
+static void lock_acquire_contended(struct lock* lock, struct thread* cur) {
+  struct thread* holder = lock->holder;
+  uint64_t start = lock->stat != NULL ? rdtsc() : 0;
+  enum intr_level old_level;
+  bool spun;
+
+  if (holder != NULL)
+    TRACE(TRACE_LOCK_WAIT, lock, holder->tid);
+
+  spun = lock_spin(lock, cur);
+  old_level = intr_disable();
+  if (!spun) {
+    while (!lock_claim(lock, cur)) {
+      struct wait_queue_elem waiter;
+
+      if (active_sched_policy == SCHED_PRIO)
+        thread_donate_priority(cur, lock->holder, lock);
+      wait_queue_push(&lock->waiters, &waiter, cur);
+      thread_block();
+    }
+  }
+
+  /* The holder may have released LOCK while we spun, withdrawing
+     the donations of the threads still queued. */
+  if (active_sched_policy == SCHED_PRIO)
+    lock_inherit_waiters(lock, cur);
+  intr_set_level(old_level);
+
+  cur->lock_cnt++;
+  TRACE(TRACE_LOCK_ACQUIRE, lock, 0);
+  if (lock->stat != NULL)
+    lock_stat_acquired(lock, true, start);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -190,53 +538,27 @@ void lock_init(struct lock* lock) {
    interrupts disabled, but interrupts will be turned back on if
    we need to sleep. */
 void lock_acquire(struct lock* lock) {
+  struct thread* cur = thread_current();
+
   ASSERT(lock != NULL);
   ASSERT(!intr_context());
   ASSERT(!lock_held_by_current_thread(lock));
 
-  struct thread* current_thread = thread_current();
-  if (active_sched_policy == SCHED_PRIO) {
-    // Disable interrupts for atomic donation operations
-    enum intr_level old_level = intr_disable();
-
-    // If lock is held, donate priority and set up donation chain
-    if (lock->holder != NULL && current_thread->donating_to == NULL) {
-      struct donation* new_donation = malloc(sizeof(struct donation));
-      new_donation->lock = lock;
-      new_donation->donated_priority = thread_get_priority();
-      new_donation->donor = current_thread;
-
-      // Add donation to holder's sorted donations list
-      list_push_back(&lock->holder->donations, &new_donation->elem);
-
-      // Set up chain for nested donation
-      current_thread->donating_to = lock->holder;
-
-      // Recursively donate through the chain
-      struct thread* recipient = lock->holder;
-      while (recipient != NULL) {
-        struct thread* next = recipient->donating_to;
-
-        if (!next) {
-          break;
-        }
-
-        // Find existing donation from recipient to next
-        struct donation* existing = find_donation_by_donor_and_donee(recipient, next);
-        if (existing && existing->donated_priority < new_donation->donated_priority) {
-          // Update existing donation with higher priority
-          existing->donated_priority = new_donation->donated_priority;
-        }
-        recipient = next;
-      }
-    }
+  if (!lock_claim(lock, cur)) {
+    lock_acquire_contended(lock, cur);
+    return;
+  }
+  cur->lock_cnt++;
+  if (lock->stat != NULL)
+    lock_stat_acquired(lock, false, 0);
 
+  /* A thread released LOCK and woke a waiter, but we got in
+     first, so the waiters must donate to us instead. */
+  if (active_sched_policy == SCHED_PRIO && !wait_queue_empty(&lock->waiters)) {
+    enum intr_level old_level = intr_disable();
+    lock_inherit_waiters(lock, cur);
     intr_set_level(old_level);
   }
-
-  sema_down(&lock->semaphore);
-  lock->holder = current_thread;
-  current_thread->donating_to = NULL;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -251,60 +573,81 @@ bool lock_try_acquire(struct lock* lock) {
   ASSERT(lock != NULL);
   ASSERT(!lock_held_by_current_thread(lock));
 
-  success = sema_try_down(&lock->semaphore);
-  if (success)
-    lock->holder = thread_current();
+  success = lock_claim(lock, thread_current());
+  if (success) {
+    lock->holder->lock_cnt++;
+    if (lock->stat != NULL)
+      lock_stat_acquired(lock, false, 0);
+    if (active_sched_policy == SCHED_PRIO && !wait_queue_empty(&lock->waiters)) {
+      enum intr_level old_level = intr_disable();
+      lock_inherit_waiters(lock, lock->holder);
+      intr_set_level(old_level);
+    }
+  }
   return success;
 }
 
+/* Withdraws every donation THREAD received from threads waiting
+   for LOCK. */
 static void thread_revoke_donations_for_lock(struct thread* thread, struct lock* lock) {
   struct list_elem* e = list_begin(&thread->donations);
   while (e != list_end(&thread->donations)) {
-    struct list_elem* next = list_next(e);
-
     struct donation* d = list_entry(e, struct donation, elem);
-    if (d->lock == lock) {
-      list_remove(e);
-      free(d);
-    }
-    e = next;
+    e = list_next(e);
+    if (d->resource == lock)
+      thread_revoke_made_donations(d->donor);
   }
 }
 
+/* Wakes the thread that should acquire LOCK next, if any is
+   waiting.  Returns true if it should preempt the current
+   thread.  Interrupts must be off. */
+static bool lock_wake_waiter(struct lock* lock) {
+  struct thread* t;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (wait_queue_empty(&lock->waiters))
+    return false;
+  t = wait_queue_pop(&lock->waiters)->thread;
+  thread_unblock(t);
+  if (thread_deadline_preempts(t))
+    return true;
+  return (active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS) &&
+         thread_get_priority_of(t) > thread_get_priority_of(thread_current());
+}
+
 /* Releases LOCK, which must be owned by the current thread.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
    handler. */
 void lock_release(struct lock* lock) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+  bool should_yield;
+
   ASSERT(lock != NULL);
   ASSERT(lock_held_by_current_thread(lock));
 
-  lock->holder = NULL;
-  // Wake up highest priority waiter
-  sema_up(&lock->semaphore);
+  if (lock->stat != NULL)
+    lock_stat_released(lock);
 
-  if (active_sched_policy == SCHED_PRIO) {
-    struct thread* current = thread_current();
-    // Disable interrupts for atomic operations
-    enum intr_level old_level = intr_disable();
-
-    // Remove donation chain made by thread associated with this specific lock
-    thread_revoke_made_donations(current);
-
-    // Remove donation related to lock
-    thread_revoke_donations_for_lock(current, lock);
-
-    // Yield if current thread no longer has highest effective priority
-    bool should_yield = !thread_has_highest_priority();
-
-    intr_set_level(old_level);
+  old_level = intr_disable();
+  /* Remove donations related to lock before waking a waiter. */
+  if (active_sched_policy == SCHED_PRIO)
+    thread_revoke_donations_for_lock(cur, lock);
+  cur->lock_cnt--;
+  __atomic_store_n(&lock->holder, NULL, __ATOMIC_RELEASE);
+  should_yield = lock_wake_waiter(lock);
+
+  /* Yield if current thread no longer has highest effective priority. */
+  if (active_sched_policy == SCHED_PRIO)
+    should_yield = !thread_has_highest_priority();
+  intr_set_level(old_level);
 
-    if (should_yield) {
-      thread_yield();
-    }
-    return;
-  }
+  if (should_yield)
+    thread_yield();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -316,85 +659,240 @@ bool lock_held_by_current_thread(const struct lock* lock) {
   return lock->holder == thread_current();
 }
 
-/* Initializes a readers-writers lock */
-void rw_lock_init(struct rw_lock* rw_lock) {
+/* Readers-writers locks.
+
+   Readers never touch the inner lock unless they have to wait:
+   entering and leaving a read section is a counter update with
+   interrupts briefly off.  A writer holds the inner lock for its
+   whole critical section, so threads waiting to write, and
+   readers that must wait for a writer, block on that lock and
+   donate their priority to the writer.  Once a writer owns the
+   lock, it waits on `drained' for the active readers, if any, to
+   leave.
+
+   So that a draining writer, and the threads waiting behind it,
+   are not held up by a low-priority reader, the lock keeps the
+   tids of up to RW_READER_SLOTS active readers.  The writer makes
+   one of them the owner of `drained', donating its priority to
+   it, and when that reader leaves it hands ownership to another
+   one still inside. */
+
+/* Initializes a writer-preferring readers-writers lock. */
+void rw_lock_init(struct rw_lock* rw_lock) { rw_lock_init_preference(rw_lock, RW_PREFER_WRITERS); }
+
+/* Initializes a writer-preferring readers-writers lock, naming
+   its inner lock NAME for statistics.  Writers and readers that
+   wait for a writer show up there; readers that get straight in
+   do not. */
+void rw_lock_init_named(struct rw_lock* rw_lock, const char* name) {
+  rw_lock_init(rw_lock);
+  lock_init_named(&rw_lock->lock, name);
+}
+
+/* Initializes a readers-writers lock that resolves contention
+   between readers and writers according to PREFERENCE. */
+void rw_lock_init_preference(struct rw_lock* rw_lock, enum rw_preference preference) {
+  int i;
+
+  ASSERT(rw_lock != NULL);
+
   lock_init(&rw_lock->lock);
-  cond_init(&rw_lock->read);
-  cond_init(&rw_lock->write);
-  rw_lock->AR = rw_lock->WR = rw_lock->AW = rw_lock->WW = 0;
+  sema_init(&rw_lock->drained, 0);
+  rw_lock->readers = rw_lock->writers = 0;
+  for (i = 0; i < RW_READER_SLOTS; i++)
+    rw_lock->reader_tids[i] = TID_ERROR;
+  rw_lock->writer_active = rw_lock->draining = false;
+  rw_lock->preference = preference;
 }
 
-/* Acquire a writer-centric readers-writers lock */
+/* Returns true if a new reader may enter RW_LOCK right away. */
+static bool rw_lock_reader_may_enter(const struct rw_lock* rw_lock) {
+  if (rw_lock->preference == RW_PREFER_WRITERS)
+    return rw_lock->writers == 0;
+  return !rw_lock->writer_active;
+}
+
+/* Returns the tid of one of RW_LOCK's active readers, or
+   TID_ERROR if it keeps track of none of them. */
+static tid_t rw_lock_some_reader(const struct rw_lock* rw_lock) {
+  int i;
+
+  for (i = 0; i < RW_READER_SLOTS; i++)
+    if (rw_lock->reader_tids[i] != TID_ERROR)
+      return rw_lock->reader_tids[i];
+  return TID_ERROR;
+}
+
+/* Counts the running thread in as a reader of RW_LOCK, keeping
+   its tid if there is a free slot.  Interrupts must be off. */
+static void rw_lock_add_reader(struct rw_lock* rw_lock) {
+  int i;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  rw_lock->readers++;
+  for (i = 0; i < RW_READER_SLOTS; i++)
+    if (rw_lock->reader_tids[i] == TID_ERROR) {
+      rw_lock->reader_tids[i] = thread_tid();
+      break;
+    }
+}
+
+/* Counts the running thread out as a reader of RW_LOCK.  If a
+   writer is draining RW_LOCK and was donating to us, it is made
+   to donate to another reader instead.  Interrupts must be
+   off. */
+static void rw_lock_remove_reader(struct rw_lock* rw_lock) {
+  tid_t tid = thread_tid();
+  int i;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(rw_lock->readers > 0);
+
+  rw_lock->readers--;
+  for (i = 0; i < RW_READER_SLOTS; i++)
+    if (rw_lock->reader_tids[i] == tid) {
+      rw_lock->reader_tids[i] = TID_ERROR;
+      break;
+    }
+
+  if (rw_lock->draining && rw_lock->readers > 0 && rw_lock->drained.owner == tid)
+    sema_set_owner(&rw_lock->drained, rw_lock_some_reader(rw_lock));
+}
+
+/* Waits, with interrupts off, until every reader has left
+   RW_LOCK, whose inner lock the caller must hold, and then
+   enters the write section.  Meanwhile, donates to one of the
+   readers. */
+static void rw_lock_drain_readers(struct rw_lock* rw_lock) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(lock_held_by_current_thread(&rw_lock->lock));
+
+  while (rw_lock->readers > 0) {
+    rw_lock->draining = true;
+    sema_set_owner(&rw_lock->drained, rw_lock_some_reader(rw_lock));
+    sema_down(&rw_lock->drained);
+  }
+  rw_lock->drained.owner = TID_ERROR;
+  rw_lock->writer_active = true;
+}
+
+/* Acquires RW_LOCK for reading if READER is true, or for writing
+   otherwise, sleeping until it becomes available if
+   necessary. */
 void rw_lock_acquire(struct rw_lock* rw_lock, bool reader) {
-  // Must hold the guard lock the entire time
-  lock_acquire(&rw_lock->lock);
+  enum intr_level old_level;
 
+  ASSERT(rw_lock != NULL);
+  ASSERT(!intr_context());
+
+  old_level = intr_disable();
   if (reader) {
-    // Reader code: Block while there are waiting or active writers
-    while ((rw_lock->AW + rw_lock->WW) > 0) {
-      rw_lock->WR++;
-      cond_wait(&rw_lock->read, &rw_lock->lock);
-      rw_lock->WR--;
+    if (!rw_lock_reader_may_enter(rw_lock)) {
+      /* Wait behind the writer(s), donating to the one holding
+         the inner lock.  Count ourselves in before letting go of
+         it, so that the next writer waits for us. */
+      intr_set_level(old_level);
+      lock_acquire(&rw_lock->lock);
+      old_level = intr_disable();
+      rw_lock_add_reader(rw_lock);
+      intr_set_level(old_level);
+      lock_release(&rw_lock->lock);
+      return;
     }
-    rw_lock->AR++;
+    rw_lock_add_reader(rw_lock);
   } else {
-    // Writer code: Block while there are any active readers/writers in the system
-    while ((rw_lock->AR + rw_lock->AW) > 0) {
-      rw_lock->WW++;
-      cond_wait(&rw_lock->write, &rw_lock->lock);
-      rw_lock->WW--;
-    }
-    rw_lock->AW++;
+    rw_lock->writers++;
+    intr_set_level(old_level);
+    lock_acquire(&rw_lock->lock);
+    old_level = intr_disable();
+    rw_lock_drain_readers(rw_lock);
   }
-
-  // Release guard lock
-  lock_release(&rw_lock->lock);
+  intr_set_level(old_level);
 }
 
-/* Release a writer-centric readers-writers lock */
+/* Releases RW_LOCK, which the current thread must hold for
+   reading if READER is true, or for writing otherwise. */
 void rw_lock_release(struct rw_lock* rw_lock, bool reader) {
-  // Must hold the guard lock the entire time
-  lock_acquire(&rw_lock->lock);
+  enum intr_level old_level;
 
+  ASSERT(rw_lock != NULL);
+  ASSERT(!intr_context());
+
+  old_level = intr_disable();
   if (reader) {
-    // Reader code: Wake any waiting writers if we are the last reader
-    rw_lock->AR--;
-    if (rw_lock->AR == 0 && rw_lock->WW > 0)
-      cond_signal(&rw_lock->write, &rw_lock->lock);
+    rw_lock_remove_reader(rw_lock);
+    if (rw_lock->readers == 0 && rw_lock->draining) {
+      rw_lock->draining = false;
+      sema_up(&rw_lock->drained);
+    }
+    intr_set_level(old_level);
   } else {
-    // Writer code: First try to wake a waiting writer, otherwise all waiting readers
-    rw_lock->AW--;
-    if (rw_lock->WW > 0)
-      cond_signal(&rw_lock->write, &rw_lock->lock);
-    else if (rw_lock->WR > 0)
-      cond_broadcast(&rw_lock->read, &rw_lock->lock);
+    ASSERT(rw_lock->writer_active);
+    rw_lock->writer_active = false;
+    rw_lock->writers--;
+    intr_set_level(old_level);
+    lock_release(&rw_lock->lock);
+  }
+}
+
+/* Converts the current thread's read hold on RW_LOCK into a
+   write hold.  Returns true on success.  Fails, still holding
+   RW_LOCK for reading, if some other thread already owns or is
+   upgrading to the write side: waiting for it would deadlock if
+   it is itself waiting for our read hold to go away.  The caller
+   should then release its read hold and acquire RW_LOCK for
+   writing from scratch. */
+bool rw_lock_upgrade(struct rw_lock* rw_lock) {
+  enum intr_level old_level;
+
+  ASSERT(rw_lock != NULL);
+  ASSERT(!intr_context());
+
+  old_level = intr_disable();
+  ASSERT(rw_lock->readers > 0);
+  if (!lock_try_acquire(&rw_lock->lock)) {
+    intr_set_level(old_level);
+    return false;
   }
+  rw_lock->writers++;
+  rw_lock_remove_reader(rw_lock);
+  rw_lock_drain_readers(rw_lock);
+  intr_set_level(old_level);
+  return true;
+}
 
-  // Release guard lock
+/* Converts the current thread's write hold on RW_LOCK into a
+   read hold, without letting another writer in between.
+   Readers waiting for the writer are let in as well. */
+void rw_lock_downgrade(struct rw_lock* rw_lock) {
+  enum intr_level old_level;
+
+  ASSERT(rw_lock != NULL);
+  ASSERT(!intr_context());
+
+  old_level = intr_disable();
+  ASSERT(rw_lock->writer_active);
+  rw_lock->writer_active = false;
+  rw_lock->writers--;
+  rw_lock_add_reader(rw_lock);
+  intr_set_level(old_level);
   lock_release(&rw_lock->lock);
 }
 
-/* One semaphore in a list. */
+/* One semaphore in a condition variable's wait queue. */
 struct semaphore_elem {
-  struct list_elem elem;      /* List element. */
-  struct semaphore semaphore; /* This semaphore. */
-  struct thread* thread;      /* Thread waiting on this semaphore (for priority ordering). */
+  struct wait_queue_elem elem; /* Wait queue element. */
+  struct semaphore semaphore;  /* This semaphore. */
 };
 
-static bool semaphore_elem_thread_priority_less(const struct list_elem* a,
-                                                const struct list_elem* b, UNUSED void* aux) {
-  struct semaphore_elem* sema_elem_a = list_entry(a, struct semaphore_elem, elem);
-  struct semaphore_elem* sema_elem_b = list_entry(b, struct semaphore_elem, elem);
-  return thread_get_priority_of(sema_elem_a->thread) < thread_get_priority_of(sema_elem_b->thread);
-}
-
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
 void cond_init(struct condition* cond) {
   ASSERT(cond != NULL);
 
-  list_init(&cond->waiters);
+  wait_queue_init(&cond->waiters);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -419,6 +917,7 @@ void cond_init(struct condition* cond) {
    we need to sleep. */
 void cond_wait(struct condition* cond, struct lock* lock) {
   struct semaphore_elem waiter;
+  enum intr_level old_level;
 
   ASSERT(cond != NULL);
   ASSERT(lock != NULL);
@@ -428,55 +927,239 @@ void cond_wait(struct condition* cond, struct lock* lock) {
   /* Condition variables use a unique design: each waiting thread gets its own
      personal semaphore (initialized to 0). When cond_wait() is called, a 
      semaphore_elem with a new semaphore is created as a local stack variable
-     and added to the waiters list. The thread then blocks on its personal
-     semaphore via sema_down(). When cond_signal() is called, it picks one
-     semaphore from the waiters list and calls sema_up() on it, unblocking
-     exactly one thread. This ensures each semaphore in the waiters list
-     has exactly one thread waiting on it. */
+     and added to the wait queue. The thread then blocks on its personal
+     semaphore via sema_down(). Signaling does not wake it, since it
+     would only block again on LOCK, which the signaler holds.
+     cond_requeue() instead ups the semaphore without waking the
+     thread and moves it to LOCK's wait queue, so that releasing
+     LOCK wakes it like any other thread waiting for LOCK. */
   sema_init(&waiter.semaphore, 0);
-  waiter.thread = thread_current();
-  if (active_sched_policy == SCHED_PRIO) {
-    list_insert_ordered(&cond->waiters, &waiter.elem, semaphore_elem_thread_priority_less, NULL);
-  } else {
-    list_push_back(&cond->waiters, &waiter.elem);
-  }
+  old_level = intr_disable();
+  wait_queue_push(&cond->waiters, &waiter.elem, thread_current());
+  intr_set_level(old_level);
   lock_release(lock);
   sema_down(&waiter.semaphore);
   lock_acquire(lock);
 }
 
-/* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+/* Signals WAITER, just taken off a condition variable's wait
+   queue, by moving it to the wait queue of LOCK, which the
+   current thread holds, without waking it.  If the waiter has not
+   blocked on its semaphore yet, it will find the semaphore up and
+   go straight on to acquire LOCK.  Interrupts must be off. */
+static void cond_requeue(struct semaphore_elem* waiter, struct lock* lock) {
+  struct wait_queue_elem* e;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  waiter->semaphore.value++;
+  if (wait_queue_empty(&waiter->semaphore.waiters))
+    return;
+
+  /* E is in the waiter's sema_down() frame, which stays put until
+     the waiter is woken, and then finds the semaphore up. */
+  e = wait_queue_pop(&waiter->semaphore.waiters);
+  wait_queue_push(&lock->waiters, e, e->thread);
+  if (active_sched_policy == SCHED_PRIO)
+    thread_donate_priority(e->thread, lock->holder, lock);
+}
+
+/* Signals up to N of the threads waiting on COND (protected by
+   LOCK), the same ones that N calls to cond_signal() would, and
+   returns how many there were.  LOCK must be held before calling
+   this function.  Each is woken once it can acquire LOCK, after
+   the caller releases it, so a signal costs one thread switch.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
    interrupt handler. */
-void cond_signal(struct condition* cond, struct lock* lock UNUSED) {
+size_t cond_signal_n(struct condition* cond, struct lock* lock, size_t n) {
+  enum intr_level old_level;
+  size_t cnt;
+
   ASSERT(cond != NULL);
   ASSERT(lock != NULL);
   ASSERT(!intr_context());
   ASSERT(lock_held_by_current_thread(lock));
 
-  if (!list_empty(&cond->waiters)) {
-    if (active_sched_policy == SCHED_PRIO) {
-      sema_up(&list_entry(list_pop_back(&cond->waiters), struct semaphore_elem, elem)->semaphore);
-    } else {
-      sema_up(&list_entry(list_pop_front(&cond->waiters), struct semaphore_elem, elem)->semaphore);
-    }
-  }
+  old_level = intr_disable();
+  for (cnt = 0; cnt < n && !wait_queue_empty(&cond->waiters); cnt++)
+    cond_requeue(wait_queue_entry(wait_queue_pop(&cond->waiters), struct semaphore_elem, elem),
+                 lock);
+  intr_set_level(old_level);
+  return cnt;
 }
 
+/* If any threads are waiting on COND (protected by LOCK), then
+   this function signals one of them to wake up from its wait.
+   LOCK must be held before calling this function.
+
+   An interrupt handler cannot acquire a lock, so it does not
+   make sense to try to signal a condition variable within an
+   interrupt handler. */
+void cond_signal(struct condition* cond, struct lock* lock) { cond_signal_n(cond, lock, 1); }
+
 /* Wakes up all threads, if any, waiting on COND (protected by
-   LOCK).  LOCK must be held before calling this function.
+   LOCK).  LOCK must be held before calling this function.  They
+   are woken one at a time, as each can acquire LOCK, instead of
+   all at once only for all but one to block on LOCK again.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
    interrupt handler. */
 void cond_broadcast(struct condition* cond, struct lock* lock) {
-  ASSERT(cond != NULL);
-  ASSERT(lock != NULL);
+  cond_signal_n(cond, lock, SIZE_MAX);
+}
+
+/* Range lock.
+
+   A range lock keeps a list of the ranges held in it.  A thread
+   that wants a range that overlaps one of them waits on
+   `released' and looks again whenever any range is released.
+   Ranges are usually few, so the list stays short.  Waiters are
+   not queued behind each other, so a thread wanting a wide range
+   may wait while narrower ones keep coming and going. */
+
+/* Initializes range lock RL, with no range held. */
+void range_lock_init(struct range_lock* rl) {
+  ASSERT(rl != NULL);
+
+  lock_init(&rl->lock);
+  cond_init(&rl->released);
+  list_init(&rl->held);
+}
+
+/* Returns true if [START, END) overlaps a range held in RL.  The
+   caller must hold RL's lock. */
+static bool range_lock_conflicts(struct range_lock* rl, uint32_t start, uint32_t end) {
+  struct list_elem* e;
+
+  for (e = list_begin(&rl->held); e != list_end(&rl->held); e = list_next(e)) {
+    const struct range* r = list_entry(e, struct range, elem);
+    if (r->start < end && start < r->end)
+      return true;
+  }
+  return false;
+}
+
+/* Acquires the range [START, END) of RL into R, sleeping until no
+   other holder's range overlaps it.  The range must not be
+   empty.  A thread must not acquire a range that overlaps one it
+   already holds. */
+void range_lock_acquire(struct range_lock* rl, struct range* r, uint32_t start, uint32_t end) {
+  ASSERT(rl != NULL);
+  ASSERT(r != NULL);
+  ASSERT(start < end);
+  ASSERT(!intr_context());
+
+  lock_acquire(&rl->lock);
+  while (range_lock_conflicts(rl, start, end))
+    cond_wait(&rl->released, &rl->lock);
+  r->start = start;
+  r->end = end;
+  list_push_back(&rl->held, &r->elem);
+  lock_release(&rl->lock);
+}
+
+/* Releases range R, which must have been acquired from RL. */
+void range_lock_release(struct range_lock* rl, struct range* r) {
+  ASSERT(rl != NULL);
+  ASSERT(r != NULL);
+
+  lock_acquire(&rl->lock);
+  list_remove(&r->elem);
+  cond_broadcast(&rl->released, &rl->lock);
+  lock_release(&rl->lock);
+}
+
+/* Eventcount.
 
-  while (!list_empty(&cond->waiters))
-    cond_signal(cond, lock);
+   Advancing wakes every sleeper, since each one checks its own
+   condition afterward.  Sleepers are few, so they are kept in a
+   plain list. */
+
+/* A thread sleeping in eventcount_await(), in its stack frame. */
+struct eventcount_waiter {
+  struct thread* thread;        /* Sleeping thread. */
+  struct list_elem elem;        /* Element in the eventcount's waiters. */
+  bool asleep;                  /* Not yet woken by an advance or timeout. */
+  struct timer_callout timeout; /* Wakes the thread when time is up. */
+};
+
+struct eventcount io_events = EVENTCOUNT_INITIALIZER(io_events);
+
+/* Initializes EC with a count of 0 and no waiters. */
+void eventcount_init(struct eventcount* ec) {
+  ASSERT(ec != NULL);
+
+  ec->count = 0;
+  list_init(&ec->waiters);
+}
+
+/* Returns EC's current count, to pass to eventcount_await(). */
+unsigned eventcount_read(const struct eventcount* ec) { return ec->count; }
+
+/* Wakes waiter W and takes it off its eventcount's list.
+   Interrupts must be off. */
+static void eventcount_wake(struct eventcount_waiter* w) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  list_remove(&w->elem);
+  w->asleep = false;
+  thread_unblock(w->thread);
+}
+
+/* Timer callout for eventcount_await(). */
+static void eventcount_timeout(void* w_) {
+  struct eventcount_waiter* w = w_;
+
+  if (w->asleep)
+    eventcount_wake(w);
+}
+
+/* Sleeps until EC's count differs from SEEN, a value it had
+   earlier, or until TICKS timer ticks pass.  A negative TICKS
+   has no time limit and 0 does not sleep.  Returns true if the
+   count has moved, false on timeout.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool eventcount_await(struct eventcount* ec, unsigned seen, int64_t ticks) {
+  enum intr_level old_level;
+  struct eventcount_waiter w;
+  bool moved;
+
+  ASSERT(ec != NULL);
+  ASSERT(!intr_context());
+
+  old_level = intr_disable();
+  if (ec->count == seen && ticks != 0) {
+    w.thread = thread_current();
+    w.asleep = true;
+    w.timeout.pending = false;
+    list_push_back(&ec->waiters, &w.elem);
+    if (ticks > 0)
+      timer_add_callout(&w.timeout, ticks, eventcount_timeout, &w);
+    thread_block();
+    timer_cancel_callout(&w.timeout);
+  }
+  moved = ec->count != seen;
+  intr_set_level(old_level);
+
+  return moved;
+}
+
+/* Advances EC and wakes all of its sleepers.
+
+   This function may be called from an interrupt handler. */
+void eventcount_advance(struct eventcount* ec) {
+  enum intr_level old_level;
+
+  ASSERT(ec != NULL);
+
+  old_level = intr_disable();
+  ec->count++;
+  while (!list_empty(&ec->waiters))
+    eventcount_wake(list_entry(list_front(&ec->waiters), struct eventcount_waiter, elem));
+  intr_set_level(old_level);
 }
@@ -2,55 +2,185 @@
 #define THREADS_SYNCH_H
 
 #include <list.h>
+#include <rbtree.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-/* A counting semaphore. */
+/* A queue of threads waiting on a synchronization primitive.
+
+   Under SCHED_PRIO and SCHED_MLFQS, waiters are ordered by
+   effective priority, highest first, and FIFO among equal
+   priorities; under the other policies they are plain FIFO.  The
+   queue is a red-black tree, so adding a waiter takes O(lg n)
+   time and finding the one to wake takes O(1).  If a waiter's
+   priority changes while it waits (e.g. because of a donation),
+   thread_priority_changed() moves it to its new position.
+
+   Wait queues must only be manipulated with interrupts off. */
+struct wait_queue {
+  struct rb_tree waiters; /* Tree of struct wait_queue_elem. */
+};
+
+/* An entry in a wait queue.  Usually a local variable in the
+   waiting thread's stack frame. */
+struct wait_queue_elem {
+  struct rb_elem elem;      /* Element in queue->waiters. */
+  struct thread* thread;    /* Waiting thread. */
+  int priority;             /* Sort key, fixed while in the tree. */
+  struct wait_queue* queue; /* Queue this element is in. */
+};
+
+/* Converts pointer to wait queue element ELEM into a pointer to
+   the structure that ELEM is embedded inside. */
+#define wait_queue_entry(ELEM, STRUCT, MEMBER)                                                     \
+  ((STRUCT*)((uint8_t*)(ELEM) - offsetof(STRUCT, MEMBER)))
+
+void wait_queue_init(struct wait_queue*);
+bool wait_queue_empty(const struct wait_queue*);
+void wait_queue_push(struct wait_queue*, struct wait_queue_elem*, struct thread*);
+struct wait_queue_elem* wait_queue_pop(struct wait_queue*);
+void wait_queue_remove(struct wait_queue_elem*);
+void wait_queue_update(struct wait_queue_elem*);
+struct wait_queue_elem* wait_queue_front(struct wait_queue*);
+struct wait_queue_elem* wait_queue_next(struct wait_queue_elem*);
+
+/* A counting semaphore.  One used as a completion, upped by a
+   particular thread when it is done, can name that thread as its
+   owner with sema_set_owner(), so that threads waiting on it
+   donate their priority to it, as they would to a lock holder. */
 struct semaphore {
-  unsigned value;      /* Current value. */
-  struct list waiters; /* List of waiting threads. */
+  unsigned value;            /* Current value. */
+  struct wait_queue waiters; /* Waiting threads. */
+  int owner;                 /* Tid of the thread that will up it, or TID_ERROR. */
 };
 
 void sema_init(struct semaphore*, unsigned value);
+void sema_set_owner(struct semaphore*, int owner);
 void sema_down(struct semaphore*);
 bool sema_try_down(struct semaphore*);
 void sema_up(struct semaphore*);
 void sema_self_test(void);
 
+/* Contention statistics shared by all the locks initialized with
+   one name.  Kept only if the -lockstat option is given. */
+struct lock_stat {
+  const char* name;      /* Name of the locks. */
+  uint64_t acquisitions; /* Times acquired. */
+  uint64_t contended;    /* Times a thread had to wait. */
+  uint64_t wait_cycles;  /* Total cycles spent waiting. */
+  uint64_t max_wait;     /* Longest wait, in cycles. */
+  uint64_t hold_cycles;  /* Total cycles held. */
+};
+
+/* Collect statistics for named locks? */
+extern bool lockstat_enabled;
+
+struct lock_stat* lock_stat_for(const char* name);
+
 /* Lock. */
 struct lock {
-  struct thread* holder;      /* Thread holding lock. */
-  struct semaphore semaphore; /* Binary semaphore controlling access. */
+  struct thread* holder;     /* Thread holding lock, or null if free. */
+  struct wait_queue waiters; /* Threads sleeping until the lock is free. */
+  struct lock_stat* stat;    /* Statistics, or null if unnamed. */
+  uint64_t acquired;         /* Time-stamp counter when acquired, if named. */
 };
 
 void lock_init(struct lock*);
+void lock_init_named(struct lock*, const char* name);
 void lock_acquire(struct lock*);
 bool lock_try_acquire(struct lock*);
 void lock_release(struct lock*);
 bool lock_held_by_current_thread(const struct lock*);
+void lock_print_stats(void);
 
 /* Condition variable. */
 struct condition {
-  struct list waiters; /* List of waiting threads. */
+  struct wait_queue waiters; /* Waiting threads' semaphore_elems. */
 };
 
 void cond_init(struct condition*);
 void cond_wait(struct condition*, struct lock*);
 void cond_signal(struct condition*, struct lock*);
 void cond_broadcast(struct condition*, struct lock*);
+size_t cond_signal_n(struct condition*, struct lock*, size_t n);
 
 /* Readers-writers lock. */
 #define RW_READER 1
 #define RW_WRITER 0
 
+/* Which side a readers-writers lock lets in first when both
+   readers and writers want it. */
+enum rw_preference {
+  RW_PREFER_WRITERS, /* New readers wait while any writer waits. */
+  RW_PREFER_READERS  /* New readers enter unless a writer is active. */
+};
+
+/* Active readers of a readers-writers lock that it keeps track
+   of, for a draining writer to donate to. */
+#define RW_READER_SLOTS 4
+
 struct rw_lock {
-  struct lock lock;
-  struct condition read, write;
-  int AR, WR, AW, WW;
+  struct lock lock;                 /* Held by the writer, including while it drains readers. */
+  struct semaphore drained;         /* Upped by the last reader out for a draining writer. */
+  int readers;                      /* Number of active readers. */
+  int reader_tids[RW_READER_SLOTS]; /* Tids of some active readers, or TID_ERROR. */
+  int writers;                      /* Writers active or waiting for `lock'. */
+  bool writer_active;               /* A writer is in its critical section. */
+  bool draining;                    /* The writer is waiting for readers to leave. */
+  enum rw_preference preference;    /* Who goes first. */
 };
 
 void rw_lock_init(struct rw_lock*);
+void rw_lock_init_named(struct rw_lock*, const char* name);
+void rw_lock_init_preference(struct rw_lock*, enum rw_preference);
 void rw_lock_acquire(struct rw_lock*, bool reader);
 void rw_lock_release(struct rw_lock*, bool reader);
+bool rw_lock_upgrade(struct rw_lock*);
+void rw_lock_downgrade(struct rw_lock*);
+
+/* Range lock.  Holders of overlapping ranges exclude each other,
+   while holders of disjoint ranges go ahead in parallel. */
+struct range_lock {
+  struct lock lock;          /* Protects HELD. */
+  struct condition released; /* Signaled when a range is released. */
+  struct list held;          /* Held `struct range's. */
+};
+
+/* A range held in a range lock, usually in the holder's stack
+   frame. */
+struct range {
+  uint32_t start;        /* First unit held. */
+  uint32_t end;          /* One past the last unit held. */
+  struct list_elem elem; /* Element in the range lock's HELD. */
+};
+
+void range_lock_init(struct range_lock*);
+void range_lock_acquire(struct range_lock*, struct range*, uint32_t start, uint32_t end);
+void range_lock_release(struct range_lock*, struct range*);
+
+/* Eventcount: a counter that advances whenever something that
+   waiters care about happens.  A waiter reads the count, checks
+   its condition without any lock held against the advancer, and
+   sleeps only if the count has not moved since, so it cannot
+   miss a wakeup.  Useful when the condition spans several
+   objects, or when interrupt handlers advance the count. */
+struct eventcount {
+  unsigned count;      /* Number of advances so far. */
+  struct list waiters; /* Sleeping `struct eventcount_waiter's. */
+};
+
+/* Initializer for an eventcount named NAME. */
+#define EVENTCOUNT_INITIALIZER(NAME)                                                                 { 0, LIST_INITIALIZER((NAME).waiters) }
+
+void eventcount_init(struct eventcount*);
+unsigned eventcount_read(const struct eventcount*);
+bool eventcount_await(struct eventcount*, unsigned seen, int64_t ticks);
+void eventcount_advance(struct eventcount*);
+
+/* Advanced whenever console input arrives or a pipe may have
+   become readable or writable, for poll(). */
+extern struct eventcount io_events;
 
 /* Optimization barrier.
 
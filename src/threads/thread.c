@@ -1,19 +1,30 @@
-#include "threads/malloc.h"
 #include "threads/thread.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "list.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/percpu.h"
+#include "threads/profile.h"
+#include "threads/rcu.h"
+#include "threads/spinlock.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
+#include "threads/tunable.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
+#include "userprog/pagedir.h"
 #include "userprog/process.h"
 #endif
 
@@ -22,22 +33,172 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list fifo_ready_list;
+/* Per-CPU scheduler state.  Each CPU has its own ready queues
+   and idle thread, in its struct cpu.  A thread becomes ready on
+   the queues of the CPU that makes it ready, and records that CPU
+   in its `cpu' member, so that removing or requeuing it later
+   finds the right queues whichever CPU does it.  Each CPU's
+   `lock' protects its queues.  No code holds two CPUs' locks at
+   once.
+
+   A CPU picks the next thread to run from its own queues.  Only
+   if they are empty does it steal from the other CPUs' queues, in
+   turn, skipping any whose lock is busy rather than waiting for
+   it.  A couple of places only peek at a word of the running
+   CPU's queues without the lock, such as whether a deadline
+   thread is waiting: the answer could be stale an instant later
+   anyway.
+
+   The kernel still runs on one CPU (see threads/percpu.h), and
+   the rest of the scheduler assumes as much:
+
+     - thread_current() finds the running thread by rounding the
+       stack pointer down to a page boundary, so there is exactly
+       one "running thread" at a time.
+
+     - all_list, handoff_thread, and the SCHED_MLFQS and
+       SCHED_FAIR bookkeeping outside the queues are protected
+       only by disabling interrupts, which excludes no other CPU.
+
+     - Preemption comes from the single PIT timer interrupt
+       (devices/timer.c), not a per-CPU local APIC timer.
+
+   Running on more CPUs would still take a per-CPU pointer for
+   thread_current(), a local APIC timer, and an AP bring-up path
+   in the loader.
+
+   Under SCHED_PRIO, a thread is queued on the list matching its
+   effective priority at the time it was enqueued (recorded in
+   `ready_priority').  Bit N of prio_ready_bitmap is set iff
+   prio_ready_lists[N] is nonempty, so the highest runnable
+   priority can be found with a single find-last-set instead of
+   scanning every thread. */
+struct cpu {
+  struct thread* idle_thread;                /* Runs when no thread is ready. */
+  struct spinlock lock;                      /* Protects the queues below. */
+  struct list fifo_ready_list;               /* SCHED_FIFO ready threads. */
+  struct list prio_ready_lists[PRI_MAX + 1]; /* SCHED_PRIO ready threads, by priority. */
+  uint64_t prio_ready_bitmap;                /* Nonempty prio_ready_lists. */
+  int prio_ready_cnt;                        /* Number of threads on prio_ready_lists. */
+  struct rb_tree fair_ready_tree;            /* SCHED_FAIR ready threads, by pass. */
+  int64_t fair_vtime;                        /* Pass of the last SCHED_FAIR pick. */
+  struct list dl_ready_list;                 /* Ready deadline class members. */
+};
+
+static struct cpu cpus[CPU_CNT];
+
+/* Returns the running CPU. */
+static struct cpu* this_cpu(void) { return &cpus[cpu_index()]; }
+
+/* SCHED_MLFQS state.  load_avg is recomputed once per second.
+   Between those full passes, the only input to a thread's
+   priority that changes is its own recent_cpu, which only grows
+   while the thread runs, so threads that ran since the last
+   4-tick recompute are kept on mlfqs_dirty_list and only they
+   get their priority recomputed. */
+static fixed_point_t load_avg;
+static struct list mlfqs_dirty_list;
+
+/* SCHED_FAIR state: stride scheduling.  Each thread has a stride
+   inversely proportional to its weight (its priority plus one),
+   and its `fair_pass' advances by that stride for every tick it
+   runs.  The ready thread with the smallest pass runs next, so
+   over time each thread gets CPU in proportion to its weight and
+   none starves.  Ready threads are kept in a red-black tree
+   ordered by pass, which makes picking the next thread O(1) and
+   enqueueing O(lg n).  fair_vtime is the pass of the thread most
+   recently picked; a thread that becomes ready with a smaller
+   pass (e.g. after sleeping) is brought up to it, so it cannot
+   bank CPU time while blocked. */
+#define FAIR_STRIDE1 (1 << 20) /* Stride of a thread of weight 1. */
+
+/* Deadline class: earliest deadline first, above whichever
+   policy is active.  A thread joins it with thread_set_deadline(),
+   reserving a budget of ticks in every period, and is admitted
+   only if the budgets of all members still add up to at most
+   DL_UTIL_MAX of the CPU.  EDF meets every deadline under that
+   bound, and the rest is kept for threads outside the class.
+
+   A member's current period ends at its `dl_deadline'.  Ready
+   members wait on their CPU's dl_ready_list, earliest deadline
+   first, and run
+   before any thread of the active policy.  Each tick a member
+   runs is charged to its `dl_runtime'.  One that runs out is
+   throttled: it falls back to the active policy, at its ordinary
+   priority, until its callout starts its next period.  A member
+   that wakes with more budget left than it may use at its
+   reserved rate before its deadline starts a new period instead
+   (the constant bandwidth server rule), so it cannot bank CPU
+   time while blocked. */
+#define DL_UNIT (1 << 16)                /* Utilization of the whole CPU. */
+#define DL_UTIL_MAX (DL_UNIT * 95 / 100) /* Most utilization admitted. */
+static int dl_util;            /* Members' total utilization, in DL_UNITs. */
+static int dl_members;         /* Threads in the class. */
+static long long dl_throttles; /* Times a member ran out of budget. */
+static long long dl_misses;    /* Times a member ran out past its deadline. */
+
+/* CPU quotas.  A process with a quota may run for its limit's
+   share of the ticks of each CPU_QUOTA_PERIOD, counting every
+   tick that any of its threads runs, in user mode or in the
+   kernel.  Once it has used them up, the next tick that finds one
+   of its threads in user mode marks it held and preempts it;
+   thread_enqueue() then parks it on the quota's list instead of a
+   ready queue, until the quota's callout starts the next period.
+   Threads running in the kernel are not held back, since they may
+   hold locks that others need; they are caught when they return
+   to user mode. */
+#define CPU_QUOTA_PERIOD (TIMER_FREQ / 4)
+static long long quota_throttles; /* Times a process ran out of its quota. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread* idle_thread;
+/* Thread identifiers.
+
+   Tids are small numbers, from 1 to TID_MAX - 1, so that
+   tid_table, indexed by tid, finds the live thread with a tid in
+   one load, for thread_get_by_tid().  A tid is in use from
+   thread_create() until each of its holders lets go of it: the
+   thread itself when it exits, and the creator, if it called
+   thread_create_held(), when it calls thread_tid_release().  A
+   process's pid is its main thread's tid, which the parent holds
+   until it has waited for the child, so that a pid stays unique
+   among a process's children.
+
+   A tid that nobody holds goes to the back of free_tids, and new
+   tids come from the front, so a tid is reused only after every
+   other free tid has been.  A stale tid kept somewhere, such as
+   in a semaphore's owner, thus names no thread at all for
+   thousands of thread creations rather than a newer one.
+
+   The arrays come from palloc, so they are set up in
+   thread_start(); until then the initial thread, which takes tid
+   1, is the only thread.  All of this is protected by disabling
+   interrupts. */
+static struct thread** tid_table; /* Live threads by tid. */
+static uint8_t* tid_refs;         /* Holders of each tid. */
+static uint16_t* free_tids;       /* Ring of tids no one holds, oldest first. */
+static int free_tid_head;         /* Index in free_tids of the oldest. */
+static int free_tid_cnt;          /* Number of tids in free_tids. */
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread* initial_thread;
 
-/* Lock used by allocate_tid(). */
-static struct lock tid_lock;
+/* Cache of recycled thread pages.  Instead of returning the page
+   of a dead thread to palloc, up to THREAD_CACHE_SIZE of them are
+   kept on dirty_thread_pages.  The idle thread zeroes them and
+   moves them to clean_thread_pages, from which thread_create()
+   takes its pages without scanning the page allocator's bitmap or
+   zeroing 4 kB itself.  Both lists are protected by disabling
+   interrupts. */
+#define THREAD_CACHE_SIZE 8
+struct thread_page {
+  struct list_elem elem; /* Element in one of the cache lists. */
+};
+static struct list dirty_thread_pages;
+static struct list clean_thread_pages;
+static int thread_cache_cnt; /* Pages on either list. */
 
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame {
@@ -47,43 +208,150 @@ struct kernel_thread_frame {
 };
 
 /* Statistics. */
-static long long idle_ticks;   /* # of timer ticks spent idle. */
-static long long kernel_ticks; /* # of timer ticks in kernel threads. */
-static long long user_ticks;   /* # of timer ticks in user programs. */
-
-/* Scheduling. */
-#define TIME_SLICE 4          /* # of timer ticks to give each thread. */
+static struct percpu_counter idle_ticks;   /* # of timer ticks spent idle. */
+static struct percpu_counter kernel_ticks; /* # of timer ticks in kernel threads. */
+static struct percpu_counter user_ticks;   /* # of timer ticks in user programs. */
+
+/* Scheduler statistics, in TSC cycles. */
+static struct percpu_counter total_run_cycles;   /* Time non-idle threads spent running. */
+static struct percpu_counter total_ready_cycles; /* Time threads spent on the run queue. */
+static struct percpu_counter voluntary_switches;
+static struct percpu_counter involuntary_switches;
+static uint32_t latency_hist[SCHED_LATENCY_BUCKETS]; /* Wakeup-to-run latencies. */
+
+/* Scheduling.  Each thread runs for at most its own time slice,
+   in timer ticks, before it is preempted.  A thread that uses up
+   its whole slice is taken to be CPU-bound, and its slice doubles,
+   up to the policy's maximum, so that it is switched out less
+   often.  A thread that blocks before then has its slice halved,
+   down to the policy's minimum.
+
+   Under SCHED_FIFO and SCHED_PRIO, a thread woken by
+   thread_unblock() is boosted: it is queued at the front of its
+   ready list instead of the back, and a running thread of the
+   same priority that has had at least the minimum slice is
+   preempted at the next tick.  So a thread waiting for I/O waits
+   for at most the minimum slice of a CPU-bound one once its I/O
+   is done, not the maximum.
+
+   A user thread that knows which thread should run next, such as
+   the one it just released a lock to, can pass it what is left
+   of its slice with thread_yield_to() instead of leaving it to
+   wait its turn.
+
+   SCHED_FAIR charges by the tick and SCHED_MLFQS follows 4.4BSD,
+   so their slices stay at TIME_SLICE unless the kernel command
+   line says otherwise.  The active policy's slices are also the
+   sched.slice_min and sched.slice_max tunables. */
+#define TIME_SLICE 4          /* Default minimum slice. */
+#define TIME_SLICE_ADAPT 16   /* Default maximum slice for SCHED_FIFO and SCHED_PRIO. */
 static unsigned thread_ticks; /* # of timer ticks since last yield. */
 
+/* Minimum and maximum time slice for each policy. */
+static struct time_slice {
+  unsigned min;
+  unsigned max;
+} time_slices[] = {
+    [SCHED_FIFO] = {TIME_SLICE, TIME_SLICE_ADAPT},
+    [SCHED_PRIO] = {TIME_SLICE, TIME_SLICE_ADAPT},
+    [SCHED_FAIR] = {TIME_SLICE, TIME_SLICE},
+    [SCHED_MLFQS] = {TIME_SLICE, TIME_SLICE},
+};
+
+/* Preemption latency.  A reschedule is due once a thread that
+   should preempt the running one becomes ready, or the running
+   thread's slice runs out.  resched_due records when, until the
+   next thread switch, which thread_yield_if_needed() brings
+   forward in long kernel loops.  The tracer keeps the longest
+   wait seen, the thread that made it and where it ended, and
+   also the latest timer tick, for which interrupts must have
+   been off, with the first few frames of the call stack that
+   turned them back on. */
+#define TICK_GAP_FRAMES 4
+static uint64_t resched_due;                  /* When a reschedule became due, or 0. */
+static void* switch_site;                     /* Caller of the thread_yield() in progress. */
+static uint64_t resched_max;                  /* Longest wait for a reschedule, in TSC cycles. */
+static void* resched_max_site;                /* Where it ended. */
+static char resched_max_name[16];             /* Thread that ran meanwhile. */
+static uint64_t last_tick;                    /* When the previous timer tick came, or 0. */
+static uint64_t tick_gap_max;                 /* Longest time between timer ticks. */
+static void* tick_gap_trace[TICK_GAP_FRAMES]; /* Call stack the latest tick interrupted. */
+static long long preemption_points;           /* Yields from thread_yield_if_needed(). */
+
+/* Time slice statistics. */
+static long long slices_expired;    /* Threads preempted for using up their slice. */
+static long long boosts;            /* Woken threads queued at the front. */
+static long long boost_preemptions; /* Threads preempted early for a boosted one. */
+
+/* Scheduling hints.  thread_yield_to() sets handoff_thread to the
+   thread it hands the CPU to, which runs next, for handoff_ticks
+   more ticks, and clears it once that thread runs. */
+static struct thread* handoff_thread;
+static unsigned handoff_ticks;
+static long long handoffs; /* Slices handed over by thread_yield_to(). */
+
 static void init_thread(struct thread*, const char* name, int priority);
 static bool is_thread(struct thread*) UNUSED;
 static void* alloc_frame(struct thread*, size_t size);
 static void schedule(void);
 static void thread_enqueue(struct thread* t);
-static tid_t allocate_tid(void);
+static void prio_ready_push(struct cpu* cpu, struct thread* t);
+static void prio_ready_remove(struct thread* t);
+static int prio_ready_highest(const struct cpu* cpu);
+static struct thread* prio_ready_pop(struct cpu* cpu);
+static void mlfqs_tick(struct thread* cur);
+static int mlfqs_compute_priority(struct thread* t);
+static void mlfqs_update_priority(struct thread* t);
+static void mlfqs_update_recent_cpu(struct thread* t, void* aux);
+static bool fair_pass_less(const struct rb_elem* a, const struct rb_elem* b, void* aux);
+static int64_t fair_stride(struct thread* t);
+static bool dl_active(const struct thread* t);
+static bool dl_deadline_less(const struct list_elem* a, const struct list_elem* b, void* aux);
+static void dl_throttle(struct thread* t);
+static void dl_replenish(void* t);
+static void dl_leave(struct thread* t);
+#ifdef USERPROG
+static void quota_tick(struct thread* t, bool user);
+static void quota_replenish(void* q);
+#endif
+static void init_tids(void);
+static tid_t allocate_tid(int refs);
+static void release_tid(tid_t);
+static tid_t create_thread(const char* name, int priority, thread_func*, void* aux, bool held);
+static struct thread* thread_page_alloc(void);
+static void thread_page_free(struct thread* t);
+static void thread_page_zero_one(void);
 void thread_switch_tail(struct thread* prev);
 
 static void kernel_thread(thread_func*, void* aux);
 static void idle(void* aux UNUSED);
-static struct thread* running_thread(void);
 
 static struct thread* next_thread_to_run(void);
-static struct thread* thread_schedule_fifo(void);
-static struct thread* thread_schedule_prio(void);
-static struct thread* thread_schedule_fair(void);
-static struct thread* thread_schedule_mlfqs(void);
-static struct thread* thread_schedule_reserved(void);
+static struct thread* cpu_pick(struct cpu* cpu);
+static struct thread* thread_schedule_fifo(struct cpu* cpu);
+static struct thread* thread_schedule_prio(struct cpu* cpu);
+static struct thread* thread_schedule_fair(struct cpu* cpu);
+static struct thread* thread_schedule_mlfqs(struct cpu* cpu);
+static struct thread* thread_schedule_reserved(struct cpu* cpu);
+static bool boost_waiting(struct thread* cur);
+static void resched_mark(void);
+static void yield_from(void* site);
 
 /* Determines which scheduler the kernel should use.
    Controlled by the kernel command-line options
     "-sched=fifo", "-sched=prio",
     "-sched=fair". "-sched=mlfqs"
-   Is equal to SCHED_FIFO by default. */
+   Is equal to SCHED_FIFO by default.  A constant instead in a
+   kernel built with SCHED_FIXED. */
+#ifndef SCHED_FIXED
 enum sched_policy active_sched_policy;
+#endif
 
-/* Selects a thread to run from the ready list according to
-   some scheduling policy, and returns a pointer to it. */
-typedef struct thread* scheduler_func(void);
+/* Removes a thread from CPU's ready queues according to some
+   scheduling policy, and returns a pointer to it, or a null
+   pointer if CPU has no ready thread.  CPU's lock must be
+   held. */
+typedef struct thread* scheduler_func(struct cpu* cpu);
 
 /* Jump table for dynamically dispatching the current scheduling
    policy in use by the kernel. */
@@ -94,6 +362,19 @@ scheduler_func* scheduler_jump_table[8] = {thread_schedule_fifo,     thread_sche
 
 static void thread_update_donations(struct thread* t);
 
+/* Initializes CPU's scheduler state, with empty ready queues. */
+static void cpu_init(struct cpu* cpu) {
+  spin_init(&cpu->lock, "ready queues");
+  list_init(&cpu->fifo_ready_list);
+  for (int i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init(&cpu->prio_ready_lists[i]);
+  cpu->prio_ready_bitmap = 0;
+  cpu->prio_ready_cnt = 0;
+  rb_init(&cpu->fair_ready_tree, fair_pass_less, NULL);
+  cpu->fair_vtime = 0;
+  list_init(&cpu->dl_ready_list);
+}
+
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
    general and it is possible in this case only because loader.S
@@ -110,20 +391,29 @@ static void thread_update_donations(struct thread* t);
 void thread_init(void) {
   ASSERT(intr_get_level() == INTR_OFF);
 
-  lock_init(&tid_lock);
-  list_init(&fifo_ready_list);
+  list_init(&dirty_thread_pages);
+  list_init(&clean_thread_pages);
+  thread_cache_cnt = 0;
+  for (unsigned i = 0; i < CPU_CNT; i++)
+    cpu_init(&cpus[i]);
+  list_init(&mlfqs_dirty_list);
+  load_avg = fix_int(0);
   list_init(&all_list);
+  tunable_register_uint("sched.slice_min", &time_slices[active_sched_policy].min, 1, TIMER_FREQ);
+  tunable_register_uint("sched.slice_max", &time_slices[active_sched_policy].max, 1, TIMER_FREQ);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread();
   init_thread(initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
-  initial_thread->tid = allocate_tid();
+  initial_thread->tid = 1;
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
    Also creates the idle thread. */
 void thread_start(void) {
+  init_tids();
+
   /* Create the idle thread. */
   struct semaphore idle_started;
   sema_init(&idle_started, 0);
@@ -137,29 +427,194 @@ void thread_start(void) {
 }
 
 /* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
-void thread_tick(void) {
+   F is the frame of the code that the tick interrupted.  Thus,
+   this function runs in an external interrupt context. */
+void thread_tick(struct intr_frame* f) {
+  struct cpu* cpu = this_cpu();
   struct thread* t = thread_current();
+  uint64_t now = rdtsc();
+
+  profile_sample(f);
+
+  /* Trace the latest tick.  Ticks skipped by the tickless idle
+     loop do not count. */
+  if (last_tick != 0 && now - last_tick > tick_gap_max) {
+    void** frame = (void**)f->ebp;
+    int i;
+
+    tick_gap_max = now - last_tick;
+    memset(tick_gap_trace, 0, sizeof tick_gap_trace);
+    tick_gap_trace[0] = (void*)f->eip;
+    if ((f->cs & 3) == 0)
+      for (i = 1; i < TICK_GAP_FRAMES && is_kernel_vaddr(frame) && frame[0] != NULL; i++) {
+        tick_gap_trace[i] = frame[1];
+        frame = frame[0];
+      }
+  }
+  last_tick = now;
 
   /* Update statistics. */
-  if (t == idle_thread)
-    idle_ticks++;
+  if (t == cpu->idle_thread)
+    percpu_counter_inc(&idle_ticks);
 #ifdef USERPROG
-  else if (t->pcb != NULL)
-    user_ticks++;
+  else if (t->pcb != NULL) {
+    percpu_counter_inc(&user_ticks);
+    if (is_trap_from_userspace(f))
+      t->pcb->usage.user_ticks++;
+    else
+      t->pcb->usage.kernel_ticks++;
+    quota_tick(t, is_trap_from_userspace(f));
+  }
 #endif
   else
-    kernel_ticks++;
-
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+    percpu_counter_inc(&kernel_ticks);
+
+  if (active_sched_policy == SCHED_MLFQS)
+    mlfqs_tick(t);
+  else if (active_sched_policy == SCHED_FAIR && t != cpu->idle_thread)
+    t->fair_pass += fair_stride(t);
+
+  /* Enforce preemption.  A deadline thread runs until its budget
+     runs out or an earlier deadline preempts it. */
+  if (dl_active(t)) {
+    if (--t->dl_runtime <= 0) {
+      dl_throttle(t);
+      resched_mark();
+      intr_yield_on_return();
+    }
+  } else if (++thread_ticks >= t->slice) {
+    if (t != cpu->idle_thread)
+      slices_expired++;
+    resched_mark();
+    intr_yield_on_return();
+  } else if (thread_ticks >= time_slices[active_sched_policy].min && boost_waiting(t)) {
+    boost_preemptions++;
+    resched_mark();
     intr_yield_on_return();
+  }
+}
+
+/* Notes that a reschedule is due, if one was not already.
+   Interrupts must be off. */
+static void resched_mark(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (resched_due == 0)
+    resched_due = rdtsc();
+}
+
+/* Sets the minimum and maximum time slice, in timer ticks, for
+   POLICY.  Must be called before thread_init(). */
+void thread_set_time_slice(enum sched_policy policy, unsigned min, unsigned max) {
+  ASSERT(policy < sizeof time_slices / sizeof *time_slices);
+  ASSERT(min >= 1 && min <= max);
+
+  time_slices[policy].min = min;
+  time_slices[policy].max = max;
+}
+
+/* Returns true if the ready thread that would run next was
+   boosted by thread_unblock() and has the same effective
+   priority as CUR, the running thread.  (A higher one preempts
+   CUR anyway.)  Interrupts must be off. */
+static bool boost_waiting(struct thread* cur) {
+  struct cpu* cpu = this_cpu();
+  struct list* queue = NULL;
+  bool boosted = false;
+  int priority;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (cur == cpu->idle_thread)
+    return false;
+  spin_lock(&cpu->lock);
+  if (active_sched_policy == SCHED_FIFO) {
+    queue = &cpu->fifo_ready_list;
+  } else if (active_sched_policy == SCHED_PRIO) {
+    priority = prio_ready_highest(cpu);
+    if (priority >= 0 && priority == thread_get_priority_of(cur))
+      queue = &cpu->prio_ready_lists[priority];
+  }
+  if (queue != NULL && !list_empty(queue))
+    boosted = list_entry(list_front(queue), struct thread, elem)->boosted;
+  spin_unlock(&cpu->lock);
+  return boosted;
+}
+
+/* Accounts for TICKS timer ticks that the idle thread spent
+   halted without taking a timer interrupt. */
+void thread_idle_ticks(int64_t ticks) {
+  percpu_counter_add(&idle_ticks, ticks);
+  last_tick = 0;
 }
 
 /* Prints thread statistics. */
 void thread_print_stats(void) {
-  printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n", idle_ticks, kernel_ticks,
-         user_ticks);
+  int last;
+
+  printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
+         percpu_counter_sum(&idle_ticks), percpu_counter_sum(&kernel_ticks),
+         percpu_counter_sum(&user_ticks));
+  printf("Scheduler: %llu cycles running, %llu cycles ready, "
+         "%lld voluntary switches, %lld involuntary switches\n",
+         percpu_counter_sum(&total_run_cycles), percpu_counter_sum(&total_ready_cycles),
+         percpu_counter_sum(&voluntary_switches), percpu_counter_sum(&involuntary_switches));
+  printf("Time slices: %u to %u ticks, %lld used up, %lld handed over, "
+         "%lld boosts, %lld preempted for a boost\n",
+         time_slices[active_sched_policy].min, time_slices[active_sched_policy].max,
+         slices_expired, handoffs, boosts, boost_preemptions);
+  printf("Deadline class: %d threads, %d%% reserved, %lld throttles, %lld misses\n", dl_members,
+         dl_util * 100 / DL_UNIT, dl_throttles, dl_misses);
+  printf("CPU quotas: %lld throttles\n", quota_throttles);
+  printf("Tids: %d in use of %d\n", TID_MAX - 1 - free_tid_cnt, TID_MAX - 1);
+
+  /* Wakeup latency histogram, omitting empty buckets at the end. */
+  for (last = SCHED_LATENCY_BUCKETS - 1; last >= 0; last--)
+    if (latency_hist[last] != 0)
+      break;
+  if (last >= 0) {
+    printf("Wakeup latency (log2 cycles:count):");
+    for (int i = 0; i <= last; i++)
+      if (latency_hist[i] != 0)
+        printf(" %d:%" PRIu32, i, latency_hist[i]);
+    printf("\n");
+  }
+
+  printf("Preemption: %lld points yielded, longest wait %" PRId64 " us", preemption_points,
+         clock_cycles_to_ns(resched_max) / 1000);
+  if (resched_max != 0)
+    printf(" in %s ending at %p", resched_max_name, resched_max_site);
+  printf(", longest tick gap %" PRId64 " us", clock_cycles_to_ns(tick_gap_max) / 1000);
+  if (tick_gap_max != 0) {
+    printf(" ending at");
+    for (int i = 0; i < TICK_GAP_FRAMES && tick_gap_trace[i] != NULL; i++)
+      printf(" %p", tick_gap_trace[i]);
+  }
+  printf("\n");
+}
+
+/* Stores the running thread's scheduler statistics and the
+   system-wide wakeup latency histogram into STATS, which must be
+   in kernel memory, since they are copied with interrupts off. */
+void thread_get_sched_stats(struct sched_stats* stats) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level = intr_disable();
+
+  /* Include the current run, which schedule() has not charged yet. */
+  stats->run_cycles = cur->run_cycles + (rdtsc() - cur->run_start);
+  stats->ready_cycles = cur->ready_cycles;
+  stats->voluntary_switches = cur->voluntary_switches;
+  stats->involuntary_switches = cur->involuntary_switches;
+  stats->time_slice = cur->slice;
+  stats->slices_used_up = cur->slices_used_up;
+  stats->deadline_throttles = cur->dl_throttles;
+  stats->deadline_misses = cur->dl_misses;
+  stats->block_read_bytes = cur->block_read_bytes;
+  stats->block_write_bytes = cur->block_write_bytes;
+  stats->block_wait_cycles = cur->block_wait_cycles;
+  memcpy(stats->latency_hist, latency_hist, sizeof latency_hist);
+
+  intr_set_level(old_level);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -178,22 +633,47 @@ void thread_print_stats(void) {
    PRIORITY, but no actual priority scheduling is implemented.
    Priority scheduling is the goal of Problem 1-3. */
 tid_t thread_create(const char* name, int priority, thread_func* function, void* aux) {
+  return create_thread(name, priority, function, aux, false);
+}
+
+/* Like thread_create(), but the caller also holds the new
+   thread's tid, so that it is not reused after the thread exits
+   until the caller calls thread_tid_release() for it.  Returns
+   TID_ERROR, with nothing held, if creation fails. */
+tid_t thread_create_held(const char* name, int priority, thread_func* function, void* aux) {
+  return create_thread(name, priority, function, aux, true);
+}
+
+/* Creates a thread for thread_create() or, if HELD is true,
+   thread_create_held(). */
+static tid_t create_thread(const char* name, int priority, thread_func* function, void* aux,
+                           bool held) {
   struct thread* t;
   struct kernel_thread_frame* kf;
   struct switch_entry_frame* ef;
   struct switch_threads_frame* sf;
+  enum intr_level old_level;
   tid_t tid;
 
   ASSERT(function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page(PAL_ZERO);
+  t = thread_page_alloc();
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread(t, name, priority);
-  tid = t->tid = allocate_tid();
+  old_level = intr_disable();
+  tid = t->tid = allocate_tid(held ? 2 : 1);
+  if (tid == TID_ERROR) {
+    list_remove(&t->allelem);
+    intr_set_level(old_level);
+    thread_page_free(t);
+    return TID_ERROR;
+  }
+  tid_table[tid] = t;
+  intr_set_level(old_level);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame(t, sizeof *kf);
@@ -229,6 +709,7 @@ void thread_block(void) {
   ASSERT(!intr_context());
   ASSERT(intr_get_level() == INTR_OFF);
 
+  switch_site = __builtin_return_address(0);
   thread_current()->status = THREAD_BLOCKED;
   schedule();
 }
@@ -240,20 +721,158 @@ bool thread_priority_less(const struct list_elem* a, const struct list_elem* b,
   return thread_get_priority_of(thread_a) < thread_get_priority_of(thread_b);
 }
 
-void sort_priority_ready_list(void) { list_sort(&fifo_ready_list, thread_priority_less, NULL); }
+/* Adds T to the back of CPU's SCHED_PRIO ready list matching its
+   current effective priority.  CPU's lock must be held. */
+static void prio_ready_push(struct cpu* cpu, struct thread* t) {
+  int priority = thread_get_priority_of(t);
+
+  if (t->wake_priority > priority)
+    priority = t->wake_priority;
+  t->ready_priority = priority;
+  if (t->boosted)
+    list_push_front(&cpu->prio_ready_lists[priority], &t->elem);
+  else
+    list_push_back(&cpu->prio_ready_lists[priority], &t->elem);
+  cpu->prio_ready_bitmap |= (uint64_t)1 << priority;
+  cpu->prio_ready_cnt++;
+}
+
+/* Removes T from the SCHED_PRIO ready list it was queued on.
+   The lock of T's CPU must be held. */
+static void prio_ready_remove(struct thread* t) {
+  struct cpu* cpu = t->cpu;
+
+  ASSERT(spin_held(&cpu->lock));
+
+  list_remove(&t->elem);
+  if (list_empty(&cpu->prio_ready_lists[t->ready_priority]))
+    cpu->prio_ready_bitmap &= ~((uint64_t)1 << t->ready_priority);
+  cpu->prio_ready_cnt--;
+}
+
+/* Returns the highest priority with a nonempty SCHED_PRIO ready
+   list on CPU, or -1 if no thread is ready there. */
+static int prio_ready_highest(const struct cpu* cpu) {
+  if (cpu->prio_ready_bitmap == 0)
+    return -1;
+  return 63 - __builtin_clzll(cpu->prio_ready_bitmap);
+}
+
+/* Removes and returns the first thread on CPU's highest-priority
+   nonempty SCHED_PRIO ready list, or a null pointer if there is
+   none.  CPU's lock must be held. */
+static struct thread* prio_ready_pop(struct cpu* cpu) {
+  int priority = prio_ready_highest(cpu);
+  if (priority < 0)
+    return NULL;
+
+  struct thread* next =
+      list_entry(list_pop_front(&cpu->prio_ready_lists[priority]), struct thread, elem);
+  if (list_empty(&cpu->prio_ready_lists[priority]))
+    cpu->prio_ready_bitmap &= ~((uint64_t)1 << priority);
+  cpu->prio_ready_cnt--;
+  return next;
+}
+
+/* Must be called, with interrupts off, whenever T's effective
+   priority may have changed (e.g. a donation was made to it or
+   revoked, or its base priority was set).  Recomputes T's cached
+   effective priority, and if T is sitting on a SCHED_PRIO ready
+   list for a different priority, moves it to the list for its
+   new one. */
+void thread_priority_changed(struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(is_thread(t));
+
+  t->effective_priority = t->priority;
+  if (!list_empty(&t->donations)) {
+    int donated_priority =
+        list_entry(list_max(&t->donations, donation_priority_less, NULL), struct donation, elem)
+            ->donated_priority;
+    if (donated_priority > t->effective_priority)
+      t->effective_priority = donated_priority;
+  }
+  if (t->status == THREAD_BLOCKED && t->wait_elem != NULL)
+    wait_queue_update(t->wait_elem);
+
+  if ((active_sched_policy != SCHED_PRIO && active_sched_policy != SCHED_MLFQS) ||
+      t->status != THREAD_READY || dl_active(t) || t->quota_held)
+    return;
+  if (t->ready_priority == thread_get_priority_of(t))
+    return;
+
+  spin_lock(&t->cpu->lock);
+  prio_ready_remove(t);
+  prio_ready_push(t->cpu, t);
+  spin_unlock(&t->cpu->lock);
+}
+
+/* Removes ready thread T from the run queue without scheduling
+   it, e.g. because its process is being torn down.
 
-/* Places a thread on the ready structure appropriate for the
-   current active scheduling policy.
+   This function must be called with interrupts turned off. */
+void thread_dequeue(struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(is_thread(t));
+  ASSERT(t->status == THREAD_READY);
+
+  /* A held thread that is ready is on its quota's parked list.  It
+     stays held, so thread_enqueue() parks it again. */
+  if (t->quota_held) {
+    list_remove(&t->elem);
+    return;
+  }
+
+  spin_lock(&t->cpu->lock);
+  if (dl_active(t))
+    list_remove(&t->elem);
+  else if (active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS)
+    prio_ready_remove(t);
+  else if (active_sched_policy == SCHED_FAIR)
+    rb_remove(&t->cpu->fair_ready_tree, &t->fair_elem);
+  else
+    list_remove(&t->elem);
+  spin_unlock(&t->cpu->lock);
+}
+
+/* Places a thread on the running CPU's ready structure
+   appropriate for the current active scheduling policy.
    
    This function must be called with interrupts turned off. */
 static void thread_enqueue(struct thread* t) {
+  struct cpu* cpu = this_cpu();
+
   ASSERT(intr_get_level() == INTR_OFF);
   ASSERT(is_thread(t));
 
-  if (active_sched_policy == SCHED_FIFO || active_sched_policy == SCHED_PRIO) {
-    list_push_back(&fifo_ready_list, &t->elem);
+  t->ready_start = rdtsc();
+#ifdef USERPROG
+  if (t->quota_held) {
+    if (t->pcb != NULL && t->pcb->cpu_quota.throttled) {
+      list_push_back(&t->pcb->cpu_quota.parked, &t->elem);
+      return;
+    }
+    t->quota_held = false;
+  }
+#endif
+  t->cpu = cpu;
+  spin_lock(&cpu->lock);
+  if (dl_active(t)) {
+    list_insert_ordered(&cpu->dl_ready_list, &t->elem, dl_deadline_less, NULL);
+  } else if (active_sched_policy == SCHED_FIFO) {
+    if (t->boosted)
+      list_push_front(&cpu->fifo_ready_list, &t->elem);
+    else
+      list_push_back(&cpu->fifo_ready_list, &t->elem);
+  } else if (active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS) {
+    prio_ready_push(cpu, t);
+  } else if (active_sched_policy == SCHED_FAIR) {
+    if (t->fair_pass < cpu->fair_vtime)
+      t->fair_pass = cpu->fair_vtime;
+    rb_insert(&cpu->fair_ready_tree, &t->fair_elem);
   } else
     PANIC("Unimplemented scheduling policy value: %d", active_sched_policy);
+  spin_unlock(&cpu->lock);
 }
 
 /* Transitions a blocked thread T to the ready-to-run state.
@@ -263,7 +882,8 @@ static void thread_enqueue(struct thread* t) {
    This function does not preempt the running thread if it still has the highest priority.
    This can be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  In an interrupt handler, it does arrange to
+   yield on return for a deadline thread that should preempt. */
 void thread_unblock(struct thread* t) {
   enum intr_level old_level;
 
@@ -271,11 +891,63 @@ void thread_unblock(struct thread* t) {
 
   old_level = intr_disable();
   ASSERT(t->status == THREAD_BLOCKED);
+  if (dl_active(t)) {
+    int64_t now = timer_ticks();
+
+    /* Start a new period if T's remaining budget would exceed its
+       reserved rate over what is left of the current one. */
+    if (now >= t->dl_deadline ||
+        t->dl_runtime * t->dl_period > (t->dl_deadline - now) * t->dl_budget) {
+      t->dl_deadline = now + t->dl_period;
+      t->dl_runtime = t->dl_budget;
+    }
+  }
+  if (active_sched_policy == SCHED_FIFO || active_sched_policy == SCHED_PRIO) {
+    t->boosted = true;
+    boosts++;
+  }
   thread_enqueue(t);
   t->status = THREAD_READY;
+  t->woken = true;
+  if (thread_deadline_preempts(t)) {
+    resched_mark();
+    if (intr_context())
+      intr_yield_on_return();
+  } else if ((active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS) &&
+             thread_get_priority_of(t) > thread_get_priority_of(running_thread()))
+    resched_mark();
   intr_set_level(old_level);
 }
 
+#ifdef USERPROG
+/* Unblocks T as thread_unblock() does, but under SCHED_PRIO and
+   SCHED_MLFQS queues it as if its priority were at least
+   PRIORITY, so that threads woken together by a thread of that
+   priority, such as the waiters at a barrier, all run before
+   anything of lower priority.  The lift lasts until T runs or
+   its priority changes.  It does not make T preempt the running
+   thread. */
+void thread_unblock_at(struct thread* t, int priority) {
+  enum intr_level old_level = intr_disable();
+
+  t->wake_priority = priority;
+  thread_unblock(t);
+  t->wake_priority = PRI_MIN;
+  intr_set_level(old_level);
+}
+#endif
+
+/* Returns true if ready thread T is in the deadline class and
+   has an earlier deadline than the running thread, which is not
+   necessarily in the class.  Interrupts must be off. */
+bool thread_deadline_preempts(const struct thread* t) {
+  const struct thread* cur = running_thread();
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  return dl_active(t) && (!dl_active(cur) || t->dl_deadline < cur->dl_deadline);
+}
+
 /* Returns the name of the running thread. */
 const char* thread_name(void) { return thread_current()->name; }
 
@@ -299,46 +971,34 @@ struct thread* thread_current(void) {
 /* Returns the running thread's tid. */
 tid_t thread_tid(void) { return thread_current()->tid; }
 
-/* Recursively revoke donations it has made */
-static void thread_revoke_made_donations_recurse(struct thread* donor, struct thread* donee) {
-  if (donee == NULL) {
-    return;
-  }
-
-  if (list_empty(&donee->donations)) {
-    return;
-  }
-
-  if (donee->donating_to == NULL) {
-    return;
-  }
+/* Withdraws the donation T is making, if any, and lets the
+   priority drop propagate down the rest of the donation chain.
 
-  donor->donating_to = NULL;
+   This function must be called with interrupts turned off. */
+void thread_revoke_made_donations(struct thread* t) {
+  struct thread* donee = t->donating_to;
 
-  struct list_elem* e = list_begin(&donee->donations);
+  ASSERT(intr_get_level() == INTR_OFF);
 
-  while (e != NULL) {
-    struct donation* d = list_entry(e, struct donation, elem);
-    struct list_elem* next = list_next(e);
-    if (d->donor == donor) {
-      free(d);
-      list_remove(e);
-    }
-    e = next;
-  }
+  if (donee == NULL)
+    return;
 
-  thread_revoke_made_donations_recurse(donee, donee->donating_to);
+  list_remove(&t->donation.elem);
+  t->donating_to = NULL;
+  thread_priority_changed(donee);
+  thread_update_donations(donee);
 }
 
-/* Revoke complete donation chain it has made */
-void thread_revoke_made_donations(struct thread* t) {
-  thread_revoke_made_donations_recurse(t, t->donating_to);
-}
+/* Drops every donation T has received.  The donors stop
+   donating to anyone.
 
+   This function must be called with interrupts turned off. */
 void thread_revoke_received_donations(struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
   while (!list_empty(&t->donations)) {
     struct donation* d = list_entry(list_pop_front(&t->donations), struct donation, elem);
-    free(d);
+    d->donor->donating_to = NULL;
   }
 }
 
@@ -356,50 +1016,52 @@ bool donation_priority_less(const struct list_elem* a, const struct list_elem* b
   return d_a->donated_priority < d_b->donated_priority;
 }
 
-void thread_sort_donations(struct thread* t) {
-  list_sort(&t->donations, donation_priority_less, NULL);
-}
-
+/* Returns the donation DONOR is making to DONEE, or a null
+   pointer if DONOR is not donating to DONEE.  A thread donates
+   to at most one other thread, through its own embedded
+   `donation' record, so this is a constant-time check. */
 struct donation* find_donation_by_donor_and_donee(struct thread* donor, struct thread* donee) {
-  if (list_empty(&donee->donations)) {
-    return NULL;
-  }
-  struct list_elem* e;
-  for (e = list_begin(&donee->donations); e != list_end(&donee->donations); e = list_next(e)) {
-    struct donation* d = list_entry(e, struct donation, elem);
-    if (d->donor == donor) {
-      return d;
-    }
-  }
-  return NULL;
+  return donor->donating_to == donee && donee != NULL ? &donor->donation : NULL;
 }
 
-static void thread_update_donations_recurse(struct thread* donor, struct thread* donee) {
-  if (donee == NULL) {
-    return;
-  }
+/* Makes T donate its effective priority to HOLDER, the holder
+   of RESOURCE, a lock or owned semaphore that T is about to wait
+   for, and propagates the donation down HOLDER's own donation
+   chain.  The donation
+   record is embedded in T, so this never allocates memory.
 
-  if (list_empty(&donee->donations)) {
-    return;
-  }
+   This function must be called with interrupts turned off. */
+void thread_donate_priority(struct thread* t, struct thread* holder, const void* resource) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(t->donating_to == NULL);
+  ASSERT(holder != NULL && holder != t);
 
-  struct donation* found_donation = find_donation_by_donor_and_donee(donor, donee);
-  if (found_donation == NULL) {
-    return;
-  }
-  found_donation->donated_priority = thread_get_priority_of(donor);
-  thread_sort_donations(donee);
+  t->donation.donor = t;
+  t->donation.resource = resource;
+  t->donation.donated_priority = thread_get_priority_of(t);
+  list_push_back(&holder->donations, &t->donation.elem);
+  t->donating_to = holder;
 
-  thread_update_donations_recurse(donee, donee->donating_to);
+  thread_priority_changed(holder);
+  thread_update_donations(holder);
 }
 
-/* Updates donations this thread has made to others with new effective priority. Donations are updated down
-  the donation chain */
+/* Updates the donation T is making, and the ones its donee is
+   making in turn, down the chain, to match T's current
+   effective priority.  Stops as soon as a donation does not
+   change, since nothing past it can change either.
+
+   This function must be called with interrupts turned off. */
 static void thread_update_donations(struct thread* t) {
-  if (t->donating_to == NULL) {
-    return;
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  for (; t->donating_to != NULL; t = t->donating_to) {
+    int priority = thread_get_priority_of(t);
+    if (t->donation.donated_priority == priority)
+      break;
+    t->donation.donated_priority = priority;
+    thread_priority_changed(t->donating_to);
   }
-  thread_update_donations_recurse(t, t->donating_to);
 }
 
 /* Deschedules the current thread and destroys it.  Never
@@ -413,6 +1075,8 @@ void thread_exit(void) {
   intr_disable();
   list_remove(&thread_current()->allelem);
   struct thread* t = thread_current();
+  tid_table[t->tid] = NULL;
+  release_tid(t->tid);
   t->status = THREAD_DYING;
 
   /* Remove all donations this thread made to other threads directly and recursively.
@@ -422,21 +1086,56 @@ void thread_exit(void) {
   if (active_sched_policy == SCHED_PRIO) {
     thread_revoke_donations(t);
   }
+  if (t->mlfqs_dirty)
+    list_remove(&t->mlfqs_elem);
+  dl_leave(t);
 
+  switch_site = __builtin_return_address(0);
   schedule();
   NOT_REACHED();
 }
 
+/* Destroys thread T, which must not be the running thread,
+   without scheduling it again: removes it from whatever
+   scheduler queues it is on and frees its page.  Used to tear
+   down the other threads of an exiting process.
+
+   This function must be called with interrupts turned off. */
+void thread_discard(struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(is_thread(t));
+  ASSERT(t != running_thread());
+
+  if (t->status == THREAD_READY)
+    thread_dequeue(t);
+  else if (t->wait_elem != NULL)
+    wait_queue_remove(t->wait_elem);
+  timer_cancel_callout(&t->sleep_callout);
+  dl_leave(t);
+  thread_revoke_donations(t);
+  if (t->mlfqs_dirty)
+    list_remove(&t->mlfqs_elem);
+  list_remove(&t->allelem);
+  tid_table[t->tid] = NULL;
+  release_tid(t->tid);
+  thread_page_free(t);
+}
+
 /* Yields the CPU.  The current thread is not put to sleep and
    may be scheduled again immediately at the scheduler's whim. */
-void thread_yield(void) {
+void thread_yield(void) { yield_from(__builtin_return_address(0)); }
+
+/* Yields the CPU for the caller at SITE, which the latency
+   tracer records. */
+static void yield_from(void* site) {
   struct thread* cur = thread_current();
   enum intr_level old_level;
 
   ASSERT(!intr_context());
 
   old_level = intr_disable();
-  if (cur != idle_thread) {
+  switch_site = site;
+  if (cur != this_cpu()->idle_thread) {
     thread_enqueue(cur);
   }
   cur->status = THREAD_READY;
@@ -444,29 +1143,93 @@ void thread_yield(void) {
   intr_set_level(old_level);
 }
 
-struct thread* thread_get_by_tid(tid_t tid) {
-  enum intr_level old_level = intr_disable();
-  struct list_elem* e;
+#ifdef USERPROG
+/* Gives the rest of the running thread's time slice to the ready
+   thread whose tid is TID, which must be in the same process:
+   that thread runs next, until the slice would have ended or its
+   own time slice does, whichever is sooner, and the running
+   thread is queued as thread_yield() queues it.  A thread that
+   would preempt the running one, such as a higher priority
+   thread under SCHED_PRIO, still preempts TID.  Returns true
+   once the running thread runs again.
+
+   Returns false at once, without yielding, if TID is not a
+   ready thread of this process, if it or the running thread is
+   in the deadline class or TID is held back by a CPU quota, or
+   if a deadline thread is waiting to run. */
+bool thread_yield_to(tid_t tid) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+  struct thread* t;
 
-  struct thread* found_thread = NULL;
-  for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)) {
-    struct thread* t = list_entry(e, struct thread, allelem);
-    if (t->tid == tid) {
-      found_thread = t;
-      break;
-    }
+  old_level = intr_disable();
+  t = thread_get_by_tid(tid);
+  if (t == NULL || t == cur || t->status != THREAD_READY || dl_active(t) || dl_active(cur) ||
+      t->quota_held || !list_empty(&this_cpu()->dl_ready_list) || t->pcb != cur->pcb) {
+    intr_set_level(old_level);
+    return false;
   }
 
+  thread_dequeue(t);
+  handoff_thread = t;
+  handoff_ticks = thread_ticks < cur->slice ? cur->slice - thread_ticks : 1;
+  handoffs++;
+  yield_from(__builtin_return_address(0));
+  intr_set_level(old_level);
+  return true;
+}
+#endif
+
+/* Returns true if a reschedule is due: a ready thread should
+   preempt the running one, or its time slice ran out while
+   preemption was held off. */
+bool thread_resched_needed(void) {
+  enum intr_level old_level = intr_disable();
+  bool needed = resched_due != 0 || !thread_has_highest_priority();
+
+  intr_set_level(old_level);
+  return needed;
+}
+
+/* A preemption point for long loops in thread context: yields if
+   a reschedule is due.  Does nothing with interrupts off or
+   inside a read-side section, where yielding is not allowed, so
+   it may be called from code that does not know its caller's
+   state. */
+void thread_yield_if_needed(void) {
+  ASSERT(!intr_context());
+
+  if (intr_get_level() == INTR_OFF || rcu_read_held() || !thread_resched_needed())
+    return;
+  preemption_points++;
+  yield_from(__builtin_return_address(0));
+}
+
+/* Returns the live thread whose tid is TID, or a null pointer if
+   there is none.  Reading a tid_table entry is a single load, so
+   it needs no lock. */
+struct thread* thread_get_by_tid(tid_t tid) {
+  ASSERT(tid_table != NULL);
+
+  return tid > 0 && tid < TID_MAX ? tid_table[tid] : NULL;
+}
+
+/* Lets go of TID, which the caller held since
+   thread_create_held() returned it, so that it can be reused once
+   the thread has exited too. */
+void thread_tid_release(tid_t tid) {
+  enum intr_level old_level = intr_disable();
+  release_tid(tid);
   intr_set_level(old_level);
-  return found_thread;
 }
 
 /* Invoke function 'func' on all threads, passing along 'aux'.
-   This function must be called with interrupts off. */
+   This function must be called with interrupts off or inside a
+   read-side section, in which case 'func' must not sleep. */
 void thread_foreach(thread_action_func* func, void* aux) {
   struct list_elem* e;
 
-  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(intr_get_level() == INTR_OFF || rcu_read_held());
 
   for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)) {
     struct thread* t = list_entry(e, struct thread, allelem);
@@ -474,24 +1237,37 @@ void thread_foreach(thread_action_func* func, void* aux) {
   }
 }
 
+/* Returns false if some ready thread has a higher effective
+   priority than the running thread, or an earlier deadline in
+   the deadline class, true otherwise. */
 bool thread_has_highest_priority(void) {
-  if (!list_empty(&fifo_ready_list)) {
-    struct thread* highest_ready =
-        list_entry(list_max(&fifo_ready_list, thread_priority_less, NULL), struct thread, elem);
-    if (thread_get_priority_of(highest_ready) > thread_get_priority_of(thread_current())) {
-      return false;
-    }
-  }
-  return true;
+  struct cpu* cpu = this_cpu();
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+  bool highest;
+
+  old_level = spin_lock_irqsave(&cpu->lock);
+  if (!list_empty(&cpu->dl_ready_list))
+    highest = !thread_deadline_preempts(
+        list_entry(list_front(&cpu->dl_ready_list), struct thread, elem));
+  else
+    highest = dl_active(cur) || prio_ready_highest(cpu) <= thread_get_priority_of(cur);
+  spin_unlock_irqrestore(&cpu->lock, old_level);
+  return highest;
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY.
+   Ignored under SCHED_MLFQS, which computes priorities itself. */
 void thread_set_priority(int new_priority) {
+  if (active_sched_policy == SCHED_MLFQS)
+    return;
+
   enum intr_level old_level = intr_disable();
 
   struct thread* t = thread_current();
   int old_effective_priority = thread_get_priority();
   t->priority = new_priority;
+  thread_priority_changed(t);
 
   if (old_effective_priority != thread_get_priority_of(t)) {
     thread_update_donations(t);
@@ -501,47 +1277,339 @@ void thread_set_priority(int new_priority) {
   thread_yield();
 }
 
-/* Returns the current thread's effective priority. */
-int thread_get_priority(void) { return thread_get_priority_of(thread_current()); }
+/* Puts the running thread in the deadline class, reserving
+   BUDGET timer ticks of CPU time in every PERIOD ticks starting
+   now, or takes it out of the class if PERIOD is 0.  Returns
+   false, and leaves the thread as it was, if BUDGET is not
+   between 1 and PERIOD or the class would then reserve more
+   than DL_UTIL_MAX of the CPU. */
+bool thread_set_deadline(int64_t period, int64_t budget) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+  int util = 0;
+  int old_util;
 
-/* Returns the thread's effective priority. */
-int thread_get_priority_of(struct thread* t) {
-  int base_priority = t->priority;
-  if (list_empty(&t->donations)) {
-    return base_priority;
+  if (period != 0) {
+    if (period < 0 || budget < 1 || budget > period)
+      return false;
+    util = DIV_ROUND_UP(budget * DL_UNIT, period);
   }
 
-  int donated_priority =
-      list_entry(list_max(&t->donations, donation_priority_less, NULL), struct donation, elem)
-          ->donated_priority;
-  if (donated_priority >= base_priority) {
-    return donated_priority;
-  } else {
-    return base_priority;
+  old_level = intr_disable();
+  old_util = cur->dl_period != 0 ? DIV_ROUND_UP(cur->dl_budget * DL_UNIT, cur->dl_period) : 0;
+  if (dl_util - old_util + util > DL_UTIL_MAX) {
+    intr_set_level(old_level);
+    return false;
+  }
+  dl_leave(cur);
+  if (period != 0) {
+    cur->dl_period = period;
+    cur->dl_budget = budget;
+    cur->dl_deadline = timer_ticks() + period;
+    cur->dl_runtime = budget;
+    dl_util += util;
+    dl_members++;
   }
+  intr_set_level(old_level);
+
+  thread_yield();
+  return true;
 }
 
-/* Sets the current thread's nice value to NICE. */
-void thread_set_nice(int nice UNUSED) { /* Not yet implemented. */ }
+/* Returns the current thread's effective priority. */
+int thread_get_priority(void) { return thread_get_priority_of(thread_current()); }
 
-/* Returns the current thread's nice value. */
-int thread_get_nice(void) {
-  /* Not yet implemented. */
-  return 0;
+/* Returns the thread's effective priority: the higher of its own
+   priority and the priorities donated to it.  This is cached by
+   thread_priority_changed(), so it is a single load. */
+int thread_get_priority_of(struct thread* t) { return t->effective_priority; }
+
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
+void thread_set_nice(int nice) {
+  struct thread* t = thread_current();
+  enum intr_level old_level;
+  bool should_yield;
+
+  ASSERT(nice >= NICE_MIN && nice <= NICE_MAX);
+
+  old_level = intr_disable();
+  t->nice = nice;
+  if (active_sched_policy == SCHED_MLFQS)
+    mlfqs_update_priority(t);
+  should_yield = !thread_has_highest_priority();
+  intr_set_level(old_level);
+
+  if (should_yield)
+    thread_yield();
 }
 
+/* Returns the current thread's nice value. */
+int thread_get_nice(void) { return thread_current()->nice; }
+
 /* Returns 100 times the system load average. */
 int thread_get_load_avg(void) {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int load_avg_100 = fix_round(fix_scale(load_avg, 100));
+  intr_set_level(old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int thread_get_recent_cpu(void) {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int recent_cpu_100 = fix_round(fix_scale(thread_current()->recent_cpu, 100));
+  intr_set_level(old_level);
+  return recent_cpu_100;
+}
+
+/* SCHED_MLFQS bookkeeping for one timer tick, run in the timer
+   interrupt with CUR as the running thread.  Charges the tick to
+   CUR, recomputes load_avg and every thread's recent_cpu once per
+   second, and recomputes the priority of threads that ran since
+   the last recompute every 4 ticks. */
+static void mlfqs_tick(struct thread* cur) {
+  struct cpu* cpu = this_cpu();
+  int64_t ticks = timer_ticks();
+
+  if (cur != cpu->idle_thread) {
+    cur->recent_cpu = fix_add(cur->recent_cpu, fix_int(1));
+    if (!cur->mlfqs_dirty) {
+      cur->mlfqs_dirty = true;
+      list_push_back(&mlfqs_dirty_list, &cur->mlfqs_elem);
+    }
+  }
+
+  if (ticks % TIMER_FREQ == 0) {
+    int ready_threads = cpu->prio_ready_cnt + (cur != cpu->idle_thread ? 1 : 0);
+    load_avg = fix_add(fix_mul(fix_frac(59, 60), load_avg), fix_scale(fix_frac(1, 60), ready_threads));
+
+    fixed_point_t twice_load = fix_scale(load_avg, 2);
+    fixed_point_t decay = fix_div(twice_load, fix_add(twice_load, fix_int(1)));
+    thread_foreach(mlfqs_update_recent_cpu, &decay);
+
+    while (!list_empty(&mlfqs_dirty_list))
+      list_entry(list_pop_front(&mlfqs_dirty_list), struct thread, mlfqs_elem)->mlfqs_dirty = false;
+  } else if (ticks % 4 == 0) {
+    while (!list_empty(&mlfqs_dirty_list)) {
+      struct thread* t = list_entry(list_pop_front(&mlfqs_dirty_list), struct thread, mlfqs_elem);
+      t->mlfqs_dirty = false;
+      mlfqs_update_priority(t);
+    }
+  }
+
+  if (ticks % 4 == 0 && !thread_has_highest_priority())
+    intr_yield_on_return();
+}
+
+/* Returns T's SCHED_MLFQS priority as computed from its
+   recent_cpu and nice values. */
+static int mlfqs_compute_priority(struct thread* t) {
+  int priority = PRI_MAX - fix_trunc(fix_unscale(t->recent_cpu, 4)) - t->nice * 2;
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  return priority;
+}
+
+/* Recomputes T's SCHED_MLFQS priority and requeues it if it is
+   ready. */
+static void mlfqs_update_priority(struct thread* t) {
+  if (t == this_cpu()->idle_thread)
+    return;
+
+  t->priority = mlfqs_compute_priority(t);
+  thread_priority_changed(t);
+}
+
+/* Applies the once-per-second decay pointed to by DECAY_ to T's
+   recent_cpu, then recomputes T's priority.  Used with
+   thread_foreach(). */
+static void mlfqs_update_recent_cpu(struct thread* t, void* decay_) {
+  fixed_point_t* decay = decay_;
+
+  if (t == this_cpu()->idle_thread)
+    return;
+  t->recent_cpu = fix_add(fix_mul(*decay, t->recent_cpu), fix_int(t->nice));
+  mlfqs_update_priority(t);
+}
+
+/* Orders threads in fair_ready_tree by ascending pass.  Threads
+   with equal passes stay in the order they became ready. */
+static bool fair_pass_less(const struct rb_elem* a_, const struct rb_elem* b_,
+                           void* aux UNUSED) {
+  const struct thread* a = rb_entry(a_, struct thread, fair_elem);
+  const struct thread* b = rb_entry(b_, struct thread, fair_elem);
+
+  return a->fair_pass < b->fair_pass;
+}
+
+/* Returns the SCHED_FAIR stride of T: how far its pass advances
+   for each tick it runs.  T's weight is its effective priority
+   plus one, so a PRI_MAX thread gets 64 times the CPU share of a
+   PRI_MIN thread. */
+static int64_t fair_stride(struct thread* t) {
+  return FAIR_STRIDE1 / (thread_get_priority_of(t) + 1);
+}
+
+/* Returns true if T competes in the deadline class right now:
+   it was admitted and has budget left. */
+static bool dl_active(const struct thread* t) { return t->dl_period != 0 && !t->dl_throttled; }
+
+/* Orders dl_ready_list by ascending deadline.  Threads with
+   equal deadlines stay in the order they became ready. */
+static bool dl_deadline_less(const struct list_elem* a_, const struct list_elem* b_,
+                             void* aux UNUSED) {
+  const struct thread* a = list_entry(a_, struct thread, elem);
+  const struct thread* b = list_entry(b_, struct thread, elem);
+
+  return a->dl_deadline < b->dl_deadline;
+}
+
+/* Called from the timer interrupt when T, the running thread, has
+   used up its budget.  Throttles T until its deadline, when
+   dl_replenish() starts its next period.  If the deadline has
+   already passed, T missed it, and its next period starts now. */
+static void dl_throttle(struct thread* t) {
+  int64_t now = timer_ticks();
+
+  if (now >= t->dl_deadline) {
+    t->dl_misses++;
+    dl_misses++;
+    t->dl_deadline = now + t->dl_period;
+    t->dl_runtime = t->dl_budget;
+    return;
+  }
+  t->dl_throttles++;
+  dl_throttles++;
+  t->dl_throttled = true;
+  timer_add_callout(&t->dl_callout, t->dl_deadline - now, dl_replenish, t);
+}
+
+/* Callout function that starts throttled thread T_'s next period
+   and moves it back to dl_ready_list if it is ready. */
+static void dl_replenish(void* t_) {
+  struct thread* t = t_;
+  bool ready = t->status == THREAD_READY;
+  uint64_t ready_start = t->ready_start;
+
+  if (ready)
+    thread_dequeue(t);
+  t->dl_throttled = false;
+  t->dl_deadline += t->dl_period;
+  t->dl_runtime = t->dl_budget;
+  if (ready) {
+    thread_enqueue(t);
+    t->ready_start = ready_start;
+  }
+  if (!thread_has_highest_priority())
+    intr_yield_on_return();
+}
+
+/* Takes T, which is not on a ready queue, out of the deadline
+   class, if it is in it.  Interrupts must be off. */
+static void dl_leave(struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (t->dl_period == 0)
+    return;
+  timer_cancel_callout(&t->dl_callout);
+  dl_util -= DIV_ROUND_UP(t->dl_budget * DL_UNIT, t->dl_period);
+  dl_members--;
+  t->dl_period = 0;
+  t->dl_throttled = false;
+}
+
+/* Initializes Q, the quota of a new process, with the limit of
+   its parent's quota PARENT, or with no limit if PARENT is
+   null. */
+void cpu_quota_init(struct cpu_quota* q, const struct cpu_quota* parent) {
+  q->limit = parent != NULL ? parent->limit : 0;
+  q->used = 0;
+  q->period_end = 0;
+  q->throttled = false;
+  list_init(&q->parked);
+  q->callout.pending = false;
 }
 
+/* Limits Q to LIMIT percent of the CPU, starting with its next
+   period.  Returns false without changing anything if LIMIT is
+   out of range or looser than Q's limit, since a process may not
+   lift a limit that it was started with. */
+bool cpu_quota_set(struct cpu_quota* q, int limit) {
+  enum intr_level old_level;
+
+  if (limit <= 0 || limit > 100 || (q->limit != 0 && limit > q->limit))
+    return false;
+  old_level = intr_disable();
+  q->limit = limit;
+  intr_set_level(old_level);
+  return true;
+}
+
+/* Stops Q's callout.  Called as a process is torn down, when
+   none of its threads can be parked any more. */
+void cpu_quota_release(struct cpu_quota* q) {
+  enum intr_level old_level = intr_disable();
+
+  ASSERT(list_empty(&q->parked));
+  timer_cancel_callout(&q->callout);
+  intr_set_level(old_level);
+}
+
+#ifdef USERPROG
+/* Called from the timer interrupt for each tick that T, a thread
+   of a process, runs, in user mode if USER is true.  Charges the
+   tick to the process's quota and throttles the process once the
+   quota is used up.  T is held and preempted if that tick was in
+   user mode. */
+static void quota_tick(struct thread* t, bool user) {
+  struct cpu_quota* q = &t->pcb->cpu_quota;
+  int64_t now;
+
+  if (q->limit == 0)
+    return;
+  now = timer_ticks();
+  if (!q->throttled) {
+    if (now >= q->period_end) {
+      q->period_end = now + CPU_QUOTA_PERIOD;
+      q->used = 0;
+    }
+    if (++q->used * 100 < q->limit * CPU_QUOTA_PERIOD)
+      return;
+    q->throttled = true;
+    t->pcb->usage.cpu_throttles++;
+    quota_throttles++;
+    timer_add_callout(&q->callout, q->period_end > now ? q->period_end - now : 1,
+                      quota_replenish, q);
+  }
+  if (user) {
+    t->quota_held = true;
+    resched_mark();
+    intr_yield_on_return();
+  }
+}
+
+/* Callout function that starts throttled quota Q_'s next period
+   and makes the threads parked on it ready again. */
+static void quota_replenish(void* q_) {
+  struct cpu_quota* q = q_;
+
+  q->throttled = false;
+  q->used = 0;
+  q->period_end = timer_ticks() + CPU_QUOTA_PERIOD;
+  while (!list_empty(&q->parked)) {
+    struct thread* t = list_entry(list_pop_front(&q->parked), struct thread, elem);
+    t->quota_held = false;
+    thread_enqueue(t);
+  }
+  if (!thread_has_highest_priority())
+    intr_yield_on_return();
+}
+#endif
+
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
@@ -553,7 +1621,7 @@ int thread_get_recent_cpu(void) {
    special case when the ready list is empty. */
 static void idle(void* idle_started_ UNUSED) {
   struct semaphore* idle_started = idle_started_;
-  idle_thread = thread_current();
+  this_cpu()->idle_thread = thread_current();
   sema_up(idle_started);
 
   for (;;) {
@@ -561,6 +1629,19 @@ static void idle(void* idle_started_ UNUSED) {
     intr_disable();
     thread_block();
 
+    /* Spend some of the idle time preparing a thread page, a
+       zeroed page for palloc and a page directory. */
+    thread_page_zero_one();
+    palloc_zero_one();
+#ifdef USERPROG
+    pagedir_prepare_one();
+#endif
+
+    /* Stop the periodic timer tick until a timer callout is
+       due.  It is turned back on in schedule() when some other
+       thread gets the CPU. */
+    timer_idle_enter();
+
     /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -586,7 +1667,9 @@ static void kernel_thread(thread_func* function, void* aux) {
   thread_exit(); /* If function() returns, kill the thread. */
 }
 
-/* Returns the running thread. */
+/* Returns the running thread.  Unlike thread_current(), works
+   in the scheduler too, after the thread has left the
+   THREAD_RUNNING state. */
 struct thread* running_thread(void) {
   uint32_t* esp;
 
@@ -615,13 +1698,28 @@ static void init_thread(struct thread* t, const char* name, int priority) {
   strlcpy(t->name, name, sizeof t->name);
   t->stack = (uint8_t*)t + PGSIZE;
   t->priority = priority;
+  t->slice = time_slices[active_sched_policy].min;
   t->pcb = NULL;
   t->current_syscall = -1;
-  t->wake_time = 0;
   t->magic = THREAD_MAGIC;
+  t->run_start = rdtsc();
   t->donating_to = NULL;
   list_init(&t->donations);
 
+  /* New threads inherit nice and recent_cpu from their creator. */
+  if (t != running_thread()) {
+    struct thread* parent = running_thread();
+    t->nice = parent->nice;
+    t->recent_cpu = parent->recent_cpu;
+  } else {
+    t->nice = NICE_DEFAULT;
+    t->recent_cpu = fix_int(0);
+  }
+  t->mlfqs_dirty = false;
+  if (active_sched_policy == SCHED_MLFQS)
+    t->priority = mlfqs_compute_priority(t);
+  t->effective_priority = t->priority;
+
   old_level = intr_disable();
   list_push_back(&all_list, &t->allelem);
   intr_set_level(old_level);
@@ -639,46 +1737,94 @@ static void* alloc_frame(struct thread* t, size_t size) {
 }
 
 /* First-in first-out scheduler */
-static struct thread* thread_schedule_fifo(void) {
-  if (!list_empty(&fifo_ready_list))
-    return list_entry(list_pop_front(&fifo_ready_list), struct thread, elem);
+static struct thread* thread_schedule_fifo(struct cpu* cpu) {
+  if (!list_empty(&cpu->fifo_ready_list))
+    return list_entry(list_pop_front(&cpu->fifo_ready_list), struct thread, elem);
   else
-    return idle_thread;
+    return NULL;
 }
 
 /* Strict priority scheduler */
-static struct thread* thread_schedule_prio(void) {
-  if (!list_empty((&fifo_ready_list))) {
-    struct list_elem* next_thread = list_max(&fifo_ready_list, thread_priority_less, NULL);
-    list_remove(next_thread);
-    return list_entry(next_thread, struct thread, elem);
-  } else {
-    return idle_thread;
-  }
-}
+static struct thread* thread_schedule_prio(struct cpu* cpu) { return prio_ready_pop(cpu); }
 
-/* Fair priority scheduler */
-static struct thread* thread_schedule_fair(void) {
-  PANIC("Unimplemented scheduler policy: \"-sched=fair\"");
-}
+/* Fair priority scheduler: runs the ready thread with the
+   smallest pass.  See the comment on fair_ready_tree. */
+static struct thread* thread_schedule_fair(struct cpu* cpu) {
+  struct rb_elem* e = rb_min(&cpu->fair_ready_tree);
+  struct thread* next;
+
+  if (e == NULL)
+    return NULL;
 
-/* Multi-level feedback queue scheduler */
-static struct thread* thread_schedule_mlfqs(void) {
-  PANIC("Unimplemented scheduler policy: \"-sched=mlfqs\"");
+  rb_remove(&cpu->fair_ready_tree, e);
+  next = rb_entry(e, struct thread, fair_elem);
+  if (next->fair_pass > cpu->fair_vtime)
+    cpu->fair_vtime = next->fair_pass;
+  return next;
 }
 
+/* Multi-level feedback queue scheduler.  Priorities are kept up
+   to date by mlfqs_tick(), so picking the next thread is the
+   same bitmap lookup as the strict priority scheduler. */
+static struct thread* thread_schedule_mlfqs(struct cpu* cpu) { return prio_ready_pop(cpu); }
+
 /* Not an actual scheduling policy — placeholder for empty
  * slots in the scheduler jump table. */
-static struct thread* thread_schedule_reserved(void) {
+static struct thread* thread_schedule_reserved(struct cpu* cpu UNUSED) {
   PANIC("Invalid scheduler policy value: %d", active_sched_policy);
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
+   return a thread from the running CPU's run queue, unless it is
    empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
-struct thread* next_thread_to_run(void) { return (scheduler_jump_table[active_sched_policy])(); }
+   will be in the run queue.)  If it is empty, steals a thread
+   from another CPU's run queue, and if those are empty too,
+   returns idle_thread.  A thread that thread_yield_to() hands
+   the CPU to comes before any other. */
+struct thread* next_thread_to_run(void) {
+  unsigned self = cpu_index();
+  struct cpu* cpu = &cpus[self];
+  struct thread* next;
+  unsigned i;
+
+  if (handoff_thread != NULL)
+    return handoff_thread;
+
+  spin_lock(&cpu->lock);
+  next = cpu_pick(cpu);
+  spin_unlock(&cpu->lock);
+
+  /* Steal from the other CPUs, but do not wait for a busy one. */
+  for (i = 1; next == NULL && i < CPU_CNT; i++) {
+    struct cpu* victim = &cpus[(self + i) % CPU_CNT];
+    if (spin_trylock(&victim->lock)) {
+      next = cpu_pick(victim);
+      spin_unlock(&victim->lock);
+    }
+  }
+  return next != NULL ? next : cpu->idle_thread;
+}
+
+/* Removes and returns the thread that CPU's run queue would run
+   next, or a null pointer if it is empty.  Threads in the
+   deadline class come before any thread of the active policy.
+   CPU's lock must be held. */
+static struct thread* cpu_pick(struct cpu* cpu) {
+  if (!list_empty(&cpu->dl_ready_list))
+    return list_entry(list_pop_front(&cpu->dl_ready_list), struct thread, elem);
+#ifdef SCHED_FIXED
+  /* Only one policy can be active, so call it directly. */
+  if (active_sched_policy == SCHED_FIFO)
+    return thread_schedule_fifo(cpu);
+  if (active_sched_policy == SCHED_PRIO)
+    return thread_schedule_prio(cpu);
+  if (active_sched_policy == SCHED_FAIR)
+    return thread_schedule_fair(cpu);
+  if (active_sched_policy == SCHED_MLFQS)
+    return thread_schedule_mlfqs(cpu);
+#endif
+  return (scheduler_jump_table[active_sched_policy])(cpu);
+}
 
 /* Completes a thread switch by activating the new thread's page
    tables, and, if the previous thread is dying, destroying it.
@@ -698,17 +1844,44 @@ struct thread* next_thread_to_run(void) { return (scheduler_jump_table[active_sc
    is complete. */
 void thread_switch_tail(struct thread* prev) {
   struct thread* cur = running_thread();
+  uint64_t now = rdtsc();
 
   ASSERT(intr_get_level() == INTR_OFF);
 
-  /* Mark us as running. */
+  /* Mark us as running.  A boost lasts until the thread runs. */
   cur->status = THREAD_RUNNING;
+  cur->boosted = false;
+
+  /* Account for the time we spent waiting to run.  The idle
+     thread is never queued and a thread that was running all
+     along (PREV is null) did not wait. */
+  cur->run_start = now;
+  if (prev != NULL && cur != this_cpu()->idle_thread) {
+    uint64_t wait = now - cur->ready_start;
+
+    cur->ready_cycles += wait;
+    percpu_counter_add(&total_ready_cycles, wait);
+    if (cur->woken) {
+      int bucket = 63 - __builtin_clzll(wait | 1);
+      if (bucket >= SCHED_LATENCY_BUCKETS)
+        bucket = SCHED_LATENCY_BUCKETS - 1;
+      latency_hist[bucket]++;
+    }
+  }
+  cur->woken = false;
 
-  // printf("Switched from prev: %s to current thread: %s!\n", prev->name, cur->name);
-  // printf("Switched to current thread: %s!\n", cur->name);
+  TRACE(TRACE_SWITCH, prev != NULL ? prev->tid : TID_ERROR, prev != NULL ? prev->status : 0);
 
-  /* Start new time slice. */
+  /* Start new time slice, or finish one that was handed over. */
   thread_ticks = 0;
+  if (cur == handoff_thread) {
+    if (cur->slice > handoff_ticks)
+      thread_ticks = cur->slice - handoff_ticks;
+    handoff_thread = NULL;
+  }
+
+  /* Make the FPU trap unless it already holds our state. */
+  fpu_switch(cur);
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -722,7 +1895,7 @@ void thread_switch_tail(struct thread* prev) {
      palloc().) */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) {
     ASSERT(prev != cur);
-    palloc_free_page(prev);
+    thread_page_free(prev);
   }
 }
 
@@ -734,6 +1907,7 @@ void thread_switch_tail(struct thread* prev) {
    It's not safe to call printf() until thread_switch_tail()
    has completed. */
 static void schedule(void) {
+  struct cpu* cpu = this_cpu();
   struct thread* cur = running_thread();
   struct thread* next = next_thread_to_run();
   struct thread* prev = NULL;
@@ -741,24 +1915,163 @@ static void schedule(void) {
   ASSERT(intr_get_level() == INTR_OFF);
   ASSERT(cur->status != THREAD_RUNNING);
   ASSERT(is_thread(next));
+  if (spin_any_held())
+    PANIC("%s switched away from with a spinlock held", cur->name);
+
+  rcu_quiescent(cur);
+  if (cur == cpu->idle_thread && next != cpu->idle_thread)
+    timer_idle_exit();
+  if (cur != next) {
+    /* Charge CUR for its run and classify the switch. */
+    uint64_t now = rdtsc();
+    uint64_t ran = now - cur->run_start;
+
+    /* Trace how long a due reschedule waited. */
+    if (resched_due != 0) {
+      if (now - resched_due > resched_max) {
+        resched_max = now - resched_due;
+        resched_max_site = switch_site;
+        strlcpy(resched_max_name, cur->name, sizeof resched_max_name);
+      }
+      resched_due = 0;
+    }
 
-  if (cur != next)
+    cur->run_cycles += ran;
+    if (cur != cpu->idle_thread) {
+      percpu_counter_add(&total_run_cycles, ran);
+      if (cur->status == THREAD_READY) {
+        cur->involuntary_switches++;
+        percpu_counter_inc(&involuntary_switches);
+      } else if (cur->status == THREAD_BLOCKED) {
+        cur->voluntary_switches++;
+        percpu_counter_inc(&voluntary_switches);
+      }
+
+      /* Adapt CUR's time slice to how much of it CUR used. */
+      if (cur->status == THREAD_READY && thread_ticks >= cur->slice) {
+        cur->slices_used_up++;
+        cur->slice = cur->slice * 2 < time_slices[active_sched_policy].max
+                         ? cur->slice * 2
+                         : time_slices[active_sched_policy].max;
+      } else if (cur->status == THREAD_BLOCKED)
+        cur->slice = cur->slice / 2 > time_slices[active_sched_policy].min
+                         ? cur->slice / 2
+                         : time_slices[active_sched_policy].min;
+    }
     prev = switch_threads(cur, next);
+  }
   thread_switch_tail(prev);
 }
 
-/* Returns a tid to use for a new thread. */
-static tid_t allocate_tid(void) {
-  static tid_t next_tid = 1;
+/* Allocates the tid arrays, records the initial thread's tid,
+   and puts every other tid in free_tids, lowest first. */
+static void init_tids(void) {
+  size_t bytes = TID_MAX * (sizeof *tid_table + sizeof *tid_refs + sizeof *free_tids);
+  uint8_t* p = palloc_get_multiple(PAL_ASSERT | PAL_ZERO, DIV_ROUND_UP(bytes, PGSIZE));
+  enum intr_level old_level;
   tid_t tid;
 
-  lock_acquire(&tid_lock);
-  tid = next_tid++;
-  lock_release(&tid_lock);
+  tid_table = (struct thread**)p;
+  free_tids = (uint16_t*)(p + TID_MAX * sizeof *tid_table);
+  tid_refs = p + TID_MAX * (sizeof *tid_table + sizeof *free_tids);
+
+  old_level = intr_disable();
+  tid_table[initial_thread->tid] = initial_thread;
+  tid_refs[initial_thread->tid] = 1;
+  for (tid = initial_thread->tid + 1; tid < TID_MAX; tid++)
+    free_tids[free_tid_cnt++] = tid;
+  intr_set_level(old_level);
+}
 
+/* Returns the tid that has been free the longest, with REFS
+   holders, or TID_ERROR if every tid is in use.  Interrupts must
+   be off. */
+static tid_t allocate_tid(int refs) {
+  tid_t tid;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (free_tid_cnt == 0)
+    return TID_ERROR;
+  tid = free_tids[free_tid_head];
+  free_tid_head = (free_tid_head + 1) % TID_MAX;
+  free_tid_cnt--;
+  ASSERT(tid_refs[tid] == 0);
+  tid_refs[tid] = refs;
   return tid;
 }
 
+/* Drops a holder of TID, and puts it at the back of free_tids if
+   that was the last.  Interrupts must be off. */
+static void release_tid(tid_t tid) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(tid > 0 && tid < TID_MAX && tid_refs[tid] > 0);
+
+  if (--tid_refs[tid] == 0)
+    free_tids[(free_tid_head + free_tid_cnt++) % TID_MAX] = tid;
+}
+
+/* Returns a zeroed page for a new thread, preferably from the
+   recycled thread page cache, or a null pointer if memory is
+   exhausted. */
+static struct thread* thread_page_alloc(void) {
+  struct thread_page* page = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable();
+  if (!list_empty(&clean_thread_pages)) {
+    page = list_entry(list_pop_front(&clean_thread_pages), struct thread_page, elem);
+    thread_cache_cnt--;
+  }
+  intr_set_level(old_level);
+
+  if (page == NULL)
+    return palloc_get_page(PAL_ZERO);
+  page->elem.prev = page->elem.next = NULL;
+  return (struct thread*)page;
+}
+
+/* Releases the page of dead thread T, keeping it in the thread
+   page cache if there is room.
+
+   This function must be called with interrupts turned off. */
+static void thread_page_free(struct thread* t) {
+  struct thread_page* page = (struct thread_page*)t;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  fpu_release(t);
+  if (thread_cache_cnt >= THREAD_CACHE_SIZE) {
+    palloc_free_page(t);
+    return;
+  }
+  list_push_back(&dirty_thread_pages, &page->elem);
+  thread_cache_cnt++;
+}
+
+/* Zeroes one page on dirty_thread_pages, if there is one, and
+   moves it to clean_thread_pages.  Called by the idle thread with
+   interrupts off. */
+static void thread_page_zero_one(void) {
+  struct thread_page* page;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (list_empty(&dirty_thread_pages))
+    return;
+  page = list_entry(list_pop_front(&dirty_thread_pages), struct thread_page, elem);
+  pg_zero(page);
+  list_push_back(&clean_thread_pages, &page->elem);
+}
+
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof(struct thread, stack);
+
+/* struct thread starts a page, so its first THREAD_HOT_BYTES are
+   one cache line.  The members every switch uses, `stack'
+   included, must fit there, and the whole structure must leave
+   most of the page to the kernel stack. */
+_Static_assert(offsetof(struct thread, tid) <= THREAD_HOT_BYTES,
+               "struct thread's switch members span more than one cache line");
+_Static_assert(sizeof(struct thread) <= PGSIZE / 4, "struct thread takes too much of its page");
@@ -2,10 +2,14 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
+#include <rbtree.h>
+#include <stats.h>
 #include <stdint.h>
 #include "threads/synch.h"
 #include "threads/fixed-point.h"
+#include "devices/timer.h"
 
 /* States in a thread's life cycle. */
 enum thread_status {
@@ -19,12 +23,40 @@ enum thread_status {
    You can redefine this to whatever type you like. */
 typedef int tid_t;
 #define TID_ERROR ((tid_t) - 1) /* Error value for tid_t. */
+#define TID_MAX 4096            /* Tids are less than this. */
 
 /* Thread priorities. */
 #define PRI_MIN 0      /* Lowest priority. */
 #define PRI_DEFAULT 31 /* Default priority. */
 #define PRI_MAX 63     /* Highest priority. */
 
+/* Thread nice values (SCHED_MLFQS). */
+#define NICE_MIN -20    /* Nicest to other threads. */
+#define NICE_DEFAULT 0  /* Default nice value. */
+#define NICE_MAX 20     /* Least nice to other threads. */
+
+/* A priority donation.  Each thread embeds the one donation it
+   can make: a thread only donates while it waits for a lock, or
+   for a semaphore with an owner, and it waits for at most one of
+   them at a time. */
+struct donation {
+  int donated_priority;  /* Priority value being donated */
+  struct thread* donor;  /* Thread making the donation */
+  const void* resource;  /* Lock or semaphore associated with this donation */
+  struct list_elem elem; /* List element for donee's donations list */
+};
+
+/* A process's CPU quota: the percentage of each CPU_QUOTA_PERIOD
+   of ticks that its threads may run.  Interrupts off. */
+struct cpu_quota {
+  int limit;                         /* Percent of the CPU, or 0 for no limit. */
+  int used;                          /* Ticks run in the current period. */
+  int64_t period_end;                /* Tick at which the current period ends. */
+  bool throttled;                    /* Used up until PERIOD_END? */
+  struct list parked;                /* Ready threads held back meanwhile. */
+  struct timer_callout callout;      /* Ends the period while throttled. */
+};
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -75,46 +107,116 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member is an element in the run queue (thread.c).
+   A thread blocked on a semaphore or condition variable (synch.c)
+   is instead in that primitive's wait queue through a struct
+   wait_queue_elem in its own stack frame, which `wait_elem'
+   points to.
+
+   Members are grouped by how often they are used.  Those that
+   every thread switch and scheduling decision touches come
+   first, so that they share the page's first cache line
+   (THREAD_HOT_BYTES, checked in thread.c), followed by those
+   that locking and system calls touch.  Statistics and members
+   used only by one policy or for debugging come last. */
 struct thread {
-  /* Owned by thread.c. */
-  tid_t tid;                 /* Thread identifier. */
-  enum thread_status status; /* Thread state. */
-  char name[16];             /* Name (for debugging purposes). */
+  /* Owned by thread.c, used on every switch. */
   uint8_t* stack;            /* Saved stack pointer. */
+  enum thread_status status; /* Thread state. */
+  struct list_elem elem;     /* List element, shared with synch.c. */
   int priority;              /* Priority. */
-  struct list_elem allelem;  /* List element for all threads list. */
+  int effective_priority;    /* Priority including donations. */
+  int ready_priority;        /* SCHED_PRIO ready list this thread is queued on. */
+  unsigned slice;            /* Time slice, in timer ticks. */
+  bool boosted;              /* Queued at the front of its ready list after waking. */
+  bool woken;                /* Became ready through thread_unblock(). */
+  bool quota_held;           /* Held back by its process's quota when it is next ready. */
+  int wake_priority;         /* Least priority to queue at when unblocked, or PRI_MIN. */
+  uint64_t run_start;        /* TSC when the thread last started running. */
+  uint64_t ready_start;      /* TSC when the thread last became ready. */
+#ifdef USERPROG
+  struct process* pcb; /* Process control block if this thread is a userprog (process.c). */
+#endif
+
+  /* Owned by thread.c. */
+  tid_t tid;       /* Thread identifier. */
+  struct cpu* cpu; /* CPU whose ready queues it was last put on. */
 
   /* Shared between thread.c and synch.c. */
-  struct list_elem elem;      /* List element. */
-  struct list donations;      /* List of donations sorted by priority (highest first) */
+  struct list donations;      /* Donations received from threads waiting on our locks. */
   struct thread* donating_to; /* Thread this thread is donating to (for nested donation) */
+  struct donation donation;   /* Donation made to `donating_to', if nonnull. */
+  struct wait_queue_elem* wait_elem; /* Entry in the wait queue we are blocked on, if any. */
+  int lock_cnt;               /* Number of locks held. */
+
+  /* Owned by threads/rcu.c. */
+  int rcu_depth;  /* Nesting depth of rcu_read_lock(). */
+  bool rcu_yield; /* Preempted inside a read-side section. */
 
-  int64_t wake_time;          /* Time when thread should wake up from sleep */
-  struct list_elem sleepelem; /* List element for sleep_list */
+  /* Owned by threads/fpu.c. */
+  void* fpu_state; /* FPU save area, or null if it never used the FPU. */
 
 #ifdef USERPROG
   /* Owned by process.c. */
-  struct process* pcb; /* Process control block if this thread is a userprog */
   int current_syscall; /* Stores current syscall number, -1 if not in syscall. */
+  void* user_esp;      /* User stack pointer on entry to the current syscall. */
+  uintptr_t tls_base;  /* Base of the thread's user %gs segment. */
+
+  /* Owned by userprog/pagedir.c. */
+  struct tlb_batch* tlb_batch; /* Open bulk unmap, or null. */
 #endif
 
-  /* Owned by thread.c. */
+#ifdef FILESYS
+  /* Owned by filesys/journal.c. */
+  int journal_depth; /* Nesting depth of journal_begin(). */
+#endif
+
+  /* Owned by thread.c, used by SCHED_MLFQS. */
+  int nice;                     /* Niceness, NICE_MIN..NICE_MAX. */
+  fixed_point_t recent_cpu;     /* Recent CPU time received, decayed once per second. */
+  bool mlfqs_dirty;             /* On mlfqs_dirty_list, priority needs recomputing. */
+  struct list_elem mlfqs_elem;  /* List element for mlfqs_dirty_list. */
+
+  /* Owned by thread.c, used by SCHED_FAIR. */
+  int64_t fair_pass;          /* Virtual time consumed, in stride units. */
+  struct rb_elem fair_elem;   /* Element in fair_ready_tree. */
+
+  struct timer_callout sleep_callout; /* Wakes the thread from timer_sleep(). */
+
+  /* Owned by thread.c, used by the deadline class. */
+  int64_t dl_period;               /* Period in ticks, or 0 if not in the class. */
+  int64_t dl_budget;               /* Ticks it may run in each period. */
+  int64_t dl_deadline;             /* Tick at which its current period ends. */
+  int64_t dl_runtime;              /* Ticks of budget left in this period. */
+  bool dl_throttled;               /* Out of budget until the next period. */
+  struct timer_callout dl_callout; /* Starts the next period while throttled. */
+  uint32_t dl_throttles;           /* Times it ran out of budget. */
+  uint32_t dl_misses;              /* Times it ran out past its deadline. */
+
+  /* Owned by thread.c, rarely used. */
+  char name[16];            /* Name (for debugging purposes). */
+  struct list_elem allelem; /* List element for all threads list. */
+
+  /* Owned by thread.c, scheduler statistics in TSC cycles. */
+  uint64_t run_cycles;           /* Time spent running. */
+  uint64_t ready_cycles;         /* Time spent on the run queue. */
+  uint32_t slices_used_up;       /* Times it was preempted after its whole slice. */
+  uint32_t voluntary_switches;   /* Times it blocked. */
+  uint32_t involuntary_switches; /* Times it was preempted or yielded. */
+
+  /* Owned by devices/block.c, block I/O statistics. */
+  uint64_t block_read_bytes;  /* Bytes asked of block devices. */
+  uint64_t block_write_bytes; /* Bytes given to block devices. */
+  uint64_t block_wait_cycles; /* TSC cycles spent waiting for them. */
+
+  /* Owned by thread.c.  Last, so that a stack overflow reaches
+     it first. */
   unsigned magic; /* Detects stack overflow. */
 };
 
-/* Donation structure to track priority donations */
-struct donation {
-  int donated_priority;  /* Priority value being donated */
-  struct thread* donor;  /* Thread making the donation */
-  struct lock* lock;     /* Lock associated with this donation */
-  struct list_elem elem; /* List element for donations list */
-};
+/* Bytes at the start of struct thread that hold the members used
+   on every switch: one cache line. */
+#define THREAD_HOT_BYTES 64
 
 /* Types of scheduler that the user can request the kernel
  * use to schedule threads at runtime. */
@@ -129,27 +231,49 @@ enum sched_policy {
 /* Determines which scheduling policy the kernel should use.
  * Controller by the kernel command-line options
  *  "-sched-default", "-sched-fair", "-sched-mlfqs", "-sched-fifo"
- * Is equal to SCHED_FIFO by default. */
+ * Is equal to SCHED_FIFO by default.
+ * A kernel built with "make SCHED=..." has SCHED_FIXED defined
+ * to one policy, which is then a constant. */
+#ifdef SCHED_FIXED
+#define active_sched_policy ((enum sched_policy)SCHED_FIXED)
+#else
 extern enum sched_policy active_sched_policy;
+#endif
 
 void thread_init(void);
 void thread_start(void);
 
-void thread_tick(void);
+struct intr_frame;
+void thread_tick(struct intr_frame*);
+void thread_idle_ticks(int64_t ticks);
 void thread_print_stats(void);
+void thread_get_sched_stats(struct sched_stats*);
+void thread_set_time_slice(enum sched_policy, unsigned min, unsigned max);
 
 typedef void thread_func(void* aux);
 tid_t thread_create(const char* name, int priority, thread_func*, void*);
+tid_t thread_create_held(const char* name, int priority, thread_func*, void*);
+void thread_tid_release(tid_t);
 
 void thread_block(void);
 void thread_unblock(struct thread*);
+#ifdef USERPROG
+void thread_unblock_at(struct thread*, int priority);
+#endif
 
 struct thread* thread_current(void);
+struct thread* running_thread(void);
 tid_t thread_tid(void);
 const char* thread_name(void);
 
 void thread_exit(void) NO_RETURN;
+void thread_discard(struct thread*);
 void thread_yield(void);
+#ifdef USERPROG
+bool thread_yield_to(tid_t);
+#endif
+bool thread_resched_needed(void);
+void thread_yield_if_needed(void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func(struct thread* t, void* aux);
@@ -161,6 +285,13 @@ void thread_set_priority(int);
 bool thread_priority_less(const struct list_elem* a, const struct list_elem* b, void* aux);
 bool thread_has_highest_priority(void);
 
+bool thread_set_deadline(int64_t period, int64_t budget);
+bool thread_deadline_preempts(const struct thread*);
+
+void cpu_quota_init(struct cpu_quota*, const struct cpu_quota* parent);
+bool cpu_quota_set(struct cpu_quota*, int limit);
+void cpu_quota_release(struct cpu_quota*);
+
 int thread_get_nice(void);
 void thread_set_nice(int);
 int thread_get_recent_cpu(void);
@@ -168,10 +299,11 @@ int thread_get_load_avg(void);
 
 bool donation_priority_less(const struct list_elem* a, const struct list_elem* b, void* aux);
 struct donation* find_donation_by_donor_and_donee(struct thread* donor, struct thread* donee);
-void thread_sort_donations(struct thread* t);
+void thread_donate_priority(struct thread* t, struct thread* holder, const void* resource);
 void thread_revoke_made_donations(struct thread* t);
 void thread_revoke_received_donations(struct thread* t);
-void sort_priority_ready_list(void);
+void thread_priority_changed(struct thread* t);
+void thread_dequeue(struct thread* t);
 
 struct thread* thread_get_by_tid(tid_t tid);
 #endif /* threads/thread.h */
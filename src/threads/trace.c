@@ -0,0 +1,112 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* Trace ring.
+
+   The ring holds TRACE_RECORDS records, a power of 2, and keeps
+   the newest when it fills up.  A writer claims the next slot by
+   incrementing the head index with a single XADD instruction,
+   which an interrupt cannot split on our one CPU, so records are
+   written without locks or turning interrupts off; an interrupt
+   handler that traces in the middle of another record just takes
+   the slot after it.  With more CPUs, each would need a ring of
+   its own.
+
+   At shutdown each record is printed as "Trace: " followed by its
+   bytes in hex, after a line naming the events and one giving
+   the time-stamp counter's rate in cycles per timer tick. */
+
+/* Records in the ring. */
+#define TRACE_RECORDS 8192
+
+/* One trace record, 24 bytes. */
+struct trace_rec {
+  uint64_t tsc;   /* Time-stamp counter. */
+  int32_t tid;    /* Running thread. */
+  uint32_t event; /* A TRACE_* event. */
+  uint32_t a, b;  /* Arguments. */
+};
+
+/* Names of the events, in order. */
+static const char* event_names[TRACE_EVENT_CNT] = {
+    "switch",     "lock-wait",    "lock-acquire", "syscall", "syscall-ret",
+    "page-fault", "block-submit", "block-done",   "fork",    "syscall-args",
+    "syscall-arg3", "syscall-str"};
+
+/* Tracing? */
+bool trace_enabled;
+
+static struct trace_rec* ring; /* The records. */
+static uint32_t head;          /* Records written. */
+static uint64_t start_tsc;     /* Time-stamp counter at trace_init(). */
+static int64_t start_ticks;    /* Timer ticks at trace_init(). */
+
+/* Starts tracing. */
+void trace_init(void) {
+  size_t page_cnt = DIV_ROUND_UP(TRACE_RECORDS * sizeof *ring, PGSIZE);
+
+  ring = palloc_get_multiple(0, page_cnt);
+  if (ring == NULL) {
+    printf("trace: not enough memory for records, not tracing\n");
+    return;
+  }
+  start_tsc = rdtsc();
+  start_ticks = timer_ticks();
+  trace_enabled = true;
+}
+
+/* Appends a record of EVENT with arguments A and B to the ring.
+   Use TRACE() instead of calling this directly. */
+void trace_record(enum trace_event event, uint32_t a, uint32_t b) {
+  struct trace_rec* r;
+  uint32_t idx = 1;
+
+  asm volatile("xaddl %0, %1" : "+r"(idx), "+m"(head) : : "memory");
+  r = &ring[idx % TRACE_RECORDS];
+  r->tsc = rdtsc();
+  r->tid = thread_current()->tid;
+  r->event = event;
+  r->a = a;
+  r->b = b;
+}
+
+/* Stops tracing and prints the records, oldest first. */
+void trace_print_stats(void) {
+  int64_t ticks;
+  uint32_t first, i;
+  int event;
+
+  if (ring == NULL)
+    return;
+  trace_enabled = false;
+
+  ticks = timer_ticks() - start_ticks;
+  first = head > TRACE_RECORDS ? head - TRACE_RECORDS : 0;
+  printf("Trace: %" PRIu32 " records, %" PRIu32 " oldest overwritten; "
+         "decode with utils/pintos-trace\n",
+         head, first);
+  printf("Trace: events");
+  for (event = 0; event < TRACE_EVENT_CNT; event++)
+    printf(" %d=%s", event, event_names[event]);
+  printf("\n");
+  printf("Trace: %llu cycles per tick, %d ticks per second\n",
+         ticks > 0 ? (rdtsc() - start_tsc) / ticks : 0, TIMER_FREQ);
+
+  for (i = first; i != head; i++) {
+    const uint8_t* p = (const uint8_t*)&ring[i % TRACE_RECORDS];
+    size_t j;
+
+    printf("Trace: ");
+    for (j = 0; j < sizeof *ring; j++)
+      printf("%02x", p[j]);
+    printf("\n");
+  }
+}
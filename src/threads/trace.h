@@ -0,0 +1,48 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Static tracepoints.
+
+   TRACE(EVENT, A, B) appends a fixed-size binary record of the
+   time-stamp counter, the running thread's tid, EVENT and the two
+   arguments to a ring buffer, if tracing was enabled with the
+   -trace option, and otherwise costs a load and a branch not
+   taken.  It may be used anywhere, including interrupt handlers
+   and with interrupts off.  The records are printed at shutdown
+   for utils/pintos-trace to decode. */
+
+/* Trace events, with the meaning of their arguments.  Keep the
+   names in trace.c up to date. */
+enum trace_event {
+  TRACE_SWITCH,       /* Switched to this thread; previous tid, its status. */
+  TRACE_LOCK_WAIT,    /* Blocked on a held lock; lock, holder's tid. */
+  TRACE_LOCK_ACQUIRE, /* Got a lock after waiting; lock, 0. */
+  TRACE_SYSCALL,      /* System call entry; number, first argument. */
+  TRACE_SYSCALL_RET,  /* System call return; number, return value. */
+  TRACE_PAGE_FAULT,   /* Page fault; fault address, eip. */
+  TRACE_BLOCK_SUBMIT, /* Block request queued; sector, count | write << 31. */
+  TRACE_BLOCK_DONE,   /* Block request done; sector, count | write << 31. */
+  TRACE_FORK,         /* Forked child running; parent pid, child pid. */
+  TRACE_SYSCALL_ARGS, /* After TRACE_SYSCALL; its first and second arguments. */
+  TRACE_SYSCALL_ARG3, /* After TRACE_SYSCALL_ARGS; third argument, 0. */
+  TRACE_SYSCALL_STR,  /* After TRACE_SYSCALL_ARG3; next 8 bytes of its file name. */
+  TRACE_EVENT_CNT     /* Number of events. */
+};
+
+extern bool trace_enabled;
+
+void trace_init(void);
+void trace_record(enum trace_event, uint32_t a, uint32_t b);
+void trace_print_stats(void);
+
+/* Records EVENT with arguments A and B, if tracing. */
+#define TRACE(EVENT, A, B)                                                                         \
+  do {                                                                                             \
+    if (__builtin_expect(trace_enabled, 0))                                                        \
+      trace_record(EVENT, (uint32_t)(A), (uint32_t)(B));                                           \
+  } while (0)
+
+#endif /* threads/trace.h */
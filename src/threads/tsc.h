@@ -0,0 +1,17 @@
+#ifndef THREADS_TSC_H
+#define THREADS_TSC_H
+
+#include <stdint.h>
+
+/* Reads and returns the processor's time-stamp counter, which
+   counts CPU cycles since reset.  Cheap enough to call on every
+   context switch, but its rate depends on the CPU, so it is only
+   good for comparing intervals against one another. */
+static inline uint64_t rdtsc(void) {
+  /* See [IA32-v2b] "RDTSC". */
+  uint64_t tsc;
+  asm volatile("rdtsc" : "=A"(tsc));
+  return tsc;
+}
+
+#endif /* threads/tsc.h */
@@ -0,0 +1,184 @@
+#include "threads/tunable.h"
+#include <debug.h>
+#include <string.h>
+
+/* Most tunables, and most -tune settings on the command line. */
+#define TUNABLE_MAX 32
+
+/* A tunable. */
+struct tunable {
+  const char* name;       /* "subsystem.knob". */
+  enum tunable_type type; /* Type of VAR. */
+  void* var;              /* Variable that holds the value. */
+  int64_t min, max;       /* Bounds on the value, inclusive. */
+};
+
+/* Registered tunables.  Only added to during boot, before any
+   other thread looks, so lookups need no lock. */
+static struct tunable tunables[TUNABLE_MAX];
+static size_t tunable_cnt;
+
+/* Settings from -tune on the command line, as "KEY=VALUE", and
+   whether each has been applied. */
+static char* settings[TUNABLE_MAX];
+static bool applied[TUNABLE_MAX];
+static size_t setting_cnt;
+
+/* Returns the tunable named NAME, or a null pointer if there is
+   none. */
+static struct tunable* find(const char* name) {
+  size_t i;
+
+  for (i = 0; i < tunable_cnt; i++)
+    if (!strcmp(tunables[i].name, name))
+      return &tunables[i];
+  return NULL;
+}
+
+/* Returns T's value. */
+static int64_t get(const struct tunable* t) {
+  switch (t->type) {
+    case TUNABLE_INT:
+      return *(int*)t->var;
+    case TUNABLE_UINT:
+      return *(unsigned*)t->var;
+    case TUNABLE_BOOL:
+      return *(bool*)t->var;
+  }
+  NOT_REACHED();
+}
+
+/* Sets T to VALUE, which must be within T's bounds. */
+static void set(struct tunable* t, int64_t value) {
+  ASSERT(value >= t->min && value <= t->max);
+
+  switch (t->type) {
+    case TUNABLE_INT:
+      *(int*)t->var = value;
+      break;
+    case TUNABLE_UINT:
+      *(unsigned*)t->var = value;
+      break;
+    case TUNABLE_BOOL:
+      *(bool*)t->var = value != 0;
+      break;
+  }
+}
+
+/* Parses S as a decimal integer, with an optional sign, and
+   stores it in *VALUE.  Returns false if S is not one. */
+static bool parse_value(const char* s, int64_t* value) {
+  bool negative = *s == '-';
+  int64_t v = 0;
+
+  if (*s == '-' || *s == '+')
+    s++;
+  if (*s == '\0')
+    return false;
+  for (; *s != '\0'; s++) {
+    if (*s < '0' || *s > '9' || v > (INT64_MAX - 9) / 10)
+      return false;
+    v = v * 10 + (*s - '0');
+  }
+  *value = negative ? -v : v;
+  return true;
+}
+
+/* Registers variable VAR, of type TYPE, as the tunable named
+   NAME, which must stay valid forever, with bounds MIN and MAX.
+   VAR's current value, which must be within them, is the
+   default.  Applies a -tune setting for NAME, and panics if that
+   setting is bad.  Must be called during boot, from the main
+   thread. */
+void tunable_register(const char* name, enum tunable_type type, void* var, int64_t min,
+                      int64_t max) {
+  struct tunable* t;
+  size_t i;
+
+  ASSERT(find(name) == NULL);
+  ASSERT(min <= max);
+
+  if (tunable_cnt >= TUNABLE_MAX)
+    PANIC("too many tunables: raise TUNABLE_MAX");
+  t = &tunables[tunable_cnt++];
+  t->name = name;
+  t->type = type;
+  t->var = var;
+  t->min = min;
+  t->max = max;
+  ASSERT(get(t) >= min && get(t) <= max);
+
+  for (i = 0; i < setting_cnt; i++) {
+    const char* eq = strchr(settings[i], '=');
+    int64_t value;
+
+    if ((size_t)(eq - settings[i]) != strlen(name) || memcmp(settings[i], name, eq - settings[i]))
+      continue;
+    if (!parse_value(eq + 1, &value) || value < min || value > max)
+      PANIC("bad value in -tune=%s: must be from %lld to %lld", settings[i], min, max);
+    set(t, value);
+    applied[i] = true;
+  }
+}
+
+/* Registers int VAR as the tunable NAME, from MIN to MAX, as
+   tunable_register() does. */
+void tunable_register_int(const char* name, int* var, int min, int max) {
+  tunable_register(name, TUNABLE_INT, var, min, max);
+}
+
+/* Registers unsigned VAR as the tunable NAME, from MIN to MAX, as
+   tunable_register() does. */
+void tunable_register_uint(const char* name, unsigned* var, unsigned min, unsigned max) {
+  tunable_register(name, TUNABLE_UINT, var, min, max);
+}
+
+/* Registers bool VAR as the tunable NAME, which may be 0 or 1, as
+   tunable_register() does. */
+void tunable_register_bool(const char* name, bool* var) {
+  tunable_register(name, TUNABLE_BOOL, var, 0, 1);
+}
+
+/* Records SETTING, the value of a -tune option on the kernel
+   command line, which must have the form KEY=VALUE and stay
+   valid forever, to be applied when KEY is registered. */
+void tunable_parse(char* setting) {
+  if (setting == NULL || strchr(setting, '=') == NULL)
+    PANIC("-tune requires KEY=VALUE (use -h for help)");
+  if (setting_cnt >= TUNABLE_MAX)
+    PANIC("too many -tune options");
+  settings[setting_cnt++] = setting;
+}
+
+/* Panics if a -tune setting names a tunable that has not been
+   registered, which should be the case once boot is complete. */
+void tunable_check_settings(void) {
+  size_t i;
+
+  for (i = 0; i < setting_cnt; i++)
+    if (!applied[i])
+      PANIC("unknown tunable in -tune=%s", settings[i]);
+}
+
+/* Stores the value of the tunable named NAME in *VALUE and
+   returns true, or returns false if there is no such tunable. */
+bool tunable_get(const char* name, int64_t* value) {
+  struct tunable* t = find(name);
+
+  if (t == NULL)
+    return false;
+  *value = get(t);
+  return true;
+}
+
+/* Sets the tunable named NAME to VALUE and returns true.  Returns
+   false if there is no such tunable or VALUE is out of its
+   bounds. */
+bool tunable_set(const char* name, int64_t value) {
+  struct tunable* t = find(name);
+
+  if (t == NULL || value < t->min || value > t->max)
+    return false;
+  set(t, value);
+  return true;
+}
@@ -0,0 +1,42 @@
+#ifndef THREADS_TUNABLE_H
+#define THREADS_TUNABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Tunables.
+
+   A tunable is a kernel variable that controls performance, such
+   as a time slice or the interval between cache flushes, which
+   can be changed without rebuilding the kernel.  The subsystem
+   that owns the variable registers it at initialization under a
+   dotted name, "subsystem.knob", with the bounds its value must
+   stay within; its value at registration is its default.  The
+   kernel command line sets tunables with -tune=KEY=VALUE, which
+   takes effect as KEY is registered, and processes read and set
+   them with the sysctl() system call.
+
+   The owner reads the variable wherever it needs it, so a change
+   takes effect the next time it does.  Variables are int,
+   unsigned or bool, and a store to one is atomic, so reading one
+   needs no lock. */
+
+/* Type of a tunable variable. */
+enum tunable_type {
+  TUNABLE_INT,  /* int. */
+  TUNABLE_UINT, /* unsigned int. */
+  TUNABLE_BOOL, /* bool, 0 or 1. */
+};
+
+void tunable_register(const char* name, enum tunable_type, void* var, int64_t min, int64_t max);
+void tunable_register_int(const char* name, int* var, int min, int max);
+void tunable_register_uint(const char* name, unsigned* var, unsigned min, unsigned max);
+void tunable_register_bool(const char* name, bool* var);
+
+void tunable_parse(char* setting);
+void tunable_check_settings(void);
+
+bool tunable_get(const char* name, int64_t* value);
+bool tunable_set(const char* name, int64_t value);
+
+#endif /* threads/tunable.h */
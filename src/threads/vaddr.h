@@ -2,6 +2,7 @@
 #define THREADS_VADDR_H
 
 #include <debug.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -34,6 +35,24 @@ static inline void* pg_round_up(const void* va) {
 /* Round down to nearest page boundary. */
 static inline void* pg_round_down(const void* va) { return (void*)((uintptr_t)va & ~PGMASK); }
 
+/* Copies the page at SRC to the page at DST, both of which must
+   be page-aligned, a word at a time. */
+static inline void pg_copy(void* dst, const void* src) {
+  size_t words = PGSIZE / 4;
+
+  ASSERT(pg_ofs(dst) == 0 && pg_ofs(src) == 0);
+  asm volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(words) : : "memory");
+}
+
+/* Fills the page at PAGE, which must be page-aligned, with
+   zeros a word at a time. */
+static inline void pg_zero(void* page) {
+  size_t words = PGSIZE / 4;
+
+  ASSERT(pg_ofs(page) == 0);
+  asm volatile("rep stosl" : "+D"(page), "+c"(words) : "a"(0) : "memory");
+}
+
 /* Base address of the 1:1 physical-to-virtual mapping.  Physical
    memory is mapped starting at this virtual address.  Thus,
    physical address 0 is accessible at PHYS_BASE, physical
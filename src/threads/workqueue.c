@@ -0,0 +1,260 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Kernel work queues.
+
+   A subsystem with work to do in the background creates a queue
+   with wq_create() and hands it items with wq_queue(), instead of
+   running a thread of its own.  All queues share one pool of
+   worker threads, at most WQ_MAX_WORKERS of them, which is grown
+   when an item is queued and no worker is idle.  A worker takes
+   the highest-priority queue that has items and is running fewer
+   than its MAX_ACTIVE of them, raises or lowers itself to that
+   queue's priority, and takes up to WQ_BATCH items at once, so a
+   burst of items costs one trip through the pool.
+
+   The pool's state is protected by disabling interrupts, so
+   wq_queue() may be called from interrupt context, such as
+   deferred interrupt work.  A worker cannot be created there, so
+   such items wait for a worker that is running or idle. */
+
+/* Most worker threads in the pool. */
+#define WQ_MAX_WORKERS 8
+
+/* Most items a worker takes from a queue at once. */
+#define WQ_BATCH 8
+
+/* A work queue.  Interrupts off, except for the constant
+   members. */
+struct workqueue {
+  const char* name;      /* Name, for statistics. */
+  int priority;          /* Priority its items run at. */
+  unsigned max_active;   /* Most workers running its items at once. */
+  struct list pending;   /* Queued items, oldest first. */
+  size_t pending_cnt;    /* Number of items in PENDING. */
+  unsigned active;       /* Workers running its items. */
+  struct list flushers;  /* Threads in wq_flush(), as struct flusher. */
+  struct list_elem elem; /* Element in all_queues. */
+
+  /* Statistics. */
+  size_t queued_cnt;  /* Items queued. */
+  size_t run_cnt;     /* Items run. */
+  size_t batch_cnt;   /* Batches taken by workers. */
+  size_t peak_cnt;    /* Most items pending at once. */
+  int64_t wait_ticks; /* Total ticks from queuing to being taken. */
+};
+
+/* A thread waiting in wq_flush(). */
+struct flusher {
+  struct list_elem elem;
+  struct semaphore done;
+};
+
+/* Every queue.  Queues are never destroyed.  Interrupts off. */
+static struct list all_queues = LIST_INITIALIZER(all_queues);
+
+/* The worker pool.  Interrupts off. */
+static unsigned worker_cnt;          /* Workers created. */
+static unsigned idle_cnt;            /* Workers about to sleep on WORK_READY. */
+static struct semaphore work_ready; /* Upped once for each idle worker woken. */
+
+static thread_func worker;
+
+/* Initializes the work queue module. */
+void wq_init(void) { sema_init(&work_ready, 0); }
+
+/* Creates and returns a work queue named NAME, whose items run
+   at PRIORITY, at most MAX_ACTIVE of them at once.  A MAX_ACTIVE
+   of 1 runs items one at a time in the order queued.  Panics if
+   memory is not available, since queues are created while the
+   kernel initializes. */
+struct workqueue* wq_create(const char* name, int priority, unsigned max_active) {
+  struct workqueue* wq;
+  enum intr_level old_level;
+
+  ASSERT(priority >= PRI_MIN && priority <= PRI_MAX);
+  ASSERT(max_active > 0);
+
+  wq = calloc(1, sizeof *wq);
+  if (wq == NULL)
+    PANIC("%s: out of memory for work queue", name);
+  wq->name = name;
+  wq->priority = priority;
+  wq->max_active = max_active;
+  list_init(&wq->pending);
+  list_init(&wq->flushers);
+
+  old_level = intr_disable();
+  list_push_back(&all_queues, &wq->elem);
+  intr_set_level(old_level);
+  return wq;
+}
+
+/* Initializes W to call FN with AUX when it runs. */
+void work_init(struct work* w, work_func* fn, void* aux) {
+  w->fn = fn;
+  w->aux = aux;
+  w->pending = false;
+}
+
+/* Queues W on WQ, to be run by a worker soon.  Returns true, or
+   false without doing anything if W is already queued and has
+   not started running.  May be called from interrupt
+   context. */
+bool wq_queue(struct workqueue* wq, struct work* w) {
+  enum intr_level old_level;
+  bool spawn = false;
+
+  old_level = intr_disable();
+  if (w->pending) {
+    intr_set_level(old_level);
+    return false;
+  }
+  w->pending = true;
+  w->queued = timer_ticks();
+  list_push_back(&wq->pending, &w->elem);
+  if (++wq->pending_cnt > wq->peak_cnt)
+    wq->peak_cnt = wq->pending_cnt;
+  wq->queued_cnt++;
+
+  if (wq->active < wq->max_active) {
+    if (idle_cnt > 0) {
+      idle_cnt--;
+      sema_up(&work_ready);
+    } else if (worker_cnt < WQ_MAX_WORKERS && !intr_context()) {
+      worker_cnt++;
+      spawn = true;
+    }
+  }
+  intr_set_level(old_level);
+
+  if (spawn) {
+    char name[16];
+
+    snprintf(name, sizeof name, "kworker%u", worker_cnt - 1);
+    if (thread_create(name, wq->priority, worker, NULL) == TID_ERROR) {
+      old_level = intr_disable();
+      worker_cnt--;
+      intr_set_level(old_level);
+    }
+  }
+  return true;
+}
+
+/* Waits until every item queued on WQ before the call has run,
+   and no worker is running any of its items.  Must not be called
+   from one of WQ's own items, which would wait for itself. */
+void wq_flush(struct workqueue* wq) {
+  struct flusher f;
+  enum intr_level old_level;
+
+  ASSERT(!intr_context());
+
+  old_level = intr_disable();
+  if (wq->pending_cnt > 0 || wq->active > 0) {
+    sema_init(&f.done, 0);
+    list_push_back(&wq->flushers, &f.elem);
+    sema_down(&f.done);
+  }
+  intr_set_level(old_level);
+}
+
+/* Returns true if WQ has items queued or running.  The answer
+   may be out of date by the time the caller looks at it. */
+bool wq_busy(const struct workqueue* wq) { return wq->pending_cnt > 0 || wq->active > 0; }
+
+/* Returns the highest-priority queue that has items and room for
+   another worker, or a null pointer if there is none.
+   Interrupts must be off. */
+static struct workqueue* choose_queue(void) {
+  struct workqueue* best = NULL;
+  struct list_elem* e;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  for (e = list_begin(&all_queues); e != list_end(&all_queues); e = list_next(e)) {
+    struct workqueue* wq = list_entry(e, struct workqueue, elem);
+    if (wq->pending_cnt > 0 && wq->active < wq->max_active &&
+        (best == NULL || wq->priority > best->priority))
+      best = wq;
+  }
+  return best;
+}
+
+/* Thread function for a pool worker, which runs batches of items
+   from whichever queue choose_queue() picks, forever. */
+static void worker(void* aux UNUSED) {
+  struct list batch;
+
+  list_init(&batch);
+  for (;;) {
+    struct workqueue* wq;
+    enum intr_level old_level;
+    size_t n;
+
+    old_level = intr_disable();
+    while ((wq = choose_queue()) == NULL) {
+      idle_cnt++;
+      sema_down(&work_ready);
+    }
+    wq->active++;
+    wq->batch_cnt++;
+    for (n = 0; n < WQ_BATCH && !list_empty(&wq->pending); n++) {
+      struct work* w = list_entry(list_pop_front(&wq->pending), struct work, elem);
+      wq->wait_ticks += timer_ticks() - w->queued;
+      list_push_back(&batch, &w->elem);
+    }
+    wq->pending_cnt -= n;
+    intr_set_level(old_level);
+
+    if (thread_current()->priority != wq->priority)
+      thread_set_priority(wq->priority);
+
+    /* An item stays pending until it starts, so that queuing it
+       again cannot pull it out of BATCH.  It may free itself, so
+       it is not touched after it runs. */
+    while (!list_empty(&batch)) {
+      struct work* w;
+      work_func* fn;
+      void* aux;
+
+      old_level = intr_disable();
+      w = list_entry(list_pop_front(&batch), struct work, elem);
+      w->pending = false;
+      fn = w->fn;
+      aux = w->aux;
+      intr_set_level(old_level);
+      fn(aux);
+    }
+
+    old_level = intr_disable();
+    wq->active--;
+    wq->run_cnt += n;
+    if (wq->pending_cnt == 0 && wq->active == 0)
+      while (!list_empty(&wq->flushers)) {
+        struct flusher* f = list_entry(list_pop_front(&wq->flushers), struct flusher, elem);
+        sema_up(&f->done);
+      }
+    intr_set_level(old_level);
+  }
+}
+
+/* Prints statistics about each work queue. */
+void wq_print_stats(void) {
+  struct list_elem* e;
+
+  printf("Work queues: %u workers\n", worker_cnt);
+  for (e = list_begin(&all_queues); e != list_end(&all_queues); e = list_next(e)) {
+    struct workqueue* wq = list_entry(e, struct workqueue, elem);
+    printf("Work queue %s: %zu queued, %zu run in %zu batches, peak %zu pending, "
+           "%" PRId64 " ticks waiting\n",
+           wq->name, wq->queued_cnt, wq->run_cnt, wq->batch_cnt, wq->peak_cnt, wq->wait_ticks);
+  }
+}
@@ -0,0 +1,32 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Runs one item of background work.  AUX is the value passed to
+   work_init().  The item may be queued again, or freed, from
+   within. */
+typedef void work_func(void* aux);
+
+/* An item of background work, usually embedded in the object it
+   is about.  Owned by the work queue from wq_queue() until its
+   function is called. */
+struct work {
+  struct list_elem elem; /* Element in the queue's pending list. */
+  work_func* fn;         /* Function to run. */
+  void* aux;             /* Its argument. */
+  bool pending;          /* Queued but not yet started? */
+  int64_t queued;        /* timer_ticks() when queued. */
+};
+
+void wq_init(void);
+struct workqueue* wq_create(const char* name, int priority, unsigned max_active);
+void work_init(struct work*, work_func*, void* aux);
+bool wq_queue(struct workqueue*, struct work*);
+void wq_flush(struct workqueue*);
+bool wq_busy(const struct workqueue*);
+void wq_print_stats(void);
+
+#endif /* threads/workqueue.h */
@@ -4,17 +4,23 @@
 #include "userprog/gdt.h"
 #include "userprog/process.h"
 #include "threads/interrupt.h"
+#include "threads/percpu.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "userprog/syscall.h"
+#include "userprog/uaccess.h"
 #include "threads/synch.h"
 #include <syscall-nr.h>
 
-/* Number of page faults processed. */
-static long long page_fault_cnt;
+/* Number of page faults processed, and of those that mapped a
+   page, how many were minor and major and how many copied a page
+   for copy-on-write or grew a stack, as in struct rusage. */
+static struct percpu_counter page_fault_cnt;
+static struct percpu_counter minor_fault_cnt, major_fault_cnt;
+static struct percpu_counter cow_fault_cnt, stack_fault_cnt;
 
 static void kill(struct intr_frame*);
 static void page_fault(struct intr_frame*);
-static bool syscall_uses_filesys_lock(int syscall_num);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -47,7 +53,6 @@ void exception_init(void) {
   intr_register_int(0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int(1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int(6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int(7, 0, INTR_ON, kill, "#NM Device Not Available Exception");
   intr_register_int(11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int(12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
   intr_register_int(13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -61,7 +66,25 @@ void exception_init(void) {
 }
 
 /* Prints exception statistics. */
-void exception_print_stats(void) { printf("Exception: %lld page faults\n", page_fault_cnt); }
+void exception_print_stats(void) {
+  printf("Exception: %lld page faults (%lld minor, %lld major, %lld copy-on-write, "
+         "%lld stack growth)\n",
+         percpu_counter_sum(&page_fault_cnt), percpu_counter_sum(&minor_fault_cnt),
+         percpu_counter_sum(&major_fault_cnt), percpu_counter_sum(&cow_fault_cnt),
+         percpu_counter_sum(&stack_fault_cnt));
+}
+
+/* Counts a page fault by process PCB that mapped a page, with
+   I/O if MAJOR is true. */
+static void count_mapped_fault(struct process* pcb, bool major) {
+  if (major) {
+    percpu_counter_inc(&major_fault_cnt);
+    pcb->usage.major_faults++;
+  } else {
+    percpu_counter_inc(&minor_fault_cnt);
+    pcb->usage.minor_faults++;
+  }
+}
 
 /* Handler for an exception (probably) caused by a user process. */
 static void kill(struct intr_frame* f) {
@@ -126,13 +149,16 @@ static void page_fault(struct intr_frame* f) {
      [IA32-v3a] 5.15 "Interrupt 14--Page Fault Exception
      (#PF)". */
   asm("movl %%cr2, %0" : "=r"(fault_addr));
+  TRACE(TRACE_PAGE_FAULT, fault_addr, f->eip);
 
   /* Turn interrupts back on (they were only off so that we could
      be assured of reading CR2 before it changed). */
   intr_enable();
 
-  /* Count page faults. */
-  page_fault_cnt++;
+  /* Count page faults, globally and against the process. */
+  percpu_counter_inc(&page_fault_cnt);
+  if (thread_current()->pcb != NULL)
+    thread_current()->pcb->usage.page_faults++;
 
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
@@ -141,6 +167,42 @@ static void page_fault(struct intr_frame* f) {
 
   struct thread* t = thread_current();
 
+#ifdef VM
+  /* A page of the executable that load() left for the first touch
+     to read in. */
+  bool major;
+  if (not_present && is_user_vaddr(fault_addr) && process_load_page(fault_addr, write, &major)) {
+    count_mapped_fault(t->pcb, major);
+    return;
+  }
+#endif
+
+  /* An access just below the stack pointer, by user code or by
+     the kernel during a system call, that the stack grows to
+     cover. */
+  if (not_present && is_user_vaddr(fault_addr) &&
+      process_grow_stack(fault_addr, user ? f->esp : t->user_esp)) {
+    count_mapped_fault(t->pcb, false);
+    percpu_counter_inc(&stack_fault_cnt);
+    t->pcb->usage.stack_faults++;
+    return;
+  }
+
+  /* A write to a page that fork() shares copy-on-write, either by
+     user code or by the kernel on its behalf, succeeds once the
+     process has its own copy of the page. */
+  if (!not_present && write && is_user_vaddr(fault_addr) && process_break_cow(fault_addr)) {
+    count_mapped_fault(t->pcb, false);
+    percpu_counter_inc(&cow_fault_cnt);
+    t->pcb->usage.cow_faults++;
+    return;
+  }
+
+  /* A fault in one of the user memory accessors in uaccess.c
+     makes the accessor report an error to its caller. */
+  if (!user && is_user_vaddr(fault_addr) && uaccess_fixup(f))
+    return;
+
   /*
    * If we faulted on a user address in kernel mode while handling a syscall,
    * then it's because the user provided invalid syscall arguments. Our checks
@@ -150,13 +212,8 @@ static void page_fault(struct intr_frame* f) {
    * the kernel and end up here. These checks below will allow us to determine
    * that this happened and terminate the process appropriately.
    */
-  if (!user && t->current_syscall != -1 && is_user_vaddr(fault_addr)) {
-    /* Release filesystem lock if current syscall was using it */
-    if (t->current_syscall > 0 && syscall_uses_filesys_lock(t->current_syscall)) {
-      lock_release(&filesys_lock);
-    }
+  if (!user && t->current_syscall != -1 && is_user_vaddr(fault_addr))
     syscall_exit(-1);
-  }
 
   /*
    * If we faulted in user mode, then we assume it's an invalid memory access
@@ -176,20 +233,3 @@ static void page_fault(struct intr_frame* f) {
   kill(f);
 }
 
-/* Returns true if the given syscall number uses the filesystem lock */
-static bool syscall_uses_filesys_lock(int syscall_num) {
-  switch (syscall_num) {
-    case SYS_CREATE:
-    case SYS_REMOVE:
-    case SYS_OPEN:
-    case SYS_FILESIZE:
-    case SYS_READ:
-    case SYS_WRITE:
-    case SYS_TELL:
-    case SYS_CLOSE:
-    case SYS_SEEK:
-      return true;
-    default:
-      return false;
-  }
-}
@@ -0,0 +1,207 @@
+#include "userprog/exec-cache.h"
+#include <debug.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Cache of parsed executables.
+
+   load() reads an executable's ELF header and program headers and
+   validates every segment before it loads anything.  Programs
+   tend to be run over and over, so we keep the result for the
+   last few executables, keyed by inode and the inode's generation
+   at the time the headers were read.  A write to the file changes
+   the generation, so a stale entry is never used.
+
+   Each entry holds the inode open, which keeps the in-memory
+   inode, and with it its generation, alive between runs.  It
+   also keeps a removed file's blocks allocated until the entry is
+   evicted, which is why the cache is small.
+
+   An entry may also hold a template, the address space of the
+   executable as load() left it, which process.c copies instead
+   of loading the executable again.  A template is destroyed, and
+   the memory it holds freed, only after exec_cache_lock is
+   released, since that takes the locks of the memory system.
+
+   Lock order: exec_cache_lock, then the inode locks. */
+
+/* Number of executables cached. */
+#define EXEC_CACHE_SIZE 8
+
+/* A cached executable. */
+struct exec_cache_entry {
+  struct inode* inode;            /* Executable, or null if the entry is free. */
+  unsigned generation;            /* INODE's generation when IMAGE was read. */
+  struct exec_image* image;       /* What its headers say. */
+  struct exec_template* template; /* Loaded address space, or null. */
+  unsigned last_use;              /* Value of use_clock when last used. */
+};
+
+static struct exec_cache_entry entries[EXEC_CACHE_SIZE];
+static unsigned use_clock; /* Advances on each lookup or insertion. */
+static struct lock exec_cache_lock;
+
+/* Initializes the executable cache. */
+void exec_cache_init(void) { lock_init_named(&exec_cache_lock, "exec_cache"); }
+
+/* Returns a new image with room for SEG_CNT segments and one
+   reference, or a null pointer if memory is exhausted. */
+struct exec_image* exec_image_create(size_t seg_cnt) {
+  struct exec_image* image = malloc(sizeof *image + seg_cnt * sizeof *image->segs);
+
+  if (image != NULL) {
+    image->entry = NULL;
+    image->interp[0] = '\0';
+    image->ref_cnt = 1;
+    image->seg_cnt = seg_cnt;
+  }
+  return image;
+}
+
+/* Drops a reference to IMAGE, freeing it if that was the last. */
+void exec_image_release(struct exec_image* image) {
+  bool last;
+
+  if (image == NULL)
+    return;
+  lock_acquire(&exec_cache_lock);
+  last = --image->ref_cnt == 0;
+  lock_release(&exec_cache_lock);
+  if (last)
+    free(image);
+}
+
+/* Empties entry E.  Returns its template, whose reference the
+   caller must drop with exec_template_release() once it has
+   released exec_cache_lock, or a null pointer.  The caller must
+   hold exec_cache_lock. */
+static struct exec_template* entry_clear(struct exec_cache_entry* e) {
+  struct exec_template* template = e->template;
+
+  ASSERT(lock_held_by_current_thread(&exec_cache_lock));
+  if (e->inode != NULL) {
+    inode_close(e->inode);
+    if (--e->image->ref_cnt == 0)
+      free(e->image);
+    e->inode = NULL;
+    e->image = NULL;
+    e->template = NULL;
+  }
+  return template;
+}
+
+/* Returns the entry for INODE, or a null pointer if there is none.
+   The caller must hold exec_cache_lock. */
+static struct exec_cache_entry* entry_find(struct inode* inode) {
+  size_t i;
+
+  for (i = 0; i < EXEC_CACHE_SIZE; i++)
+    if (entries[i].inode == inode)
+      return &entries[i];
+  return NULL;
+}
+
+/* Returns a new reference to the cached image of INODE, if it was
+   read at GENERATION, or a null pointer otherwise.  A cached image
+   from another generation is out of date and is dropped. */
+struct exec_image* exec_cache_lookup(struct inode* inode, unsigned generation) {
+  struct exec_cache_entry* e;
+  struct exec_image* image = NULL;
+  struct exec_template* stale = NULL;
+
+  lock_acquire(&exec_cache_lock);
+  e = entry_find(inode);
+  if (e != NULL) {
+    if (e->generation == generation) {
+      image = e->image;
+      image->ref_cnt++;
+      e->last_use = ++use_clock;
+    } else
+      stale = entry_clear(e);
+  }
+  lock_release(&exec_cache_lock);
+  exec_template_release(stale);
+  return image;
+}
+
+/* Caches IMAGE as what INODE's headers said at GENERATION,
+   evicting the least recently used entry if the cache is full.
+   The cache takes its own reference to IMAGE, and IMAGE must not
+   change from now on. */
+void exec_cache_insert(struct inode* inode, unsigned generation, struct exec_image* image) {
+  struct exec_cache_entry* e;
+  struct exec_template* stale;
+  size_t i;
+
+  lock_acquire(&exec_cache_lock);
+  e = entry_find(inode);
+  if (e == NULL) {
+    e = &entries[0];
+    for (i = 0; i < EXEC_CACHE_SIZE && e->inode != NULL; i++)
+      if (entries[i].inode == NULL || entries[i].last_use < e->last_use)
+        e = &entries[i];
+  }
+  stale = entry_clear(e);
+
+  e->inode = inode_reopen(inode);
+  e->generation = generation;
+  e->image = image;
+  image->ref_cnt++;
+  e->last_use = ++use_clock;
+  lock_release(&exec_cache_lock);
+  exec_template_release(stale);
+}
+
+/* Initializes template T with one reference, to be freed by
+   calling DESTROY once the last one is dropped. */
+void exec_template_init(struct exec_template* t, void (*destroy)(struct exec_template*)) {
+  t->ref_cnt = 1;
+  t->destroy = destroy;
+}
+
+/* Drops a reference to template T, destroying it if that was the
+   last.  Must not be called with exec_cache_lock held. */
+void exec_template_release(struct exec_template* t) {
+  bool last;
+
+  if (t == NULL)
+    return;
+  lock_acquire(&exec_cache_lock);
+  last = --t->ref_cnt == 0;
+  lock_release(&exec_cache_lock);
+  if (last)
+    t->destroy(t);
+}
+
+/* Returns a new reference to the template cached for INODE at
+   GENERATION, or a null pointer if there is none. */
+struct exec_template* exec_cache_get_template(struct inode* inode, unsigned generation) {
+  struct exec_cache_entry* e;
+  struct exec_template* t = NULL;
+
+  lock_acquire(&exec_cache_lock);
+  e = entry_find(inode);
+  if (e != NULL && e->generation == generation && e->template != NULL) {
+    t = e->template;
+    t->ref_cnt++;
+    e->last_use = ++use_clock;
+  }
+  lock_release(&exec_cache_lock);
+  return t;
+}
+
+/* Caches T as the template for INODE at GENERATION, taking a
+   reference of its own, if INODE's image from that generation is
+   cached and has no template yet.  Otherwise does nothing. */
+void exec_cache_set_template(struct inode* inode, unsigned generation, struct exec_template* t) {
+  struct exec_cache_entry* e;
+
+  lock_acquire(&exec_cache_lock);
+  e = entry_find(inode);
+  if (e != NULL && e->generation == generation && e->template == NULL) {
+    e->template = t;
+    t->ref_cnt++;
+  }
+  lock_release(&exec_cache_lock);
+}
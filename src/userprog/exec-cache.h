@@ -0,0 +1,54 @@
+#ifndef USERPROG_EXEC_CACHE_H
+#define USERPROG_EXEC_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct inode;
+
+/* A loadable segment of an executable, already validated, in the
+   form load_segment() takes. */
+struct exec_segment {
+  uint32_t file_page;  /* Page-aligned offset of the segment in the file. */
+  uint8_t* upage;      /* First user page the segment occupies. */
+  uint32_t read_bytes; /* Bytes to read from the file. */
+  uint32_t zero_bytes; /* Bytes to zero following them. */
+  bool writable;       /* Whether user code may write the pages. */
+};
+
+/* Longest name of a shared library, including the null
+   terminator, that an executable's PT_INTERP may give. */
+#define EXEC_INTERP_MAX 32
+
+/* What load() learns from an executable's headers.  Images are
+   shared and must not be changed once they are in the cache. */
+struct exec_image {
+  void (*entry)(void);          /* Start address. */
+  char interp[EXEC_INTERP_MAX]; /* Shared library to map, or "". */
+  int ref_cnt;                  /* Private to exec-cache.c. */
+  size_t seg_cnt;               /* Number of elements in SEGS. */
+  struct exec_segment segs[];   /* Loadable segments. */
+};
+
+/* A loaded address space of an executable, which new processes
+   that run it start out as copies of.  Embedded in a structure
+   of process.c's.  Templates are shared and reference counted
+   like images. */
+struct exec_template {
+  int ref_cnt;                            /* Private to exec-cache.c. */
+  void (*destroy)(struct exec_template*); /* Frees the template. */
+};
+
+void exec_cache_init(void);
+struct exec_image* exec_image_create(size_t seg_cnt);
+void exec_image_release(struct exec_image*);
+struct exec_image* exec_cache_lookup(struct inode*, unsigned generation);
+void exec_cache_insert(struct inode*, unsigned generation, struct exec_image*);
+
+void exec_template_init(struct exec_template*, void (*destroy)(struct exec_template*));
+void exec_template_release(struct exec_template*);
+struct exec_template* exec_cache_get_template(struct inode*, unsigned generation);
+void exec_cache_set_template(struct inode*, unsigned generation, struct exec_template*);
+
+#endif /* userprog/exec-cache.h */
@@ -0,0 +1,150 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <limits.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/uaccess.h"
+
+/* Futexes ("fast user-space mutexes").
+
+   A futex is an int in user memory that user code updates with
+   atomic instructions, so that uncontended lock and semaphore
+   operations need no system call.  The kernel only provides a
+   way to sleep until the int changes, futex_wait(), and to wake
+   sleepers after changing it, futex_wake(), or all of them as a
+   gang, futex_wake_all().  The kernel attaches no meaning to the
+   value itself.
+
+   Sleepers are kept in a fixed table of wait queues, hashed by
+   process and user address, so one queue may hold sleepers on
+   several futexes.  Nothing is allocated: each sleeper's entry
+   is on its own kernel stack, and since entries are ordinary
+   wait queue elements, thread_discard() takes a killed thread
+   off its queue like any other.  A process's futexes therefore
+   need no cleanup when it exits. */
+
+/* Number of wait queues.  Must be a power of 2. */
+#define FUTEX_QUEUE_CNT 64
+
+/* A thread sleeping on a futex. */
+struct futex_waiter {
+  struct wait_queue_elem elem; /* Element in futex_queues[]. */
+  struct process* pcb;         /* Process whose address space UADDR is in. */
+  int* uaddr;                  /* The futex. */
+};
+
+static struct wait_queue futex_queues[FUTEX_QUEUE_CNT];
+
+/* Initializes the futex wait queues. */
+void futex_init(void) {
+  for (int i = 0; i < FUTEX_QUEUE_CNT; i++)
+    wait_queue_init(&futex_queues[i]);
+}
+
+/* Returns the wait queue for futex UADDR in process PCB. */
+static struct wait_queue* futex_queue(struct process* pcb, int* uaddr) {
+  unsigned h = hash_int((int)(uintptr_t)uaddr) ^ hash_int((int)(uintptr_t)pcb);
+  return &futex_queues[h & (FUTEX_QUEUE_CNT - 1)];
+}
+
+/* If the int at user address UADDR still holds VAL, sleeps until
+   futex_wake() is called on UADDR and returns 1.  Otherwise,
+   returns 0 immediately, or FUTEX_FAULT if UADDR is not mapped.
+   The check and going to sleep are atomic with respect to
+   futex_wake(), so a wakeup that follows a change to *UADDR
+   cannot be lost.  UADDR must be aligned.
+
+   The check reads *UADDR twice.  The first read, with interrupts
+   on, lets a page fault bring the page in or reject UADDR.  The
+   second, with interrupts off, must not fault, because the page
+   fault handler turns interrupts back on, so it waits until the
+   page is known to be present.  If the page was evicted between
+   the two, the check starts over. */
+int futex_wait(int* uaddr, int val) {
+  struct thread* cur = thread_current();
+  struct futex_waiter waiter;
+  enum intr_level old_level;
+  int cur_val;
+
+  ASSERT(!intr_context());
+
+  for (;;) {
+    if (!copy_from_user(&cur_val, uaddr, sizeof cur_val))
+      return FUTEX_FAULT;
+    if (cur_val != val)
+      return 0;
+
+    old_level = intr_disable();
+    if (pagedir_get_page(cur->pcb->pagedir, uaddr) != NULL)
+      break;
+    intr_set_level(old_level);
+  }
+  if (!copy_from_user(&cur_val, uaddr, sizeof cur_val) || cur_val != val) {
+    intr_set_level(old_level);
+    return 0;
+  }
+
+  waiter.pcb = cur->pcb;
+  waiter.uaddr = uaddr;
+  wait_queue_push(futex_queue(cur->pcb, uaddr), &waiter.elem, cur);
+  thread_block();
+  intr_set_level(old_level);
+  return 1;
+}
+
+/* Wakes up to CNT threads of the running process sleeping on
+   futex UADDR, highest priority first, and returns the number
+   woken.  If GANG is true, each is queued as if it had at least
+   the running thread's priority. */
+static int wake(int* uaddr, int cnt, bool gang) {
+  struct process* pcb = thread_current()->pcb;
+  int priority = thread_get_priority();
+  struct wait_queue* q = futex_queue(pcb, uaddr);
+  struct wait_queue_elem* e;
+  int max_priority = PRI_MIN;
+  int woken = 0;
+  enum intr_level old_level;
+
+  old_level = intr_disable();
+  for (e = wait_queue_front(q); e != NULL && woken < cnt;) {
+    struct futex_waiter* w = wait_queue_entry(e, struct futex_waiter, elem);
+    struct wait_queue_elem* next = wait_queue_next(e);
+
+    if (w->pcb == pcb && w->uaddr == uaddr) {
+      struct thread* t = e->thread;
+      wait_queue_remove(e);
+      if (gang)
+        thread_unblock_at(t, priority);
+      else
+        thread_unblock(t);
+      if ((active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS) &&
+          thread_get_priority_of(t) > max_priority)
+        max_priority = thread_get_priority_of(t);
+      woken++;
+    }
+    e = next;
+  }
+  intr_set_level(old_level);
+
+  if (max_priority > thread_get_priority_of(thread_current()))
+    thread_yield();
+  return woken;
+}
+
+/* Wakes up to CNT threads of the running process sleeping on
+   futex UADDR, highest priority first, and returns the number
+   woken. */
+int futex_wake(int* uaddr, int cnt) { return wake(uaddr, cnt, false); }
+
+/* Wakes every thread of the running process sleeping on futex
+   UADDR at once, and returns the number woken.  Each is queued as
+   if it had at least the running thread's priority, so that a
+   gang of threads released together, such as the waiters at a
+   barrier, all get the CPU before threads the waker would run
+   ahead of, rather than each at its own priority. */
+int futex_wake_all(int* uaddr) { return wake(uaddr, INT_MAX, true); }
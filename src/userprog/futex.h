@@ -0,0 +1,14 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdbool.h>
+
+/* Returned by futex_wait() for a bad user address. */
+#define FUTEX_FAULT -1
+
+void futex_init(void);
+int futex_wait(int* uaddr, int val);
+int futex_wake(int* uaddr, int cnt);
+int futex_wake_all(int* uaddr);
+
+#endif /* userprog/futex.h */
@@ -27,6 +27,7 @@ static uint64_t gdt[SEL_CNT];
 /* GDT helpers. */
 static uint64_t make_code_desc(int dpl);
 static uint64_t make_data_desc(int dpl);
+static uint64_t make_tls_desc(uintptr_t base);
 static uint64_t make_tss_desc(void* laddr);
 static uint64_t make_gdtr_operand(uint16_t limit, void* base);
 
@@ -42,6 +43,7 @@ void gdt_init(void) {
   gdt[SEL_UCSEG / sizeof *gdt] = make_code_desc(3);
   gdt[SEL_UDSEG / sizeof *gdt] = make_data_desc(3);
   gdt[SEL_TSS / sizeof *gdt] = make_tss_desc(tss_get());
+  gdt[SEL_UTLS / sizeof *gdt] = make_tls_desc(0);
 
   /* Load GDTR, TR.  See [IA32-v3a] 2.4.1 "Global Descriptor
      Table Register (GDTR)", 2.4.4 "Task Register (TR)", and
@@ -51,6 +53,14 @@ void gdt_init(void) {
   asm volatile("ltr %w0" : : "q"(SEL_TSS));
 }
 
+/* Points the user thread-local storage segment at BASE.  User
+   threads run with %gs set to SEL_UTLS, and the CPU rereads a
+   descriptor only when a selector is loaded, so the running
+   thread sees the new base once intr_exit or SYSEXIT reloads its
+   %gs on the way back to user mode.  process_activate() calls
+   this on every switch to a thread. */
+void gdt_set_tls(uintptr_t base) { gdt[SEL_UTLS / sizeof *gdt] = make_tls_desc(base); }
+
 /* System segment or code/data segment? */
 enum seg_class {
   CLS_SYSTEM = 0,   /* System segment. */
@@ -112,6 +122,13 @@ static uint64_t make_data_desc(int dpl) {
   return make_seg_desc(0, 0xfffff, CLS_CODE_DATA, 2, dpl, GRAN_PAGE);
 }
 
+/* Returns a descriptor for a writable user data segment with its
+   base at BASE and a limit of 4 GB, so that offsets wrap around
+   to cover the whole address space. */
+static uint64_t make_tls_desc(uintptr_t base) {
+  return make_seg_desc(base, 0xfffff, CLS_CODE_DATA, 2, 3, GRAN_PAGE);
+}
+
 /* Returns a descriptor for an "available" 32-bit Task-State
    Segment with its base at the given linear address, a limit of
    0x67 bytes (the size of a 32-bit TSS), and a DPL of 0.
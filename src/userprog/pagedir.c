@@ -1,44 +1,266 @@
 #include "userprog/pagedir.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 
 static void invalidate_pagedir(uint32_t*);
+static void invalidate_page(uint32_t*, const void* upage);
+static void batch_flush(struct tlb_batch*);
+
+/* Pages pagedir_destroy() collects before freeing them at once. */
+#define DESTROY_BATCH 64
+
+/* Page directory and page table cache.
+
+   Building a page directory from scratch means zeroing its two
+   pages and copying in the kernel's PDEs, and every page table
+   is another zeroed page.  Under a burst of fork() and exec()
+   that work is repeated for address spaces that are torn down a
+   moment later.  So pagedir_destroy() keeps up to PD_CACHE_SIZE
+   page directories and PT_CACHE_SIZE page tables instead of
+   freeing them, as "dirty", and the idle thread cleans them in
+   pagedir_prepare_one().  A clean page directory has its kernel
+   PDEs in place already, since those never change after
+   paging_init(), so cleaning it clears only the user half and
+   the population counts.  The idle thread also builds fresh page
+   directories while fewer than PD_RESERVE are clean, so that
+   pagedir_create() is usually a pop from CLEAN_PDS.
+
+   The cache is protected by turning interrupts off, like the
+   thread page cache, since the idle thread works on it with
+   interrupts off. */
+#define PD_CACHE_SIZE 8  /* Most page directories kept. */
+#define PD_RESERVE 4     /* Clean page directories built ahead. */
+#define PT_CACHE_SIZE 32 /* Most page tables kept. */
+
+static uint32_t* clean_pds[PD_CACHE_SIZE]; /* Ready for pagedir_create(). */
+static uint32_t* dirty_pds[PD_CACHE_SIZE]; /* Destroyed, user half to clear. */
+static size_t clean_pd_cnt, dirty_pd_cnt;
+static uint32_t* clean_pts[PT_CACHE_SIZE]; /* Zeroed page tables. */
+static uint32_t* dirty_pts[PT_CACHE_SIZE]; /* Page tables to zero. */
+static size_t clean_pt_cnt, dirty_pt_cnt;
+
+/* Statistics. */
+static size_t pd_hits, pd_misses; /* Page directories from the cache or not. */
+static size_t pt_hits, pt_misses; /* Page tables from the cache or not. */
+static size_t pd_built;           /* Page directories built by the idle thread. */
+static size_t large_made;         /* Heap regions mapped by a large page. */
+static size_t large_split;        /* Large pages split back into page tables. */
+
+/* Returns the array of population counts of PD, which holds the
+   number of present PTEs in the page table of each PDE.  It fills
+   the page after PD, which pagedir_create() allocates along with
+   it, so that tearing down or copying PD can skip page tables
+   that are empty and stop scanning one at its last present PTE.
+   A process's address space is usually a few runs of pages
+   scattered across mostly empty page tables. */
+static uint16_t* pt_counts(uint32_t* pd) { return (uint16_t*)(pd + PGSIZE / sizeof *pd); }
+
+/* Large user pages.
+
+   pagedir_set_large_page() maps a 4 MB region of zero-filled
+   memory with a single PDE that has PTE_PS set, in place of a
+   page table of 1024 PTEs, so that the region costs one TLB
+   entry instead of up to 1024.  Its frames are ordinary user
+   pages, each with a reference of its own, so that every other
+   operation can turn the PDE back into a page table that maps
+   the same frames, as split_large_page() does, and go on page by
+   page.  The region's population count stays at 1024 throughout.
+
+   Splitting happens whenever one page of the region needs a
+   mapping that differs from the others: it is unmapped, or
+   shared copy-on-write by pagedir_copy().  It must not fail, so
+   each large page keeps a zeroed page table in reserve for it.
+   The reserves of PD are linked through their first words, from
+   the head that spare_pts() returns.  Reading through a large
+   page, as pagedir_get_page() does, does not split it. */
+
+/* Returns the head of PD's list of page tables held in reserve
+   for splitting its large pages.  It lives in the second half of
+   the population counts page, which the counts do not reach. */
+static uint32_t** spare_pts(uint32_t* pd) {
+  return (uint32_t**)((uint8_t*)pt_counts(pd) + PGSIZE / 2);
+}
+
+/* Allocates and returns a page directory, with its population
+   counts, that maps the kernel but no user addresses, or a null
+   pointer if memory allocation fails. */
+static uint32_t* pd_build(void) {
+  uint32_t* pd = palloc_get_multiple(PAL_ZERO, 2);
+  if (pd != NULL) {
+    /* Only the PDEs that cover RAM are in use, and the kernel
+       never adds more after paging_init(). */
+    size_t first = pd_no(PHYS_BASE);
+    size_t cnt = pd_no(ptov(init_ram_pages * PGSIZE - 1)) - first + 1;
+    memcpy(pd + first, init_page_dir + first, cnt * sizeof *pd);
+  }
+  return pd;
+}
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
    Returns the new page directory, or a null pointer if memory
    allocation fails. */
 uint32_t* pagedir_create(void) {
-  uint32_t* pd = palloc_get_page(0);
-  if (pd != NULL)
-    memcpy(pd, init_page_dir, PGSIZE);
-  return pd;
+  enum intr_level old_level = intr_disable();
+  uint32_t* pd = NULL;
+
+  if (clean_pd_cnt > 0) {
+    pd = clean_pds[--clean_pd_cnt];
+    pd_hits++;
+  } else
+    pd_misses++;
+  intr_set_level(old_level);
+  return pd != NULL ? pd : pd_build();
+}
+
+/* Returns a zeroed page table, or a null pointer if memory
+   allocation fails. */
+static uint32_t* pt_alloc(void) {
+  enum intr_level old_level = intr_disable();
+  uint32_t* pt = NULL;
+
+  if (clean_pt_cnt > 0) {
+    pt = clean_pts[--clean_pt_cnt];
+    pt_hits++;
+  } else
+    pt_misses++;
+  intr_set_level(old_level);
+  return pt != NULL ? pt : palloc_get_page(PAL_ZERO);
+}
+
+/* Keeps page table PT, which is no longer in use, in the cache
+   and returns true, or returns false if the cache is full. */
+static bool pt_keep(uint32_t* pt) {
+  enum intr_level old_level = intr_disable();
+  bool kept = clean_pt_cnt + dirty_pt_cnt < PT_CACHE_SIZE;
+
+  if (kept)
+    dirty_pts[dirty_pt_cnt++] = pt;
+  intr_set_level(old_level);
+  return kept;
+}
+
+/* Keeps page directory PD, which no longer maps any pages, in
+   the cache and returns true, or returns false if the cache is
+   full. */
+static bool pd_keep(uint32_t* pd) {
+  enum intr_level old_level = intr_disable();
+  bool kept = clean_pd_cnt + dirty_pd_cnt < PD_CACHE_SIZE;
+
+  if (kept)
+    dirty_pds[dirty_pd_cnt++] = pd;
+  intr_set_level(old_level);
+  return kept;
+}
+
+/* Cleans one dirty page directory or page table, or builds a
+   page directory if too few are clean and there is room.  Called
+   by the idle thread with interrupts off. */
+void pagedir_prepare_one(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (dirty_pd_cnt > 0) {
+    uint32_t* pd = dirty_pds[--dirty_pd_cnt];
+    memset(pd, 0, pd_no(PHYS_BASE) * sizeof *pd);
+    memset(pt_counts(pd), 0, pd_no(PHYS_BASE) * sizeof(uint16_t));
+    clean_pds[clean_pd_cnt++] = pd;
+  } else if (dirty_pt_cnt > 0) {
+    uint32_t* pt = dirty_pts[--dirty_pt_cnt];
+    pg_zero(pt);
+    clean_pts[clean_pt_cnt++] = pt;
+  } else if (clean_pd_cnt < PD_RESERVE) {
+    uint32_t* pd = pd_build();
+    if (pd != NULL) {
+      clean_pds[clean_pd_cnt++] = pd;
+      pd_built++;
+    }
+  }
+}
+
+/* Adds PAGE to the CNT pages in FREES, first freeing all of them
+   if there are DESTROY_BATCH already. */
+static void destroy_free(void* frees[], size_t* cnt, void* page) {
+  if (*cnt == DESTROY_BATCH) {
+    palloc_free_pages(frees, *cnt);
+    *cnt = 0;
+  }
+  frees[(*cnt)++] = page;
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references.  The pages go back to the allocator in batches,
+   and page tables with no present PTEs are not scanned. */
 void pagedir_destroy(uint32_t* pd) {
+  uint16_t* counts;
+  void* frees[DESTROY_BATCH];
+  size_t free_cnt = 0;
   uint32_t* pde;
 
   if (pd == NULL)
     return;
 
   ASSERT(pd != init_page_dir);
+  ASSERT(pd != active_pd());
+  counts = pt_counts(pd);
   for (pde = pd; pde < pd + pd_no(PHYS_BASE); pde++)
-    if (*pde & PTE_P) {
+    if (*pde & PTE_PS) {
+      uint8_t* kpage = pde_get_large_page(*pde);
+      size_t i;
+
+      for (i = 0; i < PTSPAN / PGSIZE; i++)
+        destroy_free(frees, &free_cnt, kpage + i * PGSIZE);
+    } else if (*pde & PTE_P) {
       uint32_t* pt = pde_get_pt(*pde);
+      size_t left = counts[pde - pd];
       uint32_t* pte;
 
-      for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-        if (*pte & PTE_P)
-          palloc_free_page(pte_get_page(*pte));
-      palloc_free_page(pt);
+      for (pte = pt; left > 0; pte++) {
+        ASSERT(pte < pt + PGSIZE / sizeof *pte);
+        if (*pte & PTE_P) {
+          destroy_free(frees, &free_cnt, pte_get_page(*pte));
+          left--;
+        }
+      }
+      if (!pt_keep(pt))
+        destroy_free(frees, &free_cnt, pt);
     }
-  palloc_free_page(pd);
+  while (*spare_pts(pd) != NULL) {
+    uint32_t* pt = *spare_pts(pd);
+    *spare_pts(pd) = *(uint32_t**)pt;
+    if (!pt_keep(pt))
+      destroy_free(frees, &free_cnt, pt);
+  }
+  palloc_free_pages(frees, free_cnt);
+  if (!pd_keep(pd))
+    palloc_free_multiple(pd, 2);
+}
+
+/* Turns user large page *PDE of PD back into a page table that
+   maps the same frames with the same permissions and accessed
+   and dirty bits, taking one of PD's spare page tables. */
+static void split_large_page(uint32_t* pd, uint32_t* pde) {
+  uint32_t* pt = *spare_pts(pd);
+  uint8_t* kpage = pde_get_large_page(*pde);
+  uint32_t bits = *pde & (PTE_A | PTE_D);
+  bool writable = (*pde & PTE_W) != 0;
+  size_t i;
+
+  ASSERT(pt != NULL);
+  *spare_pts(pd) = *(uint32_t**)pt;
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    pt[i] = pte_create_user(kpage + i * PGSIZE, writable) | bits;
+  *pde = pde_create(pt);
+  large_split++;
+
+  /* Invalidating any address in a large page drops all of it. */
+  invalidate_page(pd, (void*)((pde - pd) * PTSPAN));
 }
 
 /* Returns the address of the page table entry for virtual
@@ -46,7 +268,8 @@ void pagedir_destroy(uint32_t* pd) {
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.  A user large page is returned as its
+   PDE, unless CREATE is true, in which case it is split. */
 static uint32_t* lookup_page(uint32_t* pd, const void* vaddr, bool create) {
   uint32_t *pt, *pde;
 
@@ -60,7 +283,7 @@ static uint32_t* lookup_page(uint32_t* pd, const void* vaddr, bool create) {
   pde = pd + pd_no(vaddr);
   if (*pde == 0) {
     if (create) {
-      pt = palloc_get_page(PAL_ZERO);
+      pt = pt_alloc();
       if (pt == NULL)
         return NULL;
 
@@ -69,6 +292,13 @@ static uint32_t* lookup_page(uint32_t* pd, const void* vaddr, bool create) {
       return NULL;
   }
 
+  /* A large page has no page table: its PDE serves as the PTE. */
+  if (*pde & PTE_PS) {
+    if (!create)
+      return pde;
+    split_large_page(pd, pde);
+  }
+
   /* Return the page table entry. */
   pt = pde_get_pt(*pde);
   return &pt[pt_no(vaddr)];
@@ -98,11 +328,66 @@ bool pagedir_set_page(uint32_t* pd, void* upage, void* kpage, bool writable) {
   if (pte != NULL) {
     ASSERT((*pte & PTE_P) == 0);
     *pte = pte_create_user(kpage, writable);
+    pt_counts(pd)[pd_no(upage)]++;
     return true;
   } else
     return false;
 }
 
+/* Like pagedir_set_page(), but maps KPAGE read/write as shared
+   memory, which pagedir_copy() shares with the copy as it is
+   instead of making it copy-on-write. */
+bool pagedir_share_page(uint32_t* pd, void* upage, void* kpage) {
+  uint32_t* pte;
+
+  if (!pagedir_set_page(pd, upage, kpage, true))
+    return false;
+  pte = lookup_page(pd, upage, false);
+  *pte |= PTE_SHARED;
+  return true;
+}
+
+/* Maps user virtual page UPAGE in PD to the zero page, which
+   costs no memory of its own.  If WRITABLE is true, the mapping
+   is copy-on-write, so that the first write faults and
+   pagedir_break_cow() gives PD a private page of zeros;
+   otherwise it is read-only.  UPAGE must not already be mapped.
+   Returns false if memory allocation fails or the zero page is
+   not available, in which case the caller should map a page of
+   its own instead. */
+bool pagedir_set_zero_page(uint32_t* pd, void* upage, bool writable) {
+  void* kpage = palloc_get_zero_page();
+  uint32_t* pte;
+
+  if (kpage == NULL)
+    return false;
+  if (!pagedir_set_page(pd, upage, kpage, false)) {
+    palloc_free_page(kpage);
+    return false;
+  }
+  if (writable) {
+    pte = lookup_page(pd, upage, false);
+    *pte |= PTE_COW;
+  }
+  return true;
+}
+
+/* Maps user virtual page UPAGE in PD to frame KPAGE
+   copy-on-write, as pagedir_copy() does, so that the first write
+   faults and pagedir_break_cow() gives PD a private copy if
+   anyone else still holds a reference to KPAGE.  UPAGE must not
+   already be mapped.  Returns false if memory allocation
+   fails. */
+bool pagedir_set_cow_page(uint32_t* pd, void* upage, void* kpage) {
+  uint32_t* pte;
+
+  if (!pagedir_set_page(pd, upage, kpage, false))
+    return false;
+  pte = lookup_page(pd, upage, false);
+  *pte |= PTE_COW;
+  return true;
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
@@ -113,10 +398,12 @@ void* pagedir_get_page(uint32_t* pd, const void* uaddr) {
   ASSERT(is_user_vaddr(uaddr));
 
   pte = lookup_page(pd, uaddr, false);
-  if (pte != NULL && (*pte & PTE_P) != 0)
-    return pte_get_page(*pte) + pg_ofs(uaddr);
-  else
+  if (pte == NULL || (*pte & PTE_P) == 0)
     return NULL;
+  else if (*pte & PTE_PS)
+    return (uint8_t*)pde_get_large_page(*pte) + ((uintptr_t)uaddr & (PTSPAN - 1));
+  else
+    return pte_get_page(*pte) + pg_ofs(uaddr);
 }
 
 /* Marks user virtual page UPAGE "not present" in page
@@ -129,10 +416,14 @@ void pagedir_clear_page(uint32_t* pd, void* upage) {
   ASSERT(pg_ofs(upage) == 0);
   ASSERT(is_user_vaddr(upage));
 
+  if (pd[pd_no(upage)] & PTE_PS)
+    split_large_page(pd, &pd[pd_no(upage)]);
   pte = lookup_page(pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0) {
     *pte &= ~PTE_P;
-    invalidate_pagedir(pd);
+    ASSERT(pt_counts(pd)[pd_no(upage)] > 0);
+    pt_counts(pd)[pd_no(upage)]--;
+    invalidate_page(pd, upage);
   }
 }
 
@@ -154,7 +445,7 @@ void pagedir_set_dirty(uint32_t* pd, const void* vpage, bool dirty) {
       *pte |= PTE_D;
     else {
       *pte &= ~(uint32_t)PTE_D;
-      invalidate_pagedir(pd);
+      invalidate_page(pd, vpage);
     }
   }
 }
@@ -169,16 +460,21 @@ bool pagedir_is_accessed(uint32_t* pd, const void* vpage) {
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.
+
+   Clearing the bit does not invalidate the TLB.  While a stale
+   translation stays cached, the CPU does not set the bit again,
+   so the page may look idle for a while and be evicted early,
+   but nothing is lost: eviction clears the mapping itself, which
+   does invalidate it.  Flushing here instead would cost the
+   clock sweep in the frame table one flush per page it ages. */
 void pagedir_set_accessed(uint32_t* pd, const void* vpage, bool accessed) {
   uint32_t* pte = lookup_page(pd, vpage, false);
   if (pte != NULL) {
     if (accessed)
       *pte |= PTE_A;
-    else {
+    else
       *pte &= ~(uint32_t)PTE_A;
-      invalidate_pagedir(pd);
-    }
   }
 }
 
@@ -207,14 +503,16 @@ uint32_t* active_pd(void) {
   return ptov(pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
    table.  When this happens, we have to "invalidate" the TLB by
    re-activating it.
 
    This function invalidates the TLB if PD is the active page
    directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   the TLB, so there is no need to invalidate anything: every
+   switch to PD loads CR3, which flushes them.)  The kernel's
+   mappings are global, so they survive. */
 static void invalidate_pagedir(uint32_t* pd) {
   if (active_pd() == pd) {
     /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
@@ -223,10 +521,102 @@ static void invalidate_pagedir(uint32_t* pd) {
   }
 }
 
-/* Creates a copy of page directory SRC, copying all mapped pages.
-   Returns the new page directory, or a null pointer if memory
-   allocation fails. */
+/* Removes user page UPAGE of PD from the TLB, if PD is active.
+   Inside the running thread's TLB batch for PD, only records
+   UPAGE for the batch's flush.
+
+   This and batch_flush() are the only places that invalidate
+   single pages, so that a multiprocessor kernel would only have
+   to send its shootdowns from here. */
+static void invalidate_page(uint32_t* pd, const void* upage) {
+  struct tlb_batch* b = thread_current()->tlb_batch;
+
+  if (active_pd() != pd)
+    return;
+  if (b != NULL && b->pd == pd) {
+    if (b->page_cnt < TLB_BATCH_PAGES)
+      b->pages[b->page_cnt] = upage;
+    b->page_cnt++;
+    return;
+  }
+  asm volatile("invlpg (%0)" : : "r"(upage) : "memory");
+}
+
+/* Begins a bulk unmap of user pages in PD, which must be the
+   running thread's own page directory or an inactive one, using
+   B, which the caller provides, until pagedir_batch_end(B).  In
+   between, pagedir_clear_page() on PD only records pages for
+   invalidation, and pagedir_batch_free() holds back the frames
+   that were unmapped, so that a translation still cached cannot
+   reach a frame that has been reused.  The caller must hold the
+   pagedir_lock of PD's process, so that neither the frame table
+   nor anyone else relies on PD's mappings meanwhile.  Batches do
+   not nest. */
+void pagedir_batch_begin(struct tlb_batch* b, uint32_t* pd) {
+  struct thread* t = thread_current();
+
+  ASSERT(t->tlb_batch == NULL);
+  b->pd = pd;
+  b->page_cnt = 0;
+  b->free_cnt = 0;
+  t->tlb_batch = b;
+}
+
+/* Frees user frame KPAGE, which was just unmapped from the
+   running thread's TLB batch's page directory, once the batch
+   flushes.  Outside a batch, frees it at once. */
+void pagedir_batch_free(void* kpage) {
+  struct tlb_batch* b = thread_current()->tlb_batch;
+
+  if (b == NULL) {
+    palloc_free_page(kpage);
+    return;
+  }
+  if (b->free_cnt == TLB_BATCH_FREES)
+    batch_flush(b);
+  b->frees[b->free_cnt++] = kpage;
+}
+
+/* Invalidates the pages recorded in B, one by one or, if there
+   were too many, by reloading CR3, and then frees B's frames. */
+static void batch_flush(struct tlb_batch* b) {
+  size_t i;
+
+  if (b->page_cnt > TLB_BATCH_PAGES)
+    invalidate_pagedir(b->pd);
+  else if (active_pd() == b->pd)
+    for (i = 0; i < b->page_cnt; i++)
+      asm volatile("invlpg (%0)" : : "r"(b->pages[i]) : "memory");
+  b->page_cnt = 0;
+
+  palloc_free_pages(b->frees, b->free_cnt);
+  b->free_cnt = 0;
+}
+
+/* Ends TLB batch B, begun by pagedir_batch_begin(): flushes the
+   pages it recorded and frees the frames it held back. */
+void pagedir_batch_end(struct tlb_batch* b) {
+  struct thread* t = thread_current();
+
+  ASSERT(t->tlb_batch == b);
+  batch_flush(b);
+  t->tlb_batch = NULL;
+}
+
+/* Creates a copy of page directory SRC that shares SRC's pages
+   instead of copying them.  Writable pages become read-only and
+   copy-on-write in both directories, so that the first write to
+   such a page through either one faults and pagedir_break_cow()
+   makes a private copy for the writer.  Shared memory pages stay
+   writable and shared.  Thus the cost of the copy is proportional
+   to the size of SRC's page tables, not to the memory they map.
+   The copies keep SRC's dirty bits, which record whether a page
+   still matches the file it was loaded from.  Returns the new
+   page directory, or a null pointer if memory allocation
+   fails. */
 uint32_t* pagedir_copy(uint32_t* src) {
+  uint16_t* src_counts;
+  uint16_t* dst_counts;
   uint32_t* dst;
   uint32_t* src_pde;
   uint32_t* dst_pde;
@@ -237,33 +627,194 @@ uint32_t* pagedir_copy(uint32_t* src) {
   if (dst == NULL)
     return NULL;
 
+  src_counts = pt_counts(src);
+  dst_counts = pt_counts(dst);
   for (src_pde = src, dst_pde = dst; src_pde < src + pd_no(PHYS_BASE); src_pde++, dst_pde++) {
-    if (*src_pde & PTE_P) {
+    size_t left = src_counts[src_pde - src];
+
+    /* Let a more urgent thread run between page tables.  Other
+       threads of SRC's process may run, so the writable
+       translations of pages shared so far must go first. */
+    if (thread_resched_needed()) {
+      invalidate_pagedir(src);
+      thread_yield_if_needed();
+    }
+
+    /* Each page of a large page may be written by the copy or by
+       SRC independently, so it needs a PTE of its own. */
+    if (*src_pde & PTE_PS)
+      split_large_page(src, src_pde);
+
+    /* An empty page table is not worth copying. */
+    if ((*src_pde & PTE_P) && left > 0) {
       uint32_t* src_pt = pde_get_pt(*src_pde);
-      uint32_t* dst_pt = palloc_get_page(0);
+      uint32_t* dst_pt = pt_alloc();
       if (dst_pt == NULL) {
+        invalidate_pagedir(src);
         pagedir_destroy(dst);
         return NULL;
       }
+      *dst_pde = pde_create(dst_pt);
 
       uint32_t* src_pte;
       uint32_t* dst_pte;
-      for (src_pte = src_pt, dst_pte = dst_pt; src_pte < src_pt + PGSIZE / sizeof *src_pte;
-           src_pte++, dst_pte++) {
+      for (src_pte = src_pt, dst_pte = dst_pt; left > 0; src_pte++, dst_pte++) {
+        ASSERT(src_pte < src_pt + PGSIZE / sizeof *src_pte);
         if (*src_pte & PTE_P) {
-          void* src_page = pte_get_page(*src_pte);
-          void* dst_page = palloc_get_page(PAL_USER);
-          if (dst_page == NULL) {
-            palloc_free_page(dst_pt);
-            pagedir_destroy(dst);
-            return NULL;
-          }
-          memcpy(dst_page, src_page, PGSIZE);
-          *dst_pte = pte_create_user(dst_page, (*src_pte & PTE_W) != 0);
+          if ((*src_pte & (PTE_W | PTE_SHARED)) == PTE_W)
+            *src_pte = (*src_pte & ~(uint32_t)PTE_W) | PTE_COW;
+          palloc_share_page(pte_get_page(*src_pte));
+          *dst_pte = *src_pte & ~(uint32_t)PTE_A;
+          dst_counts[dst_pde - dst]++;
+          left--;
         }
       }
-      *dst_pde = pde_create(dst_pt);
     }
   }
+
+  /* Flush stale writable translations of SRC's pages. */
+  invalidate_pagedir(src);
   return dst;
 }
+
+/* Returns the number of user pages mapped in PD. */
+size_t pagedir_page_cnt(uint32_t* pd) {
+  uint16_t* counts = pt_counts(pd);
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < pd_no(PHYS_BASE); i++)
+    cnt += counts[i];
+  return cnt;
+}
+
+/* Makes user virtual page UPAGE, which must be mapped
+   copy-on-write in PD, writable again.  If other page
+   directories still share its frame, gives PD a private copy of
+   the frame first.  Returns true if successful, false if UPAGE is
+   not a copy-on-write page or memory allocation fails. */
+bool pagedir_break_cow(uint32_t* pd, const void* upage) {
+  uint32_t* pte;
+  void* kpage;
+
+  ASSERT(pg_ofs(upage) == 0);
+  ASSERT(is_user_vaddr(upage));
+
+  pte = lookup_page(pd, upage, false);
+  if (pte == NULL || (*pte & (PTE_P | PTE_COW)) != (PTE_P | PTE_COW))
+    return false;
+
+  kpage = pte_get_page(*pte);
+  if (palloc_page_refs(kpage) > 1) {
+    /* Hold an extra reference while allocating the copy, so
+       that the frame stays shared, and thus cannot be evicted,
+       even if every other sharer lets go of it meanwhile. */
+    void* copy;
+    palloc_share_page(kpage);
+    copy = palloc_get_page(PAL_USER);
+    if (copy == NULL) {
+      palloc_free_page(kpage);
+      return false;
+    }
+    pg_copy(copy, kpage);
+    *pte = pte_create_user(copy, true);
+    palloc_free_page(kpage);
+    palloc_free_page(kpage);
+  } else
+    *pte = (*pte & ~(uint32_t)PTE_COW) | PTE_W;
+  invalidate_page(pd, upage);
+  return true;
+}
+
+/* Points the mapping of user virtual page UPAGE in PD, which
+   must be mapped, at frame KPAGE instead, keeping its
+   permissions and its accessed and dirty bits.  The caller
+   copies the contents over first, and frees the old frame with
+   pagedir_batch_free(), since inside a TLB batch the old
+   translation may stay cached until the batch flushes. */
+void pagedir_move_page(uint32_t* pd, const void* upage, void* kpage) {
+  uint32_t* pte;
+
+  ASSERT(pg_ofs(upage) == 0);
+  ASSERT(pg_ofs(kpage) == 0);
+  ASSERT(is_user_vaddr(upage));
+
+  pte = lookup_page(pd, upage, true);
+  ASSERT(pte != NULL && (*pte & PTE_P) != 0);
+  *pte = vtop(kpage) | (*pte & PTE_FLAGS);
+  invalidate_page(pd, upage);
+}
+
+/* Returns true if user virtual page UPAGE is mapped writable in
+   PD, false if it is read-only, copy-on-write or unmapped. */
+bool pagedir_is_writable(uint32_t* pd, const void* upage) {
+  uint32_t* pte = lookup_page(pd, upage, false);
+  return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
+/* Makes user virtual page UPAGE of PD, which must be mapped,
+   copy-on-write if it is writable, as pagedir_copy() does, so
+   that its frame may be shared with other page directories.  A
+   read-only page stays read-only. */
+void pagedir_protect_cow(uint32_t* pd, const void* upage) {
+  uint32_t* pte;
+
+  ASSERT(pg_ofs(upage) == 0);
+  ASSERT(is_user_vaddr(upage));
+
+  pte = lookup_page(pd, upage, true);
+  ASSERT(pte != NULL && (*pte & PTE_P) != 0);
+  if ((*pte & (PTE_W | PTE_SHARED)) == PTE_W) {
+    *pte = (*pte & ~(uint32_t)PTE_W) | PTE_COW;
+    invalidate_page(pd, upage);
+  }
+}
+
+/* Maps the 4 MB-aligned user region at UPAGE in PD, all of whose
+   pages must be mapped to the zero page copy-on-write, to fresh
+   zeroed memory with a single large page.  Returns true if
+   successful, false if the region is not all zero pages, the CPU
+   lacks large pages, or no aligned 4 MB run of user memory is
+   free, in which case nothing changes. */
+bool pagedir_set_large_page(uint32_t* pd, void* upage) {
+  uint32_t* pde = pd + pd_no(upage);
+  uint32_t* pt;
+  void* kpage;
+  size_t i;
+
+  ASSERT(((uintptr_t)upage & (PTSPAN - 1)) == 0);
+  ASSERT(is_user_vaddr(upage));
+
+  if (!init_large_pages || (*pde & (PTE_P | PTE_PS)) != PTE_P ||
+      pt_counts(pd)[pde - pd] != PTSPAN / PGSIZE)
+    return false;
+  pt = pde_get_pt(*pde);
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    if ((pt[i] & (PTE_P | PTE_COW)) != (PTE_P | PTE_COW) ||
+        !palloc_is_zero_page(pte_get_page(pt[i])))
+      return false;
+
+  kpage = palloc_get_aligned(PAL_USER | PAL_ZERO, PTSPAN / PGSIZE, PTSPAN / PGSIZE);
+  if (kpage == NULL)
+    return false;
+
+  /* Drop the region's references to the zero page and keep its
+     page table, zeroed, as the spare for splitting later. */
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    palloc_free_page(pte_get_page(pt[i]));
+  pg_zero(pt);
+  *(uint32_t**)pt = *spare_pts(pd);
+  *spare_pts(pd) = pt;
+  *pde = pde_create_user_large(kpage, true);
+  large_made++;
+  invalidate_pagedir(pd);
+  return true;
+}
+
+/* Prints statistics about the page directory cache. */
+void pagedir_print_stats(void) {
+  printf("Pagedir: %zu page directories from cache, %zu built, %zu ahead of time; "
+         "%zu page tables from cache, %zu zeroed\n",
+         pd_hits, pd_misses, pd_built, pt_hits, pt_misses);
+  printf("Pagedir: %zu large pages made, %zu split\n", large_made, large_split);
+}
@@ -2,11 +2,30 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Most pages a TLB batch invalidates one by one, and most frames
+   it holds back, before it flushes. */
+#define TLB_BATCH_PAGES 16
+#define TLB_BATCH_FREES 16
+
+/* TLB invalidations and frame frees deferred by a bulk unmap of
+   user pages in PD.  See pagedir_batch_begin(). */
+struct tlb_batch {
+  uint32_t* pd;                         /* Page directory being changed. */
+  size_t page_cnt;                      /* Pages to invalidate; may exceed PAGES. */
+  const void* pages[TLB_BATCH_PAGES];   /* The first of them. */
+  size_t free_cnt;                      /* Frames in FREES. */
+  void* frees[TLB_BATCH_FREES];         /* Unmapped frames to free after the flush. */
+};
+
 uint32_t* pagedir_create(void);
 void pagedir_destroy(uint32_t* pd);
 bool pagedir_set_page(uint32_t* pd, void* upage, void* kpage, bool rw);
+bool pagedir_share_page(uint32_t* pd, void* upage, void* kpage);
+bool pagedir_set_zero_page(uint32_t* pd, void* upage, bool rw);
+bool pagedir_set_cow_page(uint32_t* pd, void* upage, void* kpage);
 void* pagedir_get_page(uint32_t* pd, const void* upage);
 void pagedir_clear_page(uint32_t* pd, void* upage);
 bool pagedir_is_dirty(uint32_t* pd, const void* upage);
@@ -16,5 +35,16 @@ void pagedir_set_accessed(uint32_t* pd, const void* upage, bool accessed);
 void pagedir_activate(uint32_t* pd);
 uint32_t* active_pd(void);
 uint32_t* pagedir_copy(uint32_t* src);
+size_t pagedir_page_cnt(uint32_t* pd);
+bool pagedir_break_cow(uint32_t* pd, const void* upage);
+bool pagedir_set_large_page(uint32_t* pd, void* upage);
+void pagedir_move_page(uint32_t* pd, const void* upage, void* kpage);
+bool pagedir_is_writable(uint32_t* pd, const void* upage);
+void pagedir_protect_cow(uint32_t* pd, const void* upage);
+void pagedir_batch_begin(struct tlb_batch*, uint32_t* pd);
+void pagedir_batch_free(void* kpage);
+void pagedir_batch_end(struct tlb_batch*);
+void pagedir_prepare_one(void);
+void pagedir_print_stats(void);
 
 #endif /* userprog/pagedir.h */
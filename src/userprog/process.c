@@ -5,56 +5,106 @@
 #include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include "list.h"
+#include "userprog/exec-cache.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/mq.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+#endif
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
 
 #define MAX_ARGS 32
 #define MAX_PROGRAM_NAME_LENGTH 64
-#define THREAD_STACK_SIZE (1024 * 1024) // 1MB per thread
+/* User stack slots, see stack_slot_top().  pthread_slot() in
+   lib/user/pthread.c relies on this layout. */
+#define THREAD_STACK_SIZE (MAX_STACK_PAGES * PGSIZE) // 8MB per thread
 #define GUARD_PAGE_SIZE (4 * 1024)      // 4KB guard page
 
 static thread_func start_process NO_RETURN;
 static thread_func start_pthread NO_RETURN;
 static bool load(const char* file_name, void (**eip)(void), void** esp);
-bool setup_thread(void (**eip)(void), void** esp);
-static bool user_thread_allocate_stack(struct process* pcb, int user_thread_index, void** esp);
+static bool user_thread_allocate_stack(struct process* pcb, int stack_slot, void** esp);
 static void deallocate_partial_stack(struct process* pcb, void* stack_base, void* failed_addr);
+static void process_init_threads(struct process* pcb, struct thread* main, int stack_slot);
+static void process_kill_threads(struct process* pcb);
+static void process_destroy_address_space(struct process* pcb);
+static void process_free_address_space(struct process* pcb, uint32_t* pd);
+static void reap_wait(void);
+static work_func process_reap;
+#ifdef VM
+static bool load_page(struct process* pcb, void* upage, bool write, bool* major);
+#else
+static bool install_page(void* upage, void* kpage, bool writable);
+static bool install_zero_page(void* upage, bool writable);
+#endif
+static struct user_thread_info* user_thread_find(struct process* pcb, tid_t tid);
+static void user_thread_exit(struct process* pcb) NO_RETURN;
 struct process_load_info {
-  char* file_name;             /* Command line to execute */
-  struct semaphore* load_sema; /* Synchronization for load completion */
-  bool* load_success;          /* Whether load succeeded */
+  char* args;                  /* Page of packed arguments, see pack_args() */
+  size_t args_len;             /* Bytes of ARGS in use */
+  int argc;                    /* Number of arguments in ARGS */
+  struct semaphore loaded;     /* Upped by the child once it has loaded */
+  bool success;                /* Whether load succeeded (set by child) */
   struct process* parent_pcb;  /* Parent's process structure */
   struct process* child_pcb;   /* Child's process structure (set by child) */
+  const struct spawn_fd* fds;  /* Parent's files to pass on to the child */
+  size_t fd_cnt;               /* Number of elements in FDS */
 };
 struct user_thread_load_info {
   struct process* pcb;   /* PCB to share with new thread */
   stub_fun sfun;         /* Stub function entry point */
   pthread_fun tf;        /* User thread function */
   void* arg;             /* Argument to pthread function */
-  int user_thread_index; /* User thread index used to allocate stack within pagedir */
+  int stack_slot;        /* User stack slot to allocate the stack in */
 
   /* Synchronization for thread creation */
   struct semaphore* load_sema; /* Signaled when thread setup completes */
   bool* load_success;          /* Whether thread creation succeeded */
 };
 
+/* Exited processes whose teardown is left to this work queue.
+   process_exit() does only what the parent could notice, such as
+   writing back mapped files and closing the executable, before it
+   tells the parent that it has exited.  The rest, chiefly
+   destroying the page directory and closing the file descriptor
+   table, happens afterward on the queue, oldest first, so that
+   neither the exiting thread nor a parent in wait() pays for
+   it. */
+static struct workqueue* reap_wq;
+
+/* Caches of struct child_info and struct user_thread_info. */
+static struct kmem_cache* child_info_cache;
+static struct kmem_cache* thread_info_cache;
+
 /* Allocate and initialize child_info */
 struct child_info* create_child_info(pid_t pid) {
-  struct child_info* new_child_info = malloc(sizeof(struct child_info));
+  struct child_info* new_child_info = kmem_cache_alloc(child_info_cache);
   if (!new_child_info) {
     return NULL;
   }
@@ -69,22 +119,348 @@ struct child_info* create_child_info(pid_t pid) {
   return new_child_info;
 }
 
-static struct user_thread_info* user_thread_info_create(tid_t tid) {
-  struct user_thread_info* info = malloc(sizeof(struct user_thread_info));
-  if (info == NULL) {
-    return NULL;
-  }
+static void user_thread_info_init(struct user_thread_info* info, tid_t tid, int stack_slot) {
   info->tid = tid;
   sema_init(&info->exit_sema, 0);
   info->exit_value = -1;
   info->has_exited = false;
   info->has_joined = false;
   info->joiner_tid = -1;
+  info->stack_slot = stack_slot;
+}
+
+static struct user_thread_info* user_thread_info_create(tid_t tid, int stack_slot) {
+  struct user_thread_info* info = kmem_cache_alloc(thread_info_cache);
+  if (info == NULL) {
+    return NULL;
+  }
+  user_thread_info_init(info, tid, stack_slot);
   return info;
 }
 
-/* Free child_info structure */
-void destroy_child_info(struct child_info* info) { free(info); }
+/* Marks the lowest free user stack slot in PCB as used and
+   returns it, or returns -1 if all are in use.  The caller must
+   hold PCB's u_threads_lock. */
+static int stack_slot_alloc(struct process* pcb) {
+  for (int i = 0; i < STACK_SLOT_WORDS; i++) {
+    uint32_t free_bits = ~pcb->stack_slots[i];
+    if (free_bits != 0) {
+      int slot = i * 32 + __builtin_ctz(free_bits);
+      if (slot >= STACK_SLOT_CNT)
+        break;
+      pcb->stack_slots[i] |= 1u << (slot % 32);
+      return slot;
+    }
+  }
+  return -1;
+}
+
+/* Marks user stack SLOT in PCB as used (if USED) or free. */
+static void stack_slot_mark(struct process* pcb, int slot, bool used) {
+  ASSERT(slot >= 0 && slot < STACK_SLOT_CNT);
+  if (used)
+    pcb->stack_slots[slot / 32] |= 1u << (slot % 32);
+  else
+    pcb->stack_slots[slot / 32] &= ~(1u << (slot % 32));
+}
+
+/* Returns the top of user stack SLOT.  The stack may grow down
+   to THREAD_STACK_SIZE below it, one page at a time as
+   process_grow_stack() sees it used, and the GUARD_PAGE_SIZE
+   below that is never mapped, so an overflow faults instead of
+   running into the next slot. */
+static uint8_t* stack_slot_top(int slot) {
+  return (uint8_t*)PHYS_BASE - slot * (THREAD_STACK_SIZE + GUARD_PAGE_SIZE);
+}
+
+/* Returns true if user virtual address UADDR lies in the region
+   reserved for user stack slots and, just below them, the clock
+   page, which must not be put to any other use. */
+bool process_is_stack_addr(const void* uaddr) {
+  return is_user_vaddr(uaddr) && (const uint8_t*)uaddr >= (const uint8_t*)CLOCK_PAGE_ADDR;
+}
+
+/* Handles a fault at user address FAULT_ADDR in a page that is
+   not mapped, by a thread whose user stack pointer is ESP.  If
+   the address is in the stack part of a stack slot and no more
+   than 32 bytes below ESP, which is as far as the PUSHA
+   instruction reaches, the stack has grown into a new page:
+   maps a zeroed page there and returns true, so that the
+   faulting instruction can be retried.  Otherwise, or if memory
+   allocation fails, returns false. */
+bool process_grow_stack(void* fault_addr, void* esp) {
+  struct process* pcb = thread_current()->pcb;
+  uint8_t* addr = fault_addr;
+  uint8_t* upage = pg_round_down(fault_addr);
+  int slot;
+  bool success;
+
+  if (pcb == NULL || pcb->pagedir == NULL || esp == NULL || !process_is_stack_addr(addr) ||
+      addr + 32 < (uint8_t*)esp)
+    return false;
+  slot = ((uint8_t*)PHYS_BASE - addr - 1) / (THREAD_STACK_SIZE + GUARD_PAGE_SIZE);
+  if (slot >= STACK_SLOT_CNT || addr < stack_slot_top(slot) - THREAD_STACK_SIZE)
+    return false;
+
+  lock_acquire(&pcb->pagedir_lock);
+#ifdef VM
+  success =
+      page_add_file(&pcb->pages, upage, NULL, 0, 0, true) && load_page(pcb, upage, true, NULL);
+#else
+  void* kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+  success = kpage != NULL && install_page(upage, kpage, true);
+  if (!success)
+    palloc_free_page(kpage);
+#endif
+  lock_release(&pcb->pagedir_lock);
+  return success;
+}
+
+/* Frees heap page UPAGE of PCB, if it is mapped.  The caller must
+   hold PCB's pagedir_lock. */
+static void release_heap_page(struct process* pcb, uint8_t* upage) {
+#ifdef VM
+  page_release(&pcb->pages, pcb->pagedir, upage);
+#else
+  void* kpage = pagedir_get_page(pcb->pagedir, upage);
+  if (kpage != NULL) {
+    pagedir_clear_page(pcb->pagedir, upage);
+    pagedir_batch_free(kpage);
+  }
+#endif
+}
+
+/* Moves the current process's program break, the end of its
+   heap, by INCREMENT bytes and returns the old break.  The heap
+   starts at the first page after the executable's segments.
+   Pages that the heap grows into read as zeros; under VM they
+   are only allocated when first touched.  Pages that it shrinks
+   off are freed.  Returns (void*)-1, leaving the break as it was,
+   if the break would move below the start of the heap or into
+   pages already in use or the stacks, or if memory allocation
+   fails. */
+void* process_sbrk(intptr_t increment) {
+  struct process* pcb = thread_current()->pcb;
+  uint8_t* old_brk;
+  uint8_t* new_brk;
+  uint8_t* upage;
+  bool success = true;
+  bool valid;
+
+  lock_acquire(&pcb->pagedir_lock);
+  old_brk = pcb->heap_brk;
+  new_brk = old_brk + increment;
+  if (increment > 0)
+    valid = new_brk > old_brk && is_user_vaddr(new_brk - 1) && !process_is_stack_addr(new_brk - 1);
+  else
+    valid = new_brk <= old_brk && new_brk >= pcb->heap_start;
+  if (!valid) {
+    lock_release(&pcb->pagedir_lock);
+    return (void*)-1;
+  }
+
+  if (new_brk > old_brk) {
+    for (upage = pg_round_up(old_brk); upage < new_brk; upage += PGSIZE) {
+#ifdef VM
+      success = !page_exists(&pcb->pages, upage) &&
+                page_add_file(&pcb->pages, upage, NULL, 0, 0, true);
+#else
+      void* kpage = NULL;
+      success = pagedir_get_page(pcb->pagedir, upage) == NULL &&
+                (install_zero_page(upage, true) ||
+                 ((kpage = palloc_get_page(PAL_USER | PAL_ZERO)) != NULL &&
+                  install_page(upage, kpage, true)));
+      if (!success)
+        palloc_free_page(kpage);
+#endif
+      if (!success) {
+        while (upage > (uint8_t*)pg_round_up(old_brk)) {
+          upage -= PGSIZE;
+          release_heap_page(pcb, upage);
+        }
+        break;
+      }
+    }
+  } else {
+    struct tlb_batch batch;
+
+    pagedir_batch_begin(&batch, pcb->pagedir);
+    for (upage = pg_round_up(new_brk); upage < old_brk; upage += PGSIZE)
+      release_heap_page(pcb, upage);
+    pagedir_batch_end(&batch);
+  }
+
+  if (success)
+    pcb->heap_brk = new_brk;
+  lock_release(&pcb->pagedir_lock);
+  return success ? old_brk : (void*)-1;
+}
+
+/* Free child_info structure, letting go of the child's pid */
+void destroy_child_info(struct child_info* info) {
+  thread_tid_release(info->pid);
+  kmem_cache_free(child_info_cache, info);
+}
+
+/* Returns a hash value for the child_info in E. */
+static unsigned child_hash(const struct hash_elem* e, void* aux UNUSED) {
+  return hash_int(hash_entry(e, struct child_info, elem)->pid);
+}
+
+/* Returns true if child_info A has a lower pid than B. */
+static bool child_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
+  return hash_entry(a, struct child_info, elem)->pid < hash_entry(b, struct child_info, elem)->pid;
+}
+
+/* Initializes PCB's records of its children.  Returns false if
+   out of memory, in which case PCB must still be passed to
+   destroy_children() before it is freed. */
+static bool init_children(struct process* pcb) {
+  list_init(&pcb->exited_children);
+  pcb->unwaited_cnt = 0;
+  lock_init_named(&pcb->children_lock, "children");
+  cond_init(&pcb->child_exited);
+  return hash_init(&pcb->children, child_hash, child_less, NULL);
+}
+
+/* Frees the memory behind PCB's records of its children, which
+   must have none. */
+static void destroy_children(struct process* pcb) { hash_destroy(&pcb->children, NULL); }
+
+/* Records CHILD, whose main thread is TID, as a child of PARENT,
+   whose children_lock the caller must hold.  The record takes
+   over the caller's hold on TID, from thread_create_held(), so
+   that the pid is not reused while PARENT may still wait for it.
+   If memory is short, CHILD becomes an orphan instead. */
+static void add_child(struct process* parent, struct process* child, tid_t tid) {
+  struct child_info* info = create_child_info(tid);
+
+  if (info == NULL) {
+    child->parent_pcb = NULL;
+    child->as_child = NULL;
+    thread_tid_release(tid);
+    return;
+  }
+  info->pcb = child;
+  child->as_child = info;
+  hash_insert(&parent->children, &info->elem);
+  parent->unwaited_cnt++;
+}
+
+/* Returns PCB's record of its child PID, or a null pointer if it
+   has no such child or has already waited for it.  The caller
+   must hold PCB's children_lock. */
+static struct child_info* find_child(struct process* pcb, pid_t pid) {
+  struct child_info key;
+  struct hash_elem* e;
+
+  key.pid = pid;
+  e = hash_find(&pcb->children, &key.elem);
+  return e != NULL ? hash_entry(e, struct child_info, elem) : NULL;
+}
+
+/* Removes and frees PCB's record CHILD of a child that has been
+   waited for and has exited.  The caller must hold PCB's
+   children_lock. */
+static void forget_child(struct process* pcb, struct child_info* child) {
+  hash_delete(&pcb->children, &child->elem);
+  destroy_child_info(child);
+}
+
+/* Disowns the child that E records, for hash_destroy() when its
+   parent exits. */
+static void orphan_child(struct hash_elem* e, void* aux UNUSED) {
+  struct child_info* child = hash_entry(e, struct child_info, elem);
+
+  if (!child->has_exited) {
+    child->pcb->parent_pcb = NULL;
+    child->pcb->as_child = NULL;
+  }
+  destroy_child_info(child);
+}
+
+/* Tagged console output.  The console output of a process whose
+   console_tag is set, such as a task that the -parallel kernel
+   option runs alongside others, and of its descendants, which
+   inherit the tag, is collected a line at a time, so that lines
+   of concurrent processes do not mix, and each line is prefixed
+   with the tag.  Longer lines are split. */
+#define CONSOLE_LINE_MAX 128
+
+/* A partial line of tagged console output. */
+struct console_line {
+  size_t len;                 /* Bytes in BUF. */
+  char buf[CONSOLE_LINE_MAX]; /* Output since the last newline. */
+};
+
+/* Protects every process's console_line. */
+static struct lock console_line_lock;
+
+/* Sets the tag for the console output of the processes that the
+   current process creates from now on, or with a null TAG, stops
+   tagging them.  TAG must stay valid for as long as any of them
+   runs. */
+void process_set_console_tag(const char* tag) { thread_current()->pcb->console_tag = tag; }
+
+/* Prints the LEN bytes in LINE to the console as one line,
+   prefixed with TAG. */
+static void put_tagged_line(const char* tag, const char* line, size_t len) {
+  char out[CONSOLE_LINE_MAX + 32];
+  int n = snprintf(out, sizeof out, "%s: %.*s\n", tag, (int)len, line);
+  putbuf(out, (size_t)n < sizeof out ? (size_t)n : sizeof out - 1);
+}
+
+/* Writes the SIZE bytes in BUF to the console on behalf of the
+   current process, tagged a line at a time if the process has a
+   console tag. */
+void process_console_write(const char* buf, size_t size) {
+  struct process* pcb = thread_current()->pcb;
+  struct console_line* line;
+  size_t i;
+
+  if (pcb == NULL || pcb->console_tag == NULL) {
+    putbuf(buf, size);
+    return;
+  }
+
+  lock_acquire(&console_line_lock);
+  line = pcb->console_line;
+  if (line == NULL) {
+    line = pcb->console_line = malloc(sizeof *line);
+    if (line == NULL) {
+      /* Better untagged than lost. */
+      lock_release(&console_line_lock);
+      putbuf(buf, size);
+      return;
+    }
+    line->len = 0;
+  }
+  for (i = 0; i < size; i++) {
+    if (buf[i] == '\n' || line->len == CONSOLE_LINE_MAX) {
+      put_tagged_line(pcb->console_tag, line->buf, line->len);
+      line->len = 0;
+      if (buf[i] == '\n')
+        continue;
+    }
+    line->buf[line->len++] = buf[i];
+  }
+  lock_release(&console_line_lock);
+}
+
+/* Prints the current process's tagged console output that no
+   newline has ended yet. */
+void process_console_flush(void) {
+  struct process* pcb = thread_current()->pcb;
+
+  if (pcb == NULL || pcb->console_line == NULL)
+    return;
+  lock_acquire(&console_line_lock);
+  if (pcb->console_line->len > 0) {
+    put_tagged_line(pcb->console_tag, pcb->console_line->buf, pcb->console_line->len);
+    pcb->console_line->len = 0;
+  }
+  lock_release(&console_line_lock);
+}
 
 /* Initializes user programs in the system by ensuring the main
    thread has a minimal PCB so that it can execute and wait for
@@ -105,144 +481,232 @@ void userprog_init(void) {
   /* Kill the kernel if we did not succeed */
   ASSERT(success);
 
+  lock_init_named(&t->pcb->pagedir_lock, "pagedir");
+  lock_init_named(&t->pcb->files_lock, "files");
+  cpu_quota_init(&t->pcb->cpu_quota, NULL);
+  io_quota_init(&t->pcb->io_quota, NULL);
+
   /* Initialize wait infrastructure for kernel thread */
-  lock_init(&t->pcb->children_lock);
-  list_init(&t->pcb->children);
+  success = init_children(t->pcb);
+  ASSERT(success);
   t->pcb->parent_pcb = NULL;
   t->pcb->exit_status = -1;
 
+  child_info_cache = kmem_cache_create("child_info", sizeof(struct child_info), NULL);
+  thread_info_cache =
+      kmem_cache_create("user_thread_info", sizeof(struct user_thread_info), NULL);
+
   /* Initialize user thread tracking info */
-  lock_init(&t->pcb->u_threads_lock);
-  list_init(&t->pcb->u_threads);
+  process_init_threads(t->pcb, t, 0);
+
+  exec_cache_init();
+
+  reap_wq = wq_create("reap", PRI_DEFAULT, 1);
+
+  lock_init_named(&console_line_lock, "console_line");
+}
+
+/* Initializes the user thread tracking state of PCB, whose only
+   thread so far is MAIN, running on user stack STACK_SLOT. */
+static void process_init_threads(struct process* pcb, struct thread* main, int stack_slot) {
+  list_init(&pcb->u_threads);
+  lock_init_named(&pcb->u_threads_lock, "u_threads");
+  cond_init(&pcb->threads_exited);
+  memset(pcb->stack_slots, 0, sizeof pcb->stack_slots);
+  pcb->thread_cnt = 0;
+  pcb->exiting = false;
+
+  user_thread_info_init(&pcb->main_info, main->tid, stack_slot);
+  stack_slot_mark(pcb, stack_slot, true);
+  list_push_back(&pcb->u_threads, &pcb->main_info.elem);
 }
 
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
    process id, or TID_ERROR if the thread cannot be created. */
-pid_t process_execute(const char* file_name) {
-  char* fn_copy;
-  tid_t tid;
+pid_t process_execute(const char* file_name) { return process_spawn(file_name, NULL, 0); }
+
+/* Returns true if ARGC arguments whose strings take LEN bytes, null
+   terminators included, fit in the initial user stack page along
+   with the pointers that load_args() lays out below them. */
+bool process_args_fit(size_t len, int argc) {
+  return argc > 0 && len + (argc + 4) * sizeof(char*) + 16 <= PGSIZE;
+}
+
+/* Splits the null-terminated string in ARGS, which lies in a page,
+   into words at white space and packs them back to back in place,
+   each followed by a null byte.  Stores the bytes used in *LEN and
+   returns the number of words. */
+static int pack_args(char* args, size_t* len) {
+  const char* src;
+  char* dst = args;
+  bool in_word = false;
+  int argc = 0;
+
+  for (src = args; *src != '\0'; src++) {
+    if (!isspace(*src)) {
+      if (!in_word)
+        argc++;
+      *dst++ = *src;
+      in_word = true;
+    } else if (in_word) {
+      *dst++ = '\0';
+      in_word = false;
+    }
+  }
+  if (in_word)
+    *dst++ = '\0';
+  *len = dst - args;
+  return argc;
+}
+
+/* Like process_execute(), but the new process also starts out
+   with the FD_CNT open files that FDS lists, shared with the
+   calling process.  Unlike fork() followed by exec(), builds the
+   new address space from scratch without ever copying the
+   caller's.  Also fails if FDS names a file descriptor that the
+   caller does not have open, or gives the child the same
+   descriptor twice.  Giving the child STDIN_FILENO or
+   STDOUT_FILENO replaces its keyboard or console there. */
+pid_t process_spawn(const char* file_name, const struct spawn_fd* fds, size_t fd_cnt) {
+  char* args;
+  size_t len;
+  int argc;
 
   /* Make a copy of FILE_NAME.
      Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page(0);
-  if (fn_copy == NULL)
+  args = palloc_get_page(0);
+  if (args == NULL)
     return TID_ERROR;
-  strlcpy(fn_copy, file_name, PGSIZE);
+  strlcpy(args, file_name, PGSIZE);
+  argc = pack_args(args, &len);
+  return process_spawn_args(args, len, argc, fds, fd_cnt);
+}
+
+/* Like process_spawn(), but the command line is already in ARGS,
+   a page from palloc_get_page(), such as the one that a system
+   call copied it into from user memory.  Splits it in place and
+   takes ownership of ARGS, so that it is not copied again. */
+pid_t process_spawn_page(char* args, const struct spawn_fd* fds, size_t fd_cnt) {
+  size_t len;
+  int argc = pack_args(args, &len);
+
+  return process_spawn_args(args, len, argc, fds, fd_cnt);
+}
+
+/* Like process_spawn(), but the arguments for the new process are
+   already split: ARGS is a page that holds ARGC null-terminated
+   strings back to back in its first LEN bytes, the first of them
+   the program's name.  Takes ownership of ARGS.  Also fails if the
+   arguments do not fit on the new process's stack. */
+pid_t process_spawn_args(char* args, size_t len, int argc, const struct spawn_fd* fds,
+                         size_t fd_cnt) {
+  tid_t tid;
+
+  if (!process_args_fit(len, argc)) {
+    palloc_free_page(args);
+    return TID_ERROR;
+  }
+
+  /* Give back what exited processes still hold before the new one
+     needs memory. */
+  reap_wait();
 
-  bool load_success = false;
-  struct semaphore load_sema;
   struct process_load_info info;
 
-  sema_init(&load_sema, 0);
-  info.file_name = fn_copy;
-  info.load_sema = &load_sema;
-  info.load_success = &load_success;
+  sema_init(&info.loaded, 0);
+  info.success = false;
+  info.args = args;
+  info.args_len = len;
+  info.argc = argc;
   info.parent_pcb = thread_current()->pcb;
   info.child_pcb = NULL;
+  info.fds = fds;
+  info.fd_cnt = fd_cnt;
 
   lock_acquire(&info.parent_pcb->children_lock);
   /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create(file_name, PRI_DEFAULT, start_process, &info);
+  tid = thread_create_held(args, PRI_DEFAULT, start_process, &info);
   if (tid == TID_ERROR) {
-    palloc_free_page(fn_copy);
+    lock_release(&info.parent_pcb->children_lock);
+    palloc_free_page(args);
     return -1;
   }
 
-  /* Wait for child process program to load */
-  sema_down(&load_sema);
+  /* Wait for child process program to load, donating our
+     priority to it meanwhile. */
+  sema_set_owner(&info.loaded, tid);
+  sema_down(&info.loaded);
 
   /* Check result */
-  if (!load_success) {
+  if (!info.success) {
     lock_release(&info.parent_pcb->children_lock);
+    thread_tid_release(tid);
     return -1;
   }
 
   /* Add succesfully loaded child to parent's pcb */
   ASSERT(info.child_pcb != NULL);
-  struct child_info* new_child_info = create_child_info(tid);
-  new_child_info->pcb = info.child_pcb;
-  list_push_back(&info.parent_pcb->children, &new_child_info->elem);
+  add_child(info.parent_pcb, info.child_pcb, tid);
   lock_release(&info.parent_pcb->children_lock);
 
   return tid;
 }
 
-static void load_args(char* file_name, void** esp) {
-  bool in = false; /* whether in the process of copy a word */
-  int argc_ = 0;
-
-  /*           
-  0xbffffffc   argv[3][...]    bar\0       char[4]
-  0xbffffff8   argv[2][...]    foo\0       char[4]
-  0xbffffff5   argv[1][...]    -l\0        char[3]
-  0xbfffffed   argv[0][...]    /bin/ls\0   char[8]
-  0xbfffffec   stack-align       0         uint8_t
-  0xbfffffe8   argv[4]           0         char *
-  0xbfffffe4   argv[3]        0xbffffffc   char *
-  0xbfffffe0   argv[2]        0xbffffff8   char *
-  0xbfffffdc   argv[1]        0xbffffff5   char *
-  0xbfffffd8   argv[0]        0xbfffffed   char *
-  0xbfffffd4   argv           0xbfffffd8   char **
-  0xbfffffd0   argc              4         int
-  0xbfffffcc   return address    0         void (*) ()
-  */
-
-  /* load argvs on stack */
-  char* iter = *esp;
-  for (int i = strlen(file_name) - 1; i >= 0; i--) {
-    char c = file_name[i];
-    if (!isspace(c)) {
-      if (!in) { /* enter new word */
-        *(--iter) = '\0';
-        argc_ += 1;
-        in = !in;
-      }
-      *(--iter) = c;
-    } else { /* meet white space */
-      if (in)
-        in = !in;
-    }
-  }
-
-  /* align the stack by 4byte */
-  uintptr_t* argv_ = (uintptr_t*)(iter - (4 - ((char*)*esp - iter) % 4));
+/* Lays out the ARGC arguments packed into the first LEN bytes of
+   page ARGS on the user stack at *ESP, as the 80x86 calling
+   convention expects for main(), and moves *ESP down past them:
+
+   0xbffffffc   argv[3][...]    bar\0       char[4]
+   0xbffffff8   argv[2][...]    foo\0       char[4]
+   0xbffffff5   argv[1][...]    -l\0        char[3]
+   0xbfffffed   argv[0][...]    /bin/ls\0   char[8]
+   0xbfffffec   stack-align       0         uint8_t
+   0xbfffffe8   argv[4]           0         char *
+   0xbfffffe4   argv[3]        0xbffffffc   char *
+   0xbfffffe0   argv[2]        0xbffffff8   char *
+   0xbfffffdc   argv[1]        0xbffffff5   char *
+   0xbfffffd8   argv[0]        0xbfffffed   char *
+   0xbfffffd4   argv           0xbfffffd8   char **
+   0xbfffffd0   argc              4         int
+   0xbfffffcc   return address    0         void (*) ()
+
+   The strings go up in one copy.  The words below them are built
+   in the unused tail of ARGS and go up in a second copy, placed so
+   that argc is 16-byte aligned.  process_args_fit() must have
+   approved LEN and ARGC. */
+static void load_args(char* args, size_t len, int argc, void** esp) {
+  char* strs = (char*)*esp - len;
+  uintptr_t* words = (uintptr_t*)ROUND_UP((uintptr_t)args + len, sizeof(uintptr_t));
+  size_t word_cnt = argc + 4;
+  uintptr_t base = (uintptr_t)strs - word_cnt * sizeof *words;
+  const char* arg = args;
+  int i;
 
-  /* align the stack by 16byte */
-  argv_ -= ((uintptr_t)(argv_ - (argc_ + 3)) % 16) / 4;
+  ASSERT(process_args_fit(len, argc));
+  base = ((base + sizeof *words) & ~(uintptr_t)15) - sizeof *words;
 
-  /* argv[argc] = 0 */
-  *(--argv_) = 0;
-  argv_ -= argc_;
-  for (int i = 0; i < argc_; i++) {
-    argv_[i] = (uintptr_t)iter;
-    /* reach next argv */
-    while (*(iter++)) {
-    }
+  words[0] = 0;                        /* Return address. */
+  words[1] = argc;                     /* argc. */
+  words[2] = base + 3 * sizeof *words; /* argv. */
+  for (i = 0; i < argc; i++) {
+    words[3 + i] = (uintptr_t)(strs + (arg - args)); /* argv[i]. */
+    arg += strlen(arg) + 1;
   }
+  words[3 + argc] = 0; /* argv[argc]. */
 
-  argv_ -= 1;                      /* *argv = argv+1 */
-  *argv_ = (uintptr_t)(argv_ + 1); /* argv */
-  *(--argv_) = argc_;              /* argc */
-  *(--argv_) = 0;                  /* return addr = 0 */
-
-  *esp = argv_;
+  memcpy(strs, args, len);
+  memcpy((void*)base, words, word_cnt * sizeof *words);
+  *esp = (void*)base;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void start_process(void* load_info) {
   struct process_load_info* info = (struct process_load_info*)load_info;
-  char* argv = info->file_name;
-
-  /* cut the argv to get program name
-   * "program arg1 arg2" -> "program" */
-  int len = 0;
-  while (!isspace(argv[len]) && argv[len] != '\0')
-    len++;
-  char* file_name = malloc(len + 1);
-  strlcpy(file_name, argv, len + 1);
+  char* args = info->args;
+  const char* file_name = args; /* The first argument. */
 
   struct thread* t = thread_current();
   struct intr_frame if_;
@@ -257,30 +721,56 @@ static void start_process(void* load_info) {
     // Ensure that timer_interrupt() -> schedule() -> process_activate()
     // does not try to activate our uninitialized pagedir
     new_pcb->pagedir = NULL;
+    lock_init_named(&new_pcb->pagedir_lock, "pagedir");
+    memset(&new_pcb->usage, 0, sizeof new_pcb->usage);
+    memset(&new_pcb->syscalls, 0, sizeof new_pcb->syscalls);
+    cpu_quota_init(&new_pcb->cpu_quota, &info->parent_pcb->cpu_quota);
+    io_quota_init(&new_pcb->io_quota, &info->parent_pcb->io_quota);
+#ifdef VM
+    new_pcb->ws_sweep = new_pcb->ws_pages = 0;
+    new_pcb->evict_priority = EVICT_PRI_NORMAL;
+#endif
     t->pcb = new_pcb;
 
     /* Initialize wait infrastructure for this NEW process */
-    list_init(&new_pcb->children);
-    lock_init(&new_pcb->children_lock);
+    success = init_children(new_pcb);
     new_pcb->parent_pcb = info->parent_pcb;
+    new_pcb->console_tag = info->parent_pcb->console_tag;
+    new_pcb->console_line = NULL;
+    new_pcb->as_child = NULL;
     info->child_pcb = new_pcb;
     new_pcb->exit_status = -1;
-    list_init(&new_pcb->open_files);
+    lock_init_named(&new_pcb->files_lock, "files");
+    new_pcb->files = NULL;
+    new_pcb->fd_map = NULL;
+    new_pcb->fd_cap = 0;
+    new_pcb->executable_file = NULL;
+    new_pcb->library_file = NULL;
 
     /* Initialize user thread tracking infrastructure */
-    list_init(&new_pcb->u_threads);
-    lock_init(&new_pcb->u_threads_lock);
+    process_init_threads(new_pcb, t, 0);
 
     // Continue initializing the PCB as normal
-    new_pcb->next_fd = FIRST_FILE_FD;
     t->pcb->main_thread = t;
     strlcpy(t->pcb->process_name, file_name, MAX_PROGRAM_NAME_LENGTH);
+
+    /* Start in the parent's current directory, or in the root if
+       the parent is the kernel. */
+    new_pcb->cwd = info->parent_pcb->cwd != NULL ? dir_reopen(info->parent_pcb->cwd)
+                                                 : dir_open_root();
+    if (new_pcb->cwd == NULL)
+      success = false;
+
+    /* Take over the files that spawn() passes on. */
+    if (success && info->fd_cnt > 0)
+      success = spawn_file_descriptors(new_pcb, info->parent_pcb, info->fds, info->fd_cnt);
   }
 
   /* Initialize interrupt frame and load executable. */
   if (success) {
     memset(&if_, 0, sizeof if_);
-    if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+    if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+    if_.gs = SEL_UTLS;
     if_.cs = SEL_UCSEG;
     if_.eflags = FLAG_IF | FLAG_MBS;
     success = load(file_name, &if_.eip, &if_.esp);
@@ -288,14 +778,7 @@ static void start_process(void* load_info) {
 
   if (success) {
     /* Arrange arguments on interrupt frame */
-    load_args(argv, &if_.esp);
-  }
-
-  /* Protect executable file by denying file write */
-  if (success && pcb_success) {
-    struct file* executable_file = filesys_open(file_name);
-    t->pcb->executable_file = executable_file;
-    file_deny_write(executable_file);
+    load_args(args, info->args_len, info->argc, &if_.esp);
   }
 
   /* Handle failure with succesful PCB malloc. Must free the PCB */
@@ -304,16 +787,20 @@ static void start_process(void* load_info) {
     // If this happens, then an unfortuantely timed timer interrupt
     // can try to activate the pagedir, but it is now freed memory
     struct process* pcb_to_free = t->pcb;
+    process_destroy_address_space(pcb_to_free);
     t->pcb = NULL;
+    destroy_file_descriptor_table(pcb_to_free);
+    destroy_children(pcb_to_free);
+    dir_close(pcb_to_free->cwd);
+    file_close(pcb_to_free->library_file);
     free(pcb_to_free);
   }
 
-  *(info->load_success) = success;
-  sema_up(info->load_sema);
+  info->success = success;
+  sema_up(&info->loaded);
 
   /* Clean up. Exit on failure or jump to userspace */
-  palloc_free_page(argv);
-  free(file_name);
+  palloc_free_page(args);
   if (!success) {
     thread_exit();
   }
@@ -335,187 +822,475 @@ static void start_process(void* load_info) {
    been successfully called for the given PID, returns -1
    immediately, without waiting.
 */
-int process_wait(UNUSED pid_t child_pid) {
-  // /* Find child process with given child_pid */
+int process_wait(pid_t child_pid) {
   struct process* cur_pcb = thread_current()->pcb;
-  struct child_info* matching_child = NULL;
-  lock_acquire(&cur_pcb->children_lock);
-  struct list_elem* e;
-  for (e = list_begin(&cur_pcb->children); e != list_end(&cur_pcb->children); e = list_next(e)) {
-    struct child_info* child = list_entry(e, struct child_info, elem);
-    if (child_pid == child->pid) {
-      matching_child = child;
-      break;
-    }
-  }
-  // printf("Found matching_child:%s\n", matching_child != NULL ? "yes" : "no");
-  // printf("Does process have parent:%s\n", cur_pcb->parent_pcb != NULL ? "yes" : "no");
+  struct child_info* child;
+  int status;
 
-  /* child_pid is invalid, no such child process exists */
-  if (matching_child == NULL) {
-    // printf("child_pid is invalid, no such child process exists \n");
-    lock_release(&cur_pcb->children_lock);
-    return -1;
-  }
+  lock_acquire(&cur_pcb->children_lock);
+  child = find_child(cur_pcb, child_pid);
 
-  /* process_wait() has already been successfully called for the given PID */
-  if (matching_child->has_been_waited) {
+  /* No such child, or another thread is already waiting for it. */
+  if (child == NULL || child->has_been_waited) {
     lock_release(&cur_pcb->children_lock);
     return -1;
   }
 
-  matching_child->has_been_waited = true;
-  // printf("child has exited:%d\n", matching_child->has_exited);
-  if (!matching_child->has_exited) {
+  child->has_been_waited = true;
+  cur_pcb->unwaited_cnt--;
+  if (child->has_exited)
+    list_remove(&child->exited_elem);
+  else {
     lock_release(&cur_pcb->children_lock);
-    sema_down(&matching_child->exit_sema);
+    sema_set_owner(&child->exit_sema, child_pid);
+    sema_down(&child->exit_sema);
     lock_acquire(&cur_pcb->children_lock);
   }
 
-  int status = matching_child->exit_status;
+  status = child->exit_status;
+  forget_child(cur_pcb, child);
   lock_release(&cur_pcb->children_lock);
 
   return status;
 }
 
-/* Free the current process's resources. */
+/* Waits for any child of the calling process that has not been
+   waited for to die, stores its PID in *PID, and returns its exit
+   status, as process_wait() would.  Children are reaped in the
+   order they exited.  Returns -1 immediately, with *PID set to
+   TID_ERROR, if there is no such child. */
+int process_wait_any(pid_t* pid) {
+  struct process* cur_pcb = thread_current()->pcb;
+  int status = -1;
+
+  *pid = TID_ERROR;
+  lock_acquire(&cur_pcb->children_lock);
+  while (list_empty(&cur_pcb->exited_children) && cur_pcb->unwaited_cnt > 0)
+    cond_wait(&cur_pcb->child_exited, &cur_pcb->children_lock);
+  if (!list_empty(&cur_pcb->exited_children)) {
+    struct list_elem* e = list_pop_front(&cur_pcb->exited_children);
+    struct child_info* child = list_entry(e, struct child_info, exited_elem);
+
+    child->has_been_waited = true;
+    cur_pcb->unwaited_cnt--;
+    *pid = child->pid;
+    status = child->exit_status;
+    forget_child(cur_pcb, child);
+  }
+  lock_release(&cur_pcb->children_lock);
+  return status;
+}
+
+/* Free the current process's resources.  Tells the parent that
+   the process has exited as soon as nothing the parent could
+   observe is left, and hands the rest of the teardown to
+   reap_wq. */
 void process_exit(void) {
   struct thread* cur = thread_current();
-  uint32_t* pd;
+  struct process* pcb = cur->pcb;
 
   /* If this thread does not have a PCB, don't worry */
-  if (cur->pcb == NULL) {
+  if (pcb == NULL) {
     thread_exit();
     NOT_REACHED();
   }
 
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
-  pd = cur->pcb->pagedir;
+  /* Stop the process's other threads before tearing down anything
+     they might be using.  Does not return if another thread is
+     already doing so. */
+  process_kill_threads(pcb);
+  process_console_flush();
+  if (sysstat_enabled)
+    syscall_print_process_stats(pcb);
+
+#ifdef VM
+  /* Write back changes to mapped files, which the parent may read
+     as soon as it knows we have exited. */
+  if (pcb->pagedir != NULL)
+    mmap_unmap_all(pcb);
+#endif
+
+  /* Close executable file and allow writes again */
+  file_allow_write(pcb->executable_file);
+  file_close(pcb->executable_file);
+  file_close(pcb->library_file);
+  dir_close(pcb->cwd);
+  pcb->cwd = NULL;
+
+  /* Orphan our living children and forget the ones that exited. */
+  lock_acquire(&pcb->children_lock);
+  hash_destroy(&pcb->children, orphan_child);
+  lock_release(&pcb->children_lock);
+
+  /* Signal to parent process that child process has exited */
+  if (pcb->parent_pcb != NULL) {
+    lock_acquire(&pcb->parent_pcb->children_lock);
+    if (pcb->as_child != NULL) {
+      struct child_info* child = pcb->as_child;
+      child->exit_status = pcb->exit_status;
+      child->has_exited = true;
+      child->pcb = NULL;
+      if (!child->has_been_waited)
+        list_push_back(&pcb->parent_pcb->exited_children, &child->exited_elem);
+      sema_up(&child->exit_sema);
+      cond_broadcast(&pcb->parent_pcb->child_exited, &pcb->parent_pcb->children_lock);
+    }
+    lock_release(&pcb->parent_pcb->children_lock);
+  }
+
+  /* Leave the rest to reap_wq.  With the PCB gone from this
+     thread, process_activate() cannot switch back to its page
+     directory, so it is safe to destroy while we finish dying. */
+  cur->pcb = NULL;
+  pagedir_activate(NULL);
+  work_init(&pcb->reap_work, process_reap, pcb);
+  wq_queue(reap_wq, &pcb->reap_work);
+
+  thread_exit();
+}
+
+/* Frees everything that exited process PCB_ still holds,
+   including PCB_ itself.  No thread may be using its page
+   directory.  Runs on reap_wq. */
+static void process_reap(void* pcb_) {
+  struct process* pcb = pcb_;
+  uint32_t* pd;
+
+  /* Setting pagedir to null first stops the frame table from
+     evicting PCB's pages while we free them. */
+  lock_acquire(&pcb->pagedir_lock);
+  pd = pcb->pagedir;
+  pcb->pagedir = NULL;
+  lock_release(&pcb->pagedir_lock);
+  if (pd != NULL)
+    process_free_address_space(pcb, pd);
+
+  destroy_file_descriptor_table(pcb);
+
+  while (!list_empty(&pcb->u_threads)) {
+    struct list_elem* e = list_pop_front(&pcb->u_threads);
+    struct user_thread_info* info = list_entry(e, struct user_thread_info, elem);
+    if (info != &pcb->main_info)
+      kmem_cache_free(thread_info_cache, info);
+  }
+  cpu_quota_release(&pcb->cpu_quota);
+  free(pcb->console_line);
+  free(pcb);
+}
+
+/* Waits until reap_wq has torn down every process that has
+   exited so far, so that the memory they held is free again. */
+static void reap_wait(void) { wq_flush(reap_wq); }
+
+/* Destroys the page directory of PCB, which must be the running
+   thread's process, and switches back to the kernel-only page
+   directory.  Does nothing if PCB has no page directory. */
+static void process_destroy_address_space(struct process* pcb) {
+  uint32_t* pd = pcb->pagedir;
+
   if (pd != NULL) {
+#ifdef VM
+    /* Write back changes to mapped files while we still can. */
+    mmap_unmap_all(pcb);
+#endif
+
     /* Correct ordering here is crucial.  We must set
-         cur->pcb->pagedir to NULL before switching page directories,
+         pcb->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
          process page directory.  We must activate the base page
          directory before destroying the process's page
          directory, or our active page directory will be one
-         that's been freed (and cleared). */
-    cur->pcb->pagedir = NULL;
+         that's been freed (and cleared).  Holding the
+         pagedir_lock keeps the frame table from evicting a page
+         meanwhile. */
+    lock_acquire(&pcb->pagedir_lock);
+    pcb->pagedir = NULL;
+    lock_release(&pcb->pagedir_lock);
     pagedir_activate(NULL);
-    pagedir_destroy(pd);
+    process_free_address_space(pcb, pd);
   }
+}
 
-  // printf("exiting process:%d\n", get_pid(cur->pcb));
+/* Frees page directory PD, which was PCB's, and the user memory
+   it maps.  PCB's pagedir must already be null. */
+static void process_free_address_space(struct process* pcb UNUSED, uint32_t* pd) {
+  ASSERT(pcb->pagedir == NULL);
+  pagedir_destroy(pd);
+#ifdef VM
+  frame_release_owner(pcb);
+  page_table_destroy(&pcb->pages);
+  shm_exit(pcb);
+  mq_exit(pcb);
+#endif
+}
 
-  /* Signal to parent process that child process has exited */
-  int status = cur->pcb->exit_status;
-  if (cur->pcb->parent_pcb != NULL) {
-    // printf("parent exists\n");
-    lock_acquire(&cur->pcb->parent_pcb->children_lock);
+/* Sets up the CPU for running user code in the current
+   thread. This function is called on every context switch. */
+void process_activate(void) {
+  struct thread* t = thread_current();
+  uint32_t* pd = t->pcb != NULL && t->pcb->pagedir != NULL ? t->pcb->pagedir : init_page_dir;
 
-    // printf("does parent have any children: %s\n",
-    // list_empty(&cur->pcb->parent_pcb->children) ? "no" : "yes");
-    struct list_elem* e;
-    for (e = list_begin(&cur->pcb->parent_pcb->children);
-         e != list_end(&cur->pcb->parent_pcb->children); e = list_next(e)) {
-      struct child_info* child = list_entry(e, struct child_info, elem);
-      // printf("just a child from parent:%d", child->pid);
-      if (child->pid == get_pid(cur->pcb)) {
-        // printf("found child in parent pcb\n");
-        child->exit_status = status;
-        child->has_exited = true;
-        child->pcb = NULL;
-        sema_up(&child->exit_sema);
-        break;
-      }
-    }
+  /* Activate thread's page tables.  Threads of one process, and
+     kernel threads, share a page directory, and reloading CR3
+     would only flush the TLB, so skip it when PD is already
+     active.  A page directory is never freed while active (see
+     pagedir_destroy()), so an active one cannot be a stale copy
+     of a freed one at the same address. */
+  if (active_pd() != pd)
+    pagedir_activate(pd);
 
-    lock_release(&cur->pcb->parent_pcb->children_lock);
-  }
+  /* Set thread's kernel stack for use in processing interrupts.
+     This does nothing if this is not a user process. */
+  tss_update();
 
-  /* Clean up children list of this process */
-  lock_acquire(&cur->pcb->children_lock);
+  /* Give the thread its own thread-local storage segment. */
+  gdt_set_tls(t->tls_base);
+}
 
-  while (!list_empty(&cur->pcb->children)) {
-    struct list_elem* e = list_pop_back(&cur->pcb->children);
-    struct child_info* child = list_entry(e, struct child_info, elem);
+/* Sets the base of the running thread's thread-local storage
+   segment, which user code reaches through %gs, to user address
+   BASE.  Returns false if BASE is not a user address. */
+bool process_set_tls(void* base) {
+  struct thread* t = thread_current();
 
-    /* Orphaning living children */
-    if (!child->has_exited) {
-      child->pcb->parent_pcb = NULL;
-    }
+  if (!is_user_vaddr(base))
+    return false;
+  t->tls_base = (uintptr_t)base;
+  gdt_set_tls(t->tls_base);
+  return true;
+}
 
-    /* Destroy the child_info structure */
-    destroy_child_info(child);
-  }
+#ifndef VM
+/* Maps the 4 MB-aligned region of PCB's heap that holds
+   FAULT_ADDR with a large page, if the region lies wholly inside
+   the heap and none of its pages has been written yet, and
+   returns true.  A large heap then costs one TLB entry per 4 MB
+   instead of one per page.  Under VM, frames are tracked and
+   evicted page by page, so the heap always uses small pages. */
+static bool map_large_heap(struct process* pcb, void* fault_addr) {
+  uint8_t* region = (uint8_t*)((uintptr_t)fault_addr & ~(uintptr_t)(PTSPAN - 1));
+
+  return region >= pcb->heap_start && region + PTSPAN <= pcb->heap_brk &&
+         pagedir_set_large_page(pcb->pagedir, region);
+}
+#endif
+
+/* Handles a write fault at user address FAULT_ADDR in the current
+   process's address space, which may be a write to a page that
+   fork() left shared copy-on-write.  Returns true if it was and
+   the page is now writable, so the faulting instruction can be
+   retried, or false if the fault is a genuine error or there is
+   no memory for a copy. */
+bool process_break_cow(void* fault_addr) {
+  struct process* pcb = thread_current()->pcb;
+  bool success;
 
-  lock_release(&cur->pcb->children_lock);
+  if (pcb == NULL || pcb->pagedir == NULL)
+    return false;
 
-  /* Close executable file and allow writes again */
-  file_allow_write(cur->pcb->executable_file);
-  file_close(cur->pcb->executable_file);
-
-  /* Destroy file descriptor table */
-  destroy_file_descriptor_table(cur->pcb);
-
-  /* Destroy user threads mapped kernel threads and 
-     destroy user thread tracking info. The user threads' stack 
-     resides in process' pagedir */
-  lock_acquire(&cur->pcb->u_threads_lock);
-
-  /* Avoid race conditions when removing threads from all threads list */
-  enum intr_level old_level = intr_disable();
-
-  while (!list_empty(&cur->pcb->u_threads)) {
-    struct list_elem* e = list_pop_back(&cur->pcb->u_threads);
-    struct user_thread_info* thread_info = list_entry(e, struct user_thread_info, elem);
-
-    struct thread* thread = thread_get_by_tid(thread_info->tid);
-    /* For threads that aren't the current thread, force cleanup */
-    if (thread != NULL && thread != cur && !thread_info->has_exited) {
-      /* Remove from scheduler queues or semaphore's waiter list if needed */
-      if (thread->status == THREAD_READY || thread->status == THREAD_BLOCKED) {
-        list_remove(&thread->elem);
-      }
+  lock_acquire(&pcb->pagedir_lock);
+#ifdef VM
+  success = pagedir_break_cow(pcb->pagedir, pg_round_down(fault_addr));
+  if (success)
+    frame_register(pagedir_get_page(pcb->pagedir, pg_round_down(fault_addr)), pcb,
+                   pg_round_down(fault_addr));
+#else
+  success = map_large_heap(pcb, fault_addr) ||
+            pagedir_break_cow(pcb->pagedir, pg_round_down(fault_addr));
+#endif
+  lock_release(&pcb->pagedir_lock);
+  return success;
+}
 
-      list_remove(&thread->allelem);
-      palloc_free_page(thread);
-    }
+#ifdef VM
+/* Handles a fault at user address FAULT_ADDR in a page that the
+   current process has not touched yet, by reading it in from its
+   supplemental page table.  WRITE says whether the faulting
+   access was a write.  Sets *MAJOR to true if the page had to be
+   read from swap or a file.  Returns true if successful, so the
+   faulting instruction can be retried, or false if the fault is a
+   genuine error or loading fails. */
+bool process_load_page(void* fault_addr, bool write, bool* major) {
+  struct process* pcb = thread_current()->pcb;
+  void* upage = pg_round_down(fault_addr);
+  bool success;
 
-    /* Free tracking structure */
-    free(thread_info);
-  }
+  if (pcb == NULL || pcb->pagedir == NULL)
+    return false;
 
-  intr_set_level(old_level);
+  lock_acquire(&pcb->pagedir_lock);
+  success = load_page(pcb, upage, write, major);
+  lock_release(&pcb->pagedir_lock);
+  return success;
+}
 
-  lock_release(&cur->pcb->u_threads_lock);
+/* Advises the kernel how the current process will use the pages
+   in the LENGTH bytes starting at page-aligned user address ADDR,
+   with one of the MADV_* values in <mman.h>.  MADV_WILLNEED reads
+   the pages in now, as far as there are free frames for them; the
+   other values set how much load_page() reads around later faults
+   in the pages.  Returns false if ADDR is not page-aligned, ADVICE
+   is not valid, or some page in the range is not part of the
+   address space. */
+bool process_madvise(void* addr, size_t length, int advice) {
+  struct process* pcb = thread_current()->pcb;
+  uint8_t* start = addr;
+  uint8_t* end;
+  uint8_t* upage;
+  bool success = true;
+
+  if (pg_ofs(addr) != 0 || !is_user_vaddr(addr) || length == 0 ||
+      length > (size_t)((uint8_t*)PHYS_BASE - start) || advice < MADV_NORMAL ||
+      advice > MADV_WILLNEED)
+    return false;
+  end = start + ROUND_UP(length, PGSIZE);
 
-  /* Free the PCB of this process and kill this thread
-     Avoid race where PCB is freed before t->pcb is set to NULL
-     If this happens, then an unfortuantely timed timer interrupt
-     can try to activate the pagedir, but it is now freed memory */
-  struct process* pcb_to_free = cur->pcb;
-  cur->pcb = NULL;
-  free(pcb_to_free);
+  lock_acquire(&pcb->pagedir_lock);
+  for (upage = start; upage < end; upage += PGSIZE)
+    if (page_find(&pcb->pages, upage) == NULL) {
+      success = false;
+      break;
+    }
+  if (success)
+    for (upage = start; upage < end; upage += PGSIZE) {
+      if (advice != MADV_WILLNEED)
+        page_find(&pcb->pages, upage)->advice = advice;
+      else if (page_prefetch(&pcb->pages, pcb->pagedir, upage))
+        frame_register(pagedir_get_page(pcb->pagedir, upage), pcb, upage);
+    }
+  lock_release(&pcb->pagedir_lock);
+  return success;
+}
 
-  thread_exit();
+/* Locks the pages in the LENGTH bytes starting at page-aligned
+   user address ADDR into memory if LOCK is true, reading in any
+   that are not there yet and making private copies of writable
+   ones, so that touching them later costs no fault.  The frame
+   table then never evicts them.  If LOCK is false, unlocks them
+   instead.  Returns false if ADDR is not page-aligned or some page
+   in the range is not part of the address space, changing
+   nothing, or if locking would lock too many pages or there is no
+   memory to read them into, leaving the range unlocked.  fork()
+   does not pass locks on to the child. */
+bool process_mlock(void* addr, size_t length, bool lock) {
+  struct process* pcb = thread_current()->pcb;
+  uint8_t* start = addr;
+  uint8_t* end;
+  uint8_t* upage;
+  bool success = true;
+
+  if (pg_ofs(addr) != 0 || !is_user_vaddr(addr) || length == 0 ||
+      length > (size_t)((uint8_t*)PHYS_BASE - start))
+    return false;
+  end = start + ROUND_UP(length, PGSIZE);
+
+  lock_acquire(&pcb->pagedir_lock);
+  for (upage = start; upage < end; upage += PGSIZE)
+    if (page_find(&pcb->pages, upage) == NULL) {
+      lock_release(&pcb->pagedir_lock);
+      return false;
+    }
+  for (upage = start; upage < end && success; upage += PGSIZE) {
+    struct page* p = page_find(&pcb->pages, upage);
+    success = page_set_locked(p, lock) && (!lock || load_page(pcb, upage, p->writable, NULL));
+  }
+  if (!success)
+    for (upage = start; upage < end; upage += PGSIZE)
+      page_set_locked(page_find(&pcb->pages, upage), false);
+  lock_release(&pcb->pagedir_lock);
+  return success;
 }
 
-/* Sets up the CPU for running user code in the current
-   thread. This function is called on every context switch. */
-void process_activate(void) {
-  struct thread* t = thread_current();
+/* Sets how readily the frame table evicts the current process's
+   pages to PRIORITY, one of the EVICT_PRI_* values in <mman.h>.
+   Returns false if PRIORITY is not valid. */
+bool process_set_evict_priority(int priority) {
+  if (priority < EVICT_PRI_LOW || priority > EVICT_PRI_HIGH)
+    return false;
+  thread_current()->pcb->evict_priority = priority;
+  return true;
+}
 
-  /* Activate thread's page tables. */
-  if (t->pcb != NULL && t->pcb->pagedir != NULL)
-    pagedir_activate(t->pcb->pagedir);
-  else
-    pagedir_activate(NULL);
+/* Number of pages after a page read back from swap that
+   load_page() also reads back, if they are in the following swap
+   slots. */
+#define SWAP_READ_AROUND 3
+
+/* Number of pages after a page read from its file that
+   load_page() also reads, if they continue the same file, for
+   pages with MADV_NORMAL and MADV_SEQUENTIAL advice. */
+#define FAULT_AROUND_PAGES 4
+#define FAULT_AROUND_SEQUENTIAL 16
+
+/* Maps user page UPAGE of PCB from PCB's supplemental page table
+   and enters its frame into the frame table, so that it can be
+   evicted again.  WRITE says whether the page is about to be
+   written; if not, a page of zeros costs no frame until it is.
+   If MAJOR is nonnull, sets *MAJOR to true if UPAGE had to be read
+   from swap or a file.  The caller must hold PCB's pagedir_lock.
+
+   Pages after UPAGE that are likely to be wanted soon are read in
+   as well, as long as there are free frames for them, so that one
+   fault does the work of several. */
+static bool load_page(struct process* pcb, void* upage, bool write, bool* major) {
+  struct page* p = page_find(&pcb->pages, upage);
+  struct file* file;
+  off_t ofs;
+  size_t slot, cnt, i;
+  int advice;
+  bool read;
+
+  if (major != NULL)
+    *major = false;
+  if (p == NULL)
+    return false;
+  file = p->file;
+  ofs = p->ofs;
+  slot = p->swap_slot;
+  advice = p->advice;
+  cnt = slot == SWAP_ERROR && p->read_bytes > 0 ? FAULT_AROUND_PAGES : 0;
 
-  /* Set thread's kernel stack for use in processing interrupts.
-     This does nothing if this is not a user process. */
-  tss_update();
+  if (!page_load(&pcb->pages, pcb->pagedir, upage, write, &read))
+    return false;
+  if (major != NULL)
+    *major = read;
+  frame_register(pagedir_get_page(pcb->pagedir, upage), pcb, upage);
+  if (advice == MADV_RANDOM)
+    return true;
+
+  /* Pages evicted together get consecutive slots in address
+     order, so the next pages are likely in the next slots.  Read
+     them while the disk head is there. */
+  if (slot != SWAP_ERROR)
+    for (i = 1; i <= SWAP_READ_AROUND; i++) {
+      uint8_t* next = (uint8_t*)upage + i * PGSIZE;
+      struct page* np = is_user_vaddr(next) ? page_find(&pcb->pages, next) : NULL;
+      if (np == NULL || np->swap_slot != slot + i ||
+          !page_prefetch(&pcb->pages, pcb->pagedir, next))
+        break;
+      frame_register(pagedir_get_page(pcb->pagedir, next), pcb, next);
+    }
+
+  /* Likewise, read the following pages of the file, skipping any
+     that are already mapped but stopping at the first page that
+     does not continue it. */
+  if (cnt > 0 && advice == MADV_SEQUENTIAL)
+    cnt = FAULT_AROUND_SEQUENTIAL;
+  for (i = 1; i <= cnt; i++) {
+    uint8_t* next = (uint8_t*)upage + i * PGSIZE;
+    struct page* np = is_user_vaddr(next) ? page_find(&pcb->pages, next) : NULL;
+    if (np == NULL || np->file != file || np->ofs != ofs + (off_t)(i * PGSIZE) ||
+        np->swap_slot != SWAP_ERROR)
+      break;
+    if (pagedir_get_page(pcb->pagedir, next) != NULL)
+      continue;
+    if (!page_prefetch(&pcb->pages, pcb->pagedir, next))
+      break;
+    frame_register(pagedir_get_page(pcb->pagedir, next), pcb, next);
+  }
+  return true;
 }
+#endif
 
 /* We load ELF binaries.  The following definitions are taken
    from the ELF specification, [ELF1], more-or-less verbatim.  */
@@ -579,6 +1354,12 @@ struct Elf32_Phdr {
 #define PF_R 4 /* Readable. */
 
 static bool setup_stack(void** esp);
+static bool install_clock_page(void);
+static bool template_copy(struct exec_template*, struct process*);
+static void template_create(struct process*, struct inode*, unsigned generation);
+static struct exec_image* read_exec_image(struct file*, const char* file_name);
+static bool load_library(const char* name);
+static void read_ahead_segments(struct inode*, const struct exec_image*);
 static bool validate_segment(const struct Elf32_Phdr*, struct file*);
 static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t read_bytes,
                          uint32_t zero_bytes, bool writable);
@@ -589,17 +1370,16 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
    Returns true if successful, false otherwise. */
 bool load(const char* file_name, void (**eip)(void), void** esp) {
   struct thread* t = thread_current();
-  struct Elf32_Ehdr ehdr;
+  struct exec_image* image = NULL;
+  struct exec_template* template = NULL;
   struct file* file = NULL;
-  off_t file_ofs;
+  struct inode* inode;
+  unsigned generation;
+  uint32_t* pd;
   bool success = false;
-  int i;
+  size_t i;
 
-  /* Allocate and activate page directory. */
-  t->pcb->pagedir = pagedir_create();
-  if (t->pcb->pagedir == NULL)
-    goto done;
-  process_activate();
+  t->pcb->heap_start = NULL;
 
   /* Open executable file. */
   file = filesys_open(file_name);
@@ -608,83 +1388,393 @@ bool load(const char* file_name, void (**eip)(void), void** esp) {
     goto done;
   }
 
+  /* Find out where the segments go, from the cache if the file
+     has not changed since we last read its headers. */
+  inode = file_get_inode(file);
+  generation = inode_generation(inode);
+  image = exec_cache_lookup(inode, generation);
+  if (image == NULL) {
+    image = read_exec_image(file, file_name);
+    if (image == NULL)
+      goto done;
+    exec_cache_insert(inode, generation, image);
+  }
+
+  /* If the executable has been loaded before, start from a copy
+     of the address space that left behind, which already has the
+     segments and the stack. */
+  template = exec_cache_get_template(inode, generation);
+  if (template != NULL) {
+    if (!template_copy(template, t->pcb))
+      goto done;
+    process_activate();
+    *esp = PHYS_BASE;
+    *eip = image->entry;
+    success = true;
+    goto done;
+  }
+
+  /* Get the disk going on the segments while the address space
+     is set up. */
+  read_ahead_segments(inode, image);
+
+  /* Allocate and activate page directory. */
+  pd = pagedir_create();
+  if (pd == NULL)
+    goto done;
+#ifdef VM
+  if (!page_table_init(&t->pcb->pages)) {
+    pagedir_destroy(pd);
+    goto done;
+  }
+  mmap_init(t->pcb);
+#endif
+  t->pcb->pagedir = pd;
+  process_activate();
+
+  /* Set up stack and clock page, which need no data from the
+     file, while the read-ahead is in flight. */
+  if (!setup_stack(esp) || !install_clock_page())
+    goto done;
+
+  /* Load the segments. */
+  for (i = 0; i < image->seg_cnt; i++) {
+    const struct exec_segment* seg = &image->segs[i];
+    uint8_t* end = seg->upage + seg->read_bytes + seg->zero_bytes;
+
+    if (!load_segment(file, seg->file_page, seg->upage, seg->read_bytes, seg->zero_bytes,
+                      seg->writable))
+      goto done;
+    if (end > t->pcb->heap_start)
+      t->pcb->heap_start = end;
+  }
+  if (image->interp[0] != '\0' && !load_library(image->interp))
+    goto done;
+
+  /* The heap starts out empty. */
+  t->pcb->heap_brk = t->pcb->heap_start;
+
+  /* Start address. */
+  *eip = image->entry;
+
+  /* Let later runs copy the address space as it is now, before
+     the arguments go on the stack. */
+  template_create(t->pcb, inode, generation);
+
+  /* Keep the executable open, and unwritable, for as long as the
+     process runs, instead of looking it up again by name. */
+  file_deny_write(file);
+  t->pcb->executable_file = file;
+  file = NULL;
+  success = true;
+
+done:
+  /* We arrive here whether the load is successful or not. */
+  exec_template_release(template);
+  exec_image_release(image);
+  file_close(file);
+  return success;
+}
+
+/* Shared libraries.  A program linked against libc.so (see
+   Makefile.userprog) names it in a PT_INTERP header instead of
+   carrying its own copy of the user library.  The library is an
+   ordinary executable linked at an address of its own, below
+   every program (see lib/user/libc.lds), so it needs no
+   relocation: load() maps its segments beside the program's, and
+   the program calls straight into it.  Its read-only pages are
+   file pages like the program's, so all the processes that map
+   it share one copy in memory, and with VM each page is read from
+   disk only once, not once per program.  Its data is private to
+   each process, as a program's is.  The library's entry point is
+   not used. */
+
+/* Maps the segments of the shared library named NAME into the
+   current process, which keeps it open, and unwritable, as its
+   library_file.  Returns true if successful, false otherwise. */
+static bool load_library(const char* name) {
+  struct process* pcb = thread_current()->pcb;
+  struct exec_image* image;
+  struct file* file;
+  struct inode* inode;
+  unsigned generation;
+  bool success = false;
+  size_t i;
+
+  file = filesys_open(name);
+  if (file == NULL) {
+    printf("load: %s: open failed\n", name);
+    return false;
+  }
+
+  inode = file_get_inode(file);
+  generation = inode_generation(inode);
+  image = exec_cache_lookup(inode, generation);
+  if (image == NULL) {
+    image = read_exec_image(file, name);
+    if (image == NULL)
+      goto done;
+    exec_cache_insert(inode, generation, image);
+  }
+  if (image->interp[0] != '\0') {
+    printf("load: %s: shared library needs another\n", name);
+    goto done;
+  }
+
+  read_ahead_segments(inode, image);
+  for (i = 0; i < image->seg_cnt; i++) {
+    const struct exec_segment* seg = &image->segs[i];
+
+    if (!load_segment(file, seg->file_page, seg->upage, seg->read_bytes, seg->zero_bytes,
+                      seg->writable))
+      goto done;
+  }
+
+  file_deny_write(file);
+  pcb->library_file = file;
+  file = NULL;
+  success = true;
+
+done:
+  exec_image_release(image);
+  file_close(file);
+  return success;
+}
+
+/* Templates hold on to their pages, which cannot be evicted, so
+   together they may map at most one page for every
+   TEMPLATE_BUDGET_DIV pages of the user pool.  Without VM, that
+   is every page of the executable; with VM, only the stack, since
+   the rest is read in by the processes that touch it. */
+#define TEMPLATE_BUDGET_DIV 8
+
+/* Pages that the templates map.  Interrupts off. */
+static size_t template_pages;
+
+/* An executable's address space as load() laid it out, before
+   any arguments went on the stack: see struct exec_template.  No
+   thread runs in it.  Its pages are shared copy-on-write with the
+   process that loaded it and every process copied from it, so
+   they stay as they were loaded for as long as the template
+   lives. */
+struct process_template {
+  struct exec_template base; /* Reference count and destructor. */
+  struct lock lock;          /* Serializes copies of PD. */
+  uint32_t* pd;              /* Page directory. */
+#ifdef VM
+  struct hash pages; /* Supplemental page table. */
+#endif
+  uint8_t* heap_start;  /* Start of the heap. */
+  struct file* library; /* Shared library PD maps, or NULL. */
+  size_t page_cnt;      /* Pages PD maps. */
+};
+
+/* Returns the process template that embeds BASE. */
+static struct process_template* template_of(struct exec_template* base) {
+  return (struct process_template*)((uint8_t*)base - offsetof(struct process_template, base));
+}
+
+/* Frees process template BASE and the pages it holds. */
+static void template_destroy(struct exec_template* base) {
+  struct process_template* t = template_of(base);
+  enum intr_level old_level;
+
+  old_level = intr_disable();
+  template_pages -= t->page_cnt;
+  intr_set_level(old_level);
+  pagedir_destroy(t->pd);
+#ifdef VM
+  page_table_destroy(&t->pages);
+#endif
+  file_close(t->library);
+  free(t);
+}
+
+/* Gives PCB, which has no address space yet, a copy-on-write
+   copy of TEMPLATE's, as fork() would.  Returns false if memory
+   is not available. */
+static bool template_copy(struct exec_template* template, struct process* pcb) {
+  struct process_template* t = template_of(template);
+  uint32_t* pd;
+
+  if (t->library != NULL) {
+    pcb->library_file = file_reopen(t->library);
+    if (pcb->library_file == NULL)
+      return false;
+    file_deny_write(pcb->library_file);
+  }
+
+  lock_acquire(&t->lock);
+  pd = pagedir_copy(t->pd);
+#ifdef VM
+  if (pd != NULL && !page_table_copy(&pcb->pages, &t->pages)) {
+    pagedir_destroy(pd);
+    pd = NULL;
+  }
+#endif
+  lock_release(&t->lock);
+  if (pd == NULL)
+    return false;
+
+#ifdef VM
+  mmap_init(pcb);
+#endif
+  pcb->heap_start = pcb->heap_brk = t->heap_start;
+  pcb->pagedir = pd;
+  return true;
+}
+
+/* Caches a template of PCB's address space, which load() has just
+   laid out, as the one for INODE at GENERATION, unless it would
+   take the templates over their budget or memory is short. */
+static void template_create(struct process* pcb, struct inode* inode, unsigned generation) {
+  struct process_template* t;
+  enum intr_level old_level;
+  uint8_t* user_base;
+  size_t user_pages;
+  bool fits;
+
+  t = malloc(sizeof *t);
+  if (t == NULL)
+    return;
+  lock_init_named(&t->lock, "template");
+  t->heap_start = pcb->heap_start;
+  t->library = NULL;
+  if (pcb->library_file != NULL) {
+    /* Keep the library from changing under the pages PD maps. */
+    t->library = file_reopen(pcb->library_file);
+    if (t->library == NULL) {
+      free(t);
+      return;
+    }
+    file_deny_write(t->library);
+  }
+
+  lock_acquire(&pcb->pagedir_lock);
+  t->page_cnt = pagedir_page_cnt(pcb->pagedir);
+  palloc_user_pool(&user_base, &user_pages);
+  old_level = intr_disable();
+  fits = template_pages + t->page_cnt <= user_pages / TEMPLATE_BUDGET_DIV;
+  if (fits)
+    template_pages += t->page_cnt;
+  intr_set_level(old_level);
+  if (!fits) {
+    lock_release(&pcb->pagedir_lock);
+    file_close(t->library);
+    free(t);
+    return;
+  }
+  t->pd = pagedir_copy(pcb->pagedir);
+#ifdef VM
+  if (t->pd != NULL && !page_table_copy(&t->pages, &pcb->pages)) {
+    pagedir_destroy(t->pd);
+    t->pd = NULL;
+  }
+#endif
+  lock_release(&pcb->pagedir_lock);
+  if (t->pd == NULL) {
+    old_level = intr_disable();
+    template_pages -= t->page_cnt;
+    intr_set_level(old_level);
+    file_close(t->library);
+    free(t);
+    return;
+  }
+
+  exec_template_init(&t->base, template_destroy);
+  exec_cache_set_template(inode, generation, &t->base);
+  exec_template_release(&t->base);
+}
+
+/* Reads and verifies the ELF header and program headers of FILE,
+   which is named FILE_NAME, and returns what they say about
+   loading it, or a null pointer if FILE is not a valid executable
+   or memory is exhausted. */
+static struct exec_image* read_exec_image(struct file* file, const char* file_name) {
+  struct Elf32_Ehdr ehdr;
+  struct Elf32_Phdr* phdrs = NULL;
+  struct exec_image* image = NULL;
+  char interp[EXEC_INTERP_MAX] = "";
+  size_t phdrs_size;
+  size_t seg_cnt = 0;
+  int i;
+
   /* Read and verify executable header. */
-  if (file_read(file, &ehdr, sizeof ehdr) != sizeof ehdr ||
+  if (file_read_at(file, &ehdr, sizeof ehdr, 0) != sizeof ehdr ||
       memcmp(ehdr.e_ident, "\177ELF\1\1\1", 7) || ehdr.e_type != 2 || ehdr.e_machine != 3 ||
       ehdr.e_version != 1 || ehdr.e_phentsize != sizeof(struct Elf32_Phdr) || ehdr.e_phnum > 1024) {
     printf("load: %s: error loading executable\n", file_name);
-    goto done;
+    return NULL;
   }
 
-  /* Read program headers. */
-  file_ofs = ehdr.e_phoff;
-  for (i = 0; i < ehdr.e_phnum; i++) {
-    struct Elf32_Phdr phdr;
-
-    if (file_ofs < 0 || file_ofs > file_length(file))
+  /* Read all the program headers at once. */
+  phdrs_size = ehdr.e_phnum * sizeof *phdrs;
+  if (phdrs_size > 0) {
+    phdrs = malloc(phdrs_size);
+    if (phdrs == NULL || ehdr.e_phoff > (Elf32_Off)file_length(file) ||
+        file_read_at(file, phdrs, phdrs_size, ehdr.e_phoff) != (off_t)phdrs_size)
       goto done;
-    file_seek(file, file_ofs);
+  }
 
-    if (file_read(file, &phdr, sizeof phdr) != sizeof phdr)
-      goto done;
-    file_ofs += sizeof phdr;
-    switch (phdr.p_type) {
-      case PT_NULL:
-      case PT_NOTE:
-      case PT_PHDR:
-      case PT_STACK:
-      default:
-        /* Ignore this segment. */
+  for (i = 0; i < ehdr.e_phnum; i++)
+    switch (phdrs[i].p_type) {
+      case PT_INTERP:
+        /* Names a shared library to map as well, see
+           load_library(). */
+        if (phdrs[i].p_filesz == 0 || phdrs[i].p_filesz > sizeof interp ||
+            file_read_at(file, interp, phdrs[i].p_filesz, phdrs[i].p_offset) !=
+                (off_t)phdrs[i].p_filesz ||
+            interp[phdrs[i].p_filesz - 1] != '\0')
+          goto done;
         break;
       case PT_DYNAMIC:
-      case PT_INTERP:
       case PT_SHLIB:
         goto done;
       case PT_LOAD:
-        if (validate_segment(&phdr, file)) {
-          bool writable = (phdr.p_flags & PF_W) != 0;
-          uint32_t file_page = phdr.p_offset & ~PGMASK;
-          uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
-          uint32_t page_offset = phdr.p_vaddr & PGMASK;
-          uint32_t read_bytes, zero_bytes;
-          if (phdr.p_filesz > 0) {
-            /* Normal segment.
-                     Read initial part from disk and zero the rest. */
-            read_bytes = page_offset + phdr.p_filesz;
-            zero_bytes = (ROUND_UP(page_offset + phdr.p_memsz, PGSIZE) - read_bytes);
-          } else {
-            /* Entirely zero.
-                     Don't read anything from disk. */
-            read_bytes = 0;
-            zero_bytes = ROUND_UP(page_offset + phdr.p_memsz, PGSIZE);
-          }
-          if (!load_segment(file, file_page, (void*)mem_page, read_bytes, zero_bytes, writable))
-            goto done;
-        } else
+        if (!validate_segment(&phdrs[i], file))
           goto done;
+        seg_cnt++;
+        break;
+      default:
+        /* Ignore this segment. */
         break;
     }
-  }
 
-  /* Set up stack. */
-  if (!setup_stack(esp))
+  image = exec_image_create(seg_cnt);
+  if (image == NULL)
     goto done;
-
-  /* Start address. */
-  *eip = (void (*)(void))ehdr.e_entry;
-
-  success = true;
+  image->entry = (void (*)(void))ehdr.e_entry;
+  strlcpy(image->interp, interp, sizeof image->interp);
+  seg_cnt = 0;
+  for (i = 0; i < ehdr.e_phnum; i++)
+    if (phdrs[i].p_type == PT_LOAD) {
+      const struct Elf32_Phdr* phdr = &phdrs[i];
+      struct exec_segment* seg = &image->segs[seg_cnt++];
+      uint32_t page_offset = phdr->p_vaddr & PGMASK;
+
+      seg->writable = (phdr->p_flags & PF_W) != 0;
+      seg->file_page = phdr->p_offset & ~PGMASK;
+      seg->upage = (uint8_t*)(phdr->p_vaddr & ~PGMASK);
+      if (phdr->p_filesz > 0) {
+        /* Normal segment.
+           Read initial part from disk and zero the rest. */
+        seg->read_bytes = page_offset + phdr->p_filesz;
+        seg->zero_bytes = ROUND_UP(page_offset + phdr->p_memsz, PGSIZE) - seg->read_bytes;
+      } else {
+        /* Entirely zero.
+           Don't read anything from disk. */
+        seg->read_bytes = 0;
+        seg->zero_bytes = ROUND_UP(page_offset + phdr->p_memsz, PGSIZE);
+      }
+    }
 
 done:
-  /* We arrive here whether the load is successful or not. */
-  file_close(file);
-  return success;
+  free(phdrs);
+  return image;
 }
 
 /* load() helpers. */
 
-static bool install_page(void* upage, void* kpage, bool writable);
-
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
 static bool validate_segment(const struct Elf32_Phdr* phdr, struct file* file) {
@@ -740,6 +1830,9 @@ static bool validate_segment(const struct Elf32_Phdr* phdr, struct file* file) {
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, only records the pages in the supplemental page table,
+   and each is read in when the process first touches it.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t read_bytes,
@@ -756,23 +1849,32 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
     size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
     size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-    /* Get a page of memory. */
-    uint8_t* kpage = palloc_get_page(PAL_USER);
-    if (kpage == NULL)
-      return false;
-
-    /* Load this page. */
-    if (file_read(file, kpage, page_read_bytes) != (int)page_read_bytes) {
-      palloc_free_page(kpage);
+#ifdef VM
+    if (!page_add_file(&thread_current()->pcb->pages, upage, file, ofs, page_read_bytes, writable))
       return false;
-    }
-    memset(kpage + page_read_bytes, 0, page_zero_bytes);
+    ofs += page_read_bytes;
+#else
+    /* A page of bss alone takes no memory until it is written. */
+    if (page_read_bytes > 0 || !install_zero_page(upage, writable)) {
+      /* Get a page of memory. */
+      uint8_t* kpage = palloc_get_page(PAL_USER);
+      if (kpage == NULL)
+        return false;
+
+      /* Load this page. */
+      if (file_read(file, kpage, page_read_bytes) != (int)page_read_bytes) {
+        palloc_free_page(kpage);
+        return false;
+      }
+      memset(kpage + page_read_bytes, 0, page_zero_bytes);
 
-    /* Add the page to the process's address space. */
-    if (!install_page(upage, kpage, writable)) {
-      palloc_free_page(kpage);
-      return false;
+      /* Add the page to the process's address space. */
+      if (!install_page(upage, kpage, writable)) {
+        palloc_free_page(kpage);
+        return false;
+      }
     }
+#endif
 
     /* Advance. */
     read_bytes -= page_read_bytes;
@@ -782,13 +1884,47 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
   return true;
 }
 
+/* Bytes at the start of each segment that read_ahead_segments()
+   asks for.  file_read()'s own read-ahead takes over from there,
+   and asking for whole segments would only push them out of the
+   small buffer cache before load_segment() gets to them. */
+#define LOAD_READ_AHEAD (2 * PGSIZE)
+
+/* Asks the buffer cache to start reading the first part of each
+   of IMAGE's segments from INODE, so that the reads overlap with
+   load()'s page allocation and zeroing and with each other
+   instead of each waiting for load_segment() to get to it.  With
+   VM, segments are read only as their pages are touched, so
+   nothing is read here. */
+static void read_ahead_segments(struct inode* inode UNUSED, const struct exec_image* image UNUSED) {
+#ifndef VM
+  size_t i;
+
+  for (i = 0; i < image->seg_cnt; i++) {
+    const struct exec_segment* seg = &image->segs[i];
+    inode_read_ahead(inode, seg->file_page,
+                     seg->read_bytes < LOAD_READ_AHEAD ? seg->read_bytes : LOAD_READ_AHEAD);
+  }
+#endif
+}
+
 /* Create a minimal stack by mapping a zeroed page at the top of
    user virtual memory. */
 static bool setup_stack(void** esp) {
-  uint8_t* kpage;
   bool success = false;
 
-  kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+#ifdef VM
+  struct process* pcb = thread_current()->pcb;
+  uint8_t* upage = ((uint8_t*)PHYS_BASE) - PGSIZE;
+
+  lock_acquire(&pcb->pagedir_lock);
+  success =
+      page_add_file(&pcb->pages, upage, NULL, 0, 0, true) && load_page(pcb, upage, true, NULL);
+  lock_release(&pcb->pagedir_lock);
+  if (success)
+    *esp = PHYS_BASE;
+#else
+  uint8_t* kpage = palloc_get_page(PAL_USER | PAL_ZERO);
   if (kpage != NULL) {
     success = install_page(((uint8_t*)PHYS_BASE) - PGSIZE, kpage, true);
     if (success)
@@ -796,15 +1932,39 @@ static bool setup_stack(void** esp) {
     else
       palloc_free_page(kpage);
   }
+#endif
+  return success;
+}
+
+/* Maps the kernel's clock page read-only at CLOCK_PAGE_ADDR, so
+   that clock_gettime() in user programs can read the time
+   without a system call.  fork() and template_copy() pass the
+   mapping on with the rest of the page directory. */
+static bool install_clock_page(void) {
+  struct process* pcb = thread_current()->pcb;
+  void* kpage = timer_clock_page();
+  bool success;
+
+  ASSERT((uint8_t*)CLOCK_PAGE_ADDR == stack_slot_top(STACK_SLOT_CNT) - PGSIZE);
+
+  palloc_share_page(kpage);
+  lock_acquire(&pcb->pagedir_lock);
+  success = pagedir_set_page(pcb->pagedir, (void*)CLOCK_PAGE_ADDR, kpage, false);
+  lock_release(&pcb->pagedir_lock);
+  if (!success)
+    palloc_free_page(kpage);
   return success;
 }
 
 struct fork_info {
   struct intr_frame* parent_f;
-  struct semaphore* fork_sema;
-  bool* fork_success;
+  struct semaphore forked; /* Upped by the child once it is set up */
+  bool success;            /* Whether the fork succeeded (set by child) */
   struct process* parent_pcb;
   struct process* child_pcb;
+  int stack_slot;     /* Forking thread's user stack slot */
+  uintptr_t tls_base; /* Forking thread's thread-local storage */
+  struct thread* parent_thread; /* Forking thread, for its FPU state */
 };
 
 static void fork_child_process(void* fork_info_) {
@@ -815,56 +1975,101 @@ static void fork_child_process(void* fork_info_) {
   struct thread* t = thread_current();
   struct process* child_pcb = malloc(sizeof(struct process));
   bool success = child_pcb != NULL;
+  bool children_ok = false;
 
   if (success) {
     child_pcb->pagedir = NULL;
+    lock_init_named(&child_pcb->pagedir_lock, "pagedir");
+    memset(&child_pcb->usage, 0, sizeof child_pcb->usage);
+    memset(&child_pcb->syscalls, 0, sizeof child_pcb->syscalls);
+    cpu_quota_init(&child_pcb->cpu_quota, &parent_pcb->cpu_quota);
+    io_quota_init(&child_pcb->io_quota, &parent_pcb->io_quota);
+#ifdef VM
+    child_pcb->ws_sweep = child_pcb->ws_pages = 0;
+    child_pcb->evict_priority = parent_pcb->evict_priority;
+#endif
     t->pcb = child_pcb;
 
-    list_init(&child_pcb->children);
-    lock_init(&child_pcb->children_lock);
+    children_ok = init_children(child_pcb);
     child_pcb->parent_pcb = parent_pcb;
+    child_pcb->console_tag = parent_pcb->console_tag;
+    child_pcb->console_line = NULL;
+    child_pcb->as_child = NULL;
     child_pcb->exit_status = -1;
-    list_init(&child_pcb->open_files);
-    child_pcb->next_fd = parent_pcb->next_fd;
+    lock_init_named(&child_pcb->files_lock, "files");
+    child_pcb->files = NULL;
+    child_pcb->fd_map = NULL;
+    child_pcb->fd_cap = 0;
     child_pcb->main_thread = t;
-    child_pcb->executable_file = NULL;
-    if (parent_pcb->executable_file != NULL) {
-      child_pcb->executable_file = filesys_open(parent_pcb->process_name);
-      if (child_pcb->executable_file != NULL) {
-        file_deny_write(child_pcb->executable_file);
-      }
+    process_init_threads(child_pcb, t, info->stack_slot);
+    t->tls_base = info->tls_base;
+    gdt_set_tls(t->tls_base);
+    /* Share the parent's open executable rather than looking it up
+       again by a name that may be truncated, or gone. */
+    child_pcb->executable_file = file_reopen(parent_pcb->executable_file);
+    if (child_pcb->executable_file != NULL)
+      file_deny_write(child_pcb->executable_file);
+    else
+      success = false;
+    child_pcb->library_file = NULL;
+    if (parent_pcb->library_file != NULL) {
+      child_pcb->library_file = file_reopen(parent_pcb->library_file);
+      if (child_pcb->library_file != NULL)
+        file_deny_write(child_pcb->library_file);
+      else
+        success = false;
     }
-    strlcpy(child_pcb->process_name, parent_pcb->process_name, 16);
-
-    // printf("copy parent address space to child \n");
-    child_pcb->pagedir = pagedir_copy(parent_pcb->pagedir);
-    success = child_pcb->pagedir != NULL;
+    strlcpy(child_pcb->process_name, parent_pcb->process_name, sizeof child_pcb->process_name);
+    child_pcb->cwd = parent_pcb->cwd != NULL ? dir_reopen(parent_pcb->cwd) : dir_open_root();
+
+    /* Share the parent's pages copy-on-write.  The parent's other
+       threads keep running, so keep them from breaking sharing
+       while we copy. */
+    lock_acquire(&parent_pcb->pagedir_lock);
+    uint32_t* pd = pagedir_copy(parent_pcb->pagedir);
+#ifdef VM
+    if (pd != NULL && !page_table_copy(&child_pcb->pages, &parent_pcb->pages)) {
+      pagedir_destroy(pd);
+      pd = NULL;
+    } else if (pd != NULL && !mmap_copy(child_pcb, parent_pcb)) {
+      page_table_destroy(&child_pcb->pages);
+      pagedir_destroy(pd);
+      pd = NULL;
+    }
+#endif
+    lock_release(&parent_pcb->pagedir_lock);
+    child_pcb->pagedir = pd;
+    child_pcb->heap_start = parent_pcb->heap_start;
+    child_pcb->heap_brk = parent_pcb->heap_brk;
+    success = child_pcb->pagedir != NULL && children_ok && child_pcb->cwd != NULL;
   }
 
-  // printf("copy file descriptors to child \n");
+  if (success)
+    success = fpu_fork(info->parent_thread);
   if (success) {
     success = copy_file_descriptors(child_pcb, parent_pcb);
   }
 
   if (!success && child_pcb != NULL) {
-    if (child_pcb->pagedir != NULL) {
-      pagedir_destroy(child_pcb->pagedir);
-    }
+    process_destroy_address_space(child_pcb);
     struct process* pcb_to_free = t->pcb;
     t->pcb = NULL;
+    destroy_children(pcb_to_free);
+    dir_close(pcb_to_free->cwd);
+    file_close(pcb_to_free->executable_file);
+    file_close(pcb_to_free->library_file);
     free(pcb_to_free);
   }
 
+  if (success)
+    TRACE(TRACE_FORK, parent_pcb->main_thread->tid, t->tid);
   info->child_pcb = success ? child_pcb : NULL;
-  *(info->fork_success) = success;
-  sema_up(info->fork_sema);
+  info->success = success;
+  sema_up(&info->forked);
 
-  if (!success) {
-    // printf("child failed exiting thread \n");
+  if (!success)
     thread_exit();
-  }
 
-  // printf("copying parent's interrupt frame values to child interrupt frame \n");
   struct intr_frame child_if_;
   child_if_.edi = parent_if->edi;
   child_if_.esi = parent_if->esi;
@@ -903,53 +2108,56 @@ static void fork_child_process(void* fork_info_) {
 };
 
 pid_t process_fork(struct intr_frame* f) {
-  char* fn_copy;
+  struct fork_info fork_info;
   tid_t tid;
 
-  /* Make a copy of FILE_NAME.
-     Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page(0);
-  if (fn_copy == NULL)
-    return TID_ERROR;
-  strlcpy(fn_copy, thread_current()->pcb->process_name, PGSIZE);
-
-  struct semaphore fork_sema;
-  sema_init(&fork_sema, 0);
-  bool fork_success = false;
-  struct fork_info fork_info;
+  /* As in process_spawn_args(), free the memory of exited
+     processes before copying ours. */
+  reap_wait();
 
   fork_info.parent_f = f;
-  fork_info.fork_sema = &fork_sema;
-  fork_info.fork_success = &fork_success;
+  sema_init(&fork_info.forked, 0);
+  fork_info.success = false;
   fork_info.parent_pcb = thread_current()->pcb;
   fork_info.child_pcb = NULL;
 
+  /* The child's only thread continues on the forking thread's
+     stack, which the copied address space already contains. */
+  lock_acquire(&fork_info.parent_pcb->u_threads_lock);
+  fork_info.stack_slot = user_thread_find(fork_info.parent_pcb, thread_tid())->stack_slot;
+  fork_info.tls_base = thread_current()->tls_base;
+  fork_info.parent_thread = thread_current();
+  lock_release(&fork_info.parent_pcb->u_threads_lock);
+
   lock_acquire(&fork_info.parent_pcb->children_lock);
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create(fn_copy, PRI_DEFAULT, fork_child_process, &fork_info);
+  /* Create a new thread, named after us, to run the copy.
+     thread_create_held() copies the name, which the child can then
+     share. */
+  tid = thread_create_held(fork_info.parent_pcb->process_name, PRI_DEFAULT, fork_child_process,
+                           &fork_info);
   if (tid == TID_ERROR) {
-    palloc_free_page(fn_copy);
+    lock_release(&fork_info.parent_pcb->children_lock);
     return -1;
   }
 
-  sema_down(&fork_sema);
+  sema_set_owner(&fork_info.forked, tid);
+  sema_down(&fork_info.forked);
 
-  if (!fork_success) {
+  if (!fork_info.success) {
     lock_release(&fork_info.parent_pcb->children_lock);
-    palloc_free_page(fn_copy);
+    thread_tid_release(tid);
     return -1;
   }
 
   /* Add succesfully loaded child to parent's pcb */
   ASSERT(fork_info.child_pcb != NULL);
-  struct child_info* new_child_info = create_child_info(tid);
-  new_child_info->pcb = fork_info.child_pcb;
-  list_push_back(&fork_info.parent_pcb->children, &new_child_info->elem);
+  add_child(fork_info.parent_pcb, fork_info.child_pcb, tid);
   lock_release(&fork_info.parent_pcb->children_lock);
 
   return tid;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -968,60 +2176,171 @@ static bool install_page(void* upage, void* kpage, bool writable) {
           pagedir_set_page(t->pcb->pagedir, upage, kpage, writable));
 }
 
+/* Like install_page(), but maps UPAGE to the zero page, so that
+   it takes no memory until the first write, if WRITABLE, makes a
+   private copy.  Returns false if UPAGE is already mapped or the
+   zero page cannot be mapped, in which case the caller should
+   install a zeroed page of its own. */
+static bool install_zero_page(void* upage, bool writable) {
+  struct thread* t = thread_current();
+
+  return (pagedir_get_page(t->pcb->pagedir, upage) == NULL &&
+          pagedir_set_zero_page(t->pcb->pagedir, upage, writable));
+}
+#endif
+
 /* Helper function for cleanup during stack allocation failure */
 static void deallocate_partial_stack(struct process* pcb, void* stack_base, void* failed_addr) {
+  lock_acquire(&pcb->pagedir_lock);
   for (void* addr = stack_base; addr < failed_addr; addr += PGSIZE) {
     void* kpage = pagedir_get_page(pcb->pagedir, addr);
     if (kpage != NULL) {
       pagedir_clear_page(pcb->pagedir, addr); /* Unmap from page directory */
       palloc_free_page(kpage);                /* Free physical page */
     }
+#ifdef VM
+    page_remove(&pcb->pages, addr); /* Forget any copy in swap */
+#endif
   }
+  lock_release(&pcb->pagedir_lock);
 }
 
-UNUSED bool user_thread_allocate_stack(struct process* pcb, int user_thread_index, void** esp) {
-  // Calculate stack base: Main thread at index 0, user threads at index 1+
-  void* stack_base =
-      (void*)(PHYS_BASE - (user_thread_index + 1) * (THREAD_STACK_SIZE + GUARD_PAGE_SIZE));
+/* Maps a page at the top of user stack STACK_SLOT of PCB and
+   stores the initial stack pointer into *ESP.  Like the main
+   thread's stack in setup_stack(), only the top page is mapped;
+   the rest of the slot stays reserved for the stack.  Returns true
+   if successful, false if memory allocation fails. */
+static bool user_thread_allocate_stack(struct process* pcb, int stack_slot, void** esp) {
+  uint8_t* upage = stack_slot_top(stack_slot) - PGSIZE;
+
+  /* After fork(), the slot may still hold a copy of the stack of a
+     thread that did not carry over into this process.  Reuse it. */
+#ifdef VM
+  bool success;
 
-  // Allocate physical pages for the stack
-  void* current_addr = stack_base;
-  for (; current_addr < stack_base + THREAD_STACK_SIZE; current_addr += PGSIZE) {
-    void* kpage = palloc_get_page(PAL_USER);
-    if (kpage == NULL) {
-      // Cleanup: unmap and free all previously allocated pages
-      deallocate_partial_stack(pcb, stack_base, current_addr);
+  lock_acquire(&pcb->pagedir_lock);
+  (void)page_add_file(&pcb->pages, upage, NULL, 0, 0, true); /* Fails if already there */
+  success = load_page(pcb, upage, true, NULL);
+  lock_release(&pcb->pagedir_lock);
+  if (!success)
+    return false;
+#else
+  if (pagedir_get_page(pcb->pagedir, upage) == NULL) {
+    void* kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+    if (kpage == NULL)
       return false;
-    }
-
-    if (!pagedir_set_page(pcb->pagedir, current_addr, kpage, true)) {
-      palloc_free_page(kpage); // Free the page we just allocated
-      deallocate_partial_stack(pcb, stack_base, current_addr);
+    if (!pagedir_set_page(pcb->pagedir, upage, kpage, true)) {
+      palloc_free_page(kpage);
       return false;
     }
   }
+#endif
 
-  // Do NOT map the guard page - leave it unmapped for overflow detection
-
-  *esp = stack_base + THREAD_STACK_SIZE; // point esp* to stack top
+  *esp = stack_slot_top(stack_slot);
   return true;
 }
 
+/* Unmaps and frees the pages of user stack STACK_SLOT of PCB,
+   however far the stack grew. */
+static void user_thread_free_stack(struct process* pcb, int stack_slot) {
+  uint8_t* top = stack_slot_top(stack_slot);
+  deallocate_partial_stack(pcb, top - THREAD_STACK_SIZE, top);
+}
+
+/* Returns the entry for thread TID in PCB's u_threads list, or a
+   null pointer if TID is not a thread of PCB.  The caller must
+   hold PCB's u_threads_lock. */
+static struct user_thread_info* user_thread_find(struct process* pcb, tid_t tid) {
+  struct list_elem* e;
+
+  for (e = list_begin(&pcb->u_threads); e != list_end(&pcb->u_threads); e = list_next(e)) {
+    struct user_thread_info* info = list_entry(e, struct user_thread_info, elem);
+    if (info->tid == tid)
+      return info;
+  }
+  return NULL;
+}
+
+/* Kills every thread of PCB except the running one, which is left
+   as the process's only thread.  If another thread is already
+   doing this, exits the running thread instead.
+
+   A thread that holds a lock may be in the middle of updating
+   shared kernel state, such as the file system, so it cannot just
+   be discarded.  Such threads are given time to let go of their
+   locks, or to notice at their next system call that the process
+   is exiting and exit themselves. */
+static void process_kill_threads(struct process* pcb) {
+  struct thread* cur = thread_current();
+
+  lock_acquire(&pcb->u_threads_lock);
+  if (pcb->exiting)
+    user_thread_exit(pcb);
+  pcb->exiting = true;
+
+  for (;;) {
+    bool busy = false;
+    enum intr_level old_level = intr_disable();
+    struct list_elem* e;
+
+    for (e = list_begin(&pcb->u_threads); e != list_end(&pcb->u_threads); e = list_next(e)) {
+      struct user_thread_info* info = list_entry(e, struct user_thread_info, elem);
+      struct thread* t;
+
+      if (info->has_exited || info->tid == cur->tid)
+        continue;
+      t = thread_get_by_tid(info->tid);
+      ASSERT(t != NULL);
+      if (t->lock_cnt > 0) {
+        busy = true;
+        continue;
+      }
+      thread_discard(t);
+      info->has_exited = true;
+    }
+    intr_set_level(old_level);
+
+    if (!busy)
+      break;
+    lock_release(&pcb->u_threads_lock);
+    timer_sleep(1);
+    lock_acquire(&pcb->u_threads_lock);
+  }
+
+  lock_release(&pcb->u_threads_lock);
+}
+
 /* Returns true if t is the main thread of the process p */
 bool is_main_thread(struct thread* t, struct process* p) { return p->main_thread == t; }
 
 /* Gets the PID of a process */
-pid_t get_pid(struct process* p) { return (pid_t)p->main_thread->tid; }
-
-/* Creates a new stack for the thread and sets up its arguments.
-   Stores the thread's entry point into *EIP and its initial stack
-   pointer into *ESP. Handles all cleanup if unsuccessful. Returns
-   true if successful, false otherwise.
+pid_t get_pid(struct process* p) { return (pid_t)p->main_info.tid; }
+
+/* Pushes the arguments for the _pthread_start_stub() call that
+   starts a user thread, TF and ARG, and a null return address
+   onto the stack whose top *ESP points to, and updates *ESP.  The
+   arguments end up 16-byte aligned, as the i386 ABI expects at
+   function entry.  The stack must be in the active page
+   directory. */
+static void load_args_user_thread(pthread_fun tf, void* arg, void** esp) {
+  uint32_t* sp = (uint32_t*)((uint8_t*)*esp - 20);
+
+  sp[0] = 0;
+  sp[1] = (uint32_t)tf;
+  sp[2] = (uint32_t)arg;
+  *esp = sp;
+}
 
-   This function will be implemented in Project 2: Multithreading. For
-   now, it does nothing. You may find it necessary to change the
-   function signature. */
-bool setup_thread(void (**eip)(void) UNUSED, void** esp UNUSED) { return false; }
+/* Initializes IF_ to enter user mode at FUN with stack pointer ESP. */
+static void user_thread_setup_intr_frame(void* esp, stub_fun fun, struct intr_frame* if_) {
+  memset(if_, 0, sizeof *if_);
+  if_->fs = if_->es = if_->ds = if_->ss = SEL_UDSEG;
+  if_->gs = SEL_UTLS;
+  if_->cs = SEL_UCSEG;
+  if_->eflags = FLAG_IF | FLAG_MBS;
+  if_->eip = (void (*)(void))fun;
+  if_->esp = esp;
+}
 
 /* Starts a new thread with a new user stack running SF, which takes
    TF and ARG as arguments on its user stack. This new thread may be
@@ -1030,93 +2349,82 @@ bool setup_thread(void (**eip)(void) UNUSED, void** esp UNUSED) { return false;
    be created properly.
    */
 tid_t pthread_execute(stub_fun sf, pthread_fun tf, void* arg) {
+  struct process* pcb = thread_current()->pcb;
   struct user_thread_load_info info;
-
-  /* Initialize user thread load info struct */
+  struct user_thread_info* thread_info;
   struct semaphore load_sema;
+  bool load_success = false;
+  tid_t tid = TID_ERROR;
+
   sema_init(&load_sema, 0);
-  bool load_succes = 0;
-  info.load_success = &load_succes;
-  info.load_sema = &load_sema;
-  info.pcb = thread_current()->pcb;
+  info.pcb = pcb;
   info.sfun = sf;
-  info.arg = arg;
   info.tf = tf;
+  info.arg = arg;
+  info.load_sema = &load_sema;
+  info.load_success = &load_success;
 
-  char* standard_user_thread_name = malloc(sizeof(char*));
-  if (standard_user_thread_name == NULL) {
+  /* Holding u_threads_lock until the new thread is on the list
+     keeps it from exiting, or being killed, before then. */
+  lock_acquire(&pcb->u_threads_lock);
+  info.stack_slot = pcb->exiting ? -1 : stack_slot_alloc(pcb);
+  if (info.stack_slot < 0) {
+    lock_release(&pcb->u_threads_lock);
     return TID_ERROR;
   }
-  strlcpy(standard_user_thread_name, "user thread", 12);
 
-  struct lock* u_threads_lock = &thread_current()->pcb->u_threads_lock;
-  lock_acquire(u_threads_lock);
-  info.user_thread_index = list_size(&thread_current()->pcb->u_threads);
-
-  tid_t tid = thread_create(standard_user_thread_name, PRI_DEFAULT, start_pthread, &info);
-  if (tid == TID_ERROR) {
-    free(standard_user_thread_name);
-    return TID_ERROR;
+  thread_info = user_thread_info_create(TID_ERROR, info.stack_slot);
+  if (thread_info != NULL)
+    tid = thread_create(pcb->process_name, PRI_DEFAULT, start_pthread, &info);
+  if (tid != TID_ERROR) {
+    sema_set_owner(&load_sema, tid);
+    sema_down(&load_sema);
   }
 
-  sema_down(&load_sema);
-
-  if (!load_succes) {
-    lock_release(u_threads_lock);
-    free(standard_user_thread_name);
-    return TID_ERROR;
-  }
-  struct user_thread_info* user_thread_info = user_thread_info_create(tid);
-  if (user_thread_info == NULL) {
-    lock_release(u_threads_lock);
-    free(standard_user_thread_name);
+  if (!load_success) {
+    stack_slot_mark(pcb, info.stack_slot, false);
+    kmem_cache_free(thread_info_cache, thread_info);
+    lock_release(&pcb->u_threads_lock);
     return TID_ERROR;
   }
 
-  list_push_back(&thread_current()->pcb->u_threads, &user_thread_info->elem);
-  lock_release(u_threads_lock);
-
+  thread_info->tid = tid;
+  list_push_back(&pcb->u_threads, &thread_info->elem);
+  pcb->thread_cnt++;
+  lock_release(&pcb->u_threads_lock);
   return tid;
 }
 
-static void user_thread_setup_intr_frame(UNUSED void** esp, UNUSED stub_fun fun,
-                                         UNUSED struct intr_frame* if_) {
-  // Setup interrupt frame
-}
-
-static void load_args_user_thread(UNUSED pthread_fun tf, UNUSED void** esp) {
-  // Push tf and args on stack
-}
-
 /* A thread function that creates a new user thread and starts it
-   running. Responsible for adding itself to the list of threads in
-   the PCB.
+   running.  pthread_execute() adds it to the list of threads in
+   the PCB once it knows that the thread started. */
+static void start_pthread(void* load_info_) {
+  struct user_thread_load_info* load_info = load_info_;
+  struct thread* t = thread_current();
+  struct intr_frame if_;
+  void* esp;
+  bool success;
 
-   This function will be implemented in Project 2: Multithreading and
-   should be similar to start_process (). For now, it does nothing. */
-static void start_pthread(void* info) {
-  struct user_thread_load_info* user_thread_load_info = info;
-  ASSERT(user_thread_load_info != NULL);
+  t->pcb = load_info->pcb;
+  process_activate();
 
-  thread_current()->pcb = user_thread_load_info->pcb;
+  success = user_thread_allocate_stack(t->pcb, load_info->stack_slot, &esp);
+  if (success) {
+    load_args_user_thread(load_info->tf, load_info->arg, &esp);
+    user_thread_setup_intr_frame(esp, load_info->sfun, &if_);
+  }
 
-  void* esp;
+  /* LOAD_INFO is on the creating thread's stack, which may be gone
+     once we signal it. */
+  *load_info->load_success = success;
+  sema_up(load_info->load_sema);
 
-  bool stack_allocate_success = user_thread_allocate_stack(
-      thread_current()->pcb, user_thread_load_info->user_thread_index, &esp);
-  if (!stack_allocate_success) {
-    user_thread_load_info->load_success = false;
-    sema_up(user_thread_load_info->load_sema);
+  if (!success) {
+    t->pcb = NULL;
     thread_exit();
   }
 
-  load_args_user_thread(user_thread_load_info->tf, &esp);
-  sema_up(user_thread_load_info->load_sema);
-
-  struct intr_frame if_;
-  user_thread_setup_intr_frame(&esp, user_thread_load_info->sfun, &if_);
-
-  /* Start the user process by simulating a return from an
+  /* Start the user thread by simulating a return from an
      interrupt, implemented by intr_exit (in
      threads/intr-stubs.S).  Because intr_exit takes all of its
      arguments on the stack in the form of a `struct intr_frame',
@@ -1129,29 +2437,96 @@ static void start_pthread(void* info) {
 /* Waits for thread with TID to die, if that thread was spawned
    in the same process and has not been waited on yet. Returns TID on
    success and returns TID_ERROR on failure immediately, without
-   waiting.
+   waiting. */
+tid_t pthread_join(tid_t tid) {
+  struct thread* cur = thread_current();
+  struct process* pcb = cur->pcb;
+  struct user_thread_info* info;
+
+  lock_acquire(&pcb->u_threads_lock);
+  info = user_thread_find(pcb, tid);
+  if (info == NULL || tid == cur->tid || info->has_joined) {
+    lock_release(&pcb->u_threads_lock);
+    return TID_ERROR;
+  }
+  info->has_joined = true;
+  info->joiner_tid = cur->tid;
+  lock_release(&pcb->u_threads_lock);
+
+  sema_set_owner(&info->exit_sema, tid);
+  sema_down(&info->exit_sema);
+
+  /* Nobody else may join TID, so its entry can go, except for the
+     main thread's, which lives in the PCB. */
+  if (info != &pcb->main_info) {
+    lock_acquire(&pcb->u_threads_lock);
+    list_remove(&info->elem);
+    lock_release(&pcb->u_threads_lock);
+    kmem_cache_free(thread_info_cache, info);
+  }
+  return tid;
+}
+
+/* Exits the running thread, one of PCB's, whose u_threads_lock it
+   must hold: frees its user stack and wakes any thread joining
+   it. */
+static void user_thread_exit(struct process* pcb) {
+  struct thread* cur = thread_current();
+  struct user_thread_info* info = user_thread_find(pcb, cur->tid);
 
-   This function will be implemented in Project 2: Multithreading. For
-   now, it does nothing. */
-tid_t pthread_join(tid_t tid UNUSED) { return -1; }
+  ASSERT(info != NULL);
+  ASSERT(lock_held_by_current_thread(&pcb->u_threads_lock));
+
+  user_thread_free_stack(pcb, info->stack_slot);
+  stack_slot_mark(pcb, info->stack_slot, false);
+  if (info != &pcb->main_info) {
+    pcb->thread_cnt--;
+    cond_broadcast(&pcb->threads_exited, &pcb->u_threads_lock);
+  }
+  info->has_exited = true;
+  sema_up(&info->exit_sema);
+
+  /* Once the lock is released, process_exit() may hand PCB to
+     reap_wq, which frees it.  Drop our reference to it first, and
+     keep interrupts off until we are gone so that it cannot run in
+     between. */
+  intr_disable();
+  cur->pcb = NULL;
+  lock_release(&pcb->u_threads_lock);
+  thread_exit();
+}
 
 /* Free the current thread's resources. Most resources will
    be freed on thread_exit(), so all we have to do is deallocate the
    thread's userspace stack. Wake any waiters on this thread.
 
    The main thread should not use this function. See
-   pthread_exit_main() below.
+   pthread_exit_main() below. */
+void pthread_exit(void) {
+  struct process* pcb = thread_current()->pcb;
 
-   This function will be implemented in Project 2: Multithreading. For
-   now, it does nothing. */
-void pthread_exit(void) {}
+  lock_acquire(&pcb->u_threads_lock);
+  user_thread_exit(pcb);
+}
 
 /* Only to be used when the main thread explicitly calls pthread_exit.
    The main thread should wait on all threads in the process to
    terminate properly, before exiting itself. When it exits itself, it
    must terminate the process in addition to all necessary duties in
-   pthread_exit.
-
-   This function will be implemented in Project 2: Multithreading. For
-   now, it does nothing. */
-void pthread_exit_main(void) {}
+   pthread_exit. */
+void pthread_exit_main(void) {
+  struct process* pcb = thread_current()->pcb;
+
+  lock_acquire(&pcb->u_threads_lock);
+  if (pcb->exiting)
+    user_thread_exit(pcb);
+
+  /* Wake a thread joining us, but keep our own stack and thread
+     until the others are done. */
+  sema_up(&pcb->main_info.exit_sema);
+  while (pcb->thread_cnt > 0)
+    cond_wait(&pcb->threads_exited, &pcb->u_threads_lock);
+  lock_release(&pcb->u_threads_lock);
+
+  syscall_exit(0);
+}
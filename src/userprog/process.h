@@ -4,6 +4,10 @@
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/interrupt.h"
+#include "threads/workqueue.h"
+#include "devices/block.h"
+#include <hash.h>
+#include <spawn.h>
 #include <stdint.h>
 
 // At most 8MB can be allocated to the stack
@@ -11,6 +15,19 @@
 #define MAX_STACK_PAGES (1 << 11)
 #define MAX_THREADS 127
 
+/* User stack slots.  Slot 0 holds the main thread's stack below
+   PHYS_BASE; each thread created by pthread_execute() takes the
+   lowest free slot below that, so stacks of exited threads are
+   reused. */
+#define STACK_SLOT_CNT (MAX_THREADS + 1)
+#define STACK_SLOT_WORDS ((STACK_SLOT_CNT + 31) / 32)
+
+/* File descriptor table.  Grows by doubling from FD_TABLE_MIN
+   entries up to FD_MAX, as descriptors are used; open() takes
+   the lowest free descriptor. */
+#define FD_TABLE_MIN 32
+#define FD_MAX 1024
+
 /* PIDs and TIDs are the same type. PID should be
    the TID of the main thread of the process */
 typedef tid_t pid_t;
@@ -19,55 +36,112 @@ typedef tid_t pid_t;
 typedef void (*pthread_fun)(void*);
 typedef void (*stub_fun)(pthread_fun, void*);
 
+/* Track process' user threads completion, exit and joining state */
+struct user_thread_info {
+  tid_t tid;                  /* Thread id of mapped kernel thread */
+  int exit_value;             /* The value that the target thread supplied to pthread_exit(3) */
+  struct semaphore exit_sema; /* Signaled when thread exits */
+  bool has_exited;            /* Thread completion status */
+  bool has_joined;            /* Has someone already joined this thread? */
+  tid_t joiner_tid;           /* Which thread is joining (for debugging) */
+  int stack_slot;             /* User stack slot owned by the thread */
+  struct list_elem elem;      /* For PCB's user_threads list */
+};
+
 /* The process control block for a given process. Since
    there can be multiple threads per process, we need a separate
    PCB from the TCB. All TCBs in a process will have a pointer
    to the PCB, and the PCB will have a pointer to the main thread
-   of the process, which is `special`. */
+   of the process, which is `special`.
+
+   Members used by page faults, by system calls on descriptors and
+   by the scheduler come first, so that they share a few cache
+   lines; the large tables and statistics come last. */
 struct process {
   /* Owned by process.c. */
   uint32_t* pagedir;            /* Page directory. */
+  struct lock pagedir_lock;     /* Serializes fork() and page faults */
+  struct file** files;          /* Open files, indexed by file descriptor, or null */
+  uint32_t* fd_map;             /* Bitmap of file descriptors in use */
+  int fd_cap;                   /* Entries in files, a multiple of 32 */
+  struct lock files_lock;       /* Protects files, fd_map and fd_cap */
+  struct cpu_quota cpu_quota;   /* Share of the CPU it may use (thread.c). */
+#ifdef VM
+  struct hash pages;    /* Supplemental page table, valid while pagedir is nonnull */
+  struct list mappings; /* File mappings (vm/mmap.c), valid while pagedir is nonnull */
+  int next_mapid;       /* Identifier for the next file mapping */
+  unsigned ws_sweep;    /* Latest working set sweep that saw a page in use (vm/frame.c) */
+  uint32_t ws_pages;    /* Pages that sweep saw in use */
+  int evict_priority;   /* EVICT_PRI_* from set_evict_priority(), inherited by fork() */
+#endif
+  uint8_t* heap_start;          /* Start of the heap, after the executable's segments */
+  uint8_t* heap_brk;            /* End of the heap, moved by sbrk() */
+  struct dir* cwd;              /* Current directory, which relative names start from */
+  struct io_quota io_quota;     /* Block I/O rate it may use (block.c). */
   char process_name[16];        /* Name of the main thread */
   struct thread* main_thread;   /* Pointer to main thread */
-  struct list children;         /* List of child_info for direct children */
-  struct lock children_lock;    /* Protects children list */
+  struct hash children;         /* child_info for children not yet waited for, by pid */
+  struct list exited_children;  /* Those of them that have exited, oldest first */
+  int unwaited_cnt;             /* Children that no thread is waiting for yet */
+  struct lock children_lock;    /* Protects the above and their child_info */
   struct process* parent_pcb;   /* Parent thread, NULL if no parent */
+  struct child_info* as_child;  /* Parent's record of us, NULL if no parent */
   int exit_status;              /* Process' exit status */
-  struct list open_files;       /* List of open file descriptors for this process */
-  int next_fd;                  /* Next available file descriptor number */
   struct file* executable_file; /* Pointer to process's executable file (for write protection) */
+  struct file* library_file;    /* Shared library it maps, or NULL (for write protection) */
   struct list u_threads;        /* List of user_thread_info for process's user threads */
   struct lock u_threads_lock;   /* Protects operations on u_thread */
+  struct user_thread_info main_info;      /* Main thread's entry in u_threads */
+  uint32_t stack_slots[STACK_SLOT_WORDS]; /* Bitmap of user stack slots in use */
+  int thread_cnt;                         /* Non-main threads that have not exited */
+  struct condition threads_exited;        /* Signaled when thread_cnt drops */
+  bool exiting;                           /* process_exit() is killing our threads */
+  const char* console_tag;      /* Prefix for lines of console output, or null */
+  struct console_line* console_line; /* Tagged output not yet ended by a newline */
+  struct condition child_exited; /* Signaled when a child exits, with children_lock */
+  struct work reap_work;        /* Teardown, queued on reap_wq (process.c). */
+  struct rusage usage;          /* Resources used, for getrusage(). */
+  struct syscall_stats syscalls; /* System calls made, for syscall_stats(). */
 };
 
 /* New structure for tracking child processes */
 struct child_info {
-  pid_t pid;                  /* Child's process ID */
-  int exit_status;            /* Child's exit status (-1 if killed by kernel) */
-  bool has_exited;            /* True if child has called process_exit() */
-  bool has_been_waited;       /* True if parent has already waited for this child */
-  struct semaphore exit_sema; /* Signaled when child exits */
-  struct list_elem elem;      /* List element for parent's children list */
-  struct process* pcb;        /* Direct pointer to child's process structure */
-};
-
-/* Track process' user threads completion, exit and joining state */
-struct user_thread_info {
-  tid_t tid;                  /* Thread id of mapped kernel thread */
-  int exit_value;             /* The value that the target thread supplied to pthread_exit(3) */
-  struct semaphore exit_sema; /* Signaled when thread exits */
-  bool has_exited;            /* Thread completion status */
-  bool has_joined;            /* Has someone already joined this thread? */
-  tid_t joiner_tid;           /* Which thread is joining (for debugging) */
-  struct list_elem elem;      /* For PCB's user_threads list */
+  pid_t pid;                    /* Child's process ID */
+  int exit_status;              /* Child's exit status (-1 if killed by kernel) */
+  bool has_exited;              /* True if child has called process_exit() */
+  bool has_been_waited;         /* True if parent has already waited for this child */
+  struct semaphore exit_sema;   /* Signaled when child exits */
+  struct hash_elem elem;        /* Element in parent's children hash */
+  struct list_elem exited_elem; /* Element in parent's exited_children list */
+  struct process* pcb;          /* Direct pointer to child's process structure */
 };
 
 void userprog_init(void);
 
 pid_t process_execute(const char* file_name);
+pid_t process_spawn(const char* cmd_line, const struct spawn_fd* fds, size_t fd_cnt);
+pid_t process_spawn_page(char* args, const struct spawn_fd* fds, size_t fd_cnt);
+pid_t process_spawn_args(char* args, size_t len, int argc, const struct spawn_fd* fds,
+                         size_t fd_cnt);
+bool process_args_fit(size_t len, int argc);
 int process_wait(pid_t);
+int process_wait_any(pid_t* pid);
 void process_exit(void);
 void process_activate(void);
+void process_set_console_tag(const char* tag);
+void process_console_write(const char* buf, size_t size);
+void process_console_flush(void);
+bool process_break_cow(void* fault_addr);
+bool process_set_tls(void* base);
+bool process_is_stack_addr(const void* uaddr);
+bool process_grow_stack(void* fault_addr, void* esp);
+void* process_sbrk(intptr_t increment);
+#ifdef VM
+bool process_load_page(void* fault_addr, bool write, bool* major);
+bool process_madvise(void* addr, size_t length, int advice);
+bool process_mlock(void* addr, size_t length, bool lock);
+bool process_set_evict_priority(int priority);
+#endif
 
 bool is_main_thread(struct thread*, struct process*);
 pid_t get_pid(struct process*);
@@ -1,188 +1,1299 @@
 #include "userprog/syscall.h"
+#include <dirent.h>
+#include <float.h>
+#include <inttypes.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <ring.h>
 #include <syscall-nr.h>
+#include <time.h>
+#include <uio.h>
+#include "devices/block.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/eventfd.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/fsstat.h"
+#include "filesys/inode.h"
+#include "filesys/pipe.h"
 #include "list.h"
 #include "process.h"
 #include "string.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
+#include "threads/tunable.h"
 #include "threads/malloc.h"
+#include "userprog/futex.h"
 #include "userprog/process.h"
+#include "userprog/uaccess.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/mq.h"
+#include "vm/shm.h"
+#endif
 #include <stdbool.h>
 
 #define MAX_ARGS 4
 #define NUM_BYTES_ARGUMENT_STACK 4
 
 static void syscall_handler(struct intr_frame*);
-struct file_descriptor {
-  int fd;                /* File descriptor number (unique within process) */
-  struct file* file;     /* Pointer to open file from Pintos file system */
-  struct list_elem elem; /* List element for process's open_files list */
+
+/* -sysstat: Print system call statistics at process exit and
+   power off? */
+bool sysstat_enabled;
+
+/* System call statistics for all processes together.  Each
+   process also keeps its own, in its PCB.  Both are updated with
+   interrupts off, because threads of one process may make calls
+   at the same time. */
+static struct syscall_stats global_syscalls;
+
+/* Names of system calls, for printing statistics. */
+static const char* syscall_names[SYSCALL_STAT_CNT] = {
+    [SYS_HALT] = "halt",
+    [SYS_EXIT] = "exit",
+    [SYS_EXEC] = "exec",
+    [SYS_WAIT] = "wait",
+    [SYS_WAIT_ANY] = "wait_any",
+    [SYS_CREATE] = "create",
+    [SYS_REMOVE] = "remove",
+    [SYS_OPEN] = "open",
+    [SYS_FILESIZE] = "filesize",
+    [SYS_READ] = "read",
+    [SYS_WRITE] = "write",
+    [SYS_SEEK] = "seek",
+    [SYS_TELL] = "tell",
+    [SYS_CLOSE] = "close",
+    [SYS_PRACTICE] = "practice",
+    [SYS_COMPUTE_E] = "compute_e",
+    [SYS_PT_CREATE] = "pt_create",
+    [SYS_PT_EXIT] = "pt_exit",
+    [SYS_PT_JOIN] = "pt_join",
+    [SYS_FUTEX_WAIT] = "futex_wait",
+    [SYS_FUTEX_WAKE] = "futex_wake",
+    [SYS_GET_TID] = "get_tid",
+    [SYS_SET_TLS] = "set_tls",
+    [SYS_FORK] = "fork",
+    [SYS_SPAWN] = "spawn",
+    [SYS_SBRK] = "sbrk",
+    [SYS_RING_ENTER] = "ring_enter",
+    [SYS_READV] = "readv",
+    [SYS_WRITEV] = "writev",
+    [SYS_PREAD] = "pread",
+    [SYS_PWRITE] = "pwrite",
+    [SYS_EXEC_ARGV] = "exec_argv",
+    [SYS_COPY_RANGE] = "copy_range",
+    [SYS_SENDFILE] = "sendfile",
+    [SYS_FALLOCATE] = "fallocate",
+    [SYS_POLL] = "poll",
+    [SYS_PIPE] = "pipe",
+    [SYS_MMAP] = "mmap",
+    [SYS_MUNMAP] = "munmap",
+    [SYS_MADVISE] = "madvise",
+    [SYS_SHM_CREATE] = "shm_create",
+    [SYS_SHM_ATTACH] = "shm_attach",
+    [SYS_SHM_DETACH] = "shm_detach",
+    [SYS_MQ_CREATE] = "mq_create",
+    [SYS_MQ_SEND] = "mq_send",
+    [SYS_MQ_RECEIVE] = "mq_receive",
+    [SYS_CHDIR] = "chdir",
+    [SYS_MKDIR] = "mkdir",
+    [SYS_READDIR] = "readdir",
+    [SYS_ISDIR] = "isdir",
+    [SYS_INUMBER] = "inumber",
+    [SYS_FSYNC] = "fsync",
+    [SYS_FDATASYNC] = "fdatasync",
+    [SYS_SYNC] = "sync",
+    [SYS_SCHED_STATS] = "sched_stats",
+    [SYS_GETRUSAGE] = "getrusage",
+    [SYS_FSSTAT] = "fsstat",
+    [SYS_BLKSTAT] = "blkstat",
+    [SYS_SYSCALL_STATS] = "syscall_stats",
+    [SYS_CLOCK_GETTIME] = "clock_gettime",
+    [SYS_SET_DEADLINE] = "set_deadline",
+    [SYS_SET_QUOTA] = "set_quota",
+    [SYS_GETDENTS] = "getdents",
+    [SYS_OPENAT] = "openat",
+    [SYS_CREATEAT] = "createat",
+    [SYS_UNLINKAT] = "unlinkat",
+    [SYS_CLONE_FILE] = "clone_file",
+    [SYS_MLOCK] = "mlock",
+    [SYS_MUNLOCK] = "munlock",
+    [SYS_SET_EVICT_PRIORITY] = "set_evict_priority",
+    [SYS_EVENTFD] = "eventfd",
+    [SYS_TIMERFD_CREATE] = "timerfd_create",
+    [SYS_TIMERFD_SETTIME] = "timerfd_settime",
+    [SYS_SYSCTL] = "sysctl",
+    [SYS_SCHED_YIELD_TO] = "sched_yield_to",
+    [SYS_FUTEX_WAKE_ALL] = "futex_wake_all",
 };
-struct file_descriptor*
-find_file_descriptor(int fd); // Find file_descriptor in current process's open_files list
-int init_file_descriptor(
-    struct process* pcb,
-    struct file* file); // Create new file descriptor, add to process's file table, return fd number
-void destroy_file_descriptor(
-    struct file_descriptor* fd_entry); // Remove file descriptor from table and free memory
-struct lock filesys_lock;
-
-struct file_descriptor* find_file_descriptor(int fd) {
-  if (fd < FIRST_FILE_FD) {
+
+/* File descriptor tables.  Each process's open files are in an
+   array indexed by descriptor, so finding one takes constant
+   time, and a bitmap of the descriptors in use, in which open()
+   finds the lowest free one a word at a time.  Descriptors below
+   FIRST_FILE_FD are marked in use so that they are never handed
+   out.  They have no file unless spawn() put one there, in which
+   case it replaces the keyboard or the console.  Protected by the
+   process's files_lock. */
+
+/* Returns the file open as descriptor FD in PCB, or a null
+   pointer if FD is not open. */
+static struct file* fd_lookup(struct process* pcb, int fd) {
+  if (fd < 0 || fd >= pcb->fd_cap)
     return NULL;
+  return pcb->files[fd];
+}
+
+/* Grows PCB's file descriptor table to at least FD + 1 entries.
+   Returns false if FD is FD_MAX or more or memory allocation
+   fails. */
+static bool fd_table_grow(struct process* pcb, int fd) {
+  int cap = pcb->fd_cap > 0 ? pcb->fd_cap : FD_TABLE_MIN;
+  struct file** files;
+  uint32_t* map;
+
+  if (fd < 0 || fd >= FD_MAX)
+    return false;
+  while (cap <= fd)
+    cap *= 2;
+  if (cap > FD_MAX)
+    cap = FD_MAX;
+
+  /* If the second allocation fails, the larger FILES does no
+     harm, so keep it. */
+  files = realloc(pcb->files, cap * sizeof *files);
+  if (files == NULL)
+    return false;
+  pcb->files = files;
+  map = realloc(pcb->fd_map, cap / 32 * sizeof *map);
+  if (map == NULL)
+    return false;
+  pcb->fd_map = map;
+
+  memset(files + pcb->fd_cap, 0, (cap - pcb->fd_cap) * sizeof *files);
+  memset(map + pcb->fd_cap / 32, 0, (cap - pcb->fd_cap) / 32 * sizeof *map);
+  if (pcb->fd_cap == 0)
+    map[0] = (1u << FIRST_FILE_FD) - 1;
+  pcb->fd_cap = cap;
+  return true;
+}
+
+/* Makes FILE open as descriptor FD in PCB, where FD must not be
+   open yet.  Returns false if the table cannot grow to hold FD. */
+static bool fd_install_at(struct process* pcb, int fd, struct file* file) {
+  if (fd >= pcb->fd_cap && !fd_table_grow(pcb, fd))
+    return false;
+  ASSERT(fd >= 0 && pcb->files[fd] == NULL);
+  pcb->files[fd] = file;
+  pcb->fd_map[fd / 32] |= 1u << (fd % 32);
+  return true;
+}
+
+/* Makes FILE open in PCB as the lowest free descriptor and
+   returns the descriptor, or -1 if the table is full or memory
+   allocation fails. */
+static int fd_install(struct process* pcb, struct file* file) {
+  int words = pcb->fd_cap / 32;
+  int fd;
+  int i;
+
+  for (i = 0; i < words && pcb->fd_map[i] == UINT32_MAX; i++)
+    continue;
+  if (i < words)
+    fd = i * 32 + __builtin_ctz(~pcb->fd_map[i]);
+  else
+    fd = pcb->fd_cap > FIRST_FILE_FD ? pcb->fd_cap : FIRST_FILE_FD;
+  return fd_install_at(pcb, fd, file) ? fd : -1;
+}
+
+/* Closes descriptor FD in PCB, which must be open, and returns
+   its file, which the caller must close. */
+static struct file* fd_remove(struct process* pcb, int fd) {
+  struct file* file = fd_lookup(pcb, fd);
+
+  ASSERT(file != NULL);
+  pcb->files[fd] = NULL;
+  if (fd >= FIRST_FILE_FD)
+    pcb->fd_map[fd / 32] &= ~(1u << (fd % 32));
+  return file;
+}
+
+void destroy_file_descriptor_table(struct process* pcb) {
+  int fd;
+
+  lock_acquire(&pcb->files_lock);
+  for (fd = 0; fd < pcb->fd_cap; fd++) {
+    if (pcb->files[fd] != NULL) {
+      file_close(pcb->files[fd]);
+      thread_yield_if_needed();
+    }
   }
+  free(pcb->files);
+  free(pcb->fd_map);
+  pcb->files = NULL;
+  pcb->fd_map = NULL;
+  pcb->fd_cap = 0;
+  lock_release(&pcb->files_lock);
+}
+
+/* File system calls hold no file system lock while they touch
+   user memory, where a page fault may have to read the page in
+   from a file.  Instead, data and file names go through a kernel
+   page, copied to and from user memory with the accessors in
+   uaccess.c.  They report a bad user address as an error, after
+   which the call gives back what it holds before it kills the
+   process. */
 
+/* Returns a new reference to the file open as descriptor FD in
+   the current process, or a null pointer if FD is not open.  The
+   file stays usable even if another thread closes FD meanwhile.
+   The caller must close it. */
+static struct file* get_file(int fd) {
   struct process* pcb = thread_current()->pcb;
+  struct file* file;
 
-  struct list_elem* e;
-  for (e = list_begin(&pcb->open_files); e != list_end(&pcb->open_files); e = list_next(e)) {
-    struct file_descriptor* file_descriptor = list_entry(e, struct file_descriptor, elem);
-    if (file_descriptor != NULL && file_descriptor->fd == fd) {
-      return file_descriptor;
-    }
+  lock_acquire(&pcb->files_lock);
+  file = fd_lookup(pcb, fd);
+  file_ref(file);
+  lock_release(&pcb->files_lock);
+  return file;
+}
+
+/* Like get_file(), but returns a null pointer if FD is a pipe or
+   an event counter, which has no inode to size, seek in, copy or
+   map, or a directory, whose data only the directory module may
+   change. */
+static struct file* get_inode_file(int fd) {
+  struct file* file = get_file(fd);
+
+  if (file != NULL && (file_is_stream(file) || file_is_dir(file))) {
+    file_close(file);
+    return NULL;
   }
-  return NULL;
+  return file;
 }
 
-void destroy_file_descriptor_table(struct process* pcb) {
-  lock_acquire(&filesys_lock);
-  while (!list_empty(&pcb->open_files)) {
-    struct list_elem* e = list_pop_back(&pcb->open_files);
-    struct file_descriptor* file_descriptor = list_entry(e, struct file_descriptor, elem);
-    file_close(file_descriptor->file);
-    free(file_descriptor);
+/* Counts a call to system call NR by process PCB. */
+static void syscall_count(struct process* pcb, uint32_t nr) {
+  enum intr_level old_level;
+
+  if (nr >= SYSCALL_STAT_CNT)
+    return;
+  old_level = intr_disable();
+  pcb->syscalls.calls[nr].cnt++;
+  global_syscalls.calls[nr].cnt++;
+  intr_set_level(old_level);
+}
+
+/* Longest file name or command line recorded in the trace. */
+#define TRACE_STR_MAX 64
+
+/* Records the arguments of the system call at ARGS in the trace,
+   and the file name or command line that it takes, if any, so
+   that `pintos-trace --replay' can reproduce the call.  Bad
+   pointers are recorded as zeros, for the call itself to
+   reject. */
+static void trace_syscall_args(const uint32_t* args) {
+  uint32_t arg[3] = {0, 0, 0};
+  char str[TRACE_STR_MAX];
+  int len, i;
+
+  copy_from_user(arg, args + 1, sizeof arg);
+  TRACE(TRACE_SYSCALL_ARGS, arg[0], arg[1]);
+  TRACE(TRACE_SYSCALL_ARG3, arg[2], 0);
+
+  switch (args[0]) {
+    case SYS_EXEC:
+    case SYS_CREATE:
+    case SYS_REMOVE:
+    case SYS_OPEN:
+    case SYS_CHDIR:
+    case SYS_MKDIR:
+      break;
+    default:
+      return;
   }
-  lock_release(&filesys_lock);
+  memset(str, 0, sizeof str);
+  len = strncpy_from_user(str, (const char*)arg[0], sizeof str);
+  for (i = 0; i < len; i += 8) {
+    uint32_t w[2];
+    memcpy(w, str + i, sizeof w);
+    TRACE(TRACE_SYSCALL_STR, w[0], w[1]);
+  }
+}
+
+/* Adds CYCLES to the time stats S has spent in a call. */
+static void syscall_time_one(struct syscall_stat* s, uint64_t cycles) {
+  s->cycles += cycles;
+  if (cycles > s->max_cycles)
+    s->max_cycles = cycles;
+}
+
+/* Records that a call to system call NR by process PCB took
+   CYCLES TSC cycles. */
+static void syscall_time(struct process* pcb, uint32_t nr, uint64_t cycles) {
+  enum intr_level old_level;
+
+  if (nr >= SYSCALL_STAT_CNT)
+    return;
+  old_level = intr_disable();
+  syscall_time_one(&pcb->syscalls.calls[nr], cycles);
+  syscall_time_one(&global_syscalls.calls[nr], cycles);
+  intr_set_level(old_level);
+}
+
+/* Prints the system calls in STATS that were made at least
+   once, under the heading WHO. */
+static void print_syscall_stats(const char* who, const struct syscall_stats* stats) {
+  int nr;
+
+  printf("System calls by %s:\n", who);
+  for (nr = 0; nr < SYSCALL_STAT_CNT; nr++) {
+    const struct syscall_stat* s = &stats->calls[nr];
+    if (s->cnt == 0)
+      continue;
+    if (syscall_names[nr] != NULL)
+      printf("  %-14s", syscall_names[nr]);
+    else
+      printf("  #%-13d", nr);
+    printf(" %8" PRIu64 " calls, %10" PRId64 " us total, %8" PRId64 " us max\n", s->cnt,
+           clock_cycles_to_ns(s->cycles) / 1000, clock_cycles_to_ns(s->max_cycles) / 1000);
+  }
+}
+
+/* Prints the system call statistics of PCB, which is exiting. */
+void syscall_print_process_stats(const struct process* pcb) {
+  print_syscall_stats(pcb->process_name, &pcb->syscalls);
+}
+
+/* Prints system call statistics for all processes, if -sysstat
+   was given. */
+void syscall_print_stats(void) {
+  if (sysstat_enabled)
+    print_syscall_stats("all processes", &global_syscalls);
 }
 
 void syscall_init(void) {
-  lock_init(&filesys_lock);
+  futex_init();
   intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 void syscall_exit(int status) {
+  process_console_flush();
   printf("%s: exit(%d)\n", thread_current()->pcb->process_name, status);
   thread_current()->pcb->exit_status = status;
   process_exit();
 }
 
-static pid_t syscall_exec(char* cmd_line) { return process_execute(cmd_line); }
+/* Computes the first N + 1 terms of the series for e in the
+   kernel and returns the bits of the result as a float.  The
+   FPU may hold the calling thread's own registers, so this uses
+   it only inside fpu_kernel_begin() and fpu_kernel_end(). */
+static int syscall_compute_e(int n) {
+  enum intr_level old_level = fpu_kernel_begin();
+  int e = sys_sum_to_e(n);
+
+  fpu_kernel_end(old_level);
+  return e;
+}
+
+/* Copies user string NAME into a new kernel page and returns it,
+   or returns a null pointer if there is no memory or NAME does
+   not fit.  The caller must free the page.  Kills the process if
+   NAME is not in mapped user memory. */
+static char* copy_in_string(const char* name) {
+  char* kname = palloc_get_page(0);
+  int len;
+
+  if (kname == NULL)
+    return NULL;
+  len = strncpy_from_user(kname, name, PGSIZE);
+  if (len < 0 || len == PGSIZE) {
+    palloc_free_page(kname);
+    if (len < 0)
+      syscall_exit(-1);
+    return NULL;
+  }
+  return kname;
+}
+
+static pid_t syscall_exec(const char* cmd_line) {
+  char* kcmd_line = copy_in_string(cmd_line);
+
+  /* The page that holds the copy becomes the child's arguments. */
+  if (kcmd_line == NULL)
+    return -1;
+  return process_spawn_page(kcmd_line, NULL, 0);
+}
+
+/* Waits for any child of the running process to die, stores its
+   exit status into *STATUS unless STATUS is null, and returns its
+   pid, or -1 if there is no child to wait for. */
+static pid_t syscall_wait_any(int* status) {
+  pid_t pid;
+  int exit_status = process_wait_any(&pid);
+
+  if (pid == TID_ERROR)
+    return -1;
+  if (status != NULL && !copy_to_user(status, &exit_status, sizeof exit_status))
+    syscall_exit(-1);
+  return pid;
+}
+
+/* Like syscall_exec(), but the arguments come already split, in
+   the null-terminated array of user strings ARGV, and are copied
+   straight into the packed form that process_spawn_args() takes. */
+static pid_t syscall_exec_argv(char* const* argv) {
+  char* args = palloc_get_page(0);
+  size_t len = 0;
+  int argc = 0;
+
+  if (args == NULL)
+    return -1;
+  for (;;) {
+    char* arg;
+    int arg_len;
+
+    if (!copy_from_user(&arg, argv + argc, sizeof arg)) {
+      palloc_free_page(args);
+      syscall_exit(-1);
+    }
+    if (arg == NULL)
+      break;
+    arg_len = len < PGSIZE ? strncpy_from_user(args + len, arg, PGSIZE - len) : 0;
+    if (arg_len < 0) {
+      palloc_free_page(args);
+      syscall_exit(-1);
+    }
+    if (len + arg_len >= PGSIZE) {
+      palloc_free_page(args);
+      return -1;
+    }
+    len += arg_len + 1;
+    argc++;
+  }
+  return process_spawn_args(args, len, argc, NULL, 0);
+}
+
+/* Reads or writes, as WRITE says, the CNT user buffers in IOV in
+   turn, as one operation on descriptor FD.  The operation is at
+   offset *OFS, which it advances, if OFS is nonnull, and at the
+   file's position otherwise.  Unless spawn() put a file there,
+   reads from STDIN_FILENO come from the keyboard and writes to
+   STDOUT_FILENO go to the console; neither takes an offset, and
+   neither does a pipe or an event counter.  A read from the
+   keyboard, a pipe or an event counter waits for some data and
+   then returns what is there.  Returns the
+   number of bytes moved, which is short if the end of the file is
+   reached, or -1 if FD is not open for the operation.  Kills the process if a buffer
+   is bad.
+
+   Reads from a file copy straight from the buffer cache to the
+   user buffers.  Everything else goes through a kernel page. */
+static int syscall_io(int fd, const struct iovec* iov, size_t cnt, off_t* ofs, bool write) {
+  struct file* file = NULL;
+  uint8_t* kbuf = NULL;
+  unsigned total = 0;
+  bool fault = false;
+  bool done = false;
+  size_t i;
+
+  file = get_file(fd);
+  if (file == NULL ? fd != (write ? STDOUT_FILENO : STDIN_FILENO) || ofs != NULL
+                   : ofs != NULL && file_is_stream(file)) {
+    file_close(file);
+    return -1;
+  }
+  if (write || file == NULL) {
+    kbuf = palloc_get_page(0);
+    if (kbuf == NULL) {
+      file_close(file);
+      return -1;
+    }
+  }
+
+  for (i = 0; i < cnt && !done; i++) {
+    uint8_t* ubuf = iov[i].iov_base;
+    size_t size = iov[i].iov_len;
+    size_t pos;
+
+    for (pos = 0; pos < size && !done; pos += PGSIZE) {
+      unsigned chunk = size - pos < PGSIZE ? size - pos : PGSIZE;
+      unsigned moved = chunk;
+
+      if (write) {
+        fault = !copy_from_user(kbuf, ubuf + pos, chunk);
+        if (fault)
+          break;
+        if (file == NULL)
+          process_console_write((const char*)kbuf, chunk);
+        else if (ofs != NULL)
+          moved = file_write_at(file, kbuf, chunk, *ofs);
+        else
+          moved = file_write(file, kbuf, chunk);
+      } else if (file == NULL) {
+        moved = input_getbuf(kbuf, chunk);
+        fault = !copy_to_user(ubuf + pos, kbuf, moved);
+        if (fault)
+          break;
+      } else {
+        off_t n = (ofs != NULL ? file_read_at_copy(file, ubuf + pos, chunk, *ofs, copy_to_user)
+                               : file_read_copy(file, ubuf + pos, chunk, copy_to_user));
+        fault = n < 0;
+        if (fault)
+          break;
+        moved = n;
+      }
+
+      total += moved;
+      if (ofs != NULL)
+        *ofs += moved;
+      done = moved < chunk;
+    }
+    if (fault)
+      break;
+  }
+
+  palloc_free_page(kbuf);
+  file_close(file);
+  if (fault)
+    syscall_exit(-1);
+  return total;
+}
+
+static int syscall_write(int fd, const void* buffer, unsigned size) {
+  struct iovec iov = {(void*)buffer, size};
 
-static int syscall_write(int fd, void* buffer, unsigned size) {
   if (size <= 0) {
     return 0;
   }
-  if (fd == STDIN_FILENO) {
+  return syscall_io(fd, &iov, 1, NULL, true);
+}
+
+static int syscall_read(int fd, void* buffer, unsigned size) {
+  struct iovec iov = {buffer, size};
+  return syscall_io(fd, &iov, 1, NULL, false);
+}
+
+/* Reads or writes SIZE bytes at BUFFER at offset OFS in the file
+   open as FD, without using or moving the file's position. */
+static int syscall_pio(int fd, void* buffer, unsigned size, off_t ofs, bool write) {
+  struct iovec iov = {buffer, size};
+
+  if (ofs < 0) {
+    return -1;
+  }
+  return syscall_io(fd, &iov, 1, &ofs, write);
+}
+
+/* Reads or writes the CNT buffers in user array IOV in turn. */
+static int syscall_iov(int fd, const struct iovec* iov, size_t cnt, bool write) {
+  struct iovec kiov[IOV_MAX];
+
+  if (cnt > IOV_MAX) {
     return -1;
   }
-  if (fd == STDOUT_FILENO) {
-    /* Write number of size character of buffer to STDOUT */
-    putbuf(buffer, size);
-    return size;
+  if (!copy_from_user(kiov, iov, cnt * sizeof *iov)) {
+    syscall_exit(-1);
+  }
+  return syscall_io(fd, kiov, cnt, NULL, write);
+}
+
+/* Sets the REVENTS of each of the CNT descriptors in FDS to the
+   events in its EVENTS that are ready now, or to POLLNVAL if its
+   descriptor is not open, and returns the number of descriptors
+   with nonzero REVENTS.  Sets *MAY_CHANGE to true if one of them
+   that is not ready is the keyboard, a pipe or an event counter,
+   which may become ready later. */
+static int poll_scan(struct pollfd* fds, size_t cnt, bool* may_change) {
+  int ready = 0;
+  size_t i;
+
+  *may_change = false;
+  for (i = 0; i < cnt; i++) {
+    struct pollfd* p = &fds[i];
+    struct file* file;
+
+    p->revents = 0;
+    if (p->fd < 0)
+      continue;
+    file = get_file(p->fd);
+    if (file != NULL) {
+      p->revents = file_poll(file, p->events);
+      if (p->revents == 0 && file_is_stream(file))
+        *may_change = true;
+      file_close(file);
+    } else if (p->fd == STDIN_FILENO) {
+      if (p->events & POLLIN) {
+        if (input_ready())
+          p->revents = POLLIN;
+        else
+          *may_change = true;
+      }
+    } else if (p->fd == STDOUT_FILENO)
+      p->revents = p->events & POLLOUT;
+    else
+      p->revents = POLLNVAL;
+    if (p->revents != 0)
+      ready++;
   }
-  struct file_descriptor* file_descriptor = find_file_descriptor(fd);
-  if (file_descriptor == NULL) {
+  return ready;
+}
+
+/* Waits until one of the CNT descriptors in UFDS is ready for the
+   events it asks for, or until TIMEOUT milliseconds pass.  A
+   negative TIMEOUT has no limit and 0 does not wait.  Stores the
+   ready events into UFDS and returns the number of descriptors
+   with any, which is 0 on timeout, or -1 if CNT is over POLL_MAX.
+   Only the keyboard, pipes and event counters can become ready
+   later, so if no descriptor waits for one and none is ready,
+   sleeps out TIMEOUT or, if it has no limit, returns 0 at once
+   instead of sleeping forever.  Kills the process if UFDS is bad.
+
+   Everything that can make a descriptor ready advances io_events,
+   so sleeping until it moves past the value read before the scan
+   cannot miss a change. */
+static int syscall_poll(struct pollfd* ufds, size_t cnt, int timeout) {
+  struct pollfd fds[POLL_MAX];
+  int64_t deadline = 0;
+  bool may_change;
+  int ready;
+
+  if (cnt > POLL_MAX) {
     return -1;
   }
-  return file_write(file_descriptor->file, buffer, size);
+  if (!copy_from_user(fds, ufds, cnt * sizeof *fds)) {
+    syscall_exit(-1);
+  }
+  if (timeout > 0)
+    deadline = timer_ticks() + DIV_ROUND_UP((int64_t)timeout * TIMER_FREQ, 1000);
+
+  for (;;) {
+    int64_t left = timeout < 0 ? -1 : deadline - timer_ticks();
+    unsigned seen = eventcount_read(&io_events);
+
+    ready = poll_scan(fds, cnt, &may_change);
+    if (ready > 0 || (timeout >= 0 && left <= 0))
+      break;
+    if (may_change)
+      eventcount_await(&io_events, seen, left);
+    else if (timeout > 0)
+      timer_sleep(left);
+    else
+      break;
+  }
+
+  if (!copy_to_user(ufds, fds, cnt * sizeof *fds)) {
+    syscall_exit(-1);
+  }
+  return ready;
 }
 
-static bool syscall_create(char* file, unsigned initial_size) {
-  return filesys_create(file, initial_size);
+/* Returns the directory that DIRFD names for one of the *at()
+   calls: the current directory for AT_FDCWD, or else the
+   directory open as DIRFD.  Returns a null pointer if DIRFD is
+   not open as a directory.  Release it with put_at_dir(). */
+static struct dir* get_at_dir(int dirfd) {
+  struct file* file;
+  struct dir* dir = NULL;
+
+  if (dirfd == AT_FDCWD)
+    return thread_current()->pcb->cwd;
+  file = get_file(dirfd);
+  if (file != NULL && file_is_dir(file))
+    dir = dir_open(inode_reopen(file_get_inode(file)));
+  file_close(file);
+  return dir;
 }
 
-static bool syscall_remove(char* file) {
-  if (file == NULL) {
+/* Releases DIR, which get_at_dir() returned. */
+static void put_at_dir(struct dir* dir) {
+  if (dir != thread_current()->pcb->cwd)
+    dir_close(dir);
+}
+
+static bool syscall_createat(int dirfd, const char* file, unsigned initial_size) {
+  char* name = copy_in_string(file);
+  struct dir* dir;
+  bool success;
+
+  if (name == NULL) {
     return false;
   }
-  return filesys_remove(file);
+  dir = get_at_dir(dirfd);
+  success = dir != NULL && filesys_create_at(dir, name, initial_size);
+  put_at_dir(dir);
+  palloc_free_page(name);
+  return success;
 }
 
-static int syscall_open(char* file) {
-  if (file == NULL) {
-    return -1;
+static bool syscall_unlinkat(int dirfd, const char* file) {
+  char* name = copy_in_string(file);
+  struct dir* dir;
+  bool success;
+
+  if (name == NULL) {
+    return false;
+  }
+  dir = get_at_dir(dirfd);
+  success = dir != NULL && filesys_remove_at(dir, name);
+  put_at_dir(dir);
+  palloc_free_page(name);
+  return success;
+}
+
+static bool syscall_clone_file(const char* src, const char* dst) {
+  char* src_name = copy_in_string(src);
+  char* dst_name;
+  bool success;
+
+  if (src_name == NULL) {
+    return false;
+  }
+  dst_name = copy_in_string(dst);
+  if (dst_name == NULL) {
+    palloc_free_page(src_name);
+    return false;
   }
+  success = filesys_clone_at(thread_current()->pcb->cwd, src_name, dst_name);
+  palloc_free_page(dst_name);
+  palloc_free_page(src_name);
+  return success;
+}
 
-  struct file* f = filesys_open(file);
+static int syscall_openat(int dirfd, const char* file) {
+  struct process* pcb = thread_current()->pcb;
+  char* name = copy_in_string(file);
+  struct dir* dir;
+  struct file* f = NULL;
+  int fd;
+
+  if (name == NULL) {
+    return -1;
+  }
+  dir = get_at_dir(dirfd);
+  if (dir != NULL)
+    f = filesys_open_at(dir, name);
+  put_at_dir(dir);
+  palloc_free_page(name);
   if (f == NULL) {
     return -1;
   }
 
-  struct file_descriptor* file_descriptor = malloc(sizeof(struct file_descriptor));
-  if (file_descriptor == NULL) {
+  lock_acquire(&pcb->files_lock);
+  fd = fd_install(pcb, f);
+  lock_release(&pcb->files_lock);
+  if (fd < 0) {
+    file_close(f);
+  }
+  return fd;
+}
+
+/* Creates a pipe and stores descriptors for its read and write
+   ends into UFDS[0] and UFDS[1].  Returns 0 if successful, -1 if
+   memory or descriptors run out.  Kills the process if UFDS is
+   bad. */
+static int syscall_pipe(int* ufds) {
+  struct process* pcb = thread_current()->pcb;
+  struct file* ends[2];
+  int fds[2];
+
+  if (!pipe_open(&ends[0], &ends[1]))
+    return -1;
+
+  lock_acquire(&pcb->files_lock);
+  fds[0] = fd_install(pcb, ends[0]);
+  fds[1] = fds[0] >= 0 ? fd_install(pcb, ends[1]) : -1;
+  if (fds[1] < 0 && fds[0] >= 0)
+    fd_remove(pcb, fds[0]);
+  lock_release(&pcb->files_lock);
+  if (fds[1] < 0) {
+    file_close(ends[0]);
+    file_close(ends[1]);
+    return -1;
+  }
+
+  /* Exiting closes the new descriptors. */
+  if (!copy_to_user(ufds, fds, sizeof fds))
+    syscall_exit(-1);
+  return 0;
+}
+
+/* Creates an event counter that starts at COUNT, or a disarmed
+   timer if TIMER, and returns a descriptor for it, or -1 if
+   memory or descriptors run out. */
+static int syscall_eventfd(unsigned count, bool timer) {
+  struct process* pcb = thread_current()->pcb;
+  struct file* file = eventfd_open(count, timer);
+  int fd;
+
+  if (file == NULL) {
     return -1;
   }
+  lock_acquire(&pcb->files_lock);
+  fd = fd_install(pcb, file);
+  lock_release(&pcb->files_lock);
+  if (fd < 0) {
+    file_close(file);
+  }
+  return fd;
+}
 
-  struct thread* t = thread_current();
-  file_descriptor->fd = t->pcb->next_fd++;
-  file_descriptor->file = f;
+/* Returns time TS in timer ticks, rounded up, or -1 if it is
+   negative or malformed. */
+static int64_t timespec_to_ticks(const struct timespec* ts) {
+  if (ts->tv_sec < 0 || ts->tv_sec > INT32_MAX || ts->tv_nsec < 0 || ts->tv_nsec >= 1000000000) {
+    return -1;
+  }
+  return ts->tv_sec * TIMER_FREQ + DIV_ROUND_UP((int64_t)ts->tv_nsec * TIMER_FREQ, 1000000000);
+}
+
+/* Arms the timer open as FD with the times in user struct USPEC,
+   as eventfd_settime() does.  Returns 0 if successful, -1 if FD
+   is not a timer or USPEC is malformed.  Kills the process if
+   USPEC is bad. */
+static int syscall_timerfd_settime(int fd, const struct itimerspec* uspec) {
+  struct itimerspec spec;
+  struct file* file;
+  int64_t ticks, interval;
+  bool success = false;
+
+  if (!copy_from_user(&spec, uspec, sizeof spec)) {
+    syscall_exit(-1);
+  }
+  ticks = timespec_to_ticks(&spec.it_value);
+  interval = timespec_to_ticks(&spec.it_interval);
+  if (ticks < 0 || interval < 0) {
+    return -1;
+  }
 
-  list_push_back(&t->pcb->open_files, &file_descriptor->elem);
-  return file_descriptor->fd;
+  file = get_file(fd);
+  if (file != NULL && file_get_eventfd(file) != NULL)
+    success = eventfd_settime(file_get_eventfd(file), ticks, interval);
+  file_close(file);
+  return success ? 0 : -1;
 }
 
 static int syscall_filesize(int fd) {
-  struct file_descriptor* file_descriptor = find_file_descriptor(fd);
-  if (file_descriptor == NULL) {
+  struct file* file = get_inode_file(fd);
+  int length;
+
+  if (file == NULL) {
     return -1;
   }
-
-  return file_length(file_descriptor->file);
+  length = file_length(file);
+  file_close(file);
+  return length;
 }
 
 static bool syscall_close(int fd) {
-  struct file_descriptor* file_descriptor = find_file_descriptor(fd);
-  if (file_descriptor == NULL) {
+  struct process* pcb = thread_current()->pcb;
+  struct file* file = NULL;
+
+  lock_acquire(&pcb->files_lock);
+  if (fd_lookup(pcb, fd) != NULL)
+    file = fd_remove(pcb, fd);
+  lock_release(&pcb->files_lock);
+  if (file == NULL) {
     return false;
   }
-  file_close(file_descriptor->file);
-  list_remove(&file_descriptor->elem);
-  free(file_descriptor);
+  file_close(file);
   return true;
 }
 
-static int syscall_read(int fd, void* buffer, unsigned size) {
-  if (fd == STDIN_FILENO) {
-    uint8_t* byte_buffer = (uint8_t*)buffer;
-    for (unsigned i = 0; i < size; i++) {
-      byte_buffer[i] = input_getc();
-    }
-    return (int)size;
+static int syscall_tell(int fd) {
+  struct file* file = get_inode_file(fd);
+  int pos;
+
+  if (file == NULL) {
+    return -1;
+  }
+  pos = file_tell(file);
+  file_close(file);
+  return pos;
+}
+
+static void syscall_seek(int fd, unsigned position) {
+  struct file* file = get_file(fd);
+  if (file == NULL) {
+    syscall_exit(-1);
   }
+  if (!file_is_stream(file))
+    file_seek(file, position);
+  file_close(file);
+}
+
+/* inode_read_func that writes to the console. */
+static bool console_piece(const void* data, size_t size, void* aux UNUSED) {
+  process_console_write(data, size);
+  return true;
+}
 
-  struct file_descriptor* file_descriptor = find_file_descriptor(fd);
-  if (file_descriptor == NULL) {
+/* Copies up to LENGTH bytes from IN_FD, starting at its position,
+   to OUT_FD, starting at its position, without passing through
+   user memory.  OUT_FD may be the console only if CONSOLE, and
+   neither may be a pipe or an event counter.  Returns the number of bytes copied,
+   which is short if IN_FD reaches its end, or -1 if either fd is
+   not open. */
+static int syscall_copy(int in_fd, int out_fd, unsigned length, bool console) {
+  struct file* in = get_inode_file(in_fd);
+  struct file* out = NULL;
+  off_t size = length < INT32_MAX ? (off_t)length : INT32_MAX;
+  off_t copied;
+
+  if (in == NULL) {
+    return -1;
+  }
+  out = get_file(out_fd);
+  if (out == NULL ? !console || out_fd != STDOUT_FILENO : file_is_stream(out)) {
+    file_close(out);
+    file_close(in);
     return -1;
   }
 
-  return file_read(file_descriptor->file, buffer, size);
+  if (out != NULL)
+    copied = file_copy(out, in, size);
+  else
+    copied = file_read_each(in, size, console_piece, NULL);
+  file_close(out);
+  file_close(in);
+  return copied;
 }
 
-static int syscall_tell(int fd) {
-  struct file_descriptor* file_descriptor = find_file_descriptor(fd);
-  if (file_descriptor == NULL) {
+/* Allocates disk space for the LENGTH bytes of FD starting at
+   OFFSET, extending FD if they go past its end, so that writing
+   them later cannot run out of space.  Returns 0 if successful,
+   -1 if FD is not open, LENGTH is 0, the range is too big or the
+   disk is full. */
+static int syscall_fallocate(int fd, unsigned offset, unsigned length) {
+  struct file* file;
+  bool success;
+
+  if (length == 0 || offset > INT32_MAX || length > INT32_MAX - offset) {
     return -1;
   }
-  return file_tell(file_descriptor->file);
+  file = get_inode_file(fd);
+  if (file == NULL) {
+    return -1;
+  }
+  success = inode_fallocate(file_get_inode(file), offset, length);
+  file_close(file);
+  return success ? 0 : -1;
 }
 
-static void syscall_seek(int fd, unsigned position) {
-  struct file_descriptor* file_descriptor = find_file_descriptor(fd);
-  if (file_descriptor == NULL) {
+/* Makes FD's data durable and, unless DATA_ONLY, its metadata as
+   well.  Returns 0 if successful, -1 if FD is not open. */
+static int syscall_fsync(int fd, bool data_only) {
+  struct file* file = get_inode_file(fd);
+
+  if (file == NULL) {
+    return -1;
+  }
+  inode_sync(file_get_inode(file), data_only);
+  file_close(file);
+  return 0;
+}
+
+/* Returns true if FD is open as a directory. */
+static bool syscall_isdir(int fd) {
+  struct file* file = get_file(fd);
+  bool dir = file != NULL && file_is_dir(file);
+
+  file_close(file);
+  return dir;
+}
+
+/* Returns the inode number of the file open as FD, or -1 if FD
+   is not open or is a pipe or an event counter. */
+static int syscall_inumber(int fd) {
+  struct file* file = get_file(fd);
+  int inumber = -1;
+
+  if (file != NULL && !file_is_stream(file))
+    inumber = inode_get_inumber(file_get_inode(file));
+  file_close(file);
+  return inumber;
+}
+
+/* Reads as many of the next entries of directory FD as fit in
+   the SIZE bytes at UBUF, as struct dirent, and moves FD's
+   position past them.  Returns the number of bytes filled in, 0
+   at the end of the directory, or -1 if FD is not open as a
+   directory or memory is short.  Kills the process if UBUF is
+   bad. */
+static int syscall_getdents(int fd, struct dirent* ubuf, unsigned size) {
+  struct file* file = get_file(fd);
+  size_t cnt = size / sizeof *ubuf;
+  size_t done = 0;
+  struct dirent* kbuf;
+  bool fault = false;
+
+  if (file == NULL || !file_is_dir(file)) {
+    file_close(file);
+    return -1;
+  }
+  kbuf = palloc_get_page(0);
+  if (kbuf == NULL) {
+    file_close(file);
+    return -1;
+  }
+
+  while (done < cnt) {
+    size_t chunk = cnt - done < PGSIZE / sizeof *kbuf ? cnt - done : PGSIZE / sizeof *kbuf;
+    size_t n = file_readdir(file, kbuf, chunk);
+
+    if (n == 0)
+      break;
+    fault = !copy_to_user(ubuf + done, kbuf, n * sizeof *kbuf);
+    if (fault)
+      break;
+    done += n;
+  }
+
+  palloc_free_page(kbuf);
+  file_close(file);
+  if (fault)
+    syscall_exit(-1);
+  return done * sizeof *ubuf;
+}
+
+/* Stores the file system's statistics into user buffer STATS.
+   They are gathered in the kernel first, because they are
+   collected under file system locks that a page fault on STATS
+   might need.  Returns false if memory is exhausted.  Kills the
+   process if STATS is bad. */
+static bool syscall_fsstat(struct fs_stats* stats) {
+  struct fs_stats* kstats = malloc(sizeof *kstats);
+  bool fault;
+
+  if (kstats == NULL)
+    return false;
+  fsstat_get(kstats);
+  fault = !copy_to_user(stats, kstats, sizeof *kstats);
+  free(kstats);
+  if (fault)
+    syscall_exit(-1);
+  return true;
+}
+
+/* Stores the statistics of the block device at index IDX in
+   probe order into user buffer STATS, gathering them in the
+   kernel first, as syscall_fsstat() does.  Returns false if
+   there is no such device.  Kills the process if STATS is
+   bad. */
+static bool syscall_blkstat(int idx, struct block_stats* stats) {
+  struct block_stats kstats;
+
+  if (idx < 0 || !block_get_stats(idx, &kstats))
+    return false;
+  if (!copy_to_user(stats, &kstats, sizeof kstats))
+    syscall_exit(-1);
+  return true;
+}
+
+/* Stores the running thread's scheduler statistics into user
+   buffer STATS.  They are gathered in the kernel first, because
+   they are read with interrupts off, which a page fault on STATS
+   would turn back on.  Returns true.  Kills the process if STATS
+   is bad. */
+static bool syscall_sched_stats(struct sched_stats* stats) {
+  struct sched_stats kstats;
+
+  thread_get_sched_stats(&kstats);
+  if (!copy_to_user(stats, &kstats, sizeof kstats))
+    syscall_exit(-1);
+  return true;
+}
+
+/* Stores the calling process's resource usage into user buffer
+   USAGE.  Returns true.  Kills the process if USAGE is bad. */
+static bool syscall_getrusage(struct rusage* usage) {
+  struct process* pcb = thread_current()->pcb;
+  struct rusage kusage = pcb->usage;
+
+  kusage.cpu_quota = pcb->cpu_quota.limit;
+  kusage.io_quota = pcb->io_quota.rate;
+#ifdef VM
+  kusage.working_set = frame_working_set(pcb);
+#endif
+  if (!copy_to_user(usage, &kusage, sizeof kusage))
+    syscall_exit(-1);
+  return true;
+}
+
+/* Stores system call statistics into user buffer STATS: those
+   of all processes together if GLOBAL is true, otherwise those
+   of the calling process.  Returns true, or false if memory runs
+   out.  Kills the process if STATS is bad.
+
+   The statistics change with interrupts off, so they are copied
+   into a kernel buffer with interrupts off too, then copied out
+   from there, since a page fault in copy_to_user() would turn
+   interrupts back on.  The buffer is too big for the stack. */
+static bool syscall_syscall_stats(bool global, struct syscall_stats* stats) {
+  struct process* pcb = thread_current()->pcb;
+  struct syscall_stats* kstats = malloc(sizeof *kstats);
+  enum intr_level old_level;
+  bool success;
+
+  if (kstats == NULL)
+    return false;
+  old_level = intr_disable();
+  *kstats = global ? global_syscalls : pcb->syscalls;
+  intr_set_level(old_level);
+
+  success = copy_to_user(stats, kstats, sizeof *kstats);
+  free(kstats);
+  if (!success)
+    syscall_exit(-1);
+  return true;
+}
+
+/* Stores the current time on clock CLOCK into user buffer TS.
+   Returns 0 if successful, -1 if CLOCK is not a known clock.
+   Kills the process if TS is bad. */
+static int syscall_clock_gettime(int clock, struct timespec* ts) {
+  struct timespec kts;
+  int64_t ns = clock_ns();
+
+  switch (clock) {
+    case CLOCK_REALTIME:
+      kts.tv_sec = clock_realtime();
+      kts.tv_nsec = ns % 1000000000;
+      break;
+    case CLOCK_MONOTONIC:
+      kts.tv_sec = ns / 1000000000;
+      kts.tv_nsec = ns % 1000000000;
+      break;
+    default:
+      return -1;
+  }
+  if (!copy_to_user(ts, &kts, sizeof kts))
+    syscall_exit(-1);
+  return 0;
+}
+
+/* Puts the calling thread in the deadline class with BUDGET_MS
+   milliseconds of CPU time in every PERIOD_MS, or takes it out if
+   PERIOD_MS is 0.  The period is rounded down and the budget up
+   to whole timer ticks.  Returns false if the reservation is
+   refused. */
+static bool syscall_set_deadline(unsigned period_ms, unsigned budget_ms) {
+  int64_t period = (int64_t)period_ms * TIMER_FREQ / 1000;
+  int64_t budget = DIV_ROUND_UP((int64_t)budget_ms * TIMER_FREQ, 1000);
+
+  if (period_ms != 0 && period == 0)
+    return false;
+  return thread_set_deadline(period, budget);
+}
+
+/* Limits the calling process, and the children it starts from
+   now on, to CPU_PERCENT percent of the CPU and IO_RATE bytes per
+   second of block I/O.  Either may be 0 to leave that quota as it
+   is.  Returns false, changing nothing, if either is out of range
+   or looser than the quota in force. */
+static bool syscall_set_quota(unsigned cpu_percent, unsigned io_rate) {
+  struct process* pcb = thread_current()->pcb;
+
+  if (cpu_percent > 100 ||
+      (cpu_percent != 0 && pcb->cpu_quota.limit != 0 && (int)cpu_percent > pcb->cpu_quota.limit) ||
+      (io_rate != 0 && pcb->io_quota.rate != 0 && io_rate > pcb->io_quota.rate))
+    return false;
+  if (cpu_percent != 0)
+    cpu_quota_set(&pcb->cpu_quota, cpu_percent);
+  if (io_rate != 0)
+    io_quota_set(&pcb->io_quota, io_rate);
+  return true;
+}
+
+/* Stores the value of the tunable named NAME in *OLD_VALUE, if
+   OLD_VALUE is nonnull, and then sets it to *NEW_VALUE, if
+   NEW_VALUE is nonnull.  Returns false, changing nothing, if
+   there is no such tunable or *NEW_VALUE is out of its bounds.
+   Kills the process if a pointer is bad. */
+static bool syscall_sysctl(const char* name, int* old_value, const int* new_value) {
+  char* kname = copy_in_string(name);
+  int64_t value;
+  int knew;
+  bool success;
+
+  if (kname == NULL)
+    return false;
+  if (new_value != NULL && !copy_from_user(&knew, new_value, sizeof knew)) {
+    palloc_free_page(kname);
     syscall_exit(-1);
   }
-  file_seek(file_descriptor->file, position);
+  success = tunable_get(kname, &value) && (new_value == NULL || tunable_set(kname, knew));
+  palloc_free_page(kname);
+  if (success && old_value != NULL) {
+    int kold = value;
+    if (!copy_to_user(old_value, &kold, sizeof kold))
+      syscall_exit(-1);
+  }
+  return success;
 }
 
 static pid_t syscall_fork(struct intr_frame* f) { return process_fork(f); }
 
+/* Sleeps on futex UADDR if it holds VAL, as futex_wait() does.
+   Kills the process if UADDR is bad. */
+static int syscall_futex_wait(int* uaddr, int val) {
+  int result = futex_wait(uaddr, val);
+
+  if (result == FUTEX_FAULT)
+    syscall_exit(-1);
+  return result;
+}
+
+#ifdef VM
+static mapid_t syscall_mmap(int fd, void* addr) {
+  struct file* file = get_inode_file(fd);
+  mapid_t mapid;
+
+  if (file == NULL)
+    return MAP_FAILED;
+  mapid = mmap_map(file, addr);
+  file_close(file);
+  return mapid;
+}
+
+/* Sends or receives, as SEND says, a message of SIZE bytes at
+   BUF on message queue ID.  Kills the process if BUF is bad. */
+static int syscall_mq_io(mqid_t id, void* buf, size_t size, bool send) {
+  int result = send ? mq_send(id, buf, size) : mq_receive(id, buf, size);
+
+  if (result == MQ_FAULT)
+    syscall_exit(-1);
+  return result;
+}
+#endif
+
+static pid_t syscall_spawn(const char* cmd_line, const struct spawn_fd* fds, size_t fd_cnt) {
+  struct spawn_fd kfds[SPAWN_FD_MAX];
+  char* kcmd_line;
+
+  /* The child can't see our address space, so give it a copy. */
+  if (fd_cnt > SPAWN_FD_MAX)
+    return -1;
+  if (!copy_from_user(kfds, fds, fd_cnt * sizeof *fds))
+    syscall_exit(-1);
+  kcmd_line = copy_in_string(cmd_line);
+  if (kcmd_line == NULL)
+    return -1;
+  return process_spawn_page(kcmd_line, kfds, fd_cnt);
+}
+
 /*
  * This does not check that the buffer consists of only mapped pages; it merely
  * checks the buffer exists entirely below PHYS_BASE.
@@ -193,58 +1304,124 @@ static void validate_buffer_in_user_region(const void* buffer, size_t length) {
     syscall_exit(-1);
 }
 
-/*
- * This does not check that the string consists of only mapped pages; it merely
- * checks the string exists entirely below PHYS_BASE.
- */
-static void validate_string_in_user_region(const char* string) {
-  uintptr_t delta = PHYS_BASE - (const void*)string;
-  if (!is_user_vaddr(string) || strnlen(string, delta) == delta)
+/* Runs the operations queued in user RING, in order, for as long
+   as there is room for their completions, and returns how many it
+   ran.  Runs at most one queue's worth, so that a corrupt SQ_TAIL
+   cannot keep us here.  The ring is read and written only through
+   copy_from_user() and copy_to_user(), since its pages may be
+   missing or shared.  A bad ring or buffer kills the process, as
+   it would for the system call itself. */
+static int syscall_ring_enter(struct io_ring* ring) {
+  unsigned sq_head, cq_tail;
+  int cnt;
+
+  /* Only we move these, so they are read once. */
+  if (!copy_from_user(&sq_head, &ring->sq_head, sizeof sq_head) ||
+      !copy_from_user(&cq_tail, &ring->cq_tail, sizeof cq_tail))
     syscall_exit(-1);
-}
 
-/*
- * Safe validation functions that return true on success, false on failure
- * instead of calling syscall_exit directly. Use these when holding locks.
- */
-static bool safe_validate_buffer_in_user_region(const void* buffer, size_t length) {
-  uintptr_t delta = PHYS_BASE - buffer;
-  return is_user_vaddr(buffer) && length <= delta;
-}
+  for (cnt = 0; cnt < RING_SIZE; cnt++) {
+    unsigned sq_tail, cq_head;
+    struct ring_sqe sqe;
+    struct ring_cqe cqe;
+    struct file* file;
+
+    if (!copy_from_user(&sq_tail, &ring->sq_tail, sizeof sq_tail) ||
+        !copy_from_user(&cq_head, &ring->cq_head, sizeof cq_head))
+      syscall_exit(-1);
+    if (sq_head == sq_tail || cq_tail - cq_head >= RING_SIZE)
+      break;
+    if (!copy_from_user(&sqe, &ring->sq[sq_head % RING_SIZE], sizeof sqe))
+      syscall_exit(-1);
 
-static bool safe_validate_string_in_user_region(const char* string) {
-  uintptr_t delta = PHYS_BASE - (const void*)string;
-  return is_user_vaddr(string) && strnlen(string, delta) != delta;
+    cqe.user_data = sqe.user_data;
+    cqe.result = -1;
+    switch (sqe.op) {
+      case RING_READ:
+        validate_buffer_in_user_region(sqe.buf, sqe.size);
+        cqe.result = syscall_read(sqe.fd, sqe.buf, sqe.size);
+        break;
+      case RING_WRITE:
+        validate_buffer_in_user_region(sqe.buf, sqe.size);
+        cqe.result = syscall_write(sqe.fd, sqe.buf, sqe.size);
+        break;
+      case RING_SEEK:
+        file = get_inode_file(sqe.fd);
+        if (file != NULL) {
+          file_seek(file, sqe.size);
+          file_close(file);
+          cqe.result = 0;
+        }
+        break;
+      case RING_CLOSE:
+        cqe.result = syscall_close(sqe.fd) ? 0 : -1;
+        break;
+    }
+
+    /* Post the completion before the indices that publish it. */
+    if (!copy_to_user(&ring->cq[cq_tail % RING_SIZE], &cqe, sizeof cqe))
+      syscall_exit(-1);
+    cq_tail++;
+    sq_head++;
+    if (!copy_to_user(&ring->cq_tail, &cq_tail, sizeof cq_tail) ||
+        !copy_to_user(&ring->sq_head, &sq_head, sizeof sq_head))
+      syscall_exit(-1);
+  }
+  return cnt;
 }
 
+/* Gives CHILD_PCB, which has no open files yet, a copy of
+   PARENT_PCB's file descriptor table, for fork().  Returns false
+   if memory allocation fails. */
 bool copy_file_descriptors(struct process* child_pcb, struct process* parent_pcb) {
-  lock_acquire(&filesys_lock);
+  bool success = true;
+  int fd;
 
-  struct list_elem* e;
-  for (e = list_begin(&parent_pcb->open_files); e != list_end(&parent_pcb->open_files);
-       e = list_next(e)) {
-    struct file_descriptor* parent_fd = list_entry(e, struct file_descriptor, elem);
-
-    struct file_descriptor* child_fd = malloc(sizeof(struct file_descriptor));
-    if (child_fd == NULL) {
-      lock_release(&filesys_lock);
-      return false;
+  lock_acquire(&parent_pcb->files_lock);
+  if (parent_pcb->fd_cap > 0) {
+    success = fd_table_grow(child_pcb, parent_pcb->fd_cap - 1);
+    if (success) {
+      memcpy(child_pcb->files, parent_pcb->files, parent_pcb->fd_cap * sizeof *child_pcb->files);
+      memcpy(child_pcb->fd_map, parent_pcb->fd_map,
+             parent_pcb->fd_cap / 32 * sizeof *child_pcb->fd_map);
+      for (fd = 0; fd < child_pcb->fd_cap; fd++)
+        if (child_pcb->files[fd] != NULL)
+          file_ref(child_pcb->files[fd]);
     }
-
-    child_fd->fd = parent_fd->fd;
-    child_fd->file = parent_fd->file;
-    file_ref(child_fd->file); /* Increment reference count */
-    list_push_back(&child_pcb->open_files, &child_fd->elem);
   }
+  lock_release(&parent_pcb->files_lock);
+  return success;
+}
 
-  lock_release(&filesys_lock);
-  return true;
+/* Gives CHILD_PCB, which has no open files yet, the FD_CNT file
+   descriptors that FDS passes on from PARENT_PCB.  Returns false
+   if FDS is invalid or memory runs out, in which case CHILD_PCB
+   may already have some of the files open. */
+bool spawn_file_descriptors(struct process* child_pcb, struct process* parent_pcb,
+                            const struct spawn_fd* fds, size_t fd_cnt) {
+  bool success = true;
+  size_t i;
+
+  lock_acquire(&parent_pcb->files_lock);
+  for (i = 0; i < fd_cnt && success; i++) {
+    struct file* file = fd_lookup(parent_pcb, fds[i].parent_fd);
+
+    success = file != NULL && fds[i].child_fd >= 0 &&
+              fd_lookup(child_pcb, fds[i].child_fd) == NULL &&
+              fd_install_at(child_pcb, fds[i].child_fd, file);
+    if (success)
+      file_ref(file);
+  }
+  lock_release(&parent_pcb->files_lock);
+  return success;
 }
 
 static void syscall_handler(struct intr_frame* f) {
   uint32_t* args = f->esp;
   struct thread* t = thread_current();
+  uint64_t start = rdtsc();
   t->current_syscall = 0; /* Mark that we're in syscall handler but don't know which yet */
+  t->user_esp = f->esp;   /* For stack growth on faults in the kernel */
   validate_buffer_in_user_region(args, sizeof(uint32_t));
   /*
    * The following print statement, if uncommented, will print out the syscall
@@ -254,120 +1431,307 @@ static void syscall_handler(struct intr_frame* f) {
    */
   /* printf("System call number: %d\n", args[0]); */
   t->current_syscall = args[0];
+  t->pcb->usage.syscalls++;
+  syscall_count(t->pcb, args[0]);
+  TRACE(TRACE_SYSCALL, args[0], f->eip);
+  if (trace_enabled)
+    trace_syscall_args(args);
+
+  /* Another thread is exiting the process and waiting for us to
+     get out of its way. */
+  if (t->pcb->exiting)
+    process_exit();
+
   switch (args[0]) {
     case SYS_EXIT:
       validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
       syscall_exit((int)args[1]);
       break;
     case SYS_WRITE:
-      lock_acquire(&filesys_lock);
       validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
       validate_buffer_in_user_region((void*)args[2], (unsigned)args[3]);
       f->eax = syscall_write((int)args[1], (void*)args[2], (unsigned)args[3]);
-      lock_release(&filesys_lock);
       break;
     case SYS_PRACTICE:
       validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
       f->eax = (int)args[1] + 1;
       break;
+    case SYS_COMPUTE_E:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_compute_e((int)args[1]);
+      break;
     case SYS_HALT:
       shutdown_power_off();
       break;
     case SYS_EXEC:
       validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
-      validate_string_in_user_region((char*)args[1]);
       f->eax = syscall_exec((char*)args[1]);
       break;
+    case SYS_EXEC_ARGV:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_exec_argv((char* const*)args[1]);
+      break;
     case SYS_WAIT:
       validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
       f->eax = process_wait((int)args[1]);
       break;
+    case SYS_WAIT_ANY:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_wait_any((int*)args[1]);
+      break;
     case SYS_FORK:
       f->eax = process_fork(f);
       break;
+    case SYS_SPAWN:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = syscall_spawn((char*)args[1], (struct spawn_fd*)args[2], args[3]);
+      break;
+    case SYS_SBRK:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = (uint32_t)process_sbrk((intptr_t)args[1]);
+      break;
+    case SYS_RING_ENTER:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_ring_enter((struct io_ring*)args[1]);
+      break;
     case SYS_CREATE:
-      lock_acquire(&filesys_lock);
-      if (!safe_validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t)) ||
-          !safe_validate_string_in_user_region((char*)args[1])) {
-        lock_release(&filesys_lock);
-        syscall_exit(-1);
-      }
-      f->eax = syscall_create((char*)args[1], (unsigned)args[2]);
-      lock_release(&filesys_lock);
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = syscall_createat(AT_FDCWD, (char*)args[1], (unsigned)args[2]);
       break;
     case SYS_REMOVE:
-      lock_acquire(&filesys_lock);
-      if (!safe_validate_buffer_in_user_region(&args[1], sizeof(uint32_t)) ||
-          !safe_validate_string_in_user_region((char*)args[1])) {
-        lock_release(&filesys_lock);
-        syscall_exit(-1);
-      }
-      f->eax = syscall_remove((char*)args[1]);
-      lock_release(&filesys_lock);
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_unlinkat(AT_FDCWD, (char*)args[1]);
       break;
     case SYS_OPEN:
-      lock_acquire(&filesys_lock);
-      if (!safe_validate_buffer_in_user_region(&args[1], sizeof(uint32_t)) ||
-          !safe_validate_string_in_user_region((char*)args[1])) {
-        lock_release(&filesys_lock);
-        syscall_exit(-1);
-      }
-      f->eax = syscall_open((char*)args[1]);
-      lock_release(&filesys_lock);
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_openat(AT_FDCWD, (char*)args[1]);
       break;
     case SYS_FILESIZE:
-      lock_acquire(&filesys_lock);
-      if (!safe_validate_buffer_in_user_region(&args[1], sizeof(uint32_t))) {
-        lock_release(&filesys_lock);
-        syscall_exit(-1);
-      }
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
       f->eax = syscall_filesize((int)args[1]);
-      lock_release(&filesys_lock);
       break;
     case SYS_CLOSE:
-      lock_acquire(&filesys_lock);
-      if (!safe_validate_buffer_in_user_region(&args[1], sizeof(uint32_t))) {
-        lock_release(&filesys_lock);
-        syscall_exit(-1);
-      }
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
       bool success = syscall_close((int)args[1]);
-      lock_release(&filesys_lock);
       if (!success) {
         syscall_exit(-1);
       }
       break;
     case SYS_READ:
-      lock_acquire(&filesys_lock);
-      if (!safe_validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t)) ||
-          !safe_validate_buffer_in_user_region((void*)args[2], (unsigned)args[3])) {
-        lock_release(&filesys_lock);
-        syscall_exit(-1);
-      }
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      validate_buffer_in_user_region((void*)args[2], (unsigned)args[3]);
       f->eax = syscall_read((int)args[1], (void*)args[2], (unsigned)args[3]);
-      lock_release(&filesys_lock);
+      break;
+    case SYS_READV:
+    case SYS_WRITEV:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = syscall_iov((int)args[1], (struct iovec*)args[2], args[3], args[0] == SYS_WRITEV);
+      break;
+    case SYS_PREAD:
+    case SYS_PWRITE:
+      validate_buffer_in_user_region(&args[1], 4 * sizeof(uint32_t));
+      validate_buffer_in_user_region((void*)args[2], (unsigned)args[3]);
+      f->eax = syscall_pio((int)args[1], (void*)args[2], (unsigned)args[3], (off_t)args[4],
+                           args[0] == SYS_PWRITE);
+      break;
+    case SYS_COPY_RANGE:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = syscall_copy((int)args[1], (int)args[2], (unsigned)args[3], false);
+      break;
+    case SYS_SENDFILE:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = syscall_copy((int)args[2], (int)args[1], (unsigned)args[3], true);
+      break;
+    case SYS_FALLOCATE:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = syscall_fallocate((int)args[1], (unsigned)args[2], (unsigned)args[3]);
+      break;
+    case SYS_PIPE:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_pipe((int*)args[1]);
+      break;
+    case SYS_POLL:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = syscall_poll((struct pollfd*)args[1], args[2], (int)args[3]);
+      break;
+    case SYS_EVENTFD:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_eventfd((unsigned)args[1], false);
+      break;
+    case SYS_TIMERFD_CREATE:
+      f->eax = syscall_eventfd(0, true);
+      break;
+    case SYS_TIMERFD_SETTIME:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = syscall_timerfd_settime((int)args[1], (const struct itimerspec*)args[2]);
       break;
     case SYS_TELL:
-      lock_acquire(&filesys_lock);
-      if (!safe_validate_buffer_in_user_region(&args[1], sizeof(uint32_t))) {
-        lock_release(&filesys_lock);
-        syscall_exit(-1);
-      }
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
       f->eax = syscall_tell((int)args[1]);
-      lock_release(&filesys_lock);
       break;
     case SYS_SEEK:
-      lock_acquire(&filesys_lock);
-      if (!safe_validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t))) {
-        lock_release(&filesys_lock);
-        syscall_exit(-1);
-      }
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
       syscall_seek((int)args[1], (unsigned)args[2]);
-      lock_release(&filesys_lock);
+      break;
+    case SYS_FSYNC:
+    case SYS_FDATASYNC:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_fsync((int)args[1], args[0] == SYS_FDATASYNC);
+      break;
+    case SYS_SYNC:
+      filesys_sync();
+      break;
+#ifdef VM
+    case SYS_MMAP:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = syscall_mmap((int)args[1], (void*)args[2]);
+      break;
+    case SYS_MUNMAP:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      mmap_unmap((mapid_t)args[1]);
+      break;
+    case SYS_MADVISE:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = process_madvise((void*)args[1], (size_t)args[2], (int)args[3]);
+      break;
+    case SYS_MLOCK:
+    case SYS_MUNLOCK:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = process_mlock((void*)args[1], (size_t)args[2], args[0] == SYS_MLOCK);
+      break;
+    case SYS_SET_EVICT_PRIORITY:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = process_set_evict_priority((int)args[1]);
+      break;
+    case SYS_SHM_CREATE:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = shm_create((size_t)args[1]);
+      break;
+    case SYS_SHM_ATTACH:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = (uint32_t)shm_attach((shmid_t)args[1], (void*)args[2]);
+      break;
+    case SYS_SHM_DETACH:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = shm_detach((void*)args[1]);
+      break;
+    case SYS_MQ_CREATE:
+      f->eax = mq_create();
+      break;
+    case SYS_MQ_SEND:
+    case SYS_MQ_RECEIVE:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = syscall_mq_io((mqid_t)args[1], (void*)args[2], (size_t)args[3],
+                             args[0] == SYS_MQ_SEND);
+      break;
+#endif
+    case SYS_PT_CREATE:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = pthread_execute((stub_fun)args[1], (pthread_fun)args[2], (void*)args[3]);
+      break;
+    case SYS_PT_EXIT:
+      if (is_main_thread(t, t->pcb))
+        pthread_exit_main();
+      else
+        pthread_exit();
+      break;
+    case SYS_PT_JOIN:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = pthread_join((tid_t)args[1]);
+      break;
+    case SYS_FUTEX_WAIT:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = args[1] % sizeof(int) == 0 && syscall_futex_wait((int*)args[1], (int)args[2]);
+      break;
+    case SYS_FUTEX_WAKE:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = args[1] % sizeof(int) == 0 ? futex_wake((int*)args[1], (int)args[2]) : 0;
+      break;
+    case SYS_FUTEX_WAKE_ALL:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = args[1] % sizeof(int) == 0 ? futex_wake_all((int*)args[1]) : 0;
+      break;
+    case SYS_SCHED_YIELD_TO:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = thread_yield_to((tid_t)args[1]);
+      break;
+    case SYS_GET_TID:
+      f->eax = t->tid;
+      break;
+    case SYS_SET_TLS:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = process_set_tls((void*)args[1]);
+      break;
+    case SYS_SCHED_STATS:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_sched_stats((struct sched_stats*)args[1]);
+      break;
+    case SYS_GETRUSAGE:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_getrusage((struct rusage*)args[1]);
+      break;
+    case SYS_FSSTAT:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_fsstat((struct fs_stats*)args[1]);
+      break;
+    case SYS_BLKSTAT:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = syscall_blkstat(args[1], (struct block_stats*)args[2]);
+      break;
+    case SYS_SYSCALL_STATS:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = syscall_syscall_stats(args[1], (struct syscall_stats*)args[2]);
+      break;
+    case SYS_CLOCK_GETTIME:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = syscall_clock_gettime(args[1], (struct timespec*)args[2]);
+      break;
+    case SYS_SET_DEADLINE:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = syscall_set_deadline(args[1], args[2]);
+      break;
+    case SYS_SET_QUOTA:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = syscall_set_quota(args[1], args[2]);
+      break;
+    case SYS_SYSCTL:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = syscall_sysctl((const char*)args[1], (int*)args[2], (const int*)args[3]);
+      break;
+    case SYS_ISDIR:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_isdir((int)args[1]);
+      break;
+    case SYS_INUMBER:
+      validate_buffer_in_user_region(&args[1], sizeof(uint32_t));
+      f->eax = syscall_inumber((int)args[1]);
+      break;
+    case SYS_GETDENTS:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = syscall_getdents((int)args[1], (struct dirent*)args[2], args[3]);
+      break;
+    case SYS_OPENAT:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = syscall_openat((int)args[1], (char*)args[2]);
+      break;
+    case SYS_CREATEAT:
+      validate_buffer_in_user_region(&args[1], 3 * sizeof(uint32_t));
+      f->eax = syscall_createat((int)args[1], (char*)args[2], args[3]);
+      break;
+    case SYS_UNLINKAT:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = syscall_unlinkat((int)args[1], (char*)args[2]);
+      break;
+    case SYS_CLONE_FILE:
+      validate_buffer_in_user_region(&args[1], 2 * sizeof(uint32_t));
+      f->eax = syscall_clone_file((char*)args[1], (char*)args[2]);
       break;
     default:
       printf("Unimplemented system call: %d\n", (int)args[0]);
       break;
   }
 
+  TRACE(TRACE_SYSCALL_RET, t->current_syscall, f->eax);
+  syscall_time(t->pcb, t->current_syscall, rdtsc() - start);
   t->current_syscall = -1;
 }
@@ -2,15 +2,20 @@
 #define USERPROG_SYSCALL_H
 
 #include "userprog/process.h"
-#include "threads/synch.h"
 
-extern struct lock filesys_lock; /* Global filesystem lock */
+/* -sysstat: Print system call statistics at process exit and
+   power off? */
+extern bool sysstat_enabled;
 
 void syscall_init(void);
 void syscall_exit(int status);
+void syscall_print_process_stats(const struct process*);
+void syscall_print_stats(void);
 int sys_wait(pid_t pid);                                 /* System call handler for wait */
 void destroy_file_descriptor_table(struct process* pcb); /* Destroys fdt properly */
 bool copy_file_descriptors(
     struct process* child_pcb,
     struct process* parent_pcb); /* copies file descriptors from parent to child */
+bool spawn_file_descriptors(struct process* child_pcb, struct process* parent_pcb,
+                            const struct spawn_fd* fds, size_t fd_cnt);
 #endif                           /* userprog/syscall.h */
@@ -1,7 +1,9 @@
 #include "userprog/tss.h"
 #include <debug.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/cpu.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -74,6 +76,48 @@ struct tss {
 /* Kernel TSS. */
 static struct tss* tss;
 
+/* Model-specific registers that set up SYSENTER.  See [IA32-v3a]
+   4.8.7 "Performing Fast Calls to System Procedures with the
+   SYSENTER and SYSEXIT Instructions". */
+#define MSR_SYSENTER_CS 0x174  /* Kernel code segment. */
+#define MSR_SYSENTER_ESP 0x175 /* Kernel stack pointer. */
+#define MSR_SYSENTER_EIP 0x176 /* Kernel entry point. */
+
+/* Returns true if the CPU supports SYSENTER and SYSEXIT, as
+   reported in bit 11 of EDX by CPUID function 1, except that the
+   first Pentium Pros claim it but lack it.  The user library's
+   _syscall_init() makes the same test.  See [IA32-v2a] "CPUID". */
+static bool cpu_has_sep(void) {
+  struct cpuid_regs r = cpuid(1);
+  int family = (r.eax >> 8) & 0xf;
+  int model = (r.eax >> 4) & 0xf;
+  int stepping = r.eax & 0xf;
+
+  return (r.edx & CPUID_SEP) != 0 && !(family == 6 && model < 3 && stepping < 3);
+}
+
+/* Writes VALUE to model-specific register MSR. */
+static void wrmsr(uint32_t msr, uint32_t value) {
+  asm volatile("wrmsr" : : "c"(msr), "a"(value), "d"(0));
+}
+
+/* Points SYSENTER at syscall_sysenter in sysenter.S.  SYSENTER
+   loads the same stack pointer for every thread, so it is set to
+   the address of the TSS's esp0, from which syscall_sysenter
+   loads the running thread's kernel stack.  SYSEXIT takes its
+   user selectors at fixed offsets from SEL_KCSEG, which the GDT's
+   layout matches. */
+static void sysenter_init(void) {
+  extern char syscall_sysenter[];
+
+  ASSERT(SEL_UCSEG == SEL_KCSEG + 16 + 3 && SEL_UDSEG == SEL_KCSEG + 24 + 3);
+  if (!cpu_has_sep())
+    return;
+  wrmsr(MSR_SYSENTER_CS, SEL_KCSEG);
+  wrmsr(MSR_SYSENTER_ESP, (uint32_t)&tss->esp0);
+  wrmsr(MSR_SYSENTER_EIP, (uint32_t)syscall_sysenter);
+}
+
 /* Initializes the kernel TSS. */
 void tss_init(void) {
   /* Our TSS is never used in a call gate or task gate, so only a
@@ -83,6 +127,7 @@ void tss_init(void) {
   tss->ss0 = SEL_KDSEG;
   tss->bitmap = 0xdfff;
   tss_update();
+  sysenter_init();
 }
 
 /* Returns the kernel TSS. */
@@ -0,0 +1,83 @@
+#include "userprog/uaccess.h"
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Checked access to user memory.
+
+   System calls copy their arguments in and their results out
+   with these functions instead of dereferencing user pointers.
+   Each checks that the user range lies below PHYS_BASE, then
+   touches each byte once.  A page fault that the VM system cannot
+   resolve, because the address is not mapped or not writable,
+   makes the access return an error through the exception table
+   built by uaccess-stubs.S, so that the caller can release what
+   it holds before it decides what to do. */
+
+/* Accessors in uaccess-stubs.S. */
+size_t uaccess_copy(void* dst, const void* src, size_t size);
+int uaccess_strncpy(char* dst, const char* src, size_t size);
+
+/* An exception table entry: an instruction in uaccess-stubs.S
+   that may fault on a user address, and where to continue if it
+   does. */
+struct ex_entry {
+  uintptr_t insn;
+  uintptr_t fixup;
+};
+
+/* The exception table, gathered by the linker script. */
+extern const struct ex_entry _start_ex_table[], _end_ex_table[];
+
+/* Returns true if the SIZE bytes at UADDR are all user addresses. */
+static bool is_user_range(const void* uaddr, size_t size) {
+  return is_user_vaddr(uaddr) &&
+         size <= (size_t)((const uint8_t*)PHYS_BASE - (const uint8_t*)uaddr);
+}
+
+/* Copies SIZE bytes from user address USRC to DST.  Returns false
+   if the user range is not all mapped. */
+bool copy_from_user(void* dst, const void* usrc, size_t size) {
+  return is_user_range(usrc, size) && uaccess_copy(dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from SRC to user address UDST.  Returns false
+   if the user range is not all mapped and writable, in which case
+   part of it may have been written. */
+bool copy_to_user(void* udst, const void* src, size_t size) {
+  return is_user_range(udst, size) && uaccess_copy(udst, src, size) == 0;
+}
+
+/* Copies the string at user address USRC, with its null
+   terminator, into DST, which has room for SIZE bytes.  Returns
+   the string's length, or SIZE if the string does not fit, in
+   which case DST is not null-terminated.  Returns -1 if the
+   string is not all in mapped user memory. */
+int strncpy_from_user(char* dst, const char* usrc, size_t size) {
+  size_t limit;
+  int len;
+
+  if (!is_user_vaddr(usrc))
+    return -1;
+  limit = (const uint8_t*)PHYS_BASE - (const uint8_t*)usrc;
+  if (limit >= size)
+    return uaccess_strncpy(dst, usrc, size);
+
+  /* The string must end before PHYS_BASE. */
+  len = uaccess_strncpy(dst, usrc, limit);
+  return len >= 0 && (size_t)len < limit ? len : -1;
+}
+
+/* If F is a page fault in one of the accessors, makes it continue
+   at the accessor's error path and returns true.  Otherwise,
+   returns false. */
+bool uaccess_fixup(struct intr_frame* f) {
+  const struct ex_entry* e;
+
+  for (e = _start_ex_table; e < _end_ex_table; e++)
+    if (e->insn == (uintptr_t)f->eip) {
+      f->eip = (void (*)(void))e->fixup;
+      return true;
+    }
+  return false;
+}
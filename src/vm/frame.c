@@ -0,0 +1,901 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <hash.h>
+#include <mman.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* A frame in the user pool. */
+struct frame {
+  struct process* owner; /* Process that maps the frame, or null. */
+  void* upage;           /* Where OWNER maps it. */
+  bool accessed;         /* Used since the clock passed, though no
+                            accessed bit need show it. */
+  uint8_t idle_sweeps;   /* Sweeps that found it idle, for EVICT_PRI_HIGH. */
+
+  /* Page cache. */
+  bool shared;           /* In shared_frames, which holds a reference. */
+  block_sector_t sector; /* Inode sector of the file. */
+  off_t ofs;             /* Offset in the file. */
+  struct hash_elem elem; /* Element in shared_frames. */
+
+  /* Same-page merging. */
+  bool merge_listed;           /* In merge_table. */
+  unsigned checksum;           /* Hash of the contents when listed. */
+  struct hash_elem merge_elem; /* Element in merge_table. */
+};
+
+static struct frame* frames; /* One entry per user pool page. */
+static uint8_t* frame_base;  /* First page of the user pool. */
+static size_t frame_cnt;     /* Number of pages in the user pool. */
+static size_t clock_hand;    /* Next frame the clock examines. */
+
+/* Shared frames, keyed by sector and offset. */
+static struct hash shared_frames;
+
+/* Protects the frame table.  Acquired with the owner's
+   pagedir_lock held, so eviction only ever tries to acquire an
+   owner's lock. */
+static struct lock frame_lock;
+
+/* Frames freed by eviction. */
+static long long evict_cnt;
+
+/* Compaction.  When the user pool has enough free pages for a
+   contiguous request but no run long enough, frame_compact()
+   picks the aligned block of the pool that holds the fewest
+   pages in use, all of which must be movable, and moves each of
+   them to a free frame outside the block.  A frame is movable if
+   one process maps it privately: nothing but that process's page
+   directory refers to it, so copying it and repointing the PTE
+   is invisible to everyone.  Shared frames, the zero page and
+   pages that the kernel holds stay put.
+
+   Besides being called when palloc_get_multiple() fails, the
+   working set sampler compacts COMPACT_PAGES pages whenever a
+   sweep finds the free memory too broken up, so that requests
+   that come later need not wait for it. */
+#define COMPACT_PAGES 64 /* Run that background compaction keeps ready. */
+static long long compact_cnt;      /* Blocks cleared by compaction. */
+static long long compact_failures; /* Compactions that could not clear a block. */
+static long long migrate_cnt;      /* Frames moved. */
+
+/* Same-page merging.  Processes forked from one another, or
+   started from the same executable, often write the same data
+   into private pages, which then take a frame each.  The merger
+   thread, at the lowest priority, examines merge_batch frames
+   every merge_period ticks, the vm.merge_batch and
+   vm.merge_period tunables, so that it costs little however many
+   frames there are.  It hashes each private page and looks the
+   hash up in merge_table, which lists one frame per hash seen in
+   the current pass over the frame table.  If the listed frame
+   holds the same bytes, the page becomes a copy-on-write mapping
+   of that frame, just as if the two processes had forked, and its
+   own frame is freed.  A page of zeros is merged into the zero
+   page instead.
+
+   Listed frames may have changed or been freed since, so each
+   match is checked again with both owners' pagedir_locks held,
+   and the comparison and the remapping are done with interrupts
+   off, so that no user thread writes either page in between.
+   File mapping pages, shared memory and the page cache are left
+   alone.  The table is emptied at the start of each pass. */
+#define MERGE_PERIOD (TIMER_FREQ / 10) /* Default ticks between batches. */
+#define MERGE_BATCH 32                 /* Default frames examined per batch. */
+static int merge_period = MERGE_PERIOD;
+static int merge_batch = MERGE_BATCH;
+static struct hash merge_table;        /* Listed frames, by checksum. */
+static size_t merge_hand;              /* Next frame the merger examines. */
+static unsigned zero_checksum;         /* Hash of a page of zeros. */
+static long long merge_scanned;        /* Pages hashed. */
+static long long merge_cnt;            /* Pages merged into another frame. */
+static long long merge_zero_cnt;       /* Pages merged into the zero page. */
+
+static thread_func merger;
+
+/* Working set sampling.  Every WS_PERIOD timer ticks, a sweep of
+   the frame table counts the pages of each process that were
+   accessed since the last sweep, clearing their accessed bits
+   and setting the frames' accessed members instead, so that the
+   clock still gives them their second chance.  A process's
+   working set is what the latest sweep counted for it. */
+#define WS_PERIOD TIMER_FREQ
+static unsigned ws_sweep; /* Number of sweeps so far. */
+
+static thread_func ws_sampler;
+
+/* Returns a hash value for frame F. */
+static unsigned frame_hash(const struct hash_elem* f_, void* aux UNUSED) {
+  const struct frame* f = hash_entry(f_, struct frame, elem);
+  return hash_int(f->sector) ^ hash_int(f->ofs);
+}
+
+/* Returns true if frame A's file page precedes frame B's. */
+static bool frame_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  const struct frame* a = hash_entry(a_, struct frame, elem);
+  const struct frame* b = hash_entry(b_, struct frame, elem);
+  if (a->sector != b->sector)
+    return a->sector < b->sector;
+  return a->ofs < b->ofs;
+}
+
+/* Returns the merge_table hash value for frame F. */
+static unsigned merge_hash(const struct hash_elem* f_, void* aux UNUSED) {
+  return hash_entry(f_, struct frame, merge_elem)->checksum;
+}
+
+/* Returns true if frame A's checksum is less than frame B's. */
+static bool merge_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  return hash_entry(a_, struct frame, merge_elem)->checksum <
+         hash_entry(b_, struct frame, merge_elem)->checksum;
+}
+
+/* Returns the kernel virtual address of frame F. */
+static void* frame_page(const struct frame* f) { return frame_base + (f - frames) * PGSIZE; }
+
+/* Initializes the frame table.  Until then, no frame can be
+   evicted or shared. */
+void frame_init(void) {
+  void* zero;
+
+  palloc_user_pool(&frame_base, &frame_cnt);
+  frames = calloc(frame_cnt, sizeof *frames);
+  if (frames == NULL || !hash_init(&shared_frames, frame_hash, frame_less, NULL) ||
+      !hash_init(&merge_table, merge_hash, merge_less, NULL))
+    PANIC("frame_init: out of memory");
+  lock_init_named(&frame_lock, "frame");
+
+  zero = palloc_get_zero_page();
+  if (zero != NULL) {
+    zero_checksum = hash_bytes(zero, PGSIZE);
+    palloc_free_page(zero);
+  }
+
+  tunable_register_int("vm.merge_period", &merge_period, 1, 60 * TIMER_FREQ);
+  tunable_register_int("vm.merge_batch", &merge_batch, 0, 1024);
+  thread_create("ws-sampler", PRI_DEFAULT, ws_sampler, NULL);
+  thread_create("merger", PRI_MIN, merger, NULL);
+}
+
+/* Records that OWNER maps user pool page KPAGE at user virtual
+   address UPAGE, which makes KPAGE a candidate for eviction.
+   OWNER's supplemental page table must know how to reload
+   UPAGE.  Does nothing for the zero page, which is never
+   evicted. */
+void frame_register(void* kpage, struct process* owner, void* upage) {
+  struct frame* f;
+
+  ASSERT(pg_ofs(kpage) == 0);
+  ASSERT(pg_ofs(upage) == 0);
+
+  if (frames == NULL || palloc_is_zero_page(kpage))
+    return;
+
+  f = &frames[pg_no(kpage) - pg_no(frame_base)];
+  ASSERT(f < frames + frame_cnt);
+  lock_acquire(&frame_lock);
+  f->owner = owner;
+  f->upage = upage;
+  f->idle_sweeps = 0;
+  lock_release(&frame_lock);
+}
+
+/* Returns the shared frame with the page at offset OFS of the
+   file whose inode is at SECTOR, or a null pointer.  The caller
+   must hold frame_lock. */
+static struct frame* lookup_shared(block_sector_t sector, off_t ofs) {
+  struct frame key;
+  struct hash_elem* e;
+
+  key.sector = sector;
+  key.ofs = ofs;
+  e = hash_find(&shared_frames, &key.elem);
+  return e != NULL ? hash_entry(e, struct frame, elem) : NULL;
+}
+
+/* Removes shared frame F from shared_frames.  The caller must
+   hold frame_lock and drop the reference that shared_frames
+   held. */
+static void unshare(struct frame* f) {
+  ASSERT(f->shared);
+  hash_delete(&shared_frames, &f->elem);
+  f->shared = false;
+}
+
+/* Returns a reference to the shared frame that holds the page at
+   offset OFS of the file whose inode is at SECTOR, or a null
+   pointer if there is none.  The caller must free the reference
+   with palloc_free_page(), typically by mapping it into a page
+   directory that does so.  The frame's contents must not be
+   changed. */
+void* frame_find_shared(block_sector_t sector, off_t ofs) {
+  struct frame* f;
+  void* kpage = NULL;
+
+  /* Most reads are of files that no process maps.  A page
+     shared just as we look is simply missed. */
+  if (frames == NULL || hash_empty(&shared_frames))
+    return NULL;
+
+  lock_acquire(&frame_lock);
+  f = lookup_shared(sector, ofs);
+  if (f != NULL) {
+    kpage = frame_page(f);
+    palloc_share_page(kpage);
+    f->accessed = true;
+  }
+  lock_release(&frame_lock);
+  return kpage;
+}
+
+/* Shares frame KPAGE, which the caller has filled with the page
+   at offset OFS of the file whose inode is at SECTOR, so that
+   frame_find_shared() finds it.  Returns KPAGE, or, if another
+   frame already holds that page, frees KPAGE and returns a
+   reference to the other frame instead. */
+void* frame_share(void* kpage, block_sector_t sector, off_t ofs) {
+  struct frame* f;
+
+  ASSERT(pg_ofs(kpage) == 0);
+  ASSERT(pg_ofs((void*)ofs) == 0);
+
+  if (frames == NULL)
+    return kpage;
+
+  lock_acquire(&frame_lock);
+  f = lookup_shared(sector, ofs);
+  if (f == NULL) {
+    f = &frames[pg_no(kpage) - pg_no(frame_base)];
+    ASSERT(!f->shared);
+    f->shared = true;
+    f->accessed = true;
+    f->sector = sector;
+    f->ofs = ofs;
+    hash_insert(&shared_frames, &f->elem);
+    palloc_share_page(kpage);
+  } else {
+    palloc_free_page(kpage);
+    kpage = frame_page(f);
+    palloc_share_page(kpage);
+  }
+  lock_release(&frame_lock);
+  return kpage;
+}
+
+/* Stops sharing the frames that hold pages of the file whose
+   inode is at SECTOR and that overlap the SIZE bytes starting at
+   offset OFS, because the file is about to change there or is
+   being deleted.  Processes that map those frames keep them. */
+void frame_forget_shared(block_sector_t sector, off_t ofs, off_t size) {
+  off_t page_ofs;
+  bool held;
+
+  if (frames == NULL || size <= 0)
+    return;
+
+  /* Eviction writes file mapping pages back with frame_lock
+     held. */
+  held = lock_held_by_current_thread(&frame_lock);
+  if (!held)
+    lock_acquire(&frame_lock);
+  for (page_ofs = ROUND_DOWN(ofs, PGSIZE); page_ofs < ofs + size && !hash_empty(&shared_frames);
+       page_ofs += PGSIZE) {
+    struct frame* f = lookup_shared(sector, page_ofs);
+    if (f != NULL) {
+      unshare(f);
+      palloc_free_page(frame_page(f));
+    }
+  }
+  if (!held)
+    lock_release(&frame_lock);
+}
+
+/* Forgets every frame that OWNER maps.  Must be called before
+   OWNER is freed. */
+void frame_release_owner(struct process* owner) {
+  size_t i;
+
+  if (frames == NULL)
+    return;
+
+  lock_acquire(&frame_lock);
+  for (i = 0; i < frame_cnt; i++)
+    if (frames[i].owner == owner)
+      frames[i].owner = NULL;
+  lock_release(&frame_lock);
+}
+
+/* Sweeps of the clock that must find a page of an EVICT_PRI_HIGH
+   process idle, beyond the one that clears its accessed bit,
+   before it is evicted.  Pages of EVICT_PRI_LOW processes get no
+   second chance at all, and pages that mlock() locked are never
+   evicted. */
+#define HIGH_IDLE_SWEEPS 2
+
+/* Most frames that one call to frame_evict() frees.  Evicting
+   several at once lets their pages go to swap together, in
+   consecutive slots, and spares the next few allocations from
+   evicting at all. */
+#define EVICT_BATCH 8
+
+/* A frame chosen for eviction.  Its page is already unmapped. */
+struct victim {
+  struct process* owner; /* Owner, whose pagedir_lock we hold. */
+  void* upage;           /* Where OWNER mapped the frame. */
+  void* kpage;           /* The frame. */
+  struct page* page;     /* Supplemental page table entry. */
+  bool swap;             /* Must be written to swap. */
+  bool kept;             /* Mapped back in for lack of swap. */
+  bool release;          /* Release OWNER's lock when done. */
+  bool unshared;         /* Also drop the shared_frames reference. */
+};
+
+/* Returns true if victim A should get a lower swap slot than
+   victim B: the victims of one process go in order of address,
+   so that swap read-around finds neighbouring pages in
+   neighbouring slots. */
+static bool victim_less(const struct victim* a, const struct victim* b) {
+  if (a->owner != b->owner)
+    return a->owner < b->owner;
+  return a->upage < b->upage;
+}
+
+/* Checks whether shared frame F, at kernel virtual address
+   KPAGE, which no process has registered, can be evicted.  If
+   so, stops sharing it and fills in V.  Returns true if
+   successful. */
+static bool choose_unmapped_victim(struct frame* f, void* kpage, struct victim* v) {
+  if (palloc_page_refs(kpage) > 1) {
+    /* A process that did not register the frame still maps it. */
+    return false;
+  }
+  if (f->accessed) {
+    /* Second chance. */
+    f->accessed = false;
+    return false;
+  }
+
+  unshare(f);
+  v->owner = NULL;
+  v->upage = NULL;
+  v->kpage = kpage;
+  v->page = NULL;
+  v->swap = v->kept = v->release = v->unshared = false;
+  return true;
+}
+
+/* Checks whether frame F, at kernel virtual address KPAGE, whose
+   owner's pagedir_lock the caller holds, can be evicted.  If so,
+   unmaps it and fills in V.  Returns true if successful. */
+static bool choose_victim(struct frame* f, void* kpage, struct victim* v) {
+  struct process* owner = f->owner;
+  struct page* p;
+
+  if (owner->pagedir == NULL || pagedir_get_page(owner->pagedir, f->upage) != kpage) {
+    /* The owner unmapped the page since registering it. */
+    f->owner = NULL;
+    return false;
+  }
+  if (palloc_page_refs(kpage) > (f->shared ? 2 : 1)) {
+    /* Shared copy-on-write with, or shared executable page mapped
+       by, another process. */
+    return false;
+  }
+  p = page_find(&owner->pages, f->upage);
+  if (p != NULL && p->locked)
+    return false;
+  if (owner->evict_priority != EVICT_PRI_LOW &&
+      (pagedir_is_accessed(owner->pagedir, f->upage) || f->accessed)) {
+    /* Second chance. */
+    pagedir_set_accessed(owner->pagedir, f->upage, false);
+    f->accessed = false;
+    f->idle_sweeps = 0;
+    return false;
+  }
+  if (owner->evict_priority == EVICT_PRI_HIGH && f->idle_sweeps < HIGH_IDLE_SWEEPS) {
+    f->idle_sweeps++;
+    return false;
+  }
+
+  v->page = page_unmap(&owner->pages, owner->pagedir, f->upage, &v->swap);
+  if (v->page == NULL)
+    return false;
+  v->owner = owner;
+  v->upage = f->upage;
+  v->kpage = kpage;
+  v->kept = false;
+  v->unshared = f->shared;
+  if (f->shared) {
+    /* Shared pages are read-only, so never go to swap. */
+    ASSERT(!v->swap);
+    unshare(f);
+  }
+  f->owner = NULL;
+  return true;
+}
+
+/* Writes the pages of the CNT victims in V that need it to swap,
+   giving them consecutive slots where possible.  A page for
+   which there is no slot is mapped back in and marked kept. */
+static void swap_victims(struct victim* v, size_t cnt) {
+  size_t swap_cnt = 0;
+  size_t slot;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (v[i].swap)
+      swap_cnt++;
+  if (swap_cnt == 0)
+    return;
+
+  slot = swap_alloc(swap_cnt);
+  for (i = 0; i < cnt; i++) {
+    size_t s;
+
+    if (!v[i].swap)
+      continue;
+    s = slot != SWAP_ERROR ? slot++ : swap_alloc(1);
+    if (s != SWAP_ERROR) {
+      swap_write(s, v[i].kpage);
+      page_set_swap(v[i].page, s);
+      v[i].owner->usage.swap_outs++;
+    } else {
+      page_remap(v[i].page, v[i].owner->pagedir, v[i].kpage);
+      v[i].kept = true;
+    }
+  }
+}
+
+/* Evicts up to EVICT_BATCH pages from the user pool, chosen by
+   the clock algorithm, and frees their frames.  Returns true if
+   at least one frame was freed, false if no page can be evicted,
+   for example because swap is full. */
+bool frame_evict(void) {
+  struct victim victims[EVICT_BATCH];
+  size_t victim_cnt = 0;
+  bool evicted = false;
+  size_t i, j;
+
+  if (frames == NULL)
+    return false;
+
+  lock_acquire(&frame_lock);
+
+  /* Sweep until the batch is full, but stop after any sweep that
+     found anything.  The first sweep may only clear accessed
+     bits, and pages of EVICT_PRI_HIGH processes need more, so
+     make up to 2 + HIGH_IDLE_SWEEPS. */
+  for (i = 0; i < (2 + HIGH_IDLE_SWEEPS) * frame_cnt && victim_cnt < EVICT_BATCH; i++) {
+    struct frame* f = &frames[clock_hand];
+    void* kpage = frame_base + clock_hand * PGSIZE;
+    struct process* owner = f->owner;
+    bool held;
+
+    if (i > 0 && i % frame_cnt == 0 && victim_cnt > 0)
+      break;
+    clock_hand = (clock_hand + 1) % frame_cnt;
+    if (owner == NULL) {
+      if (f->shared && choose_unmapped_victim(f, kpage, &victims[victim_cnt]))
+        victim_cnt++;
+      continue;
+    }
+
+    /* The current thread may be faulting in a page of its own
+       process, or already hold the lock for an earlier victim.
+       Otherwise, skip processes that are busy with their page
+       directories rather than wait for them. */
+    held = lock_held_by_current_thread(&owner->pagedir_lock);
+    if (!held && !lock_try_acquire(&owner->pagedir_lock))
+      continue;
+    if (choose_victim(f, kpage, &victims[victim_cnt]))
+      victims[victim_cnt++].release = !held;
+    else if (!held)
+      lock_release(&owner->pagedir_lock);
+  }
+
+  /* Sort the victims by insertion sort, which is fine for so
+     few, and write them out.  The owners' locks stay held until
+     the writes finish, so that no owner can fault a page back in
+     before its contents are in swap. */
+  for (i = 1; i < victim_cnt; i++) {
+    struct victim v = victims[i];
+    for (j = i; j > 0 && victim_less(&v, &victims[j - 1]); j--)
+      victims[j] = victims[j - 1];
+    victims[j] = v;
+  }
+  swap_victims(victims, victim_cnt);
+
+  for (i = 0; i < victim_cnt; i++)
+    if (victims[i].kept) {
+      struct frame* f = &frames[pg_no(victims[i].kpage) - pg_no(frame_base)];
+      f->owner = victims[i].owner;
+      f->upage = victims[i].upage;
+    } else {
+      evict_cnt++;
+      if (victims[i].owner != NULL)
+        victims[i].owner->usage.evictions++;
+    }
+  lock_release(&frame_lock);
+
+  for (i = 0; i < victim_cnt; i++) {
+    if (victims[i].release)
+      lock_release(&victims[i].owner->pagedir_lock);
+    if (!victims[i].kept) {
+      if (victims[i].unshared)
+        palloc_free_page(victims[i].kpage);
+      palloc_free_page(victims[i].kpage);
+      evicted = true;
+    }
+  }
+  return evicted;
+}
+
+/* Returns true if frame F, at kernel virtual address KPAGE, may
+   be movable, going by what can be seen without its owner's
+   pagedir_lock.  The caller must hold frame_lock. */
+static bool maybe_movable(struct frame* f, void* kpage) {
+  return f->owner != NULL && !f->shared && palloc_page_refs(kpage) == 1;
+}
+
+/* Returns the index of the first frame of the aligned block of
+   BLOCK_CNT frames that compaction can clear by moving the
+   fewest frames, or SIZE_MAX if no block can be cleared.  The
+   caller must hold frame_lock. */
+static size_t choose_block(size_t block_cnt) {
+  size_t best = SIZE_MAX, best_used = SIZE_MAX;
+  size_t start, i;
+
+  for (start = 0; start + block_cnt <= frame_cnt; start += block_cnt) {
+    size_t used = 0;
+
+    for (i = start; i < start + block_cnt && used < best_used; i++) {
+      void* kpage = frame_base + i * PGSIZE;
+      if (palloc_user_page_free(kpage))
+        continue;
+      if (!maybe_movable(&frames[i], kpage))
+        break;
+      used++;
+    }
+    if (i == start + block_cnt && used < best_used) {
+      best = start;
+      best_used = used;
+    }
+  }
+  return best;
+}
+
+/* Moves the page in frame F, at kernel virtual address KPAGE, to
+   a free frame outside the BLOCK_CNT frames starting at frame
+   START.  Frames that palloc_get_page() hands out inside that
+   block are pushed on *HELD, linked through their first words,
+   for the caller to free.  Returns true if successful, false if
+   the page turns out not to be movable or there is no frame to
+   move it to.  The caller must hold frame_lock. */
+static bool migrate_frame(struct frame* f, void* kpage, size_t start, size_t block_cnt,
+                          void** held) {
+  struct process* owner = f->owner;
+  enum intr_level old_level;
+  bool locked;
+  void* copy;
+  size_t idx;
+
+  /* As in frame_evict(), skip a process that is busy with its
+     page directory. */
+  locked = lock_held_by_current_thread(&owner->pagedir_lock);
+  if (!locked && !lock_try_acquire(&owner->pagedir_lock))
+    return false;
+  if (owner->pagedir == NULL || pagedir_get_page(owner->pagedir, f->upage) != kpage ||
+      palloc_page_refs(kpage) != 1)
+    goto fail;
+
+  for (;;) {
+    copy = palloc_get_page(PAL_USER | PAL_NOEVICT);
+    if (copy == NULL)
+      goto fail;
+    idx = pg_no(copy) - pg_no(frame_base);
+    if (idx < start || idx >= start + block_cnt)
+      break;
+    *(void**)copy = *held;
+    *held = copy;
+  }
+
+  /* No thread of OWNER may write the page between the copy and
+     the switch, and with one CPU none runs while interrupts are
+     off. */
+  old_level = intr_disable();
+  memcpy(copy, kpage, PGSIZE);
+  pagedir_move_page(owner->pagedir, f->upage, copy);
+  intr_set_level(old_level);
+
+  frames[idx].owner = owner;
+  frames[idx].upage = f->upage;
+  frames[idx].accessed = f->accessed;
+  f->owner = NULL;
+  f->accessed = false;
+  pagedir_batch_free(kpage);
+  migrate_cnt++;
+
+  if (!locked)
+    lock_release(&owner->pagedir_lock);
+  return true;
+
+fail:
+  if (!locked)
+    lock_release(&owner->pagedir_lock);
+  return false;
+}
+
+/* Moves user pages out of the way to make a free run of at least
+   PAGE_CNT frames in the user pool, which palloc_get_multiple()
+   can then hand out, as described at COMPACT_PAGES.  Returns true
+   if successful, false if no block can be cleared. */
+bool frame_compact(size_t page_cnt) {
+  size_t block_cnt = 1;
+  void* held = NULL;
+  bool success = true;
+  size_t start, i;
+
+  if (frames == NULL)
+    return false;
+  while (block_cnt < page_cnt)
+    block_cnt *= 2;
+
+  lock_acquire(&frame_lock);
+  start = choose_block(block_cnt);
+  if (start == SIZE_MAX)
+    success = false;
+  else
+    for (i = start; i < start + block_cnt && success; i++) {
+      void* kpage = frame_base + i * PGSIZE;
+      if (!palloc_user_page_free(kpage))
+        success = maybe_movable(&frames[i], kpage) &&
+                  migrate_frame(&frames[i], kpage, start, block_cnt, &held);
+    }
+  if (success)
+    compact_cnt++;
+  else
+    compact_failures++;
+  lock_release(&frame_lock);
+
+  while (held != NULL) {
+    void* page = held;
+    held = *(void**)page;
+    palloc_free_page(page);
+  }
+
+  /* The freed frames went to the allocator's magazine.  Give them
+     back to the buddy allocator to merge into the cleared run. */
+  palloc_user_drain();
+  return success;
+}
+
+/* Compacts the user pool in the background if it has plenty of
+   free memory but no free run of COMPACT_PAGES. */
+static void compact_if_fragmented(void) {
+  size_t free_cnt, largest;
+
+  palloc_user_free(&free_cnt, &largest);
+  if (largest < COMPACT_PAGES && free_cnt >= 4 * COMPACT_PAGES)
+    frame_compact(COMPACT_PAGES);
+}
+
+/* Lists frame F in merge_table under CHECKSUM, in place of any
+   frame listed there already.  The caller must hold frame_lock. */
+static void merge_list(struct frame* f, unsigned checksum) {
+  struct hash_elem* old;
+
+  if (f->merge_listed)
+    hash_delete(&merge_table, &f->merge_elem);
+  f->checksum = checksum;
+  old = hash_replace(&merge_table, &f->merge_elem);
+  if (old != NULL)
+    hash_entry(old, struct frame, merge_elem)->merge_listed = false;
+  f->merge_listed = true;
+}
+
+/* Returns true if frame F, at kernel virtual address KPAGE, whose
+   owner's pagedir_lock the caller holds, is an ordinary private
+   page of its owner that may share a frame with identical pages:
+   not in the page cache, still mapped where it was registered,
+   neither part of a file mapping nor shared memory, and not
+   locked by mlock(), whose pages must not fault again. */
+static bool mergeable(struct frame* f, void* kpage) {
+  struct process* owner = f->owner;
+  struct page* p;
+
+  if (owner == NULL || f->shared || owner->pagedir == NULL ||
+      pagedir_get_page(owner->pagedir, f->upage) != kpage)
+    return false;
+  p = page_find(&owner->pages, f->upage);
+  return p != NULL && !p->mapped && p->shm == NULL && !p->locked;
+}
+
+/* Examines frame F for merging, as described at MERGE_PERIOD.
+   The caller must hold frame_lock. */
+static void merge_frame(struct frame* f) {
+  struct process* owner = f->owner;
+  struct process* other_owner = NULL;
+  struct frame* other = NULL;
+  void* kpage = frame_page(f);
+  void* share = NULL;
+  enum intr_level old_level;
+  bool merged = false;
+  unsigned checksum;
+
+  if (owner == NULL || f->shared || palloc_page_refs(kpage) != 1 ||
+      !lock_try_acquire(&owner->pagedir_lock))
+    return;
+  if (!mergeable(f, kpage) || palloc_page_refs(kpage) != 1) {
+    lock_release(&owner->pagedir_lock);
+    return;
+  }
+  checksum = hash_bytes(kpage, PGSIZE);
+  merge_scanned++;
+
+  if (checksum == zero_checksum)
+    share = palloc_get_zero_page();
+  else {
+    struct frame key;
+    struct hash_elem* e;
+
+    key.checksum = checksum;
+    e = hash_find(&merge_table, &key.merge_elem);
+    if (e != NULL && e != &f->merge_elem) {
+      other = hash_entry(e, struct frame, merge_elem);
+      other_owner = other->owner;
+      share = frame_page(other);
+
+      /* The other frame must still be a private page, or else a
+         page that no one can write without copying it first. */
+      if (other_owner == NULL ||
+          (other_owner != owner && !lock_try_acquire(&other_owner->pagedir_lock)))
+        other_owner = NULL;
+      else if (!mergeable(other, share) ||
+               (palloc_page_refs(share) > 1 &&
+                pagedir_is_writable(other_owner->pagedir, other->upage))) {
+        if (other_owner != owner)
+          lock_release(&other_owner->pagedir_lock);
+        other_owner = NULL;
+      }
+      if (other_owner != NULL)
+        palloc_share_page(share);
+      else
+        share = NULL;
+    }
+  }
+
+  if (share != NULL) {
+    old_level = intr_disable();
+    if (memcmp(kpage, share, PGSIZE) == 0) {
+      if (other_owner != NULL)
+        pagedir_protect_cow(other_owner->pagedir, other->upage);
+      pagedir_move_page(owner->pagedir, f->upage, share);
+      pagedir_protect_cow(owner->pagedir, f->upage);
+      merged = true;
+    }
+    intr_set_level(old_level);
+    if (other_owner != NULL && other_owner != owner)
+      lock_release(&other_owner->pagedir_lock);
+  }
+
+  if (merged) {
+    if (f->merge_listed) {
+      hash_delete(&merge_table, &f->merge_elem);
+      f->merge_listed = false;
+    }
+    f->owner = NULL;
+    f->accessed = false;
+    pagedir_batch_free(kpage);
+    if (other != NULL)
+      merge_cnt++;
+    else
+      merge_zero_cnt++;
+  } else {
+    palloc_free_page(share);
+    if (checksum != zero_checksum)
+      merge_list(f, checksum);
+  }
+  lock_release(&owner->pagedir_lock);
+}
+
+/* Thread function for the merger, which examines merge_batch
+   frames for merging every merge_period ticks, forever. */
+static void merger(void* aux UNUSED) {
+  for (;;) {
+    size_t i, batch;
+
+    timer_sleep(merge_period);
+    batch = merge_batch;
+    lock_acquire(&frame_lock);
+    for (i = 0; i < batch; i++) {
+      if (merge_hand == 0) {
+        /* A new pass: forget the last one's frames. */
+        size_t j;
+        hash_clear(&merge_table, NULL);
+        for (j = 0; j < frame_cnt; j++)
+          frames[j].merge_listed = false;
+      }
+      merge_frame(&frames[merge_hand]);
+      merge_hand = (merge_hand + 1) % frame_cnt;
+    }
+    lock_release(&frame_lock);
+  }
+}
+
+/* Counts the pages of each process that were accessed since the
+   last sweep, as described at WS_PERIOD. */
+static void sample_working_sets(void) {
+  size_t i;
+
+  lock_acquire(&frame_lock);
+  ws_sweep++;
+  for (i = 0; i < frame_cnt; i++) {
+    struct frame* f = &frames[i];
+    struct process* owner = f->owner;
+
+    /* As in frame_evict(), skip processes that are busy with
+       their page directories. */
+    if (owner == NULL || !lock_try_acquire(&owner->pagedir_lock))
+      continue;
+    if (owner->pagedir != NULL && pagedir_get_page(owner->pagedir, f->upage) == frame_page(f) &&
+        pagedir_is_accessed(owner->pagedir, f->upage)) {
+      pagedir_set_accessed(owner->pagedir, f->upage, false);
+      f->accessed = true;
+      if (owner->ws_sweep != ws_sweep) {
+        owner->ws_sweep = ws_sweep;
+        owner->ws_pages = 0;
+      }
+      owner->ws_pages++;
+    }
+    lock_release(&owner->pagedir_lock);
+  }
+  lock_release(&frame_lock);
+}
+
+/* Thread function that samples working sets every WS_PERIOD
+   timer ticks. */
+static void ws_sampler(void* aux UNUSED) {
+  for (;;) {
+    timer_sleep(WS_PERIOD);
+    sample_working_sets();
+    compact_if_fragmented();
+  }
+}
+
+/* Returns the number of OWNER's pages that the latest working
+   set sample found in use. */
+size_t frame_working_set(struct process* owner) {
+  size_t pages;
+
+  if (frames == NULL)
+    return 0;
+
+  lock_acquire(&frame_lock);
+  pages = owner->ws_sweep == ws_sweep ? owner->ws_pages : 0;
+  lock_release(&frame_lock);
+  return pages;
+}
+
+/* Prints frame table statistics. */
+void frame_print_stats(void) {
+  if (frames != NULL)
+    printf("Frames: %zu in user pool, %lld evicted, %lld moved by %lld compactions "
+           "(%lld failed)\n",
+           frame_cnt, evict_cnt, migrate_cnt, compact_cnt, compact_failures);
+  if (frames != NULL)
+    printf("Frames: %lld pages hashed for merging, %lld merged, %lld into the zero page\n",
+           merge_scanned, merge_cnt, merge_zero_cnt);
+}
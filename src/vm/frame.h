@@ -0,0 +1,56 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* Frame table.
+
+   Tracks which process maps each frame of the user pool, and at
+   what address, so that when the user pool runs out
+   palloc_get_page() can evict pages to make room.  Victims are
+   chosen by the clock algorithm, which gives pages whose
+   accessed bit is set a second chance, and evicted in batches.
+   Pages locked by mlock() are passed over, and a process's
+   eviction priority makes the clock give its pages no second
+   chance or several.
+
+   The frame table is also the page cache for file pages that
+   processes map: read-only executable pages and file mapping
+   pages.  A shared frame is known by the inode sector of its file
+   and its offset in the file, and holds a reference of its own,
+   so that it stays around for the next process to map the same
+   page until it is evicted or the file changes.  inode_read_at()
+   reads such pages from their frames, and processes that map the
+   same page share one frame until one of them writes it, so each
+   page is in memory once and is evicted by the clock like any
+   other.  Metadata stays in the buffer cache, sector by sector.
+
+   Since it knows who maps each frame, the frame table can also
+   move private pages to other frames, which frame_compact() does
+   to make a contiguous run of free frames when free memory is
+   too scattered for one.  A low-priority merger thread likewise
+   makes private pages with identical contents share one frame
+   copy-on-write.
+
+   Once a second, the frame table also samples which pages each
+   process has used, for frame_working_set(), and compacts free
+   memory if it is badly broken up. */
+
+struct process;
+
+void frame_init(void);
+void frame_register(void* kpage, struct process* owner, void* upage);
+void frame_release_owner(struct process* owner);
+bool frame_evict(void);
+bool frame_compact(size_t page_cnt);
+size_t frame_working_set(struct process* owner);
+void frame_print_stats(void);
+
+void* frame_find_shared(block_sector_t sector, off_t ofs);
+void* frame_share(void* kpage, block_sector_t sector, off_t ofs);
+void frame_forget_shared(block_sector_t sector, off_t ofs, off_t size);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,161 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+/* A file mapping.  The file itself is referenced by the
+   supplemental page table entries of the mapping's pages. */
+struct mapping {
+  mapid_t id;            /* Identifier returned by mmap(). */
+  uint8_t* addr;         /* First page of the mapping. */
+  size_t page_cnt;       /* Number of pages. */
+  struct list_elem elem; /* Element in process's mappings. */
+};
+
+/* Initializes PCB's list of file mappings as empty. */
+void mmap_init(struct process* pcb) {
+  list_init(&pcb->mappings);
+  pcb->next_mapid = 0;
+}
+
+/* Returns the mapping with identifier ID in PCB, or a null
+   pointer if there is none. */
+static struct mapping* find_mapping(struct process* pcb, mapid_t id) {
+  struct list_elem* e;
+
+  for (e = list_begin(&pcb->mappings); e != list_end(&pcb->mappings); e = list_next(e)) {
+    struct mapping* m = list_entry(e, struct mapping, elem);
+    if (m->id == id)
+      return m;
+  }
+  return NULL;
+}
+
+/* Removes the pages of mapping M of PCB, writing back the ones
+   the process changed, and frees M.  The caller must hold PCB's
+   pagedir_lock. */
+static void unmap(struct process* pcb, struct mapping* m) {
+  struct tlb_batch batch;
+  size_t i;
+
+  pagedir_batch_begin(&batch, pcb->pagedir);
+  for (i = 0; i < m->page_cnt; i++)
+    page_release(&pcb->pages, pcb->pagedir, m->addr + i * PGSIZE);
+  pagedir_batch_end(&batch);
+  list_remove(&m->elem);
+  free(m);
+}
+
+/* Maps FILE into the current process's address space starting at
+   ADDR, which must be page-aligned, and returns the new mapping's
+   identifier.  The mapping has its own reference to the file, so
+   it outlives FILE being closed.  Returns MAP_FAILED if FILE is
+   empty, if ADDR is null or unaligned, if the mapping would
+   overlap pages already in use or the stacks, or if memory
+   allocation fails. */
+mapid_t mmap_map(struct file* file, void* addr) {
+  struct process* pcb = thread_current()->pcb;
+  off_t length = file_length(file);
+  size_t page_cnt = DIV_ROUND_UP(length, PGSIZE);
+  struct mapping* m;
+  struct file* reopened;
+  size_t i;
+
+  if (length == 0 || addr == NULL || pg_ofs(addr) != 0)
+    return MAP_FAILED;
+  if ((uintptr_t)addr + page_cnt * PGSIZE < (uintptr_t)addr ||
+      process_is_stack_addr((uint8_t*)addr + page_cnt * PGSIZE - 1) ||
+      !is_user_vaddr((uint8_t*)addr + page_cnt * PGSIZE - 1))
+    return MAP_FAILED;
+
+  m = malloc(sizeof *m);
+  reopened = file_reopen(file);
+  if (m == NULL || reopened == NULL) {
+    free(m);
+    file_close(reopened);
+    return MAP_FAILED;
+  }
+  m->addr = addr;
+  m->page_cnt = 0;
+
+  lock_acquire(&pcb->pagedir_lock);
+  for (i = 0; i < page_cnt; i++) {
+    uint8_t* upage = m->addr + i * PGSIZE;
+    off_t ofs = i * PGSIZE;
+    uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+    if (page_exists(&pcb->pages, upage) ||
+        !page_add_mapping(&pcb->pages, upage, reopened, ofs, read_bytes))
+      break;
+    m->page_cnt++;
+  }
+  if (m->page_cnt == page_cnt) {
+    m->id = pcb->next_mapid++;
+    list_push_back(&pcb->mappings, &m->elem);
+  } else {
+    for (i = 0; i < m->page_cnt; i++)
+      page_remove(&pcb->pages, m->addr + i * PGSIZE);
+    free(m);
+    m = NULL;
+  }
+  lock_release(&pcb->pagedir_lock);
+
+  /* The pages hold their own references to the file. */
+  file_close(reopened);
+  return m != NULL ? m->id : MAP_FAILED;
+}
+
+/* Removes the current process's mapping ID, writing back the
+   pages that the process changed.  Returns false if there is no
+   such mapping. */
+bool mmap_unmap(mapid_t id) {
+  struct process* pcb = thread_current()->pcb;
+  struct mapping* m;
+
+  lock_acquire(&pcb->pagedir_lock);
+  m = find_mapping(pcb, id);
+  if (m != NULL)
+    unmap(pcb, m);
+  lock_release(&pcb->pagedir_lock);
+  return m != NULL;
+}
+
+/* Gives DST, for fork(), a copy of each of SRC's mappings.  The
+   pages themselves are copied along with SRC's supplemental page
+   table.  Returns false if memory allocation fails, in which case
+   DST is left with no mappings. */
+bool mmap_copy(struct process* dst, struct process* src) {
+  struct list_elem* e;
+
+  mmap_init(dst);
+  dst->next_mapid = src->next_mapid;
+  for (e = list_begin(&src->mappings); e != list_end(&src->mappings); e = list_next(e)) {
+    struct mapping* m = list_entry(e, struct mapping, elem);
+    struct mapping* copy = malloc(sizeof *copy);
+    if (copy == NULL) {
+      while (!list_empty(&dst->mappings))
+        free(list_entry(list_pop_front(&dst->mappings), struct mapping, elem));
+      return false;
+    }
+    *copy = *m;
+    list_push_back(&dst->mappings, &copy->elem);
+  }
+  return true;
+}
+
+/* Removes all of PCB's mappings, writing back the pages that the
+   process changed, as when the process exits. */
+void mmap_unmap_all(struct process* pcb) {
+  lock_acquire(&pcb->pagedir_lock);
+  while (!list_empty(&pcb->mappings))
+    unmap(pcb, list_entry(list_front(&pcb->mappings), struct mapping, elem));
+  lock_release(&pcb->pagedir_lock);
+}
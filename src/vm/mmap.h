@@ -0,0 +1,28 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <stdbool.h>
+
+/* Memory-mapped files.
+
+   mmap() maps a whole file at a page-aligned user address.  The
+   kernel reads nothing up front: each page of the mapping is an
+   entry in the supplemental page table that the first touch
+   reads in straight from the file.  Pages the process changes go
+   back to the file when they are evicted, and when the mapping
+   is removed by munmap() or process exit. */
+
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t)-1)
+
+struct file;
+struct process;
+
+mapid_t mmap_map(struct file*, void* addr);
+bool mmap_unmap(mapid_t);
+void mmap_init(struct process*);
+bool mmap_copy(struct process* dst, struct process* src);
+void mmap_unmap_all(struct process*);
+
+#endif /* vm/mmap.h */
@@ -0,0 +1,351 @@
+#include "vm/mq.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/percpu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/uaccess.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* A message. */
+struct message {
+  struct list_elem elem; /* Element in its queue's messages. */
+  size_t size;           /* Length in bytes. */
+  void* frames[];        /* User pool frames, one per page. */
+};
+
+/* A message queue. */
+struct mq {
+  mqid_t id;                  /* Identifier returned by mq_create(). */
+  struct process* creator;    /* Process that created it, until it exits. */
+  size_t ref_cnt;             /* Threads in mq_send() or mq_receive(). */
+  struct list_elem elem;      /* Element in queues, until the creator exits. */
+  struct list messages;       /* Queued messages, oldest first. */
+  size_t msg_cnt;             /* Number of messages. */
+  struct condition not_full;  /* Signaled when a message is taken out. */
+  struct condition not_empty; /* Signaled when a message is queued. */
+};
+
+/* Queues whose creators are still running. */
+static struct list queues;
+static mqid_t next_id;
+
+/* Protects queues, next_id, and the members of every queue.
+   Never held while touching user memory. */
+static struct lock mq_lock;
+
+/* Pages handed over between address spaces, and pages copied. */
+static struct percpu_counter moved_cnt, copied_cnt;
+
+/* Initializes the message queue list. */
+void mq_init(void) {
+  list_init(&queues);
+  lock_init_named(&mq_lock, "mq");
+}
+
+/* Returns the number of frames that holds a message of SIZE
+   bytes. */
+static size_t frame_cnt(size_t size) { return DIV_ROUND_UP(size, PGSIZE); }
+
+/* Frees message M. */
+static void free_message(struct message* m) {
+  size_t i;
+
+  for (i = 0; i < frame_cnt(m->size); i++)
+    palloc_free_page(m->frames[i]);
+  free(m);
+}
+
+/* Frees queue Q, whose creator has exited and which no thread
+   is using any more.  The caller must hold mq_lock. */
+static void destroy(struct mq* q) {
+  ASSERT(q->ref_cnt == 0 && q->creator == NULL);
+
+  while (!list_empty(&q->messages))
+    free_message(list_entry(list_pop_front(&q->messages), struct message, elem));
+  free(q);
+}
+
+/* Returns queue ID with a reference added, or a null pointer if
+   there is no such queue. */
+static struct mq* get_queue(mqid_t id) {
+  struct list_elem* e;
+
+  lock_acquire(&mq_lock);
+  for (e = list_begin(&queues); e != list_end(&queues); e = list_next(e)) {
+    struct mq* q = list_entry(e, struct mq, elem);
+    if (q->id == id) {
+      q->ref_cnt++;
+      lock_release(&mq_lock);
+      return q;
+    }
+  }
+  lock_release(&mq_lock);
+  return NULL;
+}
+
+/* Drops a reference to queue Q, freeing Q if that was the last
+   one and its creator has exited.  The caller must hold
+   mq_lock. */
+static void put_queue(struct mq* q) {
+  ASSERT(q->ref_cnt > 0);
+  if (--q->ref_cnt == 0 && q->creator == NULL)
+    destroy(q);
+}
+
+/* Creates an empty message queue and returns its identifier,
+   which any process can pass to mq_send() and mq_receive().
+   Returns MQ_FAILED if memory allocation fails. */
+mqid_t mq_create(void) {
+  struct mq* q = malloc(sizeof *q);
+
+  if (q == NULL)
+    return MQ_FAILED;
+  q->creator = thread_current()->pcb;
+  q->ref_cnt = 0;
+  list_init(&q->messages);
+  q->msg_cnt = 0;
+  cond_init(&q->not_full);
+  cond_init(&q->not_empty);
+
+  lock_acquire(&mq_lock);
+  q->id = next_id++;
+  list_push_back(&queues, &q->elem);
+  lock_release(&mq_lock);
+  return q->id;
+}
+
+/* Unmaps page UPAGE from the current process and returns its
+   frame, which the caller owns from then on, if the process alone
+   maps it and it is a private page of anonymous memory that the
+   process may write.  The page reads back as zeros afterward.
+   Returns a null pointer, leaving the page alone, otherwise. */
+static void* take_frame(void* upage) {
+  struct process* pcb = thread_current()->pcb;
+  void* kpage = NULL;
+  struct page* p;
+
+  lock_acquire(&pcb->pagedir_lock);
+  p = page_find(&pcb->pages, upage);
+  if (p != NULL && p->file == NULL && p->shm == NULL && !p->mapped && !p->locked &&
+      pagedir_is_writable(pcb->pagedir, upage)) {
+    kpage = pagedir_get_page(pcb->pagedir, upage);
+    if (!palloc_is_zero_page(kpage) && palloc_page_refs(kpage) == 1) {
+      /* The frame table notices that the frame is no longer
+         ours, and forgets it, when the clock comes by. */
+      pagedir_clear_page(pcb->pagedir, upage);
+      p->dirty = false;
+    } else
+      kpage = NULL;
+  }
+  lock_release(&pcb->pagedir_lock);
+  return kpage;
+}
+
+/* Maps frame KPAGE at page UPAGE of the current process in place
+   of the page that is there, which must be a writable page that
+   is neither part of a file mapping nor shared memory, and
+   returns true.  Returns false, leaving KPAGE to the caller,
+   otherwise. */
+static bool give_frame(void* upage, void* kpage) {
+  struct process* pcb = thread_current()->pcb;
+  bool success = false;
+  struct page* p;
+
+  lock_acquire(&pcb->pagedir_lock);
+  p = page_find(&pcb->pages, upage);
+  if (p != NULL && p->writable && p->shm == NULL && !p->mapped) {
+    void* old = pagedir_get_page(pcb->pagedir, upage);
+
+    if (old != NULL) {
+      pagedir_clear_page(pcb->pagedir, upage);
+      palloc_free_page(old);
+    }
+    if (p->swap_slot != SWAP_ERROR) {
+      swap_free(p->swap_slot);
+      p->swap_slot = SWAP_ERROR;
+    }
+
+    /* The new contents are in neither swap nor the page's file,
+       so if the page is evicted it must go to swap. */
+    p->dirty = true;
+    success = pagedir_set_page(pcb->pagedir, upage, kpage, true);
+    if (success) {
+      pagedir_set_dirty(pcb->pagedir, upage, true);
+      frame_register(kpage, pcb, upage);
+    }
+  }
+  lock_release(&pcb->pagedir_lock);
+  return success;
+}
+
+/* Makes a message out of the SIZE bytes at user address BUF and
+   stores it in *MP.  Returns 0 if successful, -1 if memory
+   allocation fails, or MQ_FAULT if BUF is bad. */
+static int make_message(const uint8_t* buf, size_t size, struct message** mp) {
+  size_t cnt = frame_cnt(size);
+  struct message* m;
+  size_t i;
+
+  m = malloc(sizeof *m + cnt * sizeof *m->frames);
+  if (m == NULL)
+    return -1;
+  m->size = 0;
+  for (i = 0; i < cnt; i++) {
+    size_t chunk = size - i * PGSIZE < PGSIZE ? size - i * PGSIZE : PGSIZE;
+    const uint8_t* ubuf = buf + i * PGSIZE;
+    void* kpage = NULL;
+
+    if (chunk == PGSIZE && pg_ofs(ubuf) == 0 && is_user_vaddr(ubuf))
+      kpage = take_frame((void*)ubuf);
+    if (kpage != NULL)
+      percpu_counter_inc(&moved_cnt);
+    else {
+      kpage = palloc_get_page(PAL_USER);
+      if (kpage == NULL || !copy_from_user(kpage, ubuf, chunk)) {
+        palloc_free_page(kpage);
+        free_message(m);
+        return kpage == NULL ? -1 : MQ_FAULT;
+      }
+      percpu_counter_inc(&copied_cnt);
+    }
+    m->frames[i] = kpage;
+    m->size += chunk;
+  }
+  *mp = m;
+  return 0;
+}
+
+/* Queues the SIZE bytes at user address BUF as a message in
+   queue ID, waiting while the queue is full, and returns 0.
+   Full pages of a page-aligned BUF may be handed over rather than
+   copied, as described at the top of vm/mq.h, leaving zeros in
+   their place.  Returns -1 if there is no queue ID, if SIZE is
+   more than MQ_MSG_MAX, if memory allocation fails, or if the
+   queue's creator exits meanwhile, or MQ_FAULT if BUF is bad. */
+int mq_send(mqid_t id, const void* buf, size_t size) {
+  struct message* m;
+  struct mq* q;
+  int result;
+
+  if (size > MQ_MSG_MAX)
+    return -1;
+  q = get_queue(id);
+  if (q == NULL)
+    return -1;
+
+  result = make_message(buf, size, &m);
+  lock_acquire(&mq_lock);
+  if (result == 0) {
+    while (q->msg_cnt >= MQ_DEPTH && q->creator != NULL)
+      cond_wait(&q->not_full, &mq_lock);
+    if (q->creator != NULL) {
+      list_push_back(&q->messages, &m->elem);
+      q->msg_cnt++;
+      cond_signal(&q->not_empty, &mq_lock);
+    } else {
+      free_message(m);
+      result = -1;
+    }
+  }
+  put_queue(q);
+  lock_release(&mq_lock);
+  return result;
+}
+
+/* Moves message M into the user buffer BUF, handing over its
+   full pages where BUF is page-aligned, and frees M.  Returns M's
+   length, or MQ_FAULT if BUF is bad. */
+static int deliver(struct message* m, uint8_t* buf) {
+  int result = m->size;
+  size_t i;
+
+  for (i = 0; i < frame_cnt(m->size); i++) {
+    size_t chunk = m->size - i * PGSIZE < PGSIZE ? m->size - i * PGSIZE : PGSIZE;
+    uint8_t* ubuf = buf + i * PGSIZE;
+
+    if (result != MQ_FAULT && chunk == PGSIZE && pg_ofs(ubuf) == 0 && is_user_vaddr(ubuf) &&
+        give_frame(ubuf, m->frames[i])) {
+      m->frames[i] = NULL;
+      continue;
+    }
+    if (result != MQ_FAULT && !copy_to_user(ubuf, m->frames[i], chunk))
+      result = MQ_FAULT;
+    palloc_free_page(m->frames[i]);
+  }
+  free(m);
+  return result;
+}
+
+/* Takes the oldest message out of queue ID, waiting for one if
+   the queue is empty, and stores it in the SIZE bytes at user
+   address BUF.  Full pages of the message may be mapped into a
+   page-aligned BUF in place of the pages there, rather than
+   copied.  Returns the message's length.  Returns -1 if there is
+   no queue ID or if its creator exits while waiting, or if the
+   oldest message is longer than SIZE, in which case it stays
+   queued.  Returns MQ_FAULT if BUF is bad, in which case the
+   message is lost. */
+int mq_receive(mqid_t id, void* buf, size_t size) {
+  struct message* m = NULL;
+  struct mq* q = get_queue(id);
+
+  if (q == NULL)
+    return -1;
+
+  lock_acquire(&mq_lock);
+  while (list_empty(&q->messages) && q->creator != NULL)
+    cond_wait(&q->not_empty, &mq_lock);
+  if (q->creator != NULL) {
+    m = list_entry(list_front(&q->messages), struct message, elem);
+    if (m->size <= size) {
+      list_remove(&m->elem);
+      q->msg_cnt--;
+      cond_signal(&q->not_full, &mq_lock);
+    } else
+      m = NULL;
+  }
+  put_queue(q);
+  lock_release(&mq_lock);
+
+  return m != NULL ? deliver(m, buf) : -1;
+}
+
+/* Destroys the queues that PCB created, as when PCB exits,
+   waking up any threads that wait on them. */
+void mq_exit(struct process* pcb) {
+  struct list_elem* e;
+
+  lock_acquire(&mq_lock);
+  for (e = list_begin(&queues); e != list_end(&queues);) {
+    struct mq* q = list_entry(e, struct mq, elem);
+    e = list_next(e);
+    if (q->creator == pcb) {
+      list_remove(&q->elem);
+      q->creator = NULL;
+      cond_broadcast(&q->not_full, &mq_lock);
+      cond_broadcast(&q->not_empty, &mq_lock);
+      if (q->ref_cnt == 0)
+        destroy(q);
+    }
+  }
+  lock_release(&mq_lock);
+}
+
+/* Prints message queue statistics. */
+void mq_print_stats(void) {
+  int64_t moved = percpu_counter_sum(&moved_cnt);
+  int64_t copied = percpu_counter_sum(&copied_cnt);
+
+  if (moved + copied > 0)
+    printf("Message queues: %lld pages handed over, %lld pages copied\n", moved, copied);
+}
@@ -0,0 +1,50 @@
+#ifndef VM_MQ_H
+#define VM_MQ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Message queues.
+
+   mq_send() queues a copy of a user buffer as one message, and
+   mq_receive() takes the oldest message out of a queue into a
+   user buffer, so that processes can pass data in whole messages
+   rather than through a byte stream.  A message is kept in user
+   pool frames, one per page of it.  When a sender's buffer is
+   page-aligned, each full page of it that the sender alone maps,
+   and that is not part of a file, is handed over as it is: the
+   frame is unmapped from the sender, whose page reads back as
+   zeros afterward, and is mapped into the receiver in place of
+   the page of its buffer, if that is page-aligned too.  A large
+   message between aligned buffers then costs two page table
+   updates per page instead of two copies.  Other pages, and the
+   partial ends of unaligned buffers, are copied.
+
+   A queue holds at most MQ_DEPTH messages, each at most
+   MQ_MSG_MAX bytes.  mq_send() waits for room, mq_receive() for
+   a message.  A queue lives until its creator exits, at which
+   point its messages are dropped and waiters give up. */
+
+/* Message queue identifier. */
+typedef int mqid_t;
+#define MQ_FAILED ((mqid_t)-1)
+
+/* Most messages in a queue. */
+#define MQ_DEPTH 16
+
+/* Largest message, in bytes. */
+#define MQ_MSG_MAX (64 * 1024)
+
+/* Returned by mq_send() and mq_receive() for a bad user buffer. */
+#define MQ_FAULT -2
+
+struct process;
+
+void mq_init(void);
+mqid_t mq_create(void);
+int mq_send(mqid_t, const void* buf, size_t size);
+int mq_receive(mqid_t, void* buf, size_t size);
+void mq_exit(struct process*);
+void mq_print_stats(void);
+
+#endif /* vm/mq.h */
@@ -0,0 +1,406 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+
+/* Pages locked by mlock() in every process, which may be at most
+   1/LOCKED_SHARE of the user pool, so that eviction always has
+   something to work with.  Interrupts off. */
+#define LOCKED_SHARE 2
+static size_t locked_cnt;
+
+/* Returns a hash value for page P. */
+static unsigned page_hash(const struct hash_elem* p_, void* aux UNUSED) {
+  const struct page* p = hash_entry(p_, struct page, elem);
+  return hash_bytes(&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool page_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  const struct page* a = hash_entry(a_, struct page, elem);
+  const struct page* b = hash_entry(b_, struct page, elem);
+  return a->upage < b->upage;
+}
+
+/* Releases P's swap slot, closes P's file and frees P. */
+static void page_destroy(struct hash_elem* p_, void* aux UNUSED) {
+  struct page* p = hash_entry(p_, struct page, elem);
+  page_set_locked(p, false);
+  if (p->swap_slot != SWAP_ERROR)
+    swap_free(p->swap_slot);
+  if (p->shm != NULL)
+    shm_unref(p->shm);
+  file_close(p->file);
+  free(p);
+}
+
+/* Returns the page containing user virtual address UPAGE in
+   PAGES, or a null pointer if there is none. */
+struct page* page_find(struct hash* pages, const void* upage) {
+  struct page p;
+  struct hash_elem* e;
+
+  p.upage = pg_round_down(upage);
+  e = hash_find(pages, &p.elem);
+  return e != NULL ? hash_entry(e, struct page, elem) : NULL;
+}
+
+/* Initializes PAGES as an empty supplemental page table.
+   Returns false if memory allocation fails.  The table resizes
+   incrementally so that a page fault never pays for moving every
+   page of a large process. */
+bool page_table_init(struct hash* pages) {
+  return hash_init_mode(pages, page_hash, page_less, NULL, HASH_INCREMENTAL);
+}
+
+/* Initializes DST as a copy of supplemental page table SRC, for
+   fork().  Returns false if memory allocation fails, in which
+   case DST is left uninitialized. */
+bool page_table_copy(struct hash* dst, struct hash* src) {
+  struct hash_iterator i;
+  bool success = true;
+
+  if (!page_table_init(dst))
+    return false;
+
+  hash_first(&i, src);
+  while (success && hash_next(&i)) {
+    struct page* p = hash_entry(hash_cur(&i), struct page, elem);
+    struct page* copy = malloc(sizeof *copy);
+    if (copy != NULL) {
+      *copy = *p;
+      copy->locked = false;
+      file_ref(copy->file);
+      if (copy->swap_slot != SWAP_ERROR)
+        swap_ref(copy->swap_slot);
+      if (copy->shm != NULL)
+        shm_ref(copy->shm);
+      hash_insert(dst, &copy->elem);
+    } else
+      success = false;
+  }
+  if (!success)
+    hash_destroy(dst, page_destroy);
+  return success;
+}
+
+/* Frees PAGES and everything in it, including swap slots.  The
+   frames that the pages were loaded into belong to the page
+   directory, which frees them. */
+void page_table_destroy(struct hash* pages) {
+  hash_destroy(pages, page_destroy);
+}
+
+/* Adds a page to PAGES, as described for page_add_file(), and
+   makes it part of a file mapping if MAPPED is true. */
+static bool add_page(struct hash* pages, void* upage, struct file* file, off_t ofs,
+                     uint32_t read_bytes, bool writable, bool mapped) {
+  struct page* p;
+
+  ASSERT(pg_ofs(upage) == 0);
+  ASSERT(is_user_vaddr(upage));
+  ASSERT(read_bytes <= PGSIZE);
+
+  p = malloc(sizeof *p);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->file = read_bytes > 0 ? file : NULL;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->writable = writable;
+  p->dirty = false;
+  p->mapped = mapped;
+  p->shm = NULL;
+  p->advice = MADV_NORMAL;
+  p->locked = false;
+  p->swap_slot = SWAP_ERROR;
+  if (hash_insert(pages, &p->elem) != NULL) {
+    free(p);
+    return false;
+  }
+  file_ref(p->file);
+  return true;
+}
+
+/* Adds to PAGES the page at user virtual address UPAGE, to be
+   filled with READ_BYTES bytes from FILE at offset OFS followed
+   by zeros, and writable by the user if WRITABLE is true.
+   Returns false if UPAGE is already in PAGES or memory
+   allocation fails. */
+bool page_add_file(struct hash* pages, void* upage, struct file* file, off_t ofs,
+                   uint32_t read_bytes, bool writable) {
+  return add_page(pages, upage, file, ofs, read_bytes, writable, false);
+}
+
+/* Adds to PAGES the writable page at user virtual address UPAGE,
+   which maps the READ_BYTES bytes of FILE at offset OFS.  Unlike
+   a page added by page_add_file(), changes to it are written
+   back to FILE, instead of to swap, when it is evicted or
+   released.  Returns false if UPAGE is already in PAGES or
+   memory allocation fails. */
+bool page_add_mapping(struct hash* pages, void* upage, struct file* file, off_t ofs,
+                      uint32_t read_bytes) {
+  ASSERT(read_bytes > 0);
+  return add_page(pages, upage, file, ofs, read_bytes, true, true);
+}
+
+/* Adds to PAGES the page at user virtual address UPAGE, which is
+   page OFS of shared memory region SHM, and adds a reference to
+   SHM for it.  The caller maps the region's frame there itself:
+   shared pages are never loaded or evicted.  Returns false if
+   UPAGE is already in PAGES or memory allocation fails. */
+bool page_add_shm(struct hash* pages, void* upage, struct shm* shm, off_t ofs) {
+  struct page* p;
+
+  if (!add_page(pages, upage, NULL, ofs, 0, true, false))
+    return false;
+  p = page_find(pages, upage);
+  p->shm = shm;
+  shm_ref(shm);
+  return true;
+}
+
+/* Returns true if user virtual address UPAGE is in PAGES. */
+bool page_exists(struct hash* pages, const void* upage) {
+  return page_find(pages, upage) != NULL;
+}
+
+/* Writes the contents of file mapping page P, which are in frame
+   KPAGE, back to its file. */
+static void write_back(struct page* p, const void* kpage) {
+  ASSERT(p->mapped);
+  file_write_at(p->file, kpage, p->read_bytes, p->ofs);
+}
+
+/* Removes the page at user virtual address UPAGE from PAGES, if
+   it is there.  Does not unmap it from the page directory. */
+void page_remove(struct hash* pages, void* upage) {
+  struct page* p = page_find(pages, upage);
+
+  if (p != NULL) {
+    hash_delete(pages, &p->elem);
+    page_destroy(&p->elem, NULL);
+  }
+}
+
+/* Unmaps UPAGE from page directory PD, frees its frame, and
+   removes it from PAGES, first writing it back to its file if it
+   is a file mapping page that the process changed. */
+void page_release(struct hash* pages, uint32_t* pd, void* upage) {
+  struct page* p = page_find(pages, upage);
+  void* kpage = pagedir_get_page(pd, upage);
+
+  if (kpage != NULL) {
+    if (p != NULL && p->mapped && pagedir_is_dirty(pd, upage))
+      write_back(p, kpage);
+    pagedir_clear_page(pd, upage);
+    pagedir_batch_free(kpage);
+  }
+  page_remove(pages, upage);
+}
+
+/* Returns true if page P's contents are always those of its
+   file, so that it can come from the page cache: it is a
+   read-only page of an executable, or a page of a file mapping,
+   whose changes go back to the file rather than to swap.  A
+   partial page at the end of a segment may differ from the same
+   file page at the start of the next, which is not zero-filled,
+   so only full pages are cached. */
+static bool is_shareable(const struct page* p) {
+  return p->file != NULL && (!p->writable || p->mapped) && p->read_bytes == PGSIZE &&
+         p->swap_slot == SWAP_ERROR;
+}
+
+/* Maps page P into page directory PD, reading it in first into
+   a frame obtained with palloc_get_page(FLAGS), unless the page
+   cache already has it.  A page from the page cache that the user
+   may write, which is a file mapping page, is mapped
+   copy-on-write, so that the first write gives PD a private copy
+   to write back; for a fault that is a write, as WRITE says, the
+   copy is made at once.  A page of zeros that is not about to be
+   written is mapped to the zero page instead, until the first
+   write to it.  Sets *MAJOR to true if the page had to be read
+   from swap or its file, false otherwise.  Returns true if
+   successful, false if memory allocation or the read fails. */
+static bool load(struct page* p, uint32_t* pd, enum palloc_flags flags, bool write, bool* major) {
+  bool cacheable = is_shareable(p) && !(write && p->writable);
+  block_sector_t sector = 0;
+  uint8_t* cached = NULL;
+  uint8_t* kpage = NULL;
+  bool mapped;
+
+  ASSERT(p->shm == NULL);
+
+  *major = false;
+  if (!write && p->read_bytes == 0 && p->swap_slot == SWAP_ERROR && !p->dirty &&
+      pagedir_set_zero_page(pd, p->upage, p->writable))
+    return true;
+
+  if (is_shareable(p)) {
+    sector = inode_get_inumber(file_get_inode(p->file));
+    cached = frame_find_shared(sector, p->ofs);
+    if (cached != NULL && cacheable) {
+      kpage = cached;
+      goto map;
+    }
+  }
+
+  kpage = palloc_get_page(flags);
+  if (kpage == NULL) {
+    if (cached != NULL)
+      palloc_free_page(cached);
+    return false;
+  }
+
+  *major = p->swap_slot != SWAP_ERROR || (p->read_bytes > 0 && cached == NULL);
+  if (cached != NULL) {
+    /* About to be written: start from a private copy. */
+    memcpy(kpage, cached, PGSIZE);
+    palloc_free_page(cached);
+  } else if (p->swap_slot != SWAP_ERROR) {
+    swap_read(p->swap_slot, kpage);
+    swap_free(p->swap_slot);
+    p->swap_slot = SWAP_ERROR;
+  } else if (p->read_bytes > 0) {
+    struct inode* inode = file_get_inode(p->file);
+    unsigned generation = inode_generation(inode);
+
+    if (file_read_at(p->file, kpage, p->read_bytes, p->ofs) != (off_t)p->read_bytes) {
+      palloc_free_page(kpage);
+      return false;
+    }
+    memset(kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+    if (cacheable) {
+      kpage = frame_share(kpage, sector, p->ofs);
+
+      /* A write that finished during the read may have come too
+         late for us to see it, but too early to find the page
+         in the cache and drop it.  Drop it ourselves. */
+      if (inode_generation(inode) != generation)
+        frame_forget_shared(sector, p->ofs, PGSIZE);
+    }
+  } else
+    pg_zero(kpage);
+
+map:
+  if (cacheable && p->writable)
+    mapped = pagedir_set_cow_page(pd, p->upage, kpage);
+  else
+    mapped = pagedir_set_page(pd, p->upage, kpage, p->writable);
+  if (!mapped) {
+    palloc_free_page(kpage);
+    return false;
+  }
+  /* A page read back from swap must go back to swap if it is
+     evicted again, even if it is not written meanwhile. */
+  pagedir_set_dirty(pd, p->upage, p->dirty);
+  return true;
+}
+
+/* Maps the page of PAGES that contains user virtual address
+   UPAGE into page directory PD, reading it in first, for an
+   access that is a write if WRITE is true.  Sets *MAJOR to true
+   if that took a read from swap or the page's file.  Returns true
+   if successful or if UPAGE is already mapped, false if UPAGE is
+   not in PAGES or memory allocation or the read fails. */
+bool page_load(struct hash* pages, uint32_t* pd, void* upage, bool write, bool* major) {
+  struct page* p = page_find(pages, upage);
+
+  *major = false;
+  if (p == NULL)
+    return false;
+  if (pagedir_get_page(pd, p->upage) != NULL)
+    return true;
+  return load(p, pd, PAL_USER, write, major);
+}
+
+/* Like page_load(), but only if UPAGE is not mapped yet and
+   there is a free frame for it without evicting another page.
+   Used to read ahead of a fault. */
+bool page_prefetch(struct hash* pages, uint32_t* pd, void* upage) {
+  struct page* p = page_find(pages, upage);
+  bool major;
+
+  if (p == NULL || pagedir_get_page(pd, p->upage) != NULL)
+    return false;
+  return load(p, pd, PAL_USER | PAL_NOEVICT, false, &major);
+}
+
+/* Unmaps UPAGE from page directory PD so that its frame can be
+   evicted, and returns its entry in PAGES.  Sets *SWAP to true if
+   the page's contents must be written to swap before the frame
+   is freed, because they are not in its file.  A changed file
+   mapping page is written back to its file at once instead.
+   Returns a null pointer if UPAGE is not in PAGES. */
+struct page* page_unmap(struct hash* pages, uint32_t* pd, void* upage, bool* swap) {
+  struct page* p = page_find(pages, upage);
+  void* kpage = pagedir_get_page(pd, upage);
+
+  if (p == NULL)
+    return NULL;
+
+  /* Unmap the page before checking whether it is dirty, so that
+     the process cannot write it again behind our back. */
+  pagedir_clear_page(pd, upage);
+  *swap = false;
+  if (p->mapped) {
+    if (pagedir_is_dirty(pd, upage))
+      write_back(p, kpage);
+  } else
+    *swap = p->dirty || pagedir_is_dirty(pd, upage);
+  return p;
+}
+
+/* Records that page P, unmapped by page_unmap(), has been
+   written to swap slot SLOT. */
+void page_set_swap(struct page* p, size_t slot) {
+  ASSERT(p->swap_slot == SWAP_ERROR);
+
+  p->dirty = true;
+  p->swap_slot = slot;
+}
+
+/* Locks page P into memory if LOCKED is true, so that the frame
+   table does not evict it, or unlocks it if LOCKED is false.
+   Returns false if locking P would lock more than the share of
+   the user pool that LOCKED_SHARE allows. */
+bool page_set_locked(struct page* p, bool locked) {
+  enum intr_level old_level;
+  uint8_t* base;
+  size_t pool_cnt;
+  bool success = true;
+
+  if (p->locked == locked)
+    return true;
+  palloc_user_pool(&base, &pool_cnt);
+
+  old_level = intr_disable();
+  if (!locked)
+    locked_cnt--;
+  else if (locked_cnt < pool_cnt / LOCKED_SHARE)
+    locked_cnt++;
+  else
+    success = false;
+  intr_set_level(old_level);
+
+  if (success)
+    p->locked = locked;
+  return success;
+}
+
+/* Maps page P, unmapped by page_unmap(), back into page
+   directory PD at frame KPAGE, as when swap is full. */
+void page_remap(struct page* p, uint32_t* pd, void* kpage) {
+  pagedir_set_page(pd, p->upage, kpage, p->writable);
+  pagedir_set_dirty(pd, p->upage, true);
+}
@@ -0,0 +1,60 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <mman.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+/* Supplemental page table.
+
+   Records how to fill each page of a process's address space
+   that is not necessarily in its page directory yet, so that
+   load() need not read the executable up front.  Instead,
+   page_fault() calls page_load() the first time the process
+   touches such a page.  The frame table evicts pages back out
+   through page_unmap(), keeping them in swap if they can no
+   longer be read from their files. */
+
+/* A page in a supplemental page table.  Filled from swap slot
+   SWAP_SLOT if it has one, otherwise by reading READ_BYTES bytes
+   from FILE at offset OFS and zeroing the rest of the page. */
+struct page {
+  void* upage;           /* User virtual address. */
+  struct file* file;     /* File to read from, if READ_BYTES > 0. */
+  off_t ofs;             /* Offset in FILE. */
+  uint32_t read_bytes;   /* Bytes to read from FILE. */
+  bool writable;         /* Whether the user may write the page. */
+  bool dirty;            /* Whether the contents differ from FILE. */
+  bool mapped;           /* Part of a file mapping, written back to FILE. */
+  struct shm* shm;       /* Shared memory region, whose page OFS this is. */
+  int advice;            /* MADV_* advice from madvise(). */
+  bool locked;           /* Kept in memory by mlock(). */
+  size_t swap_slot;      /* Swap slot with the contents, or SWAP_ERROR. */
+  struct hash_elem elem; /* Element in supplemental page table. */
+};
+
+bool page_table_init(struct hash* pages);
+bool page_table_copy(struct hash* dst, struct hash* src);
+void page_table_destroy(struct hash* pages);
+
+bool page_add_file(struct hash* pages, void* upage, struct file* file, off_t ofs,
+                   uint32_t read_bytes, bool writable);
+bool page_add_mapping(struct hash* pages, void* upage, struct file* file, off_t ofs,
+                      uint32_t read_bytes);
+bool page_add_shm(struct hash* pages, void* upage, struct shm*, off_t ofs);
+bool page_exists(struct hash* pages, const void* upage);
+void page_remove(struct hash* pages, void* upage);
+void page_release(struct hash* pages, uint32_t* pd, void* upage);
+bool page_load(struct hash* pages, uint32_t* pd, void* upage, bool write, bool* major);
+bool page_prefetch(struct hash* pages, uint32_t* pd, void* upage);
+struct page* page_find(struct hash* pages, const void* upage);
+
+struct page* page_unmap(struct hash* pages, uint32_t* pd, void* upage, bool* swap);
+void page_set_swap(struct page*, size_t slot);
+void page_remap(struct page*, uint32_t* pd, void* kpage);
+bool page_set_locked(struct page*, bool locked);
+
+#endif /* vm/page.h */
@@ -0,0 +1,211 @@
+#include "vm/shm.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+/* A shared memory region. */
+struct shm {
+  shmid_t id;              /* Identifier returned by shm_create(). */
+  struct process* creator; /* Process that created it, until it exits. */
+  size_t ref_cnt;          /* Attached pages, across all processes. */
+  struct list_elem elem;   /* Element in regions. */
+  size_t page_cnt;         /* Number of pages. */
+  void* frames[];          /* The pages, each holding a reference. */
+};
+
+/* All shared memory regions. */
+static struct list regions;
+static shmid_t next_id;
+
+/* Protects regions, next_id, and the members of each region
+   other than FRAMES and PAGE_CNT, which never change.  Acquired
+   with a pagedir_lock held. */
+static struct lock shm_lock;
+
+/* Initializes the shared memory region list. */
+void shm_init(void) {
+  list_init(&regions);
+  lock_init_named(&shm_lock, "shm");
+}
+
+/* Frees region R, which no process holds any more.  The caller
+   must hold shm_lock. */
+static void destroy(struct shm* r) {
+  size_t i;
+
+  ASSERT(r->ref_cnt == 0 && r->creator == NULL);
+
+  list_remove(&r->elem);
+  for (i = 0; i < r->page_cnt; i++)
+    palloc_free_page(r->frames[i]);
+  free(r);
+}
+
+/* Returns the region with identifier ID, or a null pointer if
+   there is none.  The caller must hold shm_lock. */
+static struct shm* find_region(shmid_t id) {
+  struct list_elem* e;
+
+  for (e = list_begin(&regions); e != list_end(&regions); e = list_next(e)) {
+    struct shm* r = list_entry(e, struct shm, elem);
+    if (r->id == id)
+      return r;
+  }
+  return NULL;
+}
+
+/* Creates a region of SIZE bytes, rounded up to whole pages, of
+   zeroed memory and returns its identifier, which any process
+   can pass to shm_attach().  Returns SHM_FAILED if SIZE is 0 or
+   memory allocation fails. */
+shmid_t shm_create(size_t size) {
+  size_t page_cnt = DIV_ROUND_UP(size, PGSIZE);
+  struct shm* r;
+  size_t i;
+
+  if (size == 0 || size > (uintptr_t)PHYS_BASE)
+    return SHM_FAILED;
+
+  r = malloc(sizeof *r + page_cnt * sizeof *r->frames);
+  if (r == NULL)
+    return SHM_FAILED;
+  r->creator = thread_current()->pcb;
+  r->ref_cnt = 0;
+  r->page_cnt = page_cnt;
+  for (i = 0; i < page_cnt; i++) {
+    r->frames[i] = palloc_get_page(PAL_USER | PAL_ZERO);
+    if (r->frames[i] == NULL) {
+      while (i-- > 0)
+        palloc_free_page(r->frames[i]);
+      free(r);
+      return SHM_FAILED;
+    }
+  }
+
+  lock_acquire(&shm_lock);
+  r->id = next_id++;
+  list_push_back(&regions, &r->elem);
+  lock_release(&shm_lock);
+  return r->id;
+}
+
+/* Maps region ID into the current process's address space
+   starting at ADDR, which must be page-aligned, and returns ADDR.
+   Returns a null pointer if there is no region ID, if ADDR is
+   null or unaligned, or if the region would overlap pages already
+   in use or the stacks, or if memory allocation fails. */
+void* shm_attach(shmid_t id, void* addr) {
+  struct process* pcb = thread_current()->pcb;
+  uint8_t* start = addr;
+  struct shm* r;
+  size_t i;
+
+  if (addr == NULL || pg_ofs(addr) != 0)
+    return NULL;
+
+  /* Hold a reference to R while attaching it, so that it cannot
+     go away meanwhile. */
+  lock_acquire(&pcb->pagedir_lock);
+  lock_acquire(&shm_lock);
+  r = find_region(id);
+  if (r != NULL)
+    r->ref_cnt++;
+  lock_release(&shm_lock);
+  if (r == NULL || (uintptr_t)start + r->page_cnt * PGSIZE < (uintptr_t)start ||
+      !is_user_vaddr(start + r->page_cnt * PGSIZE - 1) ||
+      process_is_stack_addr(start + r->page_cnt * PGSIZE - 1))
+    goto fail;
+
+  for (i = 0; i < r->page_cnt; i++) {
+    uint8_t* upage = start + i * PGSIZE;
+
+    if (page_exists(&pcb->pages, upage) || pagedir_get_page(pcb->pagedir, upage) != NULL ||
+        !page_add_shm(&pcb->pages, upage, r, i * PGSIZE))
+      break;
+    if (!pagedir_share_page(pcb->pagedir, upage, r->frames[i])) {
+      page_remove(&pcb->pages, upage);
+      break;
+    }
+    palloc_share_page(r->frames[i]);
+  }
+  if (i < r->page_cnt) {
+    while (i-- > 0)
+      page_release(&pcb->pages, pcb->pagedir, start + i * PGSIZE);
+    goto fail;
+  }
+  shm_unref(r);
+  lock_release(&pcb->pagedir_lock);
+  return addr;
+
+fail:
+  if (r != NULL)
+    shm_unref(r);
+  lock_release(&pcb->pagedir_lock);
+  return NULL;
+}
+
+/* Detaches the region attached at ADDR in the current process.
+   Returns false if no region is attached there. */
+bool shm_detach(void* addr) {
+  struct process* pcb = thread_current()->pcb;
+  struct tlb_batch batch;
+  struct page* p;
+  size_t page_cnt, i;
+
+  lock_acquire(&pcb->pagedir_lock);
+  p = is_user_vaddr(addr) ? page_find(&pcb->pages, addr) : NULL;
+  if (p == NULL || p->shm == NULL || p->upage != addr || p->ofs != 0) {
+    lock_release(&pcb->pagedir_lock);
+    return false;
+  }
+  page_cnt = p->shm->page_cnt;
+  pagedir_batch_begin(&batch, pcb->pagedir);
+  for (i = 0; i < page_cnt; i++)
+    page_release(&pcb->pages, pcb->pagedir, (uint8_t*)addr + i * PGSIZE);
+  pagedir_batch_end(&batch);
+  lock_release(&pcb->pagedir_lock);
+  return true;
+}
+
+/* Gives up the regions that PCB created, as when PCB exits.
+   Regions that are attached somewhere live on. */
+void shm_exit(struct process* pcb) {
+  struct list_elem* e;
+
+  lock_acquire(&shm_lock);
+  for (e = list_begin(&regions); e != list_end(&regions);) {
+    struct shm* r = list_entry(e, struct shm, elem);
+    e = list_next(e);
+    if (r->creator == pcb) {
+      r->creator = NULL;
+      if (r->ref_cnt == 0)
+        destroy(r);
+    }
+  }
+  lock_release(&shm_lock);
+}
+
+/* Adds a reference to region R for an attached page. */
+void shm_ref(struct shm* r) {
+  lock_acquire(&shm_lock);
+  r->ref_cnt++;
+  lock_release(&shm_lock);
+}
+
+/* Drops a reference to region R, freeing R if that was the last
+   one and its creator has exited. */
+void shm_unref(struct shm* r) {
+  lock_acquire(&shm_lock);
+  ASSERT(r->ref_cnt > 0);
+  if (--r->ref_cnt == 0 && r->creator == NULL)
+    destroy(r);
+  lock_release(&shm_lock);
+}
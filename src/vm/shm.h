@@ -0,0 +1,35 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Shared memory regions.
+
+   shm_create() allocates a region of zeroed frames up front, and
+   shm_attach() maps those same frames into the address space of
+   each process that attaches it, so that processes can exchange
+   data without copies or disk I/O.  Each attached page is a
+   supplemental page table entry that holds a reference to its
+   region, so that fork() and process exit keep track of
+   attachments along with the rest of the address space.  A
+   region lives until its creator has exited and no process has it
+   attached.  Its frames are never evicted. */
+
+/* Shared memory region identifier. */
+typedef int shmid_t;
+#define SHM_FAILED ((shmid_t)-1)
+
+struct process;
+struct shm;
+
+void shm_init(void);
+shmid_t shm_create(size_t size);
+void* shm_attach(shmid_t, void* addr);
+bool shm_detach(void* addr);
+void shm_exit(struct process*);
+
+void shm_ref(struct shm*);
+void shm_unref(struct shm*);
+
+#endif /* vm/shm.h */
@@ -0,0 +1,170 @@
+#include "vm/swap.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "vm/zswap.h"
+
+/* Number of sectors in a swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block* swap_block; /* Swap device, or null if there is none. */
+static size_t slot_cnt;          /* Number of slots. */
+static size_t next_slot;         /* Where to start looking for a free slot. */
+
+/* References to each slot, 0 if the slot is free.  A slot is
+   shared when fork() copies a supplemental page table that
+   refers to it. */
+static uint16_t* slot_refs;
+static struct lock swap_lock;
+
+/* Pages read from and written to swap, and of those, the ones
+   that reached the device. */
+static long long swap_in_cnt, swap_out_cnt;
+static long long device_read_cnt, device_write_cnt;
+
+/* Sets up the swap slots on the swap block device, if there is
+   one.  Without one, swap_alloc() always fails. */
+void swap_init(void) {
+  lock_init_named(&swap_lock, "swap");
+  swap_block = block_get_role(BLOCK_SWAP);
+  if (swap_block == NULL)
+    return;
+
+  slot_cnt = block_size(swap_block) / SECTORS_PER_SLOT;
+  slot_refs = calloc(slot_cnt, sizeof *slot_refs);
+  if (slot_refs == NULL)
+    PANIC("swap_init: out of memory");
+  printf("swap: %zu slots on %s\n", slot_cnt, block_name(swap_block));
+
+  /* Compressing pages into memory saves nothing if the swap
+     device is memory already. */
+  if (block_map(swap_block, 0, SECTORS_PER_SLOT, false) == NULL)
+    zswap_init(slot_cnt);
+}
+
+/* Allocates CNT consecutive free swap slots and returns the
+   first, or SWAP_ERROR if there is no such run of slots. */
+size_t swap_alloc(size_t cnt) {
+  size_t first = SWAP_ERROR;
+  size_t run = 0;
+  size_t i;
+
+  ASSERT(cnt > 0);
+
+  lock_acquire(&swap_lock);
+  /* Look for a run starting at or after NEXT_SLOT, wrapping around
+     to the start of the device once. */
+  for (i = 0; i < slot_cnt + cnt - 1 && first == SWAP_ERROR; i++) {
+    size_t s = (next_slot + i) % slot_cnt;
+    if (s == 0)
+      run = 0;
+    run = slot_refs[s] == 0 ? run + 1 : 0;
+    if (run == cnt)
+      first = s + 1 - cnt;
+  }
+  if (first != SWAP_ERROR) {
+    for (i = first; i < first + cnt; i++)
+      slot_refs[i] = 1;
+    next_slot = (first + cnt) % slot_cnt;
+  }
+  lock_release(&swap_lock);
+  return first;
+}
+
+/* Writes the page at KPAGE to swap slot SLOT, which must have
+   been allocated with swap_alloc(): into the compressed cache if
+   it takes the page, otherwise to the device as a single
+   transfer, or a copy if the swap device is in memory. */
+void swap_write(size_t slot, const void* kpage) {
+  ASSERT(slot < slot_cnt);
+  ASSERT(slot_refs[slot] > 0);
+
+  swap_out_cnt++;
+  if (!zswap_store(slot, kpage))
+    swap_write_device(slot, kpage);
+}
+
+/* Writes the page at KPAGE to swap slot SLOT on the device itself,
+   bypassing the compressed cache.  Used by swap_write() and by
+   the cache to write back pages it cannot keep. */
+void swap_write_device(size_t slot, const void* kpage) {
+  void* data;
+
+  ASSERT(slot < slot_cnt);
+
+  data = block_map(swap_block, slot * SECTORS_PER_SLOT, SECTORS_PER_SLOT, true);
+  if (data != NULL)
+    memcpy(data, kpage, PGSIZE);
+  else {
+    device_write_cnt++;
+    block_write_multiple(swap_block, slot * SECTORS_PER_SLOT, SECTORS_PER_SLOT, kpage);
+  }
+}
+
+/* Reads swap slot SLOT into the page at KPAGE, from the
+   compressed cache if it is there, otherwise as a single
+   transfer, or a copy if the swap device is in memory, and
+   charges the read to the running process.  The slot stays
+   allocated until swap_free(). */
+void swap_read(size_t slot, void* kpage) {
+  struct thread* cur = thread_current();
+  const void* data;
+
+  ASSERT(slot < slot_cnt);
+  ASSERT(slot_refs[slot] > 0);
+
+  swap_in_cnt++;
+  if (cur->pcb != NULL)
+    cur->pcb->usage.swap_ins++;
+
+  if (zswap_load(slot, kpage))
+    return;
+  data = block_map(swap_block, slot * SECTORS_PER_SLOT, SECTORS_PER_SLOT, false);
+  if (data != NULL)
+    memcpy(kpage, data, PGSIZE);
+  else {
+    device_read_cnt++;
+    block_read_multiple(swap_block, slot * SECTORS_PER_SLOT, SECTORS_PER_SLOT, kpage);
+  }
+}
+
+/* Adds a reference to swap slot SLOT, so that it takes one more
+   swap_free() to free it. */
+void swap_ref(size_t slot) {
+  ASSERT(slot < slot_cnt);
+
+  lock_acquire(&swap_lock);
+  ASSERT(slot_refs[slot] > 0 && slot_refs[slot] < UINT16_MAX);
+  slot_refs[slot]++;
+  lock_release(&swap_lock);
+}
+
+/* Drops a reference to swap slot SLOT, freeing it once the last
+   reference is gone. */
+void swap_free(size_t slot) {
+  ASSERT(slot < slot_cnt);
+
+  /* The cached copy goes while swap_lock is still held, before
+     swap_alloc() can hand out the slot again. */
+  lock_acquire(&swap_lock);
+  ASSERT(slot_refs[slot] > 0);
+  if (--slot_refs[slot] == 0)
+    zswap_forget(slot);
+  lock_release(&swap_lock);
+}
+
+/* Prints swap statistics. */
+void swap_print_stats(void) {
+  if (swap_block != NULL) {
+    printf("Swap: %lld pages in, %lld pages out, %zu slots, %lld device reads, "
+           "%lld device writes\n",
+           swap_in_cnt, swap_out_cnt, slot_cnt, device_read_cnt, device_write_cnt);
+    zswap_print_stats();
+  }
+}
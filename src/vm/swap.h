@@ -0,0 +1,32 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Swap slots.
+
+   The swap block device is divided into page-size slots.  A slot
+   holds one evicted page until the page is read back in or
+   every page table that refers to it is gone.  Pages evicted
+   together get consecutive slots, so that reading them back
+   can avoid seeking.
+
+   Unless the swap device is itself in memory, a slot's page is
+   kept compressed in memory by vm/zswap.c while there is room,
+   and only goes to the device when it is crowded out. */
+
+/* Returned by swap_alloc() when there are not enough free
+   slots. */
+#define SWAP_ERROR SIZE_MAX
+
+void swap_init(void);
+size_t swap_alloc(size_t cnt);
+void swap_write(size_t slot, const void* kpage);
+void swap_write_device(size_t slot, const void* kpage);
+void swap_read(size_t slot, void* kpage);
+void swap_ref(size_t slot);
+void swap_free(size_t slot);
+void swap_print_stats(void);
+
+#endif /* vm/swap.h */
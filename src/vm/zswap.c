@@ -0,0 +1,199 @@
+#include "vm/zswap.h"
+#include <debug.h>
+#include <list.h>
+#include <lz.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/swap.h"
+
+/* Largest entry kept, header included.  Two fit in one malloc()
+   arena page, so every compressed page saves at least half. */
+#define ZSWAP_MAX_SIZE (PGSIZE / 2 - 64)
+
+/* The cache may hold compressed pages amounting to at most one
+   page of kernel memory for every ZSWAP_POOL_DIV pages of the
+   user pool. */
+#define ZSWAP_POOL_DIV 8
+
+/* A page in the cache. */
+struct zentry {
+  struct list_elem elem; /* Element in lru, if compressed. */
+  size_t slot;           /* Swap slot it belongs to. */
+  uint32_t fill;         /* Repeated word, if SIZE is 0. */
+  size_t size;           /* Bytes in DATA, or 0 if same-filled. */
+  uint8_t data[];        /* Compressed page. */
+};
+
+/* Cache state, protected by zswap_lock.  Same-filled pages cost no
+   payload, so they are kept off LRU and out of POOL_BYTES, and
+   never written back. */
+static struct lock zswap_lock;
+static struct zentry** entries;  /* Entry for each swap slot, or null. */
+static struct list lru;          /* Compressed pages, oldest first. */
+static size_t pool_bytes;        /* Bytes held by compressed pages. */
+static size_t max_pool_bytes;    /* Most bytes allowed in POOL_BYTES. */
+static void* bounce;             /* Page for decompressing write-backs. */
+static uint16_t hash_table[LZ_HASH_SIZE]; /* Compressor scratch. */
+static uint8_t buffer[ZSWAP_MAX_SIZE];    /* Compressor output. */
+
+/* Statistics. */
+static long long same_cnt;       /* Pages stored same-filled. */
+static long long compressed_cnt; /* Pages stored compressed. */
+static long long reject_cnt;     /* Pages that compressed too poorly. */
+static long long load_cnt;       /* Pages read back from the cache. */
+static long long writeback_cnt;  /* Pages written back to disk. */
+static size_t peak_bytes;        /* Most bytes in POOL_BYTES at once. */
+
+/* Sets up the cache for a swap device of SLOT_CNT slots.  Without
+   this call, zswap_store() never stores anything. */
+void zswap_init(size_t slot_cnt) {
+  uint8_t* base;
+  size_t user_pages;
+
+  lock_init_named(&zswap_lock, "zswap");
+  list_init(&lru);
+  entries = calloc(slot_cnt, sizeof *entries);
+  bounce = palloc_get_page(0);
+  if (entries == NULL || bounce == NULL)
+    PANIC("zswap_init: out of memory");
+  palloc_user_pool(&base, &user_pages);
+  max_pool_bytes = user_pages / ZSWAP_POOL_DIV * PGSIZE;
+}
+
+/* Returns true if the words of KPAGE are all the same, and then
+   stores that word in *FILL. */
+static bool same_filled(const void* kpage, uint32_t* fill) {
+  const uint32_t* w = kpage;
+  size_t i;
+
+  for (i = 1; i < PGSIZE / sizeof *w; i++)
+    if (w[i] != w[0])
+      return false;
+  *fill = w[0];
+  return true;
+}
+
+/* Removes entry E from the cache and frees it.  The caller must
+   hold zswap_lock. */
+static void remove_entry(struct zentry* e) {
+  entries[e->slot] = NULL;
+  if (e->size > 0) {
+    list_remove(&e->elem);
+    pool_bytes -= sizeof *e + e->size;
+  }
+  free(e);
+}
+
+/* Writes the oldest compressed pages back to their swap slots on
+   disk until the cache fits into its budget with NEED more bytes.
+   The caller must hold zswap_lock. */
+static void shrink(size_t need) {
+  while (pool_bytes + need > max_pool_bytes && !list_empty(&lru)) {
+    struct zentry* e = list_entry(list_front(&lru), struct zentry, elem);
+
+    if (!lz_decompress(e->data, e->size, bounce, PGSIZE))
+      PANIC("zswap: corrupt page for slot %zu", e->slot);
+    swap_write_device(e->slot, bounce);
+    writeback_cnt++;
+    remove_entry(e);
+  }
+}
+
+/* Stores the page at KPAGE as the contents of swap slot SLOT.
+   Returns false, storing nothing, if the page does not compress
+   well enough or memory is not available, in which case the
+   caller should write it to disk itself. */
+bool zswap_store(size_t slot, const void* kpage) {
+  struct zentry* e;
+  uint32_t fill = 0;
+  size_t size = 0;
+
+  if (entries == NULL)
+    return false;
+
+  lock_acquire(&zswap_lock);
+  if (entries[slot] != NULL)
+    remove_entry(entries[slot]);
+  if (!same_filled(kpage, &fill)) {
+    size = lz_compress(kpage, PGSIZE, buffer, ZSWAP_MAX_SIZE - sizeof *e, hash_table);
+    if (size == 0 || sizeof *e + size > max_pool_bytes) {
+      reject_cnt++;
+      lock_release(&zswap_lock);
+      return false;
+    }
+    shrink(sizeof *e + size);
+  }
+
+  e = malloc(sizeof *e + size);
+  if (e == NULL) {
+    lock_release(&zswap_lock);
+    return false;
+  }
+  e->slot = slot;
+  e->fill = fill;
+  e->size = size;
+  if (size > 0) {
+    memcpy(e->data, buffer, size);
+    list_push_back(&lru, &e->elem);
+    pool_bytes += sizeof *e + size;
+    if (pool_bytes > peak_bytes)
+      peak_bytes = pool_bytes;
+    compressed_cnt++;
+  } else
+    same_cnt++;
+  entries[slot] = e;
+  lock_release(&zswap_lock);
+  return true;
+}
+
+/* Reads the page stored for swap slot SLOT into KPAGE, leaving it
+   in the cache until zswap_forget().  Returns false if SLOT's page
+   is not in the cache, in which case it is on disk. */
+bool zswap_load(size_t slot, void* kpage) {
+  struct zentry* e;
+
+  if (entries == NULL)
+    return false;
+
+  lock_acquire(&zswap_lock);
+  e = entries[slot];
+  if (e != NULL) {
+    if (e->size == 0) {
+      uint32_t* w = kpage;
+      size_t i;
+
+      for (i = 0; i < PGSIZE / sizeof *w; i++)
+        w[i] = e->fill;
+    } else if (!lz_decompress(e->data, e->size, kpage, PGSIZE))
+      PANIC("zswap: corrupt page for slot %zu", slot);
+    load_cnt++;
+  }
+  lock_release(&zswap_lock);
+  return e != NULL;
+}
+
+/* Drops the page stored for swap slot SLOT, if any, because the
+   slot has been freed. */
+void zswap_forget(size_t slot) {
+  if (entries == NULL)
+    return;
+
+  lock_acquire(&zswap_lock);
+  if (entries[slot] != NULL)
+    remove_entry(entries[slot]);
+  lock_release(&zswap_lock);
+}
+
+/* Prints compressed swap cache statistics. */
+void zswap_print_stats(void) {
+  if (entries != NULL)
+    printf("Zswap: %lld compressed, %lld same-filled, %lld rejected, %lld loaded, "
+           "%lld written back, %zu of %zu bytes (peak %zu)\n",
+           compressed_cnt, same_cnt, reject_cnt, load_cnt, writeback_cnt, pool_bytes,
+           max_pool_bytes, peak_bytes);
+}
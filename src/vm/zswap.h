@@ -0,0 +1,23 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Compressed swap cache.
+
+   Sits in front of the swap device: a page written to a swap
+   slot is compressed into kernel memory, if it compresses to half
+   a page or less, instead of going to disk, and read back from
+   there.  A page whose words are all the same, such as a page of
+   zeros, is stored as just that word.  When the cache outgrows
+   its budget, its oldest pages are written to their slots on
+   disk.  See vm/swap.c, the only user. */
+
+void zswap_init(size_t slot_cnt);
+bool zswap_store(size_t slot, const void* kpage);
+bool zswap_load(size_t slot, void* kpage);
+void zswap_forget(size_t slot);
+void zswap_print_stats(void);
+
+#endif /* vm/zswap.h */